@@ -42,52 +42,28 @@
 #include "sagan.h"
 #include "aetas.h"
 #include "rules.h"
+#include "util-time.h"
 
 struct _Rule_Struct *rulestruct;
 
 int Check_Time(int rule_number)
 {
 
-    char ct[64] = { 0 };
-    char buf[80] = { 0 };
+    struct tm ts;
 
     int day_current;
-
-    time_t     now;
-    struct     tm  ts;
-
-    /* For current utime */
-
-    time_t t;
-    struct tm *now_utime;
-
+    int current_time;
 
     bool   next_day = 0;
     bool   off_day = 0;
 
-    char current_time_tmp[5];
-    char hour_tmp[3];
-    char minute_tmp[3];
-
-    int	 current_time;
-
-    /* Get current utime / and day of the week */
-
-    t = time(NULL);
-    now_utime=localtime(&t);
-    strftime(ct, sizeof(ct), "%s",  now_utime);
-    day_current = localtime(&t)->tm_wday;
-
-    time(&now);
-    ts = *localtime(&now);
-
-    strftime(hour_tmp, sizeof(buf), "%H", &ts);
-    strftime(minute_tmp, sizeof(buf), "%M", &ts);
+    /* Get the current day of the week and time of day (HHMM) from the
+       shared clock */
 
-    snprintf(current_time_tmp, sizeof(current_time_tmp), "%s%s",  hour_tmp, minute_tmp);
-    current_time = atoi(current_time_tmp);
+    Return_Local_Time(&ts);
 
-    strftime(buf, sizeof(buf), "%d", &ts);
+    day_current = ts.tm_wday;
+    current_time = ( ts.tm_hour * 100 ) + ts.tm_min;
 
     /* We check if rule extends to a new day */
 
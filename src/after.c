@@ -29,19 +29,21 @@
 #include <time.h>
 #include <stdbool.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "rules.h"
 #include "after.h"
 #include "ipc.h"
+#include "util-time.h"
 
-pthread_mutex_t After2_Mutex=PTHREAD_MUTEX_INITIALIZER;
+struct _IPC_Hash_Stripes After2_Stripes;
 
 struct _After2_IPC *After2_IPC;
 
-struct _SaganCounters *counters;
 struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
@@ -51,33 +53,32 @@ struct _Sagan_IPC_Counters *counters_ipc;
 bool After2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_dst,  uint32_t dst_port, char *username, char *syslog_message )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint32_t i;
+    uint32_t n;
+    uint32_t slots;
+    uint32_t home;
 
-    int i;
+    int found = -1;
+    int reuse = -1;
 
     uint64_t after_oldtime;
     uint64_t current_time;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
     char src_tmp[MAXIP] = { 0 };
     char dst_tmp[MAXIP] = { 0 };
     char username_tmp[MAX_USERNAME_SIZE] = { 0 };
     uint32_t dst_port_tmp = 0;
     uint32_t src_port_tmp = 0;
 
-    char hash_string[128] = { 0 };
     char debug_string[64] = { 0 };
 
     uint32_t hash;
+    uint64_t sid = rulestruct[rule_position].s_sid;
+    uint32_t rev = rulestruct[rule_position].s_rev;
 
     bool after_log_flag = true;
 
-    current_time = atol(timet);
+    current_time = Return_Epoch();
     username_tmp[0] = '\0';
 
     if ( rulestruct[rule_position].after2_method_src == true )
@@ -105,126 +106,170 @@ bool After2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_dst,
             dst_port_tmp = dst_port;
         }
 
-    snprintf(hash_string, sizeof(hash_string), "%s|%d|%s|%d|%s", src_tmp, src_port_tmp, dst_tmp, dst_port_tmp, username_tmp);
+    /* Hash the binary key fields,  including sid/rev */
+
+    hash = IPC_Hash_Bytes(IPC_HASH_SEED, &sid, sizeof(sid));
+    hash = IPC_Hash_Bytes(hash, &rev, sizeof(rev));
+    hash = IPC_Hash_IP(hash, src_tmp);
+    hash = IPC_Hash_Bytes(hash, &src_port_tmp, sizeof(src_port_tmp));
+    hash = IPC_Hash_IP(hash, dst_tmp);
+    hash = IPC_Hash_Bytes(hash, &dst_port_tmp, sizeof(dst_port_tmp));
+    hash = IPC_Hash_Bytes(hash, username_tmp, strlen(username_tmp));
+
+    slots = IPC_Hash_Slots(config->max_after2);
+    home = IPC_Hash_Home(hash, slots);
 
-    hash = Djb2_Hash( hash_string );
+    IPC_Hash_Lock(&After2_Stripes, config->shm_after2, slots, home);
 
-    for (i = 0; i < counters_ipc->after2_count; i++ )
+    for ( i = 0; i < IPC_HASH_PROBE; i++ )
         {
 
-            if ( hash == After2_IPC[i].hash && After2_IPC[i].sid == rulestruct[rule_position].s_sid &&
-                    After2_IPC[i].rev == rulestruct[rule_position].s_rev )
+            n = ( home + i ) % slots;
+
+            /* Never used slot ends the probe chain */
+
+            if ( After2_IPC[n].used == false )
                 {
 
+                    if ( reuse == -1 )
+                        {
+                            reuse = n;
+                        }
 
-                    File_Lock(config->shm_after2);
-                    pthread_mutex_lock(&After2_Mutex);
+                    break;
+                }
 
-                    After2_IPC[i].count++;
+            if ( After2_IPC[n].hash == hash &&
+                    After2_IPC[n].sid == sid &&
+                    After2_IPC[n].rev == rev &&
+                    (uint32_t)After2_IPC[n].src_port == src_port_tmp &&
+                    (uint32_t)After2_IPC[n].dst_port == dst_port_tmp &&
+                    !strcmp(After2_IPC[n].ip_src, src_tmp) &&
+                    !strcmp(After2_IPC[n].ip_dst, dst_tmp) &&
+                    !strcmp(After2_IPC[n].username, username_tmp) )
+                {
+                    found = n;
+                    break;
+                }
 
-                    after_oldtime = current_time - After2_IPC[i].utime;
+            /* Expired entries are recycled in place */
 
-                    strlcpy(After2_IPC[i].syslog_message, syslog_message, sizeof(After2_IPC[i].syslog_message));
-                    strlcpy(After2_IPC[i].signature_msg, rulestruct[rule_position].s_msg, sizeof(After2_IPC[i].signature_msg));
+            if ( reuse == -1 && (int64_t)( current_time - After2_IPC[n].utime ) >= After2_IPC[n].expire )
+                {
+                    reuse = n;
+                }
 
-                    /* Reset counter if it's expired */
+        }
 
-                    if ( after_oldtime > rulestruct[rule_position].after2_seconds || After2_IPC[i].count == 0 )
-                        {
-                            After2_IPC[i].count=1;
-                            After2_IPC[i].utime = current_time;
-                            after_log_flag = true;
-                        }
+    if ( found != -1 )
+        {
 
+            After2_IPC[found].count++;
 
-                    if ( rulestruct[rule_position].after2_count < After2_IPC[i].count )
-                        {
+            after_oldtime = current_time - After2_IPC[found].utime;
 
-                            After2_IPC[i].utime = current_time;
-                            after_log_flag = false;
+            strlcpy(After2_IPC[found].syslog_message, syslog_message, sizeof(After2_IPC[found].syslog_message));
+            strlcpy(After2_IPC[found].signature_msg, rulestruct[rule_position].s_msg, sizeof(After2_IPC[found].signature_msg));
 
-                            if ( debug->debuglimits )
-                                {
+            /* Reset counter if it's expired */
 
-                                    if ( After2_IPC[i].after2_method_src == true )
-                                        {
-                                            strlcat(debug_string, "by_src ", sizeof(debug_string));
-                                        }
+            if ( after_oldtime > rulestruct[rule_position].after2_seconds || After2_IPC[found].count == 0 )
+                {
+                    After2_IPC[found].count=1;
+                    After2_IPC[found].utime = current_time;
+                    after_log_flag = true;
+                }
 
-                                    if ( After2_IPC[i].after2_method_dst == true )
-                                        {
-                                            strlcat(debug_string, "by_dst ", sizeof(debug_string));
-                                        }
 
-                                    if ( After2_IPC[i].after2_method_username == true )
-                                        {
-                                            strlcat(debug_string, "by_username ", sizeof(debug_string));
-                                        }
+            if ( rulestruct[rule_position].after2_count < After2_IPC[found].count )
+                {
 
-                                    if ( After2_IPC[i].after2_method_srcport == true )
-                                        {
-                                            strlcat(debug_string, "by_srcport ", sizeof(debug_string));
-                                        }
+                    After2_IPC[found].utime = current_time;
+                    after_log_flag = false;
 
-                                    if ( After2_IPC[i].after2_method_dstport == true )
-                                        {
-                                            strlcat(debug_string, "by_dstport ", sizeof(debug_string));
-                                        }
+                    if ( debug->debuglimits )
+                        {
 
-                                    Sagan_Log(NORMAL, "After SID %" PRIu64 ". Tracking by %s[%d: Hash: %lu]", After2_IPC[i].sid, debug_string, i, hash);
+                            if ( After2_IPC[found].after2_method_src == true )
+                                {
+                                    strlcat(debug_string, "by_src ", sizeof(debug_string));
+                                }
 
+                            if ( After2_IPC[found].after2_method_dst == true )
+                                {
+                                    strlcat(debug_string, "by_dst ", sizeof(debug_string));
                                 }
 
-                            counters->after_total++;
-                        }
+                            if ( After2_IPC[found].after2_method_username == true )
+                                {
+                                    strlcat(debug_string, "by_username ", sizeof(debug_string));
+                                }
 
-                    pthread_mutex_unlock(&After2_Mutex);
-                    File_Unlock(config->shm_after2);
+                            if ( After2_IPC[found].after2_method_srcport == true )
+                                {
+                                    strlcat(debug_string, "by_srcport ", sizeof(debug_string));
+                                }
+
+                            if ( After2_IPC[found].after2_method_dstport == true )
+                                {
+                                    strlcat(debug_string, "by_dstport ", sizeof(debug_string));
+                                }
 
-                    return(after_log_flag);
+                            Sagan_Log(NORMAL, "After SID %" PRIu64 ". Tracking by %s[%d: Hash: %" PRIu32 "]", After2_IPC[found].sid, debug_string, found, hash);
+
+                        }
+
+                    Sagan_Counter_Add(after_total, 1);
                 }
 
+            IPC_Hash_Unlock(&After2_Stripes, config->shm_after2, slots, home);
+
+            return(after_log_flag);
         }
 
 
-    /* If not found add it to the array */
+    /* If not found add it to the table */
 
-    if ( Clean_IPC_Object(AFTER2) == 0 )
+    if ( reuse == -1 )
         {
+            IPC_Hash_Unlock(&After2_Stripes, config->shm_after2, slots, home);
+            Sagan_Log(WARN, "[%s, line %d] No free after slot for SID %" PRIu64 ".  Consider raising sagan-core|mmap-ipc 'after' (currently %d).", __FILE__, __LINE__, sid, config->max_after2);
+            return(true);
+        }
 
-            File_Lock(config->shm_after2);
-            pthread_mutex_lock(&After2_Mutex);
-
-            After2_IPC[counters_ipc->after2_count].hash = hash;
+    if ( After2_IPC[reuse].used == false )
+        {
+            After2_IPC[reuse].used = true;
+            __atomic_add_fetch(&counters_ipc->after2_count, 1, __ATOMIC_SEQ_CST);
+        }
 
-            After2_IPC[counters_ipc->after2_count].count = 1;
-            After2_IPC[counters_ipc->after2_count].utime = current_time;
-            After2_IPC[counters_ipc->after2_count].expire = rulestruct[rule_position].after2_seconds;
-            After2_IPC[counters_ipc->after2_count].sid = rulestruct[rule_position].s_sid;
-            After2_IPC[counters_ipc->after2_count].rev = rulestruct[rule_position].s_rev;
-            After2_IPC[counters_ipc->after2_count].target_count =rulestruct[rule_position].after2_count;
+    After2_IPC[reuse].hash = hash;
 
-            After2_IPC[counters_ipc->after2_count].after2_method_src = rulestruct[rule_position].after2_method_src;
-            After2_IPC[counters_ipc->after2_count].after2_method_dst = rulestruct[rule_position].after2_method_dst;
-            After2_IPC[counters_ipc->after2_count].after2_method_username = rulestruct[rule_position].after2_method_username;
+    After2_IPC[reuse].count = 1;
+    After2_IPC[reuse].utime = current_time;
+    After2_IPC[reuse].expire = rulestruct[rule_position].after2_seconds;
+    After2_IPC[reuse].sid = sid;
+    After2_IPC[reuse].rev = rev;
+    After2_IPC[reuse].target_count =rulestruct[rule_position].after2_count;
 
-            strlcpy(After2_IPC[counters_ipc->after2_count].ip_src, src_tmp, sizeof(After2_IPC[counters_ipc->after2_count].ip_src));
-            After2_IPC[counters_ipc->after2_count].src_port = src_port_tmp;
+    After2_IPC[reuse].after2_method_src = rulestruct[rule_position].after2_method_src;
+    After2_IPC[reuse].after2_method_dst = rulestruct[rule_position].after2_method_dst;
+    After2_IPC[reuse].after2_method_username = rulestruct[rule_position].after2_method_username;
+    After2_IPC[reuse].after2_method_srcport = rulestruct[rule_position].after2_method_srcport;
+    After2_IPC[reuse].after2_method_dstport = rulestruct[rule_position].after2_method_dstport;
 
-            strlcpy(After2_IPC[counters_ipc->after2_count].ip_dst, dst_tmp, sizeof(After2_IPC[counters_ipc->after2_count].ip_dst));
-            After2_IPC[counters_ipc->after2_count].dst_port = dst_port_tmp;
+    strlcpy(After2_IPC[reuse].ip_src, src_tmp, sizeof(After2_IPC[reuse].ip_src));
+    After2_IPC[reuse].src_port = src_port_tmp;
 
-            strlcpy(After2_IPC[counters_ipc->after2_count].username, username_tmp, sizeof(After2_IPC[counters_ipc->after2_count].username));
+    strlcpy(After2_IPC[reuse].ip_dst, dst_tmp, sizeof(After2_IPC[reuse].ip_dst));
+    After2_IPC[reuse].dst_port = dst_port_tmp;
 
-            strlcpy(After2_IPC[counters_ipc->after2_count].syslog_message, syslog_message, sizeof(After2_IPC[counters_ipc->after2_count].syslog_message));
-            strlcpy(After2_IPC[counters_ipc->after2_count].signature_msg, rulestruct[rule_position].s_msg, sizeof(After2_IPC[counters_ipc->after2_count].signature_msg));
+    strlcpy(After2_IPC[reuse].username, username_tmp, sizeof(After2_IPC[reuse].username));
 
-            counters_ipc->after2_count++;
+    strlcpy(After2_IPC[reuse].syslog_message, syslog_message, sizeof(After2_IPC[reuse].syslog_message));
+    strlcpy(After2_IPC[reuse].signature_msg, rulestruct[rule_position].s_msg, sizeof(After2_IPC[reuse].signature_msg));
 
-            pthread_mutex_unlock(&After2_Mutex);
-            File_Unlock(config->shm_after2);
-        }
+    IPC_Hash_Unlock(&After2_Stripes, config->shm_after2, slots, home);
 
     return(true);
 }
-
@@ -48,6 +48,7 @@
 #include "protocol-map.h"
 #include "references.h"
 #include "parsers/parsers.h"
+#include "util-radix.h"
 
 /* Processors */
 
@@ -67,7 +68,7 @@
 #include "processors/bluedot.h"
 
 bool bluedot_load;
-struct _Sagan_Bluedot_Skip *Bluedot_Skip;
+struct _Sagan_Radix *Bluedot_Skip;
 
 #endif
 
@@ -83,7 +84,7 @@ int liblognorm_count;
 #ifdef HAVE_LIBMAXMINDDB
 #include "geoip.h"
 
-struct _Sagan_GeoIP_Skip *GeoIP_Skip;
+struct _Sagan_Radix *GeoIP_Skip;
 
 #endif
 
@@ -136,6 +137,8 @@ void Load_YAML_Config( char *yaml_file )
     char *geoip_tmpmask = NULL;
     int  geoip_mask = 0;
 
+    struct _Sagan_Radix *geoip_skip = NULL;
+
 #endif
 
 
@@ -151,6 +154,8 @@ void Load_YAML_Config( char *yaml_file )
     char *bluedot_tmpmask = NULL;
     int  bluedot_mask = 0;
 
+    struct _Sagan_Radix *bluedot_skip = NULL;
+
 #endif
 
     char *lf1 = NULL;
@@ -240,6 +245,16 @@ void Load_YAML_Config( char *yaml_file )
 
             config->max_batch = DEFAULT_SYSLOG_BATCH;
 
+            /* When reading a file,  there's no reason to drop logs */
+
+            config->ring_block = config->sagan_is_file;
+
+            config->output_queue_size = DEFAULT_OUTPUT_QUEUE_SIZE;
+            config->output_block = true;
+
+            config->output_buffer_size = DEFAULT_OUTPUT_BUFFER_SIZE;
+            config->output_flush_time = DEFAULT_OUTPUT_FLUSH_TIME;
+
             config->pp_sagan_track_clients = TRACK_TIME;
 
             config->sagan_proto = 17;           /* Default to UDP */
@@ -289,6 +304,11 @@ void Load_YAML_Config( char *yaml_file )
             config->bluedot_filename_queue = BLUEDOT_FILENAME_QUEUE_DEFAULT;
             config->bluedot_ja3_queue = BLUEDOT_JA3_QUEUE_DEFAULT;
 
+            config->bluedot_max_connections = BLUEDOT_MAX_CONNECTIONS_DEFAULT;
+            config->bluedot_lookup_timeout = BLUEDOT_LOOKUP_TIMEOUT_DEFAULT;
+            config->bluedot_max_deferred = BLUEDOT_MAX_DEFERRED_DEFAULT;
+            config->bluedot_miss = BLUEDOT_MISS_DEFER;
+
 #endif
 
 #ifdef WITH_SYSLOG
@@ -763,13 +783,13 @@ void Load_YAML_Config( char *yaml_file )
 #ifdef HAVE_LIBFASTJSON
 
 
-                                    else if (!strcmp(last_pass, "json-map" ) && config->input_type == INPUT_JSON )
+                                    else if (!strcmp(last_pass, "json-map" ) )
                                         {
                                             Var_To_Value(value, tmp, sizeof(tmp));
                                             strlcpy(config->json_input_map_file, tmp, sizeof(config->json_input_map_file));
                                         }
 
-                                    else if (!strcmp(last_pass, "json-software" ) && config->input_type == INPUT_JSON )
+                                    else if (!strcmp(last_pass, "json-software" ) )
                                         {
                                             strlcpy(config->json_input_software, value, sizeof(config->json_input_software));
                                         }
@@ -777,6 +797,23 @@ void Load_YAML_Config( char *yaml_file )
 
 #endif
 
+                                    else if (!strcmp(last_pass, "input-sources"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            strlcpy(config->input_sources, tmp, sizeof(config->input_sources));
+                                        }
+
+                                    else if (!strcmp(last_pass, "input-udp-threads"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->input_udp_threads = atoi(tmp);
+
+                                            if ( config->input_udp_threads < 0 || config->input_udp_threads > 64 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'input-udp-threads' must be between 0 and 64. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
                                     else if (!strcmp(last_pass, "default-proto"))
                                         {
 
@@ -915,6 +952,164 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    else if (!strcmp(last_pass, "ring-size"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            config->ring_size = atoi(tmp);
+
+                                            if ( config->ring_size < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'ring-size' is invalid. Abort!", __FILE__, __LINE__);
+                                                }
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "back-pressure"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if ( !strcmp(tmp, "block") )
+                                                {
+                                                    config->ring_block = true;
+                                                }
+
+                                            else if ( !strcmp(tmp, "drop") )
+                                                {
+                                                    config->ring_block = false;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'back-pressure' is set to an invalid type '%s'. It must be 'block' or 'drop'. Abort!", __FILE__, __LINE__, tmp);
+                                                }
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "output-threads"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            /* The output threads and queue are started once.  A
+                                               reload (SIGHUP) keeps them */
+
+                                            if ( config->sagan_reload == false )
+                                                {
+
+                                                    config->output_threads = atoi(tmp);
+
+                                                    if ( config->output_threads < 0 )
+                                                        {
+                                                            Sagan_Log(ERROR, "[%s, line %d] sagan:core 'output-threads' is invalid. Abort!", __FILE__, __LINE__);
+                                                        }
+
+                                                    config->output_thread_flag = config->output_threads > 0 ? true : false;
+                                                }
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "output-queue-size"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if ( config->sagan_reload == false )
+                                                {
+
+                                                    config->output_queue_size = atoi(tmp);
+
+                                                    if ( config->output_queue_size <= 0 )
+                                                        {
+                                                            Sagan_Log(ERROR, "[%s, line %d] sagan:core 'output-queue-size' is zero/invalid. Abort!", __FILE__, __LINE__);
+                                                        }
+                                                }
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "output-back-pressure"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if ( !strcmp(tmp, "block") )
+                                                {
+                                                    config->output_block = true;
+                                                }
+
+                                            else if ( !strcmp(tmp, "drop") )
+                                                {
+                                                    config->output_block = false;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'output-back-pressure' is set to an invalid type '%s'. It must be 'block' or 'drop'. Abort!", __FILE__, __LINE__, tmp);
+                                                }
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "output-buffer-size"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            config->output_buffer_size = atoi(tmp);
+
+                                            if ( config->output_buffer_size < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'output-buffer-size' is invalid. Abort!", __FILE__, __LINE__);
+                                                }
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "output-flush-time"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            config->output_flush_time = atoi(tmp);
+
+                                            if ( config->output_flush_time < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'output-flush-time' is invalid. Abort!", __FILE__, __LINE__);
+                                                }
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "output-sync"))
+                                        {
+
+                                            if (!strcasecmp(value, "enabled") || !strcasecmp(value, "true" ) || !strcasecmp(value, "yes") )
+                                                {
+                                                    config->output_sync = true;
+                                                }
+                                            else
+                                                {
+                                                    config->output_sync = false;
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "pcre-match-limit"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->pcre_match_limit = strtoul(tmp, NULL, 10);
+                                        }
+
+                                    else if (!strcmp(last_pass, "pcre-depth-limit"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->pcre_depth_limit = strtoul(tmp, NULL, 10);
+                                        }
+
+                                    else if (!strcmp(last_pass, "pcre-timing"))
+                                        {
+
+                                            if (!strcasecmp(value, "enabled") || !strcasecmp(value, "true" ) || !strcasecmp(value, "yes") )
+                                                {
+                                                    config->pcre_timing = true;
+                                                }
+                                            else
+                                                {
+                                                    config->pcre_timing = false;
+                                                }
+                                        }
+
                                     else if (!strcmp(last_pass, "xbit-storage"))
                                         {
 
@@ -1174,6 +1369,8 @@ void Load_YAML_Config( char *yaml_file )
                                             Var_To_Value(value, tmp, sizeof(tmp));
                                             Remove_Spaces(tmp);
 
+                                            geoip_skip = Sagan_Radix_Init();
+
                                             maxmind_ptr = strtok_r(tmp, ",", &tok);
 
                                             while( maxmind_ptr != NULL )
@@ -1193,37 +1390,32 @@ void Load_YAML_Config( char *yaml_file )
 
                                                     geoip_tmpmask = strtok_r(NULL, "/", &geo_tok);
 
+                                                    /* No mask means a single host */
+
                                                     if ( geoip_tmpmask == NULL )
                                                         {
-                                                            geoip_mask = 32;
+                                                            geoip_mask = strchr(geoip_iprange, ':') != NULL ? 128 : 32;
                                                         }
-
-                                                    GeoIP_Skip = (_Sagan_GeoIP_Skip *) realloc(GeoIP_Skip, (counters->geoip_skip_count+1) * sizeof(_Sagan_GeoIP_Skip));
-
-                                                    if ( GeoIP_Skip == NULL )
+                                                    else
                                                         {
-                                                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for GeoIP_Skip Abort!", __FILE__, __LINE__);
+                                                            geoip_mask = atoi(geoip_tmpmask);
                                                         }
 
-                                                    memset(&GeoIP_Skip[counters->geoip_skip_count], 0, sizeof(_Sagan_GeoIP_Skip));
-
-                                                    geoip_mask = atoi(geoip_tmpmask);
-
                                                     if ( geoip_mask == 0 || !Mask2Bit(geoip_mask, geoip_maskbits))
                                                         {
                                                             Sagan_Log(ERROR, "[%s, line %d] Invalid mask for GeoIP 'skip_networks'. Abort", __FILE__, __LINE__);
                                                         }
 
 
-                                                    memcpy(GeoIP_Skip[counters->geoip_skip_count].range.ipbits, geoip_ipbits, sizeof(geoip_ipbits));
-                                                    memcpy(GeoIP_Skip[counters->geoip_skip_count].range.maskbits, geoip_maskbits, sizeof(geoip_maskbits));
-
-                                                    __atomic_add_fetch(&counters->geoip_skip_count, 1, __ATOMIC_SEQ_CST);
+                                                    (void)Sagan_Radix_Add(geoip_skip, geoip_ipbits, geoip_mask);
 
                                                     maxmind_ptr = strtok_r(NULL, ",", &tok);
 
                                                 }
 
+                                            __atomic_store_n(&counters->geoip_skip_count, geoip_skip->count, __ATOMIC_SEQ_CST);
+                                            Sagan_Radix_Swap(&GeoIP_Skip, geoip_skip);
+
                                         }
 
                                 } /* if sub_type == YAML_SAGAN_CORE_GEOIP */
@@ -1339,6 +1531,15 @@ void Load_YAML_Config( char *yaml_file )
 
                                                 }
 
+                                            else if (!strcmp(last_pass, "direct"))
+                                                {
+
+                                                    if ( !strcasecmp(value, "yes") || !strcasecmp(value, "true") )
+                                                        {
+                                                            config->plog_direct = true;
+                                                        }
+                                                }
+
                                             else if (!strcmp(last_pass, "promiscuous"))
                                                 {
 
@@ -1785,12 +1986,67 @@ void Load_YAML_Config( char *yaml_file )
                                             config->bluedot_dns_ttl = atoi(tmp);
                                         }
 
+                                    else if (!strcmp(last_pass, "max-connections") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_max_connections = atoi(tmp);
+
+                                            if ( config->bluedot_max_connections <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'max-connections' has to be a non-zero value. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "lookup-timeout") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_lookup_timeout = atoi(tmp);
+
+                                            if ( config->bluedot_lookup_timeout <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'lookup-timeout' has to be a non-zero value. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "max-deferred") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_max_deferred = atoi(tmp);
+
+                                            if ( config->bluedot_max_deferred < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'max-deferred' is invalid. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "on-miss") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if (!strcasecmp(tmp, "defer"))
+                                                {
+                                                    config->bluedot_miss = BLUEDOT_MISS_DEFER;
+                                                }
+
+                                            else if (!strcasecmp(tmp, "fail-open"))
+                                                {
+                                                    config->bluedot_miss = BLUEDOT_MISS_FAIL_OPEN;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'on-miss' must be 'defer' or 'fail-open'. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
                                     if (!strcmp(last_pass, "skip_networks") && config->bluedot_flag == true )
                                         {
 
                                             Var_To_Value(value, tmp, sizeof(tmp));
                                             Remove_Spaces(tmp);
 
+                                            bluedot_skip = Sagan_Radix_Init();
+
                                             bluedot_ptr = strtok_r(tmp, ",", &tok);
 
                                             while ( bluedot_ptr != NULL )
@@ -1810,36 +2066,31 @@ void Load_YAML_Config( char *yaml_file )
 
                                                     bluedot_tmpmask = strtok_r(NULL, "/", &bluedot_tok);
 
+                                                    /* No mask means a single host */
+
                                                     if ( bluedot_tmpmask == NULL )
                                                         {
-                                                            bluedot_mask = 32;
+                                                            bluedot_mask = strchr(bluedot_iprange, ':') != NULL ? 128 : 32;
                                                         }
-
-                                                    Bluedot_Skip = (_Sagan_Bluedot_Skip *) realloc(Bluedot_Skip, (counters->bluedot_skip_count+1) * sizeof(_Sagan_Bluedot_Skip));
-
-                                                    if ( Bluedot_Skip == NULL )
+                                                    else
                                                         {
-                                                            Sagan_Log(ERROR, "[%s, line %d] processor: 'bluedot' - Failed to reallocate memory for Bluedot_Skip Abort!", __FILE__, __LINE__);
+                                                            bluedot_mask = atoi(bluedot_tmpmask);
                                                         }
 
-                                                    memset(&Bluedot_Skip[counters->bluedot_skip_count], 0, sizeof(_Sagan_Bluedot_Skip));
-
-                                                    bluedot_mask = atoi(bluedot_tmpmask);
-
                                                     if ( bluedot_mask == 0 || !Mask2Bit(bluedot_mask, bluedot_maskbits))
                                                         {
                                                             Sagan_Log(ERROR, "[%s, line %d] processor: 'bluedot' - Invalid mask for 'skip_networks'. Abort", __FILE__, __LINE__);
                                                         }
 
-                                                    memcpy(Bluedot_Skip[counters->bluedot_skip_count].range.ipbits, bluedot_ipbits, sizeof(bluedot_ipbits));
-                                                    memcpy(Bluedot_Skip[counters->bluedot_skip_count].range.maskbits, bluedot_maskbits, sizeof(bluedot_maskbits));
-
-                                                    __atomic_add_fetch(&counters->bluedot_skip_count, 1, __ATOMIC_SEQ_CST);
+                                                    (void)Sagan_Radix_Add(bluedot_skip, bluedot_ipbits, bluedot_mask);
 
                                                     bluedot_ptr = strtok_r(NULL, ",", &tok);
 
                                                 }
 
+                                            __atomic_store_n(&counters->bluedot_skip_count, bluedot_skip->count, __ATOMIC_SEQ_CST);
+                                            Sagan_Radix_Swap(&Bluedot_Skip, bluedot_skip);
+
                                         }
 
                                 } /* if sub_type == YAML_PROCESSORS_BLUEDOT */
@@ -1866,6 +2117,14 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    else if (!strcmp(last_pass, "cache") && config->brointel_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            strlcpy(config->brointel_cache, tmp, sizeof(config->brointel_cache));
+
+                                        }
+
                                 } /* if sub_type == YAML_PROCESSORS_BROINTEL */
 
                             else if ( sub_type == YAML_PROCESSORS_DYNAMIC_LOAD )
@@ -2717,6 +2976,10 @@ void Load_YAML_Config( char *yaml_file )
                 }
         }
 
+    /* Build the rule prefilter index now that all rules are loaded */
+
+    Rule_Index_Build();
+
 
     if ( config->sagan_is_file == false && config->sagan_fifo[0] == '\0' )
         {
@@ -2806,7 +3069,7 @@ void Load_YAML_Config( char *yaml_file )
 
 #ifdef HAVE_LIBFASTJSON
 
-    if ( config->input_type == INPUT_JSON )
+    if ( config->input_type == INPUT_JSON || strcasestr(config->input_sources, "#json") != NULL )
         {
 
             Load_Input_JSON_Map( config->json_input_map_file );
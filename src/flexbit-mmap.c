@@ -30,1465 +30,828 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <time.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
 #include <sys/mman.h>
+#include <arpa/inet.h>
 
-#include "sagan.h"
-#include "sagan-defs.h"
-#include "ipc.h"
-#include "flexbit-mmap.h"
-#include "rules.h"
-#include "sagan-config.h"
-#include "parsers/parsers.h"
-
-struct _SaganCounters *counters;
-struct _Rule_Struct *rulestruct;
-struct _SaganDebug *debug;
-struct _SaganConfig *config;
-
-pthread_mutex_t Flexbit_Mutex=PTHREAD_MUTEX_INITIALIZER;
-
-struct _Sagan_IPC_Counters *counters_ipc;
-struct _Sagan_IPC_Flexbit *flexbit_ipc;
-
-/*****************************************************************************
- * Flexbit_Condition - Used for testing "isset" & "isnotset".  Full
- * rule condition is tested here and returned.
- *****************************************************************************/
-
-bool Flexbit_Condition_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port )
-{
-
-    time_t t;
-    struct tm *now;
-    char  timet[20];
-
-    int i;
-    int a;
-
-    int flexbit_total_match = 0;
-    bool flexbit_match = 0;
-
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
-    Flexbit_Cleanup_MMAP();
-
-    for (i = 0; i < rulestruct[rule_position].flexbit_count; i++)
-        {
-
-            /*******************
-             *      ISSET      *
-             *******************/
-
-            if ( rulestruct[rule_position].flexbit_type[i] == 3 )
-                {
-
-
-                    if ( debug->debugflexbit )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Condition \"isset\" found in rule.", __FILE__, __LINE__);
-                        }
-
-
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-
-                            if ( !memcmp(rulestruct[rule_position].flexbit_name[i], flexbit_ipc[a].flexbit_name, sizeof(rulestruct[rule_position].flexbit_name[i])) &&
-                                    flexbit_ipc[a].flexbit_state == true )
-                                {
-
-                                    /* direction: by_src - most common check */
-
-                                    if ( rulestruct[rule_position].flexbit_direction[i] == 2 &&
-                                            !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"by_src\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, flexbit_ipc[a].ip_src);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: none */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 0 )
-
-                                        {
-
-                                            if ( debug->debugflexbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"none\"). (any -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: both */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 1 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"both\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: by_dst */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 3 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"by_dst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: reverse */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 4 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
-
-                                        {
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"reverse\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: src_xbitdst */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 5 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"src_xbitdst\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: dst_xbitsrc */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 6 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"dst_xbitsrc\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: both_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 7 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].src_port == src_port &&
-                                              flexbit_ipc[a].dst_port == dst_port )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"both_p\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: by_src_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 8 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == src_port )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"by_src_p\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: by_dst_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 9 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst))  &&
-                                              flexbit_ipc[a].dst_port == dst_port )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"by_dst_p\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: reverse_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 10 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].src_port == dst_port &&
-                                              flexbit_ipc[a].dst_port == src_port )
-
-
-                                        {
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"reverse_p\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: src_xbitdst_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 11 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].dst_port == src_port )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"src_xbitdst_p\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                    /* direction: dst_xbitsrc_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 12 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == dst_port )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isset\" flexbit \"%s\" (direction: \"dst_xbitsrc_p\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            flexbit_total_match++;
-
-                                        }
-
-                                } /* End of strcmp flexbit_name & flexbit_state = 1 */
-
-                        } /* End of "for a" */
-
-                } /* End "if" flexbit_type == 3 (ISSET) */
-
-            /*******************
-            *    ISNOTSET     *
-            *******************/
-
-            if ( rulestruct[rule_position].flexbit_type[i] == 4 )
-                {
-
-
-                    if ( debug->debugflexbit )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Condition \"isnotset\" found in rule.", __FILE__, __LINE__);
-                        }
-
-                    flexbit_match = false;
-
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-                            if ( !memcmp(rulestruct[rule_position].flexbit_name[i], flexbit_ipc[a].flexbit_name, sizeof(rulestruct[rule_position].flexbit_name[i])) )
-                                {
-
-                                    /* direction: none */
-
-                                    if ( rulestruct[rule_position].flexbit_direction[i] == 0 )
-                                        {
-
-                                            if ( flexbit_ipc[a].flexbit_state == true )
-                                                {
-                                                    if ( debug->debugflexbit )
-                                                        {
-                                                            Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"none\"). (any -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
-
-                                                        }
-
-                                                    flexbit_match = true;
-                                                }
-                                        }
-
-                                    /* direction: both */
-
-                                    if ( rulestruct[rule_position].flexbit_direction[i] == 1 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_src\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direction: by_src */
-
-                                    if ( rulestruct[rule_position].flexbit_direction[i] == 2 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_src\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direction: by_dst */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 3 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_dst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direction: reverse */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 4 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"reverse\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direciton: src_xbitdst */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 5 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"src_xbitdst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direction: dst_xbitsrc */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 6 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"src_xbitdst\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direction: both_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 7 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                                    flexbit_ipc[a].src_port == src_port &&
-                                                    flexbit_ipc[a].dst_port == dst_port )
-
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"src_xbitdst\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direction: by_src_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 8 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    flexbit_ipc[a].src_port == src_port )
-
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_src_p\"). (%s:%d -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, src_port);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direction: by_dst_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 9 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                                    flexbit_ipc[a].dst_port == dst_port )
-
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"by_dst_p\"). (any -> %s:%d)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, dst_port);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direction: reverse_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 10 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                                    flexbit_ipc[a].src_port == dst_port &&
-                                                    flexbit_ipc[a].dst_port == src_port)
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"reverse_p\"). (%s:%d -> %s:%d)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, dst_port, ip_dst, src_port);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
-
-                                    /* direction: src_xbitdst_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 11 )
-                                        {
-
-                                            if ( !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                                    flexbit_ipc[a].dst_port == src_port )
-
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"src_xbitdst_p\"). (any -> %s:%d)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, src_port);
-
-                                                                }
-
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 
-                                    /* direction: dst_xbitsrc_p */
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "ipc.h"
+#include "util-time.h"
+#include "flexbit-mmap.h"
+#include "rules.h"
+#include "sagan-config.h"
+#include "parsers/parsers.h"
 
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 12 )
-                                        {
+struct _SaganCounters *counters;
+struct _Rule_Struct *rulestruct;
+struct _SaganDebug *debug;
+struct _SaganConfig *config;
 
+pthread_mutex_t Flexbit_Mutex=PTHREAD_MUTEX_INITIALIZER;
 
-                                            if ( !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                                    flexbit_ipc[a].src_port == dst_port )
-                                                {
-                                                    if ( flexbit_ipc[a].flexbit_state == true )
-                                                        {
-                                                            if ( debug->debugflexbit )
-                                                                {
-                                                                    Sagan_Log(DEBUG, "[%s, line %d] \"isnotset\" flexbit \"%s\" true (direction: \"dst_xbitsrc_p\"). (%s:%d-> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, dst_port);
+struct _Sagan_IPC_Counters *counters_ipc;
+struct _Sagan_IPC_Flexbit *flexbit_ipc;
+struct _Sagan_IPC_Flexbit_Index *flexbit_index;
 
-                                                                }
+/* What a rule direction looks up.  NULL IPs and -1 ports are "any" */
 
-                                                            flexbit_match = true;
-                                                        }
-                                                }
-                                        }
+typedef struct _Flexbit_MMAP_Key _Flexbit_MMAP_Key;
+struct _Flexbit_MMAP_Key
+{
+    const char *name;
+    uint32_t name_hash;
+    int chain;
+    uint32_t bucket;
+    const unsigned char *ip_src;
+    const unsigned char *ip_dst;
+    int src_port;
+    int dst_port;
+};
+
+static const char *flexbit_direction_name[] = { "none", "both", "by_src", "by_dst", "reverse",
+                                                "src_xbitdst", "dst_xbitsrc", "both_p", "by_src_p",
+                                                "by_dst_p", "reverse_p", "src_xbitdst_p", "dst_xbitsrc_p"
+                                              };
 
-                                } /* if memcmp(rulestruct[rule_position].xbit_name[i] */
-                        } /* for a = 0 */
+/*****************************************************************************
+ * Flexbit_MMAP_Lock/Unlock - Flexbits are shared with other Sagan processes
+ *****************************************************************************/
 
-                    /* flexbit wasn't found for isnotset */
+static void Flexbit_MMAP_Lock( void )
+{
+    pthread_mutex_lock(&Flexbit_Mutex);
+    File_Lock(config->shm_flexbit);
+}
 
-                    if ( flexbit_match == false )
-                        {
-                            flexbit_total_match++;
-                        }
+static void Flexbit_MMAP_Unlock( void )
+{
+    File_Unlock(config->shm_flexbit);
+    pthread_mutex_unlock(&Flexbit_Mutex);
+}
 
-                } /* rulestruct[rule_position].flexbit_type[i] == 4 */
+/*****************************************************************************
+ * Flexbit_MMAP_IP - Binary form of an IP.  Anything that isn't an IP is
+ * stored as all zeros.
+ *****************************************************************************/
 
-        } /* for (i = 0; i < rulestruct[rule_position].xbit_count; i++) */
+static void Flexbit_MMAP_IP( const char *ip, unsigned char *bits )
+{
 
+    memset(bits, 0, MAXIPBIT);
 
-    if ( flexbit_total_match == rulestruct[rule_position].flexbit_condition_count )
+    if ( ip == NULL )
         {
+            return;
+        }
 
-            if ( debug->debugflexbit )
+    if ( inet_pton(AF_INET, ip, bits) != 1 )
+        {
+            if ( inet_pton(AF_INET6, ip, bits) != 1 )
                 {
-                    Sagan_Log(DEBUG, "[%s, line %d] Got %d flexbits & needed %d. Got corrent number of flexbits, return true!", __FILE__, __LINE__, flexbit_total_match, rulestruct[rule_position].flexbit_condition_count );
+                    memset(bits, 0, MAXIPBIT);
                 }
-
-            return(true);
-
         }
-    else
-        {
+}
 
-            if ( debug->debugflexbit )
-                {
-                    Sagan_Log(DEBUG, "[%s, line %d] Got %d flexbits, needed %d", __FILE__, __LINE__, flexbit_total_match, rulestruct[rule_position].flexbit_condition_count );
-                }
+/*****************************************************************************
+ * Flexbit_MMAP_Bucket - Bucket of a name/IP combination in one chain.
+ *****************************************************************************/
 
-            return(false);
+static uint32_t Flexbit_MMAP_Bucket( uint32_t name_hash, const unsigned char *ip_src, const unsigned char *ip_dst )
+{
 
-        }
+    uint32_t hash = name_hash;
 
-    Sagan_Log(WARN, "Shouldn't make it this far in Xbit_Condition()!\n");
+    if ( ip_src != NULL )
+        {
+            hash = IPC_Hash_Bytes(hash, ip_src, MAXIPBIT);
+        }
 
-}  /* End of Xbit_Condition(); */
+    if ( ip_dst != NULL )
+        {
+            hash = IPC_Hash_Bytes(hash, ip_dst, MAXIPBIT);
+        }
 
+    return( hash & ( flexbit_index->buckets - 1 ) );
+}
 
 /*****************************************************************************
- * Flexbit_Count - Used to determine how many flexbits have been set based on a
- * source or destination address.  This is useful for identification of
- * distributed attacks.
+ * Flexbit_MMAP_Entry_Bucket - Bucket an entry is linked in for a chain.
  *****************************************************************************/
 
-bool Flexbit_Count_MMAP( int rule_position, char *ip_src, char *ip_dst )
+static uint32_t Flexbit_MMAP_Entry_Bucket( struct _Sagan_IPC_Flexbit *flexbit, int chain )
 {
 
-    uint32_t a = 0;
-    uint32_t i = 0;
-    uint32_t counter = 0;
-
-    for (i = 0; i < rulestruct[rule_position].flexbit_count_count; i++)
+    switch ( chain )
         {
 
-            for (a = 0; a < counters_ipc->flexbit_count; a++)
-                {
-
-                    if ( rulestruct[rule_position].flexbit_direction[i] == 2 &&
-                            !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) )
-                        {
+        case FLEXBIT_INDEX_SRC:
+            return(Flexbit_MMAP_Bucket(flexbit->flexbit_name_hash, flexbit->ip_src, NULL));
 
-                            counter++;
+        case FLEXBIT_INDEX_DST:
+            return(Flexbit_MMAP_Bucket(flexbit->flexbit_name_hash, NULL, flexbit->ip_dst));
 
-                            if ( rulestruct[rule_position].flexbit_count_gt_lt[i] == 0 )
-                                {
+        case FLEXBIT_INDEX_BOTH:
+            return(Flexbit_MMAP_Bucket(flexbit->flexbit_name_hash, flexbit->ip_src, flexbit->ip_dst));
 
-                                    if ( counter > rulestruct[rule_position].flexbit_count_counter[i] )
-                                        {
+        }
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit count 'by_src' threshold reached for flexbit '%s'.", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
-                                                }
+    return(Flexbit_MMAP_Bucket(flexbit->flexbit_name_hash, NULL, NULL));
+}
 
+/*****************************************************************************
+ * Flexbit_MMAP_Key - Turns a rule direction into an index lookup.
+ *****************************************************************************/
 
-                                            return(true);
-                                        }
-                                }
-                        }
+static void Flexbit_MMAP_Key( struct _Flexbit_MMAP_Key *key, const char *name, int direction, const unsigned char *ip_src, const unsigned char *ip_dst, int src_port, int dst_port )
+{
 
-                    else if ( rulestruct[rule_position].flexbit_direction[i] == 3 &&
-                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                        {
+    key->name = name;
+    key->name_hash = IPC_Hash_Bytes(IPC_HASH_SEED, name, strlen(name));
+    key->chain = FLEXBIT_INDEX_NAME;
+    key->ip_src = NULL;
+    key->ip_dst = NULL;
+    key->src_port = -1;
+    key->dst_port = -1;
 
-                            counter++;
+    switch ( direction )
+        {
 
-                            if ( rulestruct[rule_position].flexbit_count_gt_lt[i] == 0 )
-                                {
+        case 1:		/* both */
+            key->ip_src = ip_src;
+            key->ip_dst = ip_dst;
+            break;
+
+        case 2:		/* by_src */
+            key->ip_src = ip_src;
+            break;
+
+        case 3:		/* by_dst */
+            key->ip_dst = ip_dst;
+            break;
+
+        case 4:		/* reverse */
+            key->ip_src = ip_dst;
+            key->ip_dst = ip_src;
+            break;
+
+        case 5:		/* src_xbitdst */
+            key->ip_dst = ip_src;
+            break;
+
+        case 6:		/* dst_xbitsrc */
+            key->ip_src = ip_dst;
+            break;
+
+        case 7:		/* both_p */
+            key->ip_src = ip_src;
+            key->ip_dst = ip_dst;
+            key->src_port = src_port;
+            key->dst_port = dst_port;
+            break;
+
+        case 8:		/* by_src_p */
+            key->ip_src = ip_src;
+            key->src_port = src_port;
+            break;
+
+        case 9:		/* by_dst_p */
+            key->ip_dst = ip_dst;
+            key->dst_port = dst_port;
+            break;
+
+        case 10:	/* reverse_p */
+            key->ip_src = ip_dst;
+            key->ip_dst = ip_src;
+            key->src_port = dst_port;
+            key->dst_port = src_port;
+            break;
+
+        case 11:	/* src_xbitdst_p */
+            key->ip_dst = ip_src;
+            key->dst_port = src_port;
+            break;
+
+        case 12:	/* dst_xbitsrc_p */
+            key->ip_src = ip_dst;
+            key->src_port = dst_port;
+            break;
 
-                                    if ( counter > rulestruct[rule_position].flexbit_count_counter[i] )
-                                        {
+        }
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit count 'by_dst' threshold reached for flexbit '%s'.", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
-                                                }
+    if ( key->ip_src != NULL && key->ip_dst != NULL )
+        {
+            key->chain = FLEXBIT_INDEX_BOTH;
+        }
 
-                                            return(true);
-                                        }
-                                }
-                        }
-                }
+    else if ( key->ip_src != NULL )
+        {
+            key->chain = FLEXBIT_INDEX_SRC;
         }
 
-    if ( debug->debugflexbit)
+    else if ( key->ip_dst != NULL )
         {
-            Sagan_Log(DEBUG, "[%s, line %d] Xbit count threshold NOT reached for flexbit.", __FILE__, __LINE__);
+            key->chain = FLEXBIT_INDEX_DST;
         }
 
-    return(false);
-}
+    key->bucket = Flexbit_MMAP_Bucket(key->name_hash, key->ip_src, key->ip_dst);
 
+}
 
 /*****************************************************************************
- * Flexbit_Set - Used to "set" & "unset" flexbit.  All rule "set" and
- * "unset" happen here.
+ * Flexbit_MMAP_Next - Next slot after "slot" (-1 to start) in the key's
+ * chain that matches the key.  Returns -1 at the end of the chain.  Must be
+ * called with the flexbit lock held.
  *****************************************************************************/
 
-void Flexbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port, char *syslog_message )
+static int Flexbit_MMAP_Next( struct _Flexbit_MMAP_Key *key, int slot )
 {
 
-    int i = 0;
-    int a = 0;
-
-    time_t t;
-    struct tm *now;
-    char  timet[20];
-
-    bool flexbit_match = false;
-    bool flexbit_unset_match = 0;
-
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
-    struct _Sagan_Flexbit_Track *flexbit_track;
+    int32_t a;
+    struct _Sagan_IPC_Flexbit *flexbit;
 
-    flexbit_track = malloc(sizeof(_Sagan_Flexbit_Track));
-
-    if ( flexbit_track  == NULL )
+    if ( slot == -1 )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
+            a = flexbit_index->head[ key->chain * flexbit_index->buckets + key->bucket ];
+        }
+    else
+        {
+            a = flexbit_ipc[slot].index_next[key->chain];
         }
 
-    memset(flexbit_track, 0, sizeof(_Sagan_Flexbit_Track));
-
-    int flexbit_track_count = 0;
-
-    Flexbit_Cleanup_MMAP();
-
-    for (i = 0; i < rulestruct[rule_position].flexbit_count; i++)
+    while ( a != 0 )
         {
 
-            /*******************
-             *      UNSET      *
-             *******************/
+            flexbit = &flexbit_ipc[a - 1];
 
-            if ( rulestruct[rule_position].flexbit_type[i] == 2 )
+            if ( flexbit->flexbit_name_hash == key->name_hash &&
+                    !strcmp(flexbit->flexbit_name, key->name) &&
+                    ( key->ip_src == NULL || !memcmp(flexbit->ip_src, key->ip_src, MAXIPBIT) ) &&
+                    ( key->ip_dst == NULL || !memcmp(flexbit->ip_dst, key->ip_dst, MAXIPBIT) ) &&
+                    ( key->src_port == -1 || flexbit->src_port == key->src_port ) &&
+                    ( key->dst_port == -1 || flexbit->dst_port == key->dst_port ) )
                 {
+                    return(a - 1);
+                }
 
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
-
-                            if ( !strcmp(flexbit_ipc[a].flexbit_name, rulestruct[rule_position].flexbit_name[i] ))
-                                {
-
-                                    /* direction: none */
-
-                                    if ( rulestruct[rule_position].flexbit_direction[i] == 0 )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"none\"). (any -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
-                                                }
-
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-
-                                    /* direction: both */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 1 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"both\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: by_src */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 2 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"by_src\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-
-                                    /* direction: by_dst */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 3 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"by_dst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: reverse */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 4 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) )
-
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"reverse\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = false;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: src_xbitdst */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 5 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"src_xbitdst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: dst_xbitsrc */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 6 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"dst_xbitsrc\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
-
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
-
-                                            flexbit_ipc[a].flexbit_state = 0;
-
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
-
-                                            flexbit_unset_match = 1;
-
-                                        }
-
-                                    /* direction: both_p */
-
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 7 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].src_port == src_port &&
-                                              flexbit_ipc[a].dst_port == dst_port )
-                                        {
-
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"both_p\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src, ip_dst);
-                                                }
+            a = flexbit->index_next[key->chain];
+        }
 
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
+    return(-1);
+}
 
-                                            flexbit_ipc[a].flexbit_state = 0;
+/*****************************************************************************
+ * Flexbit_MMAP_Link/Unlink - Add or remove a slot from every index chain.
+ * Unlinked slots go on the free list.
+ *****************************************************************************/
 
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
+static void Flexbit_MMAP_Link( int slot )
+{
 
-                                            flexbit_unset_match = 1;
+    int chain;
+    int32_t *head;
 
-                                        }
+    for ( chain = 0; chain < FLEXBIT_INDEX_CHAINS; chain++ )
+        {
 
-                                    /* direction: by_src_p */
+            head = &flexbit_index->head[ chain * flexbit_index->buckets + Flexbit_MMAP_Entry_Bucket(&flexbit_ipc[slot], chain) ];
 
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 8 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == src_port )
+            flexbit_ipc[slot].index_prev[chain] = 0;
+            flexbit_ipc[slot].index_next[chain] = *head;
 
-                                        {
+            if ( *head != 0 )
+                {
+                    flexbit_ipc[*head - 1].index_prev[chain] = slot + 1;
+                }
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"by_src_p\"). (%s -> any)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
+            *head = slot + 1;
+        }
 
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
+    flexbit_ipc[slot].flexbit_used = true;
+}
 
-                                            flexbit_ipc[a].flexbit_state = 0;
+static void Flexbit_MMAP_Unlink( int slot )
+{
 
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
+    int chain;
+    int32_t next;
+    int32_t prev;
 
-                                            flexbit_unset_match = 1;
+    for ( chain = 0; chain < FLEXBIT_INDEX_CHAINS; chain++ )
+        {
 
-                                        }
+            next = flexbit_ipc[slot].index_next[chain];
+            prev = flexbit_ipc[slot].index_prev[chain];
 
+            if ( prev != 0 )
+                {
+                    flexbit_ipc[prev - 1].index_next[chain] = next;
+                }
+            else
+                {
+                    flexbit_index->head[ chain * flexbit_index->buckets + Flexbit_MMAP_Entry_Bucket(&flexbit_ipc[slot], chain) ] = next;
+                }
 
-                                    /* direction: by_dst_p */
+            if ( next != 0 )
+                {
+                    flexbit_ipc[next - 1].index_prev[chain] = prev;
+                }
+        }
 
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 9 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].dst_port == dst_port )
-                                        {
+    flexbit_ipc[slot].flexbit_used = false;
+    flexbit_ipc[slot].flexbit_state = false;
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"by_dst\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
+    flexbit_ipc[slot].index_next[0] = flexbit_index->free_list;
+    flexbit_index->free_list = slot + 1;
+}
 
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
+/*****************************************************************************
+ * Flexbit_MMAP_Sweep_Range - Unlink expired flexbits between "start" and
+ * "end".  Must be called with the flexbit lock held.
+ *****************************************************************************/
 
-                                            flexbit_ipc[a].flexbit_state = 0;
+static uint32_t Flexbit_MMAP_Sweep_Range( uint32_t start, uint32_t end, uint64_t now )
+{
 
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
+    uint32_t i;
+    uint32_t removed = 0;
 
-                                            flexbit_unset_match = 1;
+    for ( i = start; i < end; i++ )
+        {
 
-                                        }
+            if ( flexbit_ipc[i].flexbit_used == true && now >= flexbit_ipc[i].flexbit_expire )
+                {
 
-                                    /* direction: reverse_p */
+                    if ( debug->debugflexbit )
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] Removing expired flexbit %s.", __FILE__, __LINE__, flexbit_ipc[i].flexbit_name);
+                        }
 
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 10 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == dst_port &&
-                                              flexbit_ipc[a].dst_port == src_port )
+                    Flexbit_MMAP_Unlink(i);
+                    removed++;
+                }
+        }
 
-                                        {
+    return(removed);
+}
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"reverse_p\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst, ip_src);
-                                                }
+/*****************************************************************************
+ * Flexbit_MMAP_Alloc - Returns a free slot or -1.  Must be called with the
+ * flexbit lock held.
+ *****************************************************************************/
 
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
+static int Flexbit_MMAP_Alloc( uint64_t now )
+{
 
-                                            flexbit_ipc[a].flexbit_state = 0;
+    int slot;
 
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
+    if ( flexbit_index->free_list == 0 && counters_ipc->flexbit_count >= config->max_flexbits )
+        {
+            Flexbit_MMAP_Sweep_Range(0, counters_ipc->flexbit_count, now);
+        }
 
-                                            flexbit_unset_match = 1;
+    if ( flexbit_index->free_list != 0 )
+        {
+            slot = flexbit_index->free_list - 1;
+            flexbit_index->free_list = flexbit_ipc[slot].index_next[0];
+            return(slot);
+        }
 
-                                        }
+    if ( counters_ipc->flexbit_count < config->max_flexbits )
+        {
+            return(__atomic_fetch_add(&counters_ipc->flexbit_count, 1, __ATOMIC_SEQ_CST));
+        }
 
-                                    /* direction: src_xbitdst_p */
+    return(-1);
+}
 
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 11 &&
-                                              !memcmp(flexbit_ipc[a].ip_dst, ip_src, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                              flexbit_ipc[a].dst_port == src_port )
-                                        {
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"src_xbitdst_p\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_src);
-                                                }
+/*****************************************************************************
+ * Flexbit_Condition - Used for testing "isset" & "isnotset".  Full
+ * rule condition is tested here and returned.
+ *****************************************************************************/
 
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
+bool Flexbit_Condition_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port )
+{
 
-                                            flexbit_ipc[a].flexbit_state = 0;
+    int i;
+    int a;
 
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
+    int flexbit_total_match = 0;
+    bool flexbit_match = false;
 
-                                            flexbit_unset_match = 1;
+    uint64_t now = Return_Epoch();
 
-                                        }
+    unsigned char ip_src_bits[MAXIPBIT];
+    unsigned char ip_dst_bits[MAXIPBIT];
 
-                                    /* direction: dst_xbitsrc_p */
+    struct _Flexbit_MMAP_Key key;
 
-                                    else if ( rulestruct[rule_position].flexbit_direction[i] == 12 &&
-                                              !memcmp(flexbit_ipc[a].ip_src, ip_dst, sizeof(flexbit_ipc[a].ip_src)) &&
-                                              flexbit_ipc[a].src_port == dst_port )
-                                        {
+    Flexbit_MMAP_IP(ip_src, ip_src_bits);
+    Flexbit_MMAP_IP(ip_dst, ip_dst_bits);
 
-                                            if ( debug->debugflexbit)
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"dst_xbitsrc_p\"). (any -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, ip_dst);
-                                                }
+    for (i = 0; i < rulestruct[rule_position].flexbit_count; i++)
+        {
 
-                                            File_Lock(config->shm_flexbit);
-                                            pthread_mutex_lock(&Flexbit_Mutex);
+            /* 3 == isset,  4 == isnotset */
 
-                                            flexbit_ipc[a].flexbit_state = 0;
+            if ( rulestruct[rule_position].flexbit_type[i] != 3 && rulestruct[rule_position].flexbit_type[i] != 4 )
+                {
+                    continue;
+                }
 
-                                            pthread_mutex_unlock(&Flexbit_Mutex);
-                                            File_Unlock(config->shm_flexbit);
+            Flexbit_MMAP_Key(&key, rulestruct[rule_position].flexbit_name[i], rulestruct[rule_position].flexbit_direction[i], ip_src_bits, ip_dst_bits, src_port, dst_port);
 
-                                            flexbit_unset_match = 1;
+            flexbit_match = false;
 
-                                        }
+            Flexbit_MMAP_Lock();
 
-                                }
-                        }
+            for ( a = Flexbit_MMAP_Next(&key, -1); a != -1; a = Flexbit_MMAP_Next(&key, a) )
+                {
 
-                    if ( debug->debugflexbit && flexbit_unset_match == 0 )
+                    if ( flexbit_ipc[a].flexbit_state == true && now < flexbit_ipc[a].flexbit_expire )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] No flexbit found to \"unset\" for %s.", __FILE__, __LINE__, rulestruct[rule_position].flexbit_name[i]);
+                            flexbit_match = true;
+                            break;
                         }
+                }
 
-                } /* if ( rulestruct[rule_position].flexbit_type[i] == 2 ) */
+            Flexbit_MMAP_Unlock();
 
-            /*******************
-             *      SET        *
-            *******************/
+            if ( debug->debugflexbit )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] \"%s\" flexbit \"%s\" is %s (direction: \"%s\"). (%s:%d -> %s:%d)", __FILE__, __LINE__, rulestruct[rule_position].flexbit_type[i] == 3 ? "isset" : "isnotset", rulestruct[rule_position].flexbit_name[i], flexbit_match == true ? "set" : "not set", flexbit_direction_name[rulestruct[rule_position].flexbit_direction[i]], ip_src, src_port, ip_dst, dst_port);
+                }
 
-            else if ( rulestruct[rule_position].flexbit_type[i] == 1 )
+            if ( ( rulestruct[rule_position].flexbit_type[i] == 3 && flexbit_match == true ) ||
+                    ( rulestruct[rule_position].flexbit_type[i] == 4 && flexbit_match == false ) )
                 {
+                    flexbit_total_match++;
+                }
 
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
+        }
 
-                            /* Do we have the flexbit already in memory?  If so,  update the information */
+    if ( flexbit_total_match == rulestruct[rule_position].flexbit_condition_count )
+        {
 
-                            if (!strcmp(flexbit_ipc[a].flexbit_name, rulestruct[rule_position].flexbit_name[i]) &&
-                                    !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                    flexbit_ipc[a].src_port == config->sagan_port &&
-                                    flexbit_ipc[a].dst_port == config->sagan_port )
-                                {
+            if ( debug->debugflexbit )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Got %d flexbits & needed %d. Got corrent number of flexbits, return true!", __FILE__, __LINE__, flexbit_total_match, rulestruct[rule_position].flexbit_condition_count );
+                }
 
+            return(true);
 
-                                    File_Lock(config->shm_flexbit);
-                                    pthread_mutex_lock(&Flexbit_Mutex);
+        }
 
-                                    flexbit_ipc[a].flexbit_date = atol(timet);
-                                    flexbit_ipc[a].flexbit_expire = atol(timet) + rulestruct[rule_position].flexbit_timeout[i];
-                                    flexbit_ipc[a].flexbit_state = true;
-                                    strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
-                                    strlcpy(flexbit_ipc[a].signature_msg, rulestruct[rule_position].s_msg, sizeof(flexbit_ipc[a].signature_msg));
-                                    flexbit_ipc[a].sid = rulestruct[rule_position].s_sid;
+    if ( debug->debugflexbit )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Got %d flexbits, needed %d", __FILE__, __LINE__, flexbit_total_match, rulestruct[rule_position].flexbit_condition_count );
+        }
 
+    return(false);
 
-                                    if ( debug->debugflexbit)
-                                        {
+}  /* End of Flexbit_Condition_MMAP(); */
 
-                                            Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set\" for flexbit \"%s\". Nex expire time is %d (%d) [ %s:%d -> %s:%d ]", __FILE__, __LINE__, a, rulestruct[rule_position].flexbit_name[i], flexbit_ipc[i].flexbit_expire, rulestruct[rule_position].flexbit_timeout[i], flexbit_ipc[a].ip_src, flexbit_ipc[a].src_port, flexbit_ipc[a].ip_dst, flexbit_ipc[a].dst_port);
 
-                                        }
+/*****************************************************************************
+ * Flexbit_Count - Used to determine how many flexbits have been set based on a
+ * source or destination address.  This is useful for identification of
+ * distributed attacks.
+ *****************************************************************************/
+
+bool Flexbit_Count_MMAP( int rule_position, char *ip_src, char *ip_dst )
+{
+
+    uint32_t a = 0;
+    uint32_t i = 0;
+    uint32_t counter = 0;
+    uint32_t flexbit_count = __atomic_load_n(&counters_ipc->flexbit_count, __ATOMIC_SEQ_CST);
 
-                                    pthread_mutex_unlock(&Flexbit_Mutex);
-                                    File_Unlock(config->shm_flexbit);
+    unsigned char ip_src_bits[MAXIPBIT];
+    unsigned char ip_dst_bits[MAXIPBIT];
 
-                                    flexbit_match = true;
-                                }
+    Flexbit_MMAP_IP(ip_src, ip_src_bits);
+    Flexbit_MMAP_IP(ip_dst, ip_dst_bits);
 
-                        }
+    for (i = 0; i < rulestruct[rule_position].flexbit_count_count; i++)
+        {
 
+            for (a = 0; a < flexbit_count; a++)
+                {
 
-                    /* If the flexbit isn't in memory,  store it to be created later */
+                    if ( flexbit_ipc[a].flexbit_used == false )
+                        {
+                            continue;
+                        }
 
-                    if ( flexbit_match == false )
+                    if ( rulestruct[rule_position].flexbit_direction[i] == 2 &&
+                            !memcmp(flexbit_ipc[a].ip_src, ip_src_bits, sizeof(flexbit_ipc[a].ip_src)) )
                         {
 
-                            flexbit_track = ( _Sagan_Flexbit_Track * ) realloc(flexbit_track, (flexbit_track_count+1) * sizeof(_Sagan_Flexbit_Track));
+                            counter++;
 
-                            if ( flexbit_track == NULL )
+                            if ( rulestruct[rule_position].flexbit_count_gt_lt[i] == 0 )
                                 {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
-                                }
 
-                            memset(&flexbit_track[flexbit_track_count], 0, sizeof(_Sagan_Flexbit_Track));
+                                    if ( counter > rulestruct[rule_position].flexbit_count_counter[i] )
+                                        {
 
-                            strlcpy(flexbit_track[flexbit_track_count].flexbit_name, rulestruct[rule_position].flexbit_name[i], sizeof(flexbit_track[flexbit_track_count].flexbit_name));
-                            strlcpy(flexbit_ipc[flexbit_track_count].syslog_message, syslog_message, sizeof(flexbit_ipc[flexbit_track_count].syslog_message));
-                            strlcpy(flexbit_ipc[flexbit_track_count].signature_msg, rulestruct[rule_position].s_msg, sizeof(flexbit_ipc[flexbit_track_count].signature_msg));
-                            flexbit_ipc[flexbit_track_count].sid = rulestruct[rule_position].s_sid;
+                                            if ( debug->debugflexbit)
+                                                {
+                                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit count 'by_src' threshold reached for flexbit '%s'.", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
+                                                }
 
-                            flexbit_track[flexbit_track_count].flexbit_timeout = rulestruct[rule_position].flexbit_timeout[i];
-                            flexbit_track[flexbit_track_count].flexbit_srcport = config->sagan_port;
-                            flexbit_track[flexbit_track_count].flexbit_dstport = config->sagan_port;
-                            flexbit_track_count++;
 
+                                            return(true);
+                                        }
+                                }
                         }
 
-                } /* if flexbit_type == 1 */
-
-            /***************************
-             *      SET_SRCPORT        *
-            ****************************/
-
-            else if ( rulestruct[rule_position].flexbit_type[i] == 5 )
-                {
-
-                    flexbit_match = false;
-
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
+                    else if ( rulestruct[rule_position].flexbit_direction[i] == 3 &&
+                              !memcmp(flexbit_ipc[a].ip_dst, ip_dst_bits, sizeof(flexbit_ipc[a].ip_dst)) )
                         {
 
-                            /* Do we have the flexbit already in memory?  If so,  update the information */
+                            counter++;
 
-                            if (!strcmp(flexbit_ipc[a].flexbit_name, rulestruct[rule_position].flexbit_name[i]) &&
-                                    !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                    flexbit_ipc[a].src_port == src_port &&
-                                    flexbit_ipc[a].dst_port == config->sagan_port )
+                            if ( rulestruct[rule_position].flexbit_count_gt_lt[i] == 0 )
                                 {
 
-                                    File_Lock(config->shm_flexbit);
-                                    pthread_mutex_lock(&Flexbit_Mutex);
-
-                                    flexbit_ipc[a].flexbit_date = atol(timet);
-                                    flexbit_ipc[a].flexbit_expire = atol(timet) + rulestruct[rule_position].flexbit_timeout[i];
-                                    flexbit_ipc[a].flexbit_state = true;
-                                    strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
-
-                                    if ( debug->debugflexbit)
+                                    if ( counter > rulestruct[rule_position].flexbit_count_counter[i] )
                                         {
 
-                                            Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set_srcport\" for flexbit \"%s\". Nex expire time is %d (%d) [ %s:%d -> %s:%d ]", __FILE__, __LINE__, a, rulestruct[rule_position].flexbit_name[i], flexbit_ipc[i].flexbit_expire, rulestruct[rule_position].flexbit_timeout[i], flexbit_ipc[a].ip_src, flexbit_ipc[a].src_port, flexbit_ipc[a].ip_dst, flexbit_ipc[a].dst_port);
+                                            if ( debug->debugflexbit)
+                                                {
+                                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit count 'by_dst' threshold reached for flexbit '%s'.", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name);
+                                                }
 
+                                            return(true);
                                         }
-
-                                    pthread_mutex_unlock(&Flexbit_Mutex);
-                                    File_Unlock(config->shm_flexbit);
-
-                                    flexbit_match = true;
                                 }
-
                         }
+                }
+        }
 
+    if ( debug->debugflexbit)
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Xbit count threshold NOT reached for flexbit.", __FILE__, __LINE__);
+        }
 
-                    /* If the flexbit isn't in memory,  store it to be created later */
+    return(false);
+}
 
-                    if ( flexbit_match == false )
-                        {
 
-                            flexbit_track = ( _Sagan_Flexbit_Track * ) realloc(flexbit_track, (flexbit_track_count+1) * sizeof(_Sagan_Flexbit_Track));
+/*****************************************************************************
+ * Flexbit_Set - Used to "set" & "unset" flexbit.  All rule "set" and
+ * "unset" happen here.
+ *****************************************************************************/
 
-                            if ( flexbit_track == NULL )
-                                {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
-                                }
+void Flexbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port, char *syslog_message )
+{
 
-                            memset(&flexbit_track[flexbit_track_count], 0, sizeof(_Sagan_Flexbit_Track));
+    int i = 0;
+    int a = 0;
+    int next = 0;
+    int type = 0;
 
-                            strlcpy(flexbit_track[flexbit_track_count].flexbit_name, rulestruct[rule_position].flexbit_name[i], sizeof(flexbit_track[flexbit_track_count].flexbit_name));
-                            strlcpy(flexbit_ipc[flexbit_track_count].syslog_message, syslog_message, sizeof(flexbit_ipc[flexbit_track_count].syslog_message));
-                            flexbit_track[flexbit_track_count].flexbit_timeout = rulestruct[rule_position].flexbit_timeout[i];
-                            flexbit_track[flexbit_track_count].flexbit_srcport = src_port;
-                            flexbit_track[flexbit_track_count].flexbit_dstport = config->sagan_port;
-                            flexbit_track_count++;
+    int flexbit_src_port = 0;
+    int flexbit_dst_port = 0;
 
-                        }
+    bool flexbit_unset_match = false;
 
-                } /* if flexbit_type == 5 */
+    uint64_t now = Return_Epoch();
 
-            /***************************
-             *      SET_DSTPORT        *
-            ****************************/
+    unsigned char ip_src_bits[MAXIPBIT];
+    unsigned char ip_dst_bits[MAXIPBIT];
 
-            else if ( rulestruct[rule_position].flexbit_type[i] == 6 )
-                {
+    struct _Flexbit_MMAP_Key key;
 
-                    flexbit_match = false;
+    Flexbit_MMAP_IP(ip_src, ip_src_bits);
+    Flexbit_MMAP_IP(ip_dst, ip_dst_bits);
 
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
+    for (i = 0; i < rulestruct[rule_position].flexbit_count; i++)
+        {
 
-                            /* Do we have the flexbit already in memory?  If so,  update the information */
+            type = rulestruct[rule_position].flexbit_type[i];
 
-                            if (!strcmp(flexbit_ipc[a].flexbit_name, rulestruct[rule_position].flexbit_name[i]) &&
-                                    !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                    flexbit_ipc[a].src_port == config->sagan_port &&
-                                    flexbit_ipc[a].dst_port == dst_port )
-                                {
+            /*******************
+             *      UNSET      *
+             *******************/
 
-                                    File_Lock(config->shm_flexbit);
-                                    pthread_mutex_lock(&Flexbit_Mutex);
+            if ( type == 2 )
+                {
 
-                                    flexbit_ipc[a].flexbit_date = atol(timet);
-                                    flexbit_ipc[a].flexbit_expire = atol(timet) + rulestruct[rule_position].flexbit_timeout[i];
-                                    flexbit_ipc[a].flexbit_state = true;
-                                    strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
+                    Flexbit_MMAP_Key(&key, rulestruct[rule_position].flexbit_name[i], rulestruct[rule_position].flexbit_direction[i], ip_src_bits, ip_dst_bits, src_port, dst_port);
 
-                                    if ( debug->debugflexbit)
-                                        {
+                    flexbit_unset_match = false;
 
-                                            Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set_dstport\" for flexbit \"%s\". Nex expire time is %d (%d) [ %s:%d -> %s:%d ]", __FILE__, __LINE__, a, rulestruct[rule_position].flexbit_name[i], flexbit_ipc[i].flexbit_expire, rulestruct[rule_position].flexbit_timeout[i], flexbit_ipc[a].ip_src, flexbit_ipc[a].src_port, flexbit_ipc[a].ip_dst, flexbit_ipc[a].dst_port);
+                    Flexbit_MMAP_Lock();
 
-                                        }
+                    for ( a = Flexbit_MMAP_Next(&key, -1); a != -1; a = next )
+                        {
 
-                                    pthread_mutex_unlock(&Flexbit_Mutex);
-                                    File_Unlock(config->shm_flexbit);
+                            next = Flexbit_MMAP_Next(&key, a);
 
-                                    flexbit_match = true;
+                            if ( debug->debugflexbit)
+                                {
+                                    Sagan_Log(DEBUG, "[%s, line %d] \"unset\" flexbit \"%s\" (direction: \"%s\"). (%s -> %s)", __FILE__, __LINE__, flexbit_ipc[a].flexbit_name, flexbit_direction_name[rulestruct[rule_position].flexbit_direction[i]], ip_src, ip_dst);
                                 }
 
+                            Flexbit_MMAP_Unlink(a);
+                            flexbit_unset_match = true;
                         }
 
+                    Flexbit_MMAP_Unlock();
 
-                    /* If the flexbit isn't in memory,  store it to be created later */
-
-                    if ( flexbit_match == false )
+                    if ( debug->debugflexbit && flexbit_unset_match == false )
                         {
+                            Sagan_Log(DEBUG, "[%s, line %d] No flexbit found to \"unset\" for %s.", __FILE__, __LINE__, rulestruct[rule_position].flexbit_name[i]);
+                        }
 
-                            flexbit_track = ( _Sagan_Flexbit_Track * ) realloc(flexbit_track, (flexbit_track_count+1) * sizeof(_Sagan_Flexbit_Track));
+                    continue;
 
-                            if ( flexbit_track == NULL )
-                                {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
-                                }
+                }
 
-                            memset(&flexbit_track[flexbit_track_count], 0, sizeof(_Sagan_Flexbit_Track));
+            /*****************************************************
+             * SET (1), SET_SRCPORT (5), SET_DSTPORT (6) and
+             * SET_PORTS (7)
+             *****************************************************/
 
-                            strlcpy(flexbit_track[flexbit_track_count].flexbit_name, rulestruct[rule_position].flexbit_name[i], sizeof(flexbit_track[flexbit_track_count].flexbit_name));
-                            strlcpy(flexbit_ipc[flexbit_track_count].syslog_message, syslog_message, sizeof(flexbit_ipc[flexbit_track_count].syslog_message));
-                            flexbit_track[flexbit_track_count].flexbit_timeout = rulestruct[rule_position].flexbit_timeout[i];
-                            flexbit_track[flexbit_track_count].flexbit_srcport = config->sagan_port;
-                            flexbit_track[flexbit_track_count].flexbit_dstport = dst_port;
-                            flexbit_track_count++;
+            if ( type != 1 && type != 5 && type != 6 && type != 7 )
+                {
+                    continue;
+                }
 
-                        }
+            flexbit_src_port = ( type == 5 || type == 7 ) ? src_port : config->sagan_port;
+            flexbit_dst_port = ( type == 6 || type == 7 ) ? dst_port : config->sagan_port;
 
-                } /* if flexbit_type == 6 */
+            /* Exact "both_p" lookup */
 
-            /*************************
-             *      SET_PORTS        *
-            **************************/
+            Flexbit_MMAP_Key(&key, rulestruct[rule_position].flexbit_name[i], 7, ip_src_bits, ip_dst_bits, flexbit_src_port, flexbit_dst_port);
 
-            else if ( rulestruct[rule_position].flexbit_type[i] == 7 )
-                {
+            Flexbit_MMAP_Lock();
 
-                    flexbit_match = false;
+            a = Flexbit_MMAP_Next(&key, -1);
 
-                    for (a = 0; a < counters_ipc->flexbit_count; a++)
-                        {
+            /* If the flexbit isn't in memory,  create it */
 
-                            /* Do we have the flexbit already in memory?  If so,  update the information */
+            if ( a == -1 )
+                {
 
-                            if (!strcmp(flexbit_ipc[a].flexbit_name, rulestruct[rule_position].flexbit_name[i]) &&
-                                    !memcmp(flexbit_ipc[a].ip_src, ip_src, sizeof(flexbit_ipc[a].ip_src)) &&
-                                    !memcmp(flexbit_ipc[a].ip_dst, ip_dst, sizeof(flexbit_ipc[a].ip_dst)) &&
-                                    flexbit_ipc[a].src_port == src_port &&
-                                    flexbit_ipc[a].dst_port == dst_port )
-                                {
+                    a = Flexbit_MMAP_Alloc(now);
 
-                                    File_Lock(config->shm_flexbit);
-                                    pthread_mutex_lock(&Flexbit_Mutex);
+                    if ( a == -1 )
+                        {
+                            Flexbit_MMAP_Unlock();
+                            Sagan_Log(WARN, "[%s, line %d] No free flexbit slot for '%s'.  Consider raising sagan-core|mmap-ipc 'flexbit' (currently %d).", __FILE__, __LINE__, rulestruct[rule_position].flexbit_name[i], config->max_flexbits);
+                            continue;
+                        }
 
-                                    flexbit_ipc[a].flexbit_date = atol(timet);
-                                    flexbit_ipc[a].flexbit_expire = atol(timet) + rulestruct[rule_position].flexbit_timeout[i];
-                                    flexbit_ipc[a].flexbit_state = true;
-                                    strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
+                    memset(&flexbit_ipc[a], 0, sizeof(_Sagan_IPC_Flexbit));
 
-                                    if ( debug->debugflexbit)
-                                        {
+                    strlcpy(flexbit_ipc[a].flexbit_name, rulestruct[rule_position].flexbit_name[i], sizeof(flexbit_ipc[a].flexbit_name));
+                    flexbit_ipc[a].flexbit_name_hash = key.name_hash;
 
-                                            Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set_ports\" for flexbit \"%s\". Nex expire time is %d (%d) [ %s:%d -> %s:%d ]", __FILE__, __LINE__, a, rulestruct[rule_position].flexbit_name[i], flexbit_ipc[i].flexbit_expire, rulestruct[rule_position].flexbit_timeout[i], flexbit_ipc[a].ip_src, flexbit_ipc[a].src_port, flexbit_ipc[a].ip_dst, flexbit_ipc[a].dst_port);
+                    memcpy(flexbit_ipc[a].ip_src, ip_src_bits, sizeof(flexbit_ipc[a].ip_src));
+                    memcpy(flexbit_ipc[a].ip_dst, ip_dst_bits, sizeof(flexbit_ipc[a].ip_dst));
+                    flexbit_ipc[a].src_port = flexbit_src_port;
+                    flexbit_ipc[a].dst_port = flexbit_dst_port;
+                    flexbit_ipc[a].expire = rulestruct[rule_position].flexbit_timeout[i];
 
-                                        }
+                    Flexbit_MMAP_Link(a);
 
-                                    pthread_mutex_unlock(&Flexbit_Mutex);
-                                    File_Unlock(config->shm_flexbit);
+                    if ( debug->debugflexbit)
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] [%d] Created flexbit \"%s\" via \"set, set_srcport, set_dstport, or set_ports\" [%s:%d -> %s:%d]", __FILE__, __LINE__, a, flexbit_ipc[a].flexbit_name, ip_src, flexbit_src_port, ip_dst, flexbit_dst_port);
+                        }
 
-                                    flexbit_match = true;
-                                }
+                }
 
-                        }
+            else if ( debug->debugflexbit)
+                {
+                    Sagan_Log(DEBUG,"[%s, line %d] [%d] Updated via \"set\" for flexbit \"%s\". Next expire time is %" PRIu64 " (%d) [ %s:%d -> %s:%d ]", __FILE__, __LINE__, a, rulestruct[rule_position].flexbit_name[i], now + rulestruct[rule_position].flexbit_timeout[i], rulestruct[rule_position].flexbit_timeout[i], ip_src, flexbit_src_port, ip_dst, flexbit_dst_port);
+                }
 
+            flexbit_ipc[a].flexbit_date = now;
+            flexbit_ipc[a].flexbit_expire = now + rulestruct[rule_position].flexbit_timeout[i];
+            flexbit_ipc[a].flexbit_state = true;
+            flexbit_ipc[a].sid = rulestruct[rule_position].s_sid;
 
-                    /* If the flexbit isn't in memory,  store it to be created later */
+            strlcpy(flexbit_ipc[a].syslog_message, syslog_message, sizeof(flexbit_ipc[a].syslog_message));
+            strlcpy(flexbit_ipc[a].signature_msg, rulestruct[rule_position].s_msg, sizeof(flexbit_ipc[a].signature_msg));
 
-                    if ( flexbit_match == false )
-                        {
+            Flexbit_MMAP_Unlock();
 
-                            flexbit_track = ( _Sagan_Flexbit_Track * ) realloc(flexbit_track, (flexbit_track_count+1) * sizeof(_Sagan_Flexbit_Track));
+        } /* Out of for i loop */
 
-                            if ( flexbit_track == NULL )
-                                {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for flexbit_track. Abort!", __FILE__, __LINE__);
-                                }
+} /* End of Flexbit_Set_MMAP */
 
-                            memset(&flexbit_track[flexbit_track_count], 0, sizeof(_Sagan_Flexbit_Track));
+/*****************************************************************************
+ * Flexbit_Buckets_MMAP - Index buckets per chain for "max" flexbits.
+ *****************************************************************************/
 
-                            strlcpy(flexbit_track[flexbit_track_count].flexbit_name, rulestruct[rule_position].flexbit_name[i], sizeof(flexbit_track[flexbit_track_count].flexbit_name));
-                            strlcpy(flexbit_ipc[flexbit_track_count].syslog_message, syslog_message, sizeof(flexbit_ipc[flexbit_track_count].syslog_message));
-                            strlcpy(flexbit_ipc[flexbit_track_count].signature_msg, rulestruct[rule_position].s_msg, sizeof(flexbit_ipc[flexbit_track_count].signature_msg));
-                            flexbit_ipc[flexbit_track_count].sid = rulestruct[rule_position].s_sid;
+uint32_t Flexbit_Buckets_MMAP( int max )
+{
 
-                            flexbit_track[flexbit_track_count].flexbit_timeout = rulestruct[rule_position].flexbit_timeout[i];
-                            flexbit_track[flexbit_track_count].flexbit_srcport = src_port;
-                            flexbit_track[flexbit_track_count].flexbit_dstport = dst_port;
-                            flexbit_track_count++;
+    uint32_t buckets = 1;
 
-                        }
+    while ( buckets < (uint32_t)max )
+        {
+            buckets <<= 1;
+        }
 
-                } /* if flexbit_type == 7 */
+    return(buckets);
+}
 
-        } /* Out of for i loop */
+/*****************************************************************************
+ * Flexbit_Init_MMAP - Called after the flexbit object is mapped.  A new
+ * object,  or one built for a different 'flexbit' size,  gets a fresh
+ * index.
+ *****************************************************************************/
 
-    /* Do we have any flexbits in memory that need to be created?  */
+void Flexbit_Init_MMAP( void )
+{
+
+    uint32_t buckets = Flexbit_Buckets_MMAP(config->max_flexbits);
 
-    if ( flexbit_track_count != 0 )
+    if ( flexbit_index->slots == (uint32_t)config->max_flexbits && flexbit_index->buckets == buckets )
         {
+            return;
+        }
 
-            for (i = 0; i < flexbit_track_count; i++)
-                {
+    if ( flexbit_index->slots != 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Flexbit shared object was built for %u flexbits (now %d).  Resetting flexbits.", __FILE__, __LINE__, flexbit_index->slots, config->max_flexbits);
+        }
 
-                    if ( Clean_IPC_Object(FLEXBIT) == 0 )
-                        {
+    Flexbit_MMAP_Lock();
 
-                            File_Lock(config->shm_flexbit);
-                            pthread_mutex_lock(&Flexbit_Mutex);
+    memset(flexbit_ipc, 0, sizeof(_Sagan_IPC_Flexbit) * config->max_flexbits + FLEXBIT_INDEX_SIZE(buckets));
 
-                            memcpy(flexbit_ipc[counters_ipc->flexbit_count].ip_src, ip_src, sizeof(flexbit_ipc[counters_ipc->flexbit_count].ip_src));
-                            memcpy(flexbit_ipc[counters_ipc->flexbit_count].ip_dst, ip_dst, sizeof(flexbit_ipc[counters_ipc->flexbit_count].ip_dst));
+    flexbit_index->slots = config->max_flexbits;
+    flexbit_index->buckets = buckets;
+    counters_ipc->flexbit_count = 0;
 
-                            flexbit_ipc[counters_ipc->flexbit_count].src_port = flexbit_track[i].flexbit_srcport;
-                            flexbit_ipc[counters_ipc->flexbit_count].dst_port = flexbit_track[i].flexbit_dstport;
-                            flexbit_ipc[counters_ipc->flexbit_count].flexbit_date = atol(timet);
-                            flexbit_ipc[counters_ipc->flexbit_count].flexbit_expire = atol(timet) + flexbit_track[i].flexbit_timeout;
-                            flexbit_ipc[counters_ipc->flexbit_count].flexbit_state = true;
-                            flexbit_ipc[counters_ipc->flexbit_count].expire = flexbit_track[i].flexbit_timeout;
+    Flexbit_MMAP_Unlock();
 
-                            strlcpy(flexbit_ipc[counters_ipc->flexbit_count].flexbit_name, flexbit_track[i].flexbit_name, sizeof(flexbit_ipc[counters_ipc->flexbit_count].flexbit_name));
-                            strlcpy(flexbit_ipc[counters_ipc->flexbit_count].signature_msg, rulestruct[rule_position].s_msg, sizeof(flexbit_ipc[counters_ipc->flexbit_count].signature_msg));
-                            strlcpy(flexbit_ipc[counters_ipc->flexbit_count].syslog_message, syslog_message, sizeof(flexbit_ipc[counters_ipc->flexbit_count].syslog_message));
-                            flexbit_ipc[counters_ipc->flexbit_count].sid = rulestruct[rule_position].s_sid;
+}
 
+/*****************************************************************************
+ * Flexbit_Sweep_MMAP - Unlinks expired flexbits.  The lock is only held
+ * for FLEXBIT_SWEEP_BATCH slots at a time.
+ *****************************************************************************/
 
-                            if ( debug->debugflexbit)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] [%d] Created flexbit \"%s\" via \"set, set_srcport, set_dstport, or set_ports\" [%s:%d -> %s:%d]", __FILE__, __LINE__, counters_ipc->flexbit_count, flexbit_ipc[counters_ipc->flexbit_count].flexbit_name, ip_src, flexbit_track[i].flexbit_srcport, ip_dst, flexbit_track[i].flexbit_dstport);
-                                }
+void Flexbit_Sweep_MMAP( void )
+{
 
-                            File_Lock(config->shm_counters);
+    uint32_t start;
+    uint32_t end;
+    uint32_t removed = 0;
+    uint32_t flexbit_count = __atomic_load_n(&counters_ipc->flexbit_count, __ATOMIC_SEQ_CST);
 
-                            counters_ipc->flexbit_count++;
+    uint64_t now = Return_Epoch();
 
-                            File_Unlock(config->shm_counters);
-                            File_Unlock(config->shm_flexbit);
+    for ( start = 0; start < flexbit_count; start += FLEXBIT_SWEEP_BATCH )
+        {
 
-                            pthread_mutex_unlock(&Flexbit_Mutex);
+            end = start + FLEXBIT_SWEEP_BATCH < flexbit_count ? start + FLEXBIT_SWEEP_BATCH : flexbit_count;
 
-                        }
-                }
+            Flexbit_MMAP_Lock();
+            removed += Flexbit_MMAP_Sweep_Range(start, end, now);
+            Flexbit_MMAP_Unlock();
         }
 
-    free(flexbit_track);
+    if ( debug->debugflexbit && removed != 0 )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Swept %u expired flexbits.", __FILE__, __LINE__, removed);
+        }
 
-} /* End of Xbit_Set */
+}
 
 /*****************************************************************************
- * Xbit_Cleanup - Find "expired" flexbits and toggle the "state"
- * to "off"
+ * Flexbit_Sweep_Thread - Background thread that removes expired flexbits
+ * so lookups never have to.
  *****************************************************************************/
 
-void Flexbit_Cleanup_MMAP(void)
+void Flexbit_Sweep_Thread( void )
 {
 
-    int i = 0;
-
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    (void)SetThreadName("SaganFlexSweep");
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
-    for (i=0; i<counters_ipc->flexbit_count; i++)
+    for(;;)
         {
-
-            if (  flexbit_ipc[i].flexbit_state == true && atol(timet) >= flexbit_ipc[i].flexbit_expire )
-                {
-                    if (debug->debugflexbit)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Setting flexbit %s to \"expired\" state.", __FILE__, __LINE__, flexbit_ipc[i].flexbit_name);
-                        }
-                    flexbit_ipc[i].flexbit_state = false;
-                }
+            sleep(FLEXBIT_SWEEP_INTERVAL);
+            Flexbit_Sweep_MMAP();
         }
 
 }
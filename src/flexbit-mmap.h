@@ -24,23 +24,38 @@
 
 #include "sagan-defs.h"
 
+/* Flexbits are found through chained index buckets stored after the
+   entries in the flexbit mmap() file.  Every entry is linked into one chain
+   per lookup key,  which covers all rule directions */
+
+#define FLEXBIT_INDEX_NAME	0	/* Flexbit name */
+#define FLEXBIT_INDEX_SRC	1	/* Name + source IP */
+#define FLEXBIT_INDEX_DST	2	/* Name + destination IP */
+#define FLEXBIT_INDEX_BOTH	3	/* Name + source & destination IP */
+#define FLEXBIT_INDEX_CHAINS	4
+
+#define FLEXBIT_SWEEP_INTERVAL	1	/* Seconds between expired flexbit sweeps */
+#define FLEXBIT_SWEEP_BATCH	1024	/* Slots swept per lock */
+
+/* Size of the index for "buckets" buckets per chain */
+
+#define FLEXBIT_INDEX_SIZE(buckets)	( sizeof(_Sagan_IPC_Flexbit_Index) + sizeof(int32_t) * FLEXBIT_INDEX_CHAINS * (buckets) )
+
 bool Flexbit_Condition_MMAP ( int, char *, char *, int, int );
-void Flexbit_Cleanup_MMAP( void );
 void Flexbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port, char *syslog_message );
 bool Flexbit_Count_MMAP( int rule_position, char *ip_src, char *ip_dst );
-
-typedef struct _Sagan_Flexbit_Track _Sagan_Flexbit_Track;
-struct _Sagan_Flexbit_Track
-{
-    char	flexbit_name[64];
-    int		flexbit_timeout;
-    int		flexbit_srcport;
-    int		flexbit_dstport;
-};
+uint32_t Flexbit_Buckets_MMAP( int );
+void Flexbit_Init_MMAP( void );
+void Flexbit_Sweep_MMAP( void );
+void Flexbit_Sweep_Thread( void );
 
 typedef struct _Sagan_IPC_Flexbit _Sagan_IPC_Flexbit;
 struct _Sagan_IPC_Flexbit
 {
+    bool flexbit_used;				/* Slot is linked into the index */
+    uint32_t flexbit_name_hash;
+    int32_t index_next[FLEXBIT_INDEX_CHAINS];	/* Slot + 1,  0 ends the chain */
+    int32_t index_prev[FLEXBIT_INDEX_CHAINS];
     char flexbit_name[64];
     bool flexbit_state;
     unsigned char ip_src[MAXIPBIT];
@@ -51,10 +66,18 @@ struct _Sagan_IPC_Flexbit
     uint64_t flexbit_date;
     uint64_t flexbit_expire;
     int expire;
-    char syslog_message[MAX_SYSLOGMSG];
+    char syslog_message[MAX_IPC_SYSLOGMSG];
     uint64_t sid;
     char signature_msg[MAX_SAGAN_MSG];
 
 };
 
+typedef struct _Sagan_IPC_Flexbit_Index _Sagan_IPC_Flexbit_Index;
+struct _Sagan_IPC_Flexbit_Index
+{
+    uint32_t slots;				/* 'flexbit' size the index was built for */
+    uint32_t buckets;				/* Buckets per chain (power of 2) */
+    int32_t free_list;				/* Recycled slots,  linked via index_next[0] */
+    int32_t head[];				/* FLEXBIT_INDEX_CHAINS * buckets */
+};
 
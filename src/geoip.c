@@ -48,12 +48,13 @@
 #include "rules.h"
 #include "geoip.h"
 #include "sagan-config.h"
+#include "util-counters.h"
+#include "util-radix.h"
 
 struct _SaganConfig *config;
 struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
-struct _SaganCounters *counters;
-struct _Sagan_GeoIP_Skip *GeoIP_Skip;
+struct _Sagan_Radix *GeoIP_Skip;
 
 void Open_GeoIP2_Database( void )
 {
@@ -105,8 +106,6 @@ int GeoIP2_Lookup_Country( char *ipaddr, int rule_position )
 
     unsigned char ip_convert[MAXIPBIT] = { 0 };
 
-    int i = 0;
-
     IP2Bit(ipaddr, ip_convert);
 
     if ( is_notroutable(ip_convert) )
@@ -119,20 +118,15 @@ int GeoIP2_Lookup_Country( char *ipaddr, int rule_position )
             return(GEOIP_SKIP);
         }
 
-    for ( i = 0; i < counters->geoip_skip_count; i++ )
+    if ( Sagan_Radix_Match( Sagan_Radix_Get(&GeoIP_Skip), ip_convert ) )
         {
 
-            if ( is_inrange(ip_convert, (unsigned char *)&GeoIP_Skip[i].range, 1) )
+            if (debug->debuggeoip2)
                 {
-
-                    if (debug->debuggeoip2)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] IP address %s is in GeoIP 'skip_networks'. Skipping lookup.", __FILE__, __LINE__, ipaddr);
-                        }
-
-                    return(GEOIP_SKIP);
+                    Sagan_Log(DEBUG, "[%s, line %d] IP address %s is in GeoIP 'skip_networks'. Skipping lookup.", __FILE__, __LINE__, ipaddr);
                 }
 
+            return(GEOIP_SKIP);
         }
 
     MMDB_lookup_result_s result = MMDB_lookup_string(&config->geoip2, ipaddr, &gai_error, &mmdb_error);
@@ -140,14 +134,14 @@ int GeoIP2_Lookup_Country( char *ipaddr, int rule_position )
 
     res = MMDB_get_value(&result.entry, &entry_data, "country", "iso_code", NULL);
 
-    __atomic_add_fetch(&counters->geoip2_lookup, 1, __ATOMIC_SEQ_CST);
+    Sagan_Counter_Add(geoip2_lookup, 1);
 
     if (res != MMDB_SUCCESS)
         {
 
             Sagan_Log(WARN, "Country code MMDB_get_value failure (%s) for %s.", MMDB_strerror(res), ipaddr);
 
-            __atomic_add_fetch(&counters->geoip2_error, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(geoip2_error, 1);
 
             return(GEOIP_SKIP);
 
@@ -36,17 +36,5 @@
 void Open_GeoIP2_Database( void );
 int GeoIP2_Lookup_Country( char *ipaddr, int rule_position );
 
-typedef struct _Sagan_GeoIP_Skip _Sagan_GeoIP_Skip;
-struct _Sagan_GeoIP_Skip
-{
-
-    struct
-    {
-        unsigned char ipbits[MAXIPBIT];
-        unsigned char maskbits[MAXIPBIT];
-    } range;
-
-};
-
 #endif
 
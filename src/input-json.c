@@ -27,759 +27,262 @@
 #ifdef HAVE_LIBFASTJSON
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "version.h"
 #include "input-pipe.h"
+#include "input-json.h"
+#include "util-json.h"
 
-struct _SaganCounters *counters;
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
 
 struct _Syslog_JSON_Map *Syslog_JSON_Map;
 
-void SyslogInput_JSON( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
-{
-
-    struct json_object *json_obj = NULL;
-    struct json_object *json_obj2 = NULL;
-    struct json_object *tmp = NULL;
+#define JSON_INPUT_FIELD(map, type, field) { offsetof(struct _Syslog_JSON_Map, map), type, offsetof(struct _Sagan_Proc_Syslog, field), sizeof(((struct _Sagan_Proc_Syslog *)0)->field) }
 
-    uint16_t json_str_count=0;
-    uint16_t a;
+/* Where each value in the map ends up */
 
-    bool has_message = false;
-
-    char json_str[JSON_MAX_NEST][JSON_MAX_SIZE] = { { 0 } };
-
-    memset(SaganProcSyslog_LOCAL, 0, sizeof(_Sagan_Proc_Syslog));
+static const struct _JSON_Input_Field JSON_Input_Fields[JSON_INPUT_FIELDS] =
+{
+    JSON_INPUT_FIELD(syslog_map_host, JSON_INPUT_HOST, syslog_host),
+    JSON_INPUT_FIELD(syslog_map_facility, JSON_INPUT_STRING, syslog_facility),
+    JSON_INPUT_FIELD(syslog_map_priority, JSON_INPUT_STRING, syslog_priority),
+    JSON_INPUT_FIELD(syslog_map_level, JSON_INPUT_STRING, syslog_level),
+    JSON_INPUT_FIELD(syslog_map_tag, JSON_INPUT_STRING, syslog_tag),
+    JSON_INPUT_FIELD(syslog_map_date, JSON_INPUT_STRING, syslog_date),
+    JSON_INPUT_FIELD(syslog_map_time, JSON_INPUT_STRING, syslog_time),
+    JSON_INPUT_FIELD(syslog_map_program, JSON_INPUT_STRING, syslog_program),
+    JSON_INPUT_FIELD(syslog_map_message, JSON_INPUT_MESSAGE, syslog_message),
+    JSON_INPUT_FIELD(src_ip, JSON_INPUT_STRING, src_ip),
+    JSON_INPUT_FIELD(dst_ip, JSON_INPUT_STRING, dst_ip),
+    JSON_INPUT_FIELD(src_port, JSON_INPUT_PORT, src_port),
+    JSON_INPUT_FIELD(dst_port, JSON_INPUT_PORT, dst_port),
+    JSON_INPUT_FIELD(proto, JSON_INPUT_PROTO, proto),
+    JSON_INPUT_FIELD(md5, JSON_INPUT_STRING, md5),
+    JSON_INPUT_FIELD(sha1, JSON_INPUT_STRING, sha1),
+    JSON_INPUT_FIELD(sha256, JSON_INPUT_STRING, sha256),
+    JSON_INPUT_FIELD(filename, JSON_INPUT_STRING, filename),
+    JSON_INPUT_FIELD(hostname, JSON_INPUT_STRING, hostname),
+    JSON_INPUT_FIELD(url, JSON_INPUT_STRING, url),
+    JSON_INPUT_FIELD(ja3, JSON_INPUT_STRING, ja3),
+    JSON_INPUT_FIELD(flow_id, JSON_INPUT_FLOW_ID, flow_id)
+};
+
+/* Sagan_JSON_Walk() callback.  Stores "value" in every field mapped to
+   "key".  When nested JSON is searched,  a value from a later nest takes
+   over one from an earlier nest (the top level is nest 0). */
+
+static void SyslogInput_JSON_Field( void *data, uint16_t nest, const char *key, size_t key_len, const struct _Sagan_JSON_Value *value )
+{
 
-    memcpy(SaganProcSyslog_LOCAL->syslog_program, "UNDEFINED\0", sizeof(SaganProcSyslog_LOCAL->syslog_program));
-    memcpy(SaganProcSyslog_LOCAL->syslog_time, "UNDEFINED\0", sizeof(SaganProcSyslog_LOCAL->syslog_time));
-    memcpy(SaganProcSyslog_LOCAL->syslog_date, "UNDEFINED\0", sizeof(SaganProcSyslog_LOCAL->syslog_date));
-    memcpy(SaganProcSyslog_LOCAL->syslog_tag, "UNDEFINED\0", sizeof(SaganProcSyslog_LOCAL->syslog_tag));
-    memcpy(SaganProcSyslog_LOCAL->syslog_level, "UNDEFINED\0", sizeof(SaganProcSyslog_LOCAL->syslog_level));
-    memcpy(SaganProcSyslog_LOCAL->syslog_priority, "UNDEFINED\0", sizeof(SaganProcSyslog_LOCAL->syslog_priority));
-    memcpy(SaganProcSyslog_LOCAL->syslog_facility, "UNDEFINED\0", sizeof(SaganProcSyslog_LOCAL->syslog_facility));
-    memcpy(SaganProcSyslog_LOCAL->syslog_host, "0.0.0.0\0", sizeof(SaganProcSyslog_LOCAL->syslog_host));
+    struct _JSON_Input_State *state = data;
+    const struct _JSON_Input_Field *field = NULL;
 
-    SaganProcSyslog_LOCAL->md5[0] = '\0';
+    char *dst = NULL;
+    const char *map = NULL;
+    char tmp[32] = { 0 };
 
-    /* If the json isn't nested,  we can do this the easy way */
+    int i;
 
-    if ( Syslog_JSON_Map->is_nested == false )
+    if ( debug->debugjson )
         {
-
-            json_obj = json_tokener_parse(syslog_string);
-
-            if ( json_obj == NULL )
-                {
-
-                    if ( syslog_string != NULL )
-                        {
-                            Sagan_Log(WARN, "[%s, line %d] Libfastjson failed to decode JSON. Got: %s", __FILE__, __LINE__, syslog_string);
-                        }
-                    else
-                        {
-                            Sagan_Log(WARN, "[%s, line %d] Libfastjson failed to decode JSON. Got NULL data.", __FILE__, __LINE__);
-                        }
-
-
-                    json_object_put(json_obj);
-
-                    __atomic_add_fetch(&counters->malformed_json_input_count, 1, __ATOMIC_SEQ_CST);
-                    return;
-                }
-
-
-            __atomic_add_fetch(&counters->json_input_count, 1, __ATOMIC_SEQ_CST);
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->syslog_map_host, &tmp))
-                {
-
-                    const char *syslog_host = json_object_get_string(tmp);
-
-                    if ( syslog_host != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_host, syslog_host, sizeof(SaganProcSyslog_LOCAL->syslog_host));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->syslog_map_facility, &tmp))
-                {
-
-                    const char *syslog_facility = json_object_get_string(tmp);
-
-                    if ( syslog_facility != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_facility, syslog_facility, sizeof(SaganProcSyslog_LOCAL->syslog_facility));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->syslog_map_priority, &tmp))
-                {
-
-                    const char *syslog_priority = json_object_get_string(tmp);
-
-                    if ( syslog_priority != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_priority, syslog_priority, sizeof(SaganProcSyslog_LOCAL->syslog_priority));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->syslog_map_level, &tmp))
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->syslog_level, json_object_get_string(tmp), sizeof(SaganProcSyslog_LOCAL->syslog_level));
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->syslog_map_tag, &tmp))
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->syslog_tag, json_object_get_string(tmp), sizeof(SaganProcSyslog_LOCAL->syslog_tag));
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->syslog_map_date, &tmp))
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->syslog_date, json_object_get_string(tmp), sizeof(SaganProcSyslog_LOCAL->syslog_date));
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->src_ip, &tmp))
-                {
-
-                    const char *src_ip = json_object_get_string(tmp);
-
-                    if ( src_ip != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->src_ip, src_ip, sizeof(SaganProcSyslog_LOCAL->src_ip));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->dst_ip, &tmp))
-                {
-
-                    const char *dst_ip = json_object_get_string(tmp);
-
-                    if ( dst_ip != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->dst_ip, dst_ip, sizeof(SaganProcSyslog_LOCAL->dst_ip));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->src_port, &tmp))
-                {
-
-                    const char *src_port = json_object_get_string(tmp);
-
-                    if ( src_port != NULL )
-                        {
-                            SaganProcSyslog_LOCAL->src_port = atoi( src_port );
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->dst_port, &tmp))
-                {
-
-                    const char *dst_port = json_object_get_string(tmp);
-
-                    if ( dst_port != NULL )
-                        {
-                            SaganProcSyslog_LOCAL->dst_port = atoi( dst_port );
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->syslog_map_time, &tmp))
-                {
-
-                    const char *syslog_time = json_object_get_string(tmp);
-
-                    if ( syslog_time != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_time, syslog_time, sizeof(SaganProcSyslog_LOCAL->syslog_time));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->syslog_map_program, &tmp))
-                {
-
-                    const char *syslog_program = json_object_get_string(tmp);
-
-                    if ( syslog_program != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_program, syslog_program, sizeof(SaganProcSyslog_LOCAL->syslog_program));
-                        }
-
-                }
-
-            if ( !strcmp(Syslog_JSON_Map->syslog_map_message, "%JSON%" ) )
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->syslog_message, syslog_string, sizeof(SaganProcSyslog_LOCAL->syslog_message));
-                    has_message = true;
-
-                }
-
-            else if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->syslog_map_message, &tmp))
-                {
-                    const char *msg_tmp = json_object_get_string(tmp);
-
-                    if ( msg_tmp !=  NULL )
-                        {
-
-                            char msg[MAX_SYSLOGMSG] = { 0 };
-
-                            strlcpy(msg, msg_tmp, sizeof(msg));
-
-                            if (msg[0] == ' ')
-                                {
-                                    /* rsyslog retains the leading space in the message */
-
-                                    strlcpy(SaganProcSyslog_LOCAL->syslog_message, msg, sizeof(SaganProcSyslog_LOCAL->syslog_message));
-                                }
-                            else
-                                {
-                                    /* syslog-ng strips the leading space: re-insert it */
-
-                                    snprintf(SaganProcSyslog_LOCAL->syslog_message, sizeof(SaganProcSyslog_LOCAL->syslog_message)," %s", msg);
-                                    SaganProcSyslog_LOCAL->syslog_message[ (sizeof(SaganProcSyslog_LOCAL->syslog_message) -1 ) ] = '\0';
-                                }
-
-                            has_message = true;
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->proto, &tmp))
-                {
-
-                    const char *proto = json_object_get_string(tmp);
-
-                    if ( proto != NULL )
-                        {
-
-                            if ( !strcmp( proto, "tcp" ) || !strcmp( proto, "TCP" ) )
-                                {
-                                    SaganProcSyslog_LOCAL->proto = 6;
-                                }
-
-                            else if ( !strcmp( proto, "udp" ) || !strcmp( proto, "UDP" ) )
-                                {
-                                    SaganProcSyslog_LOCAL->proto = 17;
-                                }
-
-                            else if ( !strcmp( proto, "icmp" ) || !strcmp( proto, "ICMP" ) )
-                                {
-                                    SaganProcSyslog_LOCAL->proto = 1;
-                                }
-
-                        }
-
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->md5, &tmp))
-                {
-
-                    const char *md5 = json_object_get_string(tmp);
-
-                    if ( md5 != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->md5, md5, sizeof(SaganProcSyslog_LOCAL->md5));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->sha1, &tmp))
-                {
-
-                    const char *sha1 = json_object_get_string(tmp);
-
-                    if ( sha1 != NULL )
-                        {
-
-                            strlcpy(SaganProcSyslog_LOCAL->sha1, sha1, sizeof(SaganProcSyslog_LOCAL->sha1));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->sha256, &tmp))
-                {
-
-                    const char *sha256 = json_object_get_string(tmp);
-
-                    if ( sha256 != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->sha256, sha256, sizeof(SaganProcSyslog_LOCAL->sha256));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->filename, &tmp))
-                {
-
-                    const char *filename = json_object_get_string(tmp);
-
-                    if ( filename != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->filename, filename, sizeof(SaganProcSyslog_LOCAL->filename));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->hostname, &tmp))
-                {
-
-                    const char *hostname = json_object_get_string(tmp);
-
-                    if ( hostname != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->hostname, hostname, sizeof(SaganProcSyslog_LOCAL->hostname));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->url, &tmp))
-                {
-
-                    const char *url = json_object_get_string(tmp);
-
-                    if ( url != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->url, url, sizeof(SaganProcSyslog_LOCAL->url));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->ja3, &tmp))
-                {
-
-                    const char *ja3 = json_object_get_string(tmp);
-
-                    if ( ja3 != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->ja3, ja3, sizeof(SaganProcSyslog_LOCAL->ja3));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj, Syslog_JSON_Map->flow_id, &tmp))
-                {
-
-                    const char *flow_id = json_object_get_string(tmp);
-
-                    if ( flow_id != NULL )
-                        {
-                            SaganProcSyslog_LOCAL->flow_id = atol( flow_id );
-                        }
-                }
-
-
+            Sagan_Log(DEBUG, "Key: \"%.*s\", Value: \"%.*s\" (nest %d)", (int)key_len, key, (int)value->len, value->ptr, nest );
         }
-    else
-        {
-
-            /* The raw syslog is the first "nested" level".  Copy that */
-
-            strlcpy(json_str[0], syslog_string, sizeof(json_str[0]));
-            json_str_count++;
-            json_obj = json_tokener_parse(syslog_string);
-
-            if ( json_obj == NULL )
-                {
-
-                    if ( debug->debugmalformed )
-                        {
-                            Sagan_Log(WARN, "[%s, line %d] Libfastjson failed to decode JSON input. The log line was: \"%s\"", __FILE__, __LINE__, syslog_string);
-                        }
-
-                    json_object_put(json_obj);
-
-                    __atomic_add_fetch(&counters->malformed_json_input_count, 1, __ATOMIC_SEQ_CST);
-                    return;
-                }
-
-            struct json_object_iterator it = json_object_iter_begin(json_obj);
-            struct json_object_iterator itEnd = json_object_iter_end(json_obj);
-
-
-            /* Search through all key/values looking for embedded JSON */
-
-
-            while (!json_object_iter_equal(&it, &itEnd))
-                {
-
-                    const char *key = json_object_iter_peek_name(&it);
-                    struct json_object *const val = json_object_iter_peek_value(&it);
-
-                    const char *val_str = json_object_get_string(val);
-
-                    if ( debug->debugjson )
-                        {
-                            Sagan_Log(DEBUG, "Key: \"%s\", Value: \"%s\"", key, val_str );
-
-                        }
-
-                    /* Is there nested JSON */
-
-                    if ( val_str != NULL && val_str[0] == '{' )
-                        {
-                            /* Validate it before handing it to the parser to save CPU */
-
-                            json_obj2 = json_tokener_parse(val_str);
-
-                            if ( json_obj2 != NULL )
-                                {
-
-                                    strlcpy(json_str[json_str_count], val_str, sizeof(json_str[json_str_count]));
-                                    json_str_count++;
-
-                                    struct json_object_iterator it2 = json_object_iter_begin(json_obj2);
-                                    struct json_object_iterator itEnd2 = json_object_iter_end(json_obj2);
-
-                                    /* Look for any second tier/third tier JSON */
-
-                                    while (!json_object_iter_equal(&it2, &itEnd2))
-                                        {
-
-                                            const char *key2 = json_object_iter_peek_name(&it2);
-                                            struct json_object *const val2 = json_object_iter_peek_value(&it2);
-
-                                            const char *val_str2 = json_object_get_string(val2);
-
-                                            if ( debug->debugjson )
-                                                {
-                                                    Sagan_Log(DEBUG, "Key2: \"%s\", Value: \"%s\"", key2, val_str );
-
-                                                }
-
-                                            if ( val_str2[0] == '{' )
-                                                {
-
-                                                    strlcpy(json_str[json_str_count], val_str2, sizeof(json_str[json_str_count]));
-                                                    json_str_count++;
-
-                                                }
-
-                                            json_object_iter_next(&it2);
-
-                                        }
-
-                                } /* json_obj2 != NULL */
-
-                            json_object_put(json_obj2);
-
-                        }
-
-
-                    json_object_iter_next(&it);
-
-                }
 
+    if ( key_len == 0 || key_len >= sizeof(Syslog_JSON_Map->syslog_map_host) || value->type == SAGAN_JSON_NULL )
+        {
+            return;
         }
 
-    /* This json_object_put works fine with the above (no leak but faults with the
-       below */
-
-    json_object_put(json_obj);
-
-    /* Search through the nest to see if we can find out values */
-
-
-    for ( a = 0; a < json_str_count; a++ )
+    for ( i = 0; i < JSON_INPUT_FIELDS; i++ )
         {
 
-            struct json_object *json_obj_sub = NULL;
-            json_obj_sub = json_tokener_parse(json_str[a]);
+            field = &JSON_Input_Fields[i];
+            map = (const char *)Syslog_JSON_Map + field->map;
 
-            if ( json_obj_sub == NULL )
+            if ( map[0] != key[0] || map[key_len] != '\0' || memcmp(map, key, key_len) != 0 )
                 {
-                    Sagan_Log(WARN, "[%s, line %d] Detected JSON nest but Libfastjson errors. The log line was: \"%s\"", __FILE__, __LINE__, json_str[a]);
-                    json_object_put(json_obj_sub);
-
-                    __atomic_add_fetch(&counters->malformed_json_input_count, 1, __ATOMIC_SEQ_CST);
-                    return;
+                    continue;
                 }
 
-            __atomic_add_fetch(&counters->json_input_count, 1, __ATOMIC_SEQ_CST);
-
-
-            if ( !strcmp(Syslog_JSON_Map->syslog_map_message, "%JSON%" ) )
+            if ( nest < state->nest[i] || ( field->type == JSON_INPUT_MESSAGE && state->json_message == true ) )
                 {
-
-                    strlcpy(SaganProcSyslog_LOCAL->syslog_message, syslog_string, sizeof(SaganProcSyslog_LOCAL->syslog_message));
-                    has_message = true;
-
+                    continue;
                 }
 
-            else if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->syslog_map_message, &tmp))
-                {
-                    const char *msg = json_object_get_string(tmp);
-
-                    if ( msg != NULL )
-                        {
-
-                            if (msg[0] == ' ')
-                                {
-                                    /* rsyslog retains the leading space in the message */
-
-                                    strlcpy(SaganProcSyslog_LOCAL->syslog_message, msg, sizeof(SaganProcSyslog_LOCAL->syslog_message));
-                                }
-                            else
-                                {
-                                    /* syslog-ng strips the leading space: re-insert it */
+            dst = (char *)state->SaganProcSyslog_LOCAL + field->offset;
 
-                                    snprintf(SaganProcSyslog_LOCAL->syslog_message, sizeof(SaganProcSyslog_LOCAL->syslog_message)," %s", msg);
-                                    SaganProcSyslog_LOCAL->syslog_message[ (sizeof(SaganProcSyslog_LOCAL->syslog_message) -1 ) ] = '\0';
-                                }
-
-                            has_message = true;
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->syslog_map_host, &tmp))
+            switch ( field->type )
                 {
 
-                    const char *syslog_host = json_object_get_string(tmp);
+                case JSON_INPUT_STRING:
+                    Sagan_JSON_Copy(value, dst, field->size);
+                    break;
 
-                    if ( *syslog_host != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_host, syslog_host, sizeof(SaganProcSyslog_LOCAL->syslog_host));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->syslog_map_facility, &tmp))
-                {
-
-                    const char *syslog_facility = json_object_get_string(tmp);
-
-                    if ( syslog_facility != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_facility, syslog_facility, sizeof(SaganProcSyslog_LOCAL->syslog_facility));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->syslog_map_priority, &tmp))
-                {
+                case JSON_INPUT_HOST:
 
-                    const char *syslog_priority = json_object_get_string(tmp);
+                    /* An empty host leaves the "0.0.0.0" default alone */
 
-                    if ( syslog_priority != NULL )
+                    if ( value->len == 0 )
                         {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_priority, syslog_priority, sizeof(SaganProcSyslog_LOCAL->syslog_priority));
+                            continue;
                         }
-                }
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->syslog_map_level, &tmp))
-                {
+                    Sagan_JSON_Copy(value, dst, field->size);
+                    break;
 
-                    const char *syslog_level = json_object_get_string(tmp);
+                case JSON_INPUT_MESSAGE:
 
-                    if ( syslog_level != NULL )
+                    if ( value->type == SAGAN_JSON_STRING && value->len > 0 && value->ptr[0] == ' ' )
                         {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_level, syslog_level, sizeof(SaganProcSyslog_LOCAL->syslog_level));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->syslog_map_tag, &tmp))
-                {
-
-                    const char *syslog_tag = json_object_get_string(tmp);
-
-                    if ( syslog_tag != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_tag, syslog_tag, sizeof(SaganProcSyslog_LOCAL->syslog_tag));
-                        }
-                }
+                            /* rsyslog retains the leading space in the message */
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->syslog_map_date, &tmp))
-                {
-
-                    const char *syslog_date = json_object_get_string(tmp);
-
-                    if ( syslog_date != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_date, syslog_date, sizeof(SaganProcSyslog_LOCAL->syslog_date));
+                            Sagan_JSON_Copy(value, dst, field->size);
                         }
-                }
-
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->syslog_map_time, &tmp))
-                {
-
-                    const char *syslog_time = json_object_get_string(tmp);
-
-                    if ( syslog_time != NULL )
+                    else
                         {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_time, syslog_time, sizeof(SaganProcSyslog_LOCAL->syslog_time));
-                        }
-                }
+                            /* syslog-ng strips the leading space: re-insert it */
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->syslog_map_program, &tmp))
-                {
-
-                    const char *syslog_program = json_object_get_string(tmp);
-
-                    if ( syslog_program != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->syslog_program, syslog_program, sizeof(SaganProcSyslog_LOCAL->syslog_program));
+                            dst[0] = ' ';
+                            Sagan_JSON_Copy(value, dst + 1, field->size - 1);
                         }
-                }
 
+                    state->has_message = true;
+                    break;
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->src_ip, &tmp))
-                {
+                case JSON_INPUT_PORT:
+                    Sagan_JSON_Copy(value, tmp, sizeof(tmp));
+                    *(uint32_t *)dst = atoi( tmp );
+                    break;
 
-                    const char *src_ip = json_object_get_string(tmp);
+                case JSON_INPUT_FLOW_ID:
+                    Sagan_JSON_Copy(value, tmp, sizeof(tmp));
+                    *(uint64_t *)dst = atol( tmp );
+                    break;
 
-                    if ( src_ip != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->src_ip, src_ip, sizeof(SaganProcSyslog_LOCAL->src_ip));
-                        }
-                }
-
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->dst_ip, &tmp))
-                {
+                case JSON_INPUT_PROTO:
 
-                    const char *dst_ip = json_object_get_string(tmp);
+                    Sagan_JSON_Copy(value, tmp, sizeof(tmp));
 
-                    if ( dst_ip != NULL )
+                    if ( !strcmp( tmp, "tcp" ) || !strcmp( tmp, "TCP" ) )
                         {
-                            strlcpy(SaganProcSyslog_LOCAL->dst_ip, dst_ip, sizeof(SaganProcSyslog_LOCAL->dst_ip));
+                            *(unsigned char *)dst = 6;
                         }
-                }
-
-
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->src_port, &tmp))
-                {
-
-                    const char *src_port = json_object_get_string(tmp);
 
-                    if ( src_port != NULL )
+                    else if ( !strcmp( tmp, "udp" ) || !strcmp( tmp, "UDP" ) )
                         {
-                            SaganProcSyslog_LOCAL->src_port = atoi( src_port );
+                            *(unsigned char *)dst = 17;
                         }
-                }
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->dst_port, &tmp))
-                {
-
-                    const char *dst_port = json_object_get_string(tmp);
-
-                    if ( dst_port != NULL )
+                    else if ( !strcmp( tmp, "icmp" ) || !strcmp( tmp, "ICMP" ) )
                         {
-                            SaganProcSyslog_LOCAL->dst_port = atoi( dst_port );
+                            *(unsigned char *)dst = 1;
                         }
-                }
-
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->proto, &tmp))
-                {
 
-                    const char *proto = json_object_get_string(tmp);
-
-                    if ( proto != NULL )
+                    else
                         {
-
-                            if ( !strcmp( proto, "tcp" ) || !strcmp( proto, "TCP" ) )
-                                {
-                                    SaganProcSyslog_LOCAL->proto = 6;
-                                }
-
-                            else if ( !strcmp( proto, "udp" ) || !strcmp( proto, "UDP" ) )
-                                {
-                                    SaganProcSyslog_LOCAL->proto = 17;
-                                }
-
-                            else if ( !strcmp( proto, "icmp" ) || !strcmp( proto, "ICMP" ) )
-                                {
-                                    SaganProcSyslog_LOCAL->proto = 1;
-                                }
-
+                            continue;	/* Unknown,  doesn't replace an earlier one */
                         }
-                }
-
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->md5, &tmp))
-                {
 
-                    const char *md5 = json_object_get_string(tmp);
+                    break;
 
-                    if ( md5 != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->md5, md5, sizeof(SaganProcSyslog_LOCAL->md5));
-                        }
                 }
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->sha1, &tmp))
-                {
-
-                    const char *sha1 = json_object_get_string(tmp);
-
-                    if ( sha1 != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->sha1, sha1, sizeof(SaganProcSyslog_LOCAL->sha1));
-                        }
-                }
+            state->nest[i] = nest;
+        }
+}
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->sha256, &tmp))
-                {
+/* Resets every field.  Only the first byte of the strings is cleared,
+   zeroing the whole structure (~75k) cost more than parsing the JSON. */
 
-                    const char *sha256 = json_object_get_string(tmp);
+static void SyslogInput_JSON_Defaults( struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+{
 
-                    if ( sha256 != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->sha256, sha256, sizeof(SaganProcSyslog_LOCAL->sha256));
-                        }
-                }
+    SaganProcSyslog_LOCAL->syslog_message[0] = '\0';
+    SaganProcSyslog_LOCAL->src_ip[0] = '\0';
+    SaganProcSyslog_LOCAL->dst_ip[0] = '\0';
+    SaganProcSyslog_LOCAL->src_port = 0;
+    SaganProcSyslog_LOCAL->dst_port = 0;
+    SaganProcSyslog_LOCAL->proto = 0;
+    SaganProcSyslog_LOCAL->flow_id = 0;
+    SaganProcSyslog_LOCAL->md5[0] = '\0';
+    SaganProcSyslog_LOCAL->sha1[0] = '\0';
+    SaganProcSyslog_LOCAL->sha256[0] = '\0';
+    SaganProcSyslog_LOCAL->filename[0] = '\0';
+    SaganProcSyslog_LOCAL->hostname[0] = '\0';
+    SaganProcSyslog_LOCAL->url[0] = '\0';
+    SaganProcSyslog_LOCAL->ja3[0] = '\0';
+
+    strlcpy(SaganProcSyslog_LOCAL->syslog_program, "UNDEFINED", sizeof(SaganProcSyslog_LOCAL->syslog_program));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_time, "UNDEFINED", sizeof(SaganProcSyslog_LOCAL->syslog_time));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_date, "UNDEFINED", sizeof(SaganProcSyslog_LOCAL->syslog_date));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_tag, "UNDEFINED", sizeof(SaganProcSyslog_LOCAL->syslog_tag));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_level, "UNDEFINED", sizeof(SaganProcSyslog_LOCAL->syslog_level));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_priority, "UNDEFINED", sizeof(SaganProcSyslog_LOCAL->syslog_priority));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_facility, "UNDEFINED", sizeof(SaganProcSyslog_LOCAL->syslog_facility));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_host, "0.0.0.0", sizeof(SaganProcSyslog_LOCAL->syslog_host));
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->filename, &tmp))
-                {
+}
 
-                    const char *filename = json_object_get_string(tmp);
+/****************************************************************************
+ * SyslogInput_JSON - Pulls the fields in the JSON input map out of
+ * "syslog_string" in a single pass.  With a "nested" map,  objects (or
+ * strings holding JSON objects) two levels under the top are searched as
+ * well.  "syslog_string" is used as scratch space for nested JSON.
+ ****************************************************************************/
 
-                    if ( filename != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->filename, filename, sizeof(SaganProcSyslog_LOCAL->filename));
-                        }
-                }
+void SyslogInput_JSON( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+{
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->hostname, &tmp))
-                {
+    struct _JSON_Input_State state = { 0 };
 
-                    const char *hostname = json_object_get_string(tmp);
+    SyslogInput_JSON_Defaults(SaganProcSyslog_LOCAL);
 
-                    if ( hostname != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->hostname, hostname, sizeof(SaganProcSyslog_LOCAL->hostname));
-                        }
-                }
+    if ( syslog_string == NULL )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Failed to decode JSON. Got NULL data.", __FILE__, __LINE__);
+            Sagan_Counter_Add(malformed_json_input_count, 1);
+            return;
+        }
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->url, &tmp))
-                {
+    state.SaganProcSyslog_LOCAL = SaganProcSyslog_LOCAL;
 
-                    const char *url = json_object_get_string(tmp);
+    if ( !strcmp(Syslog_JSON_Map->syslog_map_message, "%JSON%" ) )
+        {
+            strlcpy(SaganProcSyslog_LOCAL->syslog_message, syslog_string, sizeof(SaganProcSyslog_LOCAL->syslog_message));
+            state.json_message = true;
+            state.has_message = true;
+        }
 
-                    if ( url != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->url, url, sizeof(SaganProcSyslog_LOCAL->url));
-                        }
-                }
+    if ( Sagan_JSON_Walk(syslog_string, strlen(syslog_string), Syslog_JSON_Map->is_nested == true ? JSON_INPUT_NEST_LEVELS : 1,
+                         JSON_MAX_NEST, NULL, SyslogInput_JSON_Field, &state) == false )
+        {
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->ja3, &tmp))
+            if ( Syslog_JSON_Map->is_nested == false || debug->debugmalformed )
                 {
-
-                    const char *ja3 = json_object_get_string(tmp);
-
-                    if ( ja3 != NULL )
-                        {
-                            strlcpy(SaganProcSyslog_LOCAL->ja3, ja3, sizeof(SaganProcSyslog_LOCAL->ja3));
-                        }
+                    Sagan_Log(WARN, "[%s, line %d] Failed to decode JSON input. The log line was: \"%s\"", __FILE__, __LINE__, syslog_string);
                 }
 
-            if ( json_object_object_get_ex(json_obj_sub, Syslog_JSON_Map->flow_id, &tmp))
-                {
+            /* Don't hand the engine half of a log line */
 
-                    const char *flow_id = json_object_get_string(tmp);
-
-                    if ( flow_id != NULL )
-                        {
-                            SaganProcSyslog_LOCAL->flow_id = atol( flow_id );
-                        }
-                }
-
-            json_object_put(json_obj_sub);
+            SyslogInput_JSON_Defaults(SaganProcSyslog_LOCAL);
 
+            Sagan_Counter_Add(malformed_json_input_count, 1);
+            return;
         }
 
-    if ( has_message == false )
+    Sagan_Counter_Add(json_input_count, 1);
+
+    if ( state.has_message == false )
         {
             Sagan_Log(WARN, "[%s, line %d] Received JSON which has no decoded 'message' value. The log line was: \"%s\"", __FILE__, __LINE__, syslog_string);
         }
@@ -21,3 +21,35 @@
 void SyslogInput_JSON( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL );
 
 
+
+#define JSON_INPUT_NEST_LEVELS	3		/* Top level + two levels of nest */
+
+#define JSON_INPUT_STRING	1
+#define JSON_INPUT_MESSAGE	2
+#define JSON_INPUT_PORT		3
+#define JSON_INPUT_FLOW_ID	4
+#define JSON_INPUT_PROTO	5
+#define JSON_INPUT_HOST		6
+
+#define JSON_INPUT_FIELDS	22
+
+/* Offsets of a _Syslog_JSON_Map key and the _Sagan_Proc_Syslog member it
+   fills in */
+
+typedef struct _JSON_Input_Field _JSON_Input_Field;
+struct _JSON_Input_Field
+{
+    size_t map;
+    unsigned char type;
+    size_t offset;
+    size_t size;
+};
+
+typedef struct _JSON_Input_State _JSON_Input_State;
+struct _JSON_Input_State
+{
+    struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL;
+    bool has_message;
+    bool json_message;				/* Message is "%JSON%" */
+    uint16_t nest[JSON_INPUT_FIELDS];		/* Nest each field came from */
+};
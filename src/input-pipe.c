@@ -30,6 +30,7 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "version.h"
 #include "input-pipe.h"
 
@@ -89,7 +90,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
                                 {
 
                                     strlcpy(src_dns_lookup, config->sagan_host, sizeof(src_dns_lookup));
-                                    counters->dns_miss_count++;
+                                    Sagan_Counter_Add(dns_miss_count, 1);
 
                                 }
 
@@ -126,7 +127,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
                 {
                     strlcpy(SaganProcSyslog_LOCAL->syslog_host, config->sagan_host, sizeof(SaganProcSyslog_LOCAL->syslog_host));
 
-                    counters->malformed_host++;
+                    Sagan_Counter_Add(malformed_host, 1);
 
                     if ( debug->debugmalformed )
                         {
@@ -150,7 +151,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
 
             strlcpy(SaganProcSyslog_LOCAL->syslog_facility, "SAGAN: FACILITY ERROR", sizeof(SaganProcSyslog_LOCAL->syslog_facility));
 
-            counters->malformed_facility++;
+            Sagan_Counter_Add(malformed_facility, 1);
 
             if ( debug->debugmalformed )
                 {
@@ -170,7 +171,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
 
             strlcpy(SaganProcSyslog_LOCAL->syslog_priority, "SAGAN: PRIORITY ERROR", sizeof(SaganProcSyslog_LOCAL->syslog_priority));
 
-            counters->malformed_priority++;
+            Sagan_Counter_Add(malformed_priority, 1);
 
             if ( debug->debugmalformed )
                 {
@@ -192,7 +193,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
 
             strlcpy(SaganProcSyslog_LOCAL->syslog_level, "SAGAN: LEVEL ERROR", sizeof(SaganProcSyslog_LOCAL->syslog_level));
 
-            counters->malformed_level++;
+            Sagan_Counter_Add(malformed_level, 1);
 
             if ( debug->debugmalformed )
                 {
@@ -214,7 +215,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
 
             strlcpy(SaganProcSyslog_LOCAL->syslog_tag, "SAGAN: TAG ERROR", sizeof(SaganProcSyslog_LOCAL->syslog_tag));
 
-            counters->malformed_tag++;
+            Sagan_Counter_Add(malformed_tag, 1);
 
             if ( debug->debugmalformed )
                 {
@@ -234,7 +235,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
 
             strlcpy(SaganProcSyslog_LOCAL->syslog_date, "SAGAN: DATE ERROR", sizeof(SaganProcSyslog_LOCAL->syslog_date));
 
-            counters->malformed_date++;
+            Sagan_Counter_Add(malformed_date, 1);
 
             if ( debug->debugmalformed )
                 {
@@ -255,7 +256,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
 
             strlcpy( SaganProcSyslog_LOCAL->syslog_time, "SAGAN: TIME ERROR", sizeof(SaganProcSyslog_LOCAL->syslog_time) );
 
-            counters->malformed_time++;
+            Sagan_Counter_Add(malformed_time, 1);
 
             if ( debug->debugmalformed )
                 {
@@ -276,7 +277,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
 
             strlcpy( SaganProcSyslog_LOCAL->syslog_program, "SAGAN: PROGRAM ERROR", sizeof(SaganProcSyslog_LOCAL->syslog_program) );
 
-            counters->malformed_program++;
+            Sagan_Counter_Add(malformed_program, 1);
 
             if ( debug->debugmalformed )
                 {
@@ -299,7 +300,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
 
             strlcpy( SaganProcSyslog_LOCAL->syslog_message, "SAGAN: MESSAGE ERROR", sizeof(SaganProcSyslog_LOCAL->syslog_message) );
 
-            counters->malformed_message++;
+            Sagan_Counter_Add(malformed_message, 1);
 
             if ( debug->debugmalformed )
                 {
@@ -310,7 +311,7 @@ void SyslogInput_Pipe( char *syslog_string, struct _Sagan_Proc_Syslog *SaganProc
             /* If the message is lost,  all is lost.  Typically,  you don't lose part of the message,
              * it's more likely to lose all  - Champ Clark III 11/17/2011 */
 
-            counters->sagan_log_drop++;
+            Sagan_Counter_Add(sagan_log_drop, 1);
 
         }
     else
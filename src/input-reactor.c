@@ -0,0 +1,1581 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* input-reactor.c
+ *
+ * The log line reader.  Every input source (the FIFO or file Sagan has
+ * always read,  plus anything in "input-sources") is non-blocking and
+ * watched with epoll (poll() where epoll isn't available),  so a slow or
+ * missing writer on one source doesn't hold up the others.  Streams are
+ * read in large chunks and split into lines in place.  Lines go straight
+ * into the batch ring along with which parser (pipe,  JSON or raw syslog)
+ * the source uses.
+ *
+ * Datagrams are received in batches with recvmmsg().  With
+ * "input-udp-threads",  every UDP source gets that many SO_REUSEPORT
+ * sockets instead,  each read by its own thread,  and the kernel spreads
+ * the senders over them.  Every reader thread fills its own batch,  the
+ * ring takes any number of producers.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <pthread.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "util-counters.h"
+#include "ignore-list.h"
+#include "lockfile.h"
+#include "stats.h"
+#include "util-mpmc.h"
+#include "util-ring.h"
+#include "output-queue.h"
+#include "util-writer.h"
+#include "input-reactor.h"
+#include "parsers/parsers.h"
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+struct _SaganDebug *debug;
+struct _Sagan_Ring *SaganRing;
+struct _Sagan_Ignorelist *SaganIgnorelist;
+
+int proc_running;
+
+static struct _Sagan_Input_Source *Input_Source = NULL;
+static int Input_Source_Count = 0;
+
+static struct _Sagan_Input_Source *Input_Plog = NULL;
+
+/* Per reader thread */
+
+static __thread struct _Sagan_Ring_Slot *Input_Slot = NULL;	/* Batch being filled */
+static __thread char *Input_Scratch = NULL;			/* Lines dropped when the ring is full */
+static __thread struct sockaddr_storage Input_Scratch_Peer;
+
+
+#ifdef HAVE_SYS_EPOLL_H
+static int Input_Epoll = -1;
+#endif
+
+static const char *Sagan_Input_Type_Name( unsigned char type )
+{
+
+    switch ( type )
+        {
+
+        case INPUT_SOURCE_FIFO:
+            return("FIFO");
+
+        case INPUT_SOURCE_FILE:
+            return("FILE");
+
+        case INPUT_SOURCE_UDP:
+            return("UDP");
+
+        case INPUT_SOURCE_TCP:
+        case INPUT_SOURCE_TCP_CLIENT:
+            return("TCP");
+
+        case INPUT_SOURCE_UNIX:
+            return("UNIX");
+
+        case INPUT_SOURCE_PLOG:
+            return("PLOG");
+
+        }
+
+    return("UNKNOWN");
+}
+
+static const char *Sagan_Input_Parser_Name( unsigned char input_type )
+{
+
+    switch ( input_type )
+        {
+
+        case INPUT_PIPE:
+            return("pipe");
+
+        case INPUT_JSON:
+            return("json");
+
+        case INPUT_SYSLOG:
+            return("syslog");
+
+        }
+
+    return("unknown");
+}
+
+static void Sagan_Input_Nonblock( int fd )
+{
+
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    if ( flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1 )
+        {
+            Remove_Lock_File();
+            Sagan_Log(ERROR, "[%s, line %d] Cannot make input non-blocking - %s. Abort!", __FILE__, __LINE__, strerror(errno));
+        }
+}
+
+/* Returns a unused source,  or NULL if there are none left */
+
+static struct _Sagan_Input_Source *Sagan_Input_New( unsigned char type, unsigned char input_type, const char *name )
+{
+
+    struct _Sagan_Input_Source *source = NULL;
+    int i;
+
+    for ( i = 0; i < Input_Source_Count; i++ )
+        {
+
+            if ( Input_Source[i].type == 0 )
+                {
+                    source = &Input_Source[i];
+                    break;
+                }
+        }
+
+    if ( source == NULL )
+        {
+
+            if ( Input_Source_Count == INPUT_MAX_SOURCES )
+                {
+                    return(NULL);
+                }
+
+            source = &Input_Source[Input_Source_Count];
+        }
+
+    memset(source, 0, sizeof(struct _Sagan_Input_Source));
+
+    source->input_type = input_type;
+    source->fd = -1;
+    source->counters = &source->own;
+    strlcpy(source->name, name, sizeof(source->name));
+
+    if ( type == INPUT_SOURCE_FIFO || type == INPUT_SOURCE_FILE || type == INPUT_SOURCE_TCP_CLIENT )
+        {
+
+            source->buffer = malloc(INPUT_BUFFER_SIZE);
+
+            if ( source->buffer == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for input buffer. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    /* Publish last,  Sagan_Input_Statistics() may be looking */
+
+    __atomic_store_n(&source->type, type, __ATOMIC_RELEASE);
+
+    if ( source == &Input_Source[Input_Source_Count] )
+        {
+            __atomic_store_n(&Input_Source_Count, Input_Source_Count + 1, __ATOMIC_RELEASE);
+        }
+
+    return(source);
+}
+
+/*****************************************************************************
+ * Watch list.  Regular files can't be watched,  they are always readable
+ * and are read every pass instead.
+ *****************************************************************************/
+
+static void Sagan_Input_Watch( struct _Sagan_Input_Source *source )
+{
+
+#ifdef HAVE_SYS_EPOLL_H
+
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = source - Input_Source;
+
+    if ( epoll_ctl(Input_Epoll, EPOLL_CTL_ADD, source->fd, &event) == -1 )
+        {
+            Remove_Lock_File();
+            Sagan_Log(ERROR, "[%s, line %d] Cannot watch input %s - %s. Abort!", __FILE__, __LINE__, source->name, strerror(errno));
+        }
+
+#endif
+
+    source->watched = true;
+}
+
+static void Sagan_Input_Close( struct _Sagan_Input_Source *source )
+{
+
+#ifdef HAVE_SYS_EPOLL_H
+
+    if ( source->watched == true )
+        {
+            (void)epoll_ctl(Input_Epoll, EPOLL_CTL_DEL, source->fd, NULL);
+        }
+
+#endif
+
+    source->watched = false;
+
+    if ( source->fd != -1 )
+        {
+            close(source->fd);
+            source->fd = -1;
+        }
+
+    source->len = 0;
+    source->discard = false;
+    source->skip = 0;
+}
+
+/* Fills "ready" with the sources that can be read.  Returns how many */
+
+static int Sagan_Input_Wait( int *ready, int max, int msec )
+{
+
+    int count = 0;
+    int n;
+    int i;
+
+#ifdef HAVE_SYS_EPOLL_H
+
+    struct epoll_event events[max];
+
+    n = epoll_wait(Input_Epoll, events, max, msec);
+
+    for ( i = 0; i < n; i++ )
+        {
+            ready[count++] = events[i].data.u32;
+        }
+
+#else
+
+    struct pollfd fds[INPUT_MAX_SOURCES];
+    int index[INPUT_MAX_SOURCES];
+    int nfds = 0;
+
+    for ( i = 0; i < Input_Source_Count; i++ )
+        {
+
+            if ( Input_Source[i].watched == true )
+                {
+                    fds[nfds].fd = Input_Source[i].fd;
+                    fds[nfds].events = POLLIN;
+                    fds[nfds].revents = 0;
+                    index[nfds++] = i;
+                }
+        }
+
+    n = poll(fds, nfds, msec);
+
+    for ( i = 0; i < nfds && n > 0 && count < max; i++ )
+        {
+
+            if ( fds[i].revents != 0 )
+                {
+                    ready[count++] = index[i];
+                }
+        }
+
+#endif
+
+    if ( n == -1 && errno != EINTR )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Waiting on input failed - %s", __FILE__, __LINE__, strerror(errno));
+        }
+
+    return(count);
+}
+
+/*****************************************************************************
+ * Opening sources
+ *****************************************************************************/
+
+static void Sagan_Input_Open_FIFO( struct _Sagan_Input_Source *source )
+{
+
+    source->fd = open(source->name, O_RDONLY | O_NONBLOCK);
+
+    if ( source->fd == -1 && errno == ENOENT )
+        {
+
+            Sagan_Log(NORMAL, "Fifo not found, creating it (%s).", source->name);
+
+            if (mkfifo(source->name, 0700) == -1)
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "Could not create FIFO '%s'. Abort!", source->name);
+                }
+
+            source->fd = open(source->name, O_RDONLY | O_NONBLOCK);
+        }
+
+    if ( source->fd == -1 )
+        {
+            Remove_Lock_File();
+            Sagan_Log(ERROR, "Error opening %s. Abort!", source->name);
+        }
+
+#if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
+
+    Set_Pipe_Size(source->fd);
+
+#endif
+
+    source->counters->opened++;
+    Sagan_Input_Watch(source);
+}
+
+static void Sagan_Input_Open_File( struct _Sagan_Input_Source *source )
+{
+
+    source->fd = open(source->name, O_RDONLY);
+
+    if ( source->fd == -1 )
+        {
+            Remove_Lock_File();
+            Sagan_Log(ERROR, "Could not open file '%s'. Abort!", source->name);
+        }
+
+    source->counters->opened++;
+}
+
+/* Binds a UDP,  TCP or unix socket.  "address" is host:port ([host]:port
+   for IPv6) or a path */
+
+static void Sagan_Input_Open_Socket( struct _Sagan_Input_Source *source )
+{
+
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    struct sockaddr_un sun;
+
+    char host[MAXPATH] = { 0 };
+    char *port = NULL;
+    int one = 1;
+    int rcvbuf = INPUT_UDP_RCVBUF;
+    int rc;
+
+    if ( source->type == INPUT_SOURCE_UNIX )
+        {
+
+            memset(&sun, 0, sizeof(sun));
+            sun.sun_family = AF_UNIX;
+
+            if ( strlcpy(sun.sun_path, source->name, sizeof(sun.sun_path)) >= sizeof(sun.sun_path) )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Input socket path '%s' is too long. Abort!", __FILE__, __LINE__, source->name);
+                }
+
+            (void)unlink(source->name);
+
+            source->fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+            if ( source->fd == -1 || bind(source->fd, (struct sockaddr *)&sun, sizeof(sun)) == -1 )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Cannot bind input socket '%s' - %s. Abort!", __FILE__, __LINE__, source->name, strerror(errno));
+                }
+
+            /* Anyone can log,  like /dev/log */
+
+            (void)chmod(source->name, 0666);
+        }
+    else
+        {
+
+            strlcpy(host, source->name, sizeof(host));
+
+            port = strrchr(host, ':');
+
+            if ( port == NULL )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Input '%s' has no port. Abort!", __FILE__, __LINE__, source->name);
+                }
+
+            *port++ = '\0';
+
+            if ( host[0] == '[' && host[strlen(host) - 1] == ']' )
+                {
+                    host[strlen(host) - 1] = '\0';
+                    memmove(host, host + 1, strlen(host));
+                }
+
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = source->type == INPUT_SOURCE_UDP ? SOCK_DGRAM : SOCK_STREAM;
+            hints.ai_flags = AI_PASSIVE;
+
+            rc = getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &result);
+
+            if ( rc != 0 )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Cannot resolve input '%s' - %s. Abort!", __FILE__, __LINE__, source->name, gai_strerror(rc));
+                }
+
+            source->fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+
+            if ( source->fd != -1 )
+                {
+                    (void)setsockopt(source->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                }
+
+            /* Bursts are absorbed by the socket while the ring catches up */
+
+            if ( source->fd != -1 && source->type == INPUT_SOURCE_UDP )
+                {
+                    (void)setsockopt(source->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+                }
+
+#ifdef SO_REUSEPORT
+
+            /* Worker sockets share the address */
+
+            if ( source->fd != -1 && source->thread == true &&
+                    setsockopt(source->fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1 )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Cannot set SO_REUSEPORT on input '%s' - %s. Abort!", __FILE__, __LINE__, source->name, strerror(errno));
+                }
+
+#endif
+
+            if ( source->fd == -1 || bind(source->fd, result->ai_addr, result->ai_addrlen) == -1 ||
+                    ( source->type == INPUT_SOURCE_TCP && listen(source->fd, SOMAXCONN) == -1 ) )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Cannot bind input '%s' - %s. Abort!", __FILE__, __LINE__, source->name, strerror(errno));
+                }
+
+            freeaddrinfo(result);
+        }
+
+    Sagan_Input_Nonblock(source->fd);
+
+    /* Worker sockets are polled by their own thread */
+
+    if ( source->thread == false )
+        {
+            Sagan_Input_Watch(source);
+
+            Sagan_Log(NORMAL, "Listening for %s syslog on %s (%s).", Sagan_Input_Type_Name(source->type), source->name, Sagan_Input_Parser_Name(source->input_type));
+        }
+    else
+        {
+            Sagan_Log(NORMAL, "Listening for %s syslog on %s (%s, thread %d).", Sagan_Input_Type_Name(source->type), source->name, Sagan_Input_Parser_Name(source->input_type), source->worker);
+        }
+}
+
+/*****************************************************************************
+ * Batching
+ *****************************************************************************/
+
+/* A reserved slot holds up every slot after it (the processors take
+   them in order),  so a reader must never wait on input while it has one.
+   That's why even an empty one (everything was ignored) is published. */
+
+static void Sagan_Input_Publish( void )
+{
+
+    if ( Input_Slot != NULL )
+        {
+            Sagan_Counter_Add(events_processed, Input_Slot->count);
+            Sagan_Ring_Publish(SaganRing, Input_Slot);
+            Input_Slot = NULL;
+        }
+}
+
+/* Where the next line should be put.  If the ring is full,  either wait
+   on the processors or hand back the scratch line (it'll be dropped) */
+
+static char *Sagan_Input_Line( void )
+{
+
+    if ( Input_Slot == NULL )
+        {
+
+            Input_Slot = Sagan_Ring_Reserve(SaganRing, false);
+
+            if ( Input_Slot == NULL && config->ring_block == true )
+                {
+                    Sagan_Counter_Add(ring_full_wait, 1);
+                    Input_Slot = Sagan_Ring_Reserve(SaganRing, true);
+                }
+        }
+
+    if ( Input_Slot == NULL && Input_Scratch == NULL )
+        {
+
+            Input_Scratch = malloc(MAX_SYSLOGMSG);
+
+            if ( Input_Scratch == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for input scratch line. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    return( Input_Slot != NULL ? Input_Slot->syslog[Input_Slot->count] : Input_Scratch );
+}
+
+/* Where the sender of the line from Sagan_Input_Line() goes */
+
+static struct sockaddr_storage *Sagan_Input_Peer( void )
+{
+    return( Input_Slot != NULL ? &Input_Slot->peer[Input_Slot->count] : &Input_Scratch_Peer );
+}
+
+/* Adds the "len" byte line at "line" (from Sagan_Input_Line()) to the batch */
+
+static void Sagan_Input_Commit( struct _Sagan_Input_Source *source, char *line, size_t len )
+{
+
+    int i;
+
+    line[len] = '\0';
+
+    Sagan_Counter_Add(events_received, 1);
+
+    source->counters->received++;
+    source->counters->bytes += len;
+
+    /* If there's no free slot, we lose the line */
+
+    if ( Input_Slot == NULL )
+        {
+            Sagan_Counter_Add(worker_thread_exhaustion, 1);
+            source->counters->dropped++;
+            return;
+        }
+
+    if (debug->debugsyslog)
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] [batch position %d] Raw log from %s: %s",  __FILE__, __LINE__, Input_Slot->count, source->name, line);
+        }
+
+    /* Check for "drop" to save CPU from "ignore list" */
+
+    if ( config->sagan_droplist_flag )
+        {
+
+            for (i = 0; i < counters->droplist_count; i++)
+                {
+
+                    /* The next line will overwrite this one */
+
+                    if (Sagan_strstr(line, SaganIgnorelist[i].ignore_string))
+                        {
+                            Sagan_Counter_Add(ignore_count, 1);
+                            source->counters->ignored++;
+                            return;
+                        }
+                }
+
+        }
+
+    /* Add to batch */
+
+    Input_Slot->input_type[Input_Slot->count] = source->input_type;
+    Input_Slot->count++;
+
+    /* Has our batch count been reached?  Send work to the threads */
+
+    if ( Input_Slot->count >= config->max_batch )
+        {
+            Sagan_Input_Publish();
+        }
+}
+
+/*****************************************************************************
+ * Reading
+ *****************************************************************************/
+
+/* Adds the "len" bytes at "p" as a line */
+
+static void Sagan_Input_Add( struct _Sagan_Input_Source *source, const char *p, size_t len )
+{
+
+    char *line = Sagan_Input_Line();
+
+    if ( source->input_type == INPUT_SYSLOG )
+        {
+            memcpy(Sagan_Input_Peer(), &source->peer, sizeof(source->peer));
+        }
+
+    memcpy(line, p, len);
+    Sagan_Input_Commit(source, line, len);
+}
+
+/* RFC 6587 octet counting ("LEN SP MSG").  Returns the length of the
+   frame at "p" and sets "*header" to the size of "LEN SP",  or returns 0
+   if "p" isn't the start of a frame.  Raw syslog starts with '<',  so a
+   digit means the sender is counting. */
+
+static size_t Sagan_Input_Frame( const char *p, const char *end, size_t *header, bool *more )
+{
+
+    size_t frame = 0;
+    size_t i;
+
+    *more = false;
+
+    for ( i = 0; p + i < end && i < 10 && isdigit((unsigned char)p[i]); i++ )
+        {
+            frame = frame * 10 + ( p[i] - '0' );
+        }
+
+    if ( p + i == end )
+        {
+            *more = true;
+            return(0);
+        }
+
+    if ( i == 0 || i == 10 || p[i] != ' ' || frame == 0 )
+        {
+            return(0);
+        }
+
+    *header = i + 1;
+    return(frame);
+}
+
+/* Splits the buffered data into lines.  A partial line is kept for the
+   next read unless this is the end of the stream.  Lines too long for
+   MAX_SYSLOGMSG are truncated and the rest of them thrown away. */
+
+static void Sagan_Input_Split( struct _Sagan_Input_Source *source, bool eof )
+{
+
+    char *p = source->buffer;
+    char *end = source->buffer + source->len;
+    char *nl = NULL;
+    size_t len;
+    size_t frame;
+    size_t header;
+    bool more;
+
+    while ( p < end )
+        {
+
+            /* Rest of a octet counted frame that was too long */
+
+            if ( source->skip > 0 )
+                {
+                    len = (size_t)( end - p ) < source->skip ? (size_t)( end - p ) : source->skip;
+                    source->skip -= len;
+                    p += len;
+                    continue;
+                }
+
+            if ( source->input_type == INPUT_SYSLOG && source->discard == false && isdigit((unsigned char)*p) )
+                {
+
+                    frame = Sagan_Input_Frame(p, end, &header, &more);
+
+                    if ( more == true && eof == false )
+                        {
+                            break;
+                        }
+
+                    if ( frame > 0 )
+                        {
+
+                            len = frame < MAX_SYSLOGMSG - 1 ? frame : MAX_SYSLOGMSG - 1;
+
+                            if ( (size_t)( end - p ) < header + len && eof == false )
+                                {
+                                    break;
+                                }
+
+                            if ( (size_t)( end - p ) < header + len )
+                                {
+                                    len = end - p - header;
+                                }
+
+                            if ( frame > MAX_SYSLOGMSG - 1 )
+                                {
+                                    source->counters->truncated++;
+                                }
+
+                            source->skip = frame - len;
+
+                            if ( len > 0 )
+                                {
+                                    Sagan_Input_Add(source, p + header, len);
+                                }
+
+                            p += header + len;
+                            continue;
+                        }
+                }
+
+            nl = memchr(p, '\n', end - p);
+
+            if ( nl == NULL && eof == false && (size_t)( end - p ) < MAX_SYSLOGMSG - 1 )
+                {
+                    break;
+                }
+
+            len = ( nl != NULL ? nl : end ) - p;
+
+            if ( source->discard == true )
+                {
+                    source->discard = ( nl == NULL );
+                }
+
+            else if ( len > 0 )
+                {
+
+                    if ( len > MAX_SYSLOGMSG - 1 )
+                        {
+                            len = MAX_SYSLOGMSG - 1;
+                            source->counters->truncated++;
+                            source->discard = ( nl == NULL );
+                        }
+
+                    Sagan_Input_Add(source, p, len);
+                }
+
+            p = nl != NULL ? nl + 1 : end;
+        }
+
+    source->len = end - p;
+
+    if ( source->len > 0 && p != source->buffer )
+        {
+            memmove(source->buffer, p, source->len);
+        }
+}
+
+static void Sagan_Input_EOF( struct _Sagan_Input_Source *source );
+
+static void Sagan_Input_Read_Stream( struct _Sagan_Input_Source *source )
+{
+
+    ssize_t n;
+    int reads;
+
+    for ( reads = 0; reads < INPUT_MAX_READS && source->fd != -1; reads++ )
+        {
+
+            n = read(source->fd, source->buffer + source->len, INPUT_BUFFER_SIZE - source->len);
+
+            if ( n == -1 && errno == EINTR )
+                {
+                    continue;
+                }
+
+            if ( n == -1 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+                {
+                    return;
+                }
+
+            if ( n == -1 )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Error reading %s - %s", __FILE__, __LINE__, source->name, strerror(errno));
+                }
+
+            if ( n <= 0 )
+                {
+                    Sagan_Input_Split(source, true);
+                    Sagan_Input_EOF(source);
+                    return;
+                }
+
+            /* If the FIFO was in a error state,  let user know the FIFO writer has resumed */
+
+            if ( source->writer_gone == true )
+                {
+
+                    Sagan_Log(NORMAL, "FIFO writer has restarted (%s). Processing events.", source->name);
+
+#if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
+
+                    Set_Pipe_Size(source->fd);
+
+#endif
+                    source->writer_gone = false;
+                }
+
+            source->len += n;
+            Sagan_Input_Split(source, false);
+        }
+}
+
+static int Sagan_Input_Receive_Error( struct _Sagan_Input_Source *source )
+{
+
+    if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Error receiving on %s - %s", __FILE__, __LINE__, source->name, strerror(errno));
+        }
+
+    return(0);
+}
+
+/* Receives as many datagrams as are waiting (up to the room left in the
+   batch) straight into the batch.  Returns how many were received,  0 if
+   there were none.  Never blocks. */
+
+static int Sagan_Input_Receive( struct _Sagan_Input_Source *source )
+{
+
+    struct _Sagan_Ring_Slot *slot = NULL;
+    char *line = NULL;
+    socklen_t peer_len = sizeof(struct sockaddr_storage);
+
+    ssize_t len[INPUT_MMSG_MAX];
+    int count;
+    int room;
+    int base;
+    int i;
+
+#ifdef HAVE_RECVMMSG
+
+    struct mmsghdr msg[INPUT_MMSG_MAX];
+    struct iovec iov[INPUT_MMSG_MAX];
+
+#endif
+
+    /* Don't reserve a slot unless there's something to put in it */
+
+    if ( Input_Slot == NULL && recv(source->fd, NULL, 0, MSG_PEEK | MSG_DONTWAIT) == -1 )
+        {
+            return( Sagan_Input_Receive_Error(source) );
+        }
+
+    line = Sagan_Input_Line();
+    slot = Input_Slot;
+
+    /* The ring is full.  Take one at a time so it is checked again soon */
+
+    if ( slot == NULL )
+        {
+
+            len[0] = recvfrom(source->fd, line, MAX_SYSLOGMSG - 1, MSG_DONTWAIT, (struct sockaddr *)&Input_Scratch_Peer, &peer_len);
+            count = len[0] == -1 ? -1 : 1;
+            base = 0;
+        }
+    else
+        {
+
+            base = slot->count;
+            room = config->max_batch - base < INPUT_MMSG_MAX ? config->max_batch - base : INPUT_MMSG_MAX;
+
+#ifdef HAVE_RECVMMSG
+
+            memset(msg, 0, room * sizeof(struct mmsghdr));
+
+            for ( i = 0; i < room; i++ )
+                {
+                    iov[i].iov_base = slot->syslog[base + i];
+                    iov[i].iov_len = MAX_SYSLOGMSG - 1;
+
+                    msg[i].msg_hdr.msg_iov = &iov[i];
+                    msg[i].msg_hdr.msg_iovlen = 1;
+                    msg[i].msg_hdr.msg_name = &slot->peer[base + i];
+                    msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+                }
+
+            count = recvmmsg(source->fd, msg, room, MSG_DONTWAIT, NULL);
+
+            for ( i = 0; i < count; i++ )
+                {
+
+                    len[i] = msg[i].msg_len;
+
+                    /* Unbound unix senders have no address */
+
+                    if ( msg[i].msg_hdr.msg_namelen == 0 )
+                        {
+                            slot->peer[base + i].ss_family = AF_UNSPEC;
+                        }
+                }
+
+#else
+
+            (void)room;
+
+            len[0] = recvfrom(source->fd, line, MAX_SYSLOGMSG - 1, MSG_DONTWAIT, (struct sockaddr *)&slot->peer[base], &peer_len);
+            count = len[0] == -1 ? -1 : 1;
+
+            if ( count == 1 && peer_len == 0 )
+                {
+                    slot->peer[base].ss_family = AF_UNSPEC;
+                }
+
+#endif
+
+        }
+
+    if ( count == -1 )
+        {
+            return( Sagan_Input_Receive_Error(source) );
+        }
+
+    for ( i = 0; i < count; i++ )
+        {
+
+            if ( slot != NULL )
+                {
+                    line = slot->syslog[base + i];
+                }
+
+            while ( len[i] > 0 && ( line[len[i] - 1] == '\n' || line[len[i] - 1] == '\0' ) )
+                {
+                    len[i]--;
+                }
+
+            if ( len[i] == 0 )
+                {
+                    continue;
+                }
+
+            /* Close the gap left by empty or ignored datagrams */
+
+            if ( slot != NULL && slot->count != base + i )
+                {
+                    memmove(slot->syslog[slot->count], line, len[i]);
+                    slot->peer[slot->count] = slot->peer[base + i];
+                    line = slot->syslog[slot->count];
+                }
+
+            Sagan_Input_Commit(source, line, len[i]);
+        }
+
+    return(count);
+}
+
+static void Sagan_Input_Read_Datagram( struct _Sagan_Input_Source *source )
+{
+
+    int reads;
+
+    for ( reads = 0; reads < INPUT_MAX_READS; reads++ )
+        {
+
+            if ( Sagan_Input_Receive(source) == 0 )
+                {
+                    return;
+                }
+        }
+}
+
+/*****************************************************************************
+ * Sagan_Input_Worker - Reads one of a UDP source's SO_REUSEPORT sockets.
+ * A partial batch is published as soon as the socket is drained.
+ *****************************************************************************/
+
+static void Sagan_Input_Worker( struct _Sagan_Input_Source *source )
+{
+
+    struct pollfd fds;
+
+    (void)SetThreadName("SaganUDP");
+
+    fds.fd = source->fd;
+    fds.events = POLLIN;
+
+    for (;;)
+        {
+
+            if ( Input_Slot == NULL )
+                {
+                    (void)poll(&fds, 1, -1);
+                }
+
+            if ( Sagan_Input_Receive(source) == 0 )
+                {
+                    Sagan_Input_Publish();
+                }
+        }
+}
+
+static void Sagan_Input_Accept( struct _Sagan_Input_Source *listener )
+{
+
+    struct _Sagan_Input_Source *source = NULL;
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+    int fd;
+
+    for ( ;; )
+        {
+
+            peer_len = sizeof(peer);
+            fd = accept(listener->fd, (struct sockaddr *)&peer, &peer_len);
+
+            if ( fd == -1 )
+                {
+
+                    if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] Error accepting on %s - %s", __FILE__, __LINE__, listener->name, strerror(errno));
+                        }
+
+                    return;
+                }
+
+            source = Sagan_Input_New(INPUT_SOURCE_TCP_CLIENT, listener->input_type, listener->name);
+
+            if ( source == NULL )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Too many inputs (%d).  Closing new connection on %s.", __FILE__, __LINE__, INPUT_MAX_SOURCES, listener->name);
+                    close(fd);
+                    continue;
+                }
+
+            source->fd = fd;
+            source->peer = peer;
+            source->counters = listener->counters;
+            source->counters->opened++;
+
+            Sagan_Input_Nonblock(fd);
+            Sagan_Input_Watch(source);
+        }
+}
+
+/* Returns true if every source is a file that has been read */
+
+static bool Sagan_Input_Files_Done( void )
+{
+
+    int i;
+
+    for ( i = 0; i < Input_Source_Count; i++ )
+        {
+
+            if ( Input_Source[i].type != INPUT_SOURCE_FILE || Input_Source[i].eof == false )
+                {
+                    return(false);
+                }
+        }
+
+    return(true);
+}
+
+static void Sagan_Input_EOF( struct _Sagan_Input_Source *source )
+{
+
+    Sagan_Input_Close(source);
+
+    if ( source->type == INPUT_SOURCE_FIFO )
+        {
+
+            /* Reopen right away.  On Linux a reader won't see the FIFO hang
+               up again until a new writer has come and gone.  Systems that
+               keep reporting it get a reopen once a second instead. */
+
+            if ( source->writer_gone == false )
+                {
+                    Sagan_Log(WARN, "FIFO writer closed (%s).  Waiting for FIFO writer to restart....", source->name);
+                    source->writer_gone = true;
+                    Sagan_Input_Open_FIFO(source);
+                }
+            else
+                {
+                    source->reopen = time(NULL) + 1;
+                }
+
+            return;
+        }
+
+    if ( source->type == INPUT_SOURCE_TCP_CLIENT )
+        {
+            free(source->buffer);
+            source->buffer = NULL;
+            __atomic_store_n(&source->type, 0, __ATOMIC_RELEASE);
+            return;
+        }
+
+    /* INPUT_SOURCE_FILE */
+
+    source->eof = true;
+
+    Sagan_Input_Publish();
+
+    if ( Sagan_Input_Files_Done() == false )
+        {
+            Sagan_Log(NORMAL, "EOF reached (%s).", source->name);
+            return;
+        }
+
+    Sagan_Log(NORMAL, "EOF reached. Waiting for threads to catch up....");
+    Sagan_Log(NORMAL, "");
+
+    while( Sagan_Ring_Pending(SaganRing) != 0 )
+        {
+            Sagan_Log(NORMAL, "Waiting on %" PRIu64 " batches/%d threads....", Sagan_Ring_Pending(SaganRing), proc_running);
+            sleep(1);
+        }
+
+    /* Alerts from the last batches may still be queued for the output
+       threads */
+
+    Output_Queue_Drain();
+
+    /* Buffered alert,  fast and EVE records */
+
+    Sagan_Writer_Flush_All();
+
+    Statistics();
+    Remove_Lock_File();
+
+    Sagan_Log(NORMAL, "Exiting.");
+    exit(0);
+}
+
+/*****************************************************************************
+ * Sagan_Input_Init - Sets up the main FIFO/file and the "input-sources".
+ * Sockets are bound here since that might need root.  FIFOs and files are
+ * opened by Sagan_Input_Run() (after privileges are dropped).
+ *
+ * "input-sources" is a comma separated list of "type://address",
+ * optionally followed by "#pipe",  "#json" or "#syslog".  For example:
+ *
+ *   fifo:///var/sagan/fifo/eve.fifo#json, udp://0.0.0.0:514#syslog,
+ *   tcp://[::1]:514#syslog, unix:///var/run/sagan.sock
+ *****************************************************************************/
+
+void Sagan_Input_Init( void )
+{
+
+    struct _Sagan_Input_Source *source = NULL;
+
+    char sources[sizeof(config->input_sources)];
+    char *entry = NULL;
+    char *saveptr = NULL;
+    char *address = NULL;
+    char *parser = NULL;
+
+    unsigned char type = 0;
+    unsigned char input_type;
+    int workers;
+    int i;
+
+    Input_Source = malloc(INPUT_MAX_SOURCES * sizeof(struct _Sagan_Input_Source));
+
+    if ( Input_Source == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for input sources. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(Input_Source, 0, INPUT_MAX_SOURCES * sizeof(struct _Sagan_Input_Source));
+
+#ifdef HAVE_SYS_EPOLL_H
+
+    Input_Epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    if ( Input_Epoll == -1 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] epoll_create1() failed - %s. Abort!", __FILE__, __LINE__, strerror(errno));
+        }
+
+#endif
+
+    /* The FIFO (or -F file) always comes first */
+
+    (void)Sagan_Input_New(config->sagan_is_file == true ? INPUT_SOURCE_FILE : INPUT_SOURCE_FIFO, config->input_type, config->sagan_fifo);
+
+    strlcpy(sources, config->input_sources, sizeof(sources));
+
+    for ( entry = strtok_r(sources, ",", &saveptr); entry != NULL; entry = strtok_r(NULL, ",", &saveptr) )
+        {
+
+            while ( *entry == ' ' || *entry == '\t' )
+                {
+                    entry++;
+                }
+
+            for ( i = strlen(entry); i > 0 && ( entry[i-1] == ' ' || entry[i-1] == '\t' ); i-- )
+                {
+                    entry[i-1] = '\0';
+                }
+
+            if ( entry[0] == '\0' )
+                {
+                    continue;
+                }
+
+            input_type = config->input_type;
+
+            parser = strrchr(entry, '#');
+
+            if ( parser != NULL )
+                {
+
+                    *parser++ = '\0';
+
+                    if ( !strcasecmp(parser, "pipe") )
+                        {
+                            input_type = INPUT_PIPE;
+                        }
+
+                    else if ( !strcasecmp(parser, "json") )
+                        {
+                            input_type = INPUT_JSON;
+                        }
+
+                    else if ( !strcasecmp(parser, "syslog") )
+                        {
+                            input_type = INPUT_SYSLOG;
+                        }
+
+                    else
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Input '%s' has an invalid parser '%s'. It must be 'pipe', 'json' or 'syslog'. Abort!", __FILE__, __LINE__, entry, parser);
+                        }
+                }
+
+            address = strstr(entry, "://");
+
+            if ( address == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Input '%s' should look like 'type://address'. Abort!", __FILE__, __LINE__, entry);
+                }
+
+            *address = '\0';
+            address += 3;
+
+            if ( !strcasecmp(entry, "fifo") )
+                {
+                    type = INPUT_SOURCE_FIFO;
+                }
+
+            else if ( !strcasecmp(entry, "file") )
+                {
+                    type = INPUT_SOURCE_FILE;
+                }
+
+            else if ( !strcasecmp(entry, "udp") )
+                {
+                    type = INPUT_SOURCE_UDP;
+                }
+
+            else if ( !strcasecmp(entry, "tcp") )
+                {
+                    type = INPUT_SOURCE_TCP;
+                }
+
+            else if ( !strcasecmp(entry, "unix") )
+                {
+                    type = INPUT_SOURCE_UNIX;
+                }
+
+            else
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Input type '%s' is invalid. It must be 'fifo', 'file', 'udp', 'tcp' or 'unix'. Abort!", __FILE__, __LINE__, entry);
+                }
+
+            /* UDP sources may get a socket per worker thread */
+
+            workers = type == INPUT_SOURCE_UDP ? config->input_udp_threads : 0;
+
+#ifndef SO_REUSEPORT
+
+            if ( workers > 1 )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] SO_REUSEPORT isn't supported.  Using one thread for %s.", __FILE__, __LINE__, address);
+                    workers = 1;
+                }
+
+#endif
+
+            for ( i = 0; i < ( workers > 0 ? workers : 1 ); i++ )
+                {
+
+                    source = Sagan_Input_New(type, input_type, address);
+
+                    if ( source == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Too many inputs (max %d). Abort!", __FILE__, __LINE__, INPUT_MAX_SOURCES);
+                        }
+
+                    source->thread = ( workers > 0 );
+                    source->worker = i;
+
+                    if ( type == INPUT_SOURCE_UDP || type == INPUT_SOURCE_TCP || type == INPUT_SOURCE_UNIX )
+                        {
+                            Sagan_Input_Open_Socket(source);
+                        }
+                }
+        }
+
+#ifdef HAVE_LIBPCAP
+
+    /* plog.c hands packets straight to Sagan_Input_Plog() */
+
+    if ( config->plog_flag == true && config->plog_direct == true )
+        {
+            Input_Plog = Sagan_Input_New(INPUT_SOURCE_PLOG, INPUT_SYSLOG, config->plog_interface);
+        }
+
+#endif
+}
+
+/*****************************************************************************
+ * Sagan_Input_Run - The reader loop.  Never returns (exits once every
+ * source is a file that has been read).
+ *****************************************************************************/
+
+void Sagan_Input_Run( void )
+{
+
+    struct _Sagan_Input_Source *source = NULL;
+
+    pthread_t thread;
+
+    int ready[INPUT_MAX_SOURCES];
+    int count;
+    int wait;
+    int rc;
+    int i;
+
+    bool files;
+
+    for ( i = 0; i < Input_Source_Count; i++ )
+        {
+
+            source = &Input_Source[i];
+
+            if ( source->type == INPUT_SOURCE_FIFO )
+                {
+                    Sagan_Log(NORMAL, "Attempting to open syslog FIFO (%s).", source->name);
+                    Sagan_Input_Open_FIFO(source);
+                    Sagan_Log(NORMAL, "Successfully opened FIFO (%s).", source->name);
+                }
+
+            else if ( source->type == INPUT_SOURCE_FILE )
+                {
+                    Sagan_Log(NORMAL, "Attempting to open syslog FILE (%s).", source->name);
+                    Sagan_Input_Open_File(source);
+                    Sagan_Log(NORMAL, "Successfully opened FILE (%s) and processing events.....", source->name);
+                }
+
+            else if ( source->thread == true )
+                {
+
+                    rc = pthread_create( &thread, NULL, (void *)Sagan_Input_Worker, source );
+
+                    if ( rc != 0 )
+                        {
+                            Remove_Lock_File();
+                            Sagan_Log(ERROR, "[%s, line %d] Error creating input thread for %s [error: %d].", __FILE__, __LINE__, source->name, rc);
+                        }
+                }
+        }
+
+    for (;;)
+        {
+
+            files = false;
+
+            for ( i = 0; i < Input_Source_Count; i++ )
+                {
+
+                    source = &Input_Source[i];
+
+                    if ( source->type == INPUT_SOURCE_FILE && source->eof == false )
+                        {
+                            files = true;
+                        }
+
+                    else if ( source->type == INPUT_SOURCE_FIFO && source->fd == -1 && time(NULL) >= source->reopen )
+                        {
+                            Sagan_Input_Open_FIFO(source);
+                        }
+                }
+
+            /* Don't sit on a partial batch when there's nothing else to read */
+
+            wait = files == true || Input_Slot != NULL ? 0 : INPUT_WAIT_MSEC;
+
+            count = Sagan_Input_Wait(ready, INPUT_MAX_SOURCES, wait);
+
+            if ( count == 0 && files == false )
+                {
+                    Sagan_Input_Publish();
+                    continue;
+                }
+
+            for ( i = 0; i < count; i++ )
+                {
+
+                    source = &Input_Source[ready[i]];
+
+                    switch ( source->type )
+                        {
+
+                        case INPUT_SOURCE_FIFO:
+                        case INPUT_SOURCE_TCP_CLIENT:
+                            Sagan_Input_Read_Stream(source);
+                            break;
+
+                        case INPUT_SOURCE_UDP:
+                        case INPUT_SOURCE_UNIX:
+                            Sagan_Input_Read_Datagram(source);
+                            break;
+
+                        case INPUT_SOURCE_TCP:
+                            Sagan_Input_Accept(source);
+                            break;
+
+                        }
+                }
+
+            for ( i = 0; files == true && i < Input_Source_Count; i++ )
+                {
+
+                    if ( Input_Source[i].type == INPUT_SOURCE_FILE && Input_Source[i].eof == false )
+                        {
+                            Sagan_Input_Read_Stream(&Input_Source[i]);
+                        }
+                }
+        }
+}
+
+/*****************************************************************************
+ * Sagan_Input_Statistics - Per source counters for Statistics()
+ *****************************************************************************/
+
+void Sagan_Input_Statistics( void )
+{
+
+    struct _Sagan_Input_Source *source = NULL;
+    int count = __atomic_load_n(&Input_Source_Count, __ATOMIC_ACQUIRE);
+    int i;
+
+    char name[MAXPATH + 8];
+
+    for ( i = 0; i < count; i++ )
+        {
+
+            source = &Input_Source[i];
+
+            /* Connections are counted with their listener */
+
+            if ( source->type == 0 || source->type == INPUT_SOURCE_TCP_CLIENT )
+                {
+                    continue;
+                }
+
+            if ( source->thread == true )
+                {
+                    snprintf(name, sizeof(name), "%s/%d", source->name, source->worker);
+                }
+            else
+                {
+                    strlcpy(name, source->name, sizeof(name));
+                }
+
+            Sagan_Log(NORMAL, "           Input %-4s %-17s : %" PRIu64 " lines, %" PRIu64 " bytes, %" PRIu64 " dropped, %" PRIu64 " truncated, %" PRIu64 " ignored, %" PRIu64 " %s",
+                      Sagan_Input_Type_Name(source->type), name, source->counters->received, source->counters->bytes,
+                      source->counters->dropped, source->counters->truncated, source->counters->ignored, source->counters->opened,
+                      source->type == INPUT_SOURCE_TCP ? "connections":"opens");
+        }
+}
+
+/*****************************************************************************
+ * Sagan_Input_Plog - A syslog payload sniffed by plog.c from "src".  It goes
+ * straight into plog's own batch,  no trip through /dev/log.
+ *****************************************************************************/
+
+void Sagan_Input_Plog( const char *data, size_t len, const struct in_addr *src )
+{
+
+    struct sockaddr_in *sin = NULL;
+    char *line = NULL;
+
+    if ( Input_Plog == NULL )
+        {
+            return;
+        }
+
+    if ( len > MAX_SYSLOGMSG - 1 )
+        {
+            len = MAX_SYSLOGMSG - 1;
+            Input_Plog->counters->truncated++;
+        }
+
+    while ( len > 0 && ( data[len - 1] == '\n' || data[len - 1] == '\0' ) )
+        {
+            len--;
+        }
+
+    if ( len == 0 )
+        {
+            return;
+        }
+
+    line = Sagan_Input_Line();
+
+    sin = (struct sockaddr_in *)Sagan_Input_Peer();
+    memset(sin, 0, sizeof(struct sockaddr_in));
+    sin->sin_family = AF_INET;
+    sin->sin_addr = *src;
+
+    memcpy(line, data, len);
+    Sagan_Input_Commit(Input_Plog, line, len);
+}
+
+/*****************************************************************************
+ * Sagan_Input_Flush - Publishes the calling thread's partial batch
+ *****************************************************************************/
+
+void Sagan_Input_Flush( void )
+{
+    Sagan_Input_Publish();
+}
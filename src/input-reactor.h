@@ -0,0 +1,93 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* input-reactor.h
+ *
+ * Reads log lines from every configured input source (FIFOs,  files and
+ * syslog sockets) at once and hands them to the processors.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#define INPUT_SOURCE_FIFO	1
+#define INPUT_SOURCE_FILE	2
+#define INPUT_SOURCE_UDP	3
+#define INPUT_SOURCE_TCP	4		/* Listening socket */
+#define INPUT_SOURCE_TCP_CLIENT	5		/* Connection accepted on a INPUT_SOURCE_TCP */
+#define INPUT_SOURCE_UNIX	6		/* Datagram socket (like /dev/log) */
+#define INPUT_SOURCE_PLOG	7		/* Packets from plog.c */
+
+#define INPUT_MAX_SOURCES	256		/* Includes TCP connections */
+#define INPUT_BUFFER_SIZE	( 4 * MAX_SYSLOGMSG )	/* Per stream source */
+#define INPUT_MAX_READS		16		/* Reads per source before moving on */
+#define INPUT_WAIT_MSEC		1000
+#define INPUT_MMSG_MAX		64		/* Datagrams per recvmmsg() */
+#define INPUT_UDP_RCVBUF	( 8 * 1024 * 1024 )	/* Capped by net.core.rmem_max */
+
+/* Counted by the thread reading the source only.  TCP connections count
+   against the source they were accepted on */
+
+typedef struct _Sagan_Input_Counters _Sagan_Input_Counters;
+struct _Sagan_Input_Counters
+{
+    uint64_t received;				/* Log lines */
+    uint64_t bytes;
+    uint64_t dropped;				/* Ring was full */
+    uint64_t truncated;				/* Longer than MAX_SYSLOGMSG */
+    uint64_t ignored;				/* Droplist */
+    uint64_t opened;				/* (Re)opens or connections */
+};
+
+typedef struct _Sagan_Input_Source _Sagan_Input_Source;
+struct _Sagan_Input_Source
+{
+
+    unsigned char type;				/* INPUT_SOURCE_*,  0 == unused */
+    unsigned char input_type;			/* INPUT_PIPE,  INPUT_JSON or INPUT_SYSLOG */
+    char name[MAXPATH];				/* Path or address as configured */
+
+    int fd;
+    bool watched;				/* In the epoll/poll set */
+    bool thread;				/* Read by its own thread,  not the reactor */
+    unsigned char worker;			/* Which of the "input-udp-threads" */
+    bool writer_gone;				/* FIFO writer left */
+    time_t reopen;				/* FIFO to be reopened at */
+    bool eof;					/* File has been read */
+
+    char *buffer;				/* Stream sources only */
+    size_t len;
+    bool discard;				/* Skipping the rest of a long line */
+    size_t skip;				/* Bytes left of a long octet counted frame */
+
+    struct sockaddr_storage peer;		/* TCP connections */
+
+    struct _Sagan_Input_Counters *counters;	/* Points at "own" or the listener's */
+    struct _Sagan_Input_Counters own;
+
+};
+
+void Sagan_Input_Init( void );
+void Sagan_Input_Run( void );
+void Sagan_Input_Statistics( void );
+void Sagan_Input_Plog( const char *, size_t, const struct in_addr * );
+void Sagan_Input_Flush( void );
@@ -0,0 +1,369 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* input-syslog-load.c
+ *
+ * Loopback load generator for Sagan's syslog listeners ("input-sources"
+ * with "#syslog").  Each sender thread has its own socket (and so its own
+ * source port,  which is what SO_REUSEPORT spreads on) and sends RFC 3164
+ * or RFC 5424 messages as fast as it can or at a fixed rate.  UDP is sent
+ * in sendmmsg() batches,  TCP is newline framed.  Built with "make
+ * sagan-syslog-load",  it isn't part of the normal build.
+ *
+ * Usage: sagan-syslog-load [-t] [-5] [-n count] [-r rate] [-c senders]
+ *                          [-s size] host:port
+ *
+ *   -t   TCP instead of UDP
+ *   -5   RFC 5424 instead of RFC 3164
+ *   -n   Messages per sender (default 1000000)
+ *   -r   Messages per second per sender,  0 is as fast as possible
+ *   -c   Sender threads (default 1)
+ *   -s   Pad messages out to this many bytes
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define LOAD_DEFAULT_COUNT	1000000
+#define LOAD_MAX_SENDERS	64
+#define LOAD_BATCH		64		/* Datagrams per sendmmsg() */
+#define LOAD_MAX_MESSAGE	8192
+
+static struct addrinfo *Load_Address = NULL;
+
+static bool Load_TCP = false;
+static bool Load_RFC5424 = false;
+static uint64_t Load_Count = LOAD_DEFAULT_COUNT;
+static uint64_t Load_Rate = 0;
+static int Load_Size = 0;
+
+typedef struct _Load_Sender _Load_Sender;
+struct _Load_Sender
+{
+    pthread_t thread;
+    int id;
+    uint64_t sent;
+    uint64_t errors;
+};
+
+static double Load_Now( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( ts.tv_sec + ts.tv_nsec / 1e9 );
+}
+
+/* Builds message "n" of sender "id" into "buf".  The text changes every
+   message so nothing downstream can cache it */
+
+static int Load_Message( char *buf, size_t size, int id, uint64_t n )
+{
+
+    static const char *programs[] = { "sshd", "sudo", "postfix/smtpd", "kernel", "named" };
+    static const char *texts[] =
+    {
+        "Failed password for invalid user admin from 198.51.100.%d port %d ssh2",
+        "Accepted publickey for deploy from 203.0.113.%d port %d ssh2: RSA SHA256:abcdef",
+        "connect from unknown[192.0.2.%d] port %d",
+        "iptables denied: IN=eth0 OUT= SRC=198.51.100.%d DST=192.0.2.1 PROTO=TCP DPT=%d",
+        "client 203.0.113.%d#%d: query (cache) 'example.com/A/IN' denied"
+    };
+
+    const char *program = programs[n % 5];
+    int pid = 1000 + id;
+    int len;
+
+    if ( Load_RFC5424 == true )
+        {
+            len = snprintf(buf, size, "<38>1 2019-03-12T10:15:32.123456+00:00 loadgen%d %s %d - - ", id, program, pid);
+        }
+    else
+        {
+            len = snprintf(buf, size, "<38>Mar 12 10:15:32 loadgen%d %s[%d]: ", id, program, pid);
+        }
+
+    len += snprintf(buf + len, size - len, texts[n % 5], (int)( n % 250 ) + 1, (int)( 1024 + n % 60000 ));
+
+    while ( len < Load_Size && (size_t)len < size - 2 )
+        {
+            buf[len++] = 'x';
+        }
+
+    if ( Load_TCP == true )
+        {
+            buf[len++] = '\n';
+        }
+
+    buf[len] = '\0';
+
+    return(len);
+}
+
+static void Load_Sender( _Load_Sender *sender )
+{
+
+    static __thread char buf[LOAD_BATCH][LOAD_MAX_MESSAGE];
+
+    struct iovec iov[LOAD_BATCH];
+
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msg[LOAD_BATCH];
+#endif
+
+    double start = Load_Now();
+    double due;
+
+    uint64_t n = 0;
+    int batch;
+    int sent;
+    int fd;
+    int i;
+
+    fd = socket(Load_Address->ai_family, Load_TCP == true ? SOCK_STREAM : SOCK_DGRAM, 0);
+
+    if ( fd == -1 || connect(fd, Load_Address->ai_addr, Load_Address->ai_addrlen) == -1 )
+        {
+            fprintf(stderr, "Sender %d: cannot connect - %s\n", sender->id, strerror(errno));
+            exit(1);
+        }
+
+    while ( n < Load_Count )
+        {
+
+            batch = Load_Count - n < LOAD_BATCH ? Load_Count - n : LOAD_BATCH;
+
+            /* With a rate,  a batch isn't sent before it's due */
+
+            if ( Load_Rate > 0 )
+                {
+
+                    due = start + (double)n / Load_Rate;
+
+                    while ( Load_Now() < due )
+                        {
+                            usleep(100);
+                        }
+
+                    batch = batch > 8 ? 8 : batch;
+                }
+
+            for ( i = 0; i < batch; i++ )
+                {
+                    iov[i].iov_base = buf[i];
+                    iov[i].iov_len = Load_Message(buf[i], sizeof(buf[i]), sender->id, n + i);
+                }
+
+            if ( Load_TCP == true )
+                {
+                    sent = writev(fd, iov, batch) == -1 ? -1 : batch;
+                }
+            else
+                {
+
+#ifdef HAVE_SENDMMSG
+
+                    memset(msg, 0, batch * sizeof(struct mmsghdr));
+
+                    for ( i = 0; i < batch; i++ )
+                        {
+                            msg[i].msg_hdr.msg_iov = &iov[i];
+                            msg[i].msg_hdr.msg_iovlen = 1;
+                        }
+
+                    sent = sendmmsg(fd, msg, batch, 0);
+
+#else
+
+                    sent = send(fd, iov[0].iov_base, iov[0].iov_len, 0) == -1 ? -1 : 1;
+
+#endif
+
+                }
+
+            /* Nothing listening yet (ICMP port unreachable) or buffers full */
+
+            if ( sent <= 0 )
+                {
+
+                    if ( Load_TCP == true )
+                        {
+                            fprintf(stderr, "Sender %d: write failed - %s\n", sender->id, strerror(errno));
+                            exit(1);
+                        }
+
+                    sender->errors++;
+                    sent = 1;
+                }
+            else
+                {
+                    sender->sent += sent;
+                }
+
+            n += sent;
+        }
+
+    close(fd);
+}
+
+int main( int argc, char **argv )
+{
+
+    _Load_Sender sender[LOAD_MAX_SENDERS];
+    struct addrinfo hints;
+
+    char host[256];
+    char *port = NULL;
+
+    uint64_t sent = 0;
+    uint64_t errors = 0;
+
+    double start;
+    double elapsed;
+
+    int senders = 1;
+    int rc;
+    int c;
+    int i;
+
+    while ( ( c = getopt(argc, argv, "t5n:r:c:s:") ) != -1 )
+        {
+
+            switch ( c )
+                {
+
+                case 't':
+                    Load_TCP = true;
+                    break;
+
+                case '5':
+                    Load_RFC5424 = true;
+                    break;
+
+                case 'n':
+                    Load_Count = strtoull(optarg, NULL, 10);
+                    break;
+
+                case 'r':
+                    Load_Rate = strtoull(optarg, NULL, 10);
+                    break;
+
+                case 'c':
+                    senders = atoi(optarg);
+                    break;
+
+                case 's':
+                    Load_Size = atoi(optarg);
+                    break;
+
+                default:
+                    optind = argc;
+                    break;
+                }
+        }
+
+    if ( optind != argc - 1 || senders < 1 || senders > LOAD_MAX_SENDERS || Load_Size >= LOAD_MAX_MESSAGE - 2 )
+        {
+            fprintf(stderr, "Usage: %s [-t] [-5] [-n count] [-r rate] [-c senders (1-%d)] [-s size] host:port\n", argv[0], LOAD_MAX_SENDERS);
+            return(1);
+        }
+
+    snprintf(host, sizeof(host), "%s", argv[optind]);
+
+    port = strrchr(host, ':');
+
+    if ( port == NULL )
+        {
+            fprintf(stderr, "'%s' has no port\n", argv[optind]);
+            return(1);
+        }
+
+    *port++ = '\0';
+
+    if ( host[0] == '[' && host[strlen(host) - 1] == ']' )
+        {
+            host[strlen(host) - 1] = '\0';
+            memmove(host, host + 1, strlen(host));
+        }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = Load_TCP == true ? SOCK_STREAM : SOCK_DGRAM;
+
+    rc = getaddrinfo(host, port, &hints, &Load_Address);
+
+    if ( rc != 0 )
+        {
+            fprintf(stderr, "Cannot resolve '%s' - %s\n", argv[optind], gai_strerror(rc));
+            return(1);
+        }
+
+    memset(sender, 0, sizeof(sender));
+
+    start = Load_Now();
+
+    for ( i = 0; i < senders; i++ )
+        {
+
+            sender[i].id = i;
+
+            if ( pthread_create(&sender[i].thread, NULL, (void *)Load_Sender, &sender[i]) != 0 )
+                {
+                    fprintf(stderr, "Cannot create sender thread\n");
+                    return(1);
+                }
+        }
+
+    for ( i = 0; i < senders; i++ )
+        {
+            pthread_join(sender[i].thread, NULL);
+            sent += sender[i].sent;
+            errors += sender[i].errors;
+        }
+
+    elapsed = Load_Now() - start;
+
+    printf("%" PRIu64 " messages sent by %d sender(s) in %.3f seconds (%.0f/sec),  %" PRIu64 " send errors\n",
+           sent, senders, elapsed, elapsed > 0 ? sent / elapsed : 0, errors);
+
+    freeaddrinfo(Load_Address);
+
+    return(0);
+}
+
@@ -0,0 +1,373 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* input-syslog.c
+ *
+ * Parses raw syslog received on Sagan's own sockets (see input-reactor.c)
+ * straight into a _Sagan_Proc_Syslog.  Both RFC 3164 ("BSD") and RFC 5424
+ * messages are understood.  Fields are filled in the way the rsyslog
+ * template in extra/rsyslog/sagan.conf fills the pipe format,  so rules
+ * match the same way whichever path a log took:
+ *
+ *   host      - The address the log came from (%fromhost-ip%)
+ *   facility  - "daemon",  "local0",  etc
+ *   priority  - The severity ("info",  "err",  etc).  So is "level".
+ *   tag       - "sshd[1234]:"
+ *   date/time - When it was received,  local time
+ *   program   - "sshd"
+ *   message   - The rest,  with its leading space
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "input-syslog.h"
+#include "util-time.h"
+
+struct _SaganConfig *config;
+
+static const char *Syslog_Facility[] =
+{
+    "kern", "user", "mail", "daemon", "auth", "syslog", "lpr", "news",
+    "uucp", "cron", "authpriv", "ftp", "ntp", "audit", "alert", "clock",
+    "local0", "local1", "local2", "local3", "local4", "local5", "local6", "local7"
+};
+
+static const char *Syslog_Severity[] =
+{
+    "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"
+};
+
+/* Logs are stamped with the time they were parsed.  Formatting that once
+   a second per thread is plenty */
+
+static __thread uint64_t Syslog_Last = 0;
+static __thread char Syslog_Date[MAX_SYSLOG_DATE];
+static __thread char Syslog_Time[MAX_SYSLOG_TIME];
+
+/* Copies "len" bytes of "src" (truncated if need be) */
+
+static void Syslog_Copy( char *dst, size_t size, const char *src, size_t len )
+{
+
+    if ( len > size - 1 )
+        {
+            len = size - 1;
+        }
+
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/* Length of the space delimited word at "p" */
+
+static size_t Syslog_Word( const char *p )
+{
+    return( strcspn(p, " ") );
+}
+
+/* Skips the word at "p" and the space after it */
+
+static char *Syslog_Skip( char *p )
+{
+
+    p += Syslog_Word(p);
+
+    return( *p == ' ' ? p + 1 : p );
+}
+
+/* "Mmm dd hh:mm:ss " (RFC 3164) or an ISO 8601 stamp like rsyslog's
+   high precision format.  Returns the length to skip,  0 if there isn't
+   one */
+
+static size_t Syslog_Timestamp( const char *p )
+{
+
+    size_t len;
+
+    if ( strnlen(p, 16) == 16 && isalpha((unsigned char)p[0]) && p[3] == ' ' &&
+            p[6] == ' ' && p[9] == ':' && p[12] == ':' && p[15] == ' ' )
+        {
+            return(16);
+        }
+
+    len = Syslog_Word(p);
+
+    if ( len >= 19 && p[len] == ' ' && isdigit((unsigned char)p[0]) && p[4] == '-' && p[10] == 'T' )
+        {
+            return(len + 1);
+        }
+
+    return(0);
+}
+
+/* Does the word at "p" look like a host name (and not a tag)? */
+
+static bool Syslog_Is_Hostname( const char *p )
+{
+
+    size_t len = strspn(p, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.-_:");
+
+    return( len > 0 && p[len] == ' ' && p[len - 1] != ':' );
+}
+
+/* The address the log came from.  Logs from a unix socket or FIFO don't
+   have one,  so the header's host name is used if it's an IP */
+
+static void Syslog_Host( const struct sockaddr_storage *peer, const char *hostname, char *host, size_t size )
+{
+
+    const struct sockaddr_in6 *sin6 = NULL;
+    unsigned char ip[16];
+
+    if ( peer != NULL && peer->ss_family == AF_INET )
+        {
+            inet_ntop(AF_INET, &((const struct sockaddr_in *)peer)->sin_addr, host, size);
+            return;
+        }
+
+    if ( peer != NULL && peer->ss_family == AF_INET6 )
+        {
+
+            sin6 = (const struct sockaddr_in6 *)peer;
+
+            /* IPv4 senders on a [::] socket */
+
+            if ( IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr) )
+                {
+                    inet_ntop(AF_INET, &sin6->sin6_addr.s6_addr[12], host, size);
+                }
+            else
+                {
+                    inet_ntop(AF_INET6, &sin6->sin6_addr, host, size);
+                }
+
+            return;
+        }
+
+    if ( inet_pton(AF_INET, hostname, ip) == 1 || inet_pton(AF_INET6, hostname, ip) == 1 )
+        {
+            strlcpy(host, hostname, size);
+            return;
+        }
+
+    strlcpy(host, config->sagan_host, size);
+}
+
+void SyslogInput_Syslog( char *syslog_string, const struct sockaddr_storage *peer, struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+{
+
+    struct tm tm;
+    uint64_t now;
+
+    char hostname[MAX_SYSLOG_HOST] = { 0 };
+    char *p = syslog_string;
+    char *app = NULL;
+    char *procid = NULL;
+
+    size_t len;
+    size_t app_len = 0;
+    size_t procid_len = 0;
+
+    int pri = SYSLOG_DEFAULT_PRI;
+    int value = 0;
+    int i;
+
+    bool quoted;
+
+    memset(SaganProcSyslog_LOCAL, 0, sizeof(_Sagan_Proc_Syslog));
+
+    /* <PRI>.  Without one,  RFC 3164 says to assume user.notice */
+
+    if ( p[0] == '<' )
+        {
+
+            for ( i = 1; i < 5 && isdigit((unsigned char)p[i]); i++ )
+                {
+                    value = value * 10 + ( p[i] - '0' );
+                }
+
+            if ( i > 1 && p[i] == '>' && value <= SYSLOG_MAX_PRI )
+                {
+                    pri = value;
+                    p += i + 1;
+                }
+        }
+
+    if ( p != syslog_string && p[0] == '1' && p[1] == ' ' )
+        {
+
+            /* RFC 5424 - VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID [SD] MSG */
+
+            p = Syslog_Skip(p + 2);
+
+            Syslog_Copy(hostname, sizeof(hostname), p, Syslog_Word(p));
+            p = Syslog_Skip(p);
+
+            app = p;
+            app_len = Syslog_Word(p);
+            p = Syslog_Skip(p);
+
+            procid = p;
+            procid_len = Syslog_Word(p);
+            p = Syslog_Skip(p);
+
+            p = Syslog_Skip(p);		/* MSGID */
+
+            /* Structured data is "-" or one or more [id param="value"...] */
+
+            if ( p[0] == '-' )
+                {
+                    p++;
+                }
+
+            while ( p[0] == '[' )
+                {
+
+                    quoted = false;
+
+                    for ( p++; *p != '\0' && ( quoted == true || *p != ']' ); p++ )
+                        {
+
+                            if ( *p == '\\' && p[1] != '\0' )
+                                {
+                                    p++;
+                                }
+
+                            else if ( *p == '"' )
+                                {
+                                    quoted = !quoted;
+                                }
+                        }
+
+                    if ( *p == ']' )
+                        {
+                            p++;
+                        }
+                }
+
+            /* MSG may start with a UTF-8 BOM */
+
+            if ( p[0] == ' ' && !memcmp(p + 1, "\xEF\xBB\xBF", 3) )
+                {
+                    p += 3;
+                    p[0] = ' ';
+                }
+
+            if ( app_len == 1 && app[0] == '-' )
+                {
+                    app_len = 0;
+                }
+
+            if ( procid_len == 1 && procid[0] == '-' )
+                {
+                    procid_len = 0;
+                }
+
+            if ( hostname[0] == '-' && hostname[1] == '\0' )
+                {
+                    hostname[0] = '\0';
+                }
+
+            Syslog_Copy(SaganProcSyslog_LOCAL->syslog_program, sizeof(SaganProcSyslog_LOCAL->syslog_program), app, app_len);
+
+            if ( app_len > 0 )
+                {
+                    snprintf(SaganProcSyslog_LOCAL->syslog_tag, sizeof(SaganProcSyslog_LOCAL->syslog_tag),
+                             procid_len > 0 ? "%.*s[%.*s]:" : "%.*s:", (int)app_len, app, (int)procid_len, procid);
+                }
+        }
+    else
+        {
+
+            /* RFC 3164 - TIMESTAMP HOSTNAME TAG: MSG.  The host name is
+               only looked for after a time stamp.  Local logs (/dev/log)
+               usually don't have one. */
+
+            len = Syslog_Timestamp(p);
+
+            if ( len > 0 )
+                {
+
+                    p += len;
+
+                    if ( Syslog_Is_Hostname(p) )
+                        {
+                            Syslog_Copy(hostname, sizeof(hostname), p, Syslog_Word(p));
+                            p = Syslog_Skip(p);
+                        }
+                }
+
+            /* The tag runs to a ':' or space.  A lone word is all message */
+
+            len = strcspn(p, ": ");
+
+            if ( p[len] != '\0' )
+                {
+
+                    Syslog_Copy(SaganProcSyslog_LOCAL->syslog_tag, sizeof(SaganProcSyslog_LOCAL->syslog_tag), p, p[len] == ':' ? len + 1 : len);
+                    Syslog_Copy(SaganProcSyslog_LOCAL->syslog_program, sizeof(SaganProcSyslog_LOCAL->syslog_program), p, strcspn(p, "[: "));
+
+                    p += p[len] == ':' ? len + 1 : len;
+                }
+        }
+
+    /* Like the pipe format,  the message stops at a new line */
+
+    len = strcspn(p, "\r\n");
+
+    Syslog_Copy(SaganProcSyslog_LOCAL->syslog_message, sizeof(SaganProcSyslog_LOCAL->syslog_message), p, len);
+
+    strlcpy(SaganProcSyslog_LOCAL->syslog_facility, Syslog_Facility[pri >> 3], sizeof(SaganProcSyslog_LOCAL->syslog_facility));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_priority, Syslog_Severity[pri & 7], sizeof(SaganProcSyslog_LOCAL->syslog_priority));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_level, Syslog_Severity[pri & 7], sizeof(SaganProcSyslog_LOCAL->syslog_level));
+
+    Syslog_Host(peer, hostname, SaganProcSyslog_LOCAL->syslog_host, sizeof(SaganProcSyslog_LOCAL->syslog_host));
+
+    now = Return_Epoch();
+
+    if ( now != Syslog_Last )
+        {
+
+            Return_Local_Time(&tm);
+
+            strftime(Syslog_Date, sizeof(Syslog_Date), "%Y-%m-%d", &tm);
+            strftime(Syslog_Time, sizeof(Syslog_Time), "%H:%M:%S", &tm);
+
+            Syslog_Last = now;
+        }
+
+    strlcpy(SaganProcSyslog_LOCAL->syslog_date, Syslog_Date, sizeof(SaganProcSyslog_LOCAL->syslog_date));
+    strlcpy(SaganProcSyslog_LOCAL->syslog_time, Syslog_Time, sizeof(SaganProcSyslog_LOCAL->syslog_time));
+}
+
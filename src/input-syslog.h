@@ -0,0 +1,31 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* input-syslog.h
+ *
+ * Raw RFC 3164/RFC 5424 syslog,  as received on Sagan's own sockets.
+ *
+ */
+
+#define SYSLOG_DEFAULT_PRI	13		/* user.notice (RFC 3164 4.3.3) */
+#define SYSLOG_MAX_PRI		191
+
+void SyslogInput_Syslog( char *syslog_string, const struct sockaddr_storage *peer, struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL );
+
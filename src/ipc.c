@@ -58,378 +58,162 @@ struct _Sagan_IPC_Counters *counters_ipc;
 
 struct _SaganConfig *config;
 
-pthread_mutex_t After2_Mutex;
-pthread_mutex_t Thresh2_Mutex;
-pthread_mutex_t Flexbit_Mutex;
-pthread_mutex_t Xbit_Mutex;
-
 struct _After2_IPC *After2_IPC;
 struct _Threshold2_IPC *Threshold2_IPC;
 struct _Sagan_Track_Clients_IPC *SaganTrackClients_ipc;
 struct _Sagan_IPC_Flexbit *flexbit_ipc;
+struct _Sagan_IPC_Flexbit_Index *flexbit_index;
 struct _Sagan_IPC_Xbit *Xbit_IPC;
 
+struct _IPC_Hash_Stripes Xbit_Stripes;
+struct _IPC_Hash_Stripes Thresh2_Stripes;
+struct _IPC_Hash_Stripes After2_Stripes;
+
 struct _SaganDebug *debug;
 
 /*****************************************************************************
- * Clean_IPC_Object - If the max IPC is hit,  we attempt to "clean" out
- * any stale IPC entries.
+ * IPC_Hash_Bytes - FNV-1a over binary data.  Pass in the previous result to
+ * hash several fields.  The first call should use IPC_HASH_SEED.
  *****************************************************************************/
 
-bool Clean_IPC_Object( int type )
+uint32_t IPC_Hash_Bytes( uint32_t hash, const void *data, size_t len )
 {
 
-    if ( type == AFTER2 && config->max_after2 < counters_ipc->after2_count )
-        {
-
-            time_t t;
-            struct tm *now;
-
-            int i;
-            int utime = 0;
-            int new_count = 0;
-            int old_count = 0;
-
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
-
-            if ( debug->debugipc )
-                {
-                    Sagan_Log(DEBUG, "[%s, %d line] Cleaning IPC data. Type: %d", __FILE__, __LINE__, type);
-                }
-
-            File_Lock(config->shm_after2);
-            pthread_mutex_lock(&After2_Mutex);
-
-            struct _After2_IPC *Temp_After2_IPC;
-            Temp_After2_IPC = malloc(sizeof(struct _After2_IPC) * config->max_after2);
-            memset(Temp_After2_IPC, 0, sizeof(sizeof(struct _After2_IPC) * config->max_after2));
-
-            old_count = counters_ipc->after2_count;
-
-            for (i = 0; i < counters_ipc->after2_count; i++)
-                {
-
-                    if ( (utime - After2_IPC[i].utime) < After2_IPC[i].expire )
-                        {
-
-                            if ( debug->debugipc )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, %d line] After2_IPC : Keeping %lu.", __FILE__, __LINE__, After2_IPC[i].hash);
-                                }
-
-                            Temp_After2_IPC[new_count].hash = After2_IPC[i].hash;
-                            Temp_After2_IPC[new_count].count = After2_IPC[i].count;
-                            Temp_After2_IPC[new_count].utime = After2_IPC[i].utime;
-                            Temp_After2_IPC[new_count].expire = After2_IPC[i].expire;
-                            Temp_After2_IPC[new_count].sid = After2_IPC[i].sid;
-                            new_count++;
-
-                        }
-                }
-
-
-            if ( new_count > 0 )
-                {
-                    for ( i = 0; i < new_count; i++ )
-                        {
-                            After2_IPC[i].hash = Temp_After2_IPC[i].hash;
-                            After2_IPC[i].count = Temp_After2_IPC[i].count;
-                            After2_IPC[i].utime = Temp_After2_IPC[i].utime;
-                            After2_IPC[i].expire = Temp_After2_IPC[i].expire;
-                            After2_IPC[i].sid =  Temp_After2_IPC[i].sid;
-                        }
-
-                    counters_ipc->after2_count = new_count;
-
-                }
-            else
-                {
-
-                    Sagan_Log(WARN, "[%s, line %d] Could not clean After2_IPC.  Nothing to remove!", __FILE__, __LINE__);
-                    free(Temp_After2_IPC);
-                    pthread_mutex_unlock(&After2_Mutex);
-                    File_Unlock(config->shm_after2);
-                    return(1);
-
-                }
-
-            Sagan_Log(NORMAL, "[%s, line %d] Kept %d elements out of %d for After2_IPC", __FILE__, __LINE__, new_count, old_count);
-            free(Temp_After2_IPC);
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i;
 
-            pthread_mutex_unlock(&After2_Mutex);
-            File_Unlock(config->shm_after2);
-            return(0);
-        }
-
-    /* Threshold2 */
-
-    else if ( type == THRESHOLD2 && config->max_threshold2 < counters_ipc->thresh2_count )
+    for ( i = 0; i < len; i++ )
         {
+            hash ^= p[i];
+            hash *= 16777619;
+        }
 
-            time_t t;
-            struct tm *now;
-
-            int i;
-            int utime = 0;
-            int new_count = 0;
-            int old_count = 0;
-
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
-
-            new_count = 0;
-            old_count = 0;
-
-            File_Lock(config->shm_thresh2);
-            pthread_mutex_lock(&Thresh2_Mutex);
-
-            struct _Threshold2_IPC *Temp_Threshold2_IPC;
-            Temp_Threshold2_IPC = malloc(sizeof(struct _Threshold2_IPC) * config->max_threshold2);
-
-            memset(Temp_Threshold2_IPC, 0, sizeof(sizeof(struct _Threshold2_IPC) * config->max_threshold2));
-
-            old_count = counters_ipc->thresh2_count;
-
-            for (i = 0; i < counters_ipc->thresh2_count; i++)
-                {
-                    if ( (utime - Threshold2_IPC[i].utime) < Threshold2_IPC[i].expire )
-                        {
-
-                            if ( debug->debugipc )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, %d line] Threshold2_IPC : Keeping %lu.", __FILE__, __LINE__, Threshold2_IPC[i].hash);
-                                }
-
-                            Temp_Threshold2_IPC[new_count].hash = Threshold2_IPC[i].hash;
-                            Temp_Threshold2_IPC[new_count].count = Threshold2_IPC[i].count;
-                            Temp_Threshold2_IPC[new_count].utime = Threshold2_IPC[i].utime;
-                            Temp_Threshold2_IPC[new_count].expire = Threshold2_IPC[i].expire;
-                            Temp_Threshold2_IPC[new_count].sid = Threshold2_IPC[i].sid;
-
-                            new_count++;
-
-                        }
-                }
-
-            if ( new_count > 0 )
-                {
-                    for ( i = 0; i < new_count; i++ )
-                        {
-                            Threshold2_IPC[i].hash = Temp_Threshold2_IPC[i].hash;
-                            Threshold2_IPC[i].count = Temp_Threshold2_IPC[i].count;
-                            Threshold2_IPC[i].utime = Temp_Threshold2_IPC[i].utime;
-                            Threshold2_IPC[i].expire = Temp_Threshold2_IPC[i].expire;
-                            Threshold2_IPC[i].sid =  Temp_Threshold2_IPC[i].sid;
-                        }
-
-                    counters_ipc->thresh2_count = new_count;
-
-                }
-            else
-                {
+    return(hash);
+}
 
-                    Sagan_Log(WARN, "[%s, line %d] Could not clean Threshold2_IPC.  Nothing to remove!", __FILE__, __LINE__);
-                    free(Temp_Threshold2_IPC);
-                    pthread_mutex_unlock(&Thresh2_Mutex);
-                    File_Unlock(config->shm_thresh2);
-                    return(1);
-                }
+/*****************************************************************************
+ * IPC_Hash_IP - Hashes the binary form of an IP address.  If it's not an
+ * IP (or empty),  the string itself is used.
+ *****************************************************************************/
 
-            Sagan_Log(NORMAL, "[%s, line %d] Kept %d elements out of %d for Threshold2_IPC", __FILE__, __LINE__, new_count, old_count);
-            free(Temp_Threshold2_IPC);
+uint32_t IPC_Hash_IP( uint32_t hash, const char *ip )
+{
 
-            pthread_mutex_unlock(&Thresh2_Mutex);
-            File_Unlock(config->shm_thresh2);
-            return(0);
+    unsigned char ip_bits[MAXIPBIT] = { 0 };
 
+    if ( inet_pton(AF_INET, ip, ip_bits) == 1 )
+        {
+            return(IPC_Hash_Bytes(hash, ip_bits, 4));
         }
 
-    /* Flexbit_IPC */
-
-    else if ( type == FLEXBIT && config->max_flexbits < counters_ipc->flexbit_count )
+    if ( inet_pton(AF_INET6, ip, ip_bits) == 1 )
         {
+            return(IPC_Hash_Bytes(hash, ip_bits, MAXIPBIT));
+        }
 
-            time_t t;
-            struct tm *now;
-
-            int i;
-            int utime = 0;
-            int new_count = 0;
-            int old_count = 0;
-
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
-
-            new_count = 0;
-            old_count = 0;
-
-            File_Lock(config->shm_flexbit);
-            pthread_mutex_lock(&Flexbit_Mutex);
-
-            struct _Sagan_IPC_Flexbit *temp_flexbit_ipc;
-            temp_flexbit_ipc = malloc(sizeof(struct _Sagan_IPC_Flexbit) * config->max_flexbits);
-
-            memset(temp_flexbit_ipc, 0, sizeof(sizeof(struct _Sagan_IPC_Flexbit) * config->max_flexbits));
-
-            old_count = counters_ipc->flexbit_count;
-
-            for (i = 0; i < counters_ipc->flexbit_count; i++)
-                {
-                    if ( (utime - flexbit_ipc[i].flexbit_expire) < flexbit_ipc[i].expire )
-                        {
-
-                            if ( debug->debugipc )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, %d line] Flexbit_IPC : Keeping [0x%.08X%.08X%.08X%.08X -> 0x%.08X%.08X%.08X%.08X].", __FILE__, __LINE__,
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_src)[0]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_src)[1]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_src)[2]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_src)[3]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_dst)[0]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_dst)[1]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_dst)[2]),
-                                              htonl(((unsigned int *)&flexbit_ipc[i].ip_dst)[3]));
-                                }
-
-                            temp_flexbit_ipc[new_count].flexbit_state = flexbit_ipc[i].flexbit_state;
-                            memcpy(temp_flexbit_ipc[new_count].ip_src, flexbit_ipc[i].ip_src, sizeof(flexbit_ipc[i].ip_src));
-                            memcpy(temp_flexbit_ipc[new_count].ip_dst, flexbit_ipc[i].ip_dst, sizeof(flexbit_ipc[i].ip_dst));
-                            temp_flexbit_ipc[new_count].flexbit_expire = flexbit_ipc[i].flexbit_expire;
-                            temp_flexbit_ipc[new_count].expire = flexbit_ipc[i].expire;
-                            strlcpy(temp_flexbit_ipc[new_count].flexbit_name, flexbit_ipc[i].flexbit_name, sizeof(temp_flexbit_ipc[new_count].flexbit_name));
-
-                            new_count++;
-                        }
-                }
-
-            if ( new_count > 0 )
-                {
-                    for ( i = 0; i < new_count; i++ )
-                        {
-                            flexbit_ipc[i].flexbit_state = temp_flexbit_ipc[i].flexbit_state;
-                            memcpy(temp_flexbit_ipc[i].ip_src, temp_flexbit_ipc[i].ip_src, sizeof(temp_flexbit_ipc[i].ip_src));
-                            memcpy(temp_flexbit_ipc[i].ip_dst, temp_flexbit_ipc[i].ip_dst, sizeof(temp_flexbit_ipc[i].ip_dst));
-                            flexbit_ipc[i].flexbit_expire = temp_flexbit_ipc[i].flexbit_expire;
-                            flexbit_ipc[i].expire = temp_flexbit_ipc[i].expire;
-                            strlcpy(flexbit_ipc[i].flexbit_name, temp_flexbit_ipc[i].flexbit_name, sizeof(flexbit_ipc[i].flexbit_name));
-                        }
-
-                    counters_ipc->flexbit_count = new_count;
-
-                }
-            else
-                {
-
-                    Sagan_Log(WARN, "[%s, line %d] Could not clean _Sagan_IPC_Flexbit.  Nothing to remove!", __FILE__, __LINE__);
-                    free(temp_flexbit_ipc);
-                    pthread_mutex_unlock(&Flexbit_Mutex);
-                    File_Unlock(config->shm_flexbit);
-                    return(1);
-                }
+    return(IPC_Hash_Bytes(hash, ip, strlen(ip)));
+}
 
-            Sagan_Log(NORMAL, "[%s, line %d] Kept %d elements out of %d for _Sagan_IPC_Flexbit.", __FILE__, __LINE__, new_count, old_count);
-            free(temp_flexbit_ipc);
+/*****************************************************************************
+ * IPC_Hash_Slots - Slots used by a table of "max" entries.  This is rounded
+ * down to a multiple of IPC_HASH_PROBE so a probe window never spans more
+ * than two stripes.
+ *****************************************************************************/
 
-            pthread_mutex_unlock(&Flexbit_Mutex);
-            File_Unlock(config->shm_flexbit);
-            return(0);
+uint32_t IPC_Hash_Slots( int max )
+{
 
-        }
+    uint32_t table_size = IPC_HASH_TABLE_SIZE( (uint32_t)max );
 
-    else if ( type == XBIT && config->max_xbits < counters_ipc->xbit_count && config->xbit_storage == XBIT_STORAGE_MMAP )
+    if ( table_size < IPC_HASH_PROBE )
         {
+            return( table_size );
+        }
 
+    return( table_size - ( table_size % IPC_HASH_PROBE ) );
+}
 
-            int old_count = 0;
-            int new_count = 0;
-
-            int i = 0;
-
-            File_Lock(config->shm_xbit);
-            pthread_mutex_lock(&Xbit_Mutex);
+/*****************************************************************************
+ * IPC_Hash_Home - Returns the "home" slot for a hash
+ *****************************************************************************/
 
-            struct _Sagan_IPC_Xbit *temp_xbit_ipc;
-            temp_xbit_ipc = malloc(sizeof(struct _Sagan_IPC_Xbit) * config->max_xbits);
-            memset(temp_xbit_ipc, 0, sizeof(sizeof(struct _Sagan_IPC_Xbit) * config->max_xbits));
+uint32_t IPC_Hash_Home( uint32_t hash, uint32_t slots )
+{
 
-            old_count = counters_ipc->xbit_count;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
 
-            for (i = 0; i < counters_ipc->xbit_count; i++)
-                {
+    return( hash % slots );
+}
 
-                    if ( Xbit_IPC[i].xbit_expire != 0 && Xbit_IPC[i].xbit_expire >= Return_Epoch() )
-                        {
+/*****************************************************************************
+ * IPC_Hash_Init - Sets up the lock stripes for a table
+ *****************************************************************************/
 
-                            strlcpy(temp_xbit_ipc[new_count].xbit_name, Xbit_IPC[i].xbit_name, sizeof(temp_xbit_ipc[new_count].xbit_name));
-                            strlcpy(temp_xbit_ipc[new_count].syslog_message, Xbit_IPC[i].syslog_message, sizeof(temp_xbit_ipc[new_count].syslog_message));
-                            strlcpy(temp_xbit_ipc[new_count].signature_msg, Xbit_IPC[i].signature_msg, sizeof(temp_xbit_ipc[new_count].signature_msg));
+void IPC_Hash_Init( struct _IPC_Hash_Stripes *stripes )
+{
 
-                            temp_xbit_ipc[new_count].xbit_hash = Xbit_IPC[i].xbit_hash;
-                            temp_xbit_ipc[new_count].xbit_name_hash = Xbit_IPC[i].xbit_name_hash;
-                            temp_xbit_ipc[new_count].xbit_expire = Xbit_IPC[i].xbit_expire;
-                            temp_xbit_ipc[new_count].expire = Xbit_IPC[i].expire;
-                            temp_xbit_ipc[new_count].sid =  Xbit_IPC[i].sid;
+    int i;
 
-                            new_count++;
+    for ( i = 0; i < IPC_HASH_STRIPES; i++ )
+        {
+            pthread_mutex_init(&stripes->mutex[i], NULL);
+        }
+}
 
-                        }
-                }
+/*****************************************************************************
+ * IPC_Hash_Lock/IPC_Hash_Unlock - Each run of IPC_HASH_PROBE slots maps to a
+ * stripe.  A stripe is a pthread mutex (threads) and a one byte fcntl()
+ * lock (other processes).  A probe window can cross into the next run,  so
+ * up to two stripes are taken (lowest first).
+ *****************************************************************************/
 
-            if ( new_count > 0 )
-                {
+static void IPC_Hash_Stripes( uint32_t slots, uint32_t home, int *stripe_a, int *stripe_b )
+{
 
-                    for ( i = 0; i < new_count; i++ )
-                        {
+    uint32_t last = ( home + IPC_HASH_PROBE - 1 ) % slots;
+    int a = ( home / IPC_HASH_PROBE ) % IPC_HASH_STRIPES;
+    int b = ( last / IPC_HASH_PROBE ) % IPC_HASH_STRIPES;
 
-                            strlcpy(Xbit_IPC[i].xbit_name, temp_xbit_ipc[new_count].xbit_name, sizeof(Xbit_IPC[i].xbit_name));
-                            strlcpy(Xbit_IPC[i].syslog_message, temp_xbit_ipc[new_count].syslog_message, sizeof(Xbit_IPC[i].syslog_message));
-                            strlcpy(Xbit_IPC[i].signature_msg, temp_xbit_ipc[new_count].signature_msg, sizeof(Xbit_IPC[i].signature_msg));
+    *stripe_a = a < b ? a : b;
+    *stripe_b = a < b ? b : a;
+}
 
-                            Xbit_IPC[i].xbit_hash = temp_xbit_ipc[new_count].xbit_hash;
-                            Xbit_IPC[i].xbit_name_hash = temp_xbit_ipc[new_count].xbit_name_hash;
-                            Xbit_IPC[i].xbit_expire = temp_xbit_ipc[new_count].xbit_expire;
-                            Xbit_IPC[i].expire = temp_xbit_ipc[new_count].expire;
-                            Xbit_IPC[i].sid = temp_xbit_ipc[new_count].sid;
+void IPC_Hash_Lock( struct _IPC_Hash_Stripes *stripes, int fd, uint32_t slots, uint32_t home )
+{
 
-                        }
+    int stripe_a;
+    int stripe_b;
 
-                    counters_ipc->xbit_count = new_count;
+    IPC_Hash_Stripes(slots, home, &stripe_a, &stripe_b);
 
-                }
-            else
-                {
+    pthread_mutex_lock(&stripes->mutex[stripe_a]);
+    File_Lock_Range(fd, stripe_a, 1);
 
-                    Sagan_Log(WARN, "[%s, line %d] Could not clean _Sagan_IPC_Xbit.  Nothing to remove!", __FILE__, __LINE__);
-                    free(temp_xbit_ipc);
-                    pthread_mutex_unlock(&Xbit_Mutex);
-                    File_Unlock(config->shm_xbit);
-                    return(1);
+    if ( stripe_b != stripe_a )
+        {
+            pthread_mutex_lock(&stripes->mutex[stripe_b]);
+            File_Lock_Range(fd, stripe_b, 1);
+        }
+}
 
-                }
+void IPC_Hash_Unlock( struct _IPC_Hash_Stripes *stripes, int fd, uint32_t slots, uint32_t home )
+{
 
-            Sagan_Log(NORMAL, "[%s, line %d] Kept %d xbits out of %d for _Sagan_IPC_Xbit.", __FILE__, __LINE__, new_count, old_count);
-            free(temp_xbit_ipc);
+    int stripe_a;
+    int stripe_b;
 
-            File_Unlock(config->shm_xbit);
-            pthread_mutex_unlock(&Xbit_Mutex);
+    IPC_Hash_Stripes(slots, home, &stripe_a, &stripe_b);
 
+    if ( stripe_b != stripe_a )
+        {
+            File_Unlock_Range(fd, stripe_b, 1);
+            pthread_mutex_unlock(&stripes->mutex[stripe_b]);
         }
 
-    return(0);
-
+    File_Unlock_Range(fd, stripe_a, 1);
+    pthread_mutex_unlock(&stripes->mutex[stripe_a]);
 }
 
 /*****************************************************************************
@@ -472,6 +256,10 @@ void IPC_Init(void)
     Sagan_Log(NORMAL, "Initializing shared memory objects.");
     Sagan_Log(NORMAL, "---------------------------------------------------------------------------");
 
+    IPC_Hash_Init(&Xbit_Stripes);
+    IPC_Hash_Init(&Thresh2_Stripes);
+    IPC_Hash_Init(&After2_Stripes);
+
     /* Init counters first.  Need to track all other share memory objects */
 
     snprintf(tmp_object_check, sizeof(tmp_object_check) - 1, "%s/%s", config->ipc_directory, COUNTERS_IPC_FILE);
@@ -541,12 +329,12 @@ void IPC_Init(void)
 
             config->shm_xbit_status = true;
 
-            if ( ftruncate(config->shm_xbit, sizeof(_Sagan_IPC_Xbit) * config->max_xbits ) != 0 )
+            if ( ftruncate(config->shm_xbit, sizeof(_Sagan_IPC_Xbit) * IPC_HASH_TABLE_SIZE(config->max_xbits) ) != 0 )
                 {
                     Sagan_Log(ERROR, "[%s, line %d] Failed to ftruncate xbit. [%s]", __FILE__, __LINE__, strerror(errno));
                 }
 
-            if (( Xbit_IPC = mmap(0, sizeof(_Sagan_IPC_Xbit) * config->max_xbits, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_xbit, 0)) == MAP_FAILED )
+            if (( Xbit_IPC = mmap(0, sizeof(_Sagan_IPC_Xbit) * IPC_HASH_TABLE_SIZE(config->max_xbits), (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_xbit, 0)) == MAP_FAILED )
                 {
                     Sagan_Log(ERROR, "[%s, line %d] Error allocating memory for xbit object! [%s]", __FILE__, __LINE__, strerror(errno));
                 }
@@ -586,16 +374,21 @@ void IPC_Init(void)
 
     config->shm_flexbit_status = true;
 
-    if ( ftruncate(config->shm_flexbit, sizeof(_Sagan_IPC_Flexbit) * config->max_flexbits ) != 0 )
+    /* Flexbit entries are followed by their lookup index */
+
+    if ( ftruncate(config->shm_flexbit, sizeof(_Sagan_IPC_Flexbit) * config->max_flexbits + FLEXBIT_INDEX_SIZE(Flexbit_Buckets_MMAP(config->max_flexbits)) ) != 0 )
         {
             Sagan_Log(ERROR, "[%s, line %d] Failed to ftruncate flexbit. [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
-    if (( flexbit_ipc = mmap(0, sizeof(_Sagan_IPC_Flexbit) * config->max_flexbits, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_flexbit, 0)) == MAP_FAILED )
+    if (( flexbit_ipc = mmap(0, sizeof(_Sagan_IPC_Flexbit) * config->max_flexbits + FLEXBIT_INDEX_SIZE(Flexbit_Buckets_MMAP(config->max_flexbits)), (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_flexbit, 0)) == MAP_FAILED )
         {
             Sagan_Log(ERROR, "[%s, line %d] Error allocating memory for flexbit object! [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
+    flexbit_index = (struct _Sagan_IPC_Flexbit_Index *)( flexbit_ipc + config->max_flexbits );
+    Flexbit_Init_MMAP();
+
     if ( new_object == 0)
         {
             Sagan_Log(NORMAL, "- Flexbit shared object reloaded (%d flexbits loaded / max: %d).", counters_ipc->flexbit_count, config->max_flexbits);
@@ -623,12 +416,12 @@ void IPC_Init(void)
 
     config->shm_thresh2_status = true;
 
-    if ( ftruncate(config->shm_thresh2, sizeof(_Threshold2_IPC) * config->max_threshold2 ) != 0 )
+    if ( ftruncate(config->shm_thresh2, sizeof(_Threshold2_IPC) * IPC_HASH_TABLE_SIZE(config->max_threshold2) ) != 0 )
         {
             Sagan_Log(ERROR, "[%s, line %d] Failed to ftruncate thresh2. [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
-    if (( Threshold2_IPC = mmap(0, sizeof(_Threshold2_IPC) * config->max_threshold2, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_thresh2, 0)) == MAP_FAILED )
+    if (( Threshold2_IPC = mmap(0, sizeof(_Threshold2_IPC) * IPC_HASH_TABLE_SIZE(config->max_threshold2), (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_thresh2, 0)) == MAP_FAILED )
         {
             Sagan_Log(ERROR, "[%s, line %d] Error allocating memory for _Threshold2_IPC object! [%s]", __FILE__, __LINE__, strerror(errno));
         }
@@ -661,12 +454,12 @@ void IPC_Init(void)
 
     config->shm_after2_status = true;
 
-    if ( ftruncate(config->shm_after2, sizeof(_After2_IPC) * config->max_after2 ) != 0 )
+    if ( ftruncate(config->shm_after2, sizeof(_After2_IPC) * IPC_HASH_TABLE_SIZE(config->max_after2) ) != 0 )
         {
             Sagan_Log(ERROR, "[%s, line %d] Failed to ftruncate after2. [%s]", __FILE__, __LINE__, strerror(errno));
         }
 
-    if (( After2_IPC = mmap(0, sizeof(_After2_IPC) * config->max_after2, (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_after2, 0)) == MAP_FAILED )
+    if (( After2_IPC = mmap(0, sizeof(_After2_IPC) * IPC_HASH_TABLE_SIZE(config->max_after2), (PROT_READ | PROT_WRITE), MAP_SHARED, config->shm_after2, 0)) == MAP_FAILED )
         {
             Sagan_Log(ERROR, "[%s, line %d] Error allocating memory for _After2_IPC object! [%s]", __FILE__, __LINE__, strerror(errno));
         }
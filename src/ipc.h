@@ -31,8 +31,39 @@
 #include "config.h"             /* From autoconf */
 #endif
 
+#include <pthread.h>
+#include <stdint.h>
+
+/* xbits,  thresholds and afters are stored as open addressing hash tables in
+   their mmap() files.  An entry lives within IPC_HASH_PROBE slots of its
+   "home" slot.  Slots are never emptied,  expired ones are reused in place.
+   That keeps probe chains valid for every Sagan process sharing the files
+   and means nothing ever needs to be compacted. */
+
+#define IPC_HASH_PROBE		32	/* Max slots from "home" an entry can live */
+#define IPC_HASH_STRIPES	256	/* Lock stripes per table */
+#define IPC_HASH_SEED		2166136261U
+
+/* Slots in a mmap() file for "max" entries.  Tables are kept at most half
+   full so entries stay close to their "home" slot */
+
+#define IPC_HASH_TABLE_SIZE(max)	( (max) * 2 )
+
+typedef struct _IPC_Hash_Stripes _IPC_Hash_Stripes;
+struct _IPC_Hash_Stripes
+{
+    pthread_mutex_t mutex[IPC_HASH_STRIPES];
+};
+
 void IPC_Init(void);
-bool Clean_IPC_Object( int );
 void IPC_Check_Object(char *, bool, char *);
 
+uint32_t IPC_Hash_Bytes( uint32_t, const void *, size_t );
+uint32_t IPC_Hash_IP( uint32_t, const char * );
+uint32_t IPC_Hash_Slots( int );
+uint32_t IPC_Hash_Home( uint32_t, uint32_t );
+void IPC_Hash_Init( struct _IPC_Hash_Stripes * );
+void IPC_Hash_Lock( struct _IPC_Hash_Stripes *, int, uint32_t, uint32_t );
+void IPC_Hash_Unlock( struct _IPC_Hash_Stripes *, int, uint32_t, uint32_t );
+
 
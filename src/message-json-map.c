@@ -32,12 +32,17 @@ libfastjson is required for Sagan to function!
 #ifdef HAVE_LIBFASTJSON
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <json.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "version.h"
 #include "message-json-map.h"
 
@@ -49,7 +54,273 @@ struct _SaganCounters *counters;
 struct _SaganDebug *debug;
 
 struct _JSON_Message_Map *JSON_Message_Map;
-struct _JSON_Message_Tmp *JSON_Message_Tmp;
+
+static struct _JSON_Message_Plan *JSON_Message_Plan = NULL;
+
+/* The key in the map that "handler" is for */
+
+static const char *JSON_Message_Key( const struct _JSON_Message_Plan_Handler *handler )
+{
+
+    struct _JSON_Message_Map *map = &JSON_Message_Map[handler->map];
+
+    switch ( handler->field )
+        {
+
+        case JSON_MESSAGE_MESSAGE:
+            return(map->message[handler->message]);
+
+        case JSON_MESSAGE_PROGRAM:
+            return(map->program);
+
+        case JSON_MESSAGE_SRC_IP:
+            return(map->src_ip);
+
+        case JSON_MESSAGE_DST_IP:
+            return(map->dst_ip);
+
+        case JSON_MESSAGE_SRC_PORT:
+            return(map->src_port);
+
+        case JSON_MESSAGE_DST_PORT:
+            return(map->dst_port);
+
+        case JSON_MESSAGE_PROTO:
+            return(map->proto);
+
+        case JSON_MESSAGE_FLOW_ID:
+            return(map->flow_id);
+
+        case JSON_MESSAGE_MD5:
+            return(map->md5);
+
+        case JSON_MESSAGE_SHA1:
+            return(map->sha1);
+
+        case JSON_MESSAGE_SHA256:
+            return(map->sha256);
+
+        case JSON_MESSAGE_FILENAME:
+            return(map->filename);
+
+        case JSON_MESSAGE_HOSTNAME:
+            return(map->hostname);
+
+        case JSON_MESSAGE_URL:
+            return(map->url);
+
+        case JSON_MESSAGE_JA3:
+            return(map->ja3);
+
+        }
+
+    return("");
+}
+
+/* Same as Djb2_Hash(),  but for keys that aren't terminated */
+
+static inline uint32_t JSON_Message_Hash( const char *key, size_t len )
+{
+
+    uint32_t hash = 5381;
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+        {
+            hash = ((hash << 5) + hash) + (unsigned char)key[i];
+        }
+
+    return(hash);
+}
+
+static int JSON_Message_Handler_Compare( const void *a, const void *b )
+{
+
+    const struct _JSON_Message_Plan_Handler *ha = a;
+    const struct _JSON_Message_Plan_Handler *hb = b;
+
+    int ret = strcmp( JSON_Message_Key(ha), JSON_Message_Key(hb) );
+
+    if ( ret != 0 )
+        {
+            return(ret);
+        }
+
+    if ( ha->map != hb->map )
+        {
+            return( ha->map < hb->map ? -1 : 1 );
+        }
+
+    if ( ha->field != hb->field )
+        {
+            return( ha->field < hb->field ? -1 : 1 );
+        }
+
+    return( ha->message - hb->message );
+}
+
+static void JSON_Message_Free( struct _JSON_Message_Plan *plan )
+{
+
+    if ( plan == NULL )
+        {
+            return;
+        }
+
+    free(plan->key);
+    free(plan->table);
+    free(plan->handler);
+    free(plan);
+}
+
+/****************************************************************************
+ * JSON_Message_Compile - Builds the plan for the loaded maps.  Called after
+ * loading (and reloading,  while the processors are paused).
+ ****************************************************************************/
+
+static void JSON_Message_Compile( void )
+{
+
+    struct _JSON_Message_Plan *plan = NULL;
+    struct _JSON_Message_Plan_Handler *handler = NULL;
+    struct _JSON_Message_Plan_Key *key = NULL;
+
+    const char *name = NULL;
+    uint32_t max = 0;
+    uint32_t slots = 1;
+    uint32_t i;
+    uint32_t slot;
+    int f;
+    int b;
+
+    plan = malloc(sizeof(struct _JSON_Message_Plan));
+
+    if ( plan == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for JSON message plan. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(plan, 0, sizeof(struct _JSON_Message_Plan));
+
+    max = counters->json_message_map * ( JSON_MESSAGE_FIELDS + JSON_MESSAGE_MAX_KEYS );
+
+    plan->handler = malloc( ( max + 1 ) * sizeof(struct _JSON_Message_Plan_Handler) );
+
+    if ( plan->handler == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for JSON message plan. Abort!", __FILE__, __LINE__);
+        }
+
+    /* One handler per key each map names */
+
+    for ( i = 0; i < counters->json_message_map; i++ )
+        {
+
+            for ( f = 0; f < JSON_MESSAGE_FIELDS; f++ )
+                {
+
+                    if ( f == JSON_MESSAGE_MESSAGE )
+                        {
+
+                            if ( !strcmp(JSON_Message_Map[i].message[0], "%JSON%" ) )
+                                {
+                                    continue;
+                                }
+
+                            for ( b = 0; b < JSON_Message_Map[i].message_count; b++ )
+                                {
+
+                                    if ( JSON_Message_Map[i].message[b][0] != '\0' )
+                                        {
+                                            handler = &plan->handler[plan->handler_count++];
+                                            handler->map = i;
+                                            handler->field = f;
+                                            handler->message = b;
+                                        }
+                                }
+
+                            continue;
+                        }
+
+                    handler = &plan->handler[plan->handler_count];
+                    handler->map = i;
+                    handler->field = f;
+                    handler->message = 0;
+
+                    if ( JSON_Message_Key(handler)[0] != '\0' )
+                        {
+                            plan->handler_count++;
+                        }
+                }
+        }
+
+    /* Group them by key */
+
+    qsort(plan->handler, plan->handler_count, sizeof(struct _JSON_Message_Plan_Handler), JSON_Message_Handler_Compare);
+
+    plan->key = malloc( ( plan->handler_count + 1 ) * sizeof(struct _JSON_Message_Plan_Key) );
+
+    if ( plan->key == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for JSON message plan. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < plan->handler_count; i++ )
+        {
+
+            name = JSON_Message_Key(&plan->handler[i]);
+
+            if ( plan->key_count == 0 || strcmp(plan->key[plan->key_count - 1].key, name) )
+                {
+                    key = &plan->key[plan->key_count++];
+
+                    strlcpy(key->key, name, sizeof(key->key));
+                    key->len = strlen(key->key);
+                    key->hash = JSON_Message_Hash(key->key, key->len);
+                    key->handler = i;
+                    key->handler_count = 0;
+                }
+
+            key->handler_count++;
+        }
+
+    /* Open addressing,  at most half full */
+
+    while ( slots < plan->key_count * 2 )
+        {
+            slots <<= 1;
+        }
+
+    plan->table = malloc( slots * sizeof(int32_t) );
+
+    if ( plan->table == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for JSON message plan. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(plan->table, 0xFF, slots * sizeof(int32_t));
+    plan->table_mask = slots - 1;
+
+    for ( i = 0; i < plan->key_count; i++ )
+        {
+
+            slot = plan->key[i].hash & plan->table_mask;
+
+            while ( plan->table[slot] != -1 )
+                {
+                    slot = ( slot + 1 ) & plan->table_mask;
+                }
+
+            plan->table[slot] = i;
+        }
+
+    JSON_Message_Free(JSON_Message_Plan);
+    JSON_Message_Plan = plan;
+
+    Sagan_Log(NORMAL, "Compiled %d JSON 'message' mapping(s) into %d key(s).", counters->json_message_map, plan->key_count);
+
+}
+
 
 /*************************
  * Load JSON mapping file
@@ -179,7 +450,7 @@ void Load_Message_JSON_Map ( const char *json_map )
 
                             ptr2 = strtok_r(data, ",", &ptr1);
 
-                            while ( ptr2 != NULL )
+                            while ( ptr2 != NULL && JSON_Message_Map[counters->json_message_map].message_count < JSON_MESSAGE_MAX_KEYS )
                                 {
 
                                     strlcpy(JSON_Message_Map[counters->json_message_map].message[JSON_Message_Map[counters->json_message_map].message_count], ptr2, sizeof(JSON_Message_Map[counters->json_message_map].message[JSON_Message_Map[counters->json_message_map].message_count]));
@@ -364,426 +635,334 @@ void Load_Message_JSON_Map ( const char *json_map )
 
     json_object_put(json_obj);
 
+    JSON_Message_Compile();
+
 }
 
-/************************************************************************
- * Parse_JSON_Message - Parses mesage (or program+message) for JSON data
- ************************************************************************/
+/* Sagan_JSON_Walk() callback.  Looks "key" up in the plan and records the
+   value for every map that wants it.  Nothing is copied,  the hit points
+   into the log line. */
 
-void Parse_JSON_Message ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+static void Parse_JSON_Message_Field( void *data, uint16_t nest, const char *key, size_t key_len, const struct _Sagan_JSON_Value *value )
 {
 
-    struct _JSON_Message_Map_Found *JSON_Message_Map_Found = NULL;
-    JSON_Message_Map_Found = malloc(sizeof(struct _JSON_Message_Map_Found) * JSON_MAX_NEST);
-
-    if ( JSON_Message_Map_Found == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for JSON_Message_Map_Found. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(JSON_Message_Map_Found, 0, sizeof(_JSON_Message_Map_Found) * JSON_MAX_NEST);
-
-    uint16_t i=0;
-    uint16_t a=0;
-    uint16_t b=0;
-
-    uint32_t score=0;
-    uint32_t prev_score=0;
-    uint32_t pos=0;
-
-    /* We start at 1 because the SaganProcSyslog_LOCAL->message is considered the
-       first JSON string */
-
-    uint16_t json_str_count=1;
-
-    bool has_message;
-    bool found = false;
-
-    struct json_object *json_obj = NULL;
-    struct json_object *json_obj2 = NULL;
-
-    struct json_object *tmp = NULL;
-
-    char json_str[JSON_MAX_NEST][JSON_MAX_SIZE];  // = { { 0 } };
-    char tmp_message[MAX_SYSLOGMSG] = { 0 };
+    struct _JSON_Message_State *state = data;
+    struct _JSON_Message_Plan *plan = JSON_Message_Plan;
+    struct _JSON_Message_Plan_Key *plan_key = NULL;
+    struct _JSON_Message_Plan_Handler *handler = NULL;
+    struct _JSON_Message_Hit *hit = NULL;
 
-    strlcpy(json_str[0], SaganProcSyslog_LOCAL->syslog_message, sizeof(json_str[0]));
-    json_obj = json_tokener_parse(SaganProcSyslog_LOCAL->syslog_message);
+    struct _Sagan_JSON_Value saved;
 
-    /* If JSON parsing fails, it wasn't JSON after all */
+    uint32_t slot;
+    uint32_t i;
+    uint32_t j;
+    int32_t k;
 
-    if ( json_obj == NULL )
+    if ( debug->debugjson )
         {
-
-            if ( debug->debugmalformed )
-                {
-                    Sagan_Log(WARN, "[%s, line %d] Sagan Detected JSON but Libfastjson failed to decode it. The log line was: \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->syslog_message);
-                }
-
-            json_object_put(json_obj);
-            free(JSON_Message_Map_Found);
-            __atomic_add_fetch(&counters->malformed_json_mp_count, 1, __ATOMIC_SEQ_CST);
-            return;
+            Sagan_Log(DEBUG, "Key: \"%.*s\", Value: \"%.*s\" (nest %d)", (int)key_len, key, (int)value->len, value->ptr, nest );
         }
 
-
-
-    if ( debug->debugjson )
+    if ( value->type == SAGAN_JSON_NULL )
         {
-            Sagan_Log(DEBUG, "Syslog Message: |%s|\n", SaganProcSyslog_LOCAL->syslog_message);
+            return;
         }
 
-    struct json_object_iterator it = json_object_iter_begin(json_obj);
-    struct json_object_iterator itEnd = json_object_iter_end(json_obj);
+    slot = JSON_Message_Hash(key, key_len) & plan->table_mask;
 
-    while (!json_object_iter_equal(&it, &itEnd))
+    while ( ( k = plan->table[slot] ) != -1 )
         {
 
-            const char *key = json_object_iter_peek_name(&it);
-            struct json_object *const val = json_object_iter_peek_value(&it);
+            plan_key = &plan->key[k];
 
-            const char *val_str = json_object_get_string(val);
-
-            if ( debug->debugjson )
+            if ( plan_key->len == key_len && memcmp(plan_key->key, key, key_len) == 0 )
                 {
-                    Sagan_Log(DEBUG, "Key: \"%s\", Value: \"%s\"", key, val_str );
-
+                    break;
                 }
 
-            /* Is there nested JSON */
-
-            if ( val_str != NULL && val_str[0] == '{' )
-                {
-
-                    /* Validate it before handing it to the parser to save CPU */
-
-                    json_obj2 = json_tokener_parse(val_str);
-
-                    if ( json_obj2 != NULL )
-                        {
-
-
-                            strlcpy(json_str[json_str_count], val_str, sizeof(json_str[json_str_count]));
-                            json_str_count++;
-
-                            struct json_object_iterator it2 = json_object_iter_begin(json_obj2);
-                            struct json_object_iterator itEnd2 = json_object_iter_end(json_obj2);
-
-                            /* Look for any second tier/third tier JSON */
-
-                            while (!json_object_iter_equal(&it2, &itEnd2))
-                                {
-
-                                    const char *key2 = json_object_iter_peek_name(&it2);
-                                    struct json_object *const val2 = json_object_iter_peek_value(&it2);
-
-                                    const char *val_str2 = json_object_get_string(val2);
-
-                                    if ( debug->debugjson )
-                                        {
-                                            Sagan_Log(DEBUG, "Key2: \"%s\", Value: \"%s\"", key2, val_str );
-
-                                        }
-
-
-                                    if ( val_str2[0] == '{' )
-                                        {
-
-                                            strlcpy(json_str[json_str_count], val_str2, sizeof(json_str[json_str_count]));
-                                            json_str_count++;
-
-                                        }
-
-                                    json_object_iter_next(&it2);
-
-                                }
-                        } /* json_obj2 != NULL */
-
-                    json_object_put(json_obj2);
-
-                }
-
-
-            json_object_iter_next(&it);
+            slot = ( slot + 1 ) & plan->table_mask;
+        }
 
+    if ( k == -1 )
+        {
+            return;
         }
 
+    /* Strings holding JSON get decoded in place when the nest under them
+       is searched,  so hang on to the original */
 
-    if ( debug->debugjson )
+    saved = *value;
+
+    if ( value->type == SAGAN_JSON_STRING && value->len > 0 && value->ptr[0] == '{' )
         {
 
-            for ( a=0; a < json_str_count; a++ )
+            if ( value->len > sizeof(state->saved) - state->saved_len )
                 {
-                    Sagan_Log(DEBUG, "[%s, line %d] %d. JSON found: \"%s\"",  __FILE__, __LINE__, a, json_str[a]);
-
+                    return;
                 }
+
+            memcpy(state->saved + state->saved_len, value->ptr, value->len);
+            saved.ptr = state->saved + state->saved_len;
+            state->saved_len += value->len;
         }
 
+    for ( i = 0; i < plan_key->handler_count; i++ )
+        {
 
-    /* Search message maps and see which one's match our syslog message best */
+            handler = &plan->handler[plan_key->handler + i];
 
-    for (i = 0; i < counters->json_message_map; i++ )
-        {
-            score = 0;
+            /* A key repeated in the same object only counts once,  the
+               last value wins */
 
-            for ( a = 0; a < json_str_count; a++ )
+            for ( j = 0; j < state->hit_count; j++ )
                 {
 
-                    struct json_object *json_obj = NULL;
-                    json_obj = json_tokener_parse(json_str[a]);
+                    hit = &state->hit[j];
 
-                    if ( json_obj == NULL )
+                    if ( hit->nest == nest && hit->map == handler->map &&
+                            hit->field == handler->field && hit->message == handler->message )
                         {
-                            Sagan_Log(WARN, "[%s, line %d] Detected JSON Nest but function was incorrect. The log line was: \"%s\"", __FILE__, __LINE__, json_str[a]);
-                            json_object_put(json_obj);
-                            free(JSON_Message_Map_Found);
-                            return;
+                            break;
                         }
+                }
 
+            if ( j == state->hit_count )
+                {
 
-
-                    if ( !strcmp(JSON_Message_Map[i].message[0], "%JSON%" ) )
+                    if ( state->hit_count == JSON_MESSAGE_MAX_HITS )
                         {
-                            strlcpy( JSON_Message_Map_Found[i].message, SaganProcSyslog_LOCAL->syslog_message, sizeof(JSON_Message_Map_Found[i].message) );
-                            has_message = true;
-                            score++;
+                            return;
                         }
 
-                    if ( JSON_Message_Map[i].message_count > 1 )
-                        {
+                    hit = &state->hit[state->hit_count++];
+                }
 
+            hit->value = saved;
+            hit->nest = nest;
+            hit->map = handler->map;
+            hit->field = handler->field;
+            hit->message = handler->message;
+        }
+}
 
-                            for ( b=0; b < JSON_Message_Map[i].message_count; b++ )
-                                {
+/* The last value of "field" found for "map" in the deepest nest (later
+   nests win,  like the input parser) */
 
+static struct _JSON_Message_Hit *Parse_JSON_Message_Best( struct _JSON_Message_State *state, uint16_t map, unsigned char field )
+{
 
-                                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].message[b], &tmp))
-                                        {
+    struct _JSON_Message_Hit *best = NULL;
+    uint32_t i;
 
-                                            const char *message = json_object_get_string(tmp);
+    for ( i = 0; i < state->hit_count; i++ )
+        {
 
-                                            if ( message != NULL )
-                                                {
+            if ( state->hit[i].map == map && state->hit[i].field == field &&
+                    ( best == NULL || state->hit[i].nest >= best->nest ) )
+                {
+                    best = &state->hit[i];
+                }
+        }
 
-                                                    snprintf(tmp_message, sizeof(tmp_message), "%s: %s ,", JSON_Message_Map[i].message[b], message);
-                                                    strlcat(JSON_Message_Map_Found[i].message, tmp_message, sizeof(JSON_Message_Map_Found[i].message));
+    return(best);
+}
 
-                                                    has_message=true;
-                                                    score++;
-                                                }
+/* Copies the best value of a string field unless it's empty */
 
-                                        }
+static void Parse_JSON_Message_String( struct _JSON_Message_State *state, uint16_t map, unsigned char field, char *dst, size_t size )
+{
 
-                                }
+    struct _JSON_Message_Hit *hit = Parse_JSON_Message_Best(state, map, field);
 
-                        }
-                    else
-                        {
+    if ( hit != NULL && hit->value.len > 0 )
+        {
+            Sagan_JSON_Copy(&hit->value, dst, size);
+        }
+}
 
-                            if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].message[0], &tmp) )
-                                {
+/* Builds the new message from "map"'s "message" keys.  With more than one
+   key it is "key: value ,key: value ..." in nest then map order,  with one
+   it's "key: value". */
 
-                                    const char *message = json_object_get_string(tmp);
+static void Parse_JSON_Message_Build( struct _JSON_Message_State *state, uint16_t map, char *dst, size_t size )
+{
 
-                                    if ( message != NULL )
-                                        {
+    struct _JSON_Message_Hit *hit[JSON_MESSAGE_MAX_HITS];
+    struct _JSON_Message_Hit *tmp = NULL;
+    struct _JSON_Message_Map *message_map = &JSON_Message_Map[map];
 
-                                            snprintf(JSON_Message_Map_Found[i].message, sizeof(JSON_Message_Map_Found[i].message), "%s: %s", JSON_Message_Map[i].message[0], message);
+    const char *name = NULL;
+    uint32_t count = 0;
+    uint32_t i;
+    uint32_t j;
+    size_t pos = 0;
 
-                                        }
+    dst[0] = '\0';
 
-                                }
+    if ( message_map->message_count <= 1 )
+        {
 
+            tmp = Parse_JSON_Message_Best(state, map, JSON_MESSAGE_MESSAGE);
 
-                        }
+            if ( tmp != NULL )
+                {
+                    pos = snprintf(dst, size, "%s: ", message_map->message[0]);
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].program, &tmp))
+                    if ( pos < size )
                         {
-
-
-                            const char *program = json_object_get_string(tmp);
-
-                            if ( program != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].program, program, sizeof(JSON_Message_Map_Found[i].program));
-                                    score++;
-                                }
-
+                            Sagan_JSON_Copy(&tmp->value, dst + pos, size - pos);
                         }
+                }
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].src_ip, &tmp))
-                        {
-                            const char *src_ip = json_object_get_string(tmp);
+            return;
+        }
 
-                            if ( src_ip != NULL )
-                                {
+    /* Insertion sort (stable) of this map's message hits by nest,  then
+       position in the map */
 
-                                    strlcpy(JSON_Message_Map_Found[i].src_ip, src_ip, sizeof(JSON_Message_Map_Found[i].src_ip));
-                                    score++;
+    for ( i = 0; i < state->hit_count; i++ )
+        {
 
-                                }
-                        }
+            if ( state->hit[i].map != map || state->hit[i].field != JSON_MESSAGE_MESSAGE )
+                {
+                    continue;
+                }
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].dst_ip, &tmp))
-                        {
+            tmp = &state->hit[i];
 
-                            const char *dst_ip = json_object_get_string(tmp);
+            for ( j = count; j > 0 && ( hit[j-1]->nest > tmp->nest ||
+                                        ( hit[j-1]->nest == tmp->nest && hit[j-1]->message > tmp->message ) ); j-- )
+                {
+                    hit[j] = hit[j-1];
+                }
 
-                            if ( dst_ip != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].dst_ip, dst_ip, sizeof(JSON_Message_Map_Found[i].dst_ip));
-                                    score++;
-                                }
-                        }
+            hit[j] = tmp;
+            count++;
+        }
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].src_port, &tmp))
-                        {
-                            const char *src_port = json_object_get_string(tmp);
+    for ( i = 0; i < count && pos < size - 1; i++ )
+        {
 
-                            if ( src_port != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].src_port, src_port, sizeof(JSON_Message_Map_Found[i].src_port));
-                                    score++;
-                                }
-                        }
+            name = message_map->message[hit[i]->message];
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].dst_port, &tmp))
-                        {
+            pos += snprintf(dst + pos, size - pos, "%s: ", name);
 
-                            const char *dst_port = json_object_get_string(tmp);
+            if ( pos >= size - 1 )
+                {
+                    break;
+                }
 
-                            if ( dst_port != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].dst_port, dst_port, sizeof(JSON_Message_Map_Found[i].dst_port));
-                                    score++;
-                                }
-                        }
+            pos += Sagan_JSON_Copy(&hit[i]->value, dst + pos, size - pos);
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].proto, &tmp))
-                        {
+            if ( pos >= size - 1 )
+                {
+                    break;
+                }
 
+            pos += snprintf(dst + pos, size - pos, " ,");
+        }
 
-                            const char *proto = json_object_get_string(tmp);
+    dst[size - 1] = '\0';
+}
 
-                            if ( proto != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].proto, proto, sizeof(JSON_Message_Map_Found[i].proto));
-                                    score++;
-                                }
-                        }
+/************************************************************************
+ * Parse_JSON_Message - Parses mesage (or program+message) for JSON data.
+ * The log line is walked once,  every map is scored from that and the
+ * best one's values are copied straight into place.
+ ************************************************************************/
 
+void Parse_JSON_Message ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+{
 
-                    /* Suricata specific */
+    static __thread struct _JSON_Message_State state;
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].flow_id, &tmp))
-                        {
+    struct _JSON_Message_Hit *hit = NULL;
 
-                            const char *flow_id = json_object_get_string(tmp);
+    char tmp[MAXIP] = { 0 };
 
-                            if ( flow_id != NULL )
-                                {
-                                    JSON_Message_Map_Found[i].flow_id = atol( flow_id );
-                                    score++;
-                                }
-                        }
+    size_t len;
+    uint32_t i;
+    uint16_t map;
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].md5, &tmp))
-                        {
+    uint32_t score = 0;
+    uint32_t prev_score = 0;
+    uint32_t pos = 0;
 
-                            const char *md5 = json_object_get_string(tmp);
+    bool json_message = false;
+    bool has_message = false;
+    bool found = false;
 
-                            if ( md5 != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].md5, md5, sizeof(JSON_Message_Map_Found[i].md5));
-                                    score++;
-                                }
-                        }
+    if ( JSON_Message_Plan == NULL )
+        {
+            return;
+        }
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].sha1, &tmp))
-                        {
+    len = strlen(SaganProcSyslog_LOCAL->syslog_message);
+    memcpy(state.json, SaganProcSyslog_LOCAL->syslog_message, len + 1);
 
-                            const char *sha1 = json_object_get_string(tmp);
+    state.hit_count = 0;
+    state.saved_len = 0;
 
-                            if ( sha1 != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].sha1, sha1, sizeof(JSON_Message_Map_Found[i].sha1));
-                                    score++;
-                                }
-                        }
+    if ( debug->debugjson )
+        {
+            Sagan_Log(DEBUG, "Syslog Message: |%s|\n", SaganProcSyslog_LOCAL->syslog_message);
+        }
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].sha256, &tmp))
-                        {
+    /* If JSON parsing fails, it wasn't JSON after all */
 
-                            const char *sha256 = json_object_get_string(tmp);
+    if ( Sagan_JSON_Walk(state.json, len, JSON_MESSAGE_NEST_LEVELS, JSON_MAX_NEST, &state.nests, Parse_JSON_Message_Field, &state) == false )
+        {
 
-                            if ( sha256 != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].sha256, sha256, sizeof(JSON_Message_Map_Found[i].sha256));
-                                    score++;
-                                }
-                        }
+            if ( debug->debugmalformed )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Sagan Detected JSON but failed to decode it. The log line was: \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->syslog_message);
+                }
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].filename, &tmp))
-                        {
+            Sagan_Counter_Add(malformed_json_mp_count, 1);
+            return;
+        }
 
-                            const char *filename = json_object_get_string(tmp);
+    /* Search message maps and see which one's match our syslog message best.
+       Every value found scores a point,  except a lone "message" key.  A
+       "%JSON%" message scores a point per nest. */
 
-                            if ( filename != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].filename, filename, sizeof(JSON_Message_Map_Found[i].filename));
-                                    score++;
-                                }
-                        }
+    for (map = 0; map < counters->json_message_map; map++ )
+        {
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].hostname, &tmp))
-                        {
+            json_message = !strcmp(JSON_Message_Map[map].message[0], "%JSON%" );
 
-                            const char *hostname = json_object_get_string(tmp);
+            score = json_message == true ? state.nests : 0;
+            has_message = json_message;
 
-                            if ( hostname != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].hostname, hostname, sizeof(JSON_Message_Map_Found[i].hostname));
-                                    score++;
-                                }
-                        }
+            for ( i = 0; i < state.hit_count; i++ )
+                {
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].url, &tmp))
+                    if ( state.hit[i].map != map )
                         {
-
-                            const char *url = json_object_get_string(tmp);
-
-                            if ( url != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].url, url, sizeof(JSON_Message_Map_Found[i].url));
-                                    score++;
-                                }
+                            continue;
                         }
 
-                    if ( json_object_object_get_ex(json_obj, JSON_Message_Map[i].ja3, &tmp))
+                    if ( state.hit[i].field != JSON_MESSAGE_MESSAGE )
                         {
-
-                            const char *ja3 = json_object_get_string(tmp);
-
-                            if ( ja3 != NULL )
-                                {
-                                    strlcpy(JSON_Message_Map_Found[i].ja3, ja3, sizeof(JSON_Message_Map_Found[i].ja3));
-                                    score++;
-                                }
+                            score++;
+                            continue;
                         }
 
+                    has_message = true;
 
-                    json_object_put(json_obj);
-
+                    if ( JSON_Message_Map[map].message_count > 1 )
+                        {
+                            score++;
+                        }
                 }
 
             if ( score > prev_score && has_message == true )
                 {
-
-                    pos = i;
+                    pos = map;
                     prev_score = score;
                     found = true;
                 }
-
         }
 
     if ( debug->debugjson )
@@ -802,134 +981,119 @@ void Parse_JSON_Message ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
 
     /* We have to have a "message!" */
 
-    if ( found == true )
+    if ( found == false )
         {
+            return;
+        }
 
-            __atomic_add_fetch(&counters->json_mp_count, 1, __ATOMIC_SEQ_CST);
-
-            /* Put JSON values into place */
-
-            /* If this is "message":"{value},{value},{value}", get rid of trailing , in the new "message */
-
-            if ( JSON_Message_Map_Found[pos].message[ strlen(JSON_Message_Map_Found[pos].message) - 1 ] == ',' )
-                {
-                    JSON_Message_Map_Found[pos].message[ strlen(JSON_Message_Map_Found[pos].message) - 1 ] = '\0';
-                }
-
-            /* Copy our new message for the engine to use */
-
-            strlcpy(SaganProcSyslog_LOCAL->syslog_message, JSON_Message_Map_Found[pos].message, sizeof(SaganProcSyslog_LOCAL->syslog_message));
+    Sagan_Counter_Add(json_mp_count, 1);
 
-            /* Adopt the "flow_id" */
+    /* Put JSON values into place.  The message goes last,  the other
+       values may point into it. */
 
-            SaganProcSyslog_LOCAL->flow_id = JSON_Message_Map_Found[pos].flow_id;
+    hit = Parse_JSON_Message_Best(&state, pos, JSON_MESSAGE_FLOW_ID);
 
-            if ( JSON_Message_Map_Found[pos].md5[0] != '\0' )
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->md5, JSON_Message_Map_Found[pos].md5, sizeof(SaganProcSyslog_LOCAL->md5));
-                }
+    if ( hit != NULL )
+        {
+            Sagan_JSON_Copy(&hit->value, tmp, sizeof(tmp));
+            SaganProcSyslog_LOCAL->flow_id = atol( tmp );
+        }
+    else
+        {
+            SaganProcSyslog_LOCAL->flow_id = 0;
+        }
 
-            if ( JSON_Message_Map_Found[pos].sha1[0] != '\0' )
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->sha1, JSON_Message_Map_Found[pos].sha1, sizeof(SaganProcSyslog_LOCAL->sha1));
-                }
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_MD5, SaganProcSyslog_LOCAL->md5, sizeof(SaganProcSyslog_LOCAL->md5));
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_SHA1, SaganProcSyslog_LOCAL->sha1, sizeof(SaganProcSyslog_LOCAL->sha1));
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_SHA256, SaganProcSyslog_LOCAL->sha256, sizeof(SaganProcSyslog_LOCAL->sha256));
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_FILENAME, SaganProcSyslog_LOCAL->filename, sizeof(SaganProcSyslog_LOCAL->filename));
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_HOSTNAME, SaganProcSyslog_LOCAL->hostname, sizeof(SaganProcSyslog_LOCAL->hostname));
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_URL, SaganProcSyslog_LOCAL->url, sizeof(SaganProcSyslog_LOCAL->url));
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_SRC_IP, SaganProcSyslog_LOCAL->src_ip, sizeof(SaganProcSyslog_LOCAL->src_ip));
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_DST_IP, SaganProcSyslog_LOCAL->dst_ip, sizeof(SaganProcSyslog_LOCAL->dst_ip));
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_JA3, SaganProcSyslog_LOCAL->ja3, sizeof(SaganProcSyslog_LOCAL->ja3));
 
-            if ( JSON_Message_Map_Found[pos].sha256[0] != '\0' )
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->sha256, JSON_Message_Map_Found[pos].sha256, sizeof(SaganProcSyslog_LOCAL->sha256));
-                }
+    tmp[0] = '\0';
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_SRC_PORT, tmp, sizeof(tmp));
 
-            if ( JSON_Message_Map_Found[pos].filename[0] != '\0' )
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->filename, JSON_Message_Map_Found[pos].filename, sizeof(SaganProcSyslog_LOCAL->filename));
-                }
+    if ( tmp[0] != '\0' )
+        {
+            SaganProcSyslog_LOCAL->src_port = atoi(tmp);
+        }
 
-            if ( JSON_Message_Map_Found[pos].hostname[0] != '\0' )
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->hostname, JSON_Message_Map_Found[pos].hostname, sizeof(SaganProcSyslog_LOCAL->hostname));
-                }
+    tmp[0] = '\0';
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_DST_PORT, tmp, sizeof(tmp));
 
-            if ( JSON_Message_Map_Found[pos].url[0] != '\0' )
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->url, JSON_Message_Map_Found[pos].url, sizeof(SaganProcSyslog_LOCAL->url));
-                }
+    if ( tmp[0] != '\0' )
+        {
+            SaganProcSyslog_LOCAL->dst_port = atoi(tmp);
+        }
 
+    /* Only the first four characters were ever looked at */
 
-            if ( JSON_Message_Map_Found[pos].src_ip[0] != '\0' )
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->src_ip, JSON_Message_Map_Found[pos].src_ip, sizeof(SaganProcSyslog_LOCAL->src_ip));
-                }
+    tmp[0] = '\0';
+    Parse_JSON_Message_String(&state, pos, JSON_MESSAGE_PROTO, tmp, 5);
 
-            if ( JSON_Message_Map_Found[pos].dst_ip[0] != '\0' )
-                {
-                    strlcpy(SaganProcSyslog_LOCAL->dst_ip, JSON_Message_Map_Found[pos].dst_ip, sizeof(SaganProcSyslog_LOCAL->dst_ip));
-                }
+    if ( tmp[0] != '\0' )
+        {
 
-            if ( JSON_Message_Map_Found[pos].src_port[0] != '\0' )
+            if ( !strcasecmp( tmp, "tcp" ) )
                 {
-                    SaganProcSyslog_LOCAL->src_port = atoi(JSON_Message_Map_Found[pos].src_port);
+                    SaganProcSyslog_LOCAL->proto = 6;
                 }
 
-            if ( JSON_Message_Map_Found[pos].dst_port[0] != '\0' )
+            else if ( !strcasecmp( tmp, "udp" ) )
                 {
-                    SaganProcSyslog_LOCAL->dst_port = atoi(JSON_Message_Map_Found[pos].dst_port);
+                    SaganProcSyslog_LOCAL->proto = 17;
                 }
 
-            if ( JSON_Message_Map_Found[pos].ja3[0] != '\0' )
+            else if ( !strcasecmp( tmp, "icmp" ) )
                 {
-                    strlcpy(SaganProcSyslog_LOCAL->ja3, JSON_Message_Map_Found[pos].ja3, sizeof(SaganProcSyslog_LOCAL->ja3));
+                    SaganProcSyslog_LOCAL->proto = 1;
                 }
 
-            if ( JSON_Message_Map_Found[pos].proto[0] != '\0' )
-                {
-
-                    if ( !strcasecmp( JSON_Message_Map_Found[pos].proto, "tcp" ) || !strcasecmp( JSON_Message_Map_Found[pos].proto, "TCP" ) )
-                        {
-                            SaganProcSyslog_LOCAL->proto = 6;
-                        }
-
-                    else if ( !strcasecmp( JSON_Message_Map_Found[pos].proto, "udp" ) || !strcasecmp( JSON_Message_Map_Found[pos].proto, "UDP" ) )
-                        {
-                            SaganProcSyslog_LOCAL->proto = 17;
-                        }
-
-                    else if ( !strcasecmp( JSON_Message_Map_Found[pos].proto, "icmp" ) || !strcasecmp( JSON_Message_Map_Found[pos].proto, "ICMP" ) )
-                        {
-                            SaganProcSyslog_LOCAL->proto = 1;
-                        }
-
-                }
+        }
 
-            /* Don't override syslog program if no program is present */
+    /* Don't override syslog program if no program is present */
 
-            if ( JSON_Message_Map_Found[pos].program[0] != '\0' )
-                {
+    hit = Parse_JSON_Message_Best(&state, pos, JSON_MESSAGE_PROGRAM);
 
-                    strlcpy(SaganProcSyslog_LOCAL->syslog_program, JSON_Message_Map_Found[pos].program, sizeof(SaganProcSyslog_LOCAL->syslog_program));
-                    Remove_Spaces(SaganProcSyslog_LOCAL->syslog_program);
+    if ( hit != NULL && hit->value.len > 0 )
+        {
+            Sagan_JSON_Copy(&hit->value, SaganProcSyslog_LOCAL->syslog_program, sizeof(SaganProcSyslog_LOCAL->syslog_program));
+            Remove_Spaces(SaganProcSyslog_LOCAL->syslog_program);
+        }
 
-                }
+    /* Copy our new message for the engine to use.  "%JSON%" keeps the
+       message as is. */
 
+    if ( strcmp(JSON_Message_Map[pos].message[0], "%JSON%" ) )
+        {
+            Parse_JSON_Message_Build(&state, pos, SaganProcSyslog_LOCAL->syslog_message, sizeof(SaganProcSyslog_LOCAL->syslog_message));
+        }
 
-            if ( debug->debugjson )
-                {
-                    Sagan_Log(DEBUG, "[%s, line %d] New data extracted from JSON:", __FILE__, __LINE__);
-                    Sagan_Log(DEBUG, "[%s, line %d] -------------------------------------------------------", __FILE__, __LINE__);
-                    Sagan_Log(DEBUG, "[%s, line %d] Message: \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->syslog_message );
-                    Sagan_Log(DEBUG, "[%s, line %d] Program: \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->syslog_program );
-                    Sagan_Log(DEBUG, "[%s, line %d] src_ip : \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->src_ip );
-                    Sagan_Log(DEBUG, "[%s, line %d] dst_ip : \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->dst_ip );
-                    Sagan_Log(DEBUG, "[%s, line %d] src_port : \"%d\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->src_port );
-                    Sagan_Log(DEBUG, "[%s, line %d] dst_port : \"%d\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->dst_port );
-                    Sagan_Log(DEBUG, "[%s, line %d] proto : \"%d\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->proto );
-                    Sagan_Log(DEBUG, "[%s, line %d] ja3: \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->ja3 );
-                }
+    /* If this is "message":"{value},{value},{value}", get rid of trailing , in the new "message */
 
+    len = strlen(SaganProcSyslog_LOCAL->syslog_message);
 
+    if ( len > 0 && SaganProcSyslog_LOCAL->syslog_message[ len - 1 ] == ',' )
+        {
+            SaganProcSyslog_LOCAL->syslog_message[ len - 1 ] = '\0';
         }
 
-    free(JSON_Message_Map_Found);
-    json_object_put(json_obj);
+    if ( debug->debugjson )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] New data extracted from JSON:", __FILE__, __LINE__);
+            Sagan_Log(DEBUG, "[%s, line %d] -------------------------------------------------------", __FILE__, __LINE__);
+            Sagan_Log(DEBUG, "[%s, line %d] Message: \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->syslog_message );
+            Sagan_Log(DEBUG, "[%s, line %d] Program: \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->syslog_program );
+            Sagan_Log(DEBUG, "[%s, line %d] src_ip : \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->src_ip );
+            Sagan_Log(DEBUG, "[%s, line %d] dst_ip : \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->dst_ip );
+            Sagan_Log(DEBUG, "[%s, line %d] src_port : \"%d\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->src_port );
+            Sagan_Log(DEBUG, "[%s, line %d] dst_port : \"%d\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->dst_port );
+            Sagan_Log(DEBUG, "[%s, line %d] proto : \"%d\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->proto );
+            Sagan_Log(DEBUG, "[%s, line %d] ja3: \"%s\"", __FILE__, __LINE__, SaganProcSyslog_LOCAL->ja3 );
+        }
 
 }
 
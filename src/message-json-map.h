@@ -19,6 +19,31 @@
 */
 
 #include "sagan-defs.h"
+#include "util-json.h"
+
+/* Fields a message map can pull out */
+
+#define JSON_MESSAGE_MESSAGE	0
+#define JSON_MESSAGE_PROGRAM	1
+#define JSON_MESSAGE_SRC_IP	2
+#define JSON_MESSAGE_DST_IP	3
+#define JSON_MESSAGE_SRC_PORT	4
+#define JSON_MESSAGE_DST_PORT	5
+#define JSON_MESSAGE_PROTO	6
+#define JSON_MESSAGE_FLOW_ID	7
+#define JSON_MESSAGE_MD5	8
+#define JSON_MESSAGE_SHA1	9
+#define JSON_MESSAGE_SHA256	10
+#define JSON_MESSAGE_FILENAME	11
+#define JSON_MESSAGE_HOSTNAME	12
+#define JSON_MESSAGE_URL	13
+#define JSON_MESSAGE_JA3	14
+
+#define JSON_MESSAGE_FIELDS	15
+
+#define JSON_MESSAGE_MAX_KEYS	32		/* "message" keys per map */
+#define JSON_MESSAGE_MAX_HITS	256		/* Mapped values kept per log line */
+#define JSON_MESSAGE_NEST_LEVELS 3		/* Top level + two levels of nest */
 
 typedef struct _JSON_Message_Map _JSON_Message_Map;
 struct _JSON_Message_Map
@@ -29,7 +54,7 @@ struct _JSON_Message_Map
     char software[32];
 
     char program[32];
-    char message[32][20];
+    char message[JSON_MESSAGE_MAX_KEYS][20];
 
     char src_ip[32];
     char dst_ip[32];
@@ -51,33 +76,67 @@ struct _JSON_Message_Map
 
 };
 
-typedef struct _JSON_Message_Map_Found _JSON_Message_Map_Found;
-struct _JSON_Message_Map_Found
+/* The maps compiled into one "plan".  Every key named by any map is in a
+   hash table and points at the handlers (map + field) that want it,  so
+   a single pass over a log line scores every map at once. */
+
+typedef struct _JSON_Message_Plan_Handler _JSON_Message_Plan_Handler;
+struct _JSON_Message_Plan_Handler
 {
+    uint16_t map;				/* Index into JSON_Message_Map */
+    unsigned char field;			/* JSON_MESSAGE_* */
+    unsigned char message;			/* Position in the map's "message" list */
+};
 
-    char program[MAX_SYSLOG_PROGRAM];
-    char message[MAX_SYSLOGMSG];
+typedef struct _JSON_Message_Plan_Key _JSON_Message_Plan_Key;
+struct _JSON_Message_Plan_Key
+{
+    char key[32];
+    uint16_t len;
+    uint32_t hash;
+    uint32_t handler;				/* First handler */
+    uint32_t handler_count;
+};
 
-    char src_ip[MAXIP];
-    char dst_ip[MAXIP];
+typedef struct _JSON_Message_Plan _JSON_Message_Plan;
+struct _JSON_Message_Plan
+{
+    struct _JSON_Message_Plan_Key *key;
+    uint32_t key_count;
 
-    char src_port[MAXIP];
-    char dst_port[MAXIP];
+    int32_t *table;				/* Hash slot -> key,  -1 == empty */
+    uint32_t table_mask;
 
-    char proto[5];
+    struct _JSON_Message_Plan_Handler *handler;
+    uint32_t handler_count;
+};
 
-    uint64_t flow_id;
-    char md5[MD5_HASH_SIZE+1];
-    char sha1[SHA1_HASH_SIZE+1];
-    char sha256[SHA256_HASH_SIZE+1];
-    char filename[MAX_FILENAME_SIZE+1];
-    char hostname[MAX_HOSTNAME_SIZE+1];
-    char url[MAX_URL_SIZE+1];
-    char ja3[MD5_HASH_SIZE+1];
+/* A mapped value found in the log line being parsed */
 
+typedef struct _JSON_Message_Hit _JSON_Message_Hit;
+struct _JSON_Message_Hit
+{
+    struct _Sagan_JSON_Value value;
+    uint16_t nest;
+    uint16_t map;
+    unsigned char field;
+    unsigned char message;
 };
 
+typedef struct _JSON_Message_State _JSON_Message_State;
+struct _JSON_Message_State
+{
+    uint16_t nests;				/* Objects searched */
+    uint32_t hit_count;
+    struct _JSON_Message_Hit hit[JSON_MESSAGE_MAX_HITS];
 
+    /* The original message is parsed from "json".  Values that may be
+       decoded in place later on are saved in "saved". */
+
+    char json[MAX_SYSLOGMSG];
+    char saved[MAX_SYSLOGMSG];
+    size_t saved_len;
+};
 
 void Load_Message_JSON_Map ( const char *json_map );
 void Parse_JSON_Message ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL );
@@ -35,8 +35,11 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -46,66 +49,351 @@
 
 struct _Rule_Struct *rulestruct;
 
-int Meta_Content_Search(char *syslog_msg, int rule_position, int meta_content_count)
+#define META_CONTENT_BIT(set, n)	( (set)[(n) >> 3] & ( 1 << ( (n) & 7 ) ) )
+
+/* Compares the rest of a candidate once its first two bytes matched */
+
+static bool Meta_Content_Matcher_Verify( const struct _Meta_Content_Matcher *matcher, uint16_t key, const unsigned char *text, size_t len )
 {
 
-    int z = meta_content_count;
-    int i;
+    const struct _Meta_Content_Matcher_Entry *entry = NULL;
+    const unsigned char *str = NULL;
 
-    /* Normal "meta_content" search */
+    int lo = 0;
+    int hi = matcher->count;
+    int mid;
+    size_t i;
 
-    if ( rulestruct[rule_position].meta_content_not[z] == 0 )
+    while ( lo < hi )
         {
-            for ( i=0; i<rulestruct[rule_position].meta_content_containers[z].meta_counter; i++ )
+
+            mid = ( lo + hi ) / 2;
+
+            if ( matcher->entry[mid].key < key )
                 {
-                    if ( rulestruct[rule_position].meta_content_case[z] == 1 )
-                        {
+                    lo = mid + 1;
+                }
+            else
+                {
+                    hi = mid;
+                }
+        }
+
+    for ( ; lo < matcher->count && matcher->entry[lo].key == key; lo++ )
+        {
+
+            entry = &matcher->entry[lo];
+
+            if ( entry->len > len )
+                {
+                    continue;
+                }
+
+            str = (const unsigned char *)matcher->strings + entry->offset;
+
+            i = 2;
+
+            while ( i < entry->len && matcher->fold[text[i]] == str[i] )
+                {
+                    i++;
+                }
 
-                            if (Sagan_stristr(syslog_msg, rulestruct[rule_position].meta_content_containers[z].meta_content_converted[i], true))
-                                {
-                                    return(true);
-                                }
+            if ( i == entry->len )
+                {
+                    return(true);
+                }
+        }
+
+    return(false);
+}
+
+/* One pass over "text" looking for any of the matcher's strings */
+
+static bool Meta_Content_Matcher_Search( const struct _Meta_Content_Matcher *matcher, const char *text, size_t len )
+{
+
+    const unsigned char *t = (const unsigned char *)text;
+
+    uint16_t key;
+    size_t pos;
+    size_t i;
+    unsigned char shift;
+
+    if ( matcher->any == true )
+        {
+            return(true);
+        }
+
+    if ( matcher->has_single == true )
+        {
+            for ( i = 0; i < len; i++ )
+                {
+                    if ( META_CONTENT_BIT(matcher->single, matcher->fold[t[i]]) )
+                        {
+                            return(true);
                         }
-                    else
+                }
+        }
+
+    if ( matcher->count == 0 || len < matcher->min_len )
+        {
+            return(false);
+        }
+
+    /* "pos" is the last byte of a window that starts at pos - min_len + 1 */
+
+    pos = matcher->min_len - 1;
+
+    while ( pos < len )
+        {
+
+            shift = matcher->shift[ META_CONTENT_SHIFT_HASH(matcher->fold[t[pos - 1]], matcher->fold[t[pos]]) ];
+
+            if ( shift != 0 )
+                {
+                    pos = pos + shift;
+                    continue;
+                }
+
+            i = pos - matcher->min_len + 1;
+            key = ( matcher->fold[t[i]] << 8 ) | matcher->fold[t[i + 1]];
+
+            if ( META_CONTENT_BIT(matcher->pair, key) && Meta_Content_Matcher_Verify(matcher, key, t + i, len - i) )
+                {
+                    return(true);
+                }
+
+            pos++;
+        }
+
+    return(false);
+}
+
+static int Meta_Content_Entry_Compare( const void *a, const void *b )
+{
+
+    const struct _Meta_Content_Matcher_Entry *ea = a;
+    const struct _Meta_Content_Matcher_Entry *eb = b;
+
+    return( (int)ea->key - (int)eb->key );
+}
+
+static struct _Meta_Content_Matcher *Meta_Content_Matcher_New( struct meta_content_conversion *container, bool nocase )
+{
+
+    struct _Meta_Content_Matcher *matcher = NULL;
+    struct _Meta_Content_Matcher_Entry *entry = NULL;
+    unsigned char *str = NULL;
+
+    size_t total = 0;
+    uint32_t offset = 0;
+    uint16_t len;
+    int hash;
+    int i;
+    int c;
+
+    matcher = calloc(1, sizeof(struct _Meta_Content_Matcher));
+
+    if ( matcher == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for meta_content matcher. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < container->meta_counter; i++ )
+        {
+            total = total + container->meta_content_len[i];
+        }
+
+    matcher->strings = malloc(total + 1);
+    matcher->entry = malloc(container->meta_counter * sizeof(struct _Meta_Content_Matcher_Entry));
+
+    if ( matcher->strings == NULL || matcher->entry == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for meta_content matcher. Abort!", __FILE__, __LINE__);
+        }
+
+    matcher->nocase = nocase;
+
+    for ( c = 0; c < 256; c++ )
+        {
+            matcher->fold[c] = nocase == true ? tolower(c) : c;
+        }
+
+    for ( i = 0; i < container->meta_counter; i++ )
+        {
+
+            len = container->meta_content_len[i];
+            str = (unsigned char *)matcher->strings + offset;
+
+            for ( c = 0; c < len; c++ )
+                {
+                    str[c] = matcher->fold[ (unsigned char)container->meta_content_converted[i][c] ];
+                }
+
+            if ( len == 0 )
+                {
+                    matcher->any = true;
+                }
+
+            else if ( len == 1 )
+                {
+                    matcher->single[ str[0] >> 3 ] |= 1 << ( str[0] & 7 );
+                    matcher->has_single = true;
+                }
+
+            else
+                {
+
+                    if ( matcher->min_len == 0 || len < matcher->min_len )
                         {
+                            matcher->min_len = len;
+                        }
 
+                    entry = &matcher->entry[matcher->count++];
 
-                            if (Sagan_strstr(syslog_msg, rulestruct[rule_position].meta_content_containers[z].meta_content_converted[i]))
-                                {
-                                    return(true);
-                                }
+                    entry->key = ( str[0] << 8 ) | str[1];
+                    entry->len = len;
+                    entry->offset = offset;
+
+                    matcher->pair[ entry->key >> 3 ] |= 1 << ( entry->key & 7 );
+                }
+
+            offset = offset + len;
+        }
+
+    qsort(matcher->entry, matcher->count, sizeof(struct _Meta_Content_Matcher_Entry), Meta_Content_Entry_Compare);
+
+    /* Skip distances.  A block that doesn't appear in the first "min_len"
+       bytes of any string lets the window move past it entirely */
+
+    memset(matcher->shift, matcher->min_len - 1, sizeof(matcher->shift));
+
+    for ( i = 0; i < matcher->count; i++ )
+        {
+
+            str = (unsigned char *)matcher->strings + matcher->entry[i].offset;
+
+            for ( c = 1; c < matcher->min_len; c++ )
+                {
+
+                    hash = META_CONTENT_SHIFT_HASH(str[c - 1], str[c]);
+
+                    if ( matcher->shift[hash] > matcher->min_len - 1 - c )
+                        {
+                            matcher->shift[hash] = matcher->min_len - 1 - c;
                         }
                 }
+        }
 
-            return(false);
+    return(matcher);
+}
 
+/****************************************************************************
+ * Meta_Content_Compile - Builds matchers for a rule's larger meta_content
+ * containers.  Called once the whole rule has been parsed,  since
+ * "meta_nocase" comes after the "meta_content" it applies to.
+ ****************************************************************************/
+
+void Meta_Content_Compile( int rule_position )
+{
+
+    int z;
+
+    for ( z = 0; z < rulestruct[rule_position].meta_content_count; z++ )
+        {
+
+            if ( rulestruct[rule_position].meta_content_containers[z].meta_counter < META_CONTENT_MATCHER_MIN )
+                {
+                    continue;
+                }
+
+            __atomic_store_n(&rulestruct[rule_position].meta_content_containers[z].matcher, Meta_Content_Matcher_New(&rulestruct[rule_position].meta_content_containers[z], rulestruct[rule_position].meta_content_case[z] == 1), __ATOMIC_SEQ_CST);
+        }
+}
+
+/****************************************************************************
+ * Meta_Content_Free - Frees a rule's matchers (rule reload).  Processors
+ * may still be searching with them,  so they are only unhooked here and
+ * freed through Rule_Index_Retire().
+ ****************************************************************************/
+
+static void Meta_Content_Matcher_Free( void *data )
+{
+
+    struct _Meta_Content_Matcher *matcher = (struct _Meta_Content_Matcher *)data;
+
+    free(matcher->entry);
+    free(matcher->strings);
+    free(matcher);
+}
+
+void Meta_Content_Free( int rule_position )
+{
+
+    struct _Meta_Content_Matcher *matcher = NULL;
+    int z;
+
+    for ( z = 0; z < rulestruct[rule_position].meta_content_count; z++ )
+        {
+
+            matcher = __atomic_exchange_n(&rulestruct[rule_position].meta_content_containers[z].matcher, NULL, __ATOMIC_SEQ_CST);
+
+            if ( matcher == NULL )
+                {
+                    continue;
+                }
+
+            Rule_Index_Retire(matcher, Meta_Content_Matcher_Free);
+        }
+}
+
+/****************************************************************************
+ * Meta_Content_Search - Returns true if the meta_content (or "!"
+ * meta_content) matches.  "syslog_msg" is a window of "len" bytes into
+ * the message (after any meta_offset/meta_depth/etc) and isn't NULL
+ * terminated.
+ ****************************************************************************/
+
+int Meta_Content_Search(const char *syslog_msg, size_t len, int rule_position, int meta_content_count)
+{
+
+    struct meta_content_conversion *container = &rulestruct[rule_position].meta_content_containers[meta_content_count];
+
+    /* Loaded once,  a reload may unhook it (see Meta_Content_Free()) */
+
+    struct _Meta_Content_Matcher *matcher = __atomic_load_n(&container->matcher, __ATOMIC_SEQ_CST);
+
+    bool found = false;
+    int i;
+
+    if ( matcher != NULL )
+        {
+            found = Meta_Content_Matcher_Search(matcher, syslog_msg, len);
         }
     else
         {
 
-            for ( i=0; i<rulestruct[rule_position].meta_content_containers[z].meta_counter; i++ )
+            for ( i = 0; i < container->meta_counter && found == false; i++ )
                 {
-                    if ( rulestruct[rule_position].meta_content_case[z] == 1 )
-                        {
 
-                            if (Sagan_stristr(syslog_msg, rulestruct[rule_position].meta_content_containers[z].meta_content_converted[i], true))
-                                {
-                                    return(false);
-                                }
+                    if ( rulestruct[rule_position].meta_content_case[meta_content_count] == 1 )
+                        {
+                            found = Sagan_memmem_nocase(syslog_msg, len, container->meta_content_converted[i], container->meta_content_len[i]) != NULL;
                         }
                     else
                         {
-
-                            if (Sagan_strstr(syslog_msg, rulestruct[rule_position].meta_content_containers[z].meta_content_converted[i]))
-                                {
-                                    return(false);
-                                }
+                            found = Sagan_memmem(syslog_msg, len, container->meta_content_converted[i], container->meta_content_len[i]) != NULL;
                         }
-
                 }
+        }
 
-            return(true);
+    /* "meta_content: !" matches when none of the strings are found */
+
+    if ( rulestruct[rule_position].meta_content_not[meta_content_count] == 0 )
+        {
+            return(found);
+        }
 
-        } /* End of "else" meta_content_not[z] == 0 */
+    return(!found);
 
 } /* End of Meta_Content_Search() */
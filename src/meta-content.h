@@ -22,5 +22,53 @@
 #include "config.h"             /* From autoconf */
 #endif
 
-int Meta_Content_Search(char *, int, int);
+/* Containers with fewer strings than this are searched one string at a
+   time with Sagan_memmem().  With the SIMD kernels that is as fast as the
+   matcher up to about this many strings */
+
+#define META_CONTENT_MATCHER_MIN	8
+
+/* A meta_content container compiled so the message is scanned once no
+   matter how many strings it expands to.  This is Wu-Manber with two byte
+   blocks.  The scan looks at a window as long as the shortest string and
+   "shift" says how far it can skip ahead based on the window's last two
+   bytes.  When it can't skip,  the window's first two bytes are checked
+   in "pair" (a 65536 bit set) before any string is compared.  One byte
+   strings are kept in "single". */
+
+#define META_CONTENT_SHIFT_SIZE	4096
+#define META_CONTENT_SHIFT_HASH(c0, c1)	( ( ( (c0) << 4 ) ^ (c1) ) & ( META_CONTENT_SHIFT_SIZE - 1 ) )
+
+typedef struct _Meta_Content_Matcher_Entry _Meta_Content_Matcher_Entry;
+struct _Meta_Content_Matcher_Entry
+{
+    uint16_t key;				/* First two bytes */
+    uint16_t len;
+    uint32_t offset;				/* Into "strings" */
+};
+
+typedef struct _Meta_Content_Matcher _Meta_Content_Matcher;
+struct _Meta_Content_Matcher
+{
+
+    bool nocase;
+    bool any;					/* Has an empty string,  always matches */
+    bool has_single;
+
+    unsigned char fold[256];			/* Lower case table for nocase */
+    unsigned char single[32];
+    unsigned char pair[8192];
+    unsigned char shift[META_CONTENT_SHIFT_SIZE];
+
+    uint16_t min_len;				/* Shortest string of 2+ bytes */
+
+    int count;
+    struct _Meta_Content_Matcher_Entry *entry;	/* Sorted by "key" */
+    char *strings;				/* Folded if nocase */
+
+};
+
+int Meta_Content_Search(const char *, size_t, int, int);
+void Meta_Content_Compile(int);
+void Meta_Content_Free(int);
 
@@ -41,26 +41,47 @@
 #include "rules.h"
 #include "references.h"
 #include "sagan-config.h"
+#include "util-counters.h"
+#include "util-writer.h"
 
 struct _Rule_Struct *rulestruct;
 struct _SaganConfig *config;
-struct _SaganCounters *counters;
 
 void Alert_File( _Sagan_Event *Event )
 {
 
     char tmpref[256];
     char timebuf[64];
+    char alert_data[MAX_SYSLOGMSG+1024];
+    int len;
 
     CreateTimeString(&Event->event_time, timebuf, sizeof(timebuf), 1);
 
-    __atomic_add_fetch(&counters->alert_total, 1, __ATOMIC_SEQ_CST);
+    Sagan_Counter_Add(alert_total, 1);
 
-    fprintf(config->sagan_alert_stream, "\n[**] [%lu:%" PRIu64 ":%d] %s [**]\n", Event->generatorid, Event->sid, Event->rev, Event->f_msg);
-    fprintf(config->sagan_alert_stream, "[Classification: %s] [Priority: %d] [%s]\n", Event->class, Event->pri, Event->host );
-    fprintf(config->sagan_alert_stream, "[Alert Time: %s]\n", timebuf);
-    fprintf(config->sagan_alert_stream, "%s %s %s:%d -> %s:%d %s %s %s\n", Event->date, Event->time, Event->ip_src, Event->src_port, Event->ip_dst, Event->dst_port, Event->facility, Event->priority, Event->program);
-    fprintf(config->sagan_alert_stream, "Message: %s\n", Event->message);
+    /* The whole alert is one record,  so alerts from different threads
+       can't interleave */
+
+    len = snprintf(alert_data, sizeof(alert_data), "\n[**] [%lu:%" PRIu64 ":%d] %s [**]\n"
+                   "[Classification: %s] [Priority: %d] [%s]\n"
+                   "[Alert Time: %s]\n"
+                   "%s %s %s:%d -> %s:%d %s %s %s\n"
+                   "Message: %s\n",
+                   Event->generatorid, Event->sid, Event->rev, Event->f_msg,
+                   Event->class, Event->pri, Event->host,
+                   timebuf,
+                   Event->date, Event->time, Event->ip_src, Event->src_port, Event->ip_dst, Event->dst_port, Event->facility, Event->priority, Event->program,
+                   Event->message);
+
+    if ( len < 0 )
+        {
+            return;
+        }
+
+    if ( (size_t)len >= sizeof(alert_data) )
+        {
+            len = sizeof(alert_data) - 1;
+        }
 
     if ( Event->found != 0 )
         {
@@ -69,10 +90,15 @@ void Alert_File( _Sagan_Event *Event )
 
             if (strcmp(tmpref, "" ))
                 {
-                    fprintf(config->sagan_alert_stream, "%s\n", tmpref);
+                    len = len + snprintf(alert_data + len, sizeof(alert_data) - len, "%s\n", tmpref);
+
+                    if ( (size_t)len >= sizeof(alert_data) )
+                        {
+                            len = sizeof(alert_data) - 1;
+                        }
                 }
         }
 
-    fflush(config->sagan_alert_stream);
+    Sagan_Writer_Write(config->sagan_alert_writer, alert_data, len);
 
 }
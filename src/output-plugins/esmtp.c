@@ -42,6 +42,7 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "references.h"
 #include "rules.h"
 #include "esmtp.h"
@@ -51,7 +52,6 @@
 struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
-struct _SaganCounters *counters;
 
 int ESMTP_Thread ( _Sagan_Event *Event )
 {
@@ -123,44 +123,44 @@ int ESMTP_Thread ( _Sagan_Event *Event )
     if((session = smtp_create_session ()) == NULL)
         {
             Sagan_Log(WARN, "[%s, line %d] Cannot create smtp session.",  __FILE__, __LINE__);
-            __atomic_add_fetch(&counters->esmtp_count_failed, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(esmtp_count_failed, 1);
             goto failure;
         }
     if((message = smtp_add_message (session)) == NULL)
         {
             Sagan_Log(WARN, "[%s, line %d] Cannot add message to smtp session.",  __FILE__, __LINE__);
-            __atomic_add_fetch(&counters->esmtp_count_failed, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(esmtp_count_failed, 1);
 
             goto failure;
         }
     if(!smtp_set_server (session, config->sagan_esmtp_server))
         {
             Sagan_Log(WARN, "[%s, line %d] Cannot set smtp server.",  __FILE__, __LINE__);
-            __atomic_add_fetch(&counters->esmtp_count_failed, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(esmtp_count_failed, 1);
             goto failure;
         }
     if((r = FixLF(config, tmpb, tmpa)) <= 0)
         {
             Sagan_Log(WARN, "[%s, line %d] Cannot FixLF.",  __FILE__, __LINE__);
-            __atomic_add_fetch(&counters->esmtp_count_failed, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(esmtp_count_failed, 1);
             goto failure;
         }
     if(!smtp_set_message_str (message, tmpb))
         {
             Sagan_Log(WARN, "[%s, line %d] Cannot set message string.",  __FILE__, __LINE__);
-            __atomic_add_fetch(&counters->esmtp_count_failed, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(esmtp_count_failed, 1);
             goto failure;
         }
     if(!smtp_set_reverse_path (message, config->sagan_esmtp_from))
         {
             Sagan_Log(WARN, "[%s, line %d] Cannot reverse path.",  __FILE__, __LINE__);
-            __atomic_add_fetch(&counters->esmtp_count_failed, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(esmtp_count_failed, 1);
             goto failure;
         }
     if((recipient = smtp_add_recipient (message, rulestruct[Event->found].email)) == NULL)
         {
             Sagan_Log(WARN, "[%s, line %d] Cannot add recipient.",  __FILE__, __LINE__);
-            __atomic_add_fetch(&counters->esmtp_count_failed, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(esmtp_count_failed, 1);
             goto failure;
         }
 
@@ -174,7 +174,7 @@ int ESMTP_Thread ( _Sagan_Event *Event )
              */
 
             Sagan_Log(WARN, "[%s, line %d] SMTP Error: %s", __FILE__, __LINE__, smtp_strerror (smtp_errno (), errtmp, sizeof(errtmp)));
-            __atomic_add_fetch(&counters->esmtp_count_failed, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(esmtp_count_failed, 1);
 
         }
     else
@@ -183,7 +183,7 @@ int ESMTP_Thread ( _Sagan_Event *Event )
             /* SMTP sent successful */
 
             status = smtp_message_transfer_status (message);
-            __atomic_add_fetch(&counters->esmtp_count_success, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(esmtp_count_success, 1);
 
             if ( debug->debugesmtp ) Sagan_Log(DEBUG, "SMTP %d %s", status->code, (status->text != NULL) ? status->text : "\n");
 
@@ -33,6 +33,8 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -40,6 +42,7 @@
 #include "output-plugins/eve.h"
 
 #include "sagan-config.h"
+#include "util-writer.h"
 
 struct _SaganConfig *config;
 
@@ -47,17 +50,21 @@ void Alert_JSON( _Sagan_Event *Event )
 {
 
     char alert_data[MAX_SYSLOGMSG+1024] = { 0 };
+    size_t len;
 
     if ( config->eve_alerts == true )
         {
 
-            Format_JSON_Alert_EVE( Event, alert_data, sizeof(alert_data) );
+            /* Leave room for the newline */
 
-            fprintf(config->eve_stream, "%s\n", alert_data);
+            Format_JSON_Alert_EVE( Event, alert_data, sizeof(alert_data) - 1 );
 
-        }
+            len = strlen(alert_data);
+            alert_data[len++] = '\n';
+
+            Sagan_Writer_Write(config->eve_writer, alert_data, len);
 
-    fflush(config->eve_stream);
+        }
 
 }
 
@@ -65,11 +72,14 @@ void Log_JSON ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, struct timeval tp, js
 {
 
     char log_data[MAX_SYSLOGMSG+1024] = { 0 };
+    size_t len;
+
+    Format_JSON_Log_EVE( SaganProcSyslog_LOCAL, tp, log_data, sizeof(log_data) - 1, json_normalize );
 
-    Format_JSON_Log_EVE( SaganProcSyslog_LOCAL, tp, log_data, sizeof(log_data), json_normalize );
-    fprintf(config->eve_stream, "%s\n", log_data);
-    fflush(config->eve_stream);
+    len = strlen(log_data);
+    log_data[len++] = '\n';
 
+    Sagan_Writer_Write(config->eve_writer, log_data, len);
 
 }
 
@@ -37,6 +37,7 @@
 #include "references.h"
 #include "sagan-config.h"
 #include "util-time.h"
+#include "util-writer.h"
 
 #include "output-plugins/alert.h"
 
@@ -47,34 +48,42 @@ void Fast_File( _Sagan_Event *Event )
 {
 
     char timebuf[64];
+    char fast_data[2048];
+    const char *proto = "UNKNOWN";
+    int len;
 
     CreateTimeString(&Event->event_time, timebuf, sizeof(timebuf), 0);
 
-    fprintf(config->sagan_fast_stream, "%s [**] [%lu:%" PRIu64 ":%d] %s [**] [Classification: %s] [Priority: %d] [Program: %s] ", timebuf,
-            Event->generatorid, Event->sid, Event->rev, Event->f_msg, Event->class, Event->pri, Event->program);
-
     if ( Event->ip_proto == 1 )
         {
-            fprintf(config->sagan_fast_stream, "{ICMP}");
+            proto = "ICMP";
         }
 
     else if ( Event->ip_proto == 6 )
         {
-            fprintf(config->sagan_fast_stream, "{TCP}");
+            proto = "TCP";
         }
 
     else if ( Event->ip_proto == 17 )
         {
-            fprintf(config->sagan_fast_stream, "{UDP}");
+            proto = "UDP";
         }
 
-    else if ( Event->ip_proto != 1 && Event->ip_proto !=6 && Event->ip_proto != 17 )
+    len = snprintf(fast_data, sizeof(fast_data), "%s [**] [%lu:%" PRIu64 ":%d] %s [**] [Classification: %s] [Priority: %d] [Program: %s] {%s} %s:%d -> %s:%d\n", timebuf,
+                   Event->generatorid, Event->sid, Event->rev, Event->f_msg, Event->class, Event->pri, Event->program,
+                   proto, Event->ip_src, Event->src_port, Event->ip_dst, Event->dst_port);
+
+    if ( len < 0 )
         {
-            fprintf(config->sagan_fast_stream, "{UNKNOWN}");
+            return;
         }
 
-    fprintf(config->sagan_fast_stream," %s:%d -> %s:%d\n", Event->ip_src, Event->src_port, Event->ip_dst, Event->dst_port);
+    if ( (size_t)len >= sizeof(fast_data) )
+        {
+            len = sizeof(fast_data) - 1;
+            fast_data[len - 1] = '\n';
+        }
 
-    fflush(config->sagan_fast_stream);
+    Sagan_Writer_Write(config->sagan_fast_writer, fast_data, len);
 
 }
@@ -0,0 +1,260 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* output-queue.c
+ *
+ * Hands alerts from the processor threads to the output threads.  Writing
+ * an alert can mean waiting on a disk,  a SMTP server or an "external"
+ * program.  With "output-threads" enabled the processor copies the alert
+ * into a pre-allocated slot and goes back to work.  The output threads call
+ * Output() for it.
+ *
+ * The slots live in the same bounded MPMC queue as util-ring.c (see
+ * util-mpmc.c).  When every slot is in use "output-back-pressure" decides if the processor
+ * waits for one ("block") or the alert is dropped ("drop").
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
+#ifdef HAVE_LIBLOGNORM
+#include <json.h>
+#endif
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "output.h"
+#include "util-mpmc.h"
+#include "output-queue.h"
+#include "util-counters.h"
+
+#define SAGAN_OUTPUT_QUEUE_DRAIN_MAX	15		/* Seconds to wait for queued alerts */
+
+struct _SaganCounters *counters;
+struct _SaganConfig *config;
+
+static struct _Sagan_Output_Queue *SaganOutputQueue = NULL;
+
+/****************************************************************************
+ * Output_Queue_Init - Allocates "output-queue-size" slots (rounded up to a
+ * power of 2).
+ ****************************************************************************/
+
+void Output_Queue_Init( void )
+{
+
+    struct _Sagan_Output_Queue *queue = NULL;
+
+    if ( posix_memalign((void **)&queue, SAGAN_OUTPUT_QUEUE_CACHE_LINE, sizeof(struct _Sagan_Output_Queue)) != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for output queue. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(queue, 0, sizeof(struct _Sagan_Output_Queue));
+
+    queue->slot = Sagan_MPMC_Init(&queue->queue, config->output_queue_size, sizeof(struct _Sagan_Output_Slot));
+
+    SaganOutputQueue = queue;
+}
+
+/****************************************************************************
+ * Output_Queue_Copy - Copies an Event string into its slot.  NULL stays
+ * NULL.
+ ****************************************************************************/
+
+static char *Output_Queue_Copy( char *dst, size_t size, const char *src )
+{
+
+    if ( src == NULL )
+        {
+            return(NULL);
+        }
+
+    strlcpy(dst, src, size);
+    return(dst);
+}
+
+/****************************************************************************
+ * Output_Queue_Send - Called by the processor threads (see send-alert.c).
+ * Copies "Event" into a free slot and hands it to the output threads.
+ ****************************************************************************/
+
+void Output_Queue_Send( _Sagan_Event *Event )
+{
+
+    struct _Sagan_Output_Queue *queue = SaganOutputQueue;
+    struct _Sagan_Output_Slot *slot = NULL;
+
+    slot = Sagan_MPMC_Reserve(&queue->queue, config->output_block);
+
+    if ( slot == NULL )
+        {
+            Sagan_Counter_Add(sagan_output_drop, 1);
+            return;
+        }
+
+    memcpy(&slot->Event, Event, sizeof(struct _Sagan_Event));
+
+    slot->Event.message = Output_Queue_Copy(slot->message, sizeof(slot->message), Event->message);
+    slot->Event.host = Output_Queue_Copy(slot->host, sizeof(slot->host), Event->host);
+    slot->Event.facility = Output_Queue_Copy(slot->facility, sizeof(slot->facility), Event->facility);
+    slot->Event.priority = Output_Queue_Copy(slot->priority, sizeof(slot->priority), Event->priority);
+    slot->Event.level = Output_Queue_Copy(slot->level, sizeof(slot->level), Event->level);
+    slot->Event.tag = Output_Queue_Copy(slot->tag, sizeof(slot->tag), Event->tag);
+    slot->Event.date = Output_Queue_Copy(slot->date, sizeof(slot->date), Event->date);
+    slot->Event.time = Output_Queue_Copy(slot->time, sizeof(slot->time), Event->time);
+    slot->Event.program = Output_Queue_Copy(slot->program, sizeof(slot->program), Event->program);
+    slot->Event.ip_src = Output_Queue_Copy(slot->ip_src, sizeof(slot->ip_src), Event->ip_src);
+    slot->Event.ip_dst = Output_Queue_Copy(slot->ip_dst, sizeof(slot->ip_dst), Event->ip_dst);
+    slot->Event.f_msg = Output_Queue_Copy(slot->f_msg, sizeof(slot->f_msg), Event->f_msg);
+    slot->Event.class = Output_Queue_Copy(slot->class, sizeof(slot->class), Event->class);
+    slot->Event.normalize_http_uri = Output_Queue_Copy(slot->normalize_http_uri, sizeof(slot->normalize_http_uri), Event->normalize_http_uri);
+    slot->Event.normalize_http_hostname = Output_Queue_Copy(slot->normalize_http_hostname, sizeof(slot->normalize_http_hostname), Event->normalize_http_hostname);
+    slot->Event.bluedot_json = Output_Queue_Copy(slot->bluedot_json, sizeof(slot->bluedot_json), Event->bluedot_json);
+
+    /* Nothing points at "fpri" */
+
+    slot->Event.fpri = NULL;
+
+#ifdef HAVE_LIBLOGNORM
+
+    /* The processor frees its liblognorm object after the log line.  Pass
+       it as text;  the output thread parses it back */
+
+    slot->json_normalize[0] = '\0';
+
+    if ( Event->json_normalize != NULL )
+        {
+            strlcpy(slot->json_normalize, json_object_to_json_string_ext(Event->json_normalize, FJSON_TO_STRING_PLAIN), sizeof(slot->json_normalize));
+        }
+
+    slot->Event.json_normalize = NULL;
+
+#endif
+
+    Sagan_MPMC_Publish(&queue->queue, slot);
+}
+
+/****************************************************************************
+ * Output_Queue_Thread - An output thread.  Writes queued alerts with
+ * Output() until Sagan exits.
+ ****************************************************************************/
+
+void Output_Queue_Thread( void )
+{
+
+    (void)SetThreadName("SaganOutput");
+
+    struct _Sagan_Output_Queue *queue = SaganOutputQueue;
+    struct _Sagan_Output_Slot *slot = NULL;
+
+    for (;;)
+        {
+
+            if ( ( slot = Sagan_MPMC_Claim(&queue->queue) ) == NULL )
+                {
+                    continue;
+                }
+
+#ifdef HAVE_LIBLOGNORM
+
+            if ( slot->json_normalize[0] != '\0' )
+                {
+                    slot->Event.json_normalize = json_tokener_parse(slot->json_normalize);
+                }
+
+#endif
+
+            Output( &slot->Event );
+
+#ifdef HAVE_LIBLOGNORM
+
+            if ( slot->Event.json_normalize != NULL )
+                {
+                    json_object_put(slot->Event.json_normalize);
+                    slot->Event.json_normalize = NULL;
+                }
+
+#endif
+
+            Sagan_MPMC_Release(&queue->queue, slot);
+        }
+}
+
+/****************************************************************************
+ * Output_Queue_Drain - Waits until every queued alert has been written.
+ * The signal handler calls this before it closes/re-opens the output
+ * files or reloads the rules that queued alerts refer to.
+ ****************************************************************************/
+
+void Output_Queue_Drain( void )
+{
+
+    struct _Sagan_Output_Queue *queue = SaganOutputQueue;
+    uint64_t pending = 0;
+    int i;
+
+    if ( queue == NULL )
+        {
+            return;
+        }
+
+    for ( i = 0; i < SAGAN_OUTPUT_QUEUE_DRAIN_MAX * 100; i++ )
+        {
+
+            pending = Sagan_MPMC_Pending(&queue->queue);
+
+            if ( pending == 0 )
+                {
+                    return;
+                }
+
+            usleep(10000);
+        }
+
+    Sagan_Log(WARN, "[%s, line %d] Gave up waiting on %" PRIu64 " queued alert(s).", __FILE__, __LINE__, pending);
+}
+
+/****************************************************************************
+ * Output_Queue_Size - Number of slots (0 == no output threads)
+ ****************************************************************************/
+
+uint64_t Output_Queue_Size( void )
+{
+
+    return( SaganOutputQueue == NULL ? 0 : SaganOutputQueue->queue.size );
+}
@@ -0,0 +1,82 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* output-queue.h
+ *
+ * Bounded lock free queue of alerts handed to the output threads.  Needs
+ * util-mpmc.h.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#define SAGAN_OUTPUT_QUEUE_CACHE_LINE	64
+
+typedef struct _Sagan_Output_Slot _Sagan_Output_Slot;
+struct _Sagan_Output_Slot
+{
+
+    struct _Sagan_MPMC_Slot mpmc;		/* Must be first (see util-mpmc.c) */
+
+    struct _Sagan_Event Event;
+
+    /* The processor moves on to the next log line as soon as the alert is
+       queued,  so the Event's strings point at these copies */
+
+    char message[MAX_SYSLOGMSG];
+    char host[MAX_SYSLOG_HOST];
+    char facility[MAX_SYSLOG_FACILITY];
+    char priority[MAX_SYSLOG_PRIORITY];
+    char level[MAX_SYSLOG_LEVEL];
+    char tag[MAX_SYSLOG_TAG];
+    char date[MAX_SYSLOG_DATE];
+    char time[MAX_SYSLOG_TIME];
+    char program[MAX_SYSLOG_PROGRAM];
+    char ip_src[MAXIP];
+    char ip_dst[MAXIP];
+    char f_msg[MAX_SAGAN_MSG];
+    char class[MAX_SAGAN_MSG];
+    char normalize_http_uri[MAX_HOSTNAME_SIZE + MAX_URL_SIZE];
+    char normalize_http_hostname[MAX_HOSTNAME_SIZE+1];
+    char bluedot_json[BLUEDOT_JSON_SIZE];
+
+#ifdef HAVE_LIBLOGNORM
+    char json_normalize[MAX_SYSLOGMSG];		/* Re-parsed by the output thread */
+#endif
+
+} __attribute__ ((aligned (SAGAN_OUTPUT_QUEUE_CACHE_LINE)));
+
+typedef struct _Sagan_Output_Queue _Sagan_Output_Queue;
+struct _Sagan_Output_Queue
+{
+
+    struct _Sagan_MPMC queue;
+
+    struct _Sagan_Output_Slot *slot;
+
+};
+
+void Output_Queue_Init( void );
+void Output_Queue_Send( _Sagan_Event * );
+void Output_Queue_Thread( void );
+void Output_Queue_Drain( void );
+uint64_t Output_Queue_Size( void );
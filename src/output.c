@@ -53,21 +53,12 @@ struct _SaganCounters *counters;
 struct _Rule_Struct *rulestruct;
 struct _SaganConfig *config;
 
-bool nonthread_alert_lock = false;
-
-pthread_mutex_t SaganOutputNonThreadMutex=PTHREAD_MUTEX_INITIALIZER;
-
 void Output( _Sagan_Event *Event )
 {
 
-    /******************************/
-    /* Single threaded operations */
-    /******************************/
-
-    /* Single threaded */
-
-    pthread_mutex_lock(&SaganOutputNonThreadMutex);
-    nonthread_alert_lock = true;
+    /****************************************************************************/
+    /* Alert, EVE and fast files (each file's writer has its own lock)          */
+    /****************************************************************************/
 
     if ( config->alert_flag && rulestruct[Event->found].xbit_noalert == false )
         {
@@ -88,11 +79,6 @@ void Output( _Sagan_Event *Event )
             Fast_File(Event);
         }
 
-    nonthread_alert_lock = false;
-    pthread_mutex_unlock(&SaganOutputNonThreadMutex);
-
-    /* End single threaded */
-
     /****************************************************************************/
     /* Syslog output                                                            */
     /****************************************************************************/
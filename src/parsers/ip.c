@@ -29,6 +29,12 @@
  * parse logs.  Support IPv6 and will attempt to pull the port and protocol
  *  if avaliable.
  *
+ * The message is scanned once,  in place.  Each character is classified
+ * with a table lookup,  so a "word" is split out and its colons,  dots and
+ * hashes counted in the same pass.  Only words that could be an address
+ * are copied (into a small buffer for inet_pton()).  The engine runs this
+ * once per event and shares the result between rule options.
+ *
  * What this detects:
  *
  * IPv4
@@ -73,6 +79,8 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <pthread.h>
 
 #include "sagan.h"
@@ -85,884 +93,409 @@
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
 
-int Parse_IP( char *syslog_message, struct _Sagan_Lookup_Cache_Entry *lookup_cache )
-{
-
-    if ( debug->debugparse_ip )
-        {
-            Sagan_Log(DEBUG, "[%s:%lu] Start Function.", __FUNCTION__, pthread_self() );
-        }
-
-    struct sockaddr_in sa;
-
-    int current_position = 0;
-
-    char mod_string[MAX_SYSLOGMSG] = { 0 };
+/* Character classes.  Anything that isn't listed is part of a word */
 
-    char tmp_token[64] = { 0 };
+#define PARSE_IP_WORD		0
+#define PARSE_IP_DELIM		1
+#define PARSE_IP_COLON		2
+#define PARSE_IP_DOT		3
+#define PARSE_IP_HASH		4
 
-    char *ptr1 = NULL;
-    char *ptr2 = NULL;
+/* Longest word worth testing.  "inet#" + an IPv6 address fits */
 
-    char *ptr3 = NULL;
-    char *ptr4 = NULL;
+#define PARSE_IP_MAX_WORD	64
 
+/* Word separators.  Besides white space,  these let IPs enclosed like
+   "192.168.1.1" or (192.168.1.1) be found */
 
-    char *ip_1 = NULL;
-    char *ip_2 = NULL;
-
-    char port_test[6] = { 0 };
-    int  port_test_int = 0;
-
-    bool valid = false ;
-
-    int i=0;
-    int b=0;
-
-    int num_colons = 0;
-    int num_dots = 0;
-    int num_hashes = 0;
+static const unsigned char Parse_IP_Class[256] =
+{
+    [' '] = PARSE_IP_DELIM,  ['\t'] = PARSE_IP_DELIM, ['\r'] = PARSE_IP_DELIM,
+    ['\n'] = PARSE_IP_DELIM, ['"'] = PARSE_IP_DELIM,  ['('] = PARSE_IP_DELIM,
+    [')'] = PARSE_IP_DELIM,  ['['] = PARSE_IP_DELIM,  [']'] = PARSE_IP_DELIM,
+    ['<'] = PARSE_IP_DELIM,  ['>'] = PARSE_IP_DELIM,  ['{'] = PARSE_IP_DELIM,
+    ['}'] = PARSE_IP_DELIM,  [','] = PARSE_IP_DELIM,  ['/'] = PARSE_IP_DELIM,
+    ['@'] = PARSE_IP_DELIM,  ['='] = PARSE_IP_DELIM,  ['-'] = PARSE_IP_DELIM,
+    ['!'] = PARSE_IP_DELIM,  ['|'] = PARSE_IP_DELIM,  ['_'] = PARSE_IP_DELIM,
+    ['+'] = PARSE_IP_DELIM,  ['&'] = PARSE_IP_DELIM,  ['%'] = PARSE_IP_DELIM,
+    ['$'] = PARSE_IP_DELIM,  ['~'] = PARSE_IP_DELIM,  ['^'] = PARSE_IP_DELIM,
+    ['\''] = PARSE_IP_DELIM,
+
+    [':'] = PARSE_IP_COLON,  ['.'] = PARSE_IP_DOT,    ['#'] = PARSE_IP_HASH
+};
+
+/* Returns the next word at or after "p" and its length,  NULL at the end */
+
+static const char *Parse_IP_Next_Word( const char *p, size_t *len )
+{
 
-    int port = config->sagan_port;
+    const char *start = NULL;
 
-    for (i=0; i<strlen(syslog_message); i++)
+    while ( *p != '\0' && Parse_IP_Class[(unsigned char)*p] == PARSE_IP_DELIM )
         {
-
-            /* Remove any ", (, ), etc. In case the IP is enclosed like this:
-               "192.168.1.1" or (192.168.1.1) */
-
-            if ( syslog_message[i] != '"' && syslog_message[i] != '(' && syslog_message[i] != ')' &&
-                    syslog_message[i] != '[' && syslog_message[i] != ']' && syslog_message[i] != '<' &&
-                    syslog_message[i] != '>' && syslog_message[i] != '{' && syslog_message[i] != '}' &&
-                    syslog_message[i] != ',' && syslog_message[i] != '/' && syslog_message[i] != '@' &&
-                    syslog_message[i] != '=' && syslog_message[i] != '-' && syslog_message[i] != '!' &&
-                    syslog_message[i] != '|' && syslog_message[i] != '_' && syslog_message[i] != '+' &&
-                    syslog_message[i] != '&' && syslog_message[i] != '%' && syslog_message[i] != '$' &&
-                    syslog_message[i] != '~' && syslog_message[i] != '^' && syslog_message[i] != '\'' )
-                {
-
-                    mod_string[i] = syslog_message[i];
-                    mod_string[i+1] = '\0';
-
-                }
-            else
-                {
-
-                    mod_string[i] = ' ';
-                    mod_string[i+1] = '\0';
-
-                }
-
+            p++;
         }
 
-
-    if ( debug->debugparse_ip )
+    if ( *p == '\0' )
         {
-            Sagan_Log(DEBUG, "[%s:%lu] Modified string: %s", __FUNCTION__, pthread_self(), mod_string);
+            return(NULL);
         }
 
-    ptr1 = strtok_r(mod_string, " ", &ptr2);
-
-    while ( ptr1 != NULL )
-        {
-
-            num_colons = 0;
-            num_dots = 0;
-            num_hashes = 0;
-
-            if ( debug->debugparse_ip )
-                {
-                    Sagan_Log(DEBUG, "[%s:%lu] Token: '%s'", __FUNCTION__, pthread_self(), ptr1 );
-                }
-
-            /* Get counts of colons, hashes, dots.  */
-
-            for (i=0; i<strlen(ptr1); i++)
-                {
-
-                    switch(ptr1[i])
-                        {
-
-                        case(':'):
-                            num_colons++;
-                            break;
-
-                        case('#'):
-                            num_hashes++;
-                            break;
+    for ( start = p; *p != '\0' && Parse_IP_Class[(unsigned char)*p] != PARSE_IP_DELIM; p++ );
 
-                        case('.'):
-                            num_dots++;
-                            break;
+    *len = p - start;
+    return(start);
+}
 
-                        }
+/* Case insensitive test for "needle" (lower case) within a word */
 
-                }
+static bool Parse_IP_Word_Has( const char *word, size_t len, const char *needle )
+{
 
-            valid = false;		/* Reset to not valid */
+    size_t needle_len = strlen(needle);
+    size_t i;
 
-            if ( debug->debugparse_ip )
+    for ( i = 0; i + needle_len <= len; i++ )
+        {
+            if ( strncasecmp(word + i, needle, needle_len) == 0 )
                 {
-                    Sagan_Log(DEBUG, "[%s:%lu] Colons: %d, Dots: %d, Hashes: %d", __FUNCTION__, pthread_self(), num_colons, num_dots, num_hashes );
+                    return(true);
                 }
+        }
 
-            if ( !strcasecmp(ptr1, "tcp" ) )
-                {
-
-                    if ( debug->debugparse_ip )
-                        {
-                            Sagan_Log(DEBUG, "[%s:%lu] Protocal TCP detected.", __FUNCTION__, pthread_self() );
-                        }
+    return(false);
+}
 
-                    lookup_cache[0].proto = 6;
-                }
+/* Leading digits of "p" as a port,  like atoi().  If there aren't any,
+   the default port is used */
 
-            else if ( !strcasecmp(ptr1, "udp" ) )
-                {
+static int Parse_IP_Port( const char *p )
+{
 
-                    if ( debug->debugparse_ip )
-                        {
-                            Sagan_Log(DEBUG, "[%s:%lu] Protocal UDP detected.", __FUNCTION__, pthread_self() );
-                        }
+    int port = 0;
+    int i;
 
-                    lookup_cache[0].proto = 17;
+    for ( i = 0; i < 9 && isdigit((unsigned char)p[i]); i++ )
+        {
+            port = ( port * 10 ) + ( p[i] - '0' );
+        }
 
-                }
+    return( port == 0 ? config->sagan_port : port );
+}
 
-            else if ( !strcasecmp(ptr1, "icmp" ) )
-                {
+/* Looks at the words after an address for its port.  Handles "port 1234",
+   "source port: 1234",  "destination port 1234",  "client port 1234" and
+   ":1234" (what is left of "[fe80::1]:1234").  Returns 0 if there isn't
+   one. */
 
-                    if ( debug->debugparse_ip )
-                        {
-                            Sagan_Log(DEBUG, "[%s:%lu] Protocal ICMP detected.", __FUNCTION__, pthread_self() );
-                        }
+static int Parse_IP_Port_After( const char *rest )
+{
 
-                    lookup_cache[0].proto = 1;
+    const char *word = NULL;
+    size_t len = 0;
 
-                }
+    if (( word = Parse_IP_Next_Word(rest, &len)) == NULL )
+        {
+            return(0);
+        }
 
+    if ( word[0] == ':' )
+        {
+            return( Parse_IP_Port(word + 1) );
+        }
 
-            /* Needs to have proper IPv6 or IPv4 encoding. num_dots > 4 is for IP with trailing
-            period. */
+    if ( Parse_IP_Word_Has(word, len, "source") || Parse_IP_Word_Has(word, len, "destination") ||
+            Parse_IP_Word_Has(word, len, "client") )
+        {
 
-            if ( ( num_colons < 2 && num_dots < 3 ) || ( num_dots > 4 ) )
+            if (( word = Parse_IP_Next_Word(word + len, &len)) == NULL || !Parse_IP_Word_Has(word, len, "port") )
                 {
-
-                    if ( debug->debugparse_ip )
-                        {
-                            Sagan_Log(DEBUG, "[%s:%lu] '%s' can't be an IPv4 or IPv6.", __FUNCTION__, pthread_self(), ptr1 );
-                        }
-
-                    ptr1 = strtok_r(NULL, " ", &ptr2);		/* move to next token */
-                    continue;
+                    return(0);
                 }
+        }
 
+    else if ( !Parse_IP_Word_Has(word, len, "port") )
+        {
+            return(0);
+        }
 
-            /* Stand alone IPv4 address */
-
-            if ( num_dots == 3 && num_colons == 0 )
-                {
-
-                    valid = inet_pton(AF_INET, ptr1,  &(sa.sin_addr));
-
-                    if ( valid == 1 )
-                        {
-
-                            if ( debug->debugparse_ip )
-                                {
-                                    Sagan_Log(DEBUG, "[%s:%lu] ** Identified stand alone IPv4 address '%s' position %d **", __FUNCTION__, pthread_self(), ptr1, current_position );
-                                }
-
-                            /* Grab the IP */
-
-                            memcpy(lookup_cache[current_position].ip, ptr1, MAXIP);
-                            memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                            IP2Bit(ptr1, lookup_cache[current_position].ip_bits);
-
-                            /* Preserve the array */
-
-                            memcpy(tmp_token, ptr2, sizeof(tmp_token));
-
-                            ptr4 = tmp_token;
-                            ptr3 = strtok_r(NULL, " ", &ptr4);
-
-                            /* Look for "192.168.1.1 port 1234" */
-
-                            if ( ptr3 != NULL && strcasestr(ptr3, "port") )
-                                {
-
-                                    if ( debug->debugparse_ip )
-                                        {
-                                            Sagan_Log(DEBUG, "[%s:%d] Identified the word 'port'", __FUNCTION__, pthread_self() );
-                                        }
-
-                                    ptr3 = strtok_r(NULL, " ", &ptr4);
-
-                                    if ( ptr3 != NULL )
-                                        {
-                                            port = atoi(ptr3);
-
-                                            if ( port == 0 )
-                                                {
-                                                    lookup_cache[current_position].port = config->sagan_port;
-
-                                                }
-                                            else
-                                                {
-
-                                                    lookup_cache[current_position].port = port;
-
-                                                }
-                                        }
-
-                                }
-
-                            /* Look for "192.168.1.1 source port: 1234" or
-                            "192.168.1.1 source port 1234" */
-
-                            else if ( ptr3 != NULL && ( strcasestr(ptr3, "source") ||
-                                                        strcasestr(ptr3, "destination" ) ) )
-
-                                {
-
-                                    if ( debug->debugparse_ip )
-                                        {
-                                            Sagan_Log(DEBUG, "[%s:%lu] Identified 'source' or 'destination'", __FUNCTION__, pthread_self() );
-                                        }
-
-                                    ptr3 = strtok_r(NULL, " ", &ptr4);
-
-                                    if ( ptr3 != NULL && strcasestr(ptr3, "port" ) )
-                                        {
-
-                                            if ( debug->debugparse_ip )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s:%lu] Identified 'port'.", __FUNCTION__, pthread_self() );
-                                                }
-
-                                            ptr3 = strtok_r(NULL, " ", &ptr4);
-
-                                            if ( ptr3 != NULL )
-                                                {
-
-                                                    port = atoi(ptr3);
+    if (( word = Parse_IP_Next_Word(word + len, &len)) == NULL )
+        {
+            return(0);
+        }
 
-                                                    if ( port == 0 )
-                                                        {
+    return( Parse_IP_Port(word) );
+}
 
-                                                            lookup_cache[current_position].port = config->sagan_port;
+/* Converts "ip" to bits like IP2Bit() does,  but without the name lookup
+   machinery.  Returns false if it isn't a "family" address */
 
-                                                        }
-                                                    else
-                                                        {
+static bool Parse_IP_Pton( int family, const char *ip, unsigned char *ip_bits )
+{
+    memset(ip_bits, 0, MAXIPBIT);
+    return( inet_pton(family, ip, ip_bits) == 1 );
+}
 
-                                                            lookup_cache[current_position].port = port;
-                                                        }
+static int Parse_IP_Add( struct _Sagan_Lookup_Cache_Entry *lookup_cache, int position, const char *ip, const unsigned char *ip_bits, int port )
+{
 
+    struct _Sagan_Lookup_Cache_Entry *entry = &lookup_cache[position];
 
-                                                }
+    if ( debug->debugparse_ip )
+        {
+            Sagan_Log(DEBUG, "[%s:%lu] ** Identified address '%s' port %d position %d **", __FUNCTION__, pthread_self(), ip, port, position );
+        }
 
-                                        }
+    strlcpy(entry->ip, ip, MAXIP);
+    memcpy(entry->ip_bits, ip_bits, MAXIPBIT);
+    entry->port = port;
+    entry->status = true;
 
-                                }
+    return(position + 1);
+}
 
-                            /* Look's for 192.168.1.1 client port 1234 */
+/* Adds an IPv6 address.  ::ffff:192.168.1.1 is recorded as 192.168.1.1
+   unless "parse_ip_ipv4_mapped_ipv6" is set. */
 
-                            else if ( ptr3 != NULL && strcasestr(ptr3, "client") )
-                                {
+static int Parse_IP_Add_IPv6( struct _Sagan_Lookup_Cache_Entry *lookup_cache, int position, const char *ip, const unsigned char *ip_bits, int port )
+{
 
-                                    if ( debug->debugparse_ip )
-                                        {
-                                            Sagan_Log(DEBUG, "[%s:%lu] Identified 'client'", __FUNCTION__, pthread_self() );
-                                        }
+    if ( config->parse_ip_ipv4_mapped_ipv6 == false && strncasecmp(ip, "::ffff:", 7) == 0 )
+        {
+            ip = ip + 7;
+        }
 
-                                    ptr3 = strtok_r(NULL, " ", &ptr4);
+    return( Parse_IP_Add(lookup_cache, position, ip, ip_bits, port) );
+}
 
-                                    if ( ptr3 != NULL && strcasestr(ptr3, "port" ) )
-                                        {
+/* "ip_1:ip_2" or "ip_1#ip_2" - either side may be the address.  If it's
+   the left,  the right is its port */
 
-                                            if ( debug->debugparse_ip )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s:%lu] Identified 'port'.", __FUNCTION__, pthread_self() );
-                                                }
+static int Parse_IP_Split( struct _Sagan_Lookup_Cache_Entry *lookup_cache, int position, char *word, char *split, int family )
+{
 
-                                            ptr3 = strtok_r(NULL, " ", &ptr4);
+    unsigned char ip_bits[MAXIPBIT];
+    char *ip_2 = split + 1;
 
-                                            if ( ptr3 != NULL )
-                                                {
+    *split = '\0';
 
-                                                    port = atoi(ptr3);
+    if ( Parse_IP_Pton(family, word, ip_bits) )
+        {
+            position = Parse_IP_Add(lookup_cache, position, word, ip_bits, Parse_IP_Port(ip_2));
+        }
 
-                                                    if ( port == 0 )
-                                                        {
+    else if ( position < MAX_PARSE_IP && Parse_IP_Pton(family, ip_2, ip_bits) )
+        {
+            position = Parse_IP_Add(lookup_cache, position, ip_2, ip_bits, config->sagan_port);
+        }
 
-                                                            lookup_cache[current_position].port = config->sagan_port;
+    return(position);
+}
 
-                                                        }
-                                                    else
-                                                        {
+int Parse_IP( char *syslog_message, struct _Sagan_Lookup_Cache_Entry *lookup_cache )
+{
 
-                                                            lookup_cache[current_position].port = port;
-                                                        }
+    if ( debug->debugparse_ip )
+        {
+            Sagan_Log(DEBUG, "[%s:%lu] Start Function.", __FUNCTION__, pthread_self() );
+        }
 
+    const char *p = syslog_message;
+    const char *start = NULL;
 
-                                                }
+    char word[PARSE_IP_MAX_WORD] = { 0 };
+    unsigned char ip_bits[MAXIPBIT];
 
-                                        }
+    char *colon = NULL;
+    char *hash = NULL;
 
-                                }
+    int current_position = 0;
+    int i;
 
+    int num_colons = 0;
+    int num_dots = 0;
+    int num_hashes = 0;
 
-                            lookup_cache[current_position].status = 1;
-                            current_position++;
+    size_t len;
 
-                            /* If we've run to the end, we're done */
+    lookup_cache[0].proto = 0;
 
-                            if ( current_position > MAX_PARSE_IP )
-                                {
-                                    break;
-                                }
+    while ( *p != '\0' && current_position < MAX_PARSE_IP )
+        {
 
-                        }
+            /* Split out the next word,  counting as we go */
 
+            while ( *p != '\0' && Parse_IP_Class[(unsigned char)*p] == PARSE_IP_DELIM )
+                {
+                    p++;
                 }
 
-            /* Stand alone IPv4 with trailing period */
+            num_colons = 0;
+            num_dots = 0;
+            num_hashes = 0;
 
-            if ( num_dots == 4 && ptr1[ strlen(ptr1)-1 ] == '.' )
+            for ( start = p; *p != '\0'; p++ )
                 {
 
-                    /* Erase the period */
-
-                    ptr1[ strlen(ptr1)-1 ] = '\0';
-
-                    valid = inet_pton(AF_INET, ptr1,  &(sa.sin_addr));
-
-                    if ( valid == 1 )
+                    switch ( Parse_IP_Class[(unsigned char)*p] )
                         {
 
-                            if ( debug->debugparse_ip )
-                                {
-                                    Sagan_Log(DEBUG, "[%s:%lu] ** Identified stand alone IPv4 address '%s' with trailing period. **", __FUNCTION__, pthread_self(), ptr1 );
-                                }
-
-                            memcpy(lookup_cache[current_position].ip, ptr1, MAXIP);
-                            memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                            IP2Bit(ptr1, lookup_cache[current_position].ip_bits);
-                            lookup_cache[current_position].port = config->sagan_port;
-                            lookup_cache[current_position].status = 1;
+                        case PARSE_IP_WORD:
+                            continue;
 
-                            current_position++;
+                        case PARSE_IP_COLON:
+                            num_colons++;
+                            continue;
 
-                            if ( current_position > MAX_PARSE_IP )
-                                {
-                                    break;
-                                }
+                        case PARSE_IP_DOT:
+                            num_dots++;
+                            continue;
 
+                        case PARSE_IP_HASH:
+                            num_hashes++;
+                            continue;
 
                         }
 
+                    break;
                 }
 
-            /* IPv4 with 192.168.2.1:12345 or inet:192.168.2.1 */
+            len = p - start;
 
-            if ( num_colons == 1 && num_dots == 3)
+            if ( len == 0 )
                 {
+                    continue;
+                }
 
-                    /* test both sides */
-
-                    ip_1 = strtok_r(ptr1, ":", &ip_2);
-
-                    if ( ip_1 != NULL )
-                        {
-                            valid = inet_pton(AF_INET, ip_1,  &(sa.sin_addr));
-                        }
-
-                    if ( valid == 1 )
-                        {
-
-                            if ( debug->debugparse_ip )
-                                {
-                                    Sagan_Log(DEBUG, "[%s:%lu] ** Identified IPv4:PORT address. **", __FUNCTION__, pthread_self() );
-                                }
-
-                            memcpy(lookup_cache[current_position].ip, ip_1, MAXIP);
-                            memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                            IP2Bit(ip_1, lookup_cache[current_position].ip_bits);
-
-                            /* In many cases, the port is after the : */
-
-                            port = atoi(ip_2);
-
-                            if ( port == 0 )
-                                {
-                                    lookup_cache[current_position].port = config->sagan_port;
-                                }
-                            else
-                                {
-                                    lookup_cache[current_position].port = port;
-                                }
-
-                            lookup_cache[current_position].status = 1;
-                            current_position++;
-
-                            if ( current_position > MAX_PARSE_IP )
-                                {
-                                    break;
-                                }
-
-                        }
-
-                    if ( ip_2 != NULL )
-                        {
-                            valid = inet_pton(AF_INET, ip_2,  &(sa.sin_addr));
-                        }
-
-                    if ( valid == 1 )
-
-                        {
-
-                            if ( debug->debugparse_ip )
-                                {
-                                    Sagan_Log(DEBUG, "[%s:%lu] ** Identified INTERFACE:IPv4 **", __FUNCTION__, pthread_self() );
-                                }
+            /* Protocol */
 
-                            memcpy(lookup_cache[current_position].ip, ip_2, MAXIP);
-                            memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                            IP2Bit(ip_2, lookup_cache[current_position].ip_bits);
-                            lookup_cache[current_position].port = config->sagan_port;
-                            lookup_cache[current_position].status = 1;
+            if ( len == 3 && strncasecmp(start, "tcp", 3) == 0 )
+                {
+                    lookup_cache[0].proto = 6;
+                    continue;
+                }
 
-                            current_position++;
+            if ( len == 3 && strncasecmp(start, "udp", 3) == 0 )
+                {
+                    lookup_cache[0].proto = 17;
+                    continue;
+                }
 
-                            if ( current_position > MAX_PARSE_IP )
-                                {
-                                    break;
-                                }
+            if ( len == 4 && strncasecmp(start, "icmp", 4) == 0 )
+                {
+                    lookup_cache[0].proto = 1;
+                    continue;
+                }
 
-                        }
+            /* Needs to have proper IPv6 or IPv4 encoding. num_dots > 4 is for IP with trailing
+            period. */
 
+            if ( ( num_colons < 2 && num_dots < 3 ) || ( num_dots > 4 ) || len >= sizeof(word) )
+                {
+                    continue;
                 }
 
-            /* Handle 192.168.2.1#12345 or inet#192.168.2.1 */
+            memcpy(word, start, len);
+            word[len] = '\0';
 
-            if ( num_hashes == 1 && num_dots == 3)
+            if ( debug->debugparse_ip )
                 {
+                    Sagan_Log(DEBUG, "[%s:%lu] Word: '%s' Colons: %d, Dots: %d, Hashes: %d", __FUNCTION__, pthread_self(), word, num_colons, num_dots, num_hashes );
+                }
 
-                    /* test both sides */
+            /* Stand alone IPv4 address */
 
-                    ip_1 = strtok_r(ptr1, "#", &ip_2);
+            if ( num_dots == 3 && num_colons == 0 && num_hashes == 0 )
+                {
 
-                    if ( ip_1 != NULL )
+                    if ( Parse_IP_Pton(AF_INET, word, ip_bits) )
                         {
-                            valid = inet_pton(AF_INET, ip_1,  &(sa.sin_addr));
+                            current_position = Parse_IP_Add(lookup_cache, current_position, word, ip_bits, Parse_IP_Port_After(p));
                         }
 
-                    if ( valid == 1 )
-                        {
-
-                            if ( debug->debugparse_ip )
-                                {
-                                    Sagan_Log(DEBUG, "[%s:%lu] ** Identified IPv4#PORT **", __FUNCTION__, pthread_self() );
-                                }
-
-
-                            memcpy(lookup_cache[current_position].ip, ip_1, MAXIP);
-                            memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                            IP2Bit(ip_1, lookup_cache[current_position].ip_bits);
-
-                            /* In many cases, the port is after the : */
-
-                            port = atoi(ip_2);
-
-                            if ( port == 0 )
-                                {
-                                    lookup_cache[current_position].port = config->sagan_port;
-                                }
-                            else
-                                {
-                                    lookup_cache[current_position].port = port;
-                                }
-
-                            lookup_cache[current_position].status = 1;
-                            current_position++;
+                    continue;
+                }
 
-                            /* If we've run to the end, we're done */
+            /* Stand alone IPv4 with trailing period */
 
-                            if ( current_position > MAX_PARSE_IP )
-                                {
-                                    break;
-                                }
+            if ( num_dots == 4 && num_colons == 0 && num_hashes == 0 && word[len-1] == '.' )
+                {
 
-                        }
+                    word[len-1] = '\0';
 
-                    if ( ip_2 != NULL )
+                    if ( Parse_IP_Pton(AF_INET, word, ip_bits) )
                         {
-                            valid = inet_pton(AF_INET, ip_2,  &(sa.sin_addr));
+                            current_position = Parse_IP_Add(lookup_cache, current_position, word, ip_bits, config->sagan_port);
                         }
 
-                    if ( valid == 1 )
-
-                        {
-
-                            if ( debug->debugparse_ip )
-                                {
-                                    Sagan_Log(DEBUG, "[%s:%lu] ** Identified INTERFACE#PORT **", __FUNCTION__, pthread_self() );
-                                }
-
-                            memcpy(lookup_cache[current_position].ip, ip_2, MAXIP);
-                            memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                            IP2Bit(ip_2, lookup_cache[current_position].ip_bits);
-                            lookup_cache[current_position].port = config->sagan_port;
-                            lookup_cache[current_position].status = 1;
-
-                            current_position++;
+                    continue;
+                }
 
-                            /* If we've run to the end, we're done */
+            /* IPv4 with 192.168.2.1:12345 or inet:192.168.2.1 */
 
-                            if ( current_position > MAX_PARSE_IP )
-                                {
-                                    break;
-                                }
+            if ( num_colons == 1 && num_dots == 3 && num_hashes == 0 )
+                {
+                    colon = strchr(word, ':');
+                    current_position = Parse_IP_Split(lookup_cache, current_position, word, colon, AF_INET);
+                    continue;
+                }
 
-                        }
+            /* Handle 192.168.2.1#12345 or inet#192.168.2.1 */
 
+            if ( num_hashes == 1 && num_dots == 3 && num_colons == 0 )
+                {
+                    hash = strchr(word, '#');
+                    current_position = Parse_IP_Split(lookup_cache, current_position, word, hash, AF_INET);
+                    continue;
                 }
 
-
             /* Do we even want to part IPv6? */
 
-            if ( config->parse_ip_ipv6 == true )
+            if ( config->parse_ip_ipv6 == false || num_colons < 2 )
                 {
+                    continue;
+                }
 
-                    /* Stand alone IPv6 */
-
-                    if ( num_colons > 2 )
-                        {
-
-                            valid = inet_pton(AF_INET6, ptr1,  &(sa.sin_addr));
-
-                            if ( valid == 1 )
-                                {
-
-                                    if ( debug->debugparse_ip )
-                                        {
-                                            Sagan_Log(DEBUG, "[%s:%lu] ** Identified stand alone IPv6 address '%s' **", __FUNCTION__, pthread_self(), ptr1 );
-                                        }
-
-                                    memcpy(lookup_cache[current_position].ip, ptr1, MAXIP);
-                                    memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                                    IP2Bit(ptr1, lookup_cache[current_position].ip_bits);
-
-                                    /* This converts ::ffff:192.168.1.1 to regular IPv4 (192.168.1.1) */
-
-                                    if ( config->parse_ip_ipv4_mapped_ipv6 == false )
-                                        {
-
-                                            if ( ptr1[0] == ':' && ptr1[1] == ':' && ( ptr1[2] == 'f' || ptr1[2] == 'F' ) &&
-                                                    ( ptr1[3] == 'f' || ptr1[3] == 'F' ) && ( ptr1[4] == 'f' || ptr1[4] == 'F' ) &&
-                                                    ( ptr1[5] == 'f' || ptr1[5] == 'F' ) && ptr1[6] == ':' )
-                                                {
-
-                                                    b = strlen(ptr1);
-
-                                                    for (i = 7; b > i; i++)
-                                                        {
-                                                            lookup_cache[current_position].ip[i-7] = ptr1[i];
-                                                            lookup_cache[current_position].ip[i-6] = '\0';
-                                                        }
-
-                                                    memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                                                    IP2Bit(ptr1, lookup_cache[current_position].ip_bits);
-
-                                                }
-
-                                        }
-
-                                    /* Look for "fe80::b614:89ff:fe11:5e24 port 1234" */
-
-                                    memcpy(tmp_token, ptr2, sizeof(tmp_token));
-
-                                    ptr4 = tmp_token;
-                                    ptr3 = strtok_r(NULL, " ", &ptr4);
-
-                                    if ( ptr3 != NULL && strcasestr(ptr3, "port") )
-                                        {
-
-                                            if ( debug->debugparse_ip )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s:%lu] Identified the word 'port'", __FUNCTION__, pthread_self() );
-                                                }
-
-
-                                            ptr3 = strtok_r(NULL, " ", &ptr4);
-
-                                            if ( ptr3 != NULL )
-                                                {
-                                                    port = atoi(ptr3);
-
-                                                    if ( port == 0 )
-                                                        {
-                                                            lookup_cache[current_position].port = port;
-                                                        }
-                                                    else
-                                                        {
-                                                            lookup_cache[current_position].port = config->sagan_port;
-                                                        }
-
-                                                }
-
-                                        }
-
-                                    /* Look for "fe80::b614:89ff:fe11:5e24 source port: 1234" or
-                                    "fe80::b614:89ff:fe11:5e24 source port 1234" */
-
-                                    else if ( ptr3 != NULL && ( strcasestr(ptr3, "source") ||
-                                                                strcasestr(ptr3, "destination" ) ) )
-
-                                        {
-
-                                            if ( debug->debugparse_ip )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s:%lu] Identified the word 'source' or 'destination'", __FUNCTION__, pthread_self() );
-                                                }
-
-
-                                            ptr3 = strtok_r(NULL, " ", &ptr4);
-
-                                            if ( ptr3 != NULL && strcasestr(ptr3, "port" ) )
-                                                {
-
-                                                    if ( debug->debugparse_ip )
-                                                        {
-                                                            Sagan_Log(DEBUG, "[%s:%lu] Identified the word 'port'", __FUNCTION__, pthread_self() );
-                                                        }
-
-
-                                                    ptr3 = strtok_r(NULL, " ", &ptr4);
-
-                                                    if ( ptr3 != NULL )
-                                                        {
-
-                                                            port = atoi(ptr3);
-
-                                                            if ( port == 0 )
-                                                                {
-                                                                    lookup_cache[current_position].port = config->sagan_port;
-                                                                }
-                                                            else
-                                                                {
-                                                                    lookup_cache[current_position].port = port;
-                                                                }
-
-                                                        }
-
-                                                }
-
-                                        }
-
-                                    /* IPv6 [fe80::b614:89ff:fe11:5e24]:443 */
-
-                                    else if ( ptr3 != NULL && ptr3[0] == ':' )
-                                        {
-
-                                            if ( debug->debugparse_ip )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s:%lu] Identified possible [IPv6]:PORT", __FUNCTION__, pthread_self() );
-                                                }
-
-                                            for ( i = 1; i < strlen(ptr3); i++ )
-                                                {
-                                                    port_test[i-1] = ptr3[i];
-                                                }
-
-                                            port_test_int = atoi(port_test);
-
-                                            if ( port_test_int == 0 )
-                                                {
-                                                    lookup_cache[current_position].port = config->sagan_port;
-                                                }
-                                            else
-                                                {
-                                                    lookup_cache[current_position].port = port_test_int;
-                                                }
-
-                                        }
-
-                                    lookup_cache[current_position].status = 1;
-
-                                    current_position++;
-
-                                    if ( current_position > MAX_PARSE_IP )
-                                        {
-                                            break;
-                                        }
-
-                                }
-
-                        }
-
-
-                    /* Stand alone IPv6 with trailing period */
-
-                    if ( num_colons > 2 && ptr1[ strlen(ptr1)-1 ] == '.' )
-                        {
-
-                            /* Erase the period */
-
-                            ptr1[ strlen(ptr1)-1 ] = '\0';
-
-                            valid = inet_pton(AF_INET6, ptr1,  &(sa.sin_addr));
-
-                            if ( valid == 1 )
-                                {
-
-                                    if ( debug->debugparse_ip )
-                                        {
-                                            Sagan_Log(DEBUG, "[%s:%lu] ** Identified stand alone IPv6 '%s' with trailing period. **", __FUNCTION__, pthread_self(), ptr1 );
-                                        }
-
-                                    memcpy(lookup_cache[current_position].ip, ptr1, MAXIP);
-                                    memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                                    IP2Bit(ptr1, lookup_cache[current_position].ip_bits);
-
-                                    /* This converts ::ffff:192.168.1.1 to regular IPv4 (192.168.1.1) */
-
-                                    if ( config->parse_ip_ipv4_mapped_ipv6 == false )
-                                        {
-
-                                            if ( ptr1[0] == ':' && ptr1[1] == ':' && ( ptr1[2] == 'f' || ptr1[2] == 'F' ) &&
-                                                    ( ptr1[3] == 'f' || ptr1[3] == 'F' ) && ( ptr1[4] == 'f' || ptr1[4] == 'F' ) &&
-                                                    ( ptr1[5] == 'f' || ptr1[5] == 'F' ) && ptr1[6] == ':' )
-                                                {
-
-                                                    b = strlen(ptr1);
-
-                                                    for (i = 7; b > i; i++)
-                                                        {
-                                                            lookup_cache[current_position].ip[i-7] = ptr1[i];
-                                                            lookup_cache[current_position].ip[i-6] = '\0';
-                                                        }
-
-                                                    memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                                                    IP2Bit(ptr1, lookup_cache[current_position].ip_bits);
-
-                                                }
+            /* Handle IPv6 fe80::b614:89ff:fe11:5e24#12345 or inet#fe80::b614:89ff:fe11:5e24 */
 
-                                        }
+            if ( num_hashes == 1 )
+                {
+                    hash = strchr(word, '#');
+                    current_position = Parse_IP_Split(lookup_cache, current_position, word, hash, AF_INET6);
+                    continue;
+                }
 
-                                    lookup_cache[current_position].port = config->sagan_port;
-                                    lookup_cache[current_position].status = 1;
+            if ( num_hashes != 0 )
+                {
+                    continue;
+                }
 
-                                    current_position++;
+            /* Stand alone IPv6 */
 
-                                    if ( current_position > MAX_PARSE_IP )
-                                        {
-                                            break;
-                                        }
+            if ( Parse_IP_Pton(AF_INET6, word, ip_bits) )
+                {
+                    current_position = Parse_IP_Add_IPv6(lookup_cache, current_position, word, ip_bits, Parse_IP_Port_After(p));
+                    continue;
+                }
 
-                                }
+            /* Stand alone IPv6 with trailing period */
 
-                        }
+            if ( word[len-1] == '.' )
+                {
 
-                    /* Handle IPv6 fe80::b614:89ff:fe11:5e24#12345 or inet#fe80::b614:89ff:fe11:5e24 */
+                    word[len-1] = '\0';
 
-                    if ( num_hashes == 1 && num_colons > 2 )
+                    if ( Parse_IP_Pton(AF_INET6, word, ip_bits) )
                         {
-
-                            /* test both sides */
-
-                            ip_1 = strtok_r(ptr1, "#", &ip_2);
-
-                            if ( ip_1 != NULL )
-                                {
-                                    valid = inet_pton(AF_INET6, ip_1,  &(sa.sin_addr));
-                                }
-
-                            if ( valid == 1 )
-                                {
-
-                                    if ( debug->debugparse_ip )
-                                        {
-                                            Sagan_Log(DEBUG, "[%s:%lu] ** Identified IPv6#PORT **", __FUNCTION__, pthread_self() );
-                                        }
-
-
-                                    memcpy(lookup_cache[current_position].ip, ip_1, MAXIP);
-                                    memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                                    IP2Bit(ip_1, lookup_cache[current_position].ip_bits);
-
-                                    /* In many cases, the port is after the : */
-
-                                    port = atoi(ip_2);
-
-                                    if ( port == 0 )
-                                        {
-                                            lookup_cache[current_position].port = config->sagan_port;
-
-                                        }
-                                    else
-                                        {
-
-                                            lookup_cache[current_position].port = port;
-                                        }
-
-                                    lookup_cache[current_position].status = 1;
-                                    current_position++;
-
-                                    /* If we've run to the end, we're done */
-
-                                    if ( current_position > MAX_PARSE_IP )
-                                        {
-                                            break;
-                                        }
-
-                                }
-
-                            if ( ip_2 != NULL )
-                                {
-                                    valid = inet_pton(AF_INET6, ip_2,  &(sa.sin_addr));
-                                }
-
-                            if ( valid == 1 )
-
-                                {
-
-                                    if ( debug->debugparse_ip )
-                                        {
-                                            Sagan_Log(DEBUG, "[%s:%lu] ** Identified INTERFACE#IPv6 **", __FUNCTION__, pthread_self() );
-                                        }
-
-
-                                    memcpy(lookup_cache[current_position].ip, ip_2, MAXIP);
-                                    memset(lookup_cache[current_position].ip_bits, 0, MAXIPBIT);
-                                    IP2Bit(ip_2, lookup_cache[current_position].ip_bits);
-                                    lookup_cache[current_position].port = config->sagan_port;
-                                    lookup_cache[current_position].status = 1;
-
-                                    current_position++;
-
-                                    /* If we've run to the end, we're done */
-
-                                    if ( current_position > MAX_PARSE_IP )
-                                        {
-                                            break;
-                                        }
-
-
-                                }
-
+                            current_position = Parse_IP_Add_IPv6(lookup_cache, current_position, word, ip_bits, config->sagan_port);
                         }
-
-                } /* If config->parse_ip_ipv6 */
-
-            ptr1 = strtok_r(NULL, " ", &ptr2);
+                }
 
         }
 
-    for ( i = 0; i < current_position; i++)
+    for ( i = current_position; i < MAX_PARSE_IP; i++ )
         {
-            lookup_cache[current_position].status = 0;
+            lookup_cache[i].status = false;
         }
 
     if ( debug->debugparse_ip )
@@ -972,7 +505,7 @@ int Parse_IP( char *syslog_message, struct _Sagan_Lookup_Cache_Entry *lookup_cac
             if ( current_position > 0 )
                 {
 
-                    Sagan_Log(DEBUG, "[%lld:%d] --[Lookup Cache Array]----", pthread_self(), current_position );
+                    Sagan_Log(DEBUG, "[%lu:%d] --[Lookup Cache Array]----", pthread_self(), current_position );
 
 
                     for (i = 0; i < current_position; i++)
@@ -989,4 +522,3 @@ int Parse_IP( char *syslog_message, struct _Sagan_Lookup_Cache_Entry *lookup_cac
 
     return(current_position);
 }
-
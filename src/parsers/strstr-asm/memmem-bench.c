@@ -0,0 +1,249 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* memmem-bench.c
+ *
+ * Times each content search kernel in memmem.c against a set of typical
+ * syslog lines.  Every kernel's answer is checked against the generic C
+ * version before it is timed.  Built with "make sagan-memmem-bench",  it
+ * isn't part of the normal build.
+ *
+ * Usage: sagan-memmem-bench [iterations]
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "parsers/strstr-asm/strstr-hook.h"
+
+#define BENCH_DEFAULT_ITERATIONS	200000
+
+typedef char *(*Bench_Func)(const char *, size_t, const char *, size_t);
+
+struct _Bench_Kernel
+{
+    const char *name;
+    Bench_Func func;
+    Bench_Func func_nocase;
+    bool supported;
+};
+
+static const char *Bench_Lines[] =
+{
+    "sshd[2201]: Failed password for invalid user admin from 203.0.113.54 port 51122 ssh2",
+    "sshd[2201]: Accepted publickey for deploy from 198.51.100.7 port 40022 ssh2: RSA SHA256:Xk3nP0aQm1s2Yq4T7v9d0Lr8bE6wF5hJ2cK1uN3zA4o",
+    "postfix/smtpd[11873]: NOQUEUE: reject: RCPT from unknown[192.0.2.33]: 554 5.7.1 Service unavailable; Client host [192.0.2.33] blocked using zen.spamhaus.org; from=<bounce@example.net> to=<info@example.com> proto=ESMTP helo=<mail.example.net>",
+    "kernel: [UFW BLOCK] IN=eth0 OUT= MAC=52:54:00:12:34:56:52:54:00:65:43:21:08:00 SRC=203.0.113.200 DST=192.0.2.10 LEN=60 TOS=0x00 PREC=0x00 TTL=50 ID=54321 DF PROTO=TCP SPT=44321 DPT=23 WINDOW=29200 RES=0x00 SYN URGP=0",
+    "sudo: operator : TTY=pts/1 ; PWD=/home/operator ; USER=root ; COMMAND=/usr/bin/systemctl restart nginx",
+    "nginx: 198.51.100.23 - - [12/Mar/2019:10:15:32 +0000] \"GET /wp-login.php HTTP/1.1\" 404 162 \"-\" \"Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/72.0.3626.121 Safari/537.36\"",
+    "MSWinEventLog\t1\tSecurity\t4625\tAn account failed to log on.  Subject: Security ID: S-1-0-0 Account Name: - Logon Type: 3 Account For Which Logon Failed: Account Name: Administrator Failure Information: Failure Reason: Unknown user name or bad password. Status: 0xC000006D Sub Status: 0xC000006A Source Network Address: 203.0.113.91",
+    "named[892]: client 192.0.2.77#53211 (example.org): query (cache) 'example.org/ANY/IN' denied",
+    "CRON[30211]: (root) CMD (   cd / && run-parts --report /etc/cron.hourly)",
+    "dhcpd: DHCPACK on 10.0.0.143 to 00:11:22:33:44:55 (laptop-17) via eth1",
+    NULL
+};
+
+static const char *Bench_Needles[] =
+{
+    "Failed password",
+    "invalid user",
+    "blocked using",
+    "DPT=23 ",
+    "COMMAND=",
+    "wp-login.php",
+    "Status: 0xC000006D",
+    "denied",
+    "authentication failure",		/* Misses */
+    "segfault at",
+    "Accepted",
+    "root",
+    NULL
+};
+
+static uint64_t Bench_Now( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+/* Runs every needle against every line "iterations" times.  Returns the
+   number of hits so the compiler can't throw the work away */
+
+static uint64_t Bench_Run( Bench_Func func, int iterations, size_t *line_len, size_t *needle_len )
+{
+
+    uint64_t hits = 0;
+    int i;
+    int l;
+    int n;
+
+    for ( i = 0; i < iterations; i++ )
+        {
+            for ( l = 0; Bench_Lines[l] != NULL; l++ )
+                {
+                    for ( n = 0; Bench_Needles[n] != NULL; n++ )
+                        {
+                            if ( func(Bench_Lines[l], line_len[l], Bench_Needles[n], needle_len[n]) != NULL )
+                                {
+                                    hits++;
+                                }
+                        }
+                }
+        }
+
+    return(hits);
+}
+
+/* Makes sure "func" finds the same offsets as "reference" */
+
+static bool Bench_Verify( Bench_Func func, Bench_Func reference, size_t *line_len, size_t *needle_len )
+{
+
+    int l;
+    int n;
+
+    for ( l = 0; Bench_Lines[l] != NULL; l++ )
+        {
+            for ( n = 0; Bench_Needles[n] != NULL; n++ )
+                {
+                    if ( func(Bench_Lines[l], line_len[l], Bench_Needles[n], needle_len[n]) !=
+                            reference(Bench_Lines[l], line_len[l], Bench_Needles[n], needle_len[n]) )
+                        {
+                            fprintf(stderr, "Mismatch on line %d,  needle \"%s\"\n", l, Bench_Needles[n]);
+                            return(false);
+                        }
+                }
+        }
+
+    return(true);
+}
+
+int main( int argc, char **argv )
+{
+
+    struct _Bench_Kernel kernels[] =
+    {
+        { "generic", Sagan_memmem_generic, Sagan_memmem_nocase_generic, true },
+#ifdef HAVE_TARGET_AVX2
+        { "avx2", Sagan_memmem_avx2, Sagan_memmem_nocase_avx2, false },
+#endif
+#ifdef HAVE_TARGET_AVX512BW
+        { "avx512bw", Sagan_memmem_avx512, Sagan_memmem_nocase_avx512, false },
+#endif
+        { NULL, NULL, NULL, false }
+    };
+
+    size_t line_len[64] = { 0 };
+    size_t needle_len[64] = { 0 };
+    uint64_t searches = 0;
+    uint64_t start;
+    uint64_t hits;
+    uint64_t nsec;
+
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    int lines;
+    int needles;
+    int k;
+
+    if ( argc > 1 )
+        {
+            iterations = atoi(argv[1]);
+        }
+
+    for ( lines = 0; Bench_Lines[lines] != NULL; lines++ )
+        {
+            line_len[lines] = strlen(Bench_Lines[lines]);
+        }
+
+    for ( needles = 0; Bench_Needles[needles] != NULL; needles++ )
+        {
+            needle_len[needles] = strlen(Bench_Needles[needles]);
+        }
+
+    searches = (uint64_t)iterations * lines * needles;
+
+#if defined(HAVE_TARGET_AVX2) || defined(HAVE_TARGET_AVX512BW)
+    __builtin_cpu_init();
+#endif
+
+    for ( k = 0; kernels[k].name != NULL; k++ )
+        {
+#ifdef HAVE_TARGET_AVX2
+            if ( !strcmp(kernels[k].name, "avx2") )
+                {
+                    kernels[k].supported = __builtin_cpu_supports("avx2");
+                }
+#endif
+#ifdef HAVE_TARGET_AVX512BW
+            if ( !strcmp(kernels[k].name, "avx512bw") )
+                {
+                    kernels[k].supported = __builtin_cpu_supports("avx512bw");
+                }
+#endif
+        }
+
+    printf("Startup would select: %s\n", Sagan_memmem_Init());
+    printf("%d lines x %d needles x %d iterations = %" PRIu64 " searches per run\n\n", lines, needles, iterations, searches);
+    printf("%-10s %14s %18s\n", "kernel", "ns/search", "nocase ns/search");
+
+    for ( k = 0; kernels[k].name != NULL; k++ )
+        {
+
+            if ( kernels[k].supported == false )
+                {
+                    printf("%-10s %14s %18s\n", kernels[k].name, "unsupported", "unsupported");
+                    continue;
+                }
+
+            if ( Bench_Verify(kernels[k].func, Sagan_memmem_generic, line_len, needle_len) == false ||
+                    Bench_Verify(kernels[k].func_nocase, Sagan_memmem_nocase_generic, line_len, needle_len) == false )
+                {
+                    fprintf(stderr, "%s gives different results than generic!\n", kernels[k].name);
+                    return(1);
+                }
+
+            start = Bench_Now();
+            hits = Bench_Run(kernels[k].func, iterations, line_len, needle_len);
+            nsec = Bench_Now() - start;
+
+            printf("%-10s %14.2f", kernels[k].name, (double)nsec / searches);
+
+            start = Bench_Now();
+            hits += Bench_Run(kernels[k].func_nocase, iterations, line_len, needle_len);
+            nsec = Bench_Now() - start;
+
+            printf(" %18.2f   (%" PRIu64 " hits)\n", (double)nsec / searches, hits);
+        }
+
+    return(0);
+}
@@ -0,0 +1,528 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* memmem.c
+ *
+ * Known length substring search used by content/meta_content.  There is
+ * a plain C version plus AVX2 and AVX-512BW kernels.  The kernels are
+ * built with target attributes, so the rest of Sagan doesn't need any
+ * special compiler flags.  Sagan_memmem_Init() picks the widest one the
+ * CPU supports at startup (cpuid through __builtin_cpu_supports()).
+ *
+ * The SIMD kernels compare the first and last byte of the needle against
+ * 32 (or 64) haystack positions at once.  Only the positions where both
+ * match are compared in full.  The case insensitive kernels fold A-Z to
+ * lower case in the registers, so the haystack is never copied.
+ *
+ * This file only depends on libc so the "sagan-memmem-bench" program can
+ * link it on its own.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if defined(HAVE_TARGET_AVX2) || defined(HAVE_TARGET_AVX512BW)
+#include <immintrin.h>
+#endif
+
+#include "parsers/strstr-asm/strstr-hook.h"
+
+static char *(*Sagan_memmem_Func)(const char *, size_t, const char *, size_t) = Sagan_memmem_generic;
+static char *(*Sagan_memmem_nocase_Func)(const char *, size_t, const char *, size_t) = Sagan_memmem_nocase_generic;
+static const char *Sagan_memmem_Name = "generic";
+
+static inline unsigned char Sagan_Fold( unsigned char c )
+{
+    return( c >= 'A' && c <= 'Z' ? c + ( 'a' - 'A' ) : c );
+}
+
+/* Case insensitive compare of "len" bytes */
+
+static inline bool Sagan_Fold_Equal( const char *a, const char *b, size_t len )
+{
+
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+        {
+            if ( Sagan_Fold( (unsigned char)a[i] ) != Sagan_Fold( (unsigned char)b[i] ) )
+                {
+                    return(false);
+                }
+        }
+
+    return(true);
+}
+
+/****************************************************************************
+ * Sagan_memmem - Finds "needle" within the first "haystack_len" bytes of
+ * "haystack".  Neither needs to be NULL terminated,  so rule "offset",
+ * "depth",  etc. can be searched as a window of the original message.
+ ****************************************************************************/
+
+char *Sagan_memmem(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    return( Sagan_memmem_Func(haystack, haystack_len, needle, needle_len) );
+}
+
+/****************************************************************************
+ * Sagan_memmem_nocase - Like Sagan_memmem() but ASCII case insensitive.
+ ****************************************************************************/
+
+char *Sagan_memmem_nocase(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    return( Sagan_memmem_nocase_Func(haystack, haystack_len, needle, needle_len) );
+}
+
+/****************************************************************************
+ * Sagan_memmem_Window - The part of a "len" byte message a content or
+ * meta_content is searched in,  after offset/depth/distance/within.
+ * "start"/"window" are a slice of the original message,  so nothing needs
+ * to be copied.  The arithmetic is what the old copies in Sagan_Engine()
+ * did (depth keeps depth + 1 bytes,  distance is counted from the previous
+ * depth).  A distance past the end of the message leaves nothing to
+ * search.  "sagan-window-check" compares it against the old copies.
+ ****************************************************************************/
+
+void Sagan_memmem_Window( size_t len, int offset, int depth, int prev_depth, int distance, int within, size_t *start, size_t *window )
+{
+
+    long from = 0;
+
+    *start = 0;
+    *window = len;
+
+    if ( offset != 0 )
+        {
+            *start = len > (size_t)offset ? (size_t)offset : len;
+            *window = len - *start;
+        }
+
+    if ( depth != 0 && (size_t)depth + 1 < *window )
+        {
+            *window = (size_t)depth + 1;
+        }
+
+    if ( distance != 0 )
+        {
+
+            from = (long)prev_depth + distance + 1;
+
+            if ( from < 0 || (size_t)from > len )
+                {
+                    from = len;
+                }
+
+            *start = from;
+            *window = len - from;
+
+            if ( within != 0 && (size_t)within < *window )
+                {
+                    *window = within;
+                }
+        }
+}
+
+/****************************************************************************
+ * Sagan_memmem_Init - Selects the search kernels for this CPU and returns
+ * the name of the ones picked.
+ ****************************************************************************/
+
+const char *Sagan_memmem_Init( void )
+{
+
+#if defined(HAVE_TARGET_AVX2) || defined(HAVE_TARGET_AVX512BW)
+    __builtin_cpu_init();
+#endif
+
+#ifdef HAVE_TARGET_AVX512BW
+
+    if ( __builtin_cpu_supports("avx512bw") )
+        {
+            Sagan_memmem_Func = Sagan_memmem_avx512;
+            Sagan_memmem_nocase_Func = Sagan_memmem_nocase_avx512;
+            Sagan_memmem_Name = "avx512bw";
+            return(Sagan_memmem_Name);
+        }
+
+#endif
+
+#ifdef HAVE_TARGET_AVX2
+
+    if ( __builtin_cpu_supports("avx2") )
+        {
+            Sagan_memmem_Func = Sagan_memmem_avx2;
+            Sagan_memmem_nocase_Func = Sagan_memmem_nocase_avx2;
+            Sagan_memmem_Name = "avx2";
+            return(Sagan_memmem_Name);
+        }
+
+#endif
+
+    return(Sagan_memmem_Name);
+}
+
+/****************************************************************************
+ * Sagan_memmem_Kernel - Name of the kernels in use
+ ****************************************************************************/
+
+const char *Sagan_memmem_Kernel( void )
+{
+    return(Sagan_memmem_Name);
+}
+
+/****************************************************************************
+ * Plain C versions.  Also used by the SIMD kernels for the last few
+ * positions that don't fill a register.
+ ****************************************************************************/
+
+char *Sagan_memmem_generic(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+
+    if ( needle_len == 0 )
+        {
+            return( (char *)haystack );
+        }
+
+    if ( needle_len > haystack_len )
+        {
+            return(NULL);
+        }
+
+#ifdef HAVE_MEMMEM
+
+    return( memmem(haystack, haystack_len, needle, needle_len) );
+
+#else
+
+    const char *p = haystack;
+    const char *last = haystack + ( haystack_len - needle_len );
+
+    while ( p <= last )
+        {
+
+            p = memchr(p, needle[0], ( last - p ) + 1);
+
+            if ( p == NULL )
+                {
+                    return(NULL);
+                }
+
+            if ( memcmp(p + 1, needle + 1, needle_len - 1) == 0 )
+                {
+                    return( (char *)p );
+                }
+
+            p++;
+        }
+
+    return(NULL);
+
+#endif
+
+}
+
+char *Sagan_memmem_nocase_generic(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+
+    unsigned char first;
+    size_t i;
+
+    if ( needle_len == 0 )
+        {
+            return( (char *)haystack );
+        }
+
+    if ( needle_len > haystack_len )
+        {
+            return(NULL);
+        }
+
+    first = Sagan_Fold( (unsigned char)needle[0] );
+
+    for ( i = 0; i <= haystack_len - needle_len; i++ )
+        {
+
+            if ( Sagan_Fold( (unsigned char)haystack[i] ) == first &&
+                    Sagan_Fold_Equal(haystack + i + 1, needle + 1, needle_len - 1) )
+                {
+                    return( (char *)haystack + i );
+                }
+        }
+
+    return(NULL);
+}
+
+#ifdef HAVE_TARGET_AVX2
+
+/****************************************************************************
+ * AVX2 - 32 positions per step
+ ****************************************************************************/
+
+__attribute__((target("avx2")))
+static inline __m256i Sagan_Fold_avx2( __m256i v )
+{
+
+    __m256i upper = _mm256_and_si256( _mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v) );
+
+    return( _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20))) );
+}
+
+__attribute__((target("avx2")))
+char *Sagan_memmem_avx2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+
+    __m256i first;
+    __m256i last;
+    uint32_t mask;
+    size_t positions;
+    size_t i = 0;
+    int bit;
+
+    if ( needle_len < 2 || needle_len > haystack_len )
+        {
+            return( Sagan_memmem_generic(haystack, haystack_len, needle, needle_len) );
+        }
+
+    first = _mm256_set1_epi8(needle[0]);
+    last = _mm256_set1_epi8(needle[needle_len - 1]);
+    positions = haystack_len - needle_len + 1;
+
+    /* Short haystacks don't fill a register */
+
+    if ( positions < 32 )
+        {
+            return( Sagan_memmem_generic(haystack, haystack_len, needle, needle_len) );
+        }
+
+    /* The last step is moved back so it ends on the last position.  It
+       overlaps positions that already didn't match,  so the first hit in
+       it is still the first in the haystack */
+
+    for ( ;; )
+        {
+
+            mask = _mm256_movemask_epi8( _mm256_and_si256(
+                                             _mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i *)(haystack + i))),
+                                             _mm256_cmpeq_epi8(last, _mm256_loadu_si256((const __m256i *)(haystack + i + needle_len - 1))) ) );
+
+            while ( mask != 0 )
+                {
+
+                    bit = __builtin_ctz(mask);
+
+                    if ( memcmp(haystack + i + bit + 1, needle + 1, needle_len - 2) == 0 )
+                        {
+                            return( (char *)haystack + i + bit );
+                        }
+
+                    mask &= mask - 1;
+                }
+
+            if ( i == positions - 32 )
+                {
+                    return(NULL);
+                }
+
+            i = i + 32 < positions - 32 ? i + 32 : positions - 32;
+        }
+}
+
+__attribute__((target("avx2")))
+char *Sagan_memmem_nocase_avx2(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+
+    __m256i first;
+    __m256i last;
+    uint32_t mask;
+    size_t positions;
+    size_t i = 0;
+    int bit;
+
+    if ( needle_len < 2 || needle_len > haystack_len )
+        {
+            return( Sagan_memmem_nocase_generic(haystack, haystack_len, needle, needle_len) );
+        }
+
+    first = _mm256_set1_epi8( Sagan_Fold( (unsigned char)needle[0] ) );
+    last = _mm256_set1_epi8( Sagan_Fold( (unsigned char)needle[needle_len - 1] ) );
+    positions = haystack_len - needle_len + 1;
+
+    /* Short haystacks don't fill a register */
+
+    if ( positions < 32 )
+        {
+            return( Sagan_memmem_nocase_generic(haystack, haystack_len, needle, needle_len) );
+        }
+
+    /* The last step is moved back so it ends on the last position.  It
+       overlaps positions that already didn't match,  so the first hit in
+       it is still the first in the haystack */
+
+    for ( ;; )
+        {
+
+            mask = _mm256_movemask_epi8( _mm256_and_si256(
+                                             _mm256_cmpeq_epi8(first, Sagan_Fold_avx2(_mm256_loadu_si256((const __m256i *)(haystack + i)))),
+                                             _mm256_cmpeq_epi8(last, Sagan_Fold_avx2(_mm256_loadu_si256((const __m256i *)(haystack + i + needle_len - 1)))) ) );
+
+            while ( mask != 0 )
+                {
+
+                    bit = __builtin_ctz(mask);
+
+                    if ( Sagan_Fold_Equal(haystack + i + bit + 1, needle + 1, needle_len - 2) )
+                        {
+                            return( (char *)haystack + i + bit );
+                        }
+
+                    mask &= mask - 1;
+                }
+
+            if ( i == positions - 32 )
+                {
+                    return(NULL);
+                }
+
+            i = i + 32 < positions - 32 ? i + 32 : positions - 32;
+        }
+}
+
+#endif
+
+#ifdef HAVE_TARGET_AVX512BW
+
+/****************************************************************************
+ * AVX-512BW - 64 positions per step
+ ****************************************************************************/
+
+__attribute__((target("avx512bw")))
+static inline __m512i Sagan_Fold_avx512( __m512i v )
+{
+
+    __mmask64 upper = _mm512_cmple_epu8_mask( _mm512_sub_epi8(v, _mm512_set1_epi8('A')), _mm512_set1_epi8('Z' - 'A') );
+
+    return( _mm512_mask_add_epi8(v, upper, v, _mm512_set1_epi8(0x20)) );
+}
+
+__attribute__((target("avx512bw")))
+char *Sagan_memmem_avx512(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+
+    __m512i first;
+    __m512i last;
+    __mmask64 lanes;
+    __mmask64 mask;
+    size_t positions;
+    size_t i = 0;
+    int bit;
+
+    if ( needle_len < 2 || needle_len > haystack_len )
+        {
+            return( Sagan_memmem_generic(haystack, haystack_len, needle, needle_len) );
+        }
+
+    first = _mm512_set1_epi8(needle[0]);
+    last = _mm512_set1_epi8(needle[needle_len - 1]);
+    positions = haystack_len - needle_len + 1;
+
+    /* The last step only loads the lanes that are left,  so nothing past
+       the end of the haystack is read */
+
+    for ( i = 0; i < positions; i += 64 )
+        {
+
+            lanes = positions - i >= 64 ? ~(__mmask64)0 : ( (__mmask64)1 << ( positions - i ) ) - 1;
+
+            mask = _mm512_mask_cmpeq_epi8_mask(lanes, first, _mm512_maskz_loadu_epi8(lanes, haystack + i)) &
+                   _mm512_mask_cmpeq_epi8_mask(lanes, last, _mm512_maskz_loadu_epi8(lanes, haystack + i + needle_len - 1));
+
+            while ( mask != 0 )
+                {
+
+                    bit = __builtin_ctzll(mask);
+
+                    if ( memcmp(haystack + i + bit + 1, needle + 1, needle_len - 2) == 0 )
+                        {
+                            return( (char *)haystack + i + bit );
+                        }
+
+                    mask &= mask - 1;
+                }
+        }
+
+    return(NULL);
+}
+
+__attribute__((target("avx512bw")))
+char *Sagan_memmem_nocase_avx512(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+
+    __m512i first;
+    __m512i last;
+    __mmask64 lanes;
+    __mmask64 mask;
+    size_t positions;
+    size_t i = 0;
+    int bit;
+
+    if ( needle_len < 2 || needle_len > haystack_len )
+        {
+            return( Sagan_memmem_nocase_generic(haystack, haystack_len, needle, needle_len) );
+        }
+
+    first = _mm512_set1_epi8( Sagan_Fold( (unsigned char)needle[0] ) );
+    last = _mm512_set1_epi8( Sagan_Fold( (unsigned char)needle[needle_len - 1] ) );
+    positions = haystack_len - needle_len + 1;
+
+    for ( i = 0; i < positions; i += 64 )
+        {
+
+            lanes = positions - i >= 64 ? ~(__mmask64)0 : ( (__mmask64)1 << ( positions - i ) ) - 1;
+
+            mask = _mm512_mask_cmpeq_epi8_mask(lanes, first, Sagan_Fold_avx512(_mm512_maskz_loadu_epi8(lanes, haystack + i))) &
+                   _mm512_mask_cmpeq_epi8_mask(lanes, last, Sagan_Fold_avx512(_mm512_maskz_loadu_epi8(lanes, haystack + i + needle_len - 1)));
+
+            while ( mask != 0 )
+                {
+
+                    bit = __builtin_ctzll(mask);
+
+                    if ( Sagan_Fold_Equal(haystack + i + bit + 1, needle + 1, needle_len - 2) )
+                        {
+                            return( (char *)haystack + i + bit );
+                        }
+
+                    mask &= mask - 1;
+                }
+        }
+
+    return(NULL);
+}
+
+#endif
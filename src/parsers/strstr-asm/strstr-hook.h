@@ -45,3 +45,24 @@ int __strstr_sse42();
 char *Sagan_strstr(const char *, const char *);
 char *Sagan_stristr(const char *, const char *, bool);
 
+/* memmem.c */
+
+char *Sagan_memmem(const char *, size_t, const char *, size_t);
+char *Sagan_memmem_nocase(const char *, size_t, const char *, size_t);
+void Sagan_memmem_Window( size_t, int, int, int, int, int, size_t *, size_t * );
+const char *Sagan_memmem_Init( void );
+const char *Sagan_memmem_Kernel( void );
+
+char *Sagan_memmem_generic(const char *, size_t, const char *, size_t);
+char *Sagan_memmem_nocase_generic(const char *, size_t, const char *, size_t);
+
+#ifdef HAVE_TARGET_AVX2
+char *Sagan_memmem_avx2(const char *, size_t, const char *, size_t);
+char *Sagan_memmem_nocase_avx2(const char *, size_t, const char *, size_t);
+#endif
+
+#ifdef HAVE_TARGET_AVX512BW
+char *Sagan_memmem_avx512(const char *, size_t, const char *, size_t);
+char *Sagan_memmem_nocase_avx512(const char *, size_t, const char *, size_t);
+#endif
+
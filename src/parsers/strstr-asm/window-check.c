@@ -0,0 +1,382 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* window-check.c
+ *
+ * Checks Sagan_memmem_Window() plus Sagan_memmem()/Sagan_memmem_nocase()
+ * against the copy based content/meta_content code Sagan_Engine() used
+ * before.  That code is kept below as Window_Check_Old().  Every case in
+ * Window_Cases[] is run first,  then "iterations" random
+ * message/content/offset/depth/distance/within combinations.  Any
+ * difference in the window or in the search result is printed and the
+ * exit status is 1.  Built with "make sagan-window-check",  it isn't part
+ * of the normal build.
+ *
+ * Usage: sagan-window-check [iterations] [seed]
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "parsers/strstr-asm/strstr-hook.h"
+
+#define WINDOW_CHECK_DEFAULT_ITERATIONS	1000000
+#define WINDOW_CHECK_MAX_MSG		1024
+
+#ifndef HAVE_STRLCPY
+size_t strlcpy(char *, const char *, size_t);
+#endif
+
+struct _Window_Case
+{
+    const char *message;
+    const char *content;
+    bool nocase;
+    int offset;
+    int depth;
+    int prev_depth;		/* s_depth[z-1],  only used with distance */
+    int distance;
+    int within;
+};
+
+/* Edge cases around each modifier.  The old code is undefined when
+   distance lands past the end of the message,  so there are none of
+   those here (Sagan_memmem_Window() searches nothing for them). */
+
+static const struct _Window_Case Window_Cases[] =
+{
+    { "sshd[2201]: Failed password for root", "Failed", false, 0, 0, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "failed", true, 0, 0, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "failed", false, 0, 0, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 0, 0, 0, 0, 0 },
+
+    /* offset */
+
+    { "sshd[2201]: Failed password for root", "Failed", false, 12, 0, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "Failed", false, 13, 0, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 32, 0, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 33, 0, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "t", false, 35, 0, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "t", false, 36, 0, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "t", false, 500, 0, 0, 0, 0 },
+
+    /* depth keeps depth + 1 bytes */
+
+    { "sshd[2201]: Failed password for root", "sshd", false, 0, 2, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "sshd", false, 0, 3, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "Failed", false, 0, 16, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "Failed", false, 0, 17, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 0, 35, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 0, 36, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 0, 1000, 0, 0, 0 },
+
+    /* offset + depth */
+
+    { "sshd[2201]: Failed password for root", "Failed", false, 12, 4, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "Failed", false, 12, 5, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "FAILED", true, 12, 5, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 30, 5, 0, 0, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 40, 5, 0, 0, 0 },
+
+    /* distance is counted from the previous content's depth */
+
+    { "sshd[2201]: Failed password for root", "password", false, 0, 0, 10, 1, 0 },
+    { "sshd[2201]: Failed password for root", "password", false, 0, 0, 10, 8, 0 },
+    { "sshd[2201]: Failed password for root", "password", false, 0, 0, 10, 9, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 0, 0, 0, 31, 0 },
+    { "sshd[2201]: Failed password for root", "root", false, 0, 0, 0, 32, 0 },
+    { "sshd[2201]: Failed password for root", "t", false, 0, 0, 30, 5, 0 },
+    { "sshd[2201]: Failed password for root", "t", false, 0, 0, 28, 6, 0 },
+    { "sshd[2201]: Failed password for root", "password", false, 0, 0, 0, 19, 0 },
+    { "sshd[2201]: Failed password for root", "sshd", false, 0, 0, 0, 1, 0 },
+
+    /* distance replaces offset/depth */
+
+    { "sshd[2201]: Failed password for root", "root", false, 20, 3, 10, 5, 0 },
+    { "sshd[2201]: Failed password for root", "sshd", false, 0, 40, 10, 5, 0 },
+
+    /* within */
+
+    { "sshd[2201]: Failed password for root", "password", false, 0, 0, 10, 8, 8 },
+    { "sshd[2201]: Failed password for root", "password", false, 0, 0, 10, 8, 9 },
+    { "sshd[2201]: Failed password for root", "password", false, 0, 0, 10, 8, 10 },
+    { "sshd[2201]: Failed password for root", "PASSWORD", true, 0, 0, 10, 8, 9 },
+    { "sshd[2201]: Failed password for root", "root", false, 0, 0, 20, 11, 4 },
+    { "sshd[2201]: Failed password for root", "root", false, 0, 0, 20, 11, 3 },
+    { "sshd[2201]: Failed password for root", "root", false, 0, 0, 20, 11, 100 },
+
+    /* within without distance is ignored */
+
+    { "sshd[2201]: Failed password for root", "root", false, 0, 0, 0, 0, 2 },
+
+    /* Short and empty messages */
+
+    { "a", "a", false, 0, 0, 0, 0, 0 },
+    { "a", "a", false, 1, 0, 0, 0, 0 },
+    { "a", "a", false, 0, 1, 0, 0, 0 },
+    { "ab", "b", false, 0, 0, 0, 1, 0 },
+    { "ab", "b", false, 0, 0, 0, 0, 0 },
+    { "", "a", false, 0, 0, 0, 0, 0 },
+    { "", "a", false, 3, 2, 0, 0, 0 },
+
+    { NULL, NULL, false, 0, 0, 0, 0, 0 }
+};
+
+/* What Sagan_Engine() used to do: copy the window out with strlcpy()
+   and run a NUL terminated search over the copy.  "copy" gets the window
+   so it can be compared too. */
+
+static bool Window_Check_Old( const char *message, const struct _Window_Case *c, char *copy, size_t copy_size )
+{
+
+    char lower[WINDOW_CHECK_MAX_MSG] = { 0 };
+
+    int len = strlen(message);
+    int alter_num = 0;
+    int i;
+
+    /* OFFSET */
+
+    if ( c->offset != 0 )
+        {
+
+            if ( len > c->offset )
+                {
+                    alter_num = len - c->offset;
+                    strlcpy(copy, message + (len - alter_num), alter_num + 1);
+                }
+            else
+                {
+                    copy[0] = '\0';
+                }
+
+        }
+    else
+        {
+            strlcpy(copy, message, copy_size);
+        }
+
+    /* DEPTH */
+
+    if ( c->depth != 0 )
+        {
+            strlcpy(lower, copy, c->depth + 2);
+            strlcpy(copy, lower, copy_size);
+        }
+
+    /* DISTANCE */
+
+    if ( c->distance != 0 )
+        {
+
+            alter_num = len - ( c->prev_depth + c->distance + 1 );
+            strlcpy(copy, message + (len - alter_num), alter_num + 1);
+
+            /* WITHIN */
+
+            if ( c->within != 0 )
+                {
+                    strlcpy(lower, copy, c->within + 1);
+                    strlcpy(copy, lower, copy_size);
+                }
+
+        }
+
+    /* Sagan_stristr() lowercased the haystack only,  nocase contents are
+       lowercased when the rules load */
+
+    if ( c->nocase == true )
+        {
+
+            for ( i = 0; copy[i] != '\0'; i++ )
+                {
+                    lower[i] = tolower((unsigned char)copy[i]);
+                }
+
+            lower[i] = '\0';
+
+            return( strstr(lower, c->content) != NULL );
+        }
+
+    return( strstr(copy, c->content) != NULL );
+}
+
+/* Same case through Sagan_memmem_Window() and the in place search.
+   Returns false and prints the case if anything differs. */
+
+static bool Window_Check_Case( const struct _Window_Case *c, const char *label, unsigned long n )
+{
+
+    char copy[WINDOW_CHECK_MAX_MSG] = { 0 };
+    char content[WINDOW_CHECK_MAX_MSG] = { 0 };
+
+    struct _Window_Case old = *c;
+
+    size_t len = strlen(c->message);
+    size_t start = 0;
+    size_t window = 0;
+    bool old_found;
+    bool new_found;
+    int i;
+
+    /* Rules store nocase contents lowercased */
+
+    strlcpy(content, c->content, sizeof(content));
+
+    if ( c->nocase == true )
+        {
+            for ( i = 0; content[i] != '\0'; i++ )
+                {
+                    content[i] = tolower((unsigned char)content[i]);
+                }
+        }
+
+    old.content = content;
+
+    old_found = Window_Check_Old(c->message, &old, copy, sizeof(copy));
+
+    Sagan_memmem_Window(len, c->offset, c->depth, c->prev_depth, c->distance, c->within, &start, &window);
+
+    if ( c->nocase == true )
+        {
+            new_found = Sagan_memmem_nocase(c->message + start, window, content, strlen(content)) != NULL;
+        }
+    else
+        {
+            new_found = Sagan_memmem(c->message + start, window, content, strlen(content)) != NULL;
+        }
+
+    if ( start + window > len || strlen(copy) != window || memcmp(copy, c->message + start, window) ||
+            old_found != new_found )
+        {
+            fprintf(stderr, "%s %lu: message \"%s\" content \"%s\" nocase %d offset %d depth %d prev_depth %d distance %d within %d\n",
+                    label, n, c->message, c->content, c->nocase, c->offset, c->depth, c->prev_depth, c->distance, c->within);
+            fprintf(stderr, "    old window \"%s\" found %d,  new window \"%.*s\" found %d\n",
+                    copy, old_found, (int)window, c->message + start, new_found);
+            return(false);
+        }
+
+    return(true);
+}
+
+/* Small alphabet so random contents actually match now and then */
+
+static void Window_Check_Random_String( char *str, int len )
+{
+
+    static const char alphabet[] = "abAB :[]1";
+    int i;
+
+    for ( i = 0; i < len; i++ )
+        {
+            str[i] = alphabet[rand() % ( sizeof(alphabet) - 1 )];
+        }
+
+    str[len] = '\0';
+}
+
+int main( int argc, char **argv )
+{
+
+    char message[WINDOW_CHECK_MAX_MSG] = { 0 };
+    char content[16] = { 0 };
+
+    struct _Window_Case c;
+
+    unsigned long iterations = WINDOW_CHECK_DEFAULT_ITERATIONS;
+    unsigned long skipped = 0;
+    unsigned long failed = 0;
+    unsigned long n;
+    unsigned int seed = 1;
+    int len;
+    int i;
+
+    if ( argc > 1 )
+        {
+            iterations = strtoul(argv[1], NULL, 10);
+        }
+
+    if ( argc > 2 )
+        {
+            seed = strtoul(argv[2], NULL, 10);
+        }
+
+    printf("Search kernel: %s\n", Sagan_memmem_Init());
+
+    for ( i = 0; Window_Cases[i].message != NULL; i++ )
+        {
+            if ( Window_Check_Case(&Window_Cases[i], "case", i) == false )
+                {
+                    failed++;
+                }
+        }
+
+    printf("%d table cases,  %lu failed\n", i, failed);
+
+    srand(seed);
+
+    for ( n = 0; n < iterations; n++ )
+        {
+
+            len = rand() % 64;
+            Window_Check_Random_String(message, len);
+            Window_Check_Random_String(content, 1 + rand() % 3);
+
+            c.message = message;
+            c.content = content;
+            c.nocase = rand() % 2;
+            c.offset = rand() % 3 ? 0 : rand() % 70;
+            c.depth = rand() % 3 ? 0 : rand() % 70;
+            c.prev_depth = rand() % 70;
+            c.distance = rand() % 2 ? 0 : 1 + rand() % 70;
+            c.within = rand() % 2 ? 0 : rand() % 70;
+
+            /* The old code is undefined when distance goes past the end */
+
+            if ( c.distance != 0 && c.prev_depth + c.distance + 1 > len )
+                {
+                    skipped++;
+                    continue;
+                }
+
+            if ( Window_Check_Case(&c, "random", n) == false )
+                {
+                    failed++;
+
+                    if ( failed > 20 )
+                        {
+                            break;
+                        }
+                }
+        }
+
+    printf("%lu random cases (seed %u,  %lu skipped),  %lu failed in total\n", n, seed, skipped, failed);
+
+    return( failed == 0 ? 0 : 1 );
+}
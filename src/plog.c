@@ -49,6 +49,7 @@
 #include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <pthread.h>
 
 #ifdef HAVE_SYS_PRCTL_H
 #include <sys/prctl.h>
@@ -59,6 +60,10 @@
 #include "sagan-config.h"
 #include "signal-handler.h"
 #include "lockfile.h"
+#include "input-reactor.h"
+#include "util-mpmc.h"
+#include "output-queue.h"
+#include "util-writer.h"
 #include "plog.h"
 
 struct _SaganDebug *debug;
@@ -93,7 +98,7 @@ void Plog_Handler( void )
     Sagan_Log(NORMAL, "Initalizing Sagan syslog sniffer thread (PLOG)");
     Sagan_Log(NORMAL, "Interface: %s", iface);
     Sagan_Log(NORMAL, "Packet filter: \"%s\"", config->plog_filter);
-    Sagan_Log(NORMAL, "Log device: %s", config->plog_logdev);
+    Sagan_Log(NORMAL, "Log device: %s", config->plog_direct ? "none (direct)" : config->plog_logdev);
 
     if ( config->plog_promiscuous )
         {
@@ -127,6 +132,24 @@ void Plog_Handler( void )
             Sagan_Log(ERROR, "[%s, line %d] Cannot install filter in %s: %s", __FILE__, __LINE__, iface, eb);
         }
 
+    /* "direct" hands packets to the processors (input-reactor.c).  A batch
+       is published after every buffer pcap hands us,  so nothing waits
+       on the next packet */
+
+    if ( config->plog_direct )
+        {
+
+            while ( pcap_dispatch(bp, -1, logpkt, NULL) >= 0 )
+                {
+                    Sagan_Input_Flush();
+                }
+
+            pcap_close(bp);
+            Output_Queue_Drain();
+            Sagan_Writer_Flush_All();
+            exit(0);
+        }
+
     /* wireup /dev/log; we can't use openlog() because these are going to be raw inputs */
 
     if(wiredevlog(config))
@@ -140,6 +163,8 @@ void Plog_Handler( void )
     (void)pcap_loop(bp,-1,logpkt, NULL);
 
     pcap_close(bp);
+    Output_Queue_Drain();
+    Sagan_Writer_Flush_All();
     exit(0);
 }
 
@@ -199,6 +224,18 @@ logpkt(u_char *pass_args,const struct pcap_pkthdr *p,const u_char *pkt)
             l = (char *)u + sizeof(struct udphdr);
             len = ntohs(u->uh_ulen) - sizeof(struct udphdr);
 
+            /* Don't read past what was captured */
+
+            if ( l + len > (const char *)pkt + p->caplen )
+                {
+                    len = (const char *)pkt + p->caplen - l;
+                }
+
+            if ( len <= 0 )
+                {
+                    goto bad;
+                }
+
             if(debug->debugplog)
                 {
 
@@ -222,6 +259,12 @@ logpkt(u_char *pass_args,const struct pcap_pkthdr *p,const u_char *pkt)
                 }
 
 
+            if ( config->plog_direct )
+                {
+                    Sagan_Input_Plog(l, len, &ih->ip_src);
+                    return;
+                }
+
             /* send it! */
             if(send(outf,l,len,0) < 0)
                 {
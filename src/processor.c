@@ -43,7 +43,10 @@
 #include "ignore-list.h"
 #include "sagan-config.h"
 #include "input-pipe.h"
+#include "input-syslog.h"
 #include "parsers/parsers.h"
+#include "util-mpmc.h"
+#include "util-ring.h"
 
 #ifdef HAVE_LIBFASTJSON
 #include "input-json.h"
@@ -56,14 +59,17 @@
 #include "processors/dynamic-rules.h"
 #include "processors/client-stats.h"
 
+#ifdef WITH_BLUEDOT
+#include "processors/bluedot.h"
+#endif
+
 struct _SaganCounters *counters;
 struct _Sagan_Proc_Syslog *SaganProcSyslog;
-struct _Sagan_Pass_Syslog *SaganPassSyslog;
+struct _Sagan_Ring *SaganRing;
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
 
 
-int proc_msgslot; 		/* Comes from sagan.c */
 int proc_running;   	        /* Comes from sagan.c */
 
 bool dynamic_rule_flag = NORMAL_RULE;
@@ -72,10 +78,6 @@ uint32_t dynamic_line_count = 0;
 
 bool death=false;
 
-pthread_cond_t SaganProcDoWork;
-pthread_mutex_t SaganProcWorkMutex;
-
-pthread_cond_t SaganReloadCond;
 pthread_mutex_t SaganReloadMutex;
 
 pthread_mutex_t SaganDynamicFlag;
@@ -100,67 +102,75 @@ void Processor ( void )
     memset(SaganProcSyslog_LOCAL, 0, sizeof(struct _Sagan_Proc_Syslog));
 
 
-    struct _Sagan_Pass_Syslog *SaganPassSyslog_LOCAL = NULL;
-    SaganPassSyslog_LOCAL = malloc(sizeof(struct _Sagan_Pass_Syslog));
-
-    if ( SaganPassSyslog_LOCAL == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganPassSyslog_LOCAL. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(SaganPassSyslog_LOCAL, 0, sizeof(struct _Sagan_Pass_Syslog));
+    struct _Sagan_Ring_Slot *slot = NULL;
 
     int i;
 
+#ifdef WITH_BLUEDOT
+    int replay_rule;
+#endif
+
     while(death == false)
         {
 
-            pthread_mutex_lock(&SaganProcWorkMutex);
+#ifdef WITH_BLUEDOT
 
-            while ( proc_msgslot == 0 ) pthread_cond_wait(&SaganProcDoWork, &SaganProcWorkMutex);
+            /* Re-run rules that were waiting on a Bluedot lookup that has
+               since finished */
 
-            if ( config->sagan_reload )
+            if ( config->bluedot_flag == true && config->sagan_reload == false )
                 {
-                    pthread_cond_wait(&SaganReloadCond, &SaganReloadMutex);
+
+                    while ( ( replay_rule = Sagan_Bluedot_Replay(SaganProcSyslog_LOCAL) ) != -1 )
+                        {
+                            (void)Sagan_Engine(SaganProcSyslog_LOCAL, NORMAL_RULE, replay_rule );
+                        }
                 }
 
-            proc_msgslot--;     /* This was ++ before coming over, so we now -- it to get to
-                                 * original value */
+#endif
 
+            /* Claim the next batch.  NULL means nothing arrived for a bit */
 
-            /* Copy inbound array from global to local */
+            slot = Sagan_Ring_Claim(SaganRing);
 
-            for (i=0; i < config->max_batch; i++)
+            if ( slot == NULL )
                 {
-
-
-                    if (debug->debugsyslog)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] [batch position %d] Raw log: %s",  __FILE__, __LINE__, i, SaganPassSyslog[proc_msgslot].syslog[i]);
-                        }
-
-                    strlcpy(SaganPassSyslog_LOCAL->syslog[i],  SaganPassSyslog[proc_msgslot].syslog[i], sizeof(SaganPassSyslog_LOCAL->syslog[i]));
+                    continue;
                 }
 
+            /* The signal handler holds this while rules are reloaded */
 
-            pthread_mutex_unlock(&SaganProcWorkMutex);
+            if ( config->sagan_reload )
+                {
+                    pthread_mutex_lock(&SaganReloadMutex);
+                    pthread_mutex_unlock(&SaganReloadMutex);
+                }
 
             __atomic_add_fetch(&proc_running, 1, __ATOMIC_SEQ_CST);
 
-            /* Process local syslog buffer */
+            /* Process the batch in place */
 
-            for (i=0; i < config->max_batch; i++)
+            for (i=0; i < slot->count; i++)
                 {
 
+                    if (debug->debugsyslog)
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] [batch position %d] Raw log: %s",  __FILE__, __LINE__, i, slot->syslog[i]);
+                        }
+
 //		    memset(SaganProcSyslog_LOCAL, 0, sizeof(struct _Sagan_Proc_Syslog));
 
-                    if ( config->input_type == INPUT_PIPE )
+                    if ( slot->input_type[i] == INPUT_PIPE )
                         {
-                            SyslogInput_Pipe( SaganPassSyslog_LOCAL->syslog[i], SaganProcSyslog_LOCAL );
+                            SyslogInput_Pipe( slot->syslog[i], SaganProcSyslog_LOCAL );
+                        }
+                    else if ( slot->input_type[i] == INPUT_SYSLOG )
+                        {
+                            SyslogInput_Syslog( slot->syslog[i], &slot->peer[i], SaganProcSyslog_LOCAL );
                         }
                     else
                         {
-                            SyslogInput_JSON( SaganPassSyslog_LOCAL->syslog[i], SaganProcSyslog_LOCAL );
+                            SyslogInput_JSON( slot->syslog[i], SaganProcSyslog_LOCAL );
                         }
 
                     if (debug->debugsyslog)
@@ -185,7 +195,7 @@ void Processor ( void )
                                 }
                         }
 
-                    (void)Sagan_Engine(SaganProcSyslog_LOCAL, dynamic_rule_flag );
+                    (void)Sagan_Engine(SaganProcSyslog_LOCAL, dynamic_rule_flag, SAGAN_ENGINE_ALL_RULES );
 
                     /* If this is a dynamic run,  reset back to normal */
 
@@ -229,6 +239,10 @@ void Processor ( void )
 
                 }
 
+            /* Hand the slot back to the reader */
+
+            Sagan_Ring_Release(SaganRing, slot);
+
             __atomic_sub_fetch(&proc_running, 1, __ATOMIC_SEQ_CST);
 
         } /*  for (;;) */
@@ -37,10 +37,14 @@
 #include <pthread.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <inttypes.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-counters.h"
+#include "util-radix.h"
 #include "parsers/parsers.h"
 
 #include "processors/blacklist.h"
@@ -48,7 +52,12 @@
 struct _SaganCounters *counters;
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
-struct _Sagan_Blacklist *SaganBlacklist;
+struct _Sagan_Radix *SaganBlacklist;
+
+static pthread_mutex_t SaganBlacklistLoadMutex=PTHREAD_MUTEX_INITIALIZER;
+
+static void Sagan_Blacklist_Load_Files ( char * );
+static void *Sagan_Blacklist_Reload_Thread ( void * );
 
 
 /****************************************************************************
@@ -63,11 +72,77 @@ void Sagan_Blacklist_Init ( void )
 }
 
 /****************************************************************************
- * Sagan_Blacklist_Load - Loads 32 bit IP addresses into memory so that they
- * can be queried later
+ * Sagan_Blacklist_Load - Loads IP addresses/networks into memory so that
+ * they can be queried later
  ****************************************************************************/
 
 void Sagan_Blacklist_Load ( void )
+{
+
+    char blacklist_files[sizeof(config->blacklist_files)] = { 0 };
+
+    /* strtok_r() would chop up the config copy,  so work on our own */
+
+    strlcpy(blacklist_files, config->blacklist_files, sizeof(blacklist_files));
+
+    pthread_mutex_lock(&SaganBlacklistLoadMutex);
+    Sagan_Blacklist_Load_Files(blacklist_files);
+    pthread_mutex_unlock(&SaganBlacklistLoadMutex);
+
+}
+
+/****************************************************************************
+ * Sagan_Blacklist_Reload - Rebuilds the blacklist in its own thread (on
+ * SIGHUP).  Lookups keep using the current tree until the new one is
+ * swapped in.
+ ****************************************************************************/
+
+void Sagan_Blacklist_Reload ( void )
+{
+
+    pthread_t reload_thread;
+    pthread_attr_t reload_thread_attr;
+
+    char *blacklist_files = strdup(config->blacklist_files);
+
+    if ( blacklist_files == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for blacklist_files. Abort!", __FILE__, __LINE__);
+        }
+
+    pthread_attr_init(&reload_thread_attr);
+    pthread_attr_setdetachstate(&reload_thread_attr,  PTHREAD_CREATE_DETACHED);
+
+    if ( pthread_create( &reload_thread, &reload_thread_attr, Sagan_Blacklist_Reload_Thread, blacklist_files ) )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Error creating blacklist reload thread [error: %s]. Abort!", __FILE__, __LINE__, strerror(errno));
+        }
+
+    pthread_attr_destroy(&reload_thread_attr);
+
+}
+
+static void *Sagan_Blacklist_Reload_Thread ( void *arg )
+{
+
+    char *blacklist_files = arg;
+
+    pthread_mutex_lock(&SaganBlacklistLoadMutex);
+    Sagan_Blacklist_Load_Files(blacklist_files);
+    pthread_mutex_unlock(&SaganBlacklistLoadMutex);
+
+    free(blacklist_files);
+
+    return(NULL);
+}
+
+/****************************************************************************
+ * Sagan_Blacklist_Load_Files - Builds a new tree from the comma separated
+ * "blacklist_files" and publishes it.  Called with SaganBlacklistLoadMutex
+ * held.
+ ****************************************************************************/
+
+static void Sagan_Blacklist_Load_Files ( char *blacklist_files )
 {
 
     FILE *blacklist;
@@ -85,13 +160,12 @@ void Sagan_Blacklist_Load ( void )
 
     int line_count;
     int item_count;
-    int i;
 
     bool found = 0;
 
-    __atomic_store_n(&counters->blacklist_count, 0, __ATOMIC_SEQ_CST);
+    struct _Sagan_Radix *tree = Sagan_Radix_Init();
 
-    blacklist_filename = strtok_r(config->blacklist_files, ",", &ptmp);
+    blacklist_filename = strtok_r(blacklist_files, ",", &ptmp);
 
     Sagan_Log(NORMAL, "");
 
@@ -121,19 +195,8 @@ void Sagan_Blacklist_Load ( void )
                     else
                         {
 
-                            /* Allocate memory for Blacklists,  not comments */
-
                             line_count++;
 
-                            SaganBlacklist = (_Sagan_Blacklist *) realloc(SaganBlacklist, (counters->blacklist_count+1) * sizeof(_Sagan_Blacklist));
-
-                            if ( SaganBlacklist == NULL )
-                                {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for SaganBlacklist. Abort!", __FILE__, __LINE__);
-                                }
-
-                            memset(&SaganBlacklist[counters->blacklist_count], 0, sizeof(_Sagan_Blacklist));
-
                             Remove_Return(blacklistbuf);
 
                             iprange = NULL;
@@ -145,12 +208,21 @@ void Sagan_Blacklist_Load ( void )
                             if ( tmpmask == NULL )
                                 {
 
-                                    /* If there is no CIDR,  then assume it's a /32 */
+                                    /* If there is no CIDR,  then assume it's a single host */
 
                                     strlcpy(tmp, iprange, sizeof(tmp));
                                     iprange = tmp;
-                                    mask = 32;
-                                    tmpmask = "32";
+
+                                    if ( strchr(iprange, ':') != NULL )
+                                        {
+                                            mask = 128;
+                                            tmpmask = "128";
+                                        }
+                                    else
+                                        {
+                                            mask = 32;
+                                            tmpmask = "32";
+                                        }
                                 }
                             else
                                 {
@@ -176,14 +248,8 @@ void Sagan_Blacklist_Load ( void )
 
                                 }
 
-                            /* Record lower and upper range based on the /CIDR.  We then use IP2Bit(ipaddr) to determine
-                             * if it's within the blacklist range.
-                             *
-                             * Idea came from "ashitpro"
-                             * http://bytes.com/topic/c/answers/765104-determining-whether-given-ip-exist-cidr-ip-range
-                             *
-                             */
-
+                            /* The tree is keyed on the IP2Bit() form,  so
+                             * the CIDR mask is simply the prefix length. */
 
                             if ( found == 0 )
                                 {
@@ -195,69 +261,51 @@ void Sagan_Blacklist_Load ( void )
                                             found = 1;
 
                                         }
-                                    else
+                                    else if ( Sagan_Radix_Add(tree, ipbits, mask) == false )
                                         {
-                                            for ( i = 0; i < counters->blacklist_count; i++ )
-                                                {
-
-                                                    if ( !memcmp(SaganBlacklist[i].range.ipbits, ipbits, MAXIPBIT ) &&
-                                                            !memcmp(SaganBlacklist[i].range.maskbits, maskbits, MAXIPBIT ) )
-                                                        {
-                                                            Sagan_Log(WARN, "[%s, line %d] Got duplicate blacklist address %s/%s in %s on line %d, skipping....", __FILE__, __LINE__, iprange, tmpmask, blacklist_filename, line_count);
-                                                            found = 1;
-                                                        }
-                                                }
+                                            Sagan_Log(WARN, "[%s, line %d] Got duplicate blacklist address %s/%s in %s on line %d, skipping....", __FILE__, __LINE__, iprange, tmpmask, blacklist_filename, line_count);
+                                            found = 1;
                                         }
                                 }
 
                             if ( found == 0 )
                                 {
-
-                                    memcpy(SaganBlacklist[counters->blacklist_count].range.ipbits, ipbits, sizeof(ipbits));
-                                    memcpy(SaganBlacklist[counters->blacklist_count].range.maskbits, maskbits, sizeof(maskbits));
-
                                     item_count++;
-
-                                    __atomic_add_fetch(&counters->blacklist_count, 1, __ATOMIC_SEQ_CST);
-
-
                                 }
                         }
                 }
 
             fclose(blacklist);
 
-            Sagan_Log(NORMAL, "Blacklist Processor Loaded File: %s (File: %d, Total: %d)", blacklist_filename, item_count, counters->blacklist_count++);
+            Sagan_Log(NORMAL, "Blacklist Processor Loaded File: %s (File: %d, Total: %" PRIu64 ")", blacklist_filename, item_count, tree->count);
 
             blacklist_filename = strtok_r(NULL, ",", &ptmp);
 
         }
 
+    __atomic_store_n(&counters->blacklist_count, tree->count, __ATOMIC_SEQ_CST);
+
+    Sagan_Radix_Swap(&SaganBlacklist, tree);
+
 }
 
 
 /***************************************************************************
  * Sagan_Blacklist_IPADDR - Looks up the IP address in the Blacklist
- * array.  If found,  returns TRUE.
+ * tree.  If found,  returns TRUE.
  ***************************************************************************/
 
 bool Sagan_Blacklist_IPADDR ( unsigned char *ipaddr )
 {
 
-    int i = 0;
+    Sagan_Counter_Add(blacklist_lookup_count, 1);
 
-    counters->blacklist_lookup_count++;
-
-    for ( i = 0; i < counters->blacklist_count; i++)
+    if ( Sagan_Radix_Match( Sagan_Radix_Get(&SaganBlacklist), ipaddr ) )
         {
 
-            if ( is_inrange(ipaddr, (unsigned char *)&SaganBlacklist[i].range, 1) )
-                {
+            Sagan_Counter_Add(blacklist_hit_count, 1);
 
-                    __atomic_add_fetch(&counters->blacklist_hit_count, 1, __ATOMIC_SEQ_CST);
-
-                    return(true);
-                }
+            return(true);
         }
 
     return(false);
@@ -265,7 +313,7 @@ bool Sagan_Blacklist_IPADDR ( unsigned char *ipaddr )
 }
 
 /***************************************************************************
- * Sagan_Blacklist_IPADDR_All - Check all IPv4 addresses against the
+ * Sagan_Blacklist_IPADDR_All - Check all IP addresses against the
  * blacklist IP's in memory!
  ***************************************************************************/
 
@@ -273,21 +321,18 @@ bool Sagan_Blacklist_IPADDR_All ( char *syslog_message, _Sagan_Lookup_Cache_Entr
 {
 
     int i;
-    int b;
+
+    struct _Sagan_Radix *tree = Sagan_Radix_Get(&SaganBlacklist);
 
     for (i = 0; i < lookup_cache_size; i++)
         {
 
-            for ( b = 0; b < counters->blacklist_count; b++ )
+            if ( Sagan_Radix_Match(tree, lookup_cache[i].ip_bits) )
                 {
 
-                    if ( is_inrange(lookup_cache[i].ip_bits, (unsigned char *)&SaganBlacklist[b].range, 1) )
-                        {
-
-                            __atomic_add_fetch(&counters->blacklist_hit_count, 1, __ATOMIC_SEQ_CST);
+                    Sagan_Counter_Add(blacklist_hit_count, 1);
 
-                            return(true);
-                        }
+                    return(true);
                 }
 
         }
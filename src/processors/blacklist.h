@@ -22,18 +22,6 @@
 
 void Sagan_Blacklist_Load ( void );
 void Sagan_Blacklist_Init( void );
+void Sagan_Blacklist_Reload( void );
 bool Sagan_Blacklist_IPADDR( unsigned char * );
 bool Sagan_Blacklist_IPADDR_All ( char *, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size );
-
-typedef struct _Sagan_Blacklist _Sagan_Blacklist;
-struct _Sagan_Blacklist
-{
-
-    struct
-    {
-        unsigned char ipbits[MAXIPBIT];
-        unsigned char maskbits[MAXIPBIT];
-    } range;
-
-};
-
@@ -40,26 +40,54 @@
 #include <curl/curl.h>
 #include <json.h>
 #include <stdbool.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <ctype.h>
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "rules.h"
+#include "ipc.h"
 
 #include "processors/bluedot.h"
 
 #include "parsers/parsers.h"
+#include "util-radix.h"
+#include "util-time.h"
+
+/* One curl easy handle.  Handles are reused so the multi handle can keep
+   the connection to Bluedot alive between lookups */
+
+typedef struct _Sagan_Bluedot_Transfer _Sagan_Bluedot_Transfer;
+struct _Sagan_Bluedot_Transfer
+{
+    CURL *curl;
+    bool busy;
+    unsigned char type;
+    int slot;
+    struct timeval start;
+    char *response;
+    size_t response_len;
+    bool response_error;
+};
 
 struct _SaganCounters *counters;
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
-struct _Sagan_Bluedot_Skip *Bluedot_Skip;
+struct _Sagan_Radix *Bluedot_Skip;
 
-struct _Sagan_Bluedot_IP_Cache *SaganBluedotIPCache = NULL;
-struct _Sagan_Bluedot_Hash_Cache *SaganBluedotHashCache = NULL;
-struct _Sagan_Bluedot_URL_Cache *SaganBluedotURLCache = NULL;
-struct _Sagan_Bluedot_Filename_Cache *SaganBluedotFilenameCache = NULL;
-struct _Sagan_Bluedot_JA3_Cache *SaganBluedotJA3Cache = NULL;
+struct _Sagan_Bluedot_Cache SaganBluedotIPCache;
+struct _Sagan_Bluedot_Cache SaganBluedotHashCache;
+struct _Sagan_Bluedot_Cache SaganBluedotURLCache;
+struct _Sagan_Bluedot_Cache SaganBluedotFilenameCache;
+struct _Sagan_Bluedot_Cache SaganBluedotJA3Cache;
 
 struct _Sagan_Bluedot_Cat_List *SaganBluedotCatList = NULL;
 
@@ -69,6 +97,8 @@ struct _Sagan_Bluedot_URL_Queue *SaganBluedotURLQueue = NULL;
 struct _Sagan_Bluedot_Filename_Queue *SaganBluedotFilenameQueue = NULL;
 struct _Sagan_Bluedot_JA3_Queue *SaganBluedotJA3Queue = NULL;
 
+struct _Sagan_Bluedot_Deferred *SaganBluedotDeferred = NULL;
+
 struct _Rule_Struct *rulestruct;
 
 pthread_mutex_t SaganProcBluedotWorkMutex=PTHREAD_MUTEX_INITIALIZER;
@@ -80,1219 +110,1273 @@ pthread_mutex_t SaganProcBluedotURLWorkMutex=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t SaganProcBluedotFilenameWorkMutex=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t SaganProcBluedotJA3WorkMutex=PTHREAD_MUTEX_INITIALIZER;
 
+pthread_mutex_t SaganProcBluedotDeferMutex=PTHREAD_MUTEX_INITIALIZER;
+
+pthread_mutex_t SaganBluedotLookupMutex=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t SaganBluedotLookupCond=PTHREAD_COND_INITIALIZER;
 
-bool bluedot_cache_clean_lock=0;
-bool bluedot_dns_global=0;
+uint64_t bluedot_ticket = 0;			/* Identifies each queued lookup */
+int bluedot_waiting = 0;			/* Queued,  not yet handed to curl */
+int bluedot_deferred_used = 0;
+
+bool death;
 
 /****************************************************************************
- * Sagan_Bluedot_Init() - init's some global variables and other items
- * that need to be done only once. - Champ Clark 05/15/2013
+ * Cache helpers.  Each lookup type has its own hashed cache.  Entries are
+ * found by hashing the key into an open addressing table.  Expired
+ * entries are treated as misses on lookup and swept out by
+ * Sagan_Bluedot_Clean_Cache().  A full cache evicts with a "clock"
+ * (approximate LRU) rather than refusing new entries.
  ****************************************************************************/
 
-void Sagan_Bluedot_Init(void)
+static void Sagan_Bluedot_Cache_Init ( struct _Sagan_Bluedot_Cache *cache, uint64_t max, uint64_t *count, size_t hit, size_t miss, size_t evict )
 {
 
-    char  timet[20] = { 0 };
+    pthread_rwlock_init(&cache->lock, NULL);
 
-    time_t t;
-    struct tm *now = NULL;
+    cache->max = max;
+    cache->slots = max * 2;		/* Keep the table at most half full */
+    cache->hand = 0;
+    cache->table = NULL;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    cache->count = count;
+    cache->hit = hit;
+    cache->miss = miss;
+    cache->evict = evict;
 
-    config->bluedot_last_time = atol(timet);
-
-    /* Bluedot IP Cache */
-
-    SaganBluedotIPCache = malloc(config->bluedot_ip_max_cache * sizeof(struct _Sagan_Bluedot_IP_Cache));
-
-    if ( SaganBluedotIPCache == NULL )
+    if ( cache->slots == 0 )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotIPCache. Abort!", __FILE__, __LINE__);
+            return;
         }
 
-    memset(SaganBluedotIPCache, 0, config->bluedot_ip_max_cache * sizeof(_Sagan_Bluedot_IP_Cache));
-
-    /* Bluedot Hash Cache */
+    cache->table = malloc(cache->slots * sizeof(struct _Sagan_Bluedot_Cache_Entry));
 
-    SaganBluedotHashCache = malloc(config->bluedot_hash_max_cache * sizeof(struct _Sagan_Bluedot_Hash_Cache));
-
-    if ( SaganBluedotHashCache == NULL )
+    if ( cache->table == NULL )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotHashCache. Abort!", __FILE__, __LINE__);
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot cache. Abort!", __FILE__, __LINE__);
         }
 
-    memset(SaganBluedotHashCache, 0, config->bluedot_hash_max_cache * sizeof(_Sagan_Bluedot_Hash_Cache));
+    memset(cache->table, 0, cache->slots * sizeof(struct _Sagan_Bluedot_Cache_Entry));
 
-    /* Bluedot URL Cache */
+}
 
-    SaganBluedotURLCache = malloc(config->bluedot_url_max_cache * sizeof(struct _Sagan_Bluedot_URL_Cache));
+static struct _Sagan_Bluedot_Cache *Sagan_Bluedot_Cache_Table ( unsigned char type )
+{
 
-    if ( SaganBluedotURLCache == NULL )
+    if ( type == BLUEDOT_LOOKUP_IP )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotURLCache. Abort!", __FILE__, __LINE__);
+            return(&SaganBluedotIPCache);
         }
 
-    memset(SaganBluedotURLCache, 0, config->bluedot_url_max_cache * sizeof(_Sagan_Bluedot_URL_Cache));
-
-    /* Bluedot Filename Cache */
-
-    SaganBluedotFilenameCache = malloc(config->bluedot_filename_max_cache * sizeof(struct _Sagan_Bluedot_Filename_Cache));
-
-    if ( SaganBluedotFilenameCache == NULL )
+    else if ( type == BLUEDOT_LOOKUP_HASH )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotFilenameCache. Abort!", __FILE__, __LINE__);
+            return(&SaganBluedotHashCache);
         }
 
-    memset(SaganBluedotFilenameCache, 0, config->bluedot_filename_max_cache * sizeof(_Sagan_Bluedot_Filename_Cache));
-
-    /* Bluedot JA3 Cache */
-
-    SaganBluedotJA3Cache = malloc(config->bluedot_ja3_max_cache * sizeof(struct _Sagan_Bluedot_JA3_Cache));
-
-    if ( SaganBluedotJA3Cache == NULL )
+    else if ( type == BLUEDOT_LOOKUP_URL )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotJA3Cache. Abort!", __FILE__, __LINE__);
+            return(&SaganBluedotURLCache);
         }
 
-    memset(SaganBluedotJA3Cache, 0, config->bluedot_ja3_max_cache * sizeof(_Sagan_Bluedot_JA3_Cache));
-
-    /* ------------------ Queues ------------------------------------------------------ */
-
-    /* Bluedot IP Queue */
-
-    SaganBluedotIPQueue = malloc(config->bluedot_ip_queue * sizeof(struct _Sagan_Bluedot_IP_Queue));
-
-    if ( SaganBluedotIPQueue == NULL )
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotIPQueue. Abort!", __FILE__, __LINE__);
+            return(&SaganBluedotFilenameCache);
         }
 
-    memset(SaganBluedotIPQueue, 0, config->bluedot_ip_queue * sizeof(_Sagan_Bluedot_IP_Queue));
+    return(&SaganBluedotJA3Cache);
+}
 
+/* Builds the cache key.  IPs use their binary form,  everything else is
+   compared case insensitively so it is lower cased. */
 
-    /* Bluedot Hash Queue */
+static uint16_t Sagan_Bluedot_Cache_Key ( unsigned char type, const char *data, const unsigned char *ip_bits, char *key, size_t size )
+{
 
-    SaganBluedotHashQueue = malloc(config->bluedot_hash_queue * sizeof(struct _Sagan_Bluedot_Hash_Queue));
+    size_t i;
 
-    if ( SaganBluedotHashQueue == NULL )
+    if ( type == BLUEDOT_LOOKUP_IP )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotHashQueue. Abort!", __FILE__, __LINE__);
+            memcpy(key, ip_bits, MAXIPBIT);
+            return(MAXIPBIT);
         }
 
-    memset(SaganBluedotHashQueue, 0, config->bluedot_hash_queue * sizeof(_Sagan_Bluedot_Hash_Queue));
-
-    /* Bluedot URL Queue */
-
-    SaganBluedotURLQueue = malloc(config->bluedot_url_queue * sizeof(struct _Sagan_Bluedot_URL_Queue));
-
-    if ( SaganBluedotURLQueue == NULL )
+    for ( i = 0; data[i] != '\0' && i < size - 1; i++ )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotURLQueue. Abort!", __FILE__, __LINE__);
+            key[i] = tolower((unsigned char)data[i]);
         }
 
-    memset(SaganBluedotURLQueue, 0, config->bluedot_url_queue * sizeof(_Sagan_Bluedot_URL_Queue));
+    key[i] = '\0';
 
-    /* Bluedot Filename Queue */
+    return(i);
+}
 
-    SaganBluedotFilenameQueue = malloc(config->bluedot_filename_queue * sizeof(struct _Sagan_Bluedot_Filename_Queue));
+/* Returns the slot holding "key" or -1.  Caller holds the lock */
 
-    if ( SaganBluedotFilenameQueue == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotFilenameQueue. Abort!", __FILE__, __LINE__);
-        }
+static int Sagan_Bluedot_Cache_Find ( struct _Sagan_Bluedot_Cache *cache, const char *key, uint16_t key_len, uint32_t hash )
+{
 
-    memset(SaganBluedotFilenameQueue, 0, config->bluedot_filename_queue * sizeof(_Sagan_Bluedot_Filename_Queue));
+    uint32_t i;
+    uint32_t n = IPC_Hash_Home(hash, cache->slots);
 
-    /* Bluedot JA3 Queue */
+    for ( i = 0; i < cache->slots; i++ )
+        {
 
-    SaganBluedotJA3Queue = malloc(config->bluedot_ja3_queue * sizeof(struct _Sagan_Bluedot_JA3_Queue));
+            if ( cache->table[n].key == NULL )
+                {
+                    return(-1);
+                }
 
-    if ( SaganBluedotJA3Queue == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotJA3Queue. Abort!", __FILE__, __LINE__);
-        }
+            if ( cache->table[n].hash == hash && cache->table[n].key_len == key_len &&
+                    !memcmp(cache->table[n].key, key, key_len) )
+                {
+                    return(n);
+                }
 
-    memset(SaganBluedotJA3Queue, 0, config->bluedot_ja3_queue * sizeof(_Sagan_Bluedot_JA3_Queue));
+            n = ( n + 1 ) % cache->slots;
+        }
 
+    return(-1);
 }
 
+/* Empties slot "n" and shifts later entries of the probe chain back so
+   no tombstones are needed.  Caller holds the write lock */
 
-/****************************************************************************
- * Sagan_Bluedot_Clean_Queue - Clean's the "queue" of the type of lookup
- * that happened.  This is called after a successful lookup.  We do this to
- * prevent multiple lookups (at the same time!) of the same item!  This
- * happens a lot with IP address looks
- ****************************************************************************/
-
-int Sagan_Bluedot_Clean_Queue ( char *data, unsigned char type )
+static void Sagan_Bluedot_Cache_Remove ( struct _Sagan_Bluedot_Cache *cache, uint32_t n )
 {
 
-    int i=0;
+    uint32_t j = n;
+    uint32_t home;
 
-    unsigned char ip_convert[MAXIPBIT] = { 0 };
+    free(cache->table[n].key);
+    free(cache->table[n].bluedot_json);
 
-    if ( type == BLUEDOT_LOOKUP_IP )
+    for ( ;; )
         {
 
-            IP2Bit(data, ip_convert);
+            j = ( j + 1 ) % cache->slots;
 
-            for (i=0; i<config->bluedot_ip_queue; i++)
+            if ( cache->table[j].key == NULL )
                 {
-
-                    if ( !memcmp(ip_convert, SaganBluedotIPQueue[i].ip, MAXIPBIT) )
-                        {
-
-                            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-                            memset(SaganBluedotIPQueue[i].ip, 0, MAXIPBIT);
-                            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
-
-                        }
-
+                    break;
                 }
 
-            __atomic_sub_fetch(&counters->bluedot_ip_queue_current, 1, __ATOMIC_SEQ_CST);
-
-        }
+            home = IPC_Hash_Home(cache->table[j].hash, cache->slots);
 
-    else if ( type == BLUEDOT_LOOKUP_HASH )
-        {
+            /* Entries whose home is (cyclically) in (n, j] stay put */
 
-            for (i=0; i<config->bluedot_hash_queue; i++)
+            if ( n <= j ? ( n < home && home <= j ) : ( n < home || home <= j ) )
                 {
+                    continue;
+                }
 
-                    if ( !strcasecmp(data, SaganBluedotHashQueue[i].hash ) )
-                        {
+            cache->table[n] = cache->table[j];
+            n = j;
+        }
 
-                            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-                            memset(SaganBluedotHashQueue[i].hash, 0, SHA256_HASH_SIZE+1);
-                            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+    memset(&cache->table[n], 0, sizeof(struct _Sagan_Bluedot_Cache_Entry));
 
-                        }
+    __atomic_sub_fetch(cache->count, 1, __ATOMIC_SEQ_CST);
+}
 
-                }
+/* Makes room for one entry.  Expired entries go first,  otherwise the
+   first entry not hit since the hand last passed it.  Caller holds the
+   write lock */
 
-            __atomic_sub_fetch(&counters->bluedot_hash_queue_current, 1, __ATOMIC_SEQ_CST);
+static void Sagan_Bluedot_Cache_Evict ( struct _Sagan_Bluedot_Cache *cache, uint64_t epoch_time )
+{
 
-        }
+    uint32_t n;
 
-    else if ( type == BLUEDOT_LOOKUP_URL )
+    for ( ;; )
         {
 
-            for (i =0; i<config->bluedot_url_queue; i++)
-                {
+            n = cache->hand;
+            cache->hand = ( cache->hand + 1 ) % cache->slots;
 
-                    if ( !strcasecmp(data, SaganBluedotURLQueue[i].url ) )
-                        {
+            if ( cache->table[n].key == NULL )
+                {
+                    continue;
+                }
 
-                            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
-                            memset(SaganBluedotURLQueue[i].url, 0, sizeof(SaganBluedotURLQueue[i].url));
-                            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
-                        }
+            if ( (int64_t)( epoch_time - cache->table[n].cache_utime ) > config->bluedot_timeout )
+                {
+                    Sagan_Bluedot_Cache_Remove(cache, n);
+                    return;
                 }
 
-            __atomic_sub_fetch(&counters->bluedot_url_queue_current, 1, __ATOMIC_SEQ_CST);
+            if ( cache->table[n].referenced == true )
+                {
+                    __atomic_store_n(&cache->table[n].referenced, false, __ATOMIC_SEQ_CST);
+                    continue;
+                }
 
+            Sagan_Bluedot_Cache_Remove(cache, n);
+            Sagan_Counter_Add_Offset(cache->evict, 1);
+            return;
         }
+}
 
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
-        {
+/* Copies a cached verdict into "verdict" (and the reply into bluedot_str).
+   Returns false on a miss or if the entry has expired */
 
-            for  (i=0; i<config->bluedot_filename_queue; i++)
-                {
+static bool Sagan_Bluedot_Cache_Get ( unsigned char type, const char *key, uint16_t key_len, uint64_t epoch_time, struct _Sagan_Bluedot_Cache_Entry *verdict, char *bluedot_str, size_t bluedot_size )
+{
 
-                    if ( !strcasecmp(data, SaganBluedotFilenameQueue[i].filename ) )
-                        {
+    struct _Sagan_Bluedot_Cache *cache = Sagan_Bluedot_Cache_Table(type);
+    struct _Sagan_Bluedot_Cache_Entry *entry = NULL;
 
-                            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
-                            memset(SaganBluedotFilenameQueue[i].filename, 0, sizeof(SaganBluedotFilenameQueue[i].filename));
-                            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
-                        }
+    uint32_t hash;
+    int n;
 
-                }
+    if ( cache->table == NULL )
+        {
+            Sagan_Counter_Add_Offset(cache->miss, 1);
+            return(false);
+        }
 
-            __atomic_sub_fetch(&counters->bluedot_filename_queue_current, 1, __ATOMIC_SEQ_CST);
+    hash = IPC_Hash_Bytes(IPC_HASH_SEED, key, key_len);
 
+    pthread_rwlock_rdlock(&cache->lock);
 
-        }
+    n = Sagan_Bluedot_Cache_Find(cache, key, key_len, hash);
 
-    else if ( type == BLUEDOT_LOOKUP_JA3 )
+    if ( n == -1 || (int64_t)( epoch_time - cache->table[n].cache_utime ) > config->bluedot_timeout )
         {
+            pthread_rwlock_unlock(&cache->lock);
+            Sagan_Counter_Add_Offset(cache->miss, 1);
+            return(false);
+        }
 
-            for  (i=0; i<config->bluedot_ja3_queue; i++)
-                {
+    entry = &cache->table[n];
 
-                    if ( !strcasecmp(data, SaganBluedotJA3Queue[i].ja3 ) )
-                        {
+    __atomic_store_n(&entry->referenced, true, __ATOMIC_SEQ_CST);
 
-                            pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
-                            memset(SaganBluedotJA3Queue[i].ja3, 0, sizeof(SaganBluedotJA3Queue[i].ja3));
-                            pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
-                        }
+    verdict->alertid = entry->alertid;
+    verdict->cache_utime = entry->cache_utime;
+    verdict->cdate_utime = entry->cdate_utime;
+    verdict->mdate_utime = entry->mdate_utime;
 
-                }
+    snprintf(bluedot_str, bluedot_size, "%s", entry->bluedot_json != NULL ? entry->bluedot_json : "");
 
-            __atomic_sub_fetch(&counters->bluedot_ja3_queue_current, 1, __ATOMIC_SEQ_CST);
+    pthread_rwlock_unlock(&cache->lock);
 
-        }
+    Sagan_Counter_Add_Offset(cache->hit, 1);
 
     return(true);
 }
 
-/****************************************************************************
- * Sagan_Bluedot_Load_Cat() - load all "Bluedot" categories in memory
- ****************************************************************************/
+/* Adds (or refreshes) a verdict.  Called from the lookup thread */
 
-void Sagan_Bluedot_Load_Cat(void)
+static void Sagan_Bluedot_Cache_Put ( unsigned char type, const char *key, uint16_t key_len, uint64_t epoch_time, signed char alertid, uint64_t cdate_utime, uint64_t mdate_utime, const char *bluedot_json )
 {
 
-    FILE *bluedot_cat_file;
-    char buf[1024] = { 0 };
-    char *saveptr = NULL;
+    struct _Sagan_Bluedot_Cache *cache = Sagan_Bluedot_Cache_Table(type);
 
-    char *bluedot_tok1 = NULL;
-    char *bluedot_tok2 = NULL;
+    char *new_key = NULL;
+    char *new_json = NULL;
 
-    if (( bluedot_cat_file = fopen(config->bluedot_cat, "r" )) == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] No Bluedot categories list to load (%s)!", __FILE__, __LINE__, config->bluedot_cat);
-        }
+    uint32_t hash;
+    int n;
 
-    while(fgets(buf, 1024, bluedot_cat_file) != NULL)
+    if ( cache->table == NULL )
         {
+            return;
+        }
 
-            /* Skip comments and blank linkes */
-
-            if (buf[0] == '#' || buf[0] == 10 || buf[0] == ';' || buf[0] == 32)
-                {
-                    continue;
-
-                }
-            else
-                {
-
-                    /* Allocate memory for references,  not comments */
-
-                    SaganBluedotCatList = (_Sagan_Bluedot_Cat_List *) realloc(SaganBluedotCatList, (counters->bluedot_cat_count+1) * sizeof(_Sagan_Bluedot_Cat_List));
+    /* Allocate before taking the lock.  The key gets a trailing NULL so
+       string keys can be logged */
 
-                    if ( SaganBluedotCatList == NULL )
-                        {
-                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for SaganBluedotCatList. Abort!", __FILE__, __LINE__);
-                        }
+    new_key = malloc(key_len + 1);
 
-                    memset(&SaganBluedotCatList[counters->bluedot_cat_count], 0, sizeof(_Sagan_Bluedot_Cat_List));
+    if ( new_key == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot cache key. Abort!", __FILE__, __LINE__);
+        }
 
-                    /* Normalize the list for later use.  Better to do this here than when processing rules */
+    memcpy(new_key, key, key_len);
+    new_key[key_len] = '\0';
 
-                    bluedot_tok1 = strtok_r(buf, "|", &saveptr);
+    if ( alertid != 0 )
+        {
 
-                    if ( bluedot_tok1 == NULL )
-                        {
-                            Sagan_Log(ERROR, "[%s, line %d] Bluedot categories file appears to be malformed.", __FILE__, __LINE__);
-                        }
+            new_json = strdup(bluedot_json);
 
-                    Remove_Return(bluedot_tok1);
-                    Remove_Spaces(bluedot_tok1);
+            if ( new_json == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot cache JSON. Abort!", __FILE__, __LINE__);
+                }
+        }
 
-                    SaganBluedotCatList[counters->bluedot_cat_count].cat_number = atoi(bluedot_tok1);
+    hash = IPC_Hash_Bytes(IPC_HASH_SEED, key, key_len);
 
-                    bluedot_tok2 = strtok_r(NULL, "|", &saveptr);
+    pthread_rwlock_wrlock(&cache->lock);
 
-                    if ( bluedot_tok2 == NULL )
-                        {
-                            Sagan_Log(ERROR, "[%s, line %d] Bluedot categories file appears to be malformed.", __FILE__, __LINE__);
-                        }
+    n = Sagan_Bluedot_Cache_Find(cache, key, key_len, hash);
 
-                    Remove_Return(bluedot_tok2);
-                    Remove_Spaces(bluedot_tok2);
-                    To_LowerC(bluedot_tok2);
+    if ( n != -1 )
+        {
+            free(cache->table[n].key);
+            free(cache->table[n].bluedot_json);
+        }
+    else
+        {
 
-                    strlcpy(SaganBluedotCatList[counters->bluedot_cat_count].cat, bluedot_tok2, sizeof(SaganBluedotCatList[counters->bluedot_cat_count].cat));
+            if ( __atomic_load_n(cache->count, __ATOMIC_SEQ_CST) >= cache->max )
+                {
+                    Sagan_Bluedot_Cache_Evict(cache, epoch_time);
+                }
 
-                    __atomic_add_fetch(&counters->bluedot_cat_count, 1, __ATOMIC_SEQ_CST);
+            n = IPC_Hash_Home(hash, cache->slots);
 
+            while ( cache->table[n].key != NULL )
+                {
+                    n = ( n + 1 ) % cache->slots;
                 }
+
+            __atomic_add_fetch(cache->count, 1, __ATOMIC_SEQ_CST);
         }
 
-}
+    cache->table[n].key = new_key;
+    cache->table[n].key_len = key_len;
+    cache->table[n].hash = hash;
+    cache->table[n].bluedot_json = new_json;
+    cache->table[n].alertid = alertid;
+    cache->table[n].cache_utime = epoch_time;
+    cache->table[n].cdate_utime = cdate_utime;
+    cache->table[n].mdate_utime = mdate_utime;
+    cache->table[n].referenced = true;
 
-/****************************************************************************
- * write_callback_func() - Callback for data received via libcurl
- ****************************************************************************/
+    pthread_rwlock_unlock(&cache->lock);
 
-size_t static write_callback_func(void *buffer, size_t size, size_t nmemb, void *userp)
-{
-    char **response_ptr =  (char**)userp;
-    *response_ptr = strndup(buffer, (size_t)(size *nmemb));     /* Return the string */
 }
 
-/****************************************************************************
- * Sagan_Bluedot_Clean_Cache() - Cleans cache.  Remove old,  stale entries
- * to make room for new,  fresh entries :)
- ****************************************************************************/
+/* Removes expired entries.  Returns how many were deleted */
 
-void Sagan_Bluedot_Check_Cache_Time (void)
+static uint64_t Sagan_Bluedot_Cache_Clean ( unsigned char type, uint64_t epoch_time )
 {
 
-    time_t t;
-    struct tm *now = NULL;
-
-    char  timet[20] = { 0 };
+    struct _Sagan_Bluedot_Cache *cache = Sagan_Bluedot_Cache_Table(type);
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    uint64_t deleted_count = 0;
+    uint32_t n = 0;
 
-    if ( bluedot_cache_clean_lock == 0 && atol(timet) > ( config->bluedot_last_time + config->bluedot_timeout ) )
+    if ( cache->table == NULL )
         {
+            return(0);
+        }
 
-            pthread_mutex_lock(&SaganProcBluedotWorkMutex);
-
-            bluedot_cache_clean_lock = 1;
-
-            Sagan_Log(NORMAL, "Bluedot cache timeout reached %d minutes.  Cleaning up.", config->bluedot_timeout / 60);
-            Sagan_Bluedot_Clean_Cache();
-
-            bluedot_cache_clean_lock = 0;
+    pthread_rwlock_wrlock(&cache->lock);
 
-            pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
+    while ( n < cache->slots )
+        {
 
-        }
+            if ( cache->table[n].key != NULL &&
+                    (int64_t)( epoch_time - cache->table[n].cache_utime ) > config->bluedot_timeout )
+                {
 
-    if ( counters->bluedot_ip_cache_count >= config->bluedot_ip_max_cache && config->bluedot_ip_max_cache != 0  )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of IP cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
+                    if ( debug->debugbluedot && type != BLUEDOT_LOOKUP_IP )
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting from cache -> %s",  __FILE__, __LINE__, cache->table[n].key);
+                        }
 
-    if ( counters->bluedot_hash_cache_count >= config->bluedot_hash_max_cache && config->bluedot_hash_max_cache != 0 )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of hash cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
+                    /* A later entry may be shifted into this slot,  so
+                       look at it again */
 
-    if ( counters->bluedot_url_cache_count >= config->bluedot_url_max_cache && config->bluedot_url_max_cache != 0 )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of URL cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
+                    Sagan_Bluedot_Cache_Remove(cache, n);
+                    deleted_count++;
+                    continue;
+                }
 
-    if ( counters->bluedot_filename_cache_count >= config->bluedot_filename_max_cache && config->bluedot_filename_max_cache != 0 )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of URL cache space! Considering increasing cache size!", __FILE__, __LINE__);
+            n++;
         }
 
-    if ( counters->bluedot_ja3_cache_count >= config->bluedot_ja3_max_cache && config->bluedot_ja3_max_cache != 0 )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of JA3 cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
+    pthread_rwlock_unlock(&cache->lock);
 
+    return(deleted_count);
 }
 
 /****************************************************************************
- * Sagan_Bluedot_Clean_Cache - Cleans old Bluedot entries over the
- * specified "cache_timeout".
+ * Sagan_Bluedot_Init() - init's some global variables and other items
+ * that need to be done only once. - Champ Clark 05/15/2013
  ****************************************************************************/
 
-void Sagan_Bluedot_Clean_Cache ( void )
+void Sagan_Bluedot_Init(void)
 {
 
-    int i;
-    int deleted_count=0;
-
-    int new_bluedot_ip_max_cache = 0;
-    int new_bluedot_hash_max_cache = 0;
-    int new_bluedot_url_max_cache = 0;
-    int new_bluedot_filename_max_cache = 0;
-    int new_bluedot_ja3_max_cache = 0;
+    config->bluedot_last_time = Return_Epoch();
 
-    char  timet[20] = { 0 };
-    time_t t;
-    struct tm *now=NULL;
-    uint64_t timeint;
+    /* Caches */
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-    timeint = atol(timet);
+    Sagan_Bluedot_Cache_Init(&SaganBluedotIPCache, config->bluedot_ip_max_cache, &counters->bluedot_ip_cache_count, offsetof(struct _Sagan_Counter_Shard, bluedot_ip_cache_hit), offsetof(struct _Sagan_Counter_Shard, bluedot_ip_cache_miss), offsetof(struct _Sagan_Counter_Shard, bluedot_ip_cache_evict));
+    Sagan_Bluedot_Cache_Init(&SaganBluedotHashCache, config->bluedot_hash_max_cache, &counters->bluedot_hash_cache_count, offsetof(struct _Sagan_Counter_Shard, bluedot_hash_cache_hit), offsetof(struct _Sagan_Counter_Shard, bluedot_hash_cache_miss), offsetof(struct _Sagan_Counter_Shard, bluedot_hash_cache_evict));
+    Sagan_Bluedot_Cache_Init(&SaganBluedotURLCache, config->bluedot_url_max_cache, &counters->bluedot_url_cache_count, offsetof(struct _Sagan_Counter_Shard, bluedot_url_cache_hit), offsetof(struct _Sagan_Counter_Shard, bluedot_url_cache_miss), offsetof(struct _Sagan_Counter_Shard, bluedot_url_cache_evict));
+    Sagan_Bluedot_Cache_Init(&SaganBluedotFilenameCache, config->bluedot_filename_max_cache, &counters->bluedot_filename_cache_count, offsetof(struct _Sagan_Counter_Shard, bluedot_filename_cache_hit), offsetof(struct _Sagan_Counter_Shard, bluedot_filename_cache_miss), offsetof(struct _Sagan_Counter_Shard, bluedot_filename_cache_evict));
+    Sagan_Bluedot_Cache_Init(&SaganBluedotJA3Cache, config->bluedot_ja3_max_cache, &counters->bluedot_ja3_cache_count, offsetof(struct _Sagan_Counter_Shard, bluedot_ja3_cache_hit), offsetof(struct _Sagan_Counter_Shard, bluedot_ja3_cache_miss), offsetof(struct _Sagan_Counter_Shard, bluedot_ja3_cache_evict));
 
-    if (debug->debugbluedot)
-        {
-            Sagan_Log(DEBUG, "[%s, line %d] Sagan/Bluedot cache clean time has been reached.", __FILE__, __LINE__);
-            Sagan_Log(DEBUG, "[%s, line %d] ----------------------------------------------------------------------", __FILE__, __LINE__);
-        }
+    /* ------------------ Queues ------------------------------------------------------ */
 
-    config->bluedot_last_time = timeint;
+    /* Bluedot IP Queue */
 
-    deleted_count = 0;
+    SaganBluedotIPQueue = malloc(config->bluedot_ip_queue * sizeof(struct _Sagan_Bluedot_IP_Queue));
 
-    for (i=0; i < config->bluedot_ip_max_cache; i++ )
+    if ( SaganBluedotIPQueue == NULL )
         {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotIPQueue. Abort!", __FILE__, __LINE__);
+        }
 
-            if ( ( timeint - SaganBluedotIPCache[i].cache_utime ) > config->bluedot_timeout )
-                {
-
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting IP address from cache -> %u",  __FILE__, __LINE__, SaganBluedotIPCache[i].ip);
-                        }
+    memset(SaganBluedotIPQueue, 0, config->bluedot_ip_queue * sizeof(_Sagan_Bluedot_IP_Queue));
 
-                    pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
 
-                    memset(SaganBluedotIPCache[i].ip, 0, MAXIPBIT);
-                    SaganBluedotIPCache[i].mdate_utime = 0;
-                    SaganBluedotIPCache[i].cdate_utime = 0;
-                    SaganBluedotIPCache[i].cache_utime = 0;
-                    SaganBluedotIPCache[i].alertid = 0;
+    /* Bluedot Hash Queue */
 
-                    pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    SaganBluedotHashQueue = malloc(config->bluedot_hash_queue * sizeof(struct _Sagan_Bluedot_Hash_Queue));
 
-                    deleted_count++;
+    if ( SaganBluedotHashQueue == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotHashQueue. Abort!", __FILE__, __LINE__);
+        }
 
-                }
-            else
-                {
+    memset(SaganBluedotHashQueue, 0, config->bluedot_hash_queue * sizeof(_Sagan_Bluedot_Hash_Queue));
 
-                    new_bluedot_ip_max_cache++;
+    /* Bluedot URL Queue */
 
-                }
+    SaganBluedotURLQueue = malloc(config->bluedot_url_queue * sizeof(struct _Sagan_Bluedot_URL_Queue));
+
+    if ( SaganBluedotURLQueue == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotURLQueue. Abort!", __FILE__, __LINE__);
         }
 
-    pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-    deleted_count = counters->bluedot_ip_cache_count - new_bluedot_ip_max_cache;
-    counters->bluedot_ip_cache_count = new_bluedot_ip_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    memset(SaganBluedotURLQueue, 0, config->bluedot_url_queue * sizeof(_Sagan_Bluedot_URL_Queue));
+
+    /* Bluedot Filename Queue */
+
+    SaganBluedotFilenameQueue = malloc(config->bluedot_filename_queue * sizeof(struct _Sagan_Bluedot_Filename_Queue));
+
+    if ( SaganBluedotFilenameQueue == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotFilenameQueue. Abort!", __FILE__, __LINE__);
+        }
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d IP addresses from Bluedot cache. New IP cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_ip_cache_count);
+    memset(SaganBluedotFilenameQueue, 0, config->bluedot_filename_queue * sizeof(_Sagan_Bluedot_Filename_Queue));
 
-    /* Clean hash cache */
+    /* Bluedot JA3 Queue */
 
-    deleted_count = 0;
+    SaganBluedotJA3Queue = malloc(config->bluedot_ja3_queue * sizeof(struct _Sagan_Bluedot_JA3_Queue));
 
-    for (i=0; i < config->bluedot_hash_max_cache; i++ )
+    if ( SaganBluedotJA3Queue == NULL )
         {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotJA3Queue. Abort!", __FILE__, __LINE__);
+        }
 
-            if ( ( timeint - SaganBluedotHashCache[i].cache_utime ) > config->bluedot_timeout )
-                {
+    memset(SaganBluedotJA3Queue, 0, config->bluedot_ja3_queue * sizeof(_Sagan_Bluedot_JA3_Queue));
 
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting Hash address from cache -> %s",  __FILE__, __LINE__, SaganBluedotHashCache[i].hash);
-                        }
+    /* Events waiting on a lookup.  The events themselves are allocated
+       when first used */
 
-                    pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
+    SaganBluedotDeferred = malloc(config->bluedot_max_deferred * sizeof(struct _Sagan_Bluedot_Deferred));
 
-                    memset(SaganBluedotHashCache[i].hash, 0, SHA256_HASH_SIZE+1);
-                    SaganBluedotHashCache[i].cache_utime = 0;
-                    SaganBluedotHashCache[i].alertid = 0;
+    if ( SaganBluedotDeferred == NULL && config->bluedot_max_deferred != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotDeferred. Abort!", __FILE__, __LINE__);
+        }
 
-                    pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+    memset(SaganBluedotDeferred, 0, config->bluedot_max_deferred * sizeof(_Sagan_Bluedot_Deferred));
 
-                    deleted_count++;
+}
 
-                }
-            else
-                {
 
-                    new_bluedot_hash_max_cache++;
+/****************************************************************************
+ * Queue helpers.  Each lookup type has its own queue and mutex.  An entry
+ * stays in the queue (WAITING, then ACTIVE) until the lookup thread has
+ * stored the result in the cache.  Identical misses while an entry is in
+ * the queue are joined to it rather than looked up again.
+ ****************************************************************************/
 
-                }
+static pthread_mutex_t *Sagan_Bluedot_Queue_Mutex ( unsigned char type )
+{
+
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
+            return(&SaganProcBluedotIPWorkMutex);
         }
 
-    pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-    deleted_count = counters->bluedot_hash_cache_count - new_bluedot_hash_max_cache;
-    counters->bluedot_hash_cache_count = new_bluedot_hash_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+    else if ( type == BLUEDOT_LOOKUP_HASH )
+        {
+            return(&SaganProcBluedotHashWorkMutex);
+        }
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d hashes from Bluedot cache. New hash cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_hash_cache_count);
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            return(&SaganProcBluedotURLWorkMutex);
+        }
 
-    /* Clean URL cache */
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+        {
+            return(&SaganProcBluedotFilenameWorkMutex);
+        }
 
-    deleted_count = 0;
+    return(&SaganProcBluedotJA3WorkMutex);
+}
 
-    for (i=0; i < config->bluedot_url_max_cache; i++ )
-        {
+static int Sagan_Bluedot_Queue_Size ( unsigned char type )
+{
 
-            if ( ( timeint - SaganBluedotURLCache[i].cache_utime ) > config->bluedot_timeout )
-                {
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
+            return(config->bluedot_ip_queue);
+        }
 
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting URL address from cache -> %s",  __FILE__, __LINE__, SaganBluedotURLCache[i].url);
-                        }
+    else if ( type == BLUEDOT_LOOKUP_HASH )
+        {
+            return(config->bluedot_hash_queue);
+        }
 
-                    pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            return(config->bluedot_url_queue);
+        }
 
-                    memset(SaganBluedotURLCache[i].url, 0, sizeof(SaganBluedotURLCache[i].url));
-                    SaganBluedotURLCache[i].cache_utime = 0;
-                    SaganBluedotURLCache[i].alertid = 0;
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+        {
+            return(config->bluedot_filename_queue);
+        }
 
-                    pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+    return(config->bluedot_ja3_queue);
+}
 
-                    deleted_count++;
+static int *Sagan_Bluedot_Queue_Current ( unsigned char type )
+{
 
-                }
-            else
-                {
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
+            return(&counters->bluedot_ip_queue_current);
+        }
 
-                    new_bluedot_url_max_cache++;
+    else if ( type == BLUEDOT_LOOKUP_HASH )
+        {
+            return(&counters->bluedot_hash_queue_current);
+        }
 
-                }
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            return(&counters->bluedot_url_queue_current);
         }
 
-    pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
-    deleted_count = counters->bluedot_url_cache_count - new_bluedot_url_max_cache;
-    counters->bluedot_url_cache_count = new_bluedot_url_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+        {
+            return(&counters->bluedot_filename_queue_current);
+        }
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d URLs from Bluedot cache. New URL cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_url_cache_count);
+    return(&counters->bluedot_ja3_queue_current);
+}
 
-    /* Clean Filename cache */
+static struct _Sagan_Bluedot_Queue_State *Sagan_Bluedot_Queue_Entry ( unsigned char type, int slot )
+{
 
-    deleted_count = 0;
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
+            return(&SaganBluedotIPQueue[slot].q);
+        }
 
-    for (i=0; i < config->bluedot_filename_max_cache; i++ )
+    else if ( type == BLUEDOT_LOOKUP_HASH )
         {
+            return(&SaganBluedotHashQueue[slot].q);
+        }
 
-            if ( ( timeint - SaganBluedotFilenameCache[i].cache_utime ) > config->bluedot_timeout )
-                {
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            return(&SaganBluedotURLQueue[slot].q);
+        }
 
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting filename from cache -> %s",  __FILE__, __LINE__, SaganBluedotFilenameCache[i].filename);
-                        }
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+        {
+            return(&SaganBluedotFilenameQueue[slot].q);
+        }
 
-                    pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
+    return(&SaganBluedotJA3Queue[slot].q);
+}
 
-                    memset(SaganBluedotFilenameCache[i].filename, 0, sizeof(SaganBluedotFilenameCache[i].filename));
-                    SaganBluedotFilenameCache[i].cache_utime = 0;
-                    SaganBluedotFilenameCache[i].alertid = 0;
+/* The string we send to Bluedot */
 
-                    pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+static char *Sagan_Bluedot_Queue_Key ( unsigned char type, int slot )
+{
 
-                    deleted_count++;
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
+            return(SaganBluedotIPQueue[slot].ipaddr);
+        }
 
-                }
-            else
-                {
+    else if ( type == BLUEDOT_LOOKUP_HASH )
+        {
+            return(SaganBluedotHashQueue[slot].hash);
+        }
 
-                    new_bluedot_filename_max_cache++;
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            return(SaganBluedotURLQueue[slot].url);
+        }
 
-                }
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+        {
+            return(SaganBluedotFilenameQueue[slot].filename);
         }
 
-    pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
-    deleted_count = counters->bluedot_filename_cache_count - new_bluedot_filename_max_cache;
-    counters->bluedot_filename_cache_count = new_bluedot_filename_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+    return(SaganBluedotJA3Queue[slot].ja3);
+}
+
+/****************************************************************************
+ * Sagan_Bluedot_Enqueue - Adds a cache miss to the queue (or joins the
+ * lookup already in flight for it) and wakes the lookup thread.
+ ****************************************************************************/
+
+static void Sagan_Bluedot_Enqueue ( char *data, unsigned char type, unsigned char *ip_convert, _Sagan_Bluedot_Pending *pending )
+{
+
+    pthread_mutex_t *mutex = Sagan_Bluedot_Queue_Mutex(type);
+    int size = Sagan_Bluedot_Queue_Size(type);
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d Filenames from Bluedot cache. New Filename cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_filename_cache_count);
+    struct _Sagan_Bluedot_Queue_State *q = NULL;
 
-    /* Clean JA3 cache */
+    int free_slot = -1;
+    int i;
 
-    deleted_count = 0;
+    pthread_mutex_lock(mutex);
 
-    for (i=0; i < config->bluedot_ja3_max_cache; i++ )
+    for (i=0; i < size; i++)
         {
 
-            if ( ( timeint - SaganBluedotJA3Cache[i].cache_utime ) > config->bluedot_timeout )
+            q = Sagan_Bluedot_Queue_Entry(type, i);
+
+            if ( q->state == BLUEDOT_QUEUE_FREE )
                 {
 
-                    if (debug->debugbluedot)
+                    if ( free_slot == -1 )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting JA3 from cache -> %s",  __FILE__, __LINE__, SaganBluedotJA3Cache[i].ja3);
+                            free_slot = i;
                         }
 
-                    pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
+                    continue;
+                }
 
-                    memset(SaganBluedotJA3Cache[i].ja3, 0, sizeof(SaganBluedotJA3Cache[i].ja3));
-                    SaganBluedotFilenameCache[i].cache_utime = 0;
-                    SaganBluedotFilenameCache[i].alertid = 0;
+            if ( ( type == BLUEDOT_LOOKUP_IP && !memcmp(ip_convert, SaganBluedotIPQueue[i].ip, MAXIPBIT) ) ||
+                    ( type != BLUEDOT_LOOKUP_IP && !strcasecmp(data, Sagan_Bluedot_Queue_Key(type, i)) ) )
+                {
 
-                    pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
+                    if ( pending != NULL )
+                        {
+                            pending->flag = true;
+                            pending->type = type;
+                            pending->slot = i;
+                            pending->ticket = q->ticket;
+                        }
 
-                    deleted_count++;
+                    pthread_mutex_unlock(mutex);
 
-                }
-            else
-                {
+                    Sagan_Counter_Add(bluedot_coalesced, 1);
 
-                    new_bluedot_ja3_max_cache++;
+                    if (debug->debugbluedot)
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Waiting on that lookup.", __FILE__, __LINE__, data);
+                        }
 
+                    return;
                 }
         }
 
-    pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
-    deleted_count = counters->bluedot_ja3_cache_count - new_bluedot_ja3_max_cache;
-    counters->bluedot_ja3_cache_count = new_bluedot_ja3_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
-
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d JA3 hashes from Bluedot cache. New Filename cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_ja3_cache_count);
-
+    if ( free_slot == -1 )
+        {
+            pthread_mutex_unlock(mutex);
+            Sagan_Log(NORMAL, "[%s, line %d] Out of Bluedot queue space for '%s'! Considering increasing queue size!", __FILE__, __LINE__, data);
+            return;
+        }
 
-}
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
+            memcpy(SaganBluedotIPQueue[free_slot].ip, ip_convert, MAXIPBIT);
+            strlcpy(SaganBluedotIPQueue[free_slot].ipaddr, data, sizeof(SaganBluedotIPQueue[free_slot].ipaddr));
+        }
 
-/***************************************************************************
- * Sagan_Bluedot_IP_Lookup - This does the actual Bluedot lookup.  It returns
- * the bluedot_alertid value (0 if not found)
- ***************************************************************************/
+    else if ( type == BLUEDOT_LOOKUP_HASH )
+        {
+            strlcpy(SaganBluedotHashQueue[free_slot].hash, data, sizeof(SaganBluedotHashQueue[free_slot].hash));
+        }
 
-/* type
- *
- * 1 == IP
- * 2 == Hash
- * 3 == URL
- * 4 == Filename
- * 5 == JA3
- */
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            strlcpy(SaganBluedotURLQueue[free_slot].url, data, sizeof(SaganBluedotURLQueue[free_slot].url));
+        }
 
-unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_position, char *bluedot_str, size_t bluedot_size )
-{
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+        {
+            strlcpy(SaganBluedotFilenameQueue[free_slot].filename, data, sizeof(SaganBluedotFilenameQueue[free_slot].filename));
+        }
 
-    unsigned char ip_convert[MAXIPBIT] = { 0 };
+    else if ( type == BLUEDOT_LOOKUP_JA3 )
+        {
+            strlcpy(SaganBluedotJA3Queue[free_slot].ja3, data, sizeof(SaganBluedotJA3Queue[free_slot].ja3));
+        }
 
-    char tmpurl[1024] = { 0 };
-    char tmpdeviceid[64] = { 0 };
-    char bluedot_json[1024] = { 0 };
+    q = Sagan_Bluedot_Queue_Entry(type, free_slot);
+    q->state = BLUEDOT_QUEUE_WAITING;
+    q->ticket = __atomic_add_fetch(&bluedot_ticket, 1, __ATOMIC_SEQ_CST);
 
-    CURL *curl;
-    //CURLcode res;
+    if ( pending != NULL )
+        {
+            pending->flag = true;
+            pending->type = type;
+            pending->slot = free_slot;
+            pending->ticket = q->ticket;
+        }
 
-    struct curl_slist *headers = NULL;
-    char *response=NULL;
+    __atomic_add_fetch(Sagan_Bluedot_Queue_Current(type), 1, __ATOMIC_SEQ_CST);
 
-    struct json_object *json_in = NULL;
-    json_object *string_obj;
+    pthread_mutex_unlock(mutex);
 
-    const char *cat=NULL;
-    const char *cdate_utime=NULL;
-    const char *mdate_utime=NULL;
+    /* Wake up the lookup thread */
 
-    uint64_t cdate_utime_u32;
-    uint64_t mdate_utime_u32;
+    pthread_mutex_lock(&SaganBluedotLookupMutex);
+    __atomic_add_fetch(&bluedot_waiting, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&SaganBluedotLookupCond);
+    pthread_mutex_unlock(&SaganBluedotLookupMutex);
 
-    signed char bluedot_alertid = 0;		/* -128 to 127 */
-    int i;
+}
 
-    char tmp[64] = { 0 };
+/****************************************************************************
+ * Sagan_Bluedot_Complete - Called by the lookup thread when a lookup is
+ * finished (good or bad).  Releases any events deferred on it and frees
+ * the queue entry.
+ ****************************************************************************/
 
-    char  timet[20] = { 0 };
-    time_t t;
-    struct tm *now=NULL;
+static void Sagan_Bluedot_Complete ( unsigned char type, int slot )
+{
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    pthread_mutex_t *mutex = Sagan_Bluedot_Queue_Mutex(type);
+    struct _Sagan_Bluedot_Queue_State *q = Sagan_Bluedot_Queue_Entry(type, slot);
 
-    uint64_t epoch_time = atol(timet);
+    int i;
 
-    /* Check IP TTL for Bluedot */
+    pthread_mutex_lock(mutex);
 
-    if ( bluedot_dns_global == 0 && epoch_time - config->bluedot_dns_last_lookup > config->bluedot_dns_ttl )
+    if ( __atomic_load_n(&bluedot_deferred_used, __ATOMIC_SEQ_CST) > 0 )
         {
 
-            if ( debug->debugbluedot )
-                {
-                    Sagan_Log(DEBUG, "[%s, line %d] Bluedot host TTL of %d seconds reached.  Doing new lookup for '%s'.", __FILE__, __LINE__, config->bluedot_dns_ttl, config->bluedot_host);
-                }
-
-
-            pthread_mutex_lock(&SaganProcBluedotWorkMutex);
-            bluedot_dns_global = 1;
+            pthread_mutex_lock(&SaganProcBluedotDeferMutex);
 
-            i = DNS_Lookup( config->bluedot_host, tmp, sizeof(tmp) );
-
-            if ( i != 0 )
-                {
-                    Sagan_Log(WARN, "[%s, line %d] Cannot lookup DNS for '%s'.  Staying with old value of %s.", __FILE__, __LINE__, config->bluedot_host, config->bluedot_ip);
-                }
-            else
+            for (i=0; i < config->bluedot_max_deferred; i++)
                 {
 
-                    strlcpy(config->bluedot_ip, tmp, sizeof(config->bluedot_ip));
-
-                    if ( debug->debugbluedot )
+                    if ( SaganBluedotDeferred[i].used == true && SaganBluedotDeferred[i].ready == false &&
+                            SaganBluedotDeferred[i].type == type && SaganBluedotDeferred[i].slot == slot &&
+                            SaganBluedotDeferred[i].ticket == q->ticket )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] Bluedot host IP is now: %s", __FILE__, __LINE__, config->bluedot_ip);
+                            SaganBluedotDeferred[i].ready = true;
+                            __atomic_add_fetch(&counters->bluedot_deferred_ready, 1, __ATOMIC_SEQ_CST);
                         }
-
                 }
 
-            config->bluedot_dns_last_lookup = epoch_time;
-            bluedot_dns_global = 0;
-            pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
+            pthread_mutex_unlock(&SaganProcBluedotDeferMutex);
 
         }
 
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
+            memset(&SaganBluedotIPQueue[slot], 0, sizeof(_Sagan_Bluedot_IP_Queue));
+        }
 
-    /************************************************************************/
-    /* Lookup types                                                         */
-    /************************************************************************/
+    else if ( type == BLUEDOT_LOOKUP_HASH )
+        {
+            memset(&SaganBluedotHashQueue[slot], 0, sizeof(_Sagan_Bluedot_Hash_Queue));
+        }
 
-    /* IP Address Lookup */
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            memset(&SaganBluedotURLQueue[slot], 0, sizeof(_Sagan_Bluedot_URL_Queue));
+        }
 
-    if ( type == BLUEDOT_LOOKUP_IP )
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
         {
+            memset(&SaganBluedotFilenameQueue[slot], 0, sizeof(_Sagan_Bluedot_Filename_Queue));
+        }
 
-            /* For some reason, when I try to use the IP2Bit passed from engine.c,  it
-               is sometimes 16 bytes off!  Not idea why and doesn't happen all the time.
-               We call IP2Bit here to prevent it from getting off :(  Champ 2019/05/14 */
+    else if ( type == BLUEDOT_LOOKUP_JA3 )
+        {
+            memset(&SaganBluedotJA3Queue[slot], 0, sizeof(_Sagan_Bluedot_JA3_Queue));
+        }
 
-            IP2Bit(data, ip_convert);
+    __atomic_sub_fetch(Sagan_Bluedot_Queue_Current(type), 1, __ATOMIC_SEQ_CST);
 
-            if ( is_notroutable(ip_convert) )
-                {
+    pthread_mutex_unlock(mutex);
 
-                    if ( debug->debugbluedot )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] %s is RFC1918, link local or invalid.", __FILE__, __LINE__, data);
-                        }
+}
 
-                    return(false);
-                }
+/****************************************************************************
+ * Sagan_Bluedot_Defer - Parks a copy of the event until the lookup in
+ * "pending" finishes.  Returns false if there is no room,  in which case
+ * the caller fails open.
+ ****************************************************************************/
 
-            for ( i = 0; i < counters->bluedot_skip_count; i++ )
-                {
+bool Sagan_Bluedot_Defer ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int rule_position, _Sagan_Bluedot_Pending *pending )
+{
 
-                    if ( is_inrange(ip_convert, (unsigned char *)&Bluedot_Skip[i].range, 1) )
-                        {
+    pthread_mutex_t *mutex = Sagan_Bluedot_Queue_Mutex(pending->type);
+    struct _Sagan_Bluedot_Queue_State *q = NULL;
 
-                            if ( debug->debugbluedot )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] IP address %s is in Bluedot 'skip_networks'. Skipping lookup.", __FILE__, __LINE__, data);
-                                }
+    bool ready;
+    int i;
 
-                            return(false);
-                        }
+    pthread_mutex_lock(mutex);
 
+    /* The lookup might have finished between the cache check and now */
+
+    q = Sagan_Bluedot_Queue_Entry(pending->type, pending->slot);
+    ready = ( q->state == BLUEDOT_QUEUE_FREE || q->ticket != pending->ticket );
+
+    pthread_mutex_lock(&SaganProcBluedotDeferMutex);
+
+    for (i=0; i < config->bluedot_max_deferred; i++)
+        {
+
+            if ( SaganBluedotDeferred[i].used == true )
+                {
+                    continue;
                 }
 
+            /* Events are large,  so they are only allocated when first needed
+               and then kept for reuse */
 
-            for (i=0; i<config->bluedot_ip_max_cache; i++)
+            if ( SaganBluedotDeferred[i].event == NULL )
                 {
 
-                    if (!memcmp( ip_convert, SaganBluedotIPCache[i].ip, MAXIPBIT ))
-                        {
+                    SaganBluedotDeferred[i].event = malloc(sizeof(struct _Sagan_Proc_Syslog));
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled %s from Bluedot cache with category of \"%d\". [cdate_epoch: %d / mdate_epoch: %d]", __FILE__, __LINE__, data, SaganBluedotIPCache[i].alertid, SaganBluedotIPCache[i].cdate_utime, SaganBluedotIPCache[i].mdate_utime);
-                                }
+                    if ( SaganBluedotDeferred[i].event == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotDeferred. Abort!", __FILE__, __LINE__);
+                        }
+                }
 
-                            bluedot_alertid = SaganBluedotIPCache[i].alertid;
+            memcpy(SaganBluedotDeferred[i].event, SaganProcSyslog_LOCAL, sizeof(struct _Sagan_Proc_Syslog));
 
-                            if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_mdate_effective_period != 0 )
-                                {
+            SaganBluedotDeferred[i].used = true;
+            SaganBluedotDeferred[i].ready = ready;
+            SaganBluedotDeferred[i].rule_position = rule_position;
+            SaganBluedotDeferred[i].sid = rulestruct[rule_position].s_sid;
+            SaganBluedotDeferred[i].type = pending->type;
+            SaganBluedotDeferred[i].slot = pending->slot;
+            SaganBluedotDeferred[i].ticket = pending->ticket;
 
-                                    if ( ( epoch_time - SaganBluedotIPCache[i].mdate_utime ) > rulestruct[rule_position].bluedot_mdate_effective_period )
-                                        {
+            __atomic_add_fetch(&bluedot_deferred_used, 1, __ATOMIC_SEQ_CST);
 
-                                            if ( debug->debugbluedot )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] From Bluedot Cache - mdate_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_mdate_effective_period);
-                                                }
+            if ( ready == true )
+                {
+                    __atomic_add_fetch(&counters->bluedot_deferred_ready, 1, __ATOMIC_SEQ_CST);
+                }
 
-                                            __atomic_add_fetch(&counters->bluedot_mdate_cache, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&SaganProcBluedotDeferMutex);
+            pthread_mutex_unlock(mutex);
 
-                                            bluedot_alertid = 0;
-                                        }
-                                }
+            Sagan_Counter_Add(bluedot_deferred, 1);
 
-                            else if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_cdate_effective_period != 0 )
-                                {
+            return(true);
+        }
 
-                                    if ( ( epoch_time - SaganBluedotIPCache[i].cdate_utime ) > rulestruct[rule_position].bluedot_cdate_effective_period )
-                                        {
+    pthread_mutex_unlock(&SaganProcBluedotDeferMutex);
+    pthread_mutex_unlock(mutex);
 
-                                            if ( debug->debugbluedot )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] ctime_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_cdate_effective_period);
-                                                }
+    Sagan_Counter_Add(bluedot_deferred_drop, 1);
 
-                                            __atomic_add_fetch(&counters->bluedot_cdate_cache, 1, __ATOMIC_SEQ_CST);
+    return(false);
+}
 
-                                            bluedot_alertid = 0;
-                                        }
-                                }
+/****************************************************************************
+ * Sagan_Bluedot_Replay - Hands back a deferred event whose lookup has
+ * finished.  The event is copied into SaganProcSyslog_LOCAL and the rule
+ * to re-run is returned.  Returns -1 when nothing is ready.
+ ****************************************************************************/
 
-                            __atomic_add_fetch(&counters->bluedot_ip_cache_hit, 1, __ATOMIC_SEQ_CST);
+int Sagan_Bluedot_Replay ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+{
 
-                            snprintf(bluedot_str, bluedot_size, "%s",  SaganBluedotIPCache[i].bluedot_json);
-                            return(bluedot_alertid);
+    int rule_position = -1;
+    int i;
 
-                        }
+    if ( __atomic_load_n(&counters->bluedot_deferred_ready, __ATOMIC_SEQ_CST) == 0 )
+        {
+            return(-1);
+        }
 
-                }
+    pthread_mutex_lock(&SaganProcBluedotDeferMutex);
 
-            /* Check Bluedot IP Queue,  make sure we aren't looking up something that is already being looked up */
+    for (i=0; i < config->bluedot_max_deferred; i++)
+        {
 
-            for (i=0; i < config->bluedot_ip_queue; i++)
+            if ( SaganBluedotDeferred[i].used == false || SaganBluedotDeferred[i].ready == false )
                 {
-                    if ( !memcmp(ip_convert, SaganBluedotIPQueue[i].ip, MAXIPBIT ))
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s (%u) is already being looked up. Skipping....", __FILE__, __LINE__, data, SaganBluedotIPQueue[i].ip);
-                                }
-
-                            return(false);
-                        }
+                    continue;
                 }
 
-            /* If not in Bluedot IP queue,  add it */
+            SaganBluedotDeferred[i].used = false;
+            SaganBluedotDeferred[i].ready = false;
+            __atomic_sub_fetch(&bluedot_deferred_used, 1, __ATOMIC_SEQ_CST);
 
-            if ( counters->bluedot_ip_queue_current >= config->bluedot_ip_queue )
-                {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of IP queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
-                }
+            __atomic_sub_fetch(&counters->bluedot_deferred_ready, 1, __ATOMIC_SEQ_CST);
 
+            /* Rules may have been reloaded while we waited */
 
-            for (i=0; i < config->bluedot_ip_queue; i++)
+            if ( SaganBluedotDeferred[i].rule_position >= counters->rulecount ||
+                    rulestruct[SaganBluedotDeferred[i].rule_position].s_sid != SaganBluedotDeferred[i].sid )
                 {
+                    continue;
+                }
 
-                    /* Find an empty slot */
+            memcpy(SaganProcSyslog_LOCAL, SaganBluedotDeferred[i].event, sizeof(struct _Sagan_Proc_Syslog));
+            rule_position = SaganBluedotDeferred[i].rule_position;
+            break;
+        }
 
-                    if ( SaganBluedotIPQueue[i].ip[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
+    pthread_mutex_unlock(&SaganProcBluedotDeferMutex);
 
-                            memcpy(SaganBluedotIPQueue[i].ip, ip_convert, MAXIPBIT);
-                            counters->bluedot_ip_queue_current++;
+    if ( rule_position != -1 )
+        {
+            Sagan_Counter_Add(bluedot_deferred_replay, 1);
+        }
 
-                            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    return(rule_position);
+}
 
-                            break;
+/****************************************************************************
+ * Sagan_Bluedot_Load_Cat() - load all "Bluedot" categories in memory
+ ****************************************************************************/
 
-                        }
-                }
+void Sagan_Bluedot_Load_Cat(void)
+{
 
+    FILE *bluedot_cat_file;
+    char buf[1024] = { 0 };
+    char *saveptr = NULL;
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_IP_LOOKUP_URL, data);
+    char *bluedot_tok1 = NULL;
+    char *bluedot_tok2 = NULL;
 
-        }  /* BLUEDOT_LOOKUP_IP */
+    if (( bluedot_cat_file = fopen(config->bluedot_cat, "r" )) == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] No Bluedot categories list to load (%s)!", __FILE__, __LINE__, config->bluedot_cat);
+        }
 
-    else if ( type == BLUEDOT_LOOKUP_HASH )
+    while(fgets(buf, 1024, bluedot_cat_file) != NULL)
         {
 
-            for (i=0; i<counters->bluedot_hash_cache_count; i++)
-                {
+            /* Skip comments and blank linkes */
 
-                    if (!strcasecmp(data, SaganBluedotHashCache[i].hash))
-                        {
+            if (buf[0] == '#' || buf[0] == 10 || buf[0] == ';' || buf[0] == 32)
+                {
+                    continue;
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file hash '%s' from Bluedot hash cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotHashCache[i].alertid);
-                                }
+                }
+            else
+                {
 
-                            __atomic_add_fetch(&counters->bluedot_hash_cache_hit, 1, __ATOMIC_SEQ_CST);
+                    /* Allocate memory for references,  not comments */
 
-                            snprintf(bluedot_str, bluedot_size, "%s", SaganBluedotHashCache[i].bluedot_json);
-                            return(SaganBluedotHashCache[i].alertid);
+                    SaganBluedotCatList = (_Sagan_Bluedot_Cat_List *) realloc(SaganBluedotCatList, (counters->bluedot_cat_count+1) * sizeof(_Sagan_Bluedot_Cat_List));
 
+                    if ( SaganBluedotCatList == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for SaganBluedotCatList. Abort!", __FILE__, __LINE__);
                         }
 
-                }
+                    memset(&SaganBluedotCatList[counters->bluedot_cat_count], 0, sizeof(_Sagan_Bluedot_Cat_List));
 
-            /* Check Bluedot Hash Queue,  make sure we aren't looking up something that is already being looked up */
+                    /* Normalize the list for later use.  Better to do this here than when processing rules */
 
-            for (i=0; i < config->bluedot_hash_queue; i++)
-                {
-                    if ( !strcasecmp(data, SaganBluedotHashQueue[i].hash ) )
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
-                                }
+                    bluedot_tok1 = strtok_r(buf, "|", &saveptr);
 
-                            return(false);
+                    if ( bluedot_tok1 == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Bluedot categories file appears to be malformed.", __FILE__, __LINE__);
                         }
-                }
-
 
-            if ( counters->bluedot_hash_queue_current >= config->bluedot_hash_queue )
-                {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of hash queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
-                }
+                    Remove_Return(bluedot_tok1);
+                    Remove_Spaces(bluedot_tok1);
 
-            /* If not in Bluedot Hash queue,  add it */
+                    SaganBluedotCatList[counters->bluedot_cat_count].cat_number = atoi(bluedot_tok1);
 
-            for (i=0; i < config->bluedot_ip_queue; i++)
-                {
-                    /* Find an empty slot */
+                    bluedot_tok2 = strtok_r(NULL, "|", &saveptr);
 
-                    if ( SaganBluedotHashQueue[i].hash[0] == 0 )
+                    if ( bluedot_tok2 == NULL )
                         {
-                            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
+                            Sagan_Log(ERROR, "[%s, line %d] Bluedot categories file appears to be malformed.", __FILE__, __LINE__);
+                        }
 
-                            strlcpy(SaganBluedotHashQueue[i].hash, data, sizeof(SaganBluedotHashQueue[i].hash));
-                            counters->bluedot_hash_queue_current++;
+                    Remove_Return(bluedot_tok2);
+                    Remove_Spaces(bluedot_tok2);
+                    To_LowerC(bluedot_tok2);
 
-                            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+                    strlcpy(SaganBluedotCatList[counters->bluedot_cat_count].cat, bluedot_tok2, sizeof(SaganBluedotCatList[counters->bluedot_cat_count].cat));
 
-                            break;
+                    __atomic_add_fetch(&counters->bluedot_cat_count, 1, __ATOMIC_SEQ_CST);
 
-                        }
                 }
-
-
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_HASH_LOOKUP_URL, data);
         }
 
-    else if ( type == BLUEDOT_LOOKUP_URL )
-        {
-
-            for (i=0; i<counters->bluedot_url_cache_count; i++)
-                {
-
-                    if (!strcasecmp(data, SaganBluedotURLCache[i].url))
-                        {
+}
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file URL '%s' from Bluedot URL cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotURLCache[i].alertid);
-                                }
+/****************************************************************************
+ * write_callback_func() - Callback for data received via libcurl.  Data
+ * may arrive in more than one piece,  so it is appended to the transfer.
+ ****************************************************************************/
 
-                            __atomic_add_fetch(&counters->bluedot_url_cache_hit, 1, __ATOMIC_SEQ_CST);
+static size_t write_callback_func(void *buffer, size_t size, size_t nmemb, void *userp)
+{
 
-                            snprintf(bluedot_str, bluedot_size, "%s", SaganBluedotURLCache[i].bluedot_json);
-                            return(SaganBluedotURLCache[i].alertid);
+    struct _Sagan_Bluedot_Transfer *transfer = (struct _Sagan_Bluedot_Transfer *)userp;
+    size_t len = size * nmemb;
 
-                        }
+    if ( transfer->response_len + len > BLUEDOT_RESPONSE_MAX )
+        {
+            transfer->response_error = true;
+            return(0);				/* Aborts the transfer */
+        }
 
+    memcpy(transfer->response + transfer->response_len, buffer, len);
+    transfer->response_len += len;
 
-                }
+    return(len);
+}
 
-            /* Check Bluedot Hash Queue,  make sure we aren't looking up something that is already being looked up */
+/****************************************************************************
+ * Sagan_Bluedot_Check_Cache_Time() - Sweeps expired entries out of the
+ * caches once every "cache_timeout".  Full caches evict on their own.
+ ****************************************************************************/
 
-            for (i=0; i < config->bluedot_url_queue; i++)
-                {
-                    if ( !strcasecmp(data, SaganBluedotURLQueue[i].url ) )
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
-                                }
+void Sagan_Bluedot_Check_Cache_Time (void)
+{
 
-                            return(false);
-                        }
-                }
+    uint64_t epoch_time = Return_Epoch();
 
+    if ( epoch_time > ( config->bluedot_last_time + config->bluedot_timeout ) )
+        {
 
-            /* If not in Bluedot URL queue,  add it */
+            /* Only one thread cleans,  the rest carry on */
 
-            if ( counters->bluedot_url_queue_current >= config->bluedot_url_queue )
+            if ( pthread_mutex_trylock(&SaganProcBluedotWorkMutex) != 0 )
                 {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of URL queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
+                    return;
                 }
 
-
-            for (i=0; i < config->bluedot_url_queue; i++)
+            if ( epoch_time > ( config->bluedot_last_time + config->bluedot_timeout ) )
                 {
+                    Sagan_Log(NORMAL, "Bluedot cache timeout reached %d minutes.  Cleaning up.", config->bluedot_timeout / 60);
+                    Sagan_Bluedot_Clean_Cache();
+                }
 
-                    /* Find an empty slot */
+            pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
 
-                    if ( SaganBluedotURLQueue[i].url[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
+        }
 
-                            strlcpy(SaganBluedotURLQueue[i].url, data, sizeof(SaganBluedotURLQueue[i].url));
-                            counters->bluedot_url_queue_current++;
+}
 
-                            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+/****************************************************************************
+ * Sagan_Bluedot_Clean_Cache - Cleans old Bluedot entries over the
+ * specified "cache_timeout".
+ ****************************************************************************/
 
-                            break;
+void Sagan_Bluedot_Clean_Cache ( void )
+{
 
-                        }
-                }
+    uint64_t deleted_count=0;
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_URL_LOOKUP_URL, data);
+    uint64_t timeint = Return_Epoch();
 
+    if (debug->debugbluedot)
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Sagan/Bluedot cache clean time has been reached.", __FILE__, __LINE__);
+            Sagan_Log(DEBUG, "[%s, line %d] ----------------------------------------------------------------------", __FILE__, __LINE__);
         }
 
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
-        {
+    config->bluedot_last_time = timeint;
 
-            for (i=0; i<counters->bluedot_filename_cache_count; i++)
-                {
+    deleted_count = Sagan_Bluedot_Cache_Clean(BLUEDOT_LOOKUP_IP, timeint);
+    Sagan_Log(NORMAL, "[%s, line %d] Deleted %" PRIu64 " IP addresses from Bluedot cache. New IP cache count is %" PRIu64 ".",__FILE__, __LINE__, deleted_count, counters->bluedot_ip_cache_count);
 
-                    if (!strcasecmp(data, SaganBluedotFilenameCache[i].filename))
-                        {
+    deleted_count = Sagan_Bluedot_Cache_Clean(BLUEDOT_LOOKUP_HASH, timeint);
+    Sagan_Log(NORMAL, "[%s, line %d] Deleted %" PRIu64 " hashes from Bluedot cache. New hash cache count is %" PRIu64 ".",__FILE__, __LINE__, deleted_count, counters->bluedot_hash_cache_count);
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file filename '%s' from Bluedot filename cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotFilenameCache[i].alertid);
-                                }
+    deleted_count = Sagan_Bluedot_Cache_Clean(BLUEDOT_LOOKUP_URL, timeint);
+    Sagan_Log(NORMAL, "[%s, line %d] Deleted %" PRIu64 " URLs from Bluedot cache. New URL cache count is %" PRIu64 ".",__FILE__, __LINE__, deleted_count, counters->bluedot_url_cache_count);
 
-                            __atomic_add_fetch(&counters->bluedot_filename_cache_hit, 1, __ATOMIC_SEQ_CST);
+    deleted_count = Sagan_Bluedot_Cache_Clean(BLUEDOT_LOOKUP_FILENAME, timeint);
+    Sagan_Log(NORMAL, "[%s, line %d] Deleted %" PRIu64 " Filenames from Bluedot cache. New Filename cache count is %" PRIu64 ".",__FILE__, __LINE__, deleted_count, counters->bluedot_filename_cache_count);
 
-                            snprintf(bluedot_str, bluedot_size, "%s",  SaganBluedotFilenameCache[i].bluedot_json);
-                            return(SaganBluedotFilenameCache[i].alertid);
-
-                        }
+    deleted_count = Sagan_Bluedot_Cache_Clean(BLUEDOT_LOOKUP_JA3, timeint);
+    Sagan_Log(NORMAL, "[%s, line %d] Deleted %" PRIu64 " JA3 hashes from Bluedot cache. New JA3 cache count is %" PRIu64 ".",__FILE__, __LINE__, deleted_count, counters->bluedot_ja3_cache_count);
 
-                }
+}
 
-            /* Check Bluedot File Queue,  make sure we aren't looking up something that is already being looked up */
+/***************************************************************************
+ * Sagan_Bluedot_Lookup - Checks the Bluedot cache.  It returns the
+ * bluedot_alertid value (0 if not found).  On a cache miss the item is
+ * handed to the lookup thread and "pending" (if not NULL) is filled in so
+ * the caller can wait on the result.  This never blocks on the network.
+ ***************************************************************************/
 
-            for (i=0; i < config->bluedot_filename_queue; i++)
-                {
-                    if ( !strcasecmp(SaganBluedotFilenameQueue[i].filename, data ) )
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
-                                }
+/* type
+ *
+ * 1 == IP
+ * 2 == Hash
+ * 3 == URL
+ * 4 == Filename
+ * 5 == JA3
+ */
 
-                            return(false);
-                        }
-                }
+unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_position, char *bluedot_str, size_t bluedot_size, _Sagan_Bluedot_Pending *pending )
+{
 
+    unsigned char ip_convert[MAXIPBIT] = { 0 };
 
-            /* If not in Bluedot Filename queue,  add it */
+    signed char bluedot_alertid = 0;		/* -128 to 127 */
 
-            if ( counters->bluedot_filename_queue_current >= config->bluedot_filename_queue )
-                {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of filename queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
-                }
+    char key[8192];
+    uint16_t key_len = 0;
+    struct _Sagan_Bluedot_Cache_Entry verdict = { 0 };
 
+    uint64_t epoch_time = Return_Epoch();
 
-            for (i=0; i < config->bluedot_filename_queue; i++)
-                {
+    /************************************************************************/
+    /* Lookup types                                                         */
+    /************************************************************************/
 
-                    /* Find an empty slot */
+    /* IP Address Lookup */
 
-                    if ( SaganBluedotFilenameQueue[i].filename[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
 
-                            strlcpy(SaganBluedotFilenameQueue[i].filename, data, sizeof(SaganBluedotFilenameQueue[i].filename));
-                            counters->bluedot_filename_queue_current++;
+            /* For some reason, when I try to use the IP2Bit passed from engine.c,  it
+               is sometimes 16 bytes off!  Not idea why and doesn't happen all the time.
+               We call IP2Bit here to prevent it from getting off :(  Champ 2019/05/14 */
 
-                            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+            IP2Bit(data, ip_convert);
 
-                            break;
+            if ( is_notroutable(ip_convert) )
+                {
 
+                    if ( debug->debugbluedot )
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] %s is RFC1918, link local or invalid.", __FILE__, __LINE__, data);
                         }
-                }
-
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_FILENAME_LOOKUP_URL, data);
-        }
 
-    else if ( type == BLUEDOT_LOOKUP_JA3 )
-        {
+                    return(false);
+                }
 
-            for (i=0; i<counters->bluedot_ja3_cache_count; i++)
+            if ( Sagan_Radix_Match( Sagan_Radix_Get(&Bluedot_Skip), ip_convert ) )
                 {
 
-                    if (!strcasecmp(data, SaganBluedotJA3Cache[i].ja3))
+                    if ( debug->debugbluedot )
                         {
+                            Sagan_Log(DEBUG, "[%s, line %d] IP address %s is in Bluedot 'skip_networks'. Skipping lookup.", __FILE__, __LINE__, data);
+                        }
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file JA3 '%s' from Bluedot JA3 cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotJA3Cache[i].alertid);
-                                }
+                    return(false);
+                }
 
-                            __atomic_add_fetch(&counters->bluedot_ja3_cache_hit, 1, __ATOMIC_SEQ_CST);
+        }  /* BLUEDOT_LOOKUP_IP */
 
-                            snprintf(bluedot_str, bluedot_size, "%s",  SaganBluedotJA3Cache[i].bluedot_json);
-                            return(SaganBluedotJA3Cache[i].alertid);
+    key_len = Sagan_Bluedot_Cache_Key(type, data, ip_convert, key, sizeof(key));
 
-                        }
+    if ( Sagan_Bluedot_Cache_Get(type, key, key_len, epoch_time, &verdict, bluedot_str, bluedot_size) )
+        {
 
+            if (debug->debugbluedot)
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Pulled '%s' from Bluedot cache with category of \"%d\". [cdate_epoch: %" PRIu64 " / mdate_epoch: %" PRIu64 "]", __FILE__, __LINE__, data, verdict.alertid, verdict.cdate_utime, verdict.mdate_utime);
                 }
 
-            /* Check Bluedot JA3 Queue,  make sure we aren't looking up something that is already being looked up */
+            bluedot_alertid = verdict.alertid;
 
-            for (i=0; i < config->bluedot_ja3_queue; i++)
+            if ( type == BLUEDOT_LOOKUP_IP && bluedot_alertid != 0 && rulestruct[rule_position].bluedot_mdate_effective_period != 0 )
                 {
-                    if ( !strcasecmp(SaganBluedotJA3Queue[i].ja3, data ) )
+
+                    if ( ( epoch_time - verdict.mdate_utime ) > rulestruct[rule_position].bluedot_mdate_effective_period )
                         {
-                            if (debug->debugbluedot)
+
+                            if ( debug->debugbluedot )
                                 {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
+                                    Sagan_Log(DEBUG, "[%s, line %d] From Bluedot Cache - mdate_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_mdate_effective_period);
                                 }
 
-                            return(false);
-                        }
-                }
-
-
-            /* If not in Bluedot JA3 queue,  add it */
+                            Sagan_Counter_Add(bluedot_mdate_cache, 1);
 
-            if ( counters->bluedot_ja3_queue_current >= config->bluedot_ja3_queue )
-                {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of JA3 queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
+                            bluedot_alertid = 0;
+                        }
                 }
 
-
-            for (i=0; i < config->bluedot_ja3_queue; i++)
+            else if ( type == BLUEDOT_LOOKUP_IP && bluedot_alertid != 0 && rulestruct[rule_position].bluedot_cdate_effective_period != 0 )
                 {
 
-                    /* Find an empty slot */
-
-                    if ( SaganBluedotJA3Queue[i].ja3[0] == 0 )
+                    if ( ( epoch_time - verdict.cdate_utime ) > rulestruct[rule_position].bluedot_cdate_effective_period )
                         {
-                            pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
 
-                            strlcpy(SaganBluedotJA3Queue[i].ja3, data, sizeof(SaganBluedotJA3Queue[i].ja3));
-                            counters->bluedot_ja3_queue_current++;
-
-                            pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
+                            if ( debug->debugbluedot )
+                                {
+                                    Sagan_Log(DEBUG, "[%s, line %d] ctime_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_cdate_effective_period);
+                                }
 
-                            break;
+                            Sagan_Counter_Add(bluedot_cdate_cache, 1);
 
+                            bluedot_alertid = 0;
                         }
                 }
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_FILENAME_LOOKUP_URL, data);
-        }
+            return(bluedot_alertid);
 
+        }
 
+    /* Not in cache.  Queue it up for the lookup thread */
 
-    snprintf(tmpdeviceid, sizeof(tmpdeviceid), "X-BLUEDOT-DEVICEID: %s", config->bluedot_device_id);
+    Sagan_Bluedot_Enqueue(data, type, ip_convert, pending);
 
-    /* Do the Bluedot API call */
+    return(false);
+}
 
-    curl = curl_easy_init();
+/****************************************************************************
+ * Sagan_Bluedot_Store - Parses a Bluedot reply and adds it to the cache.
+ * Called from the lookup thread.
+ ****************************************************************************/
 
-    if (curl)
-        {
+static void Sagan_Bluedot_Store ( unsigned char type, int slot, char *response )
+{
 
-            curl_easy_setopt(curl, CURLOPT_URL, tmpurl);
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback_func);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-            curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);    /* WIll send SIGALRM if not set */
+    char *data = Sagan_Bluedot_Queue_Key(type, slot);
+    char bluedot_json[BLUEDOT_JSON_SIZE] = { 0 };
 
-            headers = NULL;
+    struct json_object *json_in = NULL;
+    json_object *string_obj;
 
-            headers = curl_slist_append (headers, BLUEDOT_PROCESSOR_USER_AGENT);
-            headers = curl_slist_append (headers, tmpdeviceid);
-//	    headers = curl_slist_append (headers, "X-Bluedot-Verbose: 1");		/* For more verbose output */
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers );
-            //res = curl_easy_perform(curl);
-            (void)curl_easy_perform(curl);
-        }
+    const char *cat=NULL;
+    const char *cdate_utime=NULL;
+    const char *mdate_utime=NULL;
 
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
-    curl_global_cleanup();
+    uint64_t cdate_utime_u32 = 0;
+    uint64_t mdate_utime_u32 = 0;
 
-    if ( response == NULL )
-        {
-            Sagan_Log(WARN, "[%s, line %d] Bluedot returned a empty \"response\".", __FILE__, __LINE__);
+    signed char bluedot_alertid = 0;		/* -128 to 127 */
 
-            __atomic_add_fetch(&counters->bluedot_error_count, 1, __ATOMIC_SEQ_CST);
+    char key[8192];
+    uint16_t key_len = 0;
 
-            return(false);
-        }
+    uint64_t epoch_time = Return_Epoch();
 
     Remove_Return(response);
     json_in = json_tokener_parse(response);
 
+    if ( json_in == NULL )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Bluedot returned invalid JSON for '%s'.", __FILE__, __LINE__, data);
+            Sagan_Counter_Add(bluedot_error_count, 1);
+            return;
+        }
+
     strlcpy(bluedot_json, response, sizeof(bluedot_json));              /* Returned for alerts */
 
     if ( type == BLUEDOT_LOOKUP_IP )
@@ -1339,170 +1423,407 @@ unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_pos
         {
             Sagan_Log(WARN, "Bluedot return a qipcode category.");
 
-            __atomic_add_fetch(&counters->bluedot_error_count, 1, __ATOMIC_SEQ_CST);
+            Sagan_Counter_Add(bluedot_error_count, 1);
 
-            return(false);
+            json_object_put(json_in);
+            return;
         }
 
-    /* strtok_r() doesn't like const char *cat */
-
     bluedot_alertid  = atoi(cat);
 
+    json_object_put(json_in);       		/* Clear json_in as we're done with it */
+
     if ( debug->debugbluedot)
         {
-            Sagan_Log(DEBUG, "[%s, line %d] Bluedot return category \"%d\" for %s. [cdate_epoch: %d / mdate_epoch: %d]", __FILE__, __LINE__, bluedot_alertid, data, cdate_utime_u32, mdate_utime_u32);
+            Sagan_Log(DEBUG, "[%s, line %d] Bluedot return category \"%d\" for %s. [cdate_epoch: %" PRIu64 " / mdate_epoch: %" PRIu64 "]", __FILE__, __LINE__, bluedot_alertid, data, cdate_utime_u32, mdate_utime_u32);
         }
 
     if ( bluedot_alertid == -1 )
         {
             Sagan_Log(WARN, "Bluedot reports an invalid API key.  Lookup aborted!");
-            counters->bluedot_error_count++;
-            return(false);
+            Sagan_Counter_Add(bluedot_error_count, 1);
+            return;
         }
 
-
     /************************************************************************/
     /* Add entries to cache                                                 */
     /************************************************************************/
 
-    /* IP Address lookup */
-
     if ( type == BLUEDOT_LOOKUP_IP )
         {
+            Sagan_Counter_Add(bluedot_ip_total, 1);
+        }
+
+    else if ( type == BLUEDOT_LOOKUP_HASH )
+        {
+            Sagan_Counter_Add(bluedot_hash_total, 1);
+        }
+
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            Sagan_Counter_Add(bluedot_url_total, 1);
+        }
+
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+        {
+            Sagan_Counter_Add(bluedot_filename_total, 1);
+        }
 
-            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
+    else if ( type == BLUEDOT_LOOKUP_JA3 )
+        {
+            Sagan_Counter_Add(bluedot_ja3_total, 1);
+        }
 
-            /* Store data into cache */
+    key_len = Sagan_Bluedot_Cache_Key(type, data, type == BLUEDOT_LOOKUP_IP ? SaganBluedotIPQueue[slot].ip : NULL, key, sizeof(key));
 
-            memcpy(SaganBluedotIPCache[counters->bluedot_ip_cache_count].ip, ip_convert, MAXIPBIT);
-            strlcpy(SaganBluedotIPCache[counters->bluedot_ip_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotIPCache[counters->bluedot_ip_cache_count].bluedot_json));
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].cache_utime = epoch_time;                   /* store utime */
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].cdate_utime = cdate_utime_u32;
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].mdate_utime = mdate_utime_u32;
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].alertid = bluedot_alertid;
+    Sagan_Bluedot_Cache_Put(type, key, key_len, epoch_time, bluedot_alertid, cdate_utime_u32, mdate_utime_u32, bluedot_json);
 
-            counters->bluedot_ip_total++;
-            counters->bluedot_ip_cache_count++;
+}
 
-            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+/****************************************************************************
+ * Sagan_Bluedot_DNS_Check - Re-resolves the Bluedot host when its TTL
+ * is up.  Only the lookup thread builds URLs,  so this is done there.
+ ****************************************************************************/
 
-            if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_mdate_effective_period != 0 )
-                {
+static void Sagan_Bluedot_DNS_Check ( void )
+{
 
-                    if ( ( epoch_time - mdate_utime_u32 ) > rulestruct[rule_position].bluedot_mdate_effective_period )
-                        {
+    char tmp[64] = { 0 };
+    int i;
 
-                            if ( debug->debugbluedot )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] mdate_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_mdate_effective_period);
-                                }
+    uint64_t epoch_time = Return_Epoch();
+
+    if ( epoch_time - config->bluedot_dns_last_lookup <= config->bluedot_dns_ttl )
+        {
+            return;
+        }
+
+    if ( debug->debugbluedot )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Bluedot host TTL of %d seconds reached.  Doing new lookup for '%s'.", __FILE__, __LINE__, config->bluedot_dns_ttl, config->bluedot_host);
+        }
 
-                            __atomic_add_fetch(&counters->bluedot_mdate, 1, __ATOMIC_SEQ_CST);
+    i = DNS_Lookup( config->bluedot_host, tmp, sizeof(tmp) );
 
-                            bluedot_alertid = 0;
-                        }
-                }
+    if ( i != 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot lookup DNS for '%s'.  Staying with old value of %s.", __FILE__, __LINE__, config->bluedot_host, config->bluedot_ip);
+        }
+    else
+        {
+
+            strlcpy(config->bluedot_ip, tmp, sizeof(config->bluedot_ip));
 
-            else if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_cdate_effective_period != 0 )
+            if ( debug->debugbluedot )
                 {
+                    Sagan_Log(DEBUG, "[%s, line %d] Bluedot host IP is now: %s", __FILE__, __LINE__, config->bluedot_ip);
+                }
 
-                    if ( ( epoch_time - cdate_utime_u32 ) > rulestruct[rule_position].bluedot_cdate_effective_period )
-                        {
+        }
 
-                            if ( debug->debugbluedot )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] cdate_epoch for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_cdate_effective_period);
-                                }
+    config->bluedot_dns_last_lookup = epoch_time;
 
-                            __atomic_add_fetch(&counters->bluedot_cdate, 1, __ATOMIC_SEQ_CST);
+}
 
+/****************************************************************************
+ * Sagan_Bluedot_Next - Finds the next WAITING queue entry and marks it
+ * ACTIVE.  Types are taken round robin so one busy type can't starve
+ * the others.
+ ****************************************************************************/
 
-                            bluedot_alertid = 0;
+static bool Sagan_Bluedot_Next ( unsigned char *type, int *slot )
+{
+
+    static unsigned char next_type = BLUEDOT_LOOKUP_IP;
+
+    struct _Sagan_Bluedot_Queue_State *q = NULL;
+    pthread_mutex_t *mutex = NULL;
+
+    unsigned char t;
+    int size;
+    int i;
+    int n;
+
+    for (n=0; n < BLUEDOT_LATENCY_TYPES; n++)
+        {
+
+            t = next_type;
+            next_type = next_type == BLUEDOT_LOOKUP_JA3 ? BLUEDOT_LOOKUP_IP : next_type + 1;
+
+            mutex = Sagan_Bluedot_Queue_Mutex(t);
+            size = Sagan_Bluedot_Queue_Size(t);
+
+            pthread_mutex_lock(mutex);
+
+            for (i=0; i < size; i++)
+                {
+
+                    q = Sagan_Bluedot_Queue_Entry(t, i);
+
+                    if ( q->state == BLUEDOT_QUEUE_WAITING )
+                        {
+                            q->state = BLUEDOT_QUEUE_ACTIVE;
+                            pthread_mutex_unlock(mutex);
+
+                            *type = t;
+                            *slot = i;
+                            return(true);
                         }
                 }
 
+            pthread_mutex_unlock(mutex);
         }
 
-    /* File hash lookup */
+    return(false);
+}
 
-    else if ( type == BLUEDOT_LOOKUP_HASH )
+/****************************************************************************
+ * Sagan_Bluedot_Latency - Adds a lookup time to the latency histogram.
+ * Bucket 0 is < 1ms,  bucket n is < 2^n ms and the last bucket holds
+ * everything slower.
+ ****************************************************************************/
+
+static void Sagan_Bluedot_Latency ( unsigned char type, uint64_t usec )
+{
+
+    uint64_t msec = usec / 1000;
+    int bucket = 0;
+
+    while ( msec != 0 && bucket < BLUEDOT_LATENCY_BUCKETS - 1 )
         {
+            msec >>= 1;
+            bucket++;
+        }
 
-            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
+    Sagan_Counter_Add(bluedot_latency[type-1][bucket], 1);
+    Sagan_Counter_Add(bluedot_latency_usec[type-1], usec);
 
-            counters->bluedot_hash_total++;
+}
 
-            strlcpy(SaganBluedotHashCache[counters->bluedot_hash_cache_count].hash, data, sizeof(SaganBluedotHashCache[counters->bluedot_hash_cache_count].hash));
-            strlcpy(SaganBluedotHashCache[counters->bluedot_hash_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotHashCache[counters->bluedot_hash_cache_count].bluedot_json));
-            SaganBluedotHashCache[counters->bluedot_hash_cache_count].cache_utime = epoch_time;
-            SaganBluedotHashCache[counters->bluedot_hash_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_hash_cache_count++;
+/****************************************************************************
+ * Sagan_Bluedot_Finish - A transfer is done.  Store the result,  record
+ * the latency and release the queue entry.
+ ****************************************************************************/
 
-            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+static void Sagan_Bluedot_Finish ( struct _Sagan_Bluedot_Transfer *transfer, CURLcode res )
+{
 
-        }
+    struct timeval end;
+    uint64_t usec;
 
-    /* URL lookup */
+    long http_code = 0;
 
-    else if ( type == BLUEDOT_LOOKUP_URL )
+    gettimeofday(&end, 0);
+
+    usec = ( end.tv_sec - transfer->start.tv_sec ) * 1000000 + ( end.tv_usec - transfer->start.tv_usec );
+    Sagan_Bluedot_Latency(transfer->type, usec);
+
+    curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+    if ( res != CURLE_OK || transfer->response_error == true || transfer->response_len == 0 || http_code != 200 )
         {
-            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
 
-            counters->bluedot_url_total++;
+            Sagan_Log(WARN, "[%s, line %d] Bluedot lookup for '%s' failed. [%s, HTTP code: %ld]", __FILE__, __LINE__, Sagan_Bluedot_Queue_Key(transfer->type, transfer->slot), transfer->response_error == true ? "reply too large" : curl_easy_strerror(res), http_code);
+
+            Sagan_Counter_Add(bluedot_error_count, 1);
 
-            strlcpy(SaganBluedotURLCache[counters->bluedot_url_cache_count].url, data, sizeof(SaganBluedotURLCache[counters->bluedot_url_cache_count].url));
-            strlcpy(SaganBluedotURLCache[counters->bluedot_url_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotURLCache[counters->bluedot_url_cache_count].bluedot_json));
-            SaganBluedotURLCache[counters->bluedot_url_cache_count].cache_utime = epoch_time;
-            SaganBluedotURLCache[counters->bluedot_url_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_url_cache_count++;
+        }
+    else
+        {
 
-            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+            transfer->response[transfer->response_len] = '\0';
+            Sagan_Bluedot_Store(transfer->type, transfer->slot, transfer->response);
 
         }
 
-    /* Filename Lookup */
+    Sagan_Bluedot_Complete(transfer->type, transfer->slot);
 
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
-        {
+    transfer->busy = false;
+    transfer->response_len = 0;
+    transfer->response_error = false;
+
+}
+
+/****************************************************************************
+ * Sagan_Bluedot_Thread - The Bluedot lookup pool.  Queued lookups are run
+ * concurrently through a curl multi handle,  which keeps the connections
+ * to Bluedot alive between requests.  Processor threads never wait on it.
+ ****************************************************************************/
+
+void Sagan_Bluedot_Thread ( void )
+{
+
+    (void)SetThreadName("SaganBluedot");
+
+    struct _Sagan_Bluedot_Transfer *transfer = NULL;
+    struct _Sagan_Bluedot_Transfer *done = NULL;
+
+    struct curl_slist *headers = NULL;
+
+    CURLM *multi = NULL;
+    CURLMsg *msg = NULL;
+
+    char tmpurl[9216] = { 0 };
+    char tmpdeviceid[64] = { 0 };
+
+    const char *lookup_url = NULL;
+
+    struct timeval now;
+    struct timespec wait_time;
 
-            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
+    unsigned char type;
+    int slot;
 
-            counters->bluedot_filename_total++;
+    int running = 0;
+    int msgs_left = 0;
+    int i;
 
-            strlcpy(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].filename, data, sizeof(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].filename));
-            strlcpy(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].bluedot_json));
-            SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].cache_utime = epoch_time;
-            SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_filename_cache_count++;
+    transfer = malloc(config->bluedot_max_connections * sizeof(struct _Sagan_Bluedot_Transfer));
 
-            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+    if ( transfer == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot transfers. Abort!", __FILE__, __LINE__);
         }
 
-    /* JA3 Lookup */
+    memset(transfer, 0, config->bluedot_max_connections * sizeof(struct _Sagan_Bluedot_Transfer));
 
-    else if ( type == BLUEDOT_LOOKUP_JA3 )
+    multi = curl_multi_init();
+
+    if ( multi == NULL )
         {
+            Sagan_Log(ERROR, "[%s, line %d] Cannot initialize curl multi handle for Bluedot. Abort!", __FILE__, __LINE__);
+        }
+
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)config->bluedot_max_connections);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)config->bluedot_max_connections);
+
+    snprintf(tmpdeviceid, sizeof(tmpdeviceid), "X-BLUEDOT-DEVICEID: %s", config->bluedot_device_id);
 
-            pthread_mutex_lock(&SaganProcBluedotJA3WorkMutex);
+    headers = curl_slist_append (headers, BLUEDOT_PROCESSOR_USER_AGENT);
+    headers = curl_slist_append (headers, tmpdeviceid);
+//  headers = curl_slist_append (headers, "X-Bluedot-Verbose: 1");		/* For more verbose output */
 
-            counters->bluedot_ja3_total++;
+    for (i=0; i < config->bluedot_max_connections; i++)
+        {
+
+            transfer[i].curl = curl_easy_init();
+            transfer[i].response = malloc(BLUEDOT_RESPONSE_MAX + 1);
 
-            strlcpy(SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].ja3, data, sizeof(SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].ja3));
-            strlcpy(SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].bluedot_json, bluedot_json, sizeof(SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].bluedot_json));
-            SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].cache_utime = epoch_time;
-            SaganBluedotJA3Cache[counters->bluedot_ja3_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_ja3_cache_count++;
+            if ( transfer[i].curl == NULL || transfer[i].response == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Cannot initialize Bluedot transfer. Abort!", __FILE__, __LINE__);
+                }
 
-            pthread_mutex_unlock(&SaganProcBluedotJA3WorkMutex);
+            curl_easy_setopt(transfer[i].curl, CURLOPT_WRITEFUNCTION, write_callback_func);
+            curl_easy_setopt(transfer[i].curl, CURLOPT_WRITEDATA, &transfer[i]);
+            curl_easy_setopt(transfer[i].curl, CURLOPT_PRIVATE, &transfer[i]);
+            curl_easy_setopt(transfer[i].curl, CURLOPT_NOSIGNAL, 1);    /* WIll send SIGALRM if not set */
+            curl_easy_setopt(transfer[i].curl, CURLOPT_TIMEOUT, (long)config->bluedot_lookup_timeout);
+            curl_easy_setopt(transfer[i].curl, CURLOPT_TCP_KEEPALIVE, 1L);
+            curl_easy_setopt(transfer[i].curl, CURLOPT_HTTPHEADER, headers );
         }
 
-    Sagan_Bluedot_Clean_Queue(data, type);	/* Remove item for "queue" */
+    while ( death == false )
+        {
 
-    json_object_put(json_in);       		/* Clear json_in as we're done with it */
+            Sagan_Bluedot_DNS_Check();
+
+            /* Hand waiting lookups to free transfers */
+
+            for (i=0; i < config->bluedot_max_connections; i++)
+                {
+
+                    if ( transfer[i].busy == true )
+                        {
+                            continue;
+                        }
+
+                    if ( __atomic_load_n(&bluedot_waiting, __ATOMIC_SEQ_CST) == 0 || Sagan_Bluedot_Next(&type, &slot) == false )
+                        {
+                            break;
+                        }
+
+                    __atomic_sub_fetch(&bluedot_waiting, 1, __ATOMIC_SEQ_CST);
+
+                    lookup_url = type == BLUEDOT_LOOKUP_IP ? BLUEDOT_IP_LOOKUP_URL :
+                                 type == BLUEDOT_LOOKUP_HASH ? BLUEDOT_HASH_LOOKUP_URL :
+                                 type == BLUEDOT_LOOKUP_URL ? BLUEDOT_URL_LOOKUP_URL :
+                                 type == BLUEDOT_LOOKUP_FILENAME ? BLUEDOT_FILENAME_LOOKUP_URL :
+                                 BLUEDOT_JA3_LOOKUP_URL;
+
+                    snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, lookup_url, Sagan_Bluedot_Queue_Key(type, slot));
+
+                    transfer[i].busy = true;
+                    transfer[i].type = type;
+                    transfer[i].slot = slot;
+                    transfer[i].response_len = 0;
+                    transfer[i].response_error = false;
+
+                    gettimeofday(&transfer[i].start, 0);
+
+                    curl_easy_setopt(transfer[i].curl, CURLOPT_URL, tmpurl);
+                    curl_multi_add_handle(multi, transfer[i].curl);
+
+                    running++;
+                }
+
+            /* Nothing to do.  Sleep until a lookup is queued */
+
+            if ( running == 0 )
+                {
+
+                    pthread_mutex_lock(&SaganBluedotLookupMutex);
+
+                    if ( __atomic_load_n(&bluedot_waiting, __ATOMIC_SEQ_CST) == 0 )
+                        {
+                            gettimeofday(&now, 0);
+                            wait_time.tv_sec = now.tv_sec + 1;
+                            wait_time.tv_nsec = now.tv_usec * 1000;
+
+                            pthread_cond_timedwait(&SaganBluedotLookupCond, &SaganBluedotLookupMutex, &wait_time);
+                        }
+
+                    pthread_mutex_unlock(&SaganBluedotLookupMutex);
+
+                    continue;
+                }
+
+            curl_multi_perform(multi, &running);
+
+            while ( ( msg = curl_multi_info_read(multi, &msgs_left) ) != NULL )
+                {
+
+                    if ( msg->msg != CURLMSG_DONE )
+                        {
+                            continue;
+                        }
+
+                    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&done);
+
+                    curl_multi_remove_handle(multi, msg->easy_handle);
+                    Sagan_Bluedot_Finish(done, msg->data.result);
+
+                }
+
+            if ( running > 0 )
+                {
+                    curl_multi_wait(multi, NULL, 0, 50, NULL);
+                }
+
+        }
+
+    for (i=0; i < config->bluedot_max_connections; i++)
+        {
+            curl_easy_cleanup(transfer[i].curl);
+            free(transfer[i].response);
+        }
+
+    curl_multi_cleanup(multi);
+    curl_slist_free_all(headers);
+    free(transfer);
 
-    snprintf(bluedot_str, bluedot_size, "%s", bluedot_json);
+    pthread_exit(NULL);
 
-    return(bluedot_alertid);
 }
 
 /***************************************************************************
@@ -1524,7 +1845,7 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
                     if ( bluedot_results == rulestruct[rule_position].bluedot_ip_cats[i] )
                         {
 
-                            __atomic_add_fetch(&counters->bluedot_ip_positive_hit, 1, __ATOMIC_SEQ_CST);
+                            Sagan_Counter_Add(bluedot_ip_positive_hit, 1);
 
                             return(true);
                         }
@@ -1541,7 +1862,7 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
 
                     if ( bluedot_results == rulestruct[rule_position].bluedot_hash_cats[i] )
                         {
-                            __atomic_add_fetch(&counters->bluedot_hash_positive_hit, 1, __ATOMIC_SEQ_CST);
+                            Sagan_Counter_Add(bluedot_hash_positive_hit, 1);
 
                             return(true);
                         }
@@ -1557,7 +1878,7 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
                     if ( bluedot_results == rulestruct[rule_position].bluedot_url_cats[i] )
                         {
 
-                            __atomic_add_fetch(&counters->bluedot_url_positive_hit, 1, __ATOMIC_SEQ_CST);
+                            Sagan_Counter_Add(bluedot_url_positive_hit, 1);
 
                             return(true);
                         }
@@ -1572,7 +1893,7 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
 
                     if ( bluedot_results == rulestruct[rule_position].bluedot_filename_cats[i] )
                         {
-                            __atomic_add_fetch(&counters->bluedot_filename_positive_hit, 1, __ATOMIC_SEQ_CST);
+                            Sagan_Counter_Add(bluedot_filename_positive_hit, 1);
 
                             return(true);
 
@@ -1589,7 +1910,7 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
 
                     if ( bluedot_results == rulestruct[rule_position].bluedot_ja3_cats[i] )
                         {
-                            __atomic_add_fetch(&counters->bluedot_ja3_positive_hit, 1, __ATOMIC_SEQ_CST);
+                            Sagan_Counter_Add(bluedot_ja3_positive_hit, 1);
 
                             return(true);
 
@@ -1607,7 +1928,7 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
  * message and preforms a Bluedot query.
  ***************************************************************************/
 
-int Sagan_Bluedot_IP_Lookup_All ( char *syslog_message, int rule_position, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size )
+int Sagan_Bluedot_IP_Lookup_All ( char *syslog_message, int rule_position, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size, _Sagan_Bluedot_Pending *pending )
 {
 
     int i;
@@ -1618,7 +1939,7 @@ int Sagan_Bluedot_IP_Lookup_All ( char *syslog_message, int rule_position, _Saga
     for (i = 0; i < lookup_cache_size; i++)
         {
 
-            bluedot_results = Sagan_Bluedot_Lookup(lookup_cache[i].ip, BLUEDOT_LOOKUP_IP, rule_position, NULL, 0);
+            bluedot_results = Sagan_Bluedot_Lookup(lookup_cache[i].ip, BLUEDOT_LOOKUP_IP, rule_position, NULL, 0, pending);
             bluedot_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, rule_position, BLUEDOT_LOOKUP_IP );
 
             if ( bluedot_flag == 1 )
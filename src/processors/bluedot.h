@@ -44,10 +44,41 @@
 #define BLUEDOT_LOOKUP_FILENAME 4
 #define BLUEDOT_LOOKUP_JA3 5
 
+/* Queue entry states */
+
+#define BLUEDOT_QUEUE_FREE 0
+#define BLUEDOT_QUEUE_WAITING 1			/* Queued,  not yet sent */
+#define BLUEDOT_QUEUE_ACTIVE 2			/* Handed to curl */
+
+#define BLUEDOT_RESPONSE_MAX 65536		/* Larger replies are treated as errors */
+
+/* Filled in by Sagan_Bluedot_Lookup() on a cache miss.  The ticket
+   identifies the in-flight lookup the caller can wait on */
+
+typedef struct _Sagan_Bluedot_Pending _Sagan_Bluedot_Pending;
+struct _Sagan_Bluedot_Pending
+{
+    bool flag;
+    unsigned char type;
+    int slot;
+    uint64_t ticket;
+};
+
+typedef struct _Sagan_Bluedot_Queue_State _Sagan_Bluedot_Queue_State;
+struct _Sagan_Bluedot_Queue_State
+{
+    unsigned char state;
+    uint64_t ticket;
+};
+
 int Sagan_Bluedot_Cat_Compare ( unsigned char, int, unsigned char );
 int Sagan_Bluedot ( _Sagan_Proc_Syslog *, int  );
-unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_position, char *bluedot_str, size_t bluedot_size );
-int Sagan_Bluedot_IP_Lookup_All ( char *, int, _Sagan_Lookup_Cache_Entry *, int );
+unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_position, char *bluedot_str, size_t bluedot_size, _Sagan_Bluedot_Pending *pending );
+int Sagan_Bluedot_IP_Lookup_All ( char *, int, _Sagan_Lookup_Cache_Entry *, int, _Sagan_Bluedot_Pending * );
+
+void Sagan_Bluedot_Thread ( void );
+bool Sagan_Bluedot_Defer ( _Sagan_Proc_Syslog *, int, _Sagan_Bluedot_Pending * );
+int Sagan_Bluedot_Replay ( _Sagan_Proc_Syslog * );
 
 void Sagan_Bluedot_Clean_Cache ( void );
 void Sagan_Bluedot_Init(void);
@@ -55,7 +86,6 @@ void Sagan_Bluedot_Load_Cat(void);
 void Sagan_Verify_Categories( char *, int, const char *, int, unsigned char );
 void Sagan_Bluedot_Check_Cache_Time (void);
 
-int Sagan_Bluedot_Clean_Queue ( char *, unsigned char );
 
 
 typedef struct _Sagan_Bluedot_Cat_List _Sagan_Bluedot_Cat_List;
@@ -66,51 +96,43 @@ struct _Sagan_Bluedot_Cat_List
 };
 
 
-typedef struct _Sagan_Bluedot_IP_Cache _Sagan_Bluedot_IP_Cache;
-struct _Sagan_Bluedot_IP_Cache
-{
-    unsigned char ip[MAXIPBIT];
-    uint64_t mdate_utime;
-    uint64_t cdate_utime;
-    uint64_t cache_utime;
-    char bluedot_json[BLUEDOT_JSON_SIZE];
-    int	alertid;
-};
-
-typedef struct _Sagan_Bluedot_Hash_Cache _Sagan_Bluedot_Hash_Cache;
-struct _Sagan_Bluedot_Hash_Cache
-{
-    char hash[SHA256_HASH_SIZE+1];
-    uint64_t cache_utime;
-    char bluedot_json[BLUEDOT_JSON_SIZE];
-    int alertid;
-};
+/* One cached verdict.  Keys are copied at their real length (IPs are kept
+   as MAXIPBIT binary,  everything else lower cased).  The Bluedot reply is
+   only kept for verdicts that can alert,  since that is the only time it
+   is written out. */
 
-typedef struct _Sagan_Bluedot_URL_Cache _Sagan_Bluedot_URL_Cache;
-struct _Sagan_Bluedot_URL_Cache
+typedef struct _Sagan_Bluedot_Cache_Entry _Sagan_Bluedot_Cache_Entry;
+struct _Sagan_Bluedot_Cache_Entry
 {
-    char url[8192];
+    char *key;					/* NULL == empty slot */
+    char *bluedot_json;				/* NULL unless alertid != 0 */
     uint64_t cache_utime;
-    char bluedot_json[BLUEDOT_JSON_SIZE];
-    int alertid;
+    uint64_t cdate_utime;			/* IP only */
+    uint64_t mdate_utime;			/* IP only */
+    uint32_t hash;
+    uint16_t key_len;
+    signed char alertid;
+    bool referenced;				/* Clock bit for eviction */
 };
 
-typedef struct _Sagan_Bluedot_Filename_Cache _Sagan_Bluedot_Filename_Cache;
-struct _Sagan_Bluedot_Filename_Cache
-{
-    char filename[256];
-    uint64_t cache_utime;
-    char bluedot_json[BLUEDOT_JSON_SIZE];
-    int alertid;
-};
+/* Open addressing hash table,  at most half full.  Lookups take the read
+   lock,  the lookup thread and the cleaner take the write lock.  When the
+   cache is full the "clock" hand evicts the first entry that hasn't been
+   hit since the hand last passed it. */
 
-typedef struct _Sagan_Bluedot_JA3_Cache _Sagan_Bluedot_JA3_Cache;
-struct _Sagan_Bluedot_JA3_Cache
+typedef struct _Sagan_Bluedot_Cache _Sagan_Bluedot_Cache;
+struct _Sagan_Bluedot_Cache
 {
-    char ja3[MD5_HASH_SIZE+1];
-    uint64_t cache_utime;
-    char bluedot_json[BLUEDOT_JSON_SIZE];
-    int alertid;
+    pthread_rwlock_t lock;
+    struct _Sagan_Bluedot_Cache_Entry *table;
+    uint32_t slots;
+    uint32_t max;
+    uint32_t hand;
+
+    uint64_t *count;				/* Gauge in _SaganCounters */
+    size_t hit;					/* Offsets into _Sagan_Counter_Shard */
+    size_t miss;
+    size_t evict;
 };
 
 
@@ -118,47 +140,54 @@ typedef struct _Sagan_Bluedot_IP_Queue _Sagan_Bluedot_IP_Queue;
 struct _Sagan_Bluedot_IP_Queue
 {
     unsigned char ip[MAXIPBIT];
+    char ipaddr[MAXIP];
+    struct _Sagan_Bluedot_Queue_State q;
 };
 
 typedef struct _Sagan_Bluedot_Hash_Queue _Sagan_Bluedot_Hash_Queue;
 struct _Sagan_Bluedot_Hash_Queue
 {
     char hash[SHA256_HASH_SIZE+1];
+    struct _Sagan_Bluedot_Queue_State q;
 };
 
 typedef struct _Sagan_Bluedot_URL_Queue _Sagan_Bluedot_URL_Queue;
 struct _Sagan_Bluedot_URL_Queue
 {
     char url[8192];
+    struct _Sagan_Bluedot_Queue_State q;
 };
 
 typedef struct _Sagan_Bluedot_Filename_Queue _Sagan_Bluedot_Filename_Queue;
 struct _Sagan_Bluedot_Filename_Queue
 {
     char filename[256];
+    struct _Sagan_Bluedot_Queue_State q;
 };
 
 typedef struct _Sagan_Bluedot_JA3_Queue _Sagan_Bluedot_JA3_Queue;
 struct _Sagan_Bluedot_JA3_Queue
 {
     char ja3[MD5_HASH_SIZE+1];
+    struct _Sagan_Bluedot_Queue_State q;
 };
 
 
 
-typedef struct _Sagan_Bluedot_Skip _Sagan_Bluedot_Skip;
-struct _Sagan_Bluedot_Skip
-{
-
-    struct
-    {
-        unsigned char ipbits[MAXIPBIT];
-        unsigned char maskbits[MAXIPBIT];
-    } range;
+/* An event parked until the lookup it is waiting on finishes */
 
+typedef struct _Sagan_Bluedot_Deferred _Sagan_Bluedot_Deferred;
+struct _Sagan_Bluedot_Deferred
+{
+    bool used;
+    bool ready;
+    int rule_position;
+    uint64_t sid;
+    unsigned char type;
+    int slot;
+    uint64_t ticket;
+    struct _Sagan_Proc_Syslog *event;
 };
 
-
-
 #endif
 
@@ -23,6 +23,15 @@
 * This allows Sagan to read in Bro Intel files,  like those from Critical
 * Stack (https://intel.brointel.com).
 *
+* Intel::ADDR,  FILE_HASH and CERT_HASH are exact matches and are looked
+* up in hash sets.  The other types are searched for anywhere in the log
+* line,  so each of those gets one Aho-Corasick automaton that finds every
+* indicator of that type in a single pass.
+*
+* If "cache" is set,  the sets and automatons are also written to a file
+* that later starts mmap() directly (as long as the intel files haven't
+* changed) instead of parsing and building everything again.
+*
 */
 
 /* TODO:  needs stats and perfmon! */
@@ -33,16 +42,26 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <ctype.h>
 #include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "ipc.h"
+#include "util-aho-corasick.h"
 
 #include "parsers/parsers.h"
 
@@ -50,23 +69,39 @@
 
 #define MAX_BROINTEL_LINE_SIZE 10240
 
+#define BROINTEL_INITIAL_SLOTS	64
+#define BROINTEL_INITIAL_BLOB	4096
+#define BROINTEL_ALIGN(x)	( ( (x) + 7 ) & ~( (uint64_t)7 ) )
+
 struct _SaganConfig *config;
 struct _SaganCounters *counters;
 struct _SaganDebug *debug;
 
 struct _Sagan_Processor_Info *processor_info_brointel = NULL;
 
-struct _Sagan_BroIntel_Intel_Addr *Sagan_BroIntel_Intel_Addr;
-struct _Sagan_BroIntel_Intel_Domain *Sagan_BroIntel_Intel_Domain;
-struct _Sagan_BroIntel_Intel_File_Hash *Sagan_BroIntel_Intel_File_Hash;
-struct _Sagan_BroIntel_Intel_URL *Sagan_BroIntel_Intel_URL;
-struct _Sagan_BroIntel_Intel_Software *Sagan_BroIntel_Intel_Software;
-struct _Sagan_BroIntel_Intel_Email *Sagan_BroIntel_Intel_Email;
-struct _Sagan_BroIntel_Intel_User_Name *Sagan_BroIntel_Intel_User_Name;
-struct _Sagan_BroIntel_Intel_File_Name *Sagan_BroIntel_Intel_File_Name;
-struct _Sagan_BroIntel_Intel_Cert_Hash *Sagan_BroIntel_Intel_Cert_Hash;
+struct _Sagan_BroIntel *SaganBroIntel;
 
-pthread_mutex_t CounterBroIntelGenericMutex=PTHREAD_MUTEX_INITIALIZER;
+static const char *Sagan_BroIntel_Type_Name[BROINTEL_TYPES] =
+{
+    "Intel::ADDR",
+    "Intel::DOMAIN",
+    "Intel::FILE_HASH",
+    "Intel::URL",
+    "Intel::SOFTWARE",
+    "Intel::EMAIL",
+    "Intel::USER_NAME",
+    "Intel::FILE_NAME",
+    "Intel::CERT_HASH"
+};
+
+/* Types matched anywhere in the log line (the rest are exact) */
+
+static const bool Sagan_BroIntel_Substring[BROINTEL_TYPES] =
+{
+    false, true, false, true, true, true, true, true, false
+};
+
+static void Sagan_BroIntel_Free( struct _Sagan_BroIntel * );
 
 /*****************************************************************************
  * Sagan_BroIntel_Init - Sets up globals.  Not really used yet.
@@ -78,743 +113,900 @@ void Sagan_BroIntel_Init(void)
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_Load_File - Loads BroIntel data and splits it up
- * into different arrays.
- * ***************************************************************************/
+ * Hash sets
+ *****************************************************************************/
 
-void Sagan_BroIntel_Load_File ( void )
+static uint32_t Sagan_BroIntel_Set_Find( struct _Sagan_BroIntel_Set *set, const char *key, size_t len, uint32_t hash )
 {
 
-    FILE *brointel_file;
+    uint32_t i;
+    uint32_t offset;
 
-    char *value;
-    char *type;
-    char *description;
+    if ( set->slots == 0 )
+        {
+            return(0);
+        }
 
-    bool found_flag;
-    bool found_flag_array;
+    for ( i = hash & ( set->slots - 1 ); set->table[i].offset != 0; i = ( i + 1 ) & ( set->slots - 1 ) )
+        {
 
-    char *tok = NULL; ;
-    char *ptmp = NULL;
+            offset = set->table[i].offset - 1;
 
-    int line_count;
-    int i;
+            if ( set->table[i].hash == hash &&
+                    offset + len < set->blob_len &&
+                    memcmp(set->blob + offset, key, len) == 0 &&
+                    set->blob[offset + len] == '\0' )
+                {
+                    return(set->table[i].offset);
+                }
+        }
 
-    unsigned char bits_ip[MAXIPBIT] = {0};
+    return(0);
+}
 
-    char *brointel_filename = NULL;
-    char brointelbuf[MAX_BROINTEL_LINE_SIZE] = { 0 };
+static void Sagan_BroIntel_Set_Grow( struct _Sagan_BroIntel_Set *set )
+{
 
-    __atomic_store_n (&counters->brointel_dups, 0, __ATOMIC_SEQ_CST);
+    struct _Sagan_BroIntel_Slot *old = set->table;
+    uint32_t old_slots = set->slots;
+    uint32_t i;
+    uint32_t s;
 
-    brointel_filename = strtok_r(config->brointel_files, ",", &ptmp);
+    set->slots = old_slots == 0 ? BROINTEL_INITIAL_SLOTS : old_slots * 2;
+    set->table = calloc(set->slots, sizeof(struct _Sagan_BroIntel_Slot));
 
-    while ( brointel_filename != NULL )
+    if ( set->table == NULL )
         {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bro Intel table. Abort!", __FILE__, __LINE__);
+        }
 
-            Sagan_Log(NORMAL, "Bro Intel Processor Loading File: %s.", brointel_filename);
+    for ( i = 0; i < old_slots; i++ )
+        {
 
-            if (( brointel_file = fopen(brointel_filename, "r")) == NULL )
+            if ( old[i].offset == 0 )
                 {
-                    Sagan_Log(ERROR, "[%s, line %d] Could not load Bro Intel file! (%s - %s)", __FILE__, __LINE__, brointel_filename, strerror(errno));
+                    continue;
                 }
 
-            while(fgets(brointelbuf, MAX_BROINTEL_LINE_SIZE, brointel_file) != NULL)
-                {
-
-                    /* Skip comments and blank linkes */
-
-                    if (brointelbuf[0] == '#' || brointelbuf[0] == 10 || brointelbuf[0] == ';' || brointelbuf[0] == 32 )
-                        {
-                            line_count++;
-                            continue;
-                        }
-                    else
-                        {
-
-                            Remove_Return(brointelbuf);
+            for ( s = old[i].hash & ( set->slots - 1 ); set->table[s].offset != 0; s = ( s + 1 ) & ( set->slots - 1 ) );
 
-                            value = strtok_r(brointelbuf, "\t", &tok);
-                            type = strtok_r(NULL, "\t", &tok);
-                            description = strtok_r(NULL, "\t", &tok);
+            set->table[s] = old[i];
+        }
 
-                            if ( value == NULL || type == NULL || description == NULL )
-                                {
-                                    Sagan_Log(WARN, "[%s, line %d] Got invalid line at %d in %s", __FILE__, __LINE__, line_count, brointel_filename);
-                                }
+    free(old);
+}
 
-                            found_flag = 0;
+/* Adds "key" to the set.  Returns false if it was already there */
 
-                            if (!strcmp(type, "Intel::ADDR") && IP2Bit(value, bits_ip))
-                                {
+static bool Sagan_BroIntel_Set_Add( struct _Sagan_BroIntel_Set *set, const char *key, size_t len )
+{
 
-                                    found_flag = 1; 			/* Used to short circuit other 'type' lookups */
-                                    found_flag_array = 0;		/* Used to short circuit/warn when dups are found.  This way we don't waste memory/CPU */
+    uint32_t hash = IPC_Hash_Bytes(IPC_HASH_SEED, key, len);
+    uint32_t s;
 
-                                    /* Check for duplicates. */
+    if ( Sagan_BroIntel_Set_Find(set, key, len, hash) != 0 )
+        {
+            return(false);
+        }
 
-                                    for (i=0; i < counters->brointel_addr_count; i++)
-                                        {
+    /* Keep the table at most half full */
 
-                                            if ( !memcmp(Sagan_BroIntel_Intel_Addr[i].bits_ip, bits_ip, MAXIPBIT) )
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::ADDR address %s in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(& counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+    if ( ( set->count + 1 ) * 2 > set->slots )
+        {
+            Sagan_BroIntel_Set_Grow(set);
+        }
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+    if ( set->blob_len + len + 1 > set->blob_size )
+        {
 
-                                    if ( found_flag_array == 0 )
-                                        {
+            while ( set->blob_len + len + 1 > set->blob_size )
+                {
+                    set->blob_size = set->blob_size == 0 ? BROINTEL_INITIAL_BLOB : set->blob_size * 2;
+                }
 
-                                            Sagan_BroIntel_Intel_Addr = (_Sagan_BroIntel_Intel_Addr *) realloc(Sagan_BroIntel_Intel_Addr, (counters->brointel_addr_count+1) * sizeof(_Sagan_BroIntel_Intel_Addr));
+            /* Offsets are 32 bits,  and AC pattern ids are ints */
 
-                                            if ( Sagan_BroIntel_Intel_Addr == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Addr. Abort!", __FILE__, __LINE__);
-                                                }
+            if ( set->blob_size > INT32_MAX )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Too much Bro Intel data. Abort!", __FILE__, __LINE__);
+                }
 
-                                            memset(&Sagan_BroIntel_Intel_Addr[counters->brointel_addr_count], 0, sizeof(_Sagan_BroIntel_Intel_Addr));
+            set->blob = realloc(set->blob, set->blob_size);
 
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            memcpy( Sagan_BroIntel_Intel_Addr[counters->brointel_addr_count].bits_ip, bits_ip, sizeof(bits_ip) );
-                                            counters->brointel_addr_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
-                                        }
+            if ( set->blob == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Bro Intel data. Abort!", __FILE__, __LINE__);
+                }
+        }
 
-                                }
+    memcpy(set->blob + set->blob_len, key, len);
+    set->blob[set->blob_len + len] = '\0';
 
-                            if (!strcmp(type, "Intel::DOMAIN") && found_flag == 0)
-                                {
-                                    To_LowerC(value);
+    for ( s = hash & ( set->slots - 1 ); set->table[s].offset != 0; s = ( s + 1 ) & ( set->slots - 1 ) );
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+    set->table[s].hash = hash;
+    set->table[s].offset = set->blob_len + 1;
 
+    set->blob_len = set->blob_len + len + 1;
+    set->count++;
 
-                                    for (i=0; i < counters-> brointel_domain_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Domain[i].domain, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::DOMAIN '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+    if ( set->count == 1 || len < set->min_len )
+        {
+            set->min_len = len;
+        }
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+    if ( len > set->max_len )
+        {
+            set->max_len = len;
+        }
 
-                                    if ( found_flag_array == 0 )
-                                        {
-                                            Sagan_BroIntel_Intel_Domain = (_Sagan_BroIntel_Intel_Domain *) realloc(Sagan_BroIntel_Intel_Domain, (counters->brointel_domain_count+1) * sizeof(_Sagan_BroIntel_Intel_Domain));
+    return(true);
+}
 
-                                            if ( Sagan_BroIntel_Intel_Domain == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Domain. Abort!", __FILE__, __LINE__);
-                                                }
+/* Builds the substring automaton from everything in the set */
 
-                                            memset(&Sagan_BroIntel_Intel_Domain[counters->brointel_domain_count], 0, sizeof(_Sagan_BroIntel_Intel_Domain));
+static void Sagan_BroIntel_Set_Build( struct _Sagan_BroIntel_Set *set )
+{
 
-                                            strlcpy(Sagan_BroIntel_Intel_Domain[counters->brointel_domain_count].domain, value, sizeof(Sagan_BroIntel_Intel_Domain[counters->brointel_domain_count].domain));
+    uint32_t i;
+    uint32_t offset;
 
-                                            __atomic_add_fetch(&counters->brointel_domain_count, 1, __ATOMIC_SEQ_CST);
+    if ( set->count == 0 )
+        {
+            return;
+        }
 
+    set->ac = Sagan_AC_New(true);
 
-                                        }
+    for ( i = 0; i < set->slots; i++ )
+        {
 
-                                }
+            if ( set->table[i].offset == 0 )
+                {
+                    continue;
+                }
 
-                            if (!strcmp(type, "Intel::FILE_HASH") && found_flag == 0)
-                                {
-                                    To_LowerC(value);
+            offset = set->table[i].offset - 1;
+            Sagan_AC_Add(set->ac, set->blob + offset, strlen(set->blob + offset), offset);
+        }
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+    Sagan_AC_Build(set->ac);
+}
 
-                                    for (i=0; i < counters->brointel_file_hash_count; i++)
-                                        {
+/*****************************************************************************
+ * Sagan_BroIntel_Fingerprint - Identifies the current contents of the
+ * intel files by name,  size and modification time.
+ *****************************************************************************/
 
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_File_Hash[i].hash, value))
-                                                {
+static uint64_t Sagan_BroIntel_Fingerprint( const char *brointel_files )
+{
 
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::FILE_HASH '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+    char tmp[sizeof(config->brointel_files)] = { 0 };
+    char *brointel_filename = NULL;
+    char *ptmp = NULL;
 
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+    struct stat st;
+    uint64_t fingerprint = 14695981039346656037ULL;
+    uint64_t value[3];
+    const unsigned char *p;
+    size_t i;
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+    strlcpy(tmp, brointel_files, sizeof(tmp));
 
-                                    if ( found_flag_array == 0 )
-                                        {
+    brointel_filename = strtok_r(tmp, ",", &ptmp);
 
-                                            Sagan_BroIntel_Intel_File_Hash = (_Sagan_BroIntel_Intel_File_Hash *) realloc(Sagan_BroIntel_Intel_File_Hash, (counters->brointel_file_hash_count+1) * sizeof(_Sagan_BroIntel_Intel_File_Hash));
+    while ( brointel_filename != NULL )
+        {
 
-                                            if ( Sagan_BroIntel_Intel_File_Hash == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_File_Hash. Abort!", __FILE__, __LINE__);
-                                                }
+            if ( stat(brointel_filename, &st) != 0 )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Could not load Bro Intel file! (%s - %s)", __FILE__, __LINE__, brointel_filename, strerror(errno));
+                }
 
-                                            memset(&Sagan_BroIntel_Intel_File_Hash[counters->brointel_file_hash_count], 0, sizeof(_Sagan_BroIntel_Intel_File_Hash));
+            value[0] = st.st_size;
+            value[1] = st.st_mtim.tv_sec;
+            value[2] = st.st_mtim.tv_nsec;
 
-                                            strlcpy(Sagan_BroIntel_Intel_File_Hash[counters->brointel_file_hash_count].hash, value, sizeof(Sagan_BroIntel_Intel_File_Hash[counters->brointel_file_hash_count].hash));
-                                            counters->brointel_file_hash_count++;
+            for ( p = (const unsigned char *)brointel_filename; *p != '\0'; p++ )
+                {
+                    fingerprint = ( fingerprint ^ *p ) * 1099511628211ULL;
+                }
 
-                                        }
-                                }
+            for ( i = 0, p = (const unsigned char *)value; i < sizeof(value); i++ )
+                {
+                    fingerprint = ( fingerprint ^ p[i] ) * 1099511628211ULL;
+                }
 
+            brointel_filename = strtok_r(NULL, ",", &ptmp);
+        }
 
-                            if (!strcmp(type, "Intel::URL") && found_flag == 0)
-                                {
+    return(fingerprint);
+}
 
-                                    To_LowerC(value);
+/*****************************************************************************
+ * Sagan_BroIntel_Cache_Load - mmap()'s the cache file if it was built from
+ * the current intel files.  Returns NULL if it can't be used.
+ *****************************************************************************/
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+static struct _Sagan_BroIntel *Sagan_BroIntel_Cache_Load( uint64_t fingerprint )
+{
 
-                                    for (i=0; i < counters->brointel_url_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_URL[i].url, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::URL '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+    struct _Sagan_BroIntel *intel = NULL;
+    struct _Sagan_BroIntel_Cache_Header *header = NULL;
+    struct _Sagan_BroIntel_Cache_Set *cs = NULL;
+    struct stat st;
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+    unsigned char *map = NULL;
+    int fd;
+    int i;
 
+    if (( fd = open(config->brointel_cache, O_RDONLY) ) == -1 )
+        {
+            return(NULL);
+        }
 
-                                    if ( found_flag_array == 0 )
-                                        {
+    if ( fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct _Sagan_BroIntel_Cache_Header) )
+        {
+            close(fd);
+            return(NULL);
+        }
 
-                                            Sagan_BroIntel_Intel_URL = (_Sagan_BroIntel_Intel_URL *) realloc(Sagan_BroIntel_Intel_URL, (counters->brointel_url_count+1) * sizeof(_Sagan_BroIntel_Intel_URL));
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
 
-                                            if ( Sagan_BroIntel_Intel_URL == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_URL. Abort!", __FILE__, __LINE__);
-                                                }
+    if ( map == MAP_FAILED )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Could not mmap() Bro Intel cache %s (%s)", __FILE__, __LINE__, config->brointel_cache, strerror(errno));
+            return(NULL);
+        }
 
-                                            memset(&Sagan_BroIntel_Intel_URL[counters->brointel_url_count], 0, sizeof(_Sagan_BroIntel_Intel_URL));
+    header = (struct _Sagan_BroIntel_Cache_Header *)map;
 
-                                            strlcpy(Sagan_BroIntel_Intel_URL[counters->brointel_url_count].url, value, sizeof(Sagan_BroIntel_Intel_URL[counters->brointel_url_count].url));
+    if ( memcmp(header->magic, BROINTEL_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != BROINTEL_CACHE_VERSION ||
+            header->fingerprint != fingerprint ||
+            header->size != (uint64_t)st.st_size )
+        {
+            munmap(map, st.st_size);
+            return(NULL);
+        }
 
-                                            __atomic_add_fetch(&counters->brointel_url_count, 1, __ATOMIC_SEQ_CST);
+    intel = calloc(1, sizeof(struct _Sagan_BroIntel));
 
-                                        }
+    if ( intel == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bro Intel. Abort!", __FILE__, __LINE__);
+        }
 
-                                }
+    intel->map = map;
+    intel->map_len = st.st_size;
+    intel->dups = header->dups;
 
+    for ( i = 0; i < BROINTEL_TYPES; i++ )
+        {
 
-                            if (!strcmp(type, "Intel::SOFTWARE") && found_flag == 0)
-                                {
+            cs = &header->set[i];
 
+            if ( cs->slots == 0 )
+                {
+                    continue;
+                }
 
-                                    To_LowerC(value);
+            if ( ( cs->slots & ( cs->slots - 1 ) ) != 0 || cs->count > cs->slots / 2 ||
+                    cs->table_offset + (uint64_t)cs->slots * sizeof(struct _Sagan_BroIntel_Slot) > header->size ||
+                    cs->blob_offset + cs->blob_len > header->size ||
+                    cs->ac_offset + cs->ac_len > header->size )
+                {
+                    Sagan_BroIntel_Free(intel);
+                    return(NULL);
+                }
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+            intel->set[i].table = (struct _Sagan_BroIntel_Slot *)( map + cs->table_offset );
+            intel->set[i].blob = (char *)( map + cs->blob_offset );
+            intel->set[i].slots = cs->slots;
+            intel->set[i].count = cs->count;
+            intel->set[i].blob_len = cs->blob_len;
+            intel->set[i].min_len = cs->min_len;
+            intel->set[i].max_len = cs->max_len;
 
-                                    for (i=0; i < counters->brointel_software_count++; i++)
-                                        {
+            if ( cs->ac_offset != 0 &&
+                    ( intel->set[i].ac = Sagan_AC_Map(map + cs->ac_offset, cs->ac_len) ) == NULL )
+                {
+                    Sagan_BroIntel_Free(intel);
+                    return(NULL);
+                }
+        }
 
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Software[i].software, value))
-                                                {
+    return(intel);
+}
 
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::SOFTWARE '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+/*****************************************************************************
+ * Sagan_BroIntel_Cache_Write - Writes "intel" out for Cache_Load().  The
+ * file is written under a temporary name and renamed into place.
+ *****************************************************************************/
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+static bool Sagan_BroIntel_Cache_Write_Data( FILE *fp, const void *data, uint64_t len, uint64_t *offset )
+{
 
-                                    if ( found_flag_array == 0 )
-                                        {
+    static const char pad[8] = { 0 };
 
-                                            Sagan_BroIntel_Intel_Software = (_Sagan_BroIntel_Intel_Software *) realloc(Sagan_BroIntel_Intel_Software, (counters->brointel_software_count+1) * sizeof(_Sagan_BroIntel_Intel_Software));
+    if ( len != 0 && fwrite(data, len, 1, fp) != 1 )
+        {
+            return(false);
+        }
 
-                                            if ( Sagan_BroIntel_Intel_Software == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Software. Abort!", __FILE__, __LINE__);
-                                                }
+    if ( BROINTEL_ALIGN(len) != len && fwrite(pad, BROINTEL_ALIGN(len) - len, 1, fp) != 1 )
+        {
+            return(false);
+        }
 
-                                            memset(&Sagan_BroIntel_Intel_Software[counters->brointel_software_count], 0, sizeof(_Sagan_BroIntel_Intel_Software));
+    *offset = *offset + BROINTEL_ALIGN(len);
+    return(true);
+}
 
-                                            strlcpy(Sagan_BroIntel_Intel_Software[counters->brointel_software_count].software, value, sizeof(Sagan_BroIntel_Intel_Software[counters->brointel_software_count].software));
+static void Sagan_BroIntel_Cache_Write( struct _Sagan_BroIntel *intel, uint64_t fingerprint )
+{
 
-                                            __atomic_add_fetch(&counters->brointel_software_count, 1, __ATOMIC_SEQ_CST);
+    struct _Sagan_BroIntel_Cache_Header header;
+    struct _Sagan_BroIntel_Set *set = NULL;
 
+    char tmp_file[MAXPATH+8] = { 0 };
+    FILE *fp;
 
-                                        }
-                                }
+    uint64_t offset = 0;
+    bool ok = true;
+    int i;
 
-                            if (!strcmp(type, "Intel::EMAIL") && found_flag == 0)
-                                {
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", config->brointel_cache);
 
-                                    To_LowerC(value);
+    if (( fp = fopen(tmp_file, "w")) == NULL )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Could not write Bro Intel cache %s (%s)", __FILE__, __LINE__, tmp_file, strerror(errno));
+            return;
+        }
 
-                                    found_flag_array = 0;
+    memset(&header, 0, sizeof(header));
 
-                                    for (i=0; i < counters->brointel_email_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Email[i].email, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::EMAIL '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+    memcpy(header.magic, BROINTEL_CACHE_MAGIC, sizeof(header.magic));
+    header.version = BROINTEL_CACHE_VERSION;
+    header.dups = intel->dups;
+    header.fingerprint = fingerprint;
 
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+    /* Placeholder,  the real header is written last */
 
-                                                    found_flag_array = 1;
+    ok = Sagan_BroIntel_Cache_Write_Data(fp, &header, sizeof(header), &offset);
 
-                                                }
-                                        }
+    for ( i = 0; i < BROINTEL_TYPES && ok == true; i++ )
+        {
 
-                                    if ( found_flag_array == 0 )
-                                        {
+            set = &intel->set[i];
 
-                                            Sagan_BroIntel_Intel_Email = (_Sagan_BroIntel_Intel_Email *) realloc(Sagan_BroIntel_Intel_Email, (counters->brointel_email_count+1) * sizeof(_Sagan_BroIntel_Intel_Email));
+            if ( set->count == 0 )
+                {
+                    continue;
+                }
 
-                                            if ( Sagan_BroIntel_Intel_Email == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Email. Abort!", __FILE__, __LINE__);
-                                                }
+            header.set[i].slots = set->slots;
+            header.set[i].count = set->count;
+            header.set[i].min_len = set->min_len;
+            header.set[i].max_len = set->max_len;
 
-                                            memset(&Sagan_BroIntel_Intel_Email[counters->brointel_email_count], 0, sizeof(_Sagan_BroIntel_Intel_Email));
+            header.set[i].table_offset = offset;
+            ok = Sagan_BroIntel_Cache_Write_Data(fp, set->table, (uint64_t)set->slots * sizeof(struct _Sagan_BroIntel_Slot), &offset);
 
-                                            strlcpy(Sagan_BroIntel_Intel_Email[counters->brointel_email_count].email, value, sizeof(Sagan_BroIntel_Intel_Email[counters->brointel_email_count].email));
+            header.set[i].blob_offset = offset;
+            header.set[i].blob_len = set->blob_len;
 
-                                            __atomic_add_fetch(&counters->brointel_email_count, 1, __ATOMIC_SEQ_CST);
+            if ( ok == true )
+                {
+                    ok = Sagan_BroIntel_Cache_Write_Data(fp, set->blob, set->blob_len, &offset);
+                }
 
-                                            found_flag = 1;
-                                        }
+            if ( ok == true && set->ac != NULL )
+                {
 
-                                }
+                    header.set[i].ac_offset = offset;
+                    header.set[i].ac_len = Sagan_AC_Write(set->ac, fp);
 
+                    ok = header.set[i].ac_len != 0;
+                    offset = offset + header.set[i].ac_len;
+                }
+        }
 
-                            if (!strcmp(type, "Intel::USER_NAME") && found_flag == 0)
-                                {
-                                    To_LowerC(value);
+    header.size = offset;
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+    if ( ok == true )
+        {
+            ok = fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+        }
 
-                                    for (i=0; i < counters->brointel_user_name_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_User_Name[i].username, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::USER_NAME '%s' in %s on line %.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+    if ( fclose(fp) != 0 )
+        {
+            ok = false;
+        }
 
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+    if ( ok == false || rename(tmp_file, config->brointel_cache) != 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Could not write Bro Intel cache %s (%s)", __FILE__, __LINE__, config->brointel_cache, strerror(errno));
+            unlink(tmp_file);
+            return;
+        }
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+    Sagan_Log(NORMAL, "Bro Intel Processor wrote cache %s (%" PRIu64 " bytes).", config->brointel_cache, offset);
+}
 
-                                    if ( found_flag_array == 0 )
-                                        {
+/*****************************************************************************
+ * Sagan_BroIntel_Parse - Loads one Bro Intel file into "intel"
+ *****************************************************************************/
 
+static void Sagan_BroIntel_Parse( struct _Sagan_BroIntel *intel, const char *brointel_filename )
+{
 
-                                            Sagan_BroIntel_Intel_User_Name = (_Sagan_BroIntel_Intel_User_Name *) realloc(Sagan_BroIntel_Intel_User_Name, (counters->brointel_user_name_count+1) * sizeof(_Sagan_BroIntel_Intel_User_Name));
+    FILE *brointel_file;
 
-                                            if ( Sagan_BroIntel_Intel_User_Name == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_User_Name. Abort!", __FILE__, __LINE__);
-                                                }
+    char *value;
+    char *type;
+    char *description;
 
-                                            memset(&Sagan_BroIntel_Intel_User_Name[counters->brointel_user_name_count], 0, sizeof(_Sagan_BroIntel_Intel_User_Name));
+    char *tok = NULL;
 
-                                            strlcpy(Sagan_BroIntel_Intel_User_Name[counters->brointel_user_name_count].username, value, sizeof(Sagan_BroIntel_Intel_User_Name[counters->brointel_user_name_count].username));
+    int line_count = 0;
+    int i;
 
-                                            __atomic_add_fetch(&counters->brointel_user_name_count, 1, __ATOMIC_SEQ_CST);
+    unsigned char bits_ip[MAXIPBIT] = {0};
 
-                                        }
-                                }
+    char brointelbuf[MAX_BROINTEL_LINE_SIZE] = { 0 };
 
-                            if (!strcmp(type, "Intel::FILE_NAME") && found_flag == 0)
-                                {
+    Sagan_Log(NORMAL, "Bro Intel Processor Loading File: %s.", brointel_filename);
 
-                                    To_LowerC(value);
+    if (( brointel_file = fopen(brointel_filename, "r")) == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Could not load Bro Intel file! (%s - %s)", __FILE__, __LINE__, brointel_filename, strerror(errno));
+        }
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+    while(fgets(brointelbuf, MAX_BROINTEL_LINE_SIZE, brointel_file) != NULL)
+        {
 
-                                    for (i=0; i < counters->brointel_file_name_count; i++)
-                                        {
+            line_count++;
 
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_File_Name[i].file_name, value))
-                                                {
+            /* Skip comments and blank linkes */
 
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::FILE_NAME '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+            if (brointelbuf[0] == '#' || brointelbuf[0] == 10 || brointelbuf[0] == ';' || brointelbuf[0] == 32 )
+                {
+                    continue;
+                }
 
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+            Remove_Return(brointelbuf);
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+            value = strtok_r(brointelbuf, "\t", &tok);
+            type = strtok_r(NULL, "\t", &tok);
+            description = strtok_r(NULL, "\t", &tok);
 
+            if ( value == NULL || type == NULL || description == NULL )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Got invalid line at %d in %s", __FILE__, __LINE__, line_count, brointel_filename);
+                    continue;
+                }
 
-                                    if ( found_flag_array == 0 )
-                                        {
+            for ( i = 0; i < BROINTEL_TYPES; i++ )
+                {
+                    if ( !strcmp(type, Sagan_BroIntel_Type_Name[i]) )
+                        {
+                            break;
+                        }
+                }
 
-                                            Sagan_BroIntel_Intel_File_Name = (_Sagan_BroIntel_Intel_File_Name *) realloc(Sagan_BroIntel_Intel_File_Name, (counters->brointel_file_name_count+1) * sizeof(_Sagan_BroIntel_Intel_File_Name));
+            if ( i == BROINTEL_TYPES )
+                {
+                    continue;
+                }
 
-                                            if ( Sagan_BroIntel_Intel_File_Name == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_File_Name. Abort!", __FILE__, __LINE__);
-                                                }
+            if ( i == BROINTEL_ADDR )
+                {
 
-                                            memset(&Sagan_BroIntel_Intel_File_Name[counters->brointel_file_name_count], 0, sizeof(_Sagan_BroIntel_Intel_File_Name));
+                    if ( !IP2Bit(value, bits_ip) )
+                        {
+                            continue;
+                        }
 
-                                            strlcpy(Sagan_BroIntel_Intel_File_Name[counters->brointel_file_name_count].file_name, value, sizeof(Sagan_BroIntel_Intel_File_Name[counters->brointel_file_name_count].file_name));
+                    if ( Sagan_BroIntel_Set_Add(&intel->set[i], (char *)bits_ip, MAXIPBIT) == false )
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::ADDR address %s in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count);
+                            intel->dups++;
+                        }
 
-                                            __atomic_add_fetch(&counters->brointel_file_name_count, 1, __ATOMIC_SEQ_CST);
+                    continue;
+                }
 
-                                        }
+            To_LowerC(value);
 
-                                }
+            if ( ( i == BROINTEL_FILE_HASH || i == BROINTEL_CERT_HASH ) && strlen(value) > BROINTEL_MAX_HASH )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] %s '%s' in %s on line %d is too long, skipping.", __FILE__, __LINE__, type, value, brointel_filename, line_count);
+                    continue;
+                }
 
-                            if (!strcmp(type, "Intel::CERT_HASH") && found_flag == 0)
-                                {
-                                    To_LowerC(value);
+            if ( Sagan_BroIntel_Set_Add(&intel->set[i], value, strlen(value)) == false )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Got duplicate %s '%s' in %s on line %d.", __FILE__, __LINE__, type, value, brointel_filename, line_count);
+                    intel->dups++;
+                }
 
-                                    found_flag = 1;
-                                    found_flag_array = 0;
+        }
 
-                                    for (i=0; i < counters->brointel_cert_hash_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Cert_Hash[i].cert_hash, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::CERT_HASH '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-                                                    __atomic_add_fetch(&counters->brointel_dups, 1, __ATOMIC_SEQ_CST);
+    fclose(brointel_file);
+}
 
-                                                    found_flag_array = 1;
-                                                }
-                                        }
+/*****************************************************************************
+ * Sagan_BroIntel_Load_File - Loads BroIntel data (or its cache) and
+ * replaces the current data with it.
+ * ***************************************************************************/
 
-                                    if ( found_flag_array == 0 )
-                                        {
-                                            Sagan_BroIntel_Intel_Cert_Hash = (_Sagan_BroIntel_Intel_Cert_Hash *) realloc(Sagan_BroIntel_Intel_Cert_Hash, (counters->brointel_cert_hash_count+1) * sizeof(_Sagan_BroIntel_Intel_Cert_Hash));
+void Sagan_BroIntel_Load_File ( void )
+{
 
-                                            if ( Sagan_BroIntel_Intel_Cert_Hash == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Cert_Hash. Abort!", __FILE__, __LINE__);
-                                                }
+    struct _Sagan_BroIntel *intel = NULL;
+    struct _Sagan_BroIntel *old = NULL;
 
-                                            memset(&Sagan_BroIntel_Intel_Cert_Hash[counters->brointel_cert_hash_count], 0, sizeof(_Sagan_BroIntel_Intel_Cert_Hash));
+    char brointel_files[sizeof(config->brointel_files)] = { 0 };
+    char *brointel_filename = NULL;
+    char *ptmp = NULL;
 
-                                            strlcpy(Sagan_BroIntel_Intel_Cert_Hash[counters->brointel_cert_hash_count].cert_hash, value, sizeof(Sagan_BroIntel_Intel_Cert_Hash[counters->brointel_cert_hash_count].cert_hash));
+    uint64_t fingerprint;
+    int i;
 
-                                            __atomic_add_fetch(&counters->brointel_cert_hash_count, 1, __ATOMIC_SEQ_CST);
+    /* strtok_r() would chop up the config copy,  so work on our own */
 
-                                        }
-                                }
+    strlcpy(brointel_files, config->brointel_files, sizeof(brointel_files));
 
+    fingerprint = Sagan_BroIntel_Fingerprint(brointel_files);
 
-                        }
+    if ( config->brointel_cache[0] != '\0' )
+        {
 
-                    line_count++;
+            intel = Sagan_BroIntel_Cache_Load(fingerprint);
 
+            if ( intel != NULL )
+                {
+                    Sagan_Log(NORMAL, "Bro Intel Processor loaded cache %s.", config->brointel_cache);
                 }
-            fclose(brointel_file);
-            brointel_filename = strtok_r(NULL, ",", &ptmp);
-            line_count = 0;
         }
 
-}
-
-/*****************************************************************************
- * Sagan_BroIntel_IPADDR - Search array for blacklisted IP addresses
- *****************************************************************************/
-
-bool Sagan_BroIntel_IPADDR ( unsigned char *ip, char *ipaddr )
-{
-
-    int i = 0;
-
-    unsigned char ip_convert[MAXIPBIT] = { 0 };
-    memset(ip_convert, 0, MAXIPBIT);
-    memcpy(ip_convert, ip, MAXIPBIT);
-
-    /* If RFC1918 and friends,  we can short circuit here */
-
-    if ( is_notroutable(ip) )
+    if ( intel == NULL )
         {
 
-            if ( debug->debugbrointel )
+            intel = calloc(1, sizeof(struct _Sagan_BroIntel));
+
+            if ( intel == NULL )
                 {
-                    Sagan_Log(DEBUG, "[%s, line %d] %s is RFC1918, link local or invalid.", __FILE__, __LINE__, ipaddr );
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bro Intel. Abort!", __FILE__, __LINE__);
                 }
 
-            return(false);
-        }
-
-    /* Search array for for the IP address */
+            brointel_filename = strtok_r(brointel_files, ",", &ptmp);
 
-    for ( i = 0; i < counters->brointel_addr_count; i++)
-        {
+            while ( brointel_filename != NULL )
+                {
+                    Sagan_BroIntel_Parse(intel, brointel_filename);
+                    brointel_filename = strtok_r(NULL, ",", &ptmp);
+                }
 
-            if ( !memcmp(ip_convert, Sagan_BroIntel_Intel_Addr[i].bits_ip, MAXIPBIT) )
+            for ( i = 0; i < BROINTEL_TYPES; i++ )
                 {
-                    if ( debug->debugbrointel )
+                    if ( Sagan_BroIntel_Substring[i] == true )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found IP %u.", __FILE__, __LINE__, ip);
+                            Sagan_BroIntel_Set_Build(&intel->set[i]);
                         }
-
-                    return(true);
                 }
 
+            if ( config->brointel_cache[0] != '\0' )
+                {
+                    Sagan_BroIntel_Cache_Write(intel, fingerprint);
+                }
         }
 
-    return(false);
+    __atomic_store_n(&counters->brointel_addr_count, intel->set[BROINTEL_ADDR].count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->brointel_domain_count, intel->set[BROINTEL_DOMAIN].count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->brointel_file_hash_count, intel->set[BROINTEL_FILE_HASH].count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->brointel_url_count, intel->set[BROINTEL_URL].count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->brointel_software_count, intel->set[BROINTEL_SOFTWARE].count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->brointel_email_count, intel->set[BROINTEL_EMAIL].count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->brointel_user_name_count, intel->set[BROINTEL_USER_NAME].count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->brointel_file_name_count, intel->set[BROINTEL_FILE_NAME].count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->brointel_cert_hash_count, intel->set[BROINTEL_CERT_HASH].count, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&counters->brointel_dups, intel->dups, __ATOMIC_SEQ_CST);
 
-}
+    /* Lookups may still be in the data this replaces,  so it is only freed
+       on the next reload */
 
-/*****************************************************************************
- * Sagan_BroIntel_IPADDR_All - Search and tests _all_ IP addresses within
- * a syslog_message (reguardless of lognorm/parse ip)!
- *****************************************************************************/
+    old = __atomic_exchange_n(&SaganBroIntel, intel, __ATOMIC_SEQ_CST);
 
-bool Sagan_BroIntel_IPADDR_All ( char *syslog_message, _Sagan_Lookup_Cache_Entry *lookup_cache, size_t cache_size)
+    if ( old != NULL )
+        {
+            Sagan_BroIntel_Free(old->retired);
+            old->retired = NULL;
+            intel->retired = old;
+        }
+
+}
+
+static void Sagan_BroIntel_Free( struct _Sagan_BroIntel *intel )
 {
 
     int i;
-    int b;
 
-    for (i = 0; i < MAX_PARSE_IP; i++)
+    if ( intel == NULL )
+        {
+            return;
+        }
+
+    for ( i = 0; i < BROINTEL_TYPES; i++ )
         {
 
+            Sagan_AC_Free(intel->set[i].ac);
 
-            if ( lookup_cache[i].status == 0 )
+            if ( intel->map == NULL )
                 {
-                    return(false);
+                    free(intel->set[i].table);
+                    free(intel->set[i].blob);
                 }
+        }
 
-            for ( b = 0; b < counters->brointel_addr_count; b++ )
-                {
-
-                    if ( !memcmp(Sagan_BroIntel_Intel_Addr[b].bits_ip, lookup_cache[i].ip_bits, sizeof(Sagan_BroIntel_Intel_Addr[b].bits_ip)))
-                        {
-                            return(true);
-                        }
-                }
+    if ( intel->map != NULL )
+        {
+            munmap(intel->map, intel->map_len);
         }
 
-    return(false);
+    free(intel);
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_DOMAIN - Search DOMAIN array
+ * Sagan_BroIntel_Find - Exact lookup of "key" in a set of the current data.
  *****************************************************************************/
 
-bool Sagan_BroIntel_DOMAIN ( char *syslog_message )
+static bool Sagan_BroIntel_Find( int type, const char *key, size_t len )
 {
 
-    int i;
+    struct _Sagan_BroIntel *intel = __atomic_load_n(&SaganBroIntel, __ATOMIC_ACQUIRE);
 
-    for ( i = 0; i < counters->brointel_domain_count; i++)
+    if ( intel == NULL )
         {
-
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Domain[i].domain, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found domain %s.", __FILE__, __LINE__, Sagan_BroIntel_Intel_Domain[i].domain);
-                        }
-
-                    return(true);
-                }
-
+            return(false);
         }
 
-    return(false);
-
+    return( Sagan_BroIntel_Set_Find(&intel->set[type], key, len, IPC_Hash_Bytes(IPC_HASH_SEED, key, len)) != 0 );
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_FILE_HASH - Search FILE_HASH array
+ * Sagan_BroIntel_Search - Looks for any indicator of a substring "type" in
+ * the log line.
  *****************************************************************************/
 
-bool Sagan_BroIntel_FILE_HASH ( char *syslog_message )
+static bool Sagan_BroIntel_Search_Found( int id, void *data )
 {
+    *(int *)data = id;
+    return(true);
+}
 
-    int i;
+static bool Sagan_BroIntel_Search( int type, const char *syslog_message )
+{
+
+    struct _Sagan_BroIntel *intel = __atomic_load_n(&SaganBroIntel, __ATOMIC_ACQUIRE);
+    int found = -1;
 
-    for ( i = 0; i < counters->brointel_file_hash_count; i++)
+    if ( intel == NULL || intel->set[type].ac == NULL )
         {
+            return(false);
+        }
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_File_Hash[i].hash, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found file hash %s.", __FILE__, __LINE__, Sagan_BroIntel_Intel_File_Hash[i].hash);
-                        }
-
-                    return(true);
-                }
+    Sagan_AC_Search(&intel->set[type].ac, 1, syslog_message, strlen(syslog_message), Sagan_BroIntel_Search_Found, &found);
 
+    if ( found == -1 )
+        {
+            return(false);
         }
 
-    return(false);
+    if ( debug->debugbrointel )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Found %s \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Type_Name[type], intel->set[type].blob + found);
+        }
 
+    return(true);
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_URL - Search URL array
+ * Sagan_BroIntel_Hash - Looks up every word in the log line that could be
+ * a hash of "type" (runs of letters and digits the length of a loaded
+ * hash).
  *****************************************************************************/
 
-bool Sagan_BroIntel_URL ( char *syslog_message )
+static bool Sagan_BroIntel_Hash( int type, const char *syslog_message )
 {
 
-    int i;
+    struct _Sagan_BroIntel *intel = __atomic_load_n(&SaganBroIntel, __ATOMIC_ACQUIRE);
+    struct _Sagan_BroIntel_Set *set = NULL;
 
-    for ( i = 0; i < counters->brointel_url_count; i++)
-        {
+    const char *p = syslog_message;
+    const char *start = NULL;
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_URL[i].url, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found URL \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_URL[i].url);
-                        }
-
-                    return(true);
-                }
+    char hash[BROINTEL_MAX_HASH+1];
+    size_t len;
+    size_t i;
 
+    if ( intel == NULL || intel->set[type].count == 0 )
+        {
+            return(false);
         }
 
-    return(false);
-}
+    set = &intel->set[type];
 
-/*****************************************************************************
- * Sagan_BroIntel_SOFTWARE - Search SOFTWARE array
- ****************************************************************************/
+    while ( *p != '\0' )
+        {
 
-bool Sagan_BroIntel_SOFTWARE ( char *syslog_message )
-{
+            if ( !isalnum((unsigned char)*p) )
+                {
+                    p++;
+                    continue;
+                }
 
-    int i;
+            for ( start = p; isalnum((unsigned char)*p); p++ );
 
-    for ( i = 0; i < counters->brointel_software_count; i++)
-        {
+            len = p - start;
+
+            if ( len < set->min_len || len > set->max_len )
+                {
+                    continue;
+                }
+
+            for ( i = 0; i < len; i++ )
+                {
+                    hash[i] = tolower((unsigned char)start[i]);
+                }
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Software[i].software, false) )
+            if ( Sagan_BroIntel_Set_Find(set, hash, len, IPC_Hash_Bytes(IPC_HASH_SEED, hash, len)) != 0 )
                 {
+
                     if ( debug->debugbrointel )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found software \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_Software[i].software);
+                            hash[len] = '\0';
+                            Sagan_Log(DEBUG, "[%s, line %d] Found %s %s.", __FILE__, __LINE__, Sagan_BroIntel_Type_Name[type], hash);
                         }
 
                     return(true);
                 }
-
         }
 
     return(false);
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_EMAIL - Search EMAIL array
+ * Sagan_BroIntel_IPADDR - Search for blacklisted IP addresses
  *****************************************************************************/
 
-bool Sagan_BroIntel_EMAIL ( char *syslog_message )
+bool Sagan_BroIntel_IPADDR ( unsigned char *ip, char *ipaddr )
 {
 
-    int i;
+    /* If RFC1918 and friends,  we can short circuit here */
 
-    for ( i = 0; i < counters->brointel_email_count; i++)
+    if ( is_notroutable(ip) )
         {
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Email[i].email, false) )
+            if ( debug->debugbrointel )
                 {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found e-mail address \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_Email[i].email);
-                        }
+                    Sagan_Log(DEBUG, "[%s, line %d] %s is RFC1918, link local or invalid.", __FILE__, __LINE__, ipaddr );
+                }
 
-                    return(true);
+            return(false);
+        }
+
+    if ( Sagan_BroIntel_Find(BROINTEL_ADDR, (const char *)ip, MAXIPBIT) )
+        {
+            if ( debug->debugbrointel )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Found IP %s.", __FILE__, __LINE__, ipaddr);
                 }
 
+            return(true);
         }
 
     return(false);
+
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_USER_NAME - Search USER_NAME array
- ****************************************************************************/
+ * Sagan_BroIntel_IPADDR_All - Search and tests _all_ IP addresses within
+ * a syslog_message (reguardless of lognorm/parse ip)!
+ *****************************************************************************/
 
-bool Sagan_BroIntel_USER_NAME ( char *syslog_message )
+bool Sagan_BroIntel_IPADDR_All ( char *syslog_message, _Sagan_Lookup_Cache_Entry *lookup_cache, size_t cache_size)
 {
 
-    int i;
+    size_t i;
 
-    for ( i = 0; i < counters->brointel_user_name_count; i++)
+    for (i = 0; i < cache_size; i++)
         {
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_User_Name[i].username, false) )
+            if ( lookup_cache[i].status == 0 )
                 {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found the username \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_User_Name[i].username);
-                        }
+                    return(false);
+                }
 
+            if ( Sagan_BroIntel_Find(BROINTEL_ADDR, (const char *)lookup_cache[i].ip_bits, MAXIPBIT) )
+                {
                     return(true);
                 }
-
         }
 
     return(false);
 }
 
-/****************************************************************************
- * Sagan_BroIntel_FILE_NAME - Search FILE_NAME array
- ****************************************************************************/
+/*****************************************************************************
+ * Sagan_BroIntel_DOMAIN - Search for DOMAIN's
+ *****************************************************************************/
 
-bool Sagan_BroIntel_FILE_NAME ( char *syslog_message )
+bool Sagan_BroIntel_DOMAIN ( char *syslog_message )
 {
+    return( Sagan_BroIntel_Search(BROINTEL_DOMAIN, syslog_message) );
+}
 
-    int i;
+/*****************************************************************************
+ * Sagan_BroIntel_FILE_HASH - Search for FILE_HASH's
+ *****************************************************************************/
 
-    for ( i = 0; i < counters->brointel_file_name_count; i++)
-        {
+bool Sagan_BroIntel_FILE_HASH ( char *syslog_message )
+{
+    return( Sagan_BroIntel_Hash(BROINTEL_FILE_HASH, syslog_message) );
+}
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_File_Name[i].file_name, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found the file name \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_File_Name[i].file_name);
-                        }
+/*****************************************************************************
+ * Sagan_BroIntel_URL - Search for URL's
+ *****************************************************************************/
 
-                    return(true);
-                }
+bool Sagan_BroIntel_URL ( char *syslog_message )
+{
+    return( Sagan_BroIntel_Search(BROINTEL_URL, syslog_message) );
+}
 
-        }
+/*****************************************************************************
+ * Sagan_BroIntel_SOFTWARE - Search for SOFTWARE
+ ****************************************************************************/
 
-    return(false);
+bool Sagan_BroIntel_SOFTWARE ( char *syslog_message )
+{
+    return( Sagan_BroIntel_Search(BROINTEL_SOFTWARE, syslog_message) );
 }
 
-/***************************************************************************
- * Sagan_BroIntel_CERT_HASH - Search CERT_HASH array
- ***************************************************************************/
+/*****************************************************************************
+ * Sagan_BroIntel_EMAIL - Search for EMAIL's
+ *****************************************************************************/
 
-bool Sagan_BroIntel_CERT_HASH ( char *syslog_message )
+bool Sagan_BroIntel_EMAIL ( char *syslog_message )
 {
+    return( Sagan_BroIntel_Search(BROINTEL_EMAIL, syslog_message) );
+}
 
-    int i;
+/*****************************************************************************
+ * Sagan_BroIntel_USER_NAME - Search for USER_NAME's
+ ****************************************************************************/
 
-    for ( i = 0; i < counters->brointel_cert_hash_count; i++)
-        {
+bool Sagan_BroIntel_USER_NAME ( char *syslog_message )
+{
+    return( Sagan_BroIntel_Search(BROINTEL_USER_NAME, syslog_message) );
+}
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Cert_Hash[i].cert_hash, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found the CERT_HASH \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_Cert_Hash[i].cert_hash);
-                        }
+/****************************************************************************
+ * Sagan_BroIntel_FILE_NAME - Search for FILE_NAME's
+ ****************************************************************************/
 
-                    return(true);
-                }
+bool Sagan_BroIntel_FILE_NAME ( char *syslog_message )
+{
+    return( Sagan_BroIntel_Search(BROINTEL_FILE_NAME, syslog_message) );
+}
 
-        }
+/***************************************************************************
+ * Sagan_BroIntel_CERT_HASH - Search for CERT_HASH's
+ ***************************************************************************/
 
-    return(false);
+bool Sagan_BroIntel_CERT_HASH ( char *syslog_message )
+{
+    return( Sagan_BroIntel_Hash(BROINTEL_CERT_HASH, syslog_message) );
 }
-
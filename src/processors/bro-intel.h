@@ -40,58 +40,94 @@
 #define BROINTEL_PROCESSOR_GENERATOR_ID 1003
 
 
-typedef struct _Sagan_BroIntel_Intel_Addr _Sagan_BroIntel_Intel_Addr;
-struct _Sagan_BroIntel_Intel_Addr
-{
-    unsigned char bits_ip[MAXIPBIT];
-};
+/* Indicator types.  Each has its own set */
 
-typedef struct _Sagan_BroIntel_Intel_Domain _Sagan_BroIntel_Intel_Domain;
-struct _Sagan_BroIntel_Intel_Domain
-{
-    char domain[255];
-};
+#define BROINTEL_ADDR		0
+#define BROINTEL_DOMAIN		1
+#define BROINTEL_FILE_HASH	2
+#define BROINTEL_URL		3
+#define BROINTEL_SOFTWARE	4
+#define BROINTEL_EMAIL		5
+#define BROINTEL_USER_NAME	6
+#define BROINTEL_FILE_NAME	7
+#define BROINTEL_CERT_HASH	8
+#define BROINTEL_TYPES		9
 
-typedef struct _Sagan_BroIntel_Intel_File_Hash _Sagan_BroIntel_Intel_File_Hash;
-struct _Sagan_BroIntel_Intel_File_Hash
-{
-    char hash[64];
-};
+#define BROINTEL_MAX_HASH	128		/* Longest FILE_HASH/CERT_HASH looked up */
 
-typedef struct _Sagan_BroIntel_Intel_URL _Sagan_BroIntel_Intel_URL;
-struct _Sagan_BroIntel_Intel_URL
-{
-    char url[10240];
-};
+#define BROINTEL_CACHE_MAGIC	"SAGANBI1"
+#define BROINTEL_CACHE_VERSION	1
+
+/* Hash table slot.  "offset" is one past the indicator's offset in the
+   set's "blob",  so 0 is an empty slot */
 
-typedef struct _Sagan_BroIntel_Intel_Software _Sagan_BroIntel_Intel_Software;
-struct _Sagan_BroIntel_Intel_Software
+typedef struct _Sagan_BroIntel_Slot _Sagan_BroIntel_Slot;
+struct _Sagan_BroIntel_Slot
 {
-    char software[128];
+    uint32_t hash;
+    uint32_t offset;
 };
 
-typedef struct _Sagan_BroIntel_Intel_Email _Sagan_BroIntel_Intel_Email;
-struct _Sagan_BroIntel_Intel_Email
+/* Indicators of one type.  Each is stored once in "blob" (NUL terminated,
+   Intel::ADDR as MAXIPBIT bytes) and found through an open addressing hash
+   table.  The substring types also get an Aho-Corasick automaton whose
+   pattern ids are blob offsets. */
+
+typedef struct _Sagan_BroIntel_Set _Sagan_BroIntel_Set;
+struct _Sagan_BroIntel_Set
 {
-    char email[128];
+    struct _Sagan_BroIntel_Slot *table;
+    char *blob;
+    uint32_t slots;				/* Power of two */
+    uint32_t count;
+    uint64_t blob_len;
+    uint64_t blob_size;
+    uint32_t min_len;				/* Shortest/longest indicator */
+    uint32_t max_len;
+    struct _Sagan_AC *ac;
 };
 
-typedef struct _Sagan_BroIntel_Intel_User_Name _Sagan_BroIntel_Intel_User_Name;
-struct _Sagan_BroIntel_Intel_User_Name
+/* Everything loaded from the intel files.  Replaced as a whole on reload,
+   the old one is kept until the next reload (like the radix trees) */
+
+typedef struct _Sagan_BroIntel _Sagan_BroIntel;
+struct _Sagan_BroIntel
 {
-    char username[64];
+    struct _Sagan_BroIntel_Set set[BROINTEL_TYPES];
+    uint32_t dups;
+
+    void *map;					/* Cache file,  if the sets are in it */
+    size_t map_len;
+
+    struct _Sagan_BroIntel *retired;
 };
 
-typedef struct _Sagan_BroIntel_Intel_File_Name _Sagan_BroIntel_Intel_File_Name;
-struct _Sagan_BroIntel_Intel_File_Name
+/* Cache file header.  The tables,  blobs and automatons follow at the
+   offsets given,  8 byte aligned */
+
+typedef struct _Sagan_BroIntel_Cache_Set _Sagan_BroIntel_Cache_Set;
+struct _Sagan_BroIntel_Cache_Set
 {
-    char file_name[128];
+    uint64_t table_offset;
+    uint64_t blob_offset;
+    uint64_t blob_len;
+    uint64_t ac_offset;				/* 0 == no automaton */
+    uint64_t ac_len;
+    uint32_t slots;
+    uint32_t count;
+    uint32_t min_len;
+    uint32_t max_len;
 };
 
-typedef struct _Sagan_BroIntel_Intel_Cert_Hash _Sagan_BroIntel_Intel_Cert_Hash;
-struct _Sagan_BroIntel_Intel_Cert_Hash
+typedef struct _Sagan_BroIntel_Cache_Header _Sagan_BroIntel_Cache_Header;
+struct _Sagan_BroIntel_Cache_Header
 {
-    char cert_hash[64];
+    char magic[8];
+    uint32_t version;
+    uint32_t dups;
+    uint64_t fingerprint;			/* Of the intel files it was built from */
+    uint64_t size;
+    struct _Sagan_BroIntel_Cache_Set set[BROINTEL_TYPES];
 };
 
 
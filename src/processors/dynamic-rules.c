@@ -133,6 +133,7 @@ int Sagan_Dynamic_Rules ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int rule_po
             reload_rules = 1;
 
             Load_Rules(rulestruct[rule_position].dynamic_ruleset);
+            Rule_Index_Build();
 
             reload_rules = 0;
             pthread_mutex_unlock(&SaganRulesLoadedMutex);
@@ -38,6 +38,7 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <inttypes.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -48,6 +49,7 @@
 #include "flexbit-mmap.h"
 #include "rules.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "ipc.h"
 #include "flow.h"
 #include "after.h"
@@ -93,7 +95,85 @@ void Sagan_Engine_Init ( void )
     /* Nothing to do yet */
 }
 
-int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_flag )
+/****************************************************************************
+ * Per-event parser results.  Each of these runs its parser the first time
+ * a rule needs it and hands back the saved result after that.
+ ****************************************************************************/
+
+static void Sagan_Engine_Fields_Reset( struct _Sagan_Engine_Fields *fields )
+{
+
+    fields->lookup_cache_parsed = false;
+    fields->proto_program_parsed = false;
+    fields->host_parsed = false;
+    fields->json_ip_parsed = false;
+
+    memset(fields->hash_parsed, 0, sizeof(fields->hash_parsed));
+
+}
+
+static int Sagan_Engine_Parse_IP( struct _Sagan_Engine_Fields *fields, char *syslog_message )
+{
+
+    if ( fields->lookup_cache_parsed == false )
+        {
+            fields->lookup_cache_size = Parse_IP(syslog_message, fields->lookup_cache);
+            fields->lookup_cache_parsed = true;
+
+            Sagan_Counter_Add(engine_parse_ip, 1);
+        }
+
+    return(fields->lookup_cache_size);
+}
+
+static char *Sagan_Engine_Parse_Hash( struct _Sagan_Engine_Fields *fields, char *syslog_message, int type )
+{
+
+    char *hash = fields->hash[type-1];
+
+    if ( fields->hash_parsed[type-1] == false )
+        {
+            Parse_Hash(syslog_message, type, hash, sizeof(fields->hash[type-1]));
+            fields->hash_parsed[type-1] = true;
+
+            Sagan_Counter_Add(engine_parse_hash, 1);
+        }
+
+    return(hash);
+}
+
+static unsigned char Sagan_Engine_Parse_Proto_Program( struct _Sagan_Engine_Fields *fields, char *syslog_program )
+{
+
+    if ( fields->proto_program_parsed == false )
+        {
+            fields->proto_program = Parse_Proto_Program(syslog_program);
+            fields->proto_program_parsed = true;
+
+            Sagan_Counter_Add(engine_parse_proto, 1);
+        }
+
+    return(fields->proto_program);
+}
+
+/* Bits of the address used when a rule has no source/destination of its
+   own.  "host" is the same for every rule in the event */
+
+static unsigned char *Sagan_Engine_Host_Bits( struct _Sagan_Engine_Fields *fields, char *host )
+{
+
+    if ( fields->host_parsed == false )
+        {
+            IP2Bit(host, fields->host_bits);
+            fields->host_parsed = true;
+
+            Sagan_Counter_Add(engine_ip2bit, 1);
+        }
+
+    return(fields->host_bits);
+}
+
+int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_flag, int replay_rule )
 {
 
     struct _Sagan_Routing *SaganRouting = NULL;
@@ -138,21 +218,32 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
     memset(processor_info_engine, 0, sizeof(_Sagan_Processor_Info));
 
-    struct _Sagan_Lookup_Cache_Entry *lookup_cache = NULL;
-    lookup_cache = malloc(sizeof(struct _Sagan_Lookup_Cache_Entry) * MAX_PARSE_IP);
+    /* Parser results for this event.  These are only valid once their
+       "parsed" flag is set,  so they aren't cleared between events */
 
-    if ( lookup_cache == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for lookup_cache. Abort!", __FILE__, __LINE__);
-        }
+    static __thread struct _Sagan_Engine_Fields SaganEngineFields;
+    struct _Sagan_Engine_Fields *fields = &SaganEngineFields;
+
+    Sagan_Engine_Fields_Reset(fields);
 
-    memset(lookup_cache, 0, sizeof(_Sagan_Lookup_Cache_Entry) * MAX_PARSE_IP);
+    struct _Sagan_Lookup_Cache_Entry *lookup_cache = fields->lookup_cache;
 
     bool after_log_flag = false;
     bool thresh_log_flag = false;
 
     int threadid = 0;
 
+    struct _Rule_Index *rule_index = NULL;
+    struct _Rule_Header_Event header_event;
+
+    /* Reused across events;  only grows when rules are added */
+
+    static __thread int *candidates = NULL;
+    static __thread int candidates_size = 0;
+    int candidate_count = 0;
+    int candidate_max = 0;
+    int c = 0;
+
     int b = 0;
     int z = 0;
 
@@ -160,19 +251,19 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
     int sagan_match = 0;	/* Used to determine if all has "matched" (content, pcre, meta_content, etc) */
 
     int rc = 0;
-    int ovector[PCRE_OVECCOUNT];
 
-    int alter_num = 0;
-    int meta_alter_num = 0;
+    size_t syslog_message_len = 0;
+
+    struct timespec pcre_start;
+    struct timespec pcre_end;
 
-    char *ptmp;
-    char *tok2;
+    size_t window_start = 0;
+    size_t window_len = 0;
+    bool content_found = false;
 
     char parse_ip_src[MAXIP] = { 0 };
     char parse_ip_dst[MAXIP] = { 0 };
-    char parse_md5_hash[MD5_HASH_SIZE+1] = { 0 };
-    char parse_sha1_hash[SHA1_HASH_SIZE+1] = { 0 };
-    char parse_sha256_hash[SHA256_HASH_SIZE+1] = { 0 };
+    char parse_no_hash[1] = { 0 };
 
     bool ip_src_flag = false;
 
@@ -184,10 +275,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
     uint32_t ip_dstport_u32 = 0;
     unsigned char ip_dst_bits[MAXIPBIT] = { 0 };
 
-    char tmpbuf[128] = { 0 };
     char s_msg[1024] = { 0 };
-    char alter_content[MAX_SYSLOGMSG] = { 0 };
-    char meta_alter_content[MAX_SYSLOGMSG] = { 0 };
 
     struct timeval tp;
     unsigned char proto = 0;
@@ -223,6 +311,12 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
     unsigned char bluedot_results = 0;
 
+#ifdef WITH_BLUEDOT
+
+    struct _Sagan_Bluedot_Pending bluedot_pending = { 0 };
+
+#endif
+
     /* Outside the WITH_BLUEDOT because we use it in passing to Send_Alert() */
 
     char bluedot_json[BLUEDOT_JSON_SIZE] = { 0 };
@@ -305,30 +399,82 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
 #endif
 
+    /* The message doesn't change from here on */
+
+    syslog_message_len = strlen(SaganProcSyslog_LOCAL->syslog_message);
+
     /* Search for matches */
 
+    /* Only look at rules the prefilter index says could match this event
+     * (by program/facility/level/priority and anchor content).  The
+     * candidates and the header lookups all use this one index.  It can't
+     * be freed until Rule_Index_Exit() */
+
+    rule_index = Rule_Index_Enter();
+
+    /* counters->rulecount moves under us (dynamic rules,  SIGHUP),  so
+       it's read once and never past what the index covers */
+
+    candidate_max = __atomic_load_n(&counters->rulecount, __ATOMIC_SEQ_CST);
+
+    if ( rule_index != NULL && rule_index->rule_count < candidate_max )
+        {
+            candidate_max = rule_index->rule_count;
+        }
+
+    if ( candidate_max + 1 > candidates_size )
+        {
+
+            candidates = realloc(candidates, sizeof(int) * (candidate_max + 1));
+
+            if ( candidates == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for candidates. Abort!", __FILE__, __LINE__);
+                }
+
+            candidates_size = candidate_max + 1;
+        }
+
+    /* A replayed event (see Sagan_Bluedot_Replay()) only re-runs the rule
+       that was waiting on it,  if a reload hasn't dropped it since */
+
+    if ( replay_rule != SAGAN_ENGINE_ALL_RULES )
+        {
+
+            if ( replay_rule < candidate_max )
+                {
+                    candidates[0] = replay_rule;
+                    candidate_count = 1;
+                }
+        }
+    else
+        {
+            candidate_count = Rule_Index_Candidates(rule_index, SaganProcSyslog_LOCAL, candidates, candidate_max);
+        }
+
     /* First we search for 'program' and such.   This way,  we don't waste CPU
-     * time with pcre/content.  */
+     * time with pcre/content.  The event's fields are interned once here. */
 
+    Rule_Index_Header_Intern(rule_index, SaganProcSyslog_LOCAL, &header_event);
 
-    for(b=0; b < counters->rulecount; b++)
+
+    for(c=0; c < candidate_count; c++)
         {
 
+            b = candidates[c];
+
             ip_src_flag = false;
             ip_dst_flag = false;
 
             parse_ip_src[0] = '\0';
             parse_ip_dst[0] = '\0';
-            parse_md5_hash[0] = '\0';
-            parse_sha1_hash[0] = '\0';
-            parse_sha256_hash[0] = '\0';
 
             ip_src = parse_ip_src;
             ip_dst = parse_ip_dst;
 
-            md5_hash = parse_md5_hash;
-            sha1_hash = parse_sha1_hash;
-            sha256_hash = parse_sha256_hash;
+            md5_hash = parse_no_hash;
+            sha1_hash = parse_no_hash;
+            sha256_hash = parse_no_hash;
 
             ip_dstport_u32 = 0;
             ip_srcport_u32 = 0;
@@ -342,10 +488,28 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                set it here.  "normalize" and "parse_*_ip can still over ride */
 
 
+            if ( fields->json_ip_parsed == false )
+                {
+
+                    if ( SaganProcSyslog_LOCAL->src_ip[0] != '\0' )
+                        {
+                            IP2Bit(SaganProcSyslog_LOCAL->src_ip, fields->json_src_bits);
+                            Sagan_Counter_Add(engine_ip2bit, 1);
+                        }
+
+                    if ( SaganProcSyslog_LOCAL->dst_ip[0] != '\0' )
+                        {
+                            IP2Bit(SaganProcSyslog_LOCAL->dst_ip, fields->json_dst_bits);
+                            Sagan_Counter_Add(engine_ip2bit, 1);
+                        }
+
+                    fields->json_ip_parsed = true;
+                }
+
             if ( SaganProcSyslog_LOCAL->src_ip[0] != '\0' )
                 {
                     ip_src = SaganProcSyslog_LOCAL->src_ip;
-                    IP2Bit(ip_src, ip_src_bits);
+                    memcpy(ip_src_bits, fields->json_src_bits, MAXIPBIT);
                     ip_src_flag = true;
                 }
 
@@ -353,7 +517,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                 {
 
                     ip_dst = SaganProcSyslog_LOCAL->dst_ip;
-                    IP2Bit(ip_dst, ip_dst_bits);
+                    memcpy(ip_dst_bits, fields->json_dst_bits, MAXIPBIT);
                     ip_dst_flag = true;
                 }
 
@@ -414,91 +578,11 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                     match = false;
 
-                    if ( rulestruct[b].s_program[0] != '\0' && match == false )
-                        {
-
-                            strlcpy(tmpbuf, rulestruct[b].s_program, sizeof(tmpbuf));
-
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-
-                            while ( ptmp != NULL )
-                                {
-                                    if ( Wildcard(ptmp, SaganProcSyslog_LOCAL->syslog_program) == 1 )
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( rulestruct[b].s_facility[0] != '\0' && match == false )
-                        {
-                            strlcpy(tmpbuf, rulestruct[b].s_facility, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_facility))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( rulestruct[b].s_level[0] != '\0' && match == false )
-                        {
-                            strlcpy(tmpbuf, rulestruct[b].s_level, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_level))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( rulestruct[b].s_tag[0] != '\0' && match == false )
-                        {
-                            strlcpy(tmpbuf, rulestruct[b].s_tag, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_tag))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
+                    /* program,  facility,  level,  tag and priority */
 
-                    if ( rulestruct[b].s_syspri[0] != '\0' && match == false )
+                    if ( Rule_Index_Header_Match(&header_event, b) == false )
                         {
-                            strlcpy(tmpbuf, rulestruct[b].s_syspri, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
                             match = true;
-
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_priority))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
                         }
 
                     /* If there has been a match above,  or NULL on all,  then we continue with
@@ -516,99 +600,24 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                         {
 
 
-                                            /* Content: OFFSET */
+                                            /* Content: OFFSET/DEPTH/DISTANCE/WITHIN */
 
-                                            alter_num = 0;
+                                            Sagan_memmem_Window(syslog_message_len, rulestruct[b].s_offset[z], rulestruct[b].s_depth[z], z > 0 ? rulestruct[b].s_depth[z-1] : 0, rulestruct[b].s_distance[z], rulestruct[b].s_within[z], &window_start, &window_len);
 
-                                            if ( rulestruct[b].s_offset[z] != 0 )
+                                            if ( rulestruct[b].s_nocase[z] == 1 )
                                                 {
-
-                                                    if ( strlen(SaganProcSyslog_LOCAL->syslog_message) > rulestruct[b].s_offset[z] )
-                                                        {
-
-                                                            alter_num = strlen(SaganProcSyslog_LOCAL->syslog_message) - rulestruct[b].s_offset[z];
-                                                            strlcpy(alter_content, SaganProcSyslog_LOCAL->syslog_message + (strlen(SaganProcSyslog_LOCAL->syslog_message) - alter_num), alter_num + 1);
-
-                                                        }
-                                                    else
-                                                        {
-
-                                                            alter_content[0] = '\0'; 	/* The offset is larger than the message.  Set content too NULL */
-
-                                                        }
-
+                                                    content_found = Sagan_memmem_nocase(SaganProcSyslog_LOCAL->syslog_message + window_start, window_len, rulestruct[b].s_content[z], rulestruct[b].s_content_len[z]) != NULL;
                                                 }
                                             else
                                                 {
-
-                                                    strlcpy(alter_content, SaganProcSyslog_LOCAL->syslog_message, sizeof(alter_content));
-
-                                                }
-
-                                            /* Content: DEPTH */
-
-                                            if ( rulestruct[b].s_depth[z] != 0 )
-                                                {
-
-                                                    /* We do +2 to account for alter_count[0] and whitespace at the begin of syslog message */
-
-                                                    strlcpy(alter_content, alter_content, rulestruct[b].s_depth[z] + 2);
-
-                                                }
-
-                                            /* Content: DISTANCE */
-
-                                            if ( rulestruct[b].s_distance[z] != 0 )
-                                                {
-
-                                                    alter_num = strlen(SaganProcSyslog_LOCAL->syslog_message) - ( rulestruct[b].s_depth[z-1] + rulestruct[b].s_distance[z] + 1);
-                                                    strlcpy(alter_content, SaganProcSyslog_LOCAL->syslog_message + (strlen(SaganProcSyslog_LOCAL->syslog_message) - alter_num), alter_num + 1);
-
-                                                    /* Content: WITHIN */
-
-                                                    if ( rulestruct[b].s_within[z] != 0 )
-                                                        {
-                                                            strlcpy(alter_content, alter_content, rulestruct[b].s_within[z] + 1);
-
-                                                        }
-
+                                                    content_found = Sagan_memmem(SaganProcSyslog_LOCAL->syslog_message + window_start, window_len, rulestruct[b].s_content[z], rulestruct[b].s_content_len[z]) != NULL;
                                                 }
 
-                                            /* If case insensitive */
+                                            /* content: ! matches when it's not found */
 
-                                            if ( rulestruct[b].s_nocase[z] == 1 )
+                                            if ( content_found != ( rulestruct[b].content_not[z] == 1 ) )
                                                 {
-
-                                                    if (rulestruct[b].content_not[z] != 1 && Sagan_stristr(alter_content, rulestruct[b].s_content[z], false))
-
-                                                        {
-                                                            sagan_match++;
-                                                        }
-                                                    else
-                                                        {
-
-                                                            /* for content: ! */
-
-                                                            if ( rulestruct[b].content_not[z] == 1 && !Sagan_stristr(alter_content, rulestruct[b].s_content[z], false)) sagan_match++;
-
-                                                        }
-                                                }
-                                            else
-                                                {
-
-                                                    /* If case sensitive */
-
-                                                    if ( rulestruct[b].content_not[z] != 1 && Sagan_strstr(alter_content, rulestruct[b].s_content[z] ))
-                                                        {
-                                                            sagan_match++;
-                                                        }
-                                                    else
-                                                        {
-
-                                                            /* for content: ! */
-                                                            if ( rulestruct[b].content_not[z] == 1 && !Sagan_strstr(alter_content, rulestruct[b].s_content[z])) sagan_match++;
-
-                                                        }
+                                                    sagan_match++;
                                                 }
                                         }
                                 }
@@ -625,9 +634,22 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                     for(z=0; z<rulestruct[b].pcre_count; z++)
                                         {
 
-                                            rc = pcre_exec( rulestruct[b].re_pcre[z], rulestruct[b].pcre_extra[z], SaganProcSyslog_LOCAL->syslog_message, (int)strlen(SaganProcSyslog_LOCAL->syslog_message), 0, 0, ovector, PCRE_OVECCOUNT);
+                                            if ( config->pcre_timing == true )
+                                                {
+                                                    clock_gettime(CLOCK_MONOTONIC, &pcre_start);
+                                                }
+
+                                            rc = Sagan_PCRE_Exec( &rulestruct[b].pcre[z], SaganProcSyslog_LOCAL->syslog_message, syslog_message_len );
 
-                                            if ( rc > 0 )
+                                            if ( config->pcre_timing == true )
+                                                {
+                                                    clock_gettime(CLOCK_MONOTONIC, &pcre_end);
+
+                                                    __atomic_add_fetch(&rulestruct[b].pcre_exec_count, 1, __ATOMIC_SEQ_CST);
+                                                    __atomic_add_fetch(&rulestruct[b].pcre_exec_nsec, ( pcre_end.tv_sec - pcre_start.tv_sec ) * 1000000000ULL + pcre_end.tv_nsec - pcre_start.tv_nsec, __ATOMIC_SEQ_CST);
+                                                }
+
+                                            if ( rc == SAGAN_PCRE_MATCH )
                                                 {
                                                     sagan_match++;
                                                 }
@@ -643,66 +665,11 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                     for (z=0; z<rulestruct[b].meta_content_count; z++)
                                         {
 
-                                            meta_alter_num = 0;
-
-                                            /* Meta_content: OFFSET */
-
-                                            if ( rulestruct[b].meta_offset[z] != 0 )
-                                                {
-
-                                                    if ( strlen(SaganProcSyslog_LOCAL->syslog_message) > rulestruct[b].meta_offset[z] )
-                                                        {
+                                            /* Meta_content: OFFSET/DEPTH/DISTANCE/WITHIN */
 
-                                                            meta_alter_num = strlen(SaganProcSyslog_LOCAL->syslog_message) - rulestruct[b].meta_offset[z];
-                                                            strlcpy(meta_alter_content, SaganProcSyslog_LOCAL->syslog_message + (strlen(SaganProcSyslog_LOCAL->syslog_message) - meta_alter_num), meta_alter_num + 1);
+                                            Sagan_memmem_Window(syslog_message_len, rulestruct[b].meta_offset[z], rulestruct[b].meta_depth[z], z > 0 ? rulestruct[b].meta_depth[z-1] : 0, rulestruct[b].meta_distance[z], rulestruct[b].meta_within[z], &window_start, &window_len);
 
-                                                        }
-                                                    else
-                                                        {
-
-                                                            meta_alter_content[0] = '\0';    /* The offset is larger than the message.  Set meta_content too NULL */
-
-                                                        }
-
-                                                }
-                                            else
-                                                {
-
-                                                    strlcpy(meta_alter_content, SaganProcSyslog_LOCAL->syslog_message, sizeof(meta_alter_content));
-
-                                                }
-
-
-                                            /* Meta_content: DEPTH */
-
-                                            if ( rulestruct[b].meta_depth[z] != 0 )
-                                                {
-
-                                                    /* We do +2 to account for alter_count[0] and whitespace at the begin of syslog message */
-
-                                                    strlcpy(meta_alter_content, meta_alter_content, rulestruct[b].meta_depth[z] + 2);
-
-                                                }
-
-                                            /* Meta_content: DISTANCE */
-
-                                            if ( rulestruct[b].meta_distance[z] != 0 )
-                                                {
-
-                                                    meta_alter_num = strlen(SaganProcSyslog_LOCAL->syslog_message) - ( rulestruct[b].meta_depth[z-1] + rulestruct[b].meta_distance[z] + 1 );
-                                                    strlcpy(meta_alter_content, SaganProcSyslog_LOCAL->syslog_message + (strlen(SaganProcSyslog_LOCAL->syslog_message) - meta_alter_num), meta_alter_num + 1);
-
-                                                    /* Meta_ontent: WITHIN */
-
-                                                    if ( rulestruct[b].meta_within[z] != 0 )
-                                                        {
-                                                            strlcpy(meta_alter_content, meta_alter_content, rulestruct[b].meta_within[z] + 1);
-
-                                                        }
-
-                                                }
-
-                                            rc = Meta_Content_Search(meta_alter_content, b, z);
+                                            rc = Meta_Content_Search(SaganProcSyslog_LOCAL->syslog_message + window_start, window_len, b, z);
 
                                             if ( rc == 1 )
                                                 {
@@ -772,6 +739,20 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     normalize_ja3 = SaganNormalizeLiblognorm.ja3;
                                                 }
 
+                                            /* Every rule that uses normalization gets the same addresses */
+
+                                            if ( SaganNormalizeLiblognorm.ip_src[0] != '0' )
+                                                {
+                                                    IP2Bit(SaganNormalizeLiblognorm.ip_src, fields->normalize_src_bits);
+                                                    Sagan_Counter_Add(engine_ip2bit, 1);
+                                                }
+
+                                            if ( SaganNormalizeLiblognorm.ip_dst[0] != '0' )
+                                                {
+                                                    IP2Bit(SaganNormalizeLiblognorm.ip_dst, fields->normalize_dst_bits);
+                                                    Sagan_Counter_Add(engine_ip2bit, 1);
+                                                }
+
                                         }
 
                                     if ( liblognorm_status == 1  && rulestruct[b].normalize == 1 )
@@ -793,7 +774,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     else
                                                         {
 
-                                                            IP2Bit(ip_src, ip_src_bits);
+                                                            memcpy(ip_src_bits, fields->normalize_src_bits, MAXIPBIT);
                                                         }
 
 
@@ -816,7 +797,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                                     else
                                                         {
-                                                            IP2Bit(ip_dst, ip_dst_bits);
+                                                            memcpy(ip_dst_bits, fields->normalize_dst_bits, MAXIPBIT);
                                                         }
 
 
@@ -856,10 +837,11 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                      * _unless_ liblognorm fails and both are in a rule or liblognorm failed to get src or dst */
 
                                     /* parse_src_ip: {position} - Parse_IP build a cache table for IPs, ports, etc.  This way,
-                                    we only parse the syslog string one time regardless of the rule options! */
+                                    we only parse the syslog string one time regardless of the rule options (or how many
+                                    rules need it) */
 
                                     if ( rulestruct[b].s_find_src_ip == 1 ||
-                                            rulestruct[b].s_find_src_ip == 1 ||
+                                            rulestruct[b].s_find_dst_ip == 1 ||
                                             rulestruct[b].blacklist_ipaddr_all == 1 ||
                                             rulestruct[b].s_find_proto == 1 ||
 #ifdef WITH_BLUEDOT
@@ -868,7 +850,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                             rulestruct[b].brointel_ipaddr_all == 1 )
                                         {
 
-                                            lookup_cache_size = Parse_IP(SaganProcSyslog_LOCAL->syslog_message, lookup_cache );
+                                            lookup_cache_size = Sagan_Engine_Parse_IP(fields, SaganProcSyslog_LOCAL->syslog_message);
 
                                         }
 
@@ -937,29 +919,26 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                     /* parse_hash: md5 */
 
-                                    if ( parse_md5_hash[0] == '\0' && rulestruct[b].s_find_hash_type == PARSE_HASH_MD5 )
+                                    if ( rulestruct[b].s_find_hash_type == PARSE_HASH_MD5 )
                                         {
-                                            Parse_Hash(SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_MD5, parse_md5_hash, sizeof(parse_md5_hash));
-                                            md5_hash = parse_md5_hash;
+                                            md5_hash = Sagan_Engine_Parse_Hash(fields, SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_MD5);
                                         }
 
-                                    else if ( parse_sha1_hash[0] == '\0' && rulestruct[b].s_find_hash_type == PARSE_HASH_SHA1 )
+                                    else if ( rulestruct[b].s_find_hash_type == PARSE_HASH_SHA1 )
                                         {
-                                            Parse_Hash(SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_SHA1, parse_sha256_hash, sizeof(parse_sha1_hash));
-                                            sha1_hash = parse_sha1_hash;
+                                            sha1_hash = Sagan_Engine_Parse_Hash(fields, SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_SHA1);
                                         }
 
-                                    else if ( parse_sha256_hash[0] == '\0' && rulestruct[b].s_find_hash_type == PARSE_HASH_SHA256 )
+                                    else if ( rulestruct[b].s_find_hash_type == PARSE_HASH_SHA256 )
                                         {
-                                            Parse_Hash(SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_SHA256, parse_sha256_hash, sizeof(parse_sha256_hash));
-                                            sha256_hash = parse_sha256_hash;
+                                            sha256_hash = Sagan_Engine_Parse_Hash(fields, SaganProcSyslog_LOCAL->syslog_message, PARSE_HASH_SHA256);
                                         }
 
                                     /* If the rule calls for proto searching,  we do it now */
 
                                     if ( rulestruct[b].s_find_proto_program == true )
                                         {
-                                            proto = Parse_Proto_Program(SaganProcSyslog_LOCAL->syslog_program);
+                                            proto = Sagan_Engine_Parse_Proto_Program(fields, SaganProcSyslog_LOCAL->syslog_program);
                                         }
 
 
@@ -983,7 +962,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     ip_src = SaganProcSyslog_LOCAL->syslog_host;
                                                 }
 
-                                            IP2Bit(ip_src, ip_src_bits);
+                                            memcpy(ip_src_bits, Sagan_Engine_Host_Bits(fields, ip_src), MAXIPBIT);
 
                                         }
 
@@ -1006,7 +985,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                                 }
 
-                                            IP2Bit(ip_dst, ip_dst_bits);
+                                            memcpy(ip_dst_bits, Sagan_Engine_Host_Bits(fields, ip_dst), MAXIPBIT);
                                         }
 
                                     /* No source port was normalized, Use the rules default */
@@ -1043,11 +1022,11 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                             if( SaganRouting->check_flow_return == false)
                                                 {
 
-                                                    __atomic_add_fetch(&counters->follow_flow_drop, 1, __ATOMIC_SEQ_CST);
+                                                    Sagan_Counter_Add(follow_flow_drop, 1);
 
                                                 }
 
-                                            __atomic_add_fetch(&counters->follow_flow_total, 1, __ATOMIC_SEQ_CST);
+                                            Sagan_Counter_Add(follow_flow_total, 1);
 
                                         }
 
@@ -1179,7 +1158,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                                 {
                                                                     SaganRouting->geoip2_isset = true;
 
-                                                                    __atomic_add_fetch(&counters->geoip2_hit, 1, __ATOMIC_SEQ_CST);
+                                                                    Sagan_Counter_Add(geoip2_hit, 1);
 
                                                                 }
                                                         }
@@ -1193,7 +1172,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                                 {
                                                                     SaganRouting->geoip2_isset = true;
 
-                                                                    __atomic_add_fetch(&counters->geoip2_hit, 1, __ATOMIC_SEQ_CST);
+                                                                    Sagan_Counter_Add(geoip2_hit, 1);
 
                                                                 }
                                                             else
@@ -1262,6 +1241,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                             bluedot_results = 0;
                                             bluedot_json[0] = '\0';
+                                            bluedot_pending.flag = false;
 
                                             if ( rulestruct[b].bluedot_ipaddr_type )
                                                 {
@@ -1270,26 +1250,26 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                                     if ( rulestruct[b].bluedot_ipaddr_type == 1 && ip_src_flag )
                                                         {
-                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                             SaganRouting->bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                         }
 
                                                     if ( rulestruct[b].bluedot_ipaddr_type == 2 && ip_dst_flag )
                                                         {
-                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                             SaganRouting->bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                         }
 
                                                     if ( rulestruct[b].bluedot_ipaddr_type == 3 && ip_src_flag && ip_dst_flag )
                                                         {
 
-                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                             SaganRouting->bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                             /* If the source isn't found,  then check the dst */
 
                                                             if ( SaganRouting->bluedot_ip_flag == 0 )
                                                                 {
-                                                                    bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json));
+                                                                    bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                                     SaganRouting->bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                                 }
 
@@ -1298,7 +1278,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     if ( lookup_cache_size > 0 && rulestruct[b].bluedot_ipaddr_type == 4 )
                                                         {
 
-                                                            SaganRouting->bluedot_ip_flag = Sagan_Bluedot_IP_Lookup_All(SaganProcSyslog_LOCAL->syslog_message, b, lookup_cache, lookup_cache_size );
+                                                            SaganRouting->bluedot_ip_flag = Sagan_Bluedot_IP_Lookup_All(SaganProcSyslog_LOCAL->syslog_message, b, lookup_cache, lookup_cache_size, &bluedot_pending );
 
                                                         }
 
@@ -1314,7 +1294,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     if ( md5_hash[0] != '\0')
                                                         {
 
-                                                            bluedot_results = Sagan_Bluedot_Lookup( md5_hash, BLUEDOT_LOOKUP_HASH, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup( md5_hash, BLUEDOT_LOOKUP_HASH, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                             SaganRouting->bluedot_hash_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_HASH);
 
                                                         }
@@ -1322,7 +1302,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     if ( sha256_hash[0] != '\0' )
                                                         {
 
-                                                            bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                             SaganRouting->bluedot_hash_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_HASH );
 
                                                         }
@@ -1330,7 +1310,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                     if ( sha256_hash[0] != '\0')
                                                         {
 
-                                                            bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, bluedot_json, sizeof(bluedot_json));
+                                                            bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                             SaganRouting->bluedot_hash_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_HASH);
 
                                                         }
@@ -1340,7 +1320,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                             if ( rulestruct[b].bluedot_url && normalize_http_uri != NULL )
                                                 {
 
-                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_http_uri, BLUEDOT_LOOKUP_URL, b, bluedot_json, sizeof(bluedot_json));
+                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_http_uri, BLUEDOT_LOOKUP_URL, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                     SaganRouting->bluedot_url_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_URL);
 
                                                 }
@@ -1348,7 +1328,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                             if ( rulestruct[b].bluedot_filename && normalize_filename != NULL )
                                                 {
 
-                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_filename, BLUEDOT_LOOKUP_FILENAME, b, bluedot_json, sizeof(bluedot_json));
+                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_filename, BLUEDOT_LOOKUP_FILENAME, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                     SaganRouting->bluedot_filename_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_FILENAME);
 
                                                 }
@@ -1356,13 +1336,38 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                             if ( rulestruct[b].bluedot_ja3 && normalize_ja3 != NULL )
                                                 {
 
-                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_ja3, BLUEDOT_LOOKUP_JA3, b, bluedot_json, sizeof(bluedot_json));
+                                                    bluedot_results = Sagan_Bluedot_Lookup( normalize_ja3, BLUEDOT_LOOKUP_JA3, b, bluedot_json, sizeof(bluedot_json), &bluedot_pending);
                                                     SaganRouting->bluedot_ja3_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_JA3);
 
                                                 }
 
 
 
+                                            /* A cache miss never waits on Bluedot.  Either park the event until
+                                             * the lookup finishes and re-run this rule then,  or fail open */
+
+                                            if ( bluedot_pending.flag == true &&
+                                                    SaganRouting->bluedot_ip_flag == false && SaganRouting->bluedot_hash_flag == false &&
+                                                    SaganRouting->bluedot_url_flag == false && SaganRouting->bluedot_filename_flag == false &&
+                                                    SaganRouting->bluedot_ja3_flag == false )
+                                                {
+
+                                                    if ( config->bluedot_miss == BLUEDOT_MISS_DEFER && replay_rule == SAGAN_ENGINE_ALL_RULES &&
+                                                            Sagan_Bluedot_Defer(SaganProcSyslog_LOCAL, b, &bluedot_pending) == true )
+                                                        {
+
+                                                            if ( debug->debugbluedot )
+                                                                {
+                                                                    Sagan_Log(DEBUG, "[%s, line %d] Deferring SID %" PRIu64 " until Bluedot lookup finishes.", __FILE__, __LINE__, rulestruct[b].s_sid);
+                                                                }
+                                                        }
+                                                    else
+                                                        {
+                                                            Sagan_Counter_Add(bluedot_fail_open, 1);
+                                                        }
+
+                                                }
+
                                             /* Do cleanup at the end in case any "hits" above refresh the cache.  This why we don't
                                              * "delete" an entry only to re-add it! */
 
@@ -1394,7 +1399,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
                                             if ( SaganRouting->brointel_results == false && rulestruct[b].brointel_ipaddr_all )
                                                 {
-                                                    SaganRouting->brointel_results = Sagan_BroIntel_IPADDR_All ( SaganProcSyslog_LOCAL->syslog_message, lookup_cache, MAX_PARSE_IP);
+                                                    SaganRouting->brointel_results = Sagan_BroIntel_IPADDR_All ( SaganProcSyslog_LOCAL->syslog_message, lookup_cache, lookup_cache_size);
                                                 }
 
                                             if ( SaganRouting->brointel_results == false && rulestruct[b].brointel_ipaddr_both && ip_src_flag && ip_dst_flag )
@@ -1478,7 +1483,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
                                                 }
 
 
-                                            __atomic_add_fetch(&counters->saganfound, 1, __ATOMIC_SEQ_CST);
+                                            Sagan_Counter_Add(saganfound, 1);
 
                                             /* Check for thesholding & "after" */
 
@@ -1577,6 +1582,8 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 
         } /* End for for loop */
 
+    Rule_Index_Exit();
+
 
 #ifdef HAVE_LIBFASTJSON
 
@@ -1588,7 +1595,6 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, bool dynamic_rule_
 #endif
 
     free(processor_info_engine);
-    free(lookup_cache);
     free(SaganRouting);
 
 #ifdef HAVE_LIBLOGNORM
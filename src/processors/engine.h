@@ -27,5 +27,41 @@
 #define SAGAN_PROCESSOR_TAG NULL
 #define SAGAN_PROCESSOR_GENERATOR_ID 1
 
-int Sagan_Engine ( _Sagan_Proc_Syslog *, bool );
+#define SAGAN_ENGINE_ALL_RULES -1
+
+#define SAGAN_ENGINE_HASH_TYPES 3	/* PARSE_HASH_MD5 - PARSE_HASH_SHA256 */
+
+/* What the engine's parsers found in an event.  Each field is filled in
+   the first time a rule asks for it and reused by every rule after that,
+   so N rules needing parse_src_ip cost one Parse_IP() */
+
+typedef struct _Sagan_Engine_Fields _Sagan_Engine_Fields;
+struct _Sagan_Engine_Fields
+{
+
+    struct _Sagan_Lookup_Cache_Entry lookup_cache[MAX_PARSE_IP];
+    int lookup_cache_size;
+    bool lookup_cache_parsed;
+
+    char hash[SAGAN_ENGINE_HASH_TYPES][SHA256_HASH_SIZE+1];
+    bool hash_parsed[SAGAN_ENGINE_HASH_TYPES];
+
+    unsigned char proto_program;
+    bool proto_program_parsed;
+
+    unsigned char host_bits[MAXIPBIT];		/* syslog_host,  or sagan_host for 127.0.0.1 */
+    bool host_parsed;
+
+    unsigned char json_src_bits[MAXIPBIT];	/* src_ip/dst_ip found in JSON */
+    unsigned char json_dst_bits[MAXIPBIT];
+    bool json_ip_parsed;
+
+#ifdef HAVE_LIBLOGNORM
+    unsigned char normalize_src_bits[MAXIPBIT];
+    unsigned char normalize_dst_bits[MAXIPBIT];
+#endif
+
+};
+
+int Sagan_Engine ( _Sagan_Proc_Syslog *, bool, int );
 void Sagan_Engine_Init ( void );
@@ -44,7 +44,9 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "lockfile.h"
+#include "util-time.h"
 
 #include "processors/perfmon.h"
 
@@ -66,13 +68,7 @@ void Sagan_Perfmonitor_Handler( void )
     unsigned long total=0;
     unsigned long seconds=0;
 
-    char curtime_utime[64] = { 0 };
-    time_t t;
-    struct tm *now;
-
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(curtime_utime, sizeof(curtime_utime), "%s",  now);
+    uint64_t epoch = 0;
 
     uint64_t last_events_received = 0;
     uint64_t last_saganfound = 0;
@@ -98,6 +94,17 @@ void Sagan_Perfmonitor_Handler( void )
     uint64_t last_bluedot_filename_cache_hit = 0;
     uint64_t last_bluedot_filename_positive_hit = 0;
     uint64_t last_bluedot_error_count = 0;
+    uint64_t last_bluedot_ja3_cache_hit = 0;
+    uint64_t last_bluedot_ip_cache_miss = 0;
+    uint64_t last_bluedot_ip_cache_evict = 0;
+    uint64_t last_bluedot_hash_cache_miss = 0;
+    uint64_t last_bluedot_hash_cache_evict = 0;
+    uint64_t last_bluedot_url_cache_miss = 0;
+    uint64_t last_bluedot_url_cache_evict = 0;
+    uint64_t last_bluedot_filename_cache_miss = 0;
+    uint64_t last_bluedot_filename_cache_evict = 0;
+    uint64_t last_bluedot_ja3_cache_miss = 0;
+    uint64_t last_bluedot_ja3_cache_evict = 0;
 
     unsigned long bluedot_ip_total;
     unsigned long bluedot_url_total;
@@ -115,53 +122,55 @@ void Sagan_Perfmonitor_Handler( void )
 
     uint64_t last_dns_miss_count = 0;
 
+    struct _Sagan_Counter_Shard sum;
+
     while (1)
         {
 
             sleep(config->perfmonitor_time);
 
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(curtime_utime, sizeof(curtime_utime), "%s",  now);
-            seconds = atol(curtime_utime) - atol(config->sagan_startutime);
+            Sagan_Counter_Sum(&sum);
+
+            epoch = Return_Epoch();
+            seconds = epoch - atol(config->sagan_startutime);
 
 
             if ( config->perfmonitor_flag )
                 {
 
-                    fprintf(config->perfmonitor_file_stream, "%s,", curtime_utime),
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", epoch),
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->events_received - last_events_received);
-                    last_events_received = counters->events_received;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.events_received - last_events_received);
+                    last_events_received = sum.events_received;
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->saganfound - last_saganfound);
-                    last_saganfound = counters->saganfound;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.saganfound - last_saganfound);
+                    last_saganfound = sum.saganfound;
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->alert_total - last_alert_total);
-                    last_alert_total = counters->alert_total;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.alert_total - last_alert_total);
+                    last_alert_total = sum.alert_total;
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->after_total - last_after_total);
-                    last_after_total = counters->after_total;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.after_total - last_after_total);
+                    last_after_total = sum.after_total;
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->threshold_total - last_threshold_total);
-                    last_threshold_total = counters->threshold_total;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.threshold_total - last_threshold_total);
+                    last_threshold_total = sum.threshold_total;
 
                     fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->sagan_processor_drop - last_sagan_processor_drop);
                     last_sagan_processor_drop = counters->sagan_processor_drop;
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->ignore_count - last_ignore_count);
-                    last_ignore_count = counters->ignore_count;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.ignore_count - last_ignore_count);
+                    last_ignore_count = sum.ignore_count;
 
-                    total = counters->events_received / seconds;
+                    total = sum.events_received / seconds;
                     fprintf(config->perfmonitor_file_stream, "%lu,", total);
 
 #ifdef HAVE_LIBMAXMINDDB
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->geoip2_lookup - last_geoip2_lookup);
-                    last_geoip2_lookup = counters->geoip2_lookup;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.geoip2_lookup - last_geoip2_lookup);
+                    last_geoip2_lookup = sum.geoip2_lookup;
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->geoip2_hit - last_geoip2_hit);
-                    last_geoip2_hit = counters->geoip2_hit;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.geoip2_hit - last_geoip2_hit);
+                    last_geoip2_hit = sum.geoip2_hit;
 
                     fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", 0);
                     //last_geoip2_miss = counters->geoip2_miss;
@@ -179,8 +188,8 @@ void Sagan_Perfmonitor_Handler( void )
                     fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->sagan_processor_drop - last_sagan_processor_drop);
                     last_sagan_processor_drop = counters->sagan_processor_drop;
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->blacklist_hit_count - last_blacklist_hit_count);
-                    last_blacklist_hit_count = counters->blacklist_hit_count;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.blacklist_hit_count - last_blacklist_hit_count);
+                    last_blacklist_hit_count = sum.blacklist_hit_count;
 
                     /* DEBUG: CONSTANT? */
 
@@ -190,18 +199,18 @@ void Sagan_Perfmonitor_Handler( void )
                     fprintf(config->perfmonitor_file_stream, "%d,", counters_ipc->track_clients_client_count);
                     fprintf(config->perfmonitor_file_stream, "%d,", counters_ipc->track_clients_down);
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->sagan_output_drop - last_sagan_output_drop);
-                    last_sagan_output_drop = counters->sagan_output_drop;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.sagan_output_drop - last_sagan_output_drop);
+                    last_sagan_output_drop = sum.sagan_output_drop;
 
 #ifdef HAVE_LIBESMTP
                     if ( config->sagan_esmtp_flag )
                         {
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->esmtp_count_success - last_esmtp_count_success);
-                            last_esmtp_count_success = counters->esmtp_count_success;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.esmtp_count_success - last_esmtp_count_success);
+                            last_esmtp_count_success = sum.esmtp_count_success;
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->esmtp_count_failed - last_esmtp_count_failed);
-                            last_esmtp_count_failed = counters->esmtp_count_failed;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.esmtp_count_failed - last_esmtp_count_failed);
+                            last_esmtp_count_failed = sum.esmtp_count_failed;
                         }
                     else
                         {
@@ -215,8 +224,8 @@ void Sagan_Perfmonitor_Handler( void )
 
                     fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->dns_cache_count);
 
-                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->dns_miss_count - last_dns_miss_count);
-                    last_dns_miss_count = counters->dns_miss_count;
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.dns_miss_count - last_dns_miss_count);
+                    last_dns_miss_count = sum.dns_miss_count;
 
 
 
@@ -229,74 +238,110 @@ void Sagan_Perfmonitor_Handler( void )
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_cache_count);
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_cache_hit - last_bluedot_ip_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_ip_cache_hit - last_bluedot_ip_cache_hit);
+                            last_bluedot_ip_cache_hit = sum.bluedot_ip_cache_hit;
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_positive_hit - last_bluedot_ip_positive_hit);
-                            last_bluedot_ip_positive_hit = counters->bluedot_ip_positive_hit;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_ip_positive_hit - last_bluedot_ip_positive_hit);
+                            last_bluedot_ip_positive_hit = sum.bluedot_ip_positive_hit;
 
-                            bluedot_ip_total = counters->bluedot_ip_total / seconds;
+                            bluedot_ip_total = sum.bluedot_ip_total / seconds;
                             fprintf(config->perfmonitor_file_stream, "%lu,", bluedot_ip_total);
 
                             /* Hash */
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_cache_count);
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_cache_hit - last_bluedot_hash_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_hash_cache_hit - last_bluedot_hash_cache_hit);
+                            last_bluedot_hash_cache_hit = sum.bluedot_hash_cache_hit;
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_positive_hit - last_bluedot_hash_positive_hit);
-                            last_bluedot_hash_positive_hit = counters->bluedot_hash_positive_hit;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_hash_positive_hit - last_bluedot_hash_positive_hit);
+                            last_bluedot_hash_positive_hit = sum.bluedot_hash_positive_hit;
 
-                            bluedot_hash_total = counters->bluedot_hash_total / seconds;
-                            fprintf(config->perfmonitor_file_stream, "%lu,", total);
+                            bluedot_hash_total = sum.bluedot_hash_total / seconds;
+                            fprintf(config->perfmonitor_file_stream, "%lu,", bluedot_hash_total);
 
                             /* URL */
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_cache_count);
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_cache_hit - last_bluedot_url_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_url_cache_hit - last_bluedot_url_cache_hit);
+                            last_bluedot_url_cache_hit = sum.bluedot_url_cache_hit;
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_positive_hit - last_bluedot_url_positive_hit);
-                            last_bluedot_url_positive_hit = counters->bluedot_url_positive_hit;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_url_positive_hit - last_bluedot_url_positive_hit);
+                            last_bluedot_url_positive_hit = sum.bluedot_url_positive_hit;
 
-                            bluedot_url_total = counters->bluedot_url_total / seconds;
+                            bluedot_url_total = sum.bluedot_url_total / seconds;
                             fprintf(config->perfmonitor_file_stream, "%lu,", bluedot_url_total);
 
                             /* Filename */
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_cache_count);
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_cache_hit - last_bluedot_filename_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_filename_cache_hit - last_bluedot_filename_cache_hit);
+                            last_bluedot_filename_cache_hit = sum.bluedot_filename_cache_hit;
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_positive_hit - last_bluedot_filename_positive_hit);
-                            last_bluedot_filename_positive_hit = counters->bluedot_filename_positive_hit;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_filename_positive_hit - last_bluedot_filename_positive_hit);
+                            last_bluedot_filename_positive_hit = sum.bluedot_filename_positive_hit;
 
-                            bluedot_filename_total = counters->bluedot_filename_total / seconds;
+                            bluedot_filename_total = sum.bluedot_filename_total / seconds;
                             fprintf(config->perfmonitor_file_stream, "%lu,", bluedot_filename_total);		/* Last comma here! */
 
                             /* Error count */
 
-                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_error_count - last_bluedot_error_count);
-                            last_bluedot_error_count = counters->bluedot_error_count;
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_error_count - last_bluedot_error_count);
+                            last_bluedot_error_count = sum.bluedot_error_count;
 
                             fprintf(config->perfmonitor_file_stream, "%lu", bluedot_ip_total + bluedot_hash_total + bluedot_url_total + bluedot_filename_total);
 
+                            /* Cache misses/evictions (and the JA3 cache) */
+
+                            fprintf(config->perfmonitor_file_stream, ",%" PRIu64 ",", counters->bluedot_ja3_cache_count);
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_ja3_cache_hit - last_bluedot_ja3_cache_hit);
+                            last_bluedot_ja3_cache_hit = sum.bluedot_ja3_cache_hit;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_ip_cache_miss - last_bluedot_ip_cache_miss);
+                            last_bluedot_ip_cache_miss = sum.bluedot_ip_cache_miss;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_ip_cache_evict - last_bluedot_ip_cache_evict);
+                            last_bluedot_ip_cache_evict = sum.bluedot_ip_cache_evict;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_hash_cache_miss - last_bluedot_hash_cache_miss);
+                            last_bluedot_hash_cache_miss = sum.bluedot_hash_cache_miss;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_hash_cache_evict - last_bluedot_hash_cache_evict);
+                            last_bluedot_hash_cache_evict = sum.bluedot_hash_cache_evict;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_url_cache_miss - last_bluedot_url_cache_miss);
+                            last_bluedot_url_cache_miss = sum.bluedot_url_cache_miss;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_url_cache_evict - last_bluedot_url_cache_evict);
+                            last_bluedot_url_cache_evict = sum.bluedot_url_cache_evict;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_filename_cache_miss - last_bluedot_filename_cache_miss);
+                            last_bluedot_filename_cache_miss = sum.bluedot_filename_cache_miss;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_filename_cache_evict - last_bluedot_filename_cache_evict);
+                            last_bluedot_filename_cache_evict = sum.bluedot_filename_cache_evict;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", sum.bluedot_ja3_cache_miss - last_bluedot_ja3_cache_miss);
+                            last_bluedot_ja3_cache_miss = sum.bluedot_ja3_cache_miss;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64, sum.bluedot_ja3_cache_evict - last_bluedot_ja3_cache_evict);
+                            last_bluedot_ja3_cache_evict = sum.bluedot_ja3_cache_evict;
 
                         }
                     else
                         {
 
-                            fprintf(config->perfmonitor_file_stream, "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
+                            fprintf(config->perfmonitor_file_stream, "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
                         }
 
 #endif
 
 #ifndef WITH_BLUEDOT
 
-                    fprintf(config->perfmonitor_file_stream, "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
+                    fprintf(config->perfmonitor_file_stream, "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
 #endif
 
                     fprintf(config->perfmonitor_file_stream, "\n");
@@ -352,7 +397,7 @@ void Sagan_Perfmonitor_Open(void)
     config->perfmonitor_file_stream_status = true;
 
     fprintf(config->perfmonitor_file_stream, "################################ Perfmon start: pid=%d at=%s ###################################\n", getpid(), curtime);
-    fprintf(config->perfmonitor_file_stream, "# engine.utime,engine.total,engine.sig_match.total,engine.alerts.total,engine.after.total,engine.threshold.total, engine.drop.total,engine.ignored.total,engine.eps,geoip2.lookup.total,geoip2.hits,geoip2.misses,processor.drop.total,processor.blacklist.hits,processor.tracker.total,processor.tracker.down,output.drop.total,processor.esmtp.success,processor.esmtp.failed,dns.total,dns.miss,processor.bluedot_ip_cache_count,processor.bluedot_ip_cache_hit,processor.bluedot_ip_positive_hit,processor.bluedot_ip_qps,processor.bluedot_hash_cache_count,processor.bluedot_hash_cache_hit,processor.bluedot_hash_positive_hit,processor.bluedot_hash_qps,processor.bluedot_url_cache_count,processor.bluedot_url_cache_hit,processor.bluedot_url_positive_hit,processor.bluedot_url_qps,processor.bluedot_filename_cache_count,processor.bluedot_filename_cache_hit,processor.bluedot_filename_positive_hit,processor.bluedot_filename_qps,processor.bluedot_error_count,processor.bluedot_total_qps\n");
+    fprintf(config->perfmonitor_file_stream, "# engine.utime,engine.total,engine.sig_match.total,engine.alerts.total,engine.after.total,engine.threshold.total, engine.drop.total,engine.ignored.total,engine.eps,geoip2.lookup.total,geoip2.hits,geoip2.misses,processor.drop.total,processor.blacklist.hits,processor.tracker.total,processor.tracker.down,output.drop.total,processor.esmtp.success,processor.esmtp.failed,dns.total,dns.miss,processor.bluedot_ip_cache_count,processor.bluedot_ip_cache_hit,processor.bluedot_ip_positive_hit,processor.bluedot_ip_qps,processor.bluedot_hash_cache_count,processor.bluedot_hash_cache_hit,processor.bluedot_hash_positive_hit,processor.bluedot_hash_qps,processor.bluedot_url_cache_count,processor.bluedot_url_cache_hit,processor.bluedot_url_positive_hit,processor.bluedot_url_qps,processor.bluedot_filename_cache_count,processor.bluedot_filename_cache_hit,processor.bluedot_filename_positive_hit,processor.bluedot_filename_qps,processor.bluedot_error_count,processor.bluedot_total_qps,processor.bluedot_ja3_cache_count,processor.bluedot_ja3_cache_hit,processor.bluedot_ip_cache_miss,processor.bluedot_ip_cache_evict,processor.bluedot_hash_cache_miss,processor.bluedot_hash_cache_evict,processor.bluedot_url_cache_miss,processor.bluedot_url_cache_evict,processor.bluedot_filename_cache_miss,processor.bluedot_filename_cache_evict,processor.bluedot_ja3_cache_miss,processor.bluedot_ja3_cache_evict\n");
     fflush(config->perfmonitor_file_stream);
 
 }
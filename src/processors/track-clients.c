@@ -72,17 +72,11 @@ struct _SaganConfig *config;
 void Track_Clients ( char *host )
 {
 
-    char utime_tmp[20] = { 0 };
-    time_t t;
-    struct tm *now;
     int i;
     uint64_t utime_u64;
     unsigned char hostbits[MAXIPBIT] = { 0 };
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(utime_tmp, sizeof(utime_tmp), "%s",  now);
-    utime_u64 = atol(utime_tmp);
+    utime_u64 = Return_Epoch();
     int expired_time = config->pp_sagan_track_clients * 60;
 
     IP2Bit(host, hostbits);
@@ -189,18 +183,11 @@ void Track_Clients_Thread ( void )
 
             const char *tmp_ip = NULL;
 
-            char utime_tmp[20] = { 0 };
-            time_t t;
-            struct tm *now;
-
             uint64_t utime_u32;
 
             struct timeval tp;
 
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(utime_tmp, sizeof(utime_tmp), "%s",  now);
-            utime_u32 = atol(utime_tmp);
+            utime_u32 = Return_Epoch();
 
             int expired_time = config->pp_sagan_track_clients * 60;
 
@@ -41,7 +41,7 @@
 #include <string.h>
 #include <getopt.h>
 #include <time.h>
-#include <pcre.h>
+#include <sys/time.h>
 
 #include "version.h"
 
@@ -54,7 +54,10 @@
 #include "classifications.h"
 #include "rules.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "parsers/parsers.h"
+#include "util-aho-corasick.h"
+#include "meta-content.h"
 
 #ifdef WITH_BLUEDOT
 #include "processors/bluedot.h"
@@ -108,8 +111,7 @@ void Load_Rules( const char *ruleset )
 
     bool found = 0;
 
-    const char *error;
-    int erroffset;
+    char pcre_error[256] = { 0 };
 
     FILE *rulesfile;
     char ruleset_fullname[MAXPATH];
@@ -1817,6 +1819,7 @@ void Load_Rules( const char *ruleset )
 
                                     Replace_Sagan(rulestruct[counters->rulecount].meta_content_help[meta_content_count], ptmp, tmp_help, sizeof(tmp_help));
                                     strlcpy(rulestruct[counters->rulecount].meta_content_containers[meta_content_count].meta_content_converted[meta_content_converted_count], tmp_help, sizeof(rulestruct[counters->rulecount].meta_content_containers[meta_content_count].meta_content_converted[meta_content_converted_count]));
+                                    rulestruct[counters->rulecount].meta_content_containers[meta_content_count].meta_content_len[meta_content_converted_count] = strlen(rulestruct[counters->rulecount].meta_content_containers[meta_content_count].meta_content_converted[meta_content_converted_count]);
 
                                     meta_content_converted_count++;
 
@@ -2104,6 +2107,7 @@ void Load_Rules( const char *ruleset )
                             strlcpy(final_content, rule_tmp, sizeof(final_content));
 
                             strlcpy(rulestruct[counters->rulecount].s_content[content_count], final_content, sizeof(rulestruct[counters->rulecount].s_content[content_count]));
+                            rulestruct[counters->rulecount].s_content_len[content_count] = strlen(rulestruct[counters->rulecount].s_content[content_count]);
                             final_content[0] = '\0';
                             content_count++;
                             rulestruct[counters->rulecount].content_count=content_count;
@@ -2240,6 +2244,7 @@ void Load_Rules( const char *ruleset )
                                 }
 
                             pcreflag=0;
+                            pcreoptions=0;
                             memset(pcrerule, 0, sizeof(pcrerule));
 
                             for ( i = 1; i < strlen(tmp2); i++)
@@ -2265,25 +2270,25 @@ void Load_Rules( const char *ruleset )
                                                 {
 
                                                 case 'i':
-                                                    if ( pcreflag == 1 ) pcreoptions |= PCRE_CASELESS;
+                                                    if ( pcreflag == 1 ) pcreoptions |= SAGAN_PCRE_CASELESS;
                                                     break;
                                                 case 's':
-                                                    if ( pcreflag == 1 ) pcreoptions |= PCRE_DOTALL;
+                                                    if ( pcreflag == 1 ) pcreoptions |= SAGAN_PCRE_DOTALL;
                                                     break;
                                                 case 'm':
-                                                    if ( pcreflag == 1 ) pcreoptions |= PCRE_MULTILINE;
+                                                    if ( pcreflag == 1 ) pcreoptions |= SAGAN_PCRE_MULTILINE;
                                                     break;
                                                 case 'x':
-                                                    if ( pcreflag == 1 ) pcreoptions |= PCRE_EXTENDED;
+                                                    if ( pcreflag == 1 ) pcreoptions |= SAGAN_PCRE_EXTENDED;
                                                     break;
                                                 case 'A':
-                                                    if ( pcreflag == 1 ) pcreoptions |= PCRE_ANCHORED;
+                                                    if ( pcreflag == 1 ) pcreoptions |= SAGAN_PCRE_ANCHORED;
                                                     break;
                                                 case 'E':
-                                                    if ( pcreflag == 1 ) pcreoptions |= PCRE_DOLLAR_ENDONLY;
+                                                    if ( pcreflag == 1 ) pcreoptions |= SAGAN_PCRE_DOLLAR_ENDONLY;
                                                     break;
                                                 case 'G':
-                                                    if ( pcreflag == 1 ) pcreoptions |= PCRE_UNGREEDY;
+                                                    if ( pcreflag == 1 ) pcreoptions |= SAGAN_PCRE_UNGREEDY;
                                                     break;
 
 
@@ -2319,38 +2324,14 @@ void Load_Rules( const char *ruleset )
 
                             /* We store the compiled/study results.  This saves us some CPU time during searching - Champ Clark III - 02/01/2011 */
 
-                            rulestruct[counters->rulecount].re_pcre[pcre_count] =  pcre_compile( pcrerule, pcreoptions, &error, &erroffset, NULL );
-
-#ifdef PCRE_HAVE_JIT
-
-                            if ( config->pcre_jit == 1 )
-                                {
-                                    pcreoptions |= PCRE_STUDY_JIT_COMPILE;
-                                }
-#endif
-
-                            rulestruct[counters->rulecount].pcre_extra[pcre_count] = pcre_study( rulestruct[counters->rulecount].re_pcre[pcre_count], pcreoptions, &error);
-
-#ifdef PCRE_HAVE_JIT
-
-                            if ( config->pcre_jit == 1 )
+                            if ( Sagan_PCRE_Compile(&rulestruct[counters->rulecount].pcre[pcre_count], pcrerule, pcreoptions, pcre_error, sizeof(pcre_error)) == false )
                                 {
-                                    int jit = 0;
-                                    rc = 0;
-
-                                    rc = pcre_fullinfo(rulestruct[counters->rulecount].re_pcre[pcre_count], rulestruct[counters->rulecount].pcre_extra[pcre_count], PCRE_INFO_JIT, &jit);
-
-                                    if (rc != 0 || jit != 1)
-                                        {
-                                            Sagan_Log(WARN, "[%s, line %d] PCRE JIT does not support regexp in %s at line %d (pcre: \"%s\"). Continuing without PCRE JIT enabled for this rule.", __FILE__, __LINE__, ruleset_fullname, linecount, pcrerule);
-                                        }
+                                    Sagan_Log(ERROR, "[%s, line %d] PCRE failure in %s at %d [%s], Abort", __FILE__, __LINE__, ruleset_fullname, linecount, pcre_error);
                                 }
 
-#endif
-
-                            if (  rulestruct[counters->rulecount].re_pcre[pcre_count]  == NULL )
+                            if ( config->pcre_jit == true && rulestruct[counters->rulecount].pcre[pcre_count].jit == false )
                                 {
-                                    Sagan_Log(ERROR, "[%s, line %d] PCRE failure in %s at %d [%d: %s], Abort", __FILE__, __LINE__, ruleset_fullname, linecount, erroffset, error);
+                                    Sagan_Log(WARN, "[%s, line %d] PCRE JIT does not support regexp in %s at line %d (pcre: \"%s\"). Continuing without PCRE JIT enabled for this rule.", __FILE__, __LINE__, ruleset_fullname, linecount, pcrerule);
                                 }
 
                             pcre_count++;
@@ -3219,9 +3200,1421 @@ void Load_Rules( const char *ruleset )
                         }
                 }
 
+            Meta_Content_Compile(counters->rulecount);
+
             __atomic_add_fetch(&counters->rulecount, 1,  __ATOMIC_SEQ_CST);
 
         } /* end of while loop */
 
     fclose(rulesfile);
 }
+
+/****************************************************************************
+ * Rule_Index_Table_* - Small open addressing hash tables used by the rule
+ * prefilter index.  Each entry holds a key (program,  facility,  etc) and
+ * the rule positions that require it,  in ascending order.
+ ****************************************************************************/
+
+static struct _Rule_Index *Rule_Index = NULL;
+
+/* Replaced indexes (and anything else passed to Rule_Index_Retire())
+   waiting to be freed,  see Rule_Index_Enter() */
+
+#define RULE_INDEX_CACHE_LINE	64
+
+typedef struct _Rule_Index_Reader _Rule_Index_Reader;
+struct _Rule_Index_Reader
+{
+    uint64_t epoch;				/* 0 == not in Sagan_Engine() */
+} __attribute__ ((aligned (RULE_INDEX_CACHE_LINE)));
+
+typedef struct _Rule_Index_Retired _Rule_Index_Retired;
+struct _Rule_Index_Retired
+{
+    void *data;
+    void (*free_func)( void * );
+    uint64_t retire_epoch;
+    struct _Rule_Index_Retired *next;
+};
+
+static uint64_t Rule_Index_Epoch = 1;
+static struct _Rule_Index_Retired *Rule_Index_Retired = NULL;
+
+static struct _Rule_Index_Reader **Rule_Index_Readers = NULL;
+static int Rule_Index_Reader_Count = 0;
+static __thread struct _Rule_Index_Reader *Rule_Index_Reader_Thread = NULL;
+
+static pthread_mutex_t RuleIndexRetireMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void Rule_Index_Reclaim( void );
+
+static void Rule_Index_Table_Init( struct _Rule_Index_Table *table, uint32_t size )
+{
+
+    table->size = size;
+    table->count = 0;
+    table->entry = calloc(size, sizeof(struct _Rule_Index_Entry));
+
+    if ( table->entry == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule index table. Abort!", __FILE__, __LINE__);
+        }
+}
+
+static void Rule_Index_Table_Free( struct _Rule_Index_Table *table )
+{
+
+    uint32_t i;
+
+    if ( table->entry == NULL )
+        {
+            return;
+        }
+
+    for ( i = 0; i < table->size; i++ )
+        {
+            free(table->entry[i].rules);
+        }
+
+    free(table->entry);
+    table->entry = NULL;
+}
+
+static struct _Rule_Index_Entry *Rule_Index_Table_Lookup( struct _Rule_Index_Table *table, const char *key )
+{
+
+    uint32_t hash = Djb2_Hash((char *)key);
+    uint32_t i = hash & ( table->size - 1 );
+
+    while ( table->entry[i].rules != NULL )
+        {
+
+            if ( table->entry[i].hash == hash && !strcmp(table->entry[i].key, key) )
+                {
+                    return(&table->entry[i]);
+                }
+
+            i = ( i + 1 ) & ( table->size - 1 );
+        }
+
+    return(NULL);
+}
+
+static void Rule_Index_Table_Add( struct _Rule_Index_Table *table, const char *key, int rule );
+
+static void Rule_Index_Table_Grow( struct _Rule_Index_Table *table )
+{
+
+    struct _Rule_Index_Table old = *table;
+    uint32_t i;
+    int r;
+
+    Rule_Index_Table_Init(table, old.size * 2);
+
+    for ( i = 0; i < old.size; i++ )
+        {
+            for ( r = 0; r < old.entry[i].rule_count; r++ )
+                {
+                    Rule_Index_Table_Add(table, old.entry[i].key, old.entry[i].rules[r]);
+                }
+        }
+
+    Rule_Index_Table_Free(&old);
+}
+
+static void Rule_Index_Table_Add( struct _Rule_Index_Table *table, const char *key, int rule )
+{
+
+    struct _Rule_Index_Entry *entry = NULL;
+    char tmp_key[RULE_INDEX_MAX_KEY] = { 0 };
+    uint32_t hash;
+    uint32_t i;
+
+    /* Keys longer than the event field can never match exactly,  but
+       keeping them (truncated) only adds candidates,  never loses them */
+
+    strlcpy(tmp_key, key, sizeof(tmp_key));
+
+    entry = Rule_Index_Table_Lookup(table, tmp_key);
+
+    if ( entry == NULL )
+        {
+
+            if ( ( table->count + 1 ) * 2 > table->size )
+                {
+                    Rule_Index_Table_Grow(table);
+                }
+
+            hash = Djb2_Hash(tmp_key);
+            i = hash & ( table->size - 1 );
+
+            while ( table->entry[i].rules != NULL )
+                {
+                    i = ( i + 1 ) & ( table->size - 1 );
+                }
+
+            entry = &table->entry[i];
+            entry->hash = hash;
+            strlcpy(entry->key, tmp_key, sizeof(entry->key));
+            table->count++;
+        }
+
+    /* Rules are added in order,  so a duplicate ("sshd|sshd") is always last */
+
+    if ( entry->rule_count > 0 && entry->rules[entry->rule_count - 1] == rule )
+        {
+            return;
+        }
+
+    entry->rules = (int *) realloc(entry->rules, (entry->rule_count+1) * sizeof(int));
+
+    if ( entry->rules == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for rule index entry. Abort!", __FILE__, __LINE__);
+        }
+
+    entry->rules[entry->rule_count] = rule;
+    entry->rule_count++;
+}
+
+static void Rule_Index_Table_Add_List( struct _Rule_Index_Table *table, const char *list, int rule )
+{
+
+    char tmp[RULEBUF] = { 0 };
+    char *ptmp = NULL;
+    char *tok = NULL;
+
+    strlcpy(tmp, list, sizeof(tmp));
+
+    ptmp = strtok_r(tmp, "|", &tok);
+
+    while ( ptmp != NULL )
+        {
+            Rule_Index_Table_Add(table, ptmp, rule);
+            ptmp = strtok_r(NULL, "|", &tok);
+        }
+}
+
+static void Rule_Header_Free( struct _Rule_Header *header );
+static void Rule_Intern_Free( struct _Rule_Intern *intern );
+
+static void Rule_Index_Free( struct _Rule_Index *index )
+{
+
+    int b;
+
+    if ( index == NULL )
+        {
+            return;
+        }
+
+    Rule_Index_Table_Free(&index->program);
+    Rule_Index_Table_Free(&index->facility);
+    Rule_Index_Table_Free(&index->level);
+    Rule_Index_Table_Free(&index->priority);
+
+    if ( index->header != NULL )
+        {
+            for ( b = 0; b < index->rule_count; b++ )
+                {
+                    Rule_Header_Free(&index->header[b]);
+                }
+        }
+
+    free(index->header);
+    Rule_Intern_Free(&index->intern);
+
+    Sagan_AC_Free(index->content_ac[0]);
+    Sagan_AC_Free(index->content_ac[1]);
+
+    free(index->unkeyed);
+    free(index->pattern_requirement_start);
+    free(index->pattern_requirement);
+    free(index->requirement_rule);
+    free(index->rule_requirements);
+    free(index);
+}
+
+static void Rule_Index_Free_Retired( void *data )
+{
+    Rule_Index_Free( (struct _Rule_Index *)data );
+}
+
+/****************************************************************************
+ * Rule_Intern_* - Program,  facility,  level,  tag and priority names used
+ * by rules,  each given a small ID (starting at 1).  The event's fields are
+ * looked up once and rules compare IDs.
+ ****************************************************************************/
+
+static void Rule_Intern_Init( struct _Rule_Intern *intern, uint32_t size )
+{
+
+    intern->size = size;
+    intern->count = 0;
+    intern->entry = calloc(size, sizeof(struct _Rule_Intern_Entry));
+
+    if ( intern->entry == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule intern table. Abort!", __FILE__, __LINE__);
+        }
+}
+
+static void Rule_Intern_Free( struct _Rule_Intern *intern )
+{
+
+    uint32_t i;
+
+    if ( intern->entry == NULL )
+        {
+            return;
+        }
+
+    for ( i = 0; i < intern->size; i++ )
+        {
+            free(intern->entry[i].key);
+        }
+
+    free(intern->entry);
+    intern->entry = NULL;
+}
+
+/* Returns the ID of "key",  or 0 if no rule uses it */
+
+static uint32_t Rule_Intern_Lookup( struct _Rule_Intern *intern, const char *key )
+{
+
+    uint32_t hash = Djb2_Hash((char *)key);
+    uint32_t i = hash & ( intern->size - 1 );
+
+    while ( intern->entry[i].id != 0 )
+        {
+
+            if ( intern->entry[i].hash == hash && !strcmp(intern->entry[i].key, key) )
+                {
+                    return(intern->entry[i].id);
+                }
+
+            i = ( i + 1 ) & ( intern->size - 1 );
+        }
+
+    return(0);
+}
+
+static void Rule_Intern_Insert( struct _Rule_Intern *intern, uint32_t hash, uint32_t id, char *key )
+{
+
+    uint32_t i = hash & ( intern->size - 1 );
+
+    while ( intern->entry[i].id != 0 )
+        {
+            i = ( i + 1 ) & ( intern->size - 1 );
+        }
+
+    intern->entry[i].hash = hash;
+    intern->entry[i].id = id;
+    intern->entry[i].key = key;
+}
+
+static uint32_t Rule_Intern_Add( struct _Rule_Intern *intern, const char *key )
+{
+
+    struct _Rule_Intern old;
+    uint32_t id;
+    uint32_t i;
+    char *tmp_key = NULL;
+
+    if ( ( id = Rule_Intern_Lookup(intern, key) ) != 0 )
+        {
+            return(id);
+        }
+
+    if ( ( intern->count + 1 ) * 2 > intern->size )
+        {
+
+            old = *intern;
+            Rule_Intern_Init(intern, old.size * 2);
+            intern->count = old.count;
+
+            for ( i = 0; i < old.size; i++ )
+                {
+                    if ( old.entry[i].id != 0 )
+                        {
+                            Rule_Intern_Insert(intern, old.entry[i].hash, old.entry[i].id, old.entry[i].key);
+                        }
+                }
+
+            free(old.entry);
+        }
+
+    tmp_key = strdup(key);
+
+    if ( tmp_key == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule intern table. Abort!", __FILE__, __LINE__);
+        }
+
+    intern->count++;
+    Rule_Intern_Insert(intern, Djb2_Hash(tmp_key), intern->count, tmp_key);
+
+    return(intern->count);
+}
+
+/****************************************************************************
+ * Rule_Header_* - Compiled program/facility/level/tag/priority lists.
+ ****************************************************************************/
+
+static const char *Rule_Header_Raw( int rule, int field )
+{
+
+    switch ( field )
+        {
+
+        case RULE_HEADER_PROGRAM:
+            return(rulestruct[rule].s_program);
+
+        case RULE_HEADER_FACILITY:
+            return(rulestruct[rule].s_facility);
+
+        case RULE_HEADER_LEVEL:
+            return(rulestruct[rule].s_level);
+
+        case RULE_HEADER_TAG:
+            return(rulestruct[rule].s_tag);
+
+        }
+
+    return(rulestruct[rule].s_syspri);
+}
+
+static void Rule_Header_Glob_Compile( struct _Rule_Header_Glob *glob, const char *name )
+{
+
+    char *out = NULL;
+    bool literal = true;
+
+    glob->pattern = malloc(strlen(name) + 1);
+
+    if ( glob->pattern == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule glob. Abort!", __FILE__, __LINE__);
+        }
+
+    glob->prefix_len = 0;
+    glob->min_len = 0;
+
+    for ( out = glob->pattern; *name != '\0'; name++ )
+        {
+
+            if ( *name == '*' || *name == '?' )
+                {
+                    literal = false;
+                }
+
+            if ( *name == '*' )
+                {
+
+                    if ( out != glob->pattern && out[-1] == '*' )
+                        {
+                            continue;
+                        }
+                }
+            else
+                {
+
+                    glob->min_len++;
+
+                    if ( literal == true )
+                        {
+                            glob->prefix_len++;
+                        }
+                }
+
+            *out++ = *name;
+        }
+
+    *out = '\0';
+}
+
+/* Same results as Wildcard(),  without the recursion.  On a mismatch we
+   only ever need to back up to the last '*' */
+
+static bool Rule_Header_Glob_Match( const struct _Rule_Header_Glob *glob, const char *str )
+{
+
+    const char *p = glob->pattern + glob->prefix_len;
+    const char *star = NULL;
+    const char *mark = NULL;
+
+    if ( strncmp(glob->pattern, str, glob->prefix_len) != 0 )
+        {
+            return(false);
+        }
+
+    str = str + glob->prefix_len;
+
+    while ( *str != '\0' )
+        {
+
+            if ( *p == '*' )
+                {
+                    star = ++p;
+                    mark = str;
+                    continue;
+                }
+
+            if ( *p != '\0' && ( *p == '?' || *p == *str ) )
+                {
+                    p++;
+                    str++;
+                    continue;
+                }
+
+            if ( star == NULL )
+                {
+                    return(false);
+                }
+
+            p = star;
+            str = ++mark;
+        }
+
+    while ( *p == '*' )
+        {
+            p++;
+        }
+
+    return( *p == '\0' );
+}
+
+static void Rule_Header_List_Compile( struct _Rule_Index *index, struct _Rule_Header_List *list, const char *raw, bool wildcard )
+{
+
+    char tmp[RULEBUF] = { 0 };
+    char *ptmp = NULL;
+    char *tok = NULL;
+
+    memset(list, 0, sizeof(struct _Rule_Header_List));
+
+    if ( raw[0] == '\0' )
+        {
+            return;
+        }
+
+    list->set = true;
+
+    strlcpy(tmp, raw, sizeof(tmp));
+
+    for ( ptmp = strtok_r(tmp, "|", &tok); ptmp != NULL; ptmp = strtok_r(NULL, "|", &tok) )
+        {
+
+            if ( wildcard == true && strpbrk(ptmp, "*?") != NULL )
+                {
+
+                    list->glob = realloc(list->glob, (list->glob_count+1) * sizeof(struct _Rule_Header_Glob));
+
+                    if ( list->glob == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for rule glob. Abort!", __FILE__, __LINE__);
+                        }
+
+                    Rule_Header_Glob_Compile(&list->glob[list->glob_count], ptmp);
+                    list->glob_count++;
+                    continue;
+                }
+
+            list->id = realloc(list->id, (list->id_count+1) * sizeof(uint32_t));
+
+            if ( list->id == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for rule header. Abort!", __FILE__, __LINE__);
+                }
+
+            list->id[list->id_count] = Rule_Intern_Add(&index->intern, ptmp);
+            list->id_count++;
+        }
+}
+
+static void Rule_Header_Free( struct _Rule_Header *header )
+{
+
+    int f;
+    int i;
+
+    for ( f = 0; f < RULE_HEADER_FIELDS; f++ )
+        {
+
+            for ( i = 0; i < header->field[f].glob_count; i++ )
+                {
+                    free(header->field[f].glob[i].pattern);
+                }
+
+            free(header->field[f].glob);
+            free(header->field[f].id);
+        }
+}
+
+/* Only used before the first Rule_Index_Build(),  when there is no index
+   to look the event up in.  Walks the '|' list as loaded. */
+
+static bool Rule_Header_Raw_Match( const char *raw, char *value, bool wildcard )
+{
+
+    char tmp[RULEBUF] = { 0 };
+    char *ptmp = NULL;
+    char *tok = NULL;
+
+    strlcpy(tmp, raw, sizeof(tmp));
+
+    for ( ptmp = strtok_r(tmp, "|", &tok); ptmp != NULL; ptmp = strtok_r(NULL, "|", &tok) )
+        {
+
+            if ( wildcard == true ? Wildcard(ptmp, value) : !strcmp(ptmp, value) )
+                {
+                    return(true);
+                }
+        }
+
+    return(false);
+}
+
+/****************************************************************************
+ * Content prefilter build helpers.  Patterns are de-duplicated (rules
+ * tend to share content) and each pattern remembers which requirements
+ * it satisfies.
+ ****************************************************************************/
+
+typedef struct _Rule_Index_Pattern_Build _Rule_Index_Pattern_Build;
+struct _Rule_Index_Pattern_Build
+{
+    const char **pattern;
+    bool *nocase;
+    int pattern_size;
+
+    int *slots;				/* De-duplication hash,  pattern + 1 */
+    uint32_t slot_size;
+
+    int *pair_pattern;			/* pattern -> requirement pairs */
+    int *pair_requirement;
+    int pair_count;
+    int pair_size;
+};
+
+static uint32_t Rule_Index_Pattern_Hash( const char *str, bool nocase )
+{
+
+    uint32_t hash = 5381;
+    unsigned char c;
+
+    while ( ( c = (unsigned char)*str++ ) )
+        {
+            hash = ((hash << 5) + hash) + ( nocase ? (unsigned char)tolower(c) : c );
+        }
+
+    return(hash + nocase);
+}
+
+static int Rule_Index_Pattern_Add( struct _Rule_Index *index, struct _Rule_Index_Pattern_Build *build, const char *pattern, bool nocase, int requirement )
+{
+
+    uint32_t slot;
+    int id = -1;
+    int i;
+
+    if ( (uint32_t)( index->pattern_count + 1 ) * 2 > build->slot_size )
+        {
+
+            /* Re-hash into a larger table */
+
+            free(build->slots);
+            build->slot_size = build->slot_size * 2;
+            build->slots = calloc(build->slot_size, sizeof(int));
+
+            if ( build->slots == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for pattern slots. Abort!", __FILE__, __LINE__);
+                }
+
+            for ( i = 0; i < index->pattern_count; i++ )
+                {
+
+                    slot = Rule_Index_Pattern_Hash(build->pattern[i], build->nocase[i]) & ( build->slot_size - 1 );
+
+                    while ( build->slots[slot] != 0 )
+                        {
+                            slot = ( slot + 1 ) & ( build->slot_size - 1 );
+                        }
+
+                    build->slots[slot] = i + 1;
+                }
+        }
+
+    slot = Rule_Index_Pattern_Hash(pattern, nocase) & ( build->slot_size - 1 );
+
+    while ( build->slots[slot] != 0 )
+        {
+
+            i = build->slots[slot] - 1;
+
+            if ( build->nocase[i] == nocase &&
+                    ( nocase ? !strcasecmp(build->pattern[i], pattern) : !strcmp(build->pattern[i], pattern) ) )
+                {
+                    id = i;
+                    break;
+                }
+
+            slot = ( slot + 1 ) & ( build->slot_size - 1 );
+        }
+
+    if ( id == -1 )
+        {
+
+            if ( index->pattern_count == build->pattern_size )
+                {
+
+                    build->pattern_size = build->pattern_size * 2;
+                    build->pattern = (const char **) realloc(build->pattern, build->pattern_size * sizeof(char *));
+                    build->nocase = (bool *) realloc(build->nocase, build->pattern_size * sizeof(bool));
+
+                    if ( build->pattern == NULL || build->nocase == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for patterns. Abort!", __FILE__, __LINE__);
+                        }
+                }
+
+            id = index->pattern_count;
+            index->pattern_count++;
+
+            build->pattern[id] = pattern;
+            build->nocase[id] = nocase;
+            build->slots[slot] = id + 1;
+
+            Sagan_AC_Add(index->content_ac[nocase], pattern, strlen(pattern), id);
+        }
+
+    if ( build->pair_count == build->pair_size )
+        {
+
+            build->pair_size = build->pair_size * 2;
+            build->pair_pattern = (int *) realloc(build->pair_pattern, build->pair_size * sizeof(int));
+            build->pair_requirement = (int *) realloc(build->pair_requirement, build->pair_size * sizeof(int));
+
+            if ( build->pair_pattern == NULL || build->pair_requirement == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for pattern pairs. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    build->pair_pattern[build->pair_count] = id;
+    build->pair_requirement[build->pair_count] = requirement;
+    build->pair_count++;
+
+    return(id);
+}
+
+static int Rule_Index_Requirement_Add( struct _Rule_Index *index, int *requirement_size, int rule )
+{
+
+    if ( index->requirement_count == *requirement_size )
+        {
+
+            *requirement_size = *requirement_size * 2;
+            index->requirement_rule = (int *) realloc(index->requirement_rule, *requirement_size * sizeof(int));
+
+            if ( index->requirement_rule == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for requirements. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    index->requirement_rule[index->requirement_count] = rule;
+    index->rule_requirements[rule]++;
+
+    return(index->requirement_count++);
+}
+
+/****************************************************************************
+ * Rule_Index_Build - Builds the rule prefilter index from the currently
+ * loaded rules.  This needs to be called after rules are (re)loaded.
+ ****************************************************************************/
+
+void Rule_Index_Build( void )
+{
+
+    static uint32_t generation = 0;
+
+    struct _Rule_Index *index = NULL;
+    struct _Rule_Index *old_index = NULL;
+
+    struct _Rule_Index_Pattern_Build build = { 0 };
+
+    struct timeval start_time;
+    struct timeval end_time;
+
+    int rule_count = counters->rulecount;
+    int requirement_size = 64;
+    int requirement;
+    int b;
+    int z;
+    int i;
+
+    gettimeofday(&start_time, NULL);
+
+    index = calloc(1, sizeof(struct _Rule_Index));
+
+    if ( index == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule index. Abort!", __FILE__, __LINE__);
+        }
+
+    index->rule_count = rule_count;
+    index->generation = ++generation;
+
+    Rule_Index_Table_Init(&index->program, 64);
+    Rule_Index_Table_Init(&index->facility, 16);
+    Rule_Index_Table_Init(&index->level, 16);
+    Rule_Index_Table_Init(&index->priority, 16);
+
+    Rule_Intern_Init(&index->intern, 64);
+    index->header = calloc( rule_count+1, sizeof(struct _Rule_Header) );
+
+    index->content_ac[0] = Sagan_AC_New(false);
+    index->content_ac[1] = Sagan_AC_New(true);
+
+    index->unkeyed = malloc( (rule_count+1) * sizeof(int) );
+    index->rule_requirements = calloc( rule_count+1, sizeof(int) );
+    index->requirement_rule = malloc( requirement_size * sizeof(int) );
+
+    build.pattern_size = 64;
+    build.pattern = malloc( build.pattern_size * sizeof(char *) );
+    build.nocase = malloc( build.pattern_size * sizeof(bool) );
+    build.slot_size = 128;
+    build.slots = calloc( build.slot_size, sizeof(int) );
+    build.pair_size = 64;
+    build.pair_pattern = malloc( build.pair_size * sizeof(int) );
+    build.pair_requirement = malloc( build.pair_size * sizeof(int) );
+
+    if ( index->header == NULL || index->unkeyed == NULL || index->rule_requirements == NULL || index->requirement_rule == NULL ||
+            build.pattern == NULL || build.nocase == NULL || build.slots == NULL ||
+            build.pair_pattern == NULL || build.pair_requirement == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule index. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( b = 0; b < rule_count; b++ )
+        {
+
+            for ( i = 0; i < RULE_HEADER_FIELDS; i++ )
+                {
+                    Rule_Header_List_Compile(index, &index->header[b].field[i], Rule_Header_Raw(b, i), i == RULE_HEADER_PROGRAM);
+                }
+
+            /* Key by the first field that can be compared exactly */
+
+            if ( rulestruct[b].s_program[0] != '\0' && strpbrk(rulestruct[b].s_program, "*?") == NULL )
+                {
+                    Rule_Index_Table_Add_List(&index->program, rulestruct[b].s_program, b);
+                }
+
+            else if ( rulestruct[b].s_facility[0] != '\0' )
+                {
+                    Rule_Index_Table_Add_List(&index->facility, rulestruct[b].s_facility, b);
+                }
+
+            else if ( rulestruct[b].s_level[0] != '\0' )
+                {
+                    Rule_Index_Table_Add_List(&index->level, rulestruct[b].s_level, b);
+                }
+
+            else if ( rulestruct[b].s_syspri[0] != '\0' )
+                {
+                    Rule_Index_Table_Add_List(&index->priority, rulestruct[b].s_syspri, b);
+                }
+
+            else
+                {
+                    index->unkeyed[index->unkeyed_count] = b;
+                    index->unkeyed_count++;
+                }
+
+            /* Every "content" (that isn't "!") must be in the message.  Any
+               offset/depth/distance/within window is a piece of the message,
+               so if the string isn't in the message the rule can't match */
+
+            for ( z = 0; z < rulestruct[b].content_count; z++ )
+                {
+
+                    if ( rulestruct[b].content_not[z] == true || rulestruct[b].s_content[z][0] == '\0' )
+                        {
+                            continue;
+                        }
+
+                    requirement = Rule_Index_Requirement_Add(index, &requirement_size, b);
+                    Rule_Index_Pattern_Add(index, &build, rulestruct[b].s_content[z], rulestruct[b].s_nocase[z], requirement);
+                }
+
+            /* At least one string of each (non "!") meta_content must be there */
+
+            for ( z = 0; z < rulestruct[b].meta_content_count; z++ )
+                {
+
+                    if ( rulestruct[b].meta_content_not[z] == true || rulestruct[b].meta_content_containers[z].meta_counter == 0 )
+                        {
+                            continue;
+                        }
+
+                    requirement = Rule_Index_Requirement_Add(index, &requirement_size, b);
+
+                    for ( i = 0; i < rulestruct[b].meta_content_containers[z].meta_counter; i++ )
+                        {
+
+                            if ( rulestruct[b].meta_content_containers[z].meta_content_converted[i][0] == '\0' )
+                                {
+                                    continue;
+                                }
+
+                            Rule_Index_Pattern_Add(index, &build, rulestruct[b].meta_content_containers[z].meta_content_converted[i], rulestruct[b].meta_content_case[z], requirement);
+                        }
+                }
+
+        }
+
+    /* Group requirements by pattern */
+
+    index->pattern_requirement_start = calloc( index->pattern_count + 1, sizeof(int) );
+    index->pattern_requirement = malloc( (build.pair_count + 1) * sizeof(int) );
+
+    if ( index->pattern_requirement_start == NULL || index->pattern_requirement == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule index. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < build.pair_count; i++ )
+        {
+            index->pattern_requirement_start[build.pair_pattern[i] + 1]++;
+        }
+
+    for ( i = 0; i < index->pattern_count; i++ )
+        {
+            index->pattern_requirement_start[i + 1] += index->pattern_requirement_start[i];
+        }
+
+    for ( i = build.pair_count - 1; i >= 0; i-- )
+        {
+            index->pattern_requirement[--index->pattern_requirement_start[build.pair_pattern[i] + 1]] = build.pair_requirement[i];
+        }
+
+    /* The fill above walked each "end" back to its "start",  shift down by one */
+
+    memmove(index->pattern_requirement_start, index->pattern_requirement_start + 1, index->pattern_count * sizeof(int));
+    index->pattern_requirement_start[index->pattern_count] = build.pair_count;
+
+    Sagan_AC_Build(index->content_ac[0]);
+    Sagan_AC_Build(index->content_ac[1]);
+
+    free(build.pattern);
+    free(build.nocase);
+    free(build.slots);
+    free(build.pair_pattern);
+    free(build.pair_requirement);
+
+    gettimeofday(&end_time, NULL);
+
+    Sagan_Log(NORMAL, "Content prefilter built: %d patterns, %d/%d states (case/nocase), %lu KB in %.3f ms.",
+              index->pattern_count, index->content_ac[0]->state_count, index->content_ac[1]->state_count,
+              (unsigned long)( Sagan_AC_Memory(index->content_ac[0]) + Sagan_AC_Memory(index->content_ac[1]) ) / 1024,
+              ( end_time.tv_sec - start_time.tv_sec ) * 1000.0 + ( end_time.tv_usec - start_time.tv_usec ) / 1000.0 );
+
+    if ( debug->debugload )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Rule index: %d rules, %u program keys, %u facility keys, %u level keys, %u priority keys, %d unkeyed rules, %d content requirements, %u interned names.", __FILE__, __LINE__, rule_count, index->program.count, index->facility.count, index->level.count, index->priority.count, index->unkeyed_count, index->requirement_count, index->intern.count);
+        }
+
+    /* Events already in Sagan_Engine() may still be using the index we
+       replace.  It's retired and freed once they have all finished */
+
+    old_index = __atomic_exchange_n(&Rule_Index, index, __ATOMIC_SEQ_CST);
+
+    if ( old_index != NULL )
+        {
+            Rule_Index_Retire(old_index, Rule_Index_Free_Retired);
+        }
+
+}
+
+/****************************************************************************
+ * Rule_Index_Retire - Frees "data" with "free_func" once no processor in
+ * Sagan_Engine() can still be using it.  The caller must already have
+ * replaced or cleared every pointer an event could load it through.
+ ****************************************************************************/
+
+void Rule_Index_Retire( void *data, void (*free_func)( void * ) )
+{
+
+    struct _Rule_Index_Retired *retired = NULL;
+
+    retired = malloc(sizeof(struct _Rule_Index_Retired));
+
+    if ( retired == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for retired rule data. Abort!", __FILE__, __LINE__);
+        }
+
+    retired->data = data;
+    retired->free_func = free_func;
+
+    pthread_mutex_lock(&RuleIndexRetireMutex);
+
+    retired->retire_epoch = __atomic_add_fetch(&Rule_Index_Epoch, 1, __ATOMIC_SEQ_CST);
+    retired->next = Rule_Index_Retired;
+    __atomic_store_n(&Rule_Index_Retired, retired, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&RuleIndexRetireMutex);
+
+    Rule_Index_Reclaim();
+}
+
+/****************************************************************************
+ * Rule_Index_Enter/Rule_Index_Exit - Sagan_Engine() wraps each event in
+ * these.  On entry a processor posts the current Rule_Index_Epoch in its
+ * reader slot,  and clears it on exit.  An index (or meta_content
+ * matcher) retired at epoch E can only be held by a reader that posted an
+ * epoch below E,  since anyone posting E or later loads the pointer after
+ * it was replaced.
+ *
+ * Rule_Index_Enter() returns the index for the whole event.  A rebuild
+ * (SIGHUP may load fewer rules) doesn't change what the event looks at.
+ ****************************************************************************/
+
+static struct _Rule_Index_Reader *Rule_Index_Reader_Register( void )
+{
+
+    struct _Rule_Index_Reader *reader = NULL;
+    struct _Rule_Index_Reader **readers = NULL;
+
+    if ( posix_memalign((void **)&reader, RULE_INDEX_CACHE_LINE, sizeof(struct _Rule_Index_Reader)) != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule index reader. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(reader, 0, sizeof(struct _Rule_Index_Reader));
+
+    pthread_mutex_lock(&RuleIndexRetireMutex);
+
+    readers = realloc(Rule_Index_Readers, (Rule_Index_Reader_Count + 1) * sizeof(struct _Rule_Index_Reader *));
+
+    if ( readers == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for rule index readers. Abort!", __FILE__, __LINE__);
+        }
+
+    readers[Rule_Index_Reader_Count] = reader;
+    Rule_Index_Readers = readers;
+    Rule_Index_Reader_Count++;
+
+    pthread_mutex_unlock(&RuleIndexRetireMutex);
+
+    return(reader);
+}
+
+struct _Rule_Index *Rule_Index_Enter( void )
+{
+
+    if ( Rule_Index_Reader_Thread == NULL )
+        {
+            Rule_Index_Reader_Thread = Rule_Index_Reader_Register();
+        }
+
+    __atomic_store_n(&Rule_Index_Reader_Thread->epoch, __atomic_load_n(&Rule_Index_Epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+
+    return( __atomic_load_n(&Rule_Index, __ATOMIC_SEQ_CST) );
+}
+
+void Rule_Index_Exit( void )
+{
+
+    __atomic_store_n(&Rule_Index_Reader_Thread->epoch, 0, __ATOMIC_SEQ_CST);
+
+    /* A dynamic rule load replaces the index from inside an event,  and
+       a reload retires while events are running,  so it's freed here */
+
+    if ( __atomic_load_n(&Rule_Index_Retired, __ATOMIC_SEQ_CST) != NULL )
+        {
+            Rule_Index_Reclaim();
+        }
+}
+
+/****************************************************************************
+ * Rule_Index_Reclaim - Frees retired data no reader can still hold.
+ ****************************************************************************/
+
+static void Rule_Index_Reclaim( void )
+{
+
+    struct _Rule_Index_Retired *retired = NULL;
+    struct _Rule_Index_Retired **prev = NULL;
+
+    uint64_t oldest = UINT64_MAX;
+    uint64_t epoch;
+    int i;
+
+    if ( pthread_mutex_trylock(&RuleIndexRetireMutex) != 0 )
+        {
+            return;		/* Someone else is at it */
+        }
+
+    for ( i = 0; i < Rule_Index_Reader_Count; i++ )
+        {
+
+            epoch = __atomic_load_n(&Rule_Index_Readers[i]->epoch, __ATOMIC_SEQ_CST);
+
+            if ( epoch != 0 && epoch < oldest )
+                {
+                    oldest = epoch;
+                }
+        }
+
+    prev = &Rule_Index_Retired;
+
+    while ( ( retired = *prev ) != NULL )
+        {
+
+            if ( retired->retire_epoch <= oldest )
+                {
+                    __atomic_store_n(prev, retired->next, __ATOMIC_SEQ_CST);
+                    retired->free_func(retired->data);
+                    free(retired);
+                    continue;
+                }
+
+            prev = &retired->next;
+        }
+
+    pthread_mutex_unlock(&RuleIndexRetireMutex);
+}
+
+/****************************************************************************
+ * Per thread state for the content prefilter.  "epoch" stamps avoid having
+ * to clear the arrays between events.
+ ****************************************************************************/
+
+typedef struct _Rule_Index_Scan _Rule_Index_Scan;
+struct _Rule_Index_Scan
+{
+    struct _Rule_Index *index;
+    uint32_t generation;
+    uint32_t epoch;
+
+    uint32_t *pattern_epoch;
+    uint32_t *requirement_epoch;
+    uint32_t *rule_epoch;
+    int *rule_satisfied;
+    uint64_t *rule_bitmap;		/* Rules with all required strings present */
+};
+
+static bool Rule_Index_Pattern_Found( int pattern, void *data )
+{
+
+    struct _Rule_Index_Scan *scan = (struct _Rule_Index_Scan *)data;
+    struct _Rule_Index *index = scan->index;
+
+    int requirement;
+    int rule;
+    int i;
+
+    if ( scan->pattern_epoch[pattern] == scan->epoch )
+        {
+            return(false);
+        }
+
+    scan->pattern_epoch[pattern] = scan->epoch;
+
+    for ( i = index->pattern_requirement_start[pattern]; i < index->pattern_requirement_start[pattern + 1]; i++ )
+        {
+
+            requirement = index->pattern_requirement[i];
+
+            if ( scan->requirement_epoch[requirement] == scan->epoch )
+                {
+                    continue;
+                }
+
+            scan->requirement_epoch[requirement] = scan->epoch;
+
+            rule = index->requirement_rule[requirement];
+
+            if ( scan->rule_epoch[rule] != scan->epoch )
+                {
+                    scan->rule_epoch[rule] = scan->epoch;
+                    scan->rule_satisfied[rule] = 0;
+                }
+
+            scan->rule_satisfied[rule]++;
+
+            if ( scan->rule_satisfied[rule] == index->rule_requirements[rule] )
+                {
+                    scan->rule_bitmap[rule >> 6] |= 1ULL << ( rule & 63 );
+                }
+        }
+
+    return(false);
+}
+
+static void Rule_Index_Scan_Setup( struct _Rule_Index_Scan *scan, struct _Rule_Index *index )
+{
+
+    scan->index = index;
+
+    if ( scan->generation == index->generation )
+        {
+            return;
+        }
+
+    free(scan->pattern_epoch);
+    free(scan->requirement_epoch);
+    free(scan->rule_epoch);
+    free(scan->rule_satisfied);
+    free(scan->rule_bitmap);
+
+    scan->pattern_epoch = calloc(index->pattern_count + 1, sizeof(uint32_t));
+    scan->requirement_epoch = calloc(index->requirement_count + 1, sizeof(uint32_t));
+    scan->rule_epoch = calloc(index->rule_count + 1, sizeof(uint32_t));
+    scan->rule_satisfied = calloc(index->rule_count + 1, sizeof(int));
+    scan->rule_bitmap = calloc(( index->rule_count / 64 ) + 1, sizeof(uint64_t));
+
+    if ( scan->pattern_epoch == NULL || scan->requirement_epoch == NULL || scan->rule_epoch == NULL ||
+            scan->rule_satisfied == NULL || scan->rule_bitmap == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the content prefilter. Abort!", __FILE__, __LINE__);
+        }
+
+    scan->generation = index->generation;
+    scan->epoch = 0;
+}
+
+/****************************************************************************
+ * Rule_Index_Candidates - Fills "candidates" with the rule positions in
+ * "index" (from Rule_Index_Enter()) that could match this event,  in rule
+ * order.  Only rules below "max_candidates" are returned.  Returns the
+ * number of rules.
+ ****************************************************************************/
+
+int Rule_Index_Candidates( struct _Rule_Index *index, _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int *candidates, int max_candidates )
+{
+
+    static __thread struct _Rule_Index_Scan scan = { 0 };
+
+    struct _Rule_Index_Entry *entry = NULL;
+
+    int *list[5];
+    int list_count[5];
+    int list_pos[5] = { 0 };
+    int lists = 0;
+
+    int rule_count = max_candidates;
+    int count = 0;
+    int next;
+    int rule;
+    int l;
+
+    /* No index yet,  everything is a candidate */
+
+    if ( index == NULL )
+        {
+            for ( count = 0; count < rule_count; count++ )
+                {
+                    candidates[count] = count;
+                }
+
+            return(count);
+        }
+
+    /* One pass over the message for every content/meta_content string */
+
+    Rule_Index_Scan_Setup(&scan, index);
+
+    scan.epoch++;
+
+    if ( scan.epoch == 0 )
+        {
+            memset(scan.pattern_epoch, 0, (index->pattern_count + 1) * sizeof(uint32_t));
+            memset(scan.requirement_epoch, 0, (index->requirement_count + 1) * sizeof(uint32_t));
+            memset(scan.rule_epoch, 0, (index->rule_count + 1) * sizeof(uint32_t));
+            scan.epoch = 1;
+        }
+
+    memset(scan.rule_bitmap, 0, (( index->rule_count / 64 ) + 1) * sizeof(uint64_t));
+
+    if ( index->pattern_count > 0 )
+        {
+            Sagan_AC_Search(index->content_ac, 2, SaganProcSyslog_LOCAL->syslog_message, strlen(SaganProcSyslog_LOCAL->syslog_message), Rule_Index_Pattern_Found, &scan);
+        }
+
+    list[lists] = index->unkeyed;
+    list_count[lists] = index->unkeyed_count;
+    lists++;
+
+    if ( ( entry = Rule_Index_Table_Lookup(&index->program, SaganProcSyslog_LOCAL->syslog_program) ) != NULL )
+        {
+            list[lists] = entry->rules;
+            list_count[lists] = entry->rule_count;
+            lists++;
+        }
+
+    if ( ( entry = Rule_Index_Table_Lookup(&index->facility, SaganProcSyslog_LOCAL->syslog_facility) ) != NULL )
+        {
+            list[lists] = entry->rules;
+            list_count[lists] = entry->rule_count;
+            lists++;
+        }
+
+    if ( ( entry = Rule_Index_Table_Lookup(&index->level, SaganProcSyslog_LOCAL->syslog_level) ) != NULL )
+        {
+            list[lists] = entry->rules;
+            list_count[lists] = entry->rule_count;
+            lists++;
+        }
+
+    if ( ( entry = Rule_Index_Table_Lookup(&index->priority, SaganProcSyslog_LOCAL->syslog_priority) ) != NULL )
+        {
+            list[lists] = entry->rules;
+            list_count[lists] = entry->rule_count;
+            lists++;
+        }
+
+    /* Merge the (already sorted & disjoint) lists so rules fire in order */
+
+    for (;;)
+        {
+
+            next = -1;
+
+            for ( l = 0; l < lists; l++ )
+                {
+                    if ( list_pos[l] < list_count[l] && ( next == -1 || list[l][list_pos[l]] < list[next][list_pos[next]] ) )
+                        {
+                            next = l;
+                        }
+                }
+
+            if ( next == -1 )
+                {
+                    break;
+                }
+
+            rule = list[next][list_pos[next]];
+            list_pos[next]++;
+
+            if ( rule >= rule_count || rule >= index->rule_count )
+                {
+                    continue;
+                }
+
+            /* Skip rules missing a required content/meta_content string */
+
+            if ( index->rule_requirements[rule] != 0 &&
+                    ( scan.rule_bitmap[rule >> 6] & ( 1ULL << ( rule & 63 ) ) ) == 0 )
+                {
+                    continue;
+                }
+
+            candidates[count] = rule;
+            count++;
+        }
+
+    Sagan_Counter_Add(rule_index_events, 1);
+    Sagan_Counter_Add(rule_index_candidates, count);
+
+    return(count);
+}
+
+/****************************************************************************
+ * Rule_Index_Header_Intern - Looks up the event's program,  facility,
+ * level,  tag and priority once in "index",  for Rule_Index_Header_Match().
+ * It must be the index the candidates came from.
+ ****************************************************************************/
+
+void Rule_Index_Header_Intern( struct _Rule_Index *index, _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, _Rule_Header_Event *event )
+{
+
+    int f;
+
+    event->index = index;
+
+    event->value[RULE_HEADER_PROGRAM] = SaganProcSyslog_LOCAL->syslog_program;
+    event->value[RULE_HEADER_FACILITY] = SaganProcSyslog_LOCAL->syslog_facility;
+    event->value[RULE_HEADER_LEVEL] = SaganProcSyslog_LOCAL->syslog_level;
+    event->value[RULE_HEADER_TAG] = SaganProcSyslog_LOCAL->syslog_tag;
+    event->value[RULE_HEADER_PRIORITY] = SaganProcSyslog_LOCAL->syslog_priority;
+
+    for ( f = 0; f < RULE_HEADER_FIELDS; f++ )
+        {
+            event->id[f] = event->index != NULL ? Rule_Intern_Lookup(&event->index->intern, event->value[f]) : 0;
+        }
+}
+
+/****************************************************************************
+ * Rule_Index_Header_Match - True if the event passes "rule"'s program,
+ * facility,  level,  tag and priority options.  Any one name in each
+ * list the rule has set must match.
+ ****************************************************************************/
+
+bool Rule_Index_Header_Match( _Rule_Header_Event *event, int rule )
+{
+
+    struct _Rule_Header_List *list = NULL;
+    const char *raw = NULL;
+
+    bool found;
+    int f;
+    int i;
+
+    for ( f = 0; f < RULE_HEADER_FIELDS; f++ )
+        {
+
+            if ( event->index == NULL )
+                {
+
+                    raw = Rule_Header_Raw(rule, f);
+
+                    if ( raw[0] != '\0' && Rule_Header_Raw_Match(raw, event->value[f], f == RULE_HEADER_PROGRAM) == false )
+                        {
+                            return(false);
+                        }
+
+                    continue;
+                }
+
+            list = &event->index->header[rule].field[f];
+
+            if ( list->set == false )
+                {
+                    continue;
+                }
+
+            found = false;
+
+            if ( event->id[f] != 0 )
+                {
+                    for ( i = 0; i < list->id_count; i++ )
+                        {
+                            if ( list->id[i] == event->id[f] )
+                                {
+                                    found = true;
+                                    break;
+                                }
+                        }
+                }
+
+            for ( i = 0; found == false && i < list->glob_count; i++ )
+                {
+                    found = Rule_Header_Glob_Match(&list->glob[i], event->value[f]);
+                }
+
+            if ( found == false )
+                {
+                    return(false);
+                }
+        }
+
+    return(true);
+}
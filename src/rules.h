@@ -73,7 +73,9 @@ typedef struct meta_content_conversion meta_content_conversion;
 struct meta_content_conversion
 {
     char meta_content_converted[MAX_META_CONTENT_ITEMS][256];
+    uint16_t meta_content_len[MAX_META_CONTENT_ITEMS];
     int  meta_counter;
+    struct _Meta_Content_Matcher *matcher;	/* NULL for small containers */
 };
 
 typedef struct _Rule_Struct _Rule_Struct;
@@ -83,10 +85,13 @@ struct _Rule_Struct
 
     int ruleset_id;
 
-    pcre *re_pcre[MAX_PCRE];
-    pcre_extra *pcre_extra[MAX_PCRE];
+    struct _Sagan_PCRE pcre[MAX_PCRE];
+
+    uint64_t pcre_exec_count;			/* Only kept with "pcre-timing" */
+    uint64_t pcre_exec_nsec;
 
     char s_content[MAX_CONTENT][256];
+    uint16_t s_content_len[MAX_CONTENT];
     char s_reference[MAX_REFERENCE][256];
     char s_classtype[32];
     uint64_t s_sid;
@@ -354,4 +359,134 @@ struct _Sagan_Ruleset_Track
 };
 
 
+/* Rule prefilter index.  Built after rules are loaded so Sagan_Engine()
+ * only evaluates rules that could possibly match an event. Rules are
+ * keyed by their program (or facility,  level,  priority if no program is
+ * set). Rules with wildcards or no keyable field are "unkeyed" and always
+ * candidates.
+ *
+ * Every required content and meta_content string is also loaded into a
+ * case sensitive and a "nocase" Aho-Corasick automaton.  One pass over the
+ * message tells us which rules have all their required strings present.
+ * Only those rules are handed to the full content/pcre/meta_content checks. */
+
+#define RULE_INDEX_MAX_KEY	MAX_SYSLOG_PROGRAM
+
+typedef struct _Rule_Index_Entry _Rule_Index_Entry;
+struct _Rule_Index_Entry
+{
+    uint32_t hash;
+    char key[RULE_INDEX_MAX_KEY];
+    int *rules;
+    int rule_count;
+};
+
+typedef struct _Rule_Index_Table _Rule_Index_Table;
+struct _Rule_Index_Table
+{
+    struct _Rule_Index_Entry *entry;
+    uint32_t size;				/* Always a power of 2 */
+    uint32_t count;
+};
+
+/* A rule's program/facility/level/tag/priority lists,  split when the
+ * index is built.  Names are interned to small IDs so the engine only has
+ * to look up the event's fields once and compare integers per rule.
+ * Names with '*' or '?' are kept as globs. */
+
+#define RULE_HEADER_PROGRAM	0
+#define RULE_HEADER_FACILITY	1
+#define RULE_HEADER_LEVEL	2
+#define RULE_HEADER_TAG		3
+#define RULE_HEADER_PRIORITY	4
+#define RULE_HEADER_FIELDS	5
+
+typedef struct _Rule_Header_Glob _Rule_Header_Glob;
+struct _Rule_Header_Glob
+{
+    char *pattern;				/* Runs of '*' collapsed to one */
+    int prefix_len;				/* Literal characters before any '*' or '?' */
+    int min_len;				/* Characters that aren't '*' */
+};
+
+typedef struct _Rule_Header_List _Rule_Header_List;
+struct _Rule_Header_List
+{
+    bool set;					/* The rule has this option */
+    uint32_t *id;
+    int id_count;
+    struct _Rule_Header_Glob *glob;
+    int glob_count;
+};
+
+typedef struct _Rule_Header _Rule_Header;
+struct _Rule_Header
+{
+    struct _Rule_Header_List field[RULE_HEADER_FIELDS];
+};
+
+typedef struct _Rule_Intern_Entry _Rule_Intern_Entry;
+struct _Rule_Intern_Entry
+{
+    uint32_t hash;
+    uint32_t id;				/* 0 == empty slot */
+    char *key;
+};
+
+typedef struct _Rule_Intern _Rule_Intern;
+struct _Rule_Intern
+{
+    struct _Rule_Intern_Entry *entry;
+    uint32_t size;				/* Always a power of 2 */
+    uint32_t count;
+};
+
+typedef struct _Rule_Index _Rule_Index;
+struct _Rule_Index
+{
+    int rule_count;
+    uint32_t generation;
+
+    struct _Rule_Intern intern;
+    struct _Rule_Header *header;		/* One per rule */
+
+    struct _Rule_Index_Table program;
+    struct _Rule_Index_Table facility;
+    struct _Rule_Index_Table level;
+    struct _Rule_Index_Table priority;
+
+    int *unkeyed;
+    int unkeyed_count;
+
+    /* Content prefilter */
+
+    struct _Sagan_AC *content_ac[2];		/* 0 == case sensitive, 1 == nocase */
+
+    int pattern_count;
+    int *pattern_requirement_start;		/* Requirements waiting on a pattern */
+    int *pattern_requirement;
+
+    int requirement_count;			/* A content,  or one meta_content container */
+    int *requirement_rule;
+    int *rule_requirements;			/* Requirements a rule needs to be a candidate */
+};
+
+/* An event's header fields,  interned against "index" by
+ * Rule_Index_Header_Intern().  ID 0 means no rule names that value. */
+
+typedef struct _Rule_Header_Event _Rule_Header_Event;
+struct _Rule_Header_Event
+{
+    struct _Rule_Index *index;
+    char *value[RULE_HEADER_FIELDS];
+    uint32_t id[RULE_HEADER_FIELDS];
+};
+
 void Load_Rules ( const char * );
+void Rule_Index_Build ( void );
+struct _Rule_Index *Rule_Index_Enter ( void );
+void Rule_Index_Exit ( void );
+void Rule_Index_Retire ( void *, void (*)( void * ) );
+int  Rule_Index_Candidates ( struct _Rule_Index *, _Sagan_Proc_Syslog *, int *, int );
+void Rule_Index_Header_Intern ( struct _Rule_Index *, _Sagan_Proc_Syslog *, _Rule_Header_Event * );
+bool Rule_Index_Header_Match ( _Rule_Header_Event *, int );
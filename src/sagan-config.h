@@ -39,6 +39,8 @@ struct _SaganConfig
     bool	 quiet;
 
     unsigned char	input_type;
+    char	 input_sources[1024];		/* More inputs,  see input-reactor.c */
+    int		 input_udp_threads;		/* 0 == UDP is read by the reactor */
 
 #ifdef HAVE_LIBFASTJSON
 
@@ -65,6 +67,7 @@ struct _SaganConfig
 
     FILE		*eve_stream;
     bool		eve_stream_status;
+    struct _Sagan_Writer *eve_writer;		/* See util-writer.c */
 
 
     int		        eve_fd;
@@ -80,12 +83,14 @@ struct _SaganConfig
 
     FILE         *sagan_alert_stream;
     bool	 sagan_alert_stream_status;
+    struct _Sagan_Writer *sagan_alert_writer;
 
 
     int          sagan_alert_fd;
 
     FILE	 *sagan_fast_stream;
     bool	 sagan_fast_stream_status;
+    struct _Sagan_Writer *sagan_fast_writer;
 
     int	         sagan_fast_fd;
     char         sagan_log_filepath[MAXPATH];
@@ -115,10 +120,19 @@ struct _SaganConfig
     char         sagan_droplistfile[MAXPATH];           /* Log lines to "ignore" */
     bool         sagan_droplist_flag;
 
-    bool         output_thread_flag;
+    bool         output_thread_flag;		/* Alerts are written by output threads */
+    int		 output_threads;		/* 0 == processors call Output() themselves */
+    int		 output_queue_size;		/* Alert slots,  see output-queue.c */
+    bool	 output_block;			/* Queue full: true == block processor, false == drop */
+
+    int		 output_buffer_size;		/* Alert/fast/EVE buffers,  see util-writer.c */
+    int		 output_flush_time;		/* Milliseconds,  0 == only when full */
+    bool	 output_sync;			/* fdatasync() after each write */
 
     int          max_processor_threads;
     int		 max_batch;
+    int		 ring_size;			/* Batch ring slots, 0 == auto */
+    bool	 ring_block;			/* Ring full: true == block reader, false == drop */
 
     int          sagan_port;
     bool         disable_dns_warnings;
@@ -127,6 +141,9 @@ struct _SaganConfig
     char 	 *sagan_proto_string;
 
     bool	 pcre_jit; 				/* For PCRE JIT support testing */
+    uint32_t	 pcre_match_limit;			/* 0 == library default */
+    uint32_t	 pcre_depth_limit;			/* 0 == library default */
+    bool	 pcre_timing;				/* Per rule "pcre" timing */
 
     bool         endian;
 
@@ -219,6 +236,7 @@ struct _SaganConfig
     char        plog_logdev[50];
     char        plog_filter[256];
     bool        plog_flag;
+    bool        plog_direct;			/* Skip "log-device",  see input-reactor.c */
     int         plog_promiscuous;
 #endif
 
@@ -273,6 +291,11 @@ struct _SaganConfig
     int		 bluedot_filename_queue;
     int		 bluedot_ja3_queue;
 
+    int		 bluedot_max_connections;
+    int		 bluedot_lookup_timeout;
+    int		 bluedot_max_deferred;
+    unsigned char bluedot_miss;
+
 #endif
 
 
@@ -280,6 +303,7 @@ struct _SaganConfig
 
     bool	 brointel_flag;
     char	 brointel_files[2048];
+    char	 brointel_cache[MAXPATH];		/* mmap() cache of the above,  "" == none */
 
     /* For Maxmind GeoIP2 address lookup */
 
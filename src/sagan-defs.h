@@ -44,7 +44,7 @@ typedef void json_object;
 
 #define SENSOR_NAME		"default_sensor_name"
 #define CLUSTER_NAME		"default_cluster_name"
-#define MMAP_VERSION		2.0
+#define MMAP_VERSION		2.3
 
 #define CLASSBUF		1024
 #define RULEBUF			5128
@@ -77,14 +77,27 @@ typedef void json_object;
 #define DEFAULT_JSON_INPUT_MAP          "/usr/local/etc/sagan-rules/json-input.map"
 #define INPUT_PIPE                      1
 #define INPUT_JSON                      2
+#define INPUT_SYSLOG                    3		/* Raw RFC 3164/5424,  see input-syslog.c */
 
 /* In very high preformance (over 100k EPS),  you may want to considering raising
    the MAX_SYSLOG_BATCH and setting it in the sagan.yaml.  This allows Sagan
-   to "batch" logs together to avoid expensive mutex_lock/mutex_unlock calls. */
+   to "batch" logs together so processor threads claim fewer ring slots. */
 
 #define MAX_SYSLOG_BATCH	100
 #define DEFAULT_SYSLOG_BATCH	1
 
+/* Alerts waiting on the output threads (see output-queue.c).  Every slot
+   holds a copy of the alert and its log line (about 150k) */
+
+#define DEFAULT_OUTPUT_QUEUE_SIZE	128
+
+/* Alert,  fast and EVE files are written through buffers (see
+   util-writer.c).  They're written out when full or every
+   DEFAULT_OUTPUT_FLUSH_TIME milliseconds */
+
+#define DEFAULT_OUTPUT_BUFFER_SIZE	262144
+#define DEFAULT_OUTPUT_FLUSH_TIME	1000
+
 #define MAXPATH 		255		/* Max path for files/directories */
 #define MAXHOST         	255		/* Max host length */
 #define MAXPROGRAM		32		/* Max syslog 'program' length */
@@ -213,10 +226,7 @@ typedef void json_object;
 #define DEFAULT_IPC_FLEXBITS		1000
 #define DEFAULT_IPC_XBITS		10000
 
-#define	AFTER2				0
-#define THRESHOLD2			1
-#define FLEXBIT				2
-#define XBIT				3
+#define MAX_IPC_SYSLOGMSG		1024		/* Syslog message stored with IPC xbits/flexbits/thresholds/afters */
 
 #define PARSE_HASH_MD5			1
 #define	PARSE_HASH_SHA1			2
@@ -253,6 +263,16 @@ typedef void json_object;
 #define BLUEDOT_FILENAME_QUEUE_DEFAULT	100
 #define BLUEDOT_JA3_QUEUE_DEFAULT	100
 
+#define BLUEDOT_MAX_CONNECTIONS_DEFAULT	4		/* Keep-alive connections to Bluedot */
+#define BLUEDOT_LOOKUP_TIMEOUT_DEFAULT	10		/* Seconds */
+#define BLUEDOT_MAX_DEFERRED_DEFAULT	1000		/* Events waiting on a lookup */
+
+#define BLUEDOT_MISS_DEFER		1		/* Re-run the rule when the lookup completes */
+#define BLUEDOT_MISS_FAIL_OPEN		2		/* Treat a cache miss as "no category" */
+
+#define BLUEDOT_LATENCY_TYPES		5		/* IP, hash, URL, filename, JA3 */
+#define BLUEDOT_LATENCY_BUCKETS		16		/* <1ms, <2ms, <4ms ... >=16s */
+
 #endif
 
 /* Outside WITH_BLUEDOT because used in arg passing */
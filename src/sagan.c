@@ -42,7 +42,6 @@
 #include <getopt.h>
 #include <time.h>
 #include <signal.h>
-#include <pcre.h>
 #include <limits.h>
 #include <stdint.h>
 #include <inttypes.h>
@@ -70,6 +69,12 @@
 #include "ipc.h"
 #include "tracking-syslog.h"
 #include "parsers/parsers.h"
+#include "util-mpmc.h"
+#include "util-ring.h"
+#include "util-time.h"
+#include "output-queue.h"
+#include "util-writer.h"
+#include "input-reactor.h"
 
 #include "input-pipe.h"
 
@@ -129,15 +134,12 @@ struct _Sagan_Ignorelist *SaganIgnorelist;
 #include "redis.h"
 #endif
 
-struct _Sagan_Pass_Syslog *SaganPassSyslog = NULL;
+struct _Sagan_Ring *SaganRing = NULL;
 
 
-int proc_msgslot = 0;
 int proc_running = 0;
 
 
-pthread_cond_t SaganProcDoWork=PTHREAD_COND_INITIALIZER;
-pthread_mutex_t SaganProcWorkMutex=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t SaganRulesLoadedMutex=PTHREAD_MUTEX_INITIALIZER;
 
 /* ########################################################################
@@ -169,8 +171,6 @@ int main(int argc, char **argv)
 
     int option_index = 0;
 
-    struct _Sagan_Pass_Syslog *SaganPassSyslog_LOCAL = NULL;
-
     /****************************************************************************/
     /* libpcap/PLOG (syslog sniffer) local variables                            */
     /****************************************************************************/
@@ -209,6 +209,36 @@ int main(int argc, char **argv)
     pthread_attr_init(&thread_client_stats_attr);
     pthread_attr_setdetachstate(&thread_client_stats_attr,  PTHREAD_CREATE_DETACHED);
 
+    /****************************************************************************/
+    /* Flexbit sweeper local variables                                          */
+    /****************************************************************************/
+
+    pthread_t flexbit_sweep_thread;
+    pthread_attr_t thread_flexbit_sweep_attr;
+    pthread_attr_init(&thread_flexbit_sweep_attr);
+    pthread_attr_setdetachstate(&thread_flexbit_sweep_attr,  PTHREAD_CREATE_DETACHED);
+
+    /****************************************************************************/
+    /* Coarse clock local variables                                             */
+    /****************************************************************************/
+
+    pthread_t clock_thread;
+    pthread_attr_t thread_clock_attr;
+    pthread_attr_init(&thread_clock_attr);
+    pthread_attr_setdetachstate(&thread_clock_attr,  PTHREAD_CREATE_DETACHED);
+
+    pthread_t writer_thread;
+    pthread_attr_t thread_writer_attr;
+    pthread_attr_init(&thread_writer_attr);
+    pthread_attr_setdetachstate(&thread_writer_attr,  PTHREAD_CREATE_DETACHED);
+
+#ifdef WITH_BLUEDOT
+    pthread_t bluedot_thread;
+    pthread_attr_t thread_bluedot_attr;
+    pthread_attr_init(&thread_bluedot_attr);
+    pthread_attr_setdetachstate(&thread_bluedot_attr,  PTHREAD_CREATE_DETACHED);
+#endif
+
     /****************************************************************************/
     /* Various local variables						        */
     /****************************************************************************/
@@ -242,11 +272,6 @@ int main(int argc, char **argv)
     pthread_attr_setdetachstate(&tracking_thread_attr,  PTHREAD_CREATE_DETACHED);
 
 
-    bool fifoerr = false;
-    bool ignore_flag = false;
-
-    char syslogstring[MAX_SYSLOGMSG] = { 0 };
-
     signed char c;
     int rc=0;
 
@@ -257,8 +282,6 @@ int main(int argc, char **argv)
 
     bool debugflag = false;
 
-    int batch_count = 0;
-
     /* Allocate memory for global struct _SaganDebug */
 
     debug = malloc(sizeof(_SaganDebug));
@@ -668,47 +691,59 @@ int main(int argc, char **argv)
             Sagan_Log(ERROR, "[%s, line %d] Error creating signal handler thread. [error: %d]", __FILE__, __LINE__, rc);
         }
 
+    /* Shared clock for Return_Epoch()/Return_Local_Time().  Also after the
+       fork() */
+
+    rc = pthread_create( &clock_thread, &thread_clock_attr, (void *)Sagan_Clock_Thread, NULL );
+
+    if ( rc != 0  )
+        {
+            Remove_Lock_File();
+            Sagan_Log(ERROR, "[%s, line %d] Error creating clock thread. [error: %d]", __FILE__, __LINE__, rc);
+        }
 
-#ifdef PCRE_HAVE_JIT
 
     /* We test if pages will support RWX before loading rules.  If it doesn't due to the OS,
        we want to disable PCRE JIT now.  This prevents confusing warnings of PCRE JIT during
        rule load */
 
-    config->pcre_jit = true;
+    (void)Sagan_memmem_Init();
 
-    if (PageSupportsRWX() == false)
+    config->pcre_jit = Sagan_PCRE_JIT_Available();
+
+    if ( config->pcre_jit == true && PageSupportsRWX() == false )
         {
             Sagan_Log(WARN, "The operating system doens't allow RWX pages.  Disabling PCRE JIT.");
             config->pcre_jit = false;
         }
 
-#endif
-
     pthread_mutex_lock(&SaganRulesLoadedMutex);
     (void)Load_YAML_Config(config->sagan_config);
     pthread_mutex_unlock(&SaganRulesLoadedMutex);
 
     (void)Sagan_Engine_Init();
 
-    SaganPassSyslog = malloc(config->max_processor_threads * sizeof(_Sagan_Pass_Syslog));
+    /* Batches are handed from the reader to the processors through a ring.
+       Default to twice the number of processor threads */
 
-    if ( SaganPassSyslog == NULL )
+    if ( config->ring_size == 0 )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganPassSyslog. Abort!", __FILE__, __LINE__);
+            config->ring_size = config->max_processor_threads * 2;
         }
 
-    memset(SaganPassSyslog, 0, sizeof(struct _Sagan_Pass_Syslog));
+    SaganRing = Sagan_Ring_Init(config->ring_size, config->max_batch);
 
-    SaganPassSyslog_LOCAL = malloc(config->max_processor_threads * sizeof(_Sagan_Pass_Syslog));
+    /* Alerts are handed to the output threads through a queue */
 
-    if ( SaganPassSyslog_LOCAL == NULL )
+    if ( config->output_thread_flag == true )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganPassSyslog_LOCAL. Abort!", __FILE__, __LINE__);
+            Output_Queue_Init();
         }
 
-    memset(SaganPassSyslog_LOCAL, 0, sizeof(struct _Sagan_Pass_Syslog));
-
+    pthread_t output_id[config->output_threads];
+    pthread_attr_t thread_output_attr;
+    pthread_attr_init(&thread_output_attr);
+    pthread_attr_setdetachstate(&thread_output_attr,  PTHREAD_CREATE_DETACHED);
 
     pthread_t processor_id[config->max_processor_threads];
     pthread_attr_t thread_processor_attr;
@@ -744,26 +779,39 @@ int main(int argc, char **argv)
 #endif
 
     Sagan_Log(NORMAL, "Syslog batch: %d", config->max_batch);
+    Sagan_Log(NORMAL, "Batch ring: %" PRIu64 " slots (back-pressure: %s)", SaganRing->queue.size, config->ring_block == true ? "block":"drop");
+
+    if ( config->output_thread_flag == true )
+        {
+            Sagan_Log(NORMAL, "Output threads: %d, alert queue: %" PRIu64 " slots (back-pressure: %s)", config->output_threads, Output_Queue_Size(), config->output_block == true ? "block":"drop");
+        }
 
 
-#ifdef PCRE_HAVE_JIT
+    Sagan_Log(NORMAL, "Content search kernel: %s", Sagan_memmem_Kernel());
 
     if ( config->pcre_jit )
         {
             Sagan_Log(NORMAL, "PCRE JIT is enabled.");
         }
 
-#endif
+    if ( config->pcre_match_limit != 0 || config->pcre_depth_limit != 0 )
+        {
+            Sagan_Log(NORMAL, "PCRE match limit: %u, depth limit: %u", config->pcre_match_limit, config->pcre_depth_limit);
+        }
 
     Sagan_Log(NORMAL, "");
     Sagan_Log(NORMAL, "Sagan version %s is firing up on %s (cluster: %s)", VERSION, config->sagan_sensor_name, config->sagan_cluster_name);
     Sagan_Log(NORMAL, "");
 
+    /* Syslog sockets may need root */
+
+    Sagan_Input_Init();
+
 #ifdef HAVE_LIBPCAP
 
     /* Spawn a thread to 'sniff' syslog traffic (sagan-plog.c).  This redirects syslog
-       traffic to the /dev/log socket.  This needs "root" access,  so we drop priv's
-       after this thread is started */
+       traffic to the /dev/log socket (or straight to the processors with "direct").
+       This needs "root" access,  so we drop priv's after this thread is started */
 
     if ( config->plog_flag )
         {
@@ -784,8 +832,6 @@ int main(int argc, char **argv)
         }
 #endif
 
-
-
     CheckLockFile();
 
     Droppriv();              /* Become the Sagan user */
@@ -794,6 +840,16 @@ int main(int argc, char **argv)
 
     IPC_Init();
 
+    /* Expired flexbits are removed in the background */
+
+    rc = pthread_create( &flexbit_sweep_thread, &thread_flexbit_sweep_attr, (void *)Flexbit_Sweep_Thread, NULL );
+
+    if ( rc != 0 )
+        {
+            Remove_Lock_File();
+            Sagan_Log(ERROR, "[%s, line %d] Error creating flexbit sweeper thread [error: %d].", __FILE__, __LINE__, rc);
+        }
+
     if ( config->perfmonitor_flag )
         {
 
@@ -828,6 +884,21 @@ int main(int argc, char **argv)
 
     Open_Log_File(OPEN, ALERT_LOG);
 
+    /* Alert,  fast and EVE records are buffered (util-writer.c).  This
+       writes them out every "output-flush-time" milliseconds */
+
+    if ( config->output_flush_time > 0 && config->output_buffer_size > 0 )
+        {
+
+            rc = pthread_create( &writer_thread, &thread_writer_attr, (void *)Sagan_Writer_Thread, NULL );
+
+            if ( rc != 0 )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Error creating writer thread [error: %d].", __FILE__, __LINE__, rc);
+                }
+        }
+
     /****************************************************************************
      * Display processor information as we load
      ****************************************************************************/
@@ -899,6 +970,18 @@ int main(int argc, char **argv)
             Sagan_Log(NORMAL, "Bluedot URL Cache Size: %" PRIu64 "", config->bluedot_url_max_cache);
             Sagan_Log(NORMAL, "Bluedot Filename Cache Size: %" PRIu64 "", config->bluedot_filename_max_cache);
             Sagan_Log(NORMAL, "Bluedot JA3 Cache Size: %" PRIu64 "", config->bluedot_ja3_max_cache);
+            Sagan_Log(NORMAL, "Bluedot Connections: %d (lookup timeout: %d seconds)", config->bluedot_max_connections, config->bluedot_lookup_timeout);
+            Sagan_Log(NORMAL, "Bluedot Cache Miss: %s", config->bluedot_miss == BLUEDOT_MISS_DEFER ? "defer" : "fail-open");
+
+            /* Lookups are done in the background so processors never wait on them */
+
+            rc = pthread_create( &bluedot_thread, &thread_bluedot_attr, (void *)Sagan_Bluedot_Thread, NULL );
+
+            if ( rc != 0 )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Error creating Bluedot lookup thread [error: %d].", __FILE__, __LINE__, rc);
+                }
 
         }
 
@@ -969,7 +1052,7 @@ int main(int argc, char **argv)
     Sagan_Log(NORMAL, " \\/)\"(\\/	Version %s", VERSION);
     Sagan_Log(NORMAL, "  (_o_)	Champ Clark III & The Quadrant InfoSec Team [quadrantsec.com]");
     Sagan_Log(NORMAL, "  /   \\/)	Copyright (C) 2009-2019 Quadrant Information Security, et al.");
-    Sagan_Log(NORMAL, " (|| ||) 	Using PCRE version: %s", pcre_version());
+    Sagan_Log(NORMAL, " (|| ||) 	Using PCRE version: %s", Sagan_PCRE_Version());
     Sagan_Log(NORMAL, "  oo-oo");
     Sagan_Log(NORMAL, "");
 
@@ -1037,6 +1120,28 @@ int main(int argc, char **argv)
         }
 #endif
 
+    /* Output threads first so the processors have somewhere to send alerts */
+
+    if ( config->output_thread_flag == true )
+        {
+
+            Sagan_Log(NORMAL, "Spawning %d Output Threads.", config->output_threads);
+
+            for (i = 0; i < config->output_threads; i++)
+                {
+
+                    rc = pthread_create ( &output_id[i], &thread_output_attr, (void *)Output_Queue_Thread, NULL );
+
+                    if ( rc != 0 )
+                        {
+
+                            Remove_Lock_File();
+                            Sagan_Log(ERROR, "Could not pthread_create() for output threads [error: %d]", rc);
+
+                        }
+                }
+        }
+
     Sagan_Log(NORMAL, "Spawning %d Processor Threads.", config->max_processor_threads);
 
     for (i = 0; i < config->max_processor_threads; i++)
@@ -1079,230 +1184,7 @@ int main(int argc, char **argv)
 
     Sagan_Log(NORMAL, "");
 
-    if ( !config->sagan_is_file )
-        {
-
-            Sagan_Log(NORMAL, "Attempting to open syslog FIFO (%s).", config->sagan_fifo);
-
-        }
-    else
-        {
-
-            Sagan_Log(NORMAL, "Attempting to open syslog FILE (%s).", config->sagan_fifo);
-
-        }
-
-
-
-    while(true)
-        {
-
-            FILE *fd;
-
-            if (( fd = fopen(config->sagan_fifo, "r" )) == NULL )
-                {
-
-                    if ( config->sagan_is_file == false )
-                        {
-
-                            /* try to create it */
-
-                            Sagan_Log(NORMAL, "Fifo not found, creating it (%s).", config->sagan_fifo);
-
-                            if (mkfifo(config->sagan_fifo, 0700) == -1)
-                                {
-                                    Remove_Lock_File();
-                                    Sagan_Log(ERROR, "Could not create FIFO '%s'. Abort!", config->sagan_fifo);
-                                }
-
-                            fd = fopen(config->sagan_fifo, "r");
-
-                            if ( fd == NULL )
-                                {
-                                    Remove_Lock_File();
-                                    Sagan_Log(ERROR, "Error opening %s. Abort!", config->sagan_fifo);
-                                }
-
-                        }
-                    else
-                        {
-                            Remove_Lock_File();
-                            Sagan_Log(ERROR, "Could not open file '%s'. Abort!", config->sagan_fifo);
-                        }
-
-                }
-
-            if ( config->sagan_is_file == false )
-                {
-                    Sagan_Log(NORMAL, "Successfully opened FIFO (%s).", config->sagan_fifo);
-
-#if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
-
-                    Set_Pipe_Size(fd);
-
-#endif
-
-                }
-            else
-                {
-                    Sagan_Log(NORMAL, "Successfully opened FILE (%s) and processing events.....", config->sagan_fifo);
-                }
-
-            while(fd != NULL)
-                {
-
-
-                    clearerr( fd );
-
-                    while(fgets(syslogstring, MAX_SYSLOGMSG, fd) != NULL)
-                        {
-
-                            /* If the FIFO was in a error state,  let user know the FIFO writer has resumed */
-
-                            if ( fifoerr == true )
-                                {
-
-                                    Sagan_Log(NORMAL, "FIFO writer has restarted. Processing events.");
-
-#if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
-
-                                    Set_Pipe_Size(fd);
-
-#endif
-                                    fifoerr = false;
-                                }
-
-                            __atomic_add_fetch(&counters->events_received, 1, __ATOMIC_SEQ_CST);
-
-                            /* Copy log line to batch/queue if we haven't reached our batch limit */
-
-                            if ( batch_count <= config->max_batch )
-                                {
-
-                                    if (debug->debugsyslog)
-                                        {
-                                            Sagan_Log(DEBUG, "[%s, line %d] [batch position %d] Raw log: %s",  __FILE__, __LINE__, batch_count, syslogstring);
-                                        }
-
-                                    /* Check for "drop" to save CPU from "ignore list" */
-
-                                    if ( config->sagan_droplist_flag )
-                                        {
-
-                                            ignore_flag = false;
-
-                                            for (i = 0; i < counters->droplist_count; i++)
-                                                {
-
-                                                    if (Sagan_strstr(syslogstring, SaganIgnorelist[i].ignore_string))
-                                                        {
-                                                            __atomic_add_fetch(&counters->ignore_count, 1, __ATOMIC_SEQ_CST);
-                                                            ignore_flag = true;
-                                                            break;
-
-                                                        }
-                                                }
-
-
-                                        }
-
-                                    /* Add to batch */
-
-                                    if ( ignore_flag == false )
-                                        {
-
-                                            /* Copy data to _LOCAL array */
-
-                                            strlcpy(SaganPassSyslog_LOCAL[proc_msgslot].syslog[batch_count], syslogstring, sizeof(SaganPassSyslog_LOCAL[proc_msgslot].syslog[batch_count]));
-
-                                            batch_count++;
-                                        }
-
-                                }
-
-                            /* Do we have enough threads? */
-
-
-                            if ( proc_msgslot < config->max_processor_threads )
-                                {
-
-                                    /* Has our batch count been reached */
-
-                                    if ( batch_count >= config->max_batch )
-                                        {
-
-                                            batch_count=0;              /* Reset batch/queue */
-
-                                            pthread_mutex_lock(&SaganProcWorkMutex);
-
-                                            /* Copy local thread data to global thread */
-
-                                            for ( i = 0; i < config->max_batch; i++)
-                                                {
-                                                    strlcpy(SaganPassSyslog[proc_msgslot].syslog[i], SaganPassSyslog_LOCAL[proc_msgslot].syslog[i], sizeof(SaganPassSyslog[proc_msgslot].syslog[i]));
-                                                }
-
-                                            counters->events_processed = counters->events_processed + config->max_batch;
-
-                                            proc_msgslot++;
-
-                                            /* Send work to thread */
-
-                                            pthread_cond_signal(&SaganProcDoWork);
-                                            pthread_mutex_unlock(&SaganProcWorkMutex);
-                                        }
-
-                                }
-                            else
-                                {
-
-                                    /* If there's no thread, we lose the entire batch */
-
-                                    counters->worker_thread_exhaustion = counters->worker_thread_exhaustion + config->max_batch; ;
-                                    batch_count = 0;
-                                }
-
-                        } /* while(fgets) */
-
-                    /* fgets() has returned a error,  likely due to the FIFO writer leaving */
-
-                    if ( fifoerr == false )
-                        {
-
-                            if ( config->sagan_is_file != 0 )
-                                {
-                                    Sagan_Log(NORMAL, "EOF reached. Waiting for threads to catch up....");
-                                    Sagan_Log(NORMAL, "");
-
-                                    while(proc_msgslot != 0 || proc_running != 0)
-                                        {
-                                            Sagan_Log(NORMAL, "Waiting on %d/%d threads....", proc_msgslot, proc_running);
-                                            sleep(1);
-                                        }
-
-                                    fclose(fd);
-                                    Statistics();
-                                    Remove_Lock_File();
-
-                                    Sagan_Log(NORMAL, "Exiting.");
-                                    exit(0);
-
-                                }
-                            else
-                                {
-
-                                    Sagan_Log(WARN, "FIFO writer closed.  Waiting for FIFO writer to restart....");
-                                    clearerr(fd);
-                                    fifoerr = true; 			/* Set flag so our wile(fgets) knows */
-                                }
-                        }
-                    sleep(1);		/* So we don't eat 100% CPU */
-
-                } /* while(fd != NULL)  */
-
-            fclose(fd); 			/* ???? */
-
-        } /* End of while(1) */
+    Sagan_Input_Run();
 
 } /* End of main */
 
@@ -32,12 +32,12 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
-#include <pcre.h>
 #include <time.h>
 #include <arpa/inet.h>
 #include <stdbool.h>
 
 #include "sagan-defs.h"
+#include "util-pcre.h"
 
 #ifdef HAVE_LIBMAXMINDDB
 #include <maxminddb.h>
@@ -127,6 +127,8 @@ void      Strip_Chars(const char *string, const char *chars, char *str);
 bool     Is_IP (char *ipaddr, int ver);
 bool     File_Lock ( int );
 bool     File_Unlock ( int );
+bool     File_Lock_Range ( int, off_t, off_t );
+bool     File_Unlock_Range ( int, off_t, off_t );
 bool     Check_Content_Not( char * );
 uint32_t  Djb2_Hash( char * );
 bool     Starts_With(const char *str, const char *prefix);
@@ -134,7 +136,7 @@ char      *strrpbrk(const char *str, const char *accept);
 bool Is_IP_Range (char *str);
 
 #if defined(F_GETPIPE_SZ) && defined(F_SETPIPE_SZ)
-void      Set_Pipe_Size( FILE * );
+void      Set_Pipe_Size( int );
 #endif
 
 
@@ -178,43 +180,20 @@ struct _Sagan_IPC_Counters
 
 };
 
+/* Gauges and load time counts.  Counters bumped per event live in
+   _Sagan_Counter_Shard (see util-counters.c) */
+
 typedef struct _SaganCounters _SaganCounters;
 struct _SaganCounters
 {
 
-    uint64_t threshold_total;
-    uint64_t after_total;
-    uint64_t events_received;
-    uint64_t events_processed;
-    uint64_t saganfound;
-    uint64_t sagan_output_drop;
     uint64_t sagan_processor_drop;
-    uint64_t sagan_log_drop;
     uint64_t dns_cache_count;
-    uint64_t dns_miss_count;
     uint64_t fwsam_count;
-    uint64_t ignore_count;
     uint64_t blacklist_count;
 
-    uint64_t alert_total;
-
-    uint64_t malformed_host;
-    uint64_t malformed_facility;
-    uint64_t malformed_priority;
-    uint64_t malformed_level;
-    uint64_t malformed_tag;
-    uint64_t malformed_date;
-    uint64_t malformed_time;
-    uint64_t malformed_program;
-    uint64_t malformed_message;
-
-    uint64_t worker_thread_exhaustion;
-
     int	     ruleset_track_count;
 
-    uint64_t blacklist_hit_count;
-    uint64_t blacklist_lookup_count;
-
     uint32_t client_stats_count;
 
     int	     thread_output_counter;
@@ -252,21 +231,16 @@ struct _SaganCounters
 
     int	      rules_loaded_count;
 
-    uint64_t follow_flow_total;	 /* This will only be needed if follow_flow is an option */
-    uint64_t follow_flow_drop;   /* Amount of flows that did not match and were dropped */
-
 #ifdef HAVE_LIBMAXMINDDB
-    uint64_t geoip2_hit;				/* GeoIP hit count */
-    uint64_t geoip2_lookup;				/* Total lookups */
-    uint64_t geoip2_error;				/* Lookup Errors */
     int	     geoip_skip_count;
 #endif
 
 #ifdef WITH_BLUEDOT
     uint64_t bluedot_ip_cache_count;                      /* Bluedot cache processor */
-    uint64_t bluedot_ip_cache_hit;                        /* Bluedot hit's from Cache */
-    uint64_t bluedot_ip_positive_hit;
-    uint64_t bluedot_ip_total;
+    uint64_t bluedot_hash_cache_count;
+    uint64_t bluedot_url_cache_count;
+    uint64_t bluedot_filename_cache_count;
+    uint64_t bluedot_ja3_cache_count;
 
     int      bluedot_skip_count;
 
@@ -278,57 +252,17 @@ struct _SaganCounters
 
     uint64_t bluedot_mdate;					   /* Hits , but where over a modification date */
     uint64_t bluedot_cdate;            	                   /* Hits , but where over a creation date */
-    uint64_t bluedot_mdate_cache;                                 /* Hits from cache , but where over a modification date */
-    uint64_t bluedot_cdate_cache;      			   /* Hits from cache , but where over a create date */
-    uint64_t bluedot_error_count;
-
-    uint64_t bluedot_hash_cache_count;
-    uint64_t bluedot_hash_cache_hit;
-    uint64_t bluedot_hash_positive_hit;
-    uint64_t bluedot_hash_total;
-
-    uint64_t bluedot_url_cache_count;
-    uint64_t bluedot_url_cache_hit;
-    uint64_t bluedot_url_positive_hit;
-    uint64_t bluedot_url_total;
-
-    uint64_t bluedot_filename_cache_count;
-    uint64_t bluedot_filename_cache_hit;
-    uint64_t bluedot_filename_positive_hit;
-    uint64_t bluedot_filename_total;
-
-    uint64_t bluedot_ja3_cache_count;
-    uint64_t bluedot_ja3_cache_hit;
-    uint64_t bluedot_ja3_positive_hit;
-    uint64_t bluedot_ja3_total;
 
+    int      bluedot_deferred_ready;			   /* Deferred events ready to re-run */
 
     int bluedot_cat_count;
 
 #endif
 
-
-#ifdef HAVE_LIBESMTP
-    uint64_t esmtp_count_success;
-    uint64_t esmtp_count_failed;
-#endif
-
-#ifdef HAVE_LIBHIREDIS
-    uint64_t redis_writer_threads_drop;
-#endif
-
 #ifdef HAVE_LIBFASTJSON
     int json_message_map;
-
-    uint64_t json_input_count;
-    uint64_t malformed_json_input_count;
-
-    uint64_t json_mp_count;
-    uint64_t malformed_json_mp_count;
-
 #endif
 
-
 };
 
 typedef struct _SaganDebug _SaganDebug;
@@ -418,12 +352,6 @@ struct _Sagan_Proc_Syslog
 
 };
 
-typedef struct _Sagan_Pass_Syslog _Sagan_Pass_Syslog;
-struct _Sagan_Pass_Syslog
-{
-    char syslog[MAX_SYSLOG_BATCH][MAX_SYSLOGMSG];
-};
-
 
 #ifdef HAVE_LIBFASTJSON
 
@@ -535,6 +463,7 @@ typedef struct _Threshold2_IPC _Threshold2_IPC;
 struct _Threshold2_IPC
 {
 
+    bool used;				/* Slot has held an entry (never reset) */
     uint32_t hash;
 
     bool threshold2_method_src;
@@ -556,7 +485,7 @@ struct _Threshold2_IPC
     uint64_t utime;
     uint64_t sid;
     int expire;
-    char syslog_message[MAX_SYSLOGMSG];
+    char syslog_message[MAX_IPC_SYSLOGMSG];	/* Truncated copy for saganpeek */
     char signature_msg[MAX_SAGAN_MSG];
 };
 
@@ -565,6 +494,7 @@ typedef struct _After2_IPC _After2_IPC;
 struct _After2_IPC
 {
 
+    bool used;				/* Slot has held an entry (never reset) */
     uint32_t hash;
 
     bool after2_method_src;
@@ -588,7 +518,7 @@ struct _After2_IPC
     uint32_t rev;
 
     int expire;
-    char syslog_message[MAX_SYSLOGMSG];
+    char syslog_message[MAX_IPC_SYSLOGMSG];	/* Truncated copy for saganpeek */
     char signature_msg[MAX_SAGAN_MSG];
 };
 
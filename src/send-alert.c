@@ -29,28 +29,33 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+
 #include "sagan.h"
+#include "sagan-config.h"
 #include "version.h"
 
 #include "output.h"
+#include "util-mpmc.h"
+#include "output-queue.h"
 #include "gen-msg.h"
 
 #include "processors/engine.h"
 
 struct _SaganConfig *config;
 
+/* Each processor thread builds its alerts here rather than malloc()'ing
+   an event per alert.  The event only lives until Output() or
+   Output_Queue_Send() returns */
+
+static __thread struct _Sagan_Event SaganProcessorEvent_Thread;
+
 void Send_Alert ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, json_object *json_normalize, _Sagan_Processor_Info *processor_info, char *ip_src, char *ip_dst, char *normalize_http_uri, char *normalize_http_hostname, int proto, uint64_t sid, int src_port, int dst_port, int pos, struct timeval tp, char *bluedot_json, unsigned char bluedot_results  )
 {
 
     char tmp[64] = { 0 };
 
-    struct _Sagan_Event *SaganProcessorEvent = NULL;
-    SaganProcessorEvent = malloc(sizeof(struct _Sagan_Event));
-
-    if ( SaganProcessorEvent == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganProcessorEvent. Abort!", __FILE__, __LINE__);
-        }
+    struct _Sagan_Event *SaganProcessorEvent = &SaganProcessorEvent_Thread;
 
     memset(SaganProcessorEvent, 0, sizeof(_Sagan_Event));
 
@@ -107,8 +112,17 @@ void Send_Alert ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, json_object *json_n
     SaganProcessorEvent->flow_id	    =    SaganProcSyslog_LOCAL->flow_id;
 
 
-    Output ( SaganProcessorEvent );
-    free(SaganProcessorEvent);
+    /* With "output-threads" the alert is copied to the output queue and
+       written by an output thread */
+
+    if ( config->output_thread_flag == true )
+        {
+            Output_Queue_Send( SaganProcessorEvent );
+        }
+    else
+        {
+            Output ( SaganProcessorEvent );
+        }
 
 }
 
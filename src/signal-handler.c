@@ -58,8 +58,13 @@
 
 #include "processors/perfmon.h"
 #include "rules.h"
+#include "meta-content.h"
 #include "ignore-list.h"
 #include "flow.h"
+#include "util-radix.h"
+#include "util-mpmc.h"
+#include "output-queue.h"
+#include "util-writer.h"
 
 #include "processors/blacklist.h"
 #include "processors/track-clients.h"
@@ -75,12 +80,12 @@ int liblognorm_count;
 #ifdef HAVE_LIBMAXMINDDB
 #include <maxminddb.h>
 #include "geoip.h"
-struct _Sagan_GeoIP_Skip *GeoIP_Skip;
+struct _Sagan_Radix *GeoIP_Skip;
 #endif
 
 #ifdef WITH_BLUEDOT
 #include "processors/bluedot.h"
-struct _Sagan_Bluedot_Skip *Bluedot_Skip;
+struct _Sagan_Radix *Bluedot_Skip;
 #endif
 
 #define MAX_DEATH_TIME 15
@@ -92,21 +97,11 @@ struct _Rule_Struct *rulestruct;
 struct _Rules_Loaded *rules_loaded;
 struct _Class_Struct *classstruct;
 struct _Sagan_Processor_Generator *generator;
-struct _Sagan_Blacklist *SaganBlacklist;
 struct _Sagan_Track_Clients *SaganTrackClients;
 struct _SaganVar *var;
 
 struct _Sagan_Ignorelist *SaganIgnorelist;
 
-struct _Sagan_BroIntel_Intel_Addr *Sagan_BroIntel_Intel_Addr;
-struct _Sagan_BroIntel_Intel_Domain *Sagan_BroIntel_Intel_Domain;
-struct _Sagan_BroIntel_Intel_File_Hash *Sagan_BroIntel_Intel_File_Hash;
-struct _Sagan_BroIntel_Intel_URL *Sagan_BroIntel_Intel_URL;
-struct _Sagan_BroIntel_Intel_Software *Sagan_BroIntel_Intel_Software;
-struct _Sagan_BroIntel_Intel_Email *Sagan_BroIntel_Intel_Email;
-struct _Sagan_BroIntel_Intel_User_Name *Sagan_BroIntel_Intel_User_Name;
-struct _Sagan_BroIntel_Intel_File_Name *Sagan_BroIntel_Intel_File_Name;
-struct _Sagan_BroIntel_Intel_Cert_Hash *Sagan_BroIntel_Intel_Cert_Hash;
 
 pthread_mutex_t SaganReloadMutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t SaganReloadCond = PTHREAD_COND_INITIALIZER;
@@ -123,6 +118,7 @@ void Sig_Handler( void )
 
     sigset_t signal_set;
     int sig;
+    int i;
     bool orig_perfmon_value = 0;
     unsigned char max_death_time = 0;
 
@@ -180,6 +176,14 @@ void Sig_Handler( void )
                             Sagan_Log(WARN, "Not all threads stopped.  Forcing abort!");
                         }
 
+                    /* Write out alerts still waiting on the output threads */
+
+                    Output_Queue_Drain();
+
+                    /* Buffered alert,  fast and EVE records */
+
+                    Sagan_Writer_Flush_All();
+
                     Statistics();
 
 #ifdef HAVE_LIBMAXMINDDB
@@ -297,6 +301,11 @@ void Sig_Handler( void )
 
                     Sagan_Log(NORMAL, "[Reloading Sagan version %s.]-------", VERSION);
 
+                    /* Queued alerts point at rules and log files we're about to
+                       reset/re-open */
+
+                    Output_Queue_Drain();
+
                     /*
                     * Close and re-open log files.  This is for logrotate and such
                     * 04/14/2015 - Champ Clark III (cclark@quadrantsec.com)
@@ -304,6 +313,15 @@ void Sig_Handler( void )
 
                     Open_Log_File(REOPEN, ALL_LOGS);
 
+                    /* Compiled meta_content matchers are rebuilt as the rules reload.
+                       Processors still mid-batch may be searching with the old
+                       ones,  they are freed once those events finish */
+
+                    for ( i = 0; i < counters->rulecount; i++ )
+                        {
+                            Meta_Content_Free(i);
+                        }
+
                     /******************/
                     /* Reset counters */
                     /******************/
@@ -353,26 +371,15 @@ void Sig_Handler( void )
 
                     /* Multi Threaded processors */
 
-                    config->blacklist_flag = 0;
-
-                    if ( config->blacklist_flag )
-                        {
-                            free(SaganBlacklist);
-                        }
+                    /* The blacklist stays in use until its replacement is
+                       built (see Sagan_Blacklist_Reload()) */
 
                     config->blacklist_flag = 0;
 
                     if ( config->brointel_flag )
                         {
-                            free(Sagan_BroIntel_Intel_Addr);
-                            free(Sagan_BroIntel_Intel_Domain);
-                            free(Sagan_BroIntel_Intel_File_Hash);
-                            free(Sagan_BroIntel_Intel_URL);
-                            free(Sagan_BroIntel_Intel_Software);
-                            free(Sagan_BroIntel_Intel_Email);
-                            free(Sagan_BroIntel_Intel_User_Name);
-                            free(Sagan_BroIntel_Intel_File_Name);
-                            free(Sagan_BroIntel_Intel_Cert_Hash);
+                            /* The intel data stays in use until Sagan_BroIntel_Load_File()
+                               replaces it */
 
                             __atomic_store_n (&counters->brointel_addr_count, 0, __ATOMIC_SEQ_CST);
                             __atomic_store_n (&counters->brointel_domain_count, 0, __ATOMIC_SEQ_CST);
@@ -389,6 +396,7 @@ void Sig_Handler( void )
                         }
 
                     config->brointel_flag = 0;
+                    config->brointel_cache[0] = '\0';
 
                     if ( config->sagan_track_clients_flag )
                         {
@@ -410,15 +418,13 @@ void Sig_Handler( void )
 
 #ifdef HAVE_LIBMAXMINDDB
 
-                    /* GeoIP skip */
+                    /* GeoIP skip.  The YAML loader swaps in the new tree */
                     __atomic_store_n (&counters->geoip_skip_count, 0, __ATOMIC_SEQ_CST);
-                    memset(GeoIP_Skip, 0, sizeof(_Sagan_GeoIP_Skip));
 #endif
 
 
 #ifdef WITH_BLUEDOT
                     __atomic_store_n (&counters->bluedot_skip_count, 0, __ATOMIC_SEQ_CST);
-                    memset(Bluedot_Skip, 0, sizeof(_Sagan_Bluedot_Skip));
 #endif
 
                     /* Non-output / Processors */
@@ -441,6 +447,22 @@ void Sig_Handler( void )
                     /* Re-load primary configuration (rules/classifictions/etc) */
                     /************************************************************/
 
+                    /* "skip_networks" was removed from the configuration */
+
+#ifdef HAVE_LIBMAXMINDDB
+                    if ( counters->geoip_skip_count == 0 && GeoIP_Skip != NULL && GeoIP_Skip->count != 0 )
+                        {
+                            Sagan_Radix_Swap(&GeoIP_Skip, Sagan_Radix_Init());
+                        }
+#endif
+
+#ifdef WITH_BLUEDOT
+                    if ( counters->bluedot_skip_count == 0 && Bluedot_Skip != NULL && Bluedot_Skip->count != 0 )
+                        {
+                            Sagan_Radix_Swap(&Bluedot_Skip, Sagan_Radix_Init());
+                        }
+#endif
+
                     if ( config->perfmonitor_flag == 1 )
                         {
                             if ( orig_perfmon_value == 1 )
@@ -475,9 +497,7 @@ void Sig_Handler( void )
 
                     if ( config->blacklist_flag )
                         {
-                            __atomic_store_n (&counters->blacklist_count, 0, __ATOMIC_SEQ_CST);
-                            Sagan_Blacklist_Init();
-                            Sagan_Blacklist_Load();
+                            Sagan_Blacklist_Reload();
                         }
 
                     if ( config->brointel_flag )
@@ -38,26 +38,122 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "stats.h"
+#include "input-reactor.h"
 #include "rules.h"
 #include "sagan-config.h"
+#include "util-counters.h"
+#include "util-time.h"
 
 #include "processors/client-stats.h"
 
+#ifdef WITH_BLUEDOT
+#include "processors/bluedot.h"
+#endif
+
 
 struct _SaganCounters *counters;
 struct _Sagan_IPC_Counters *counters_ipc;
 struct _Sagan_Ruleset_Track *Ruleset_Track;
 struct _SaganConfig *config;
+struct _Rule_Struct *rulestruct;
 
 int proc_running; 	/* Count of executing threads */
 
-void Statistics( void )
+#define STATS_PCRE_TOP 5
+
+/* With "pcre-timing" enabled,  prints the rules that have spent the most
+   time in pcre */
+
+static void Statistics_PCRE_Timing( void )
 {
 
-    char timet[20];
+    int top[STATS_PCRE_TOP];
+    int top_count = 0;
+    int i;
+    int j;
+
+    for ( i = 0; i < counters->rulecount; i++ )
+        {
+
+            if ( rulestruct[i].pcre_exec_count == 0 )
+                {
+                    continue;
+                }
+
+            for ( j = top_count; j > 0 && rulestruct[top[j-1]].pcre_exec_nsec < rulestruct[i].pcre_exec_nsec; j-- )
+                {
+
+                    if ( j < STATS_PCRE_TOP )
+                        {
+                            top[j] = top[j-1];
+                        }
+                }
+
+            if ( j < STATS_PCRE_TOP )
+                {
+                    top[j] = i;
+
+                    if ( top_count < STATS_PCRE_TOP )
+                        {
+                            top_count++;
+                        }
+                }
+        }
+
+    for ( i = 0; i < top_count; i++ )
+        {
+            Sagan_Log(NORMAL, "           Slowest PCRE #%d            : sid %" PRIu64 ", %" PRIu64 " runs, avg %.3fus, total %.3fms", i + 1, rulestruct[top[i]].s_sid, rulestruct[top[i]].pcre_exec_count, (double)rulestruct[top[i]].pcre_exec_nsec / rulestruct[top[i]].pcre_exec_count / 1000, (double)rulestruct[top[i]].pcre_exec_nsec / 1000000);
+        }
+}
+
+#ifdef WITH_BLUEDOT
+
+/* Prints one Bluedot lookup latency histogram,  up to the slowest bucket
+   that has anything in it */
+
+static void Statistics_Bluedot_Latency( const struct _Sagan_Counter_Shard *sum, const char *name, int type )
+{
+
+    const char *bucket_name[BLUEDOT_LATENCY_BUCKETS] = { "<1ms", "<2ms", "<4ms", "<8ms", "<16ms", "<32ms", "<64ms", "<128ms", "<256ms", "<512ms", "<1s", "<2s", "<4s", "<8s", "<16s", ">=16s" };
+
+    char histogram[512] = { 0 };
+    char tmp[32] = { 0 };
+
+    uint64_t lookups = 0;
+    int last = -1;
+    int i;
+
+    for ( i = 0; i < BLUEDOT_LATENCY_BUCKETS; i++ )
+        {
+
+            lookups = lookups + sum->bluedot_latency[type-1][i];
+
+            if ( sum->bluedot_latency[type-1][i] != 0 )
+                {
+                    last = i;
+                }
+        }
+
+    if ( lookups == 0 )
+        {
+            return;
+        }
+
+    for ( i = 0; i <= last; i++ )
+        {
+            snprintf(tmp, sizeof(tmp), "%s%s: %" PRIu64 "", i == 0 ? "" : ", ", bucket_name[i], sum->bluedot_latency[type-1][i]);
+            strlcat(histogram, tmp, sizeof(histogram));
+        }
+
+    Sagan_Log(NORMAL, "          %-8s lookup latency         : avg %.3fms [%s]", name, (double)sum->bluedot_latency_usec[type-1] / lookups / 1000, histogram);
+
+}
+
+#endif
+
+void Statistics( void )
+{
 
-    time_t t;
-    struct tm *now;
     int seconds = 0;
     unsigned long total=0;
     int i;
@@ -70,6 +166,8 @@ void Statistics( void )
     int uptime_minutes;
     int uptime_seconds;
 
+    struct _Sagan_Counter_Shard sum;
+
 #ifdef WITH_BLUEDOT
     unsigned long bluedot_ip_total=0;
     unsigned long bluedot_hash_total=0;
@@ -79,25 +177,24 @@ void Statistics( void )
 #endif
 
 
+    Sagan_Counter_Sum(&sum);
+
     /* This is used to calulate the events per/second */
     /* Champ Clark III - 11/17/2011 */
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-    seconds = atol(timet) - atol(config->sagan_startutime);
+    seconds = Return_Epoch() - atol(config->sagan_startutime);
 
     /* if statement prevents floating point exception */
 
     if ( seconds != 0 )
         {
-            total = counters->events_received / seconds;
+            total = sum.events_received / seconds;
 
 #ifdef WITH_BLUEDOT
-            bluedot_ip_total = counters->bluedot_ip_total / seconds;
-            bluedot_hash_total = counters->bluedot_hash_total / seconds;
-            bluedot_url_total = counters->bluedot_url_total / seconds;
-            bluedot_filename_total = counters->bluedot_filename_total / seconds;
+            bluedot_ip_total = sum.bluedot_ip_total / seconds;
+            bluedot_hash_total = sum.bluedot_hash_total / seconds;
+            bluedot_url_total = sum.bluedot_url_total / seconds;
+            bluedot_filename_total = sum.bluedot_filename_total / seconds;
 #endif
 
         }
@@ -109,39 +206,62 @@ void Statistics( void )
 
             Sagan_Log(NORMAL, " ,-._,-.  -[ Sagan Version %s - Engine Statistics ]-", VERSION);
             Sagan_Log(NORMAL, " \\/)\"(\\/");
-            Sagan_Log(NORMAL, "  (_o_)    Received/Processed/Ignored : %" PRIu64 "/%" PRIu64 "/%" PRIu64 " (%.3f%%/%.3f%%)", counters->events_received, counters->events_processed, counters->ignore_count, CalcPct(counters->events_processed, counters->events_received), CalcPct(counters->ignore_count, counters->events_received));
-            Sagan_Log(NORMAL, "  /   \\/)  Signatures matched         : %" PRIu64 " (%.3f%%)", counters->saganfound, CalcPct(counters->saganfound, counters->events_received ) );
-            Sagan_Log(NORMAL, " (|| ||)   Alerts                     : %" PRIu64 " (%.3f%%)",  counters->alert_total, CalcPct( counters->alert_total, counters->events_received) );
-            Sagan_Log(NORMAL, "  oo-oo    After                      : %" PRIu64 " (%.3f%%)",  counters->after_total, CalcPct( counters->after_total, counters->events_received) );
-            Sagan_Log(NORMAL, "           Threshold                  : %" PRIu64 " (%.3f%%)", counters->threshold_total, CalcPct( counters->threshold_total, counters->events_received) );
-            Sagan_Log(NORMAL, "           Dropped                    : %" PRIu64 " (%.3f%%)", counters->sagan_processor_drop + counters->sagan_output_drop + counters->sagan_log_drop, CalcPct(counters->sagan_processor_drop + counters->sagan_output_drop + counters->sagan_log_drop, counters->events_received) );
+            Sagan_Log(NORMAL, "  (_o_)    Received/Processed/Ignored : %" PRIu64 "/%" PRIu64 "/%" PRIu64 " (%.3f%%/%.3f%%)", sum.events_received, sum.events_processed, sum.ignore_count, CalcPct(sum.events_processed, sum.events_received), CalcPct(sum.ignore_count, sum.events_received));
+            Sagan_Log(NORMAL, "  /   \\/)  Signatures matched         : %" PRIu64 " (%.3f%%)", sum.saganfound, CalcPct(sum.saganfound, sum.events_received ) );
+            Sagan_Log(NORMAL, " (|| ||)   Alerts                     : %" PRIu64 " (%.3f%%)",  sum.alert_total, CalcPct( sum.alert_total, sum.events_received) );
+            Sagan_Log(NORMAL, "  oo-oo    After                      : %" PRIu64 " (%.3f%%)",  sum.after_total, CalcPct( sum.after_total, sum.events_received) );
+            Sagan_Log(NORMAL, "           Threshold                  : %" PRIu64 " (%.3f%%)", sum.threshold_total, CalcPct( sum.threshold_total, sum.events_received) );
+            Sagan_Log(NORMAL, "           Dropped                    : %" PRIu64 " (%.3f%%)", counters->sagan_processor_drop + sum.sagan_output_drop + sum.sagan_log_drop, CalcPct(counters->sagan_processor_drop + sum.sagan_output_drop + sum.sagan_log_drop, sum.events_received) );
 
-//        Sagan_Log(NORMAL, "           Malformed                : h:%" PRIu64 "|f:%" PRIu64 "|p:%" PRIu64 "|l:%" PRIu64 "|T:%" PRIu64 "|d:%" PRIu64 "|T:%" PRIu64 "|P:%" PRIu64 "|M:%" PRIu64 "", counters->malformed_host, counters->malformed_facility, counters->malformed_priority, counters->malformed_level, counters->malformed_tag, counters->malformed_date, counters->malformed_time, counters->malformed_program, counters->malformed_message);
+//        Sagan_Log(NORMAL, "           Malformed                : h:%" PRIu64 "|f:%" PRIu64 "|p:%" PRIu64 "|l:%" PRIu64 "|T:%" PRIu64 "|d:%" PRIu64 "|T:%" PRIu64 "|P:%" PRIu64 "|M:%" PRIu64 "", sum.malformed_host, sum.malformed_facility, sum.malformed_priority, sum.malformed_level, sum.malformed_tag, sum.malformed_date, sum.malformed_time, sum.malformed_program, sum.malformed_message);
 
-            Sagan_Log(NORMAL, "           Thread Exhaustion          : %" PRIu64 " (%.3f%%)", counters->worker_thread_exhaustion,  CalcPct( counters->worker_thread_exhaustion, counters->events_received) );
+            Sagan_Log(NORMAL, "           Thread Exhaustion          : %" PRIu64 " (%.3f%%)", sum.worker_thread_exhaustion,  CalcPct( sum.worker_thread_exhaustion, sum.events_received) );
 
             Sagan_Log(NORMAL, "           Thread Usage               : %d/%d (%.3f%%)", proc_running, config->max_processor_threads, CalcPct( proc_running, config->max_processor_threads ));
 
+            if ( config->ring_block == true )
+                {
+                    Sagan_Log(NORMAL, "           Ring Full (reader waited)  : %" PRIu64 "", sum.ring_full_wait);
+                }
+
+            Sagan_Input_Statistics();
+
+            if ( sum.rule_index_events != 0 )
+                {
+                    Sagan_Log(NORMAL, "           Avg. Rule Candidates/Event : %.3f of %d", (double)sum.rule_index_candidates / (double)sum.rule_index_events, counters->rulecount);
+                    Sagan_Log(NORMAL, "           Avg. Parser Runs/Event     : ip %.3f, hash %.3f, proto %.3f, ip2bit %.3f", (double)sum.engine_parse_ip / (double)sum.rule_index_events, (double)sum.engine_parse_hash / (double)sum.rule_index_events, (double)sum.engine_parse_proto / (double)sum.rule_index_events, (double)sum.engine_ip2bit / (double)sum.rule_index_events);
+                }
+
+            if ( sum.pcre_limit != 0 || sum.pcre_error != 0 )
+                {
+                    Sagan_Log(NORMAL, "           PCRE Limit/Error           : %" PRIu64 "/%" PRIu64 "", sum.pcre_limit, sum.pcre_error);
+                }
+
+            if ( config->pcre_timing == true )
+                {
+                    Statistics_PCRE_Timing();
+                }
+
             /*
                         if (config->sagan_droplist_flag)
                             {
-                                Sagan_Log(NORMAL, "           Ignored Input            : %" PRIu64 " (%.3f%%)", counters->ignore_count, CalcPct(counters->ignore_count, counters->events_received) );
+                                Sagan_Log(NORMAL, "           Ignored Input            : %" PRIu64 " (%.3f%%)", sum.ignore_count, CalcPct(sum.ignore_count, sum.events_received) );
                             }*/
 
 #ifdef HAVE_LIBFASTJSON
             if ( config->parse_json_program == true || config->parse_json_message == true )
                 {
-                    Sagan_Log(NORMAL, "           JSON Input                 : %" PRIu64 " (%.3f%%)", counters->json_input_count, CalcPct( counters->json_input_count, counters->events_received) );
-                    Sagan_Log(NORMAL, "           JSON Program/Message       : %" PRIu64 " (%.3f%%)", counters->json_mp_count, CalcPct( counters->json_mp_count, counters->events_received) );
+                    Sagan_Log(NORMAL, "           JSON Input                 : %" PRIu64 " (%.3f%%)", sum.json_input_count, CalcPct( sum.json_input_count, sum.events_received) );
+                    Sagan_Log(NORMAL, "           JSON Program/Message       : %" PRIu64 " (%.3f%%)", sum.json_mp_count, CalcPct( sum.json_mp_count, sum.events_received) );
 
                 }
 
 #endif
 
 #ifdef HAVE_LIBMAXMINDDB
-            Sagan_Log(NORMAL, "           GeoIP Hits:                : %" PRIu64 " (%.3f%%)", counters->geoip2_hit, CalcPct( counters->geoip2_hit, counters->events_received) );
-            Sagan_Log(NORMAL, "           GeoIP Lookups:             : %" PRIu64 "", counters->geoip2_lookup);
-            Sagan_Log(NORMAL, "           GeoIP Errors               : %" PRIu64 "", counters->geoip2_error);
+            Sagan_Log(NORMAL, "           GeoIP Hits:                : %" PRIu64 " (%.3f%%)", sum.geoip2_hit, CalcPct( sum.geoip2_hit, sum.events_received) );
+            Sagan_Log(NORMAL, "           GeoIP Lookups:             : %" PRIu64 "", sum.geoip2_lookup);
+            Sagan_Log(NORMAL, "           GeoIP Errors               : %" PRIu64 "", sum.geoip2_error);
 #
 
 #endif
@@ -179,22 +299,22 @@ void Statistics( void )
             Sagan_Log(NORMAL, "");
             Sagan_Log(NORMAL, "          -[ Sagan Malformed Data Statistics ]-");
             Sagan_Log(NORMAL, "");
-            Sagan_Log(NORMAL, "           Host                       : %" PRIu64 " (%.3f%%)", counters->malformed_host, CalcPct(counters->malformed_host, counters->events_received) );
-            Sagan_Log(NORMAL, "           Facility                   : %" PRIu64 " (%.3f%%)", counters->malformed_facility, CalcPct(counters->malformed_facility, counters->events_received) );
-            Sagan_Log(NORMAL, "           Priority                   : %" PRIu64 " (%.3f%%)", counters->malformed_priority, CalcPct(counters->malformed_priority, counters->events_received) );
-            Sagan_Log(NORMAL, "           Level                      : %" PRIu64 " (%.3f%%)", counters->malformed_level, CalcPct(counters->malformed_level, counters->events_received) );
-            Sagan_Log(NORMAL, "           Tag                        : %" PRIu64 " (%.3f%%)", counters->malformed_tag, CalcPct(counters->malformed_tag, counters->events_received) );
-            Sagan_Log(NORMAL, "           Date                       : %" PRIu64 " (%.3f%%)", counters->malformed_date, CalcPct(counters->malformed_date, counters->events_received) );
-            Sagan_Log(NORMAL, "           Time                       : %" PRIu64 " (%.3f%%)", counters->malformed_time, CalcPct(counters->malformed_time, counters->events_received) );
-            Sagan_Log(NORMAL, "           Program                    : %" PRIu64 " (%.3f%%)", counters->malformed_program, CalcPct(counters->malformed_program, counters->events_received) );
-            Sagan_Log(NORMAL, "           Message                    : %" PRIu64 " (%.3f%%)", counters->malformed_message, CalcPct(counters->malformed_message, counters->events_received) );
+            Sagan_Log(NORMAL, "           Host                       : %" PRIu64 " (%.3f%%)", sum.malformed_host, CalcPct(sum.malformed_host, sum.events_received) );
+            Sagan_Log(NORMAL, "           Facility                   : %" PRIu64 " (%.3f%%)", sum.malformed_facility, CalcPct(sum.malformed_facility, sum.events_received) );
+            Sagan_Log(NORMAL, "           Priority                   : %" PRIu64 " (%.3f%%)", sum.malformed_priority, CalcPct(sum.malformed_priority, sum.events_received) );
+            Sagan_Log(NORMAL, "           Level                      : %" PRIu64 " (%.3f%%)", sum.malformed_level, CalcPct(sum.malformed_level, sum.events_received) );
+            Sagan_Log(NORMAL, "           Tag                        : %" PRIu64 " (%.3f%%)", sum.malformed_tag, CalcPct(sum.malformed_tag, sum.events_received) );
+            Sagan_Log(NORMAL, "           Date                       : %" PRIu64 " (%.3f%%)", sum.malformed_date, CalcPct(sum.malformed_date, sum.events_received) );
+            Sagan_Log(NORMAL, "           Time                       : %" PRIu64 " (%.3f%%)", sum.malformed_time, CalcPct(sum.malformed_time, sum.events_received) );
+            Sagan_Log(NORMAL, "           Program                    : %" PRIu64 " (%.3f%%)", sum.malformed_program, CalcPct(sum.malformed_program, sum.events_received) );
+            Sagan_Log(NORMAL, "           Message                    : %" PRIu64 " (%.3f%%)", sum.malformed_message, CalcPct(sum.malformed_message, sum.events_received) );
 
 #ifdef HAVE_LIBFASTJSON
 
             if ( config->parse_json_program == true || config->parse_json_message == true )
                 {
-                    Sagan_Log(NORMAL, "           JSON Input                 : %" PRIu64 " (%.3f%%)", counters->malformed_json_input_count, CalcPct(counters->malformed_json_input_count, counters->events_received) );
-                    Sagan_Log(NORMAL, "           JSON Program/Messages      : %" PRIu64 " (%.3f%%)", counters->malformed_json_mp_count, CalcPct(counters->malformed_json_mp_count, counters->events_received) );
+                    Sagan_Log(NORMAL, "           JSON Input                 : %" PRIu64 " (%.3f%%)", sum.malformed_json_input_count, CalcPct(sum.malformed_json_input_count, sum.events_received) );
+                    Sagan_Log(NORMAL, "           JSON Program/Messages      : %" PRIu64 " (%.3f%%)", sum.malformed_json_mp_count, CalcPct(sum.malformed_json_mp_count, sum.events_received) );
 
                 }
 
@@ -203,12 +323,12 @@ void Statistics( void )
             Sagan_Log(NORMAL, "");
             Sagan_Log(NORMAL, "          -[ Sagan Processor Statistics ]-");
             Sagan_Log(NORMAL, "");
-            Sagan_Log(NORMAL, "           Dropped                    : %" PRIu64 " (%.3f%%)", counters->sagan_processor_drop, CalcPct(counters->sagan_processor_drop, counters->events_received) );
+            Sagan_Log(NORMAL, "           Dropped                    : %" PRIu64 " (%.3f%%)", counters->sagan_processor_drop, CalcPct(counters->sagan_processor_drop, sum.events_received) );
 
             if (config->blacklist_flag)
                 {
-                    Sagan_Log(NORMAL, "           Blacklist Lookups          : %" PRIu64 " (%.3f%%)", counters->blacklist_lookup_count, CalcPct(counters->blacklist_lookup_count, counters->events_received) );
-                    Sagan_Log(NORMAL, "           Blacklist Hits             : %" PRIu64 " (%.3f%%)", counters->blacklist_hit_count, CalcPct(counters->blacklist_hit_count, counters->events_received) );
+                    Sagan_Log(NORMAL, "           Blacklist Lookups          : %" PRIu64 " (%.3f%%)", sum.blacklist_lookup_count, CalcPct(sum.blacklist_lookup_count, sum.events_received) );
+                    Sagan_Log(NORMAL, "           Blacklist Hits             : %" PRIu64 " (%.3f%%)", sum.blacklist_hit_count, CalcPct(sum.blacklist_hit_count, sum.events_received) );
 
                 }
 
@@ -223,13 +343,13 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          -[ Sagan Output Plugin Statistics ]-");
                     Sagan_Log(NORMAL, "");
-                    Sagan_Log(NORMAL,"           Dropped                       : %" PRIu64 " (%.3f%%)", counters->sagan_output_drop, CalcPct(counters->sagan_output_drop, counters->events_received) );
+                    Sagan_Log(NORMAL,"           Dropped                       : %" PRIu64 " (%.3f%%)", sum.sagan_output_drop, CalcPct(sum.sagan_output_drop, sum.events_received) );
                 }
 
 #ifdef HAVE_LIBESMTP
             if ( config->sagan_esmtp_flag )
                 {
-                    Sagan_Log(NORMAL, "           Email Success/Failed       : %" PRIu64 " / %" PRIu64 "", counters->esmtp_count_success, counters->esmtp_count_failed);
+                    Sagan_Log(NORMAL, "           Email Success/Failed       : %" PRIu64 " / %" PRIu64 "", sum.esmtp_count_success, sum.esmtp_count_failed);
                 }
 #endif
 
@@ -240,14 +360,14 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "          -[ Sagan DNS Cache Statistics ]-");
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "           Cached                     : %" PRIu64 "", counters->dns_cache_count);
-                    Sagan_Log(NORMAL, "           Missed                     : %" PRIu64 " (%.3f%%)", counters->dns_miss_count, CalcPct(counters->dns_miss_count, counters->dns_cache_count));
+                    Sagan_Log(NORMAL, "           Missed                     : %" PRIu64 " (%.3f%%)", sum.dns_miss_count, CalcPct(sum.dns_miss_count, counters->dns_cache_count));
                 }
 
             Sagan_Log(NORMAL, "");
             Sagan_Log(NORMAL, "          -[ Sagan follow_flow Statistics ]-");
             Sagan_Log(NORMAL, "");
-            Sagan_Log(NORMAL, "           Total                      : %" PRIu64 "", counters->follow_flow_total);
-            Sagan_Log(NORMAL, "           Dropped                    : %" PRIu64 " (%.3f%%)", counters->follow_flow_drop, CalcPct(counters->follow_flow_drop, counters->follow_flow_total));
+            Sagan_Log(NORMAL, "           Total                      : %" PRIu64 "", sum.follow_flow_total);
+            Sagan_Log(NORMAL, "           Dropped                    : %" PRIu64 " (%.3f%%)", sum.follow_flow_drop, CalcPct(sum.follow_flow_drop, sum.follow_flow_total));
 
 #ifdef WITH_BLUEDOT
 
@@ -259,51 +379,70 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "          * IP Reputation *");
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          IP addresses in cache           : %" PRIu64 " (%.3f%%)", counters->bluedot_ip_cache_count, CalcPct(counters->bluedot_ip_cache_count, config->bluedot_ip_max_cache));
-                    Sagan_Log(NORMAL, "          IP hits from cache              : %" PRIu64 " (%.3f%%)", counters->bluedot_ip_cache_hit, CalcPct(counters->bluedot_ip_cache_hit, counters->bluedot_ip_cache_count));
-                    Sagan_Log(NORMAL, "          IP/Bluedot hits in logs         : %" PRIu64 "", counters->bluedot_ip_positive_hit);
+                    Sagan_Log(NORMAL, "          IP hits from cache              : %" PRIu64 " (%.3f%%)", sum.bluedot_ip_cache_hit, CalcPct(sum.bluedot_ip_cache_hit, counters->bluedot_ip_cache_count));
+                    Sagan_Log(NORMAL, "          IP cache misses                 : %" PRIu64 "", sum.bluedot_ip_cache_miss);
+                    Sagan_Log(NORMAL, "          IP cache evictions              : %" PRIu64 "", sum.bluedot_ip_cache_evict);
+                    Sagan_Log(NORMAL, "          IP/Bluedot hits in logs         : %" PRIu64 "", sum.bluedot_ip_positive_hit);
                     Sagan_Log(NORMAL, "          IP with date > mdate            : %" PRIu64 "", counters->bluedot_mdate);
                     Sagan_Log(NORMAL, "          IP with date > cdate            : %" PRIu64 "", counters->bluedot_cdate);
-                    Sagan_Log(NORMAL, "          IP with date > mdate [cache]    : %" PRIu64 "", counters->bluedot_mdate_cache);
-                    Sagan_Log(NORMAL, "          IP with date > cdate [cache]    : %" PRIu64 "", counters->bluedot_cdate_cache);
+                    Sagan_Log(NORMAL, "          IP with date > mdate [cache]    : %" PRIu64 "", sum.bluedot_mdate_cache);
+                    Sagan_Log(NORMAL, "          IP with date > cdate [cache]    : %" PRIu64 "", sum.bluedot_cdate_cache);
                     Sagan_Log(NORMAL, "          IP queries per/second           : %lu (%" PRIu64 "/%" PRIu64 ")", bluedot_ip_total, counters->bluedot_ip_queue_current, config->bluedot_ip_queue);
 
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          * File Hash *");
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          Hashes in cache                 : %" PRIu64 " (%.3f%%)", counters->bluedot_hash_cache_count, CalcPct(counters->bluedot_hash_cache_count, config->bluedot_hash_max_cache));
-                    Sagan_Log(NORMAL, "          Hash hits from cache            : %" PRIu64 " (%.3f%%)", counters->bluedot_hash_cache_hit, CalcPct(counters->bluedot_hash_cache_hit, counters->bluedot_hash_cache_count));
-                    Sagan_Log(NORMAL, "          Hash/Bluedot hits in logs       : %" PRIu64 "", counters->bluedot_hash_positive_hit);
+                    Sagan_Log(NORMAL, "          Hash hits from cache            : %" PRIu64 " (%.3f%%)", sum.bluedot_hash_cache_hit, CalcPct(sum.bluedot_hash_cache_hit, counters->bluedot_hash_cache_count));
+                    Sagan_Log(NORMAL, "          Hash cache misses               : %" PRIu64 "", sum.bluedot_hash_cache_miss);
+                    Sagan_Log(NORMAL, "          Hash cache evictions            : %" PRIu64 "", sum.bluedot_hash_cache_evict);
+                    Sagan_Log(NORMAL, "          Hash/Bluedot hits in logs       : %" PRIu64 "", sum.bluedot_hash_positive_hit);
                     Sagan_Log(NORMAL, "          Hash queries per/second         : %lu (%" PRIu64 "/%" PRIu64 ")", bluedot_hash_total, counters->bluedot_hash_queue_current, config->bluedot_hash_queue);
 
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          * URL Reputation *");
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          URLs in cache                   : %" PRIu64 " (%.3f%%)", counters->bluedot_url_cache_count, CalcPct(counters->bluedot_url_cache_count, config->bluedot_url_max_cache));
-                    Sagan_Log(NORMAL, "          URL hits from cache             : %" PRIu64 " (%.3f%%)", counters->bluedot_url_cache_hit, CalcPct(counters->bluedot_url_cache_hit, counters->bluedot_url_cache_count));
-                    Sagan_Log(NORMAL, "          URL/Bluedot hits in logs        : %" PRIu64 "", counters->bluedot_url_positive_hit);
+                    Sagan_Log(NORMAL, "          URL hits from cache             : %" PRIu64 " (%.3f%%)", sum.bluedot_url_cache_hit, CalcPct(sum.bluedot_url_cache_hit, counters->bluedot_url_cache_count));
+                    Sagan_Log(NORMAL, "          URL cache misses                : %" PRIu64 "", sum.bluedot_url_cache_miss);
+                    Sagan_Log(NORMAL, "          URL cache evictions             : %" PRIu64 "", sum.bluedot_url_cache_evict);
+                    Sagan_Log(NORMAL, "          URL/Bluedot hits in logs        : %" PRIu64 "", sum.bluedot_url_positive_hit);
                     Sagan_Log(NORMAL, "          URL queries per/second          : %lu (%" PRIu64 "/%" PRIu64 ")", bluedot_url_total, counters->bluedot_url_queue_current, config->bluedot_url_queue);
 
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          * Filename Reputation *");
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          Filenames in cache              : %" PRIu64 " (%.3f%%)", counters->bluedot_filename_cache_count, CalcPct(counters->bluedot_filename_cache_count, config->bluedot_filename_max_cache));
-                    Sagan_Log(NORMAL, "          Filename hits from cache        : %" PRIu64 " (%.3f%%)", counters->bluedot_filename_cache_hit, CalcPct(counters->bluedot_filename_cache_hit, counters->bluedot_filename_cache_count));
-                    Sagan_Log(NORMAL, "          Filename/Bluedot hits in logs   : %" PRIu64 "", counters->bluedot_filename_positive_hit);
+                    Sagan_Log(NORMAL, "          Filename hits from cache        : %" PRIu64 " (%.3f%%)", sum.bluedot_filename_cache_hit, CalcPct(sum.bluedot_filename_cache_hit, counters->bluedot_filename_cache_count));
+                    Sagan_Log(NORMAL, "          Filename cache misses           : %" PRIu64 "", sum.bluedot_filename_cache_miss);
+                    Sagan_Log(NORMAL, "          Filename cache evictions        : %" PRIu64 "", sum.bluedot_filename_cache_evict);
+                    Sagan_Log(NORMAL, "          Filename/Bluedot hits in logs   : %" PRIu64 "", sum.bluedot_filename_positive_hit);
                     Sagan_Log(NORMAL, "          URL queries per/second          : %lu (%" PRIu64 "/%" PRIu64 ")", bluedot_filename_total, counters->bluedot_filename_queue_current, config->bluedot_filename_queue);
                     Sagan_Log(NORMAL, "");
 
                     Sagan_Log(NORMAL, "          * TLS/JA3 Reputation *");
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          JA3 in cache                    : %" PRIu64 " (%.3f%%)", counters->bluedot_ja3_cache_count, CalcPct(counters->bluedot_ja3_cache_count, config->bluedot_ja3_max_cache));
-                    Sagan_Log(NORMAL, "          JA3 hits from cache             : %" PRIu64 " (%.3f%%)", counters->bluedot_ja3_cache_hit, CalcPct(counters->bluedot_ja3_cache_hit, counters->bluedot_ja3_cache_count));
-                    Sagan_Log(NORMAL, "          JA3/Bluedot hits in logs        : %" PRIu64 "", counters->bluedot_ja3_positive_hit);
+                    Sagan_Log(NORMAL, "          JA3 hits from cache             : %" PRIu64 " (%.3f%%)", sum.bluedot_ja3_cache_hit, CalcPct(sum.bluedot_ja3_cache_hit, counters->bluedot_ja3_cache_count));
+                    Sagan_Log(NORMAL, "          JA3 cache misses                : %" PRIu64 "", sum.bluedot_ja3_cache_miss);
+                    Sagan_Log(NORMAL, "          JA3 cache evictions             : %" PRIu64 "", sum.bluedot_ja3_cache_evict);
+                    Sagan_Log(NORMAL, "          JA3/Bluedot hits in logs        : %" PRIu64 "", sum.bluedot_ja3_positive_hit);
                     Sagan_Log(NORMAL, "          JA3 queries per/second          : %lu (%" PRIu64 "/%" PRIu64 ")", bluedot_ja3_total, counters->bluedot_ja3_queue_current, config->bluedot_ja3_queue);
 
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          * Bluedot Combined Statistics *");
                     Sagan_Log(NORMAL, "");
-                    Sagan_Log(NORMAL, "          Lookup error count              : %" PRIu64 "", counters->bluedot_error_count);
+                    Sagan_Log(NORMAL, "          Lookup error count              : %" PRIu64 "", sum.bluedot_error_count);
                     Sagan_Log(NORMAL, "          Total query rate/per second     : %lu", bluedot_ip_total + bluedot_hash_total + bluedot_url_total + bluedot_filename_total);
+                    Sagan_Log(NORMAL, "          Misses joined to a lookup       : %" PRIu64 "", sum.bluedot_coalesced);
+                    Sagan_Log(NORMAL, "          Misses failed open              : %" PRIu64 "", sum.bluedot_fail_open);
+                    Sagan_Log(NORMAL, "          Events deferred                 : %" PRIu64 " (replayed: %" PRIu64 ", no room: %" PRIu64 ")", sum.bluedot_deferred, sum.bluedot_deferred_replay, sum.bluedot_deferred_drop);
+
+                    Statistics_Bluedot_Latency(&sum, "IP", BLUEDOT_LOOKUP_IP);
+                    Statistics_Bluedot_Latency(&sum, "Hash", BLUEDOT_LOOKUP_HASH);
+                    Statistics_Bluedot_Latency(&sum, "URL", BLUEDOT_LOOKUP_URL);
+                    Statistics_Bluedot_Latency(&sum, "Filename", BLUEDOT_LOOKUP_FILENAME);
+                    Statistics_Bluedot_Latency(&sum, "JA3", BLUEDOT_LOOKUP_JA3);
 
 
                 }
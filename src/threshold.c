@@ -29,20 +29,22 @@
 #include <time.h>
 #include <stdbool.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 #include "rules.h"
 #include "threshold.h"
 #include "ipc.h"
+#include "util-time.h"
 
-pthread_mutex_t Thresh2_Mutex=PTHREAD_MUTEX_INITIALIZER;
+struct _IPC_Hash_Stripes Thresh2_Stripes;
 
 struct _Threshold2_IPC *Threshold2_IPC;
 struct _Sagan_IPC_Counters *counters_ipc;
 
-struct _SaganCounters *counters;
 struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
@@ -54,20 +56,18 @@ struct _SaganConfig *config;
 bool Threshold2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_dst,  uint32_t dst_port, char *username, char *syslog_message )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
-
     bool thresh_log_flag = false;
 
     uint64_t thresh_oldtime = 0;
     uint64_t current_time = 0;
 
-    int i;
+    uint32_t i;
+    uint32_t n;
+    uint32_t slots;
+    uint32_t home;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    int found = -1;
+    int reuse = -1;
 
     char src_tmp[MAXIP] = { 0 };
     char dst_tmp[MAXIP] = { 0 };
@@ -75,12 +75,12 @@ bool Threshold2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_d
     uint32_t dst_port_tmp = 0;
     uint32_t src_port_tmp = 0;
 
-    char hash_string[128] = { 0 };
     char debug_string[64] = { 0 };
 
     uint32_t hash;
+    uint64_t sid = rulestruct[rule_position].s_sid;
 
-    current_time = atoi(timet);
+    current_time = Return_Epoch();
 
     username_tmp[0] = '\0';
 
@@ -109,126 +109,172 @@ bool Threshold2 ( int rule_position, char *ip_src, uint32_t src_port, char *ip_d
             dst_port_tmp = dst_port;
         }
 
-    snprintf(hash_string, sizeof(hash_string), "%s|%d|%s|%d|%s", src_tmp, src_port_tmp, dst_tmp, dst_port_tmp, username_tmp);
+    /* Hash the binary key fields.  The sid is part of the key so every
+       rule gets its own spread of slots */
+
+    hash = IPC_Hash_Bytes(IPC_HASH_SEED, &sid, sizeof(sid));
+    hash = IPC_Hash_IP(hash, src_tmp);
+    hash = IPC_Hash_Bytes(hash, &src_port_tmp, sizeof(src_port_tmp));
+    hash = IPC_Hash_IP(hash, dst_tmp);
+    hash = IPC_Hash_Bytes(hash, &dst_port_tmp, sizeof(dst_port_tmp));
+    hash = IPC_Hash_Bytes(hash, username_tmp, strlen(username_tmp));
 
-    hash = Djb2_Hash( hash_string );
+    slots = IPC_Hash_Slots(config->max_threshold2);
+    home = IPC_Hash_Home(hash, slots);
 
-    for (i = 0; i < counters_ipc->thresh2_count; i++ )
+    IPC_Hash_Lock(&Thresh2_Stripes, config->shm_thresh2, slots, home);
+
+    for ( i = 0; i < IPC_HASH_PROBE; i++ )
         {
 
-            if ( hash == Threshold2_IPC[i].hash && Threshold2_IPC[i].sid == rulestruct[rule_position].s_sid )
-                {
+            n = ( home + i ) % slots;
 
-                    File_Lock(config->shm_thresh2);
-                    pthread_mutex_lock(&Thresh2_Mutex);
+            /* Never used slot ends the probe chain */
 
-                    Threshold2_IPC[i].count++;
+            if ( Threshold2_IPC[n].used == false )
+                {
 
-                    if ( rulestruct[rule_position].threshold2_type == THRESHOLD_SUPPRESS )
+                    if ( reuse == -1 )
                         {
-                            thresh_oldtime = current_time - Threshold2_IPC[i].utime;
-                            Threshold2_IPC[i].utime = current_time;
+                            reuse = n;
                         }
 
-                    else if ( rulestruct[rule_position].threshold2_type == THRESHOLD_LIMIT )
-                        {
-                            thresh_oldtime = current_time - Threshold2_IPC[i].utime;
-                        }
+                    break;
+                }
 
+            if ( Threshold2_IPC[n].hash == hash &&
+                    Threshold2_IPC[n].sid == sid &&
+                    (uint32_t)Threshold2_IPC[n].src_port == src_port_tmp &&
+                    (uint32_t)Threshold2_IPC[n].dst_port == dst_port_tmp &&
+                    !strcmp(Threshold2_IPC[n].ip_src, src_tmp) &&
+                    !strcmp(Threshold2_IPC[n].ip_dst, dst_tmp) &&
+                    !strcmp(Threshold2_IPC[n].username, username_tmp) )
+                {
+                    found = n;
+                    break;
+                }
 
-                    strlcpy(Threshold2_IPC[i].syslog_message, syslog_message, sizeof(Threshold2_IPC[i].syslog_message));
-                    strlcpy(Threshold2_IPC[i].signature_msg, rulestruct[rule_position].s_msg, sizeof(Threshold2_IPC[i].signature_msg));
+            /* Expired entries are recycled in place */
 
-                    if ( thresh_oldtime > rulestruct[rule_position].threshold2_seconds )
-                        {
-                            Threshold2_IPC[i].count=1;
-                            Threshold2_IPC[i].utime = current_time;  /* Reset the time */
-                            thresh_log_flag = false;
-                        }
+            if ( reuse == -1 && (int64_t)( current_time - Threshold2_IPC[n].utime ) >= Threshold2_IPC[n].expire )
+                {
+                    reuse = n;
+                }
 
-                    if ( rulestruct[rule_position].threshold2_count < Threshold2_IPC[i].count )
-                        {
-                            thresh_log_flag = true;
+        }
 
-                            if ( debug->debuglimits )
-                                {
+    if ( found != -1 )
+        {
 
-                                    if ( Threshold2_IPC[i].threshold2_method_src == true )
-                                        {
-                                            strlcat(debug_string, "by_src ", sizeof(debug_string));
-                                        }
+            Threshold2_IPC[found].count++;
 
-                                    if ( Threshold2_IPC[i].threshold2_method_dst == true )
-                                        {
-                                            strlcat(debug_string, "by_dst ", sizeof(debug_string));
-                                        }
+            if ( rulestruct[rule_position].threshold2_type == THRESHOLD_SUPPRESS )
+                {
+                    thresh_oldtime = current_time - Threshold2_IPC[found].utime;
+                    Threshold2_IPC[found].utime = current_time;
+                }
 
-                                    if ( Threshold2_IPC[i].threshold2_method_username == true )
-                                        {
-                                            strlcat(debug_string, "by_username ", sizeof(debug_string));
-                                        }
+            else if ( rulestruct[rule_position].threshold2_type == THRESHOLD_LIMIT )
+                {
+                    thresh_oldtime = current_time - Threshold2_IPC[found].utime;
+                }
 
-                                    if ( Threshold2_IPC[i].threshold2_method_srcport == true )
-                                        {
-                                            strlcat(debug_string, "by_srcport ", sizeof(debug_string));
-                                        }
 
-                                    if ( Threshold2_IPC[i].threshold2_method_dstport == true )
-                                        {
-                                            strlcat(debug_string, "by_dstport ", sizeof(debug_string));
-                                        }
+            strlcpy(Threshold2_IPC[found].syslog_message, syslog_message, sizeof(Threshold2_IPC[found].syslog_message));
+            strlcpy(Threshold2_IPC[found].signature_msg, rulestruct[rule_position].s_msg, sizeof(Threshold2_IPC[found].signature_msg));
 
-                                    Sagan_Log(NORMAL, "Threshold SID %" PRIu64 ". Tracking by %s[%d: Hash: %lu]", Threshold2_IPC[i].sid, debug_string, i, hash);
+            if ( thresh_oldtime > rulestruct[rule_position].threshold2_seconds )
+                {
+                    Threshold2_IPC[found].count=1;
+                    Threshold2_IPC[found].utime = current_time;  /* Reset the time */
+                    thresh_log_flag = false;
+                }
 
+            if ( rulestruct[rule_position].threshold2_count < Threshold2_IPC[found].count )
+                {
+                    thresh_log_flag = true;
+
+                    if ( debug->debuglimits )
+                        {
+
+                            if ( Threshold2_IPC[found].threshold2_method_src == true )
+                                {
+                                    strlcat(debug_string, "by_src ", sizeof(debug_string));
                                 }
 
-                            counters->threshold_total++;
-                        }
+                            if ( Threshold2_IPC[found].threshold2_method_dst == true )
+                                {
+                                    strlcat(debug_string, "by_dst ", sizeof(debug_string));
+                                }
+
+                            if ( Threshold2_IPC[found].threshold2_method_username == true )
+                                {
+                                    strlcat(debug_string, "by_username ", sizeof(debug_string));
+                                }
+
+                            if ( Threshold2_IPC[found].threshold2_method_srcport == true )
+                                {
+                                    strlcat(debug_string, "by_srcport ", sizeof(debug_string));
+                                }
+
+                            if ( Threshold2_IPC[found].threshold2_method_dstport == true )
+                                {
+                                    strlcat(debug_string, "by_dstport ", sizeof(debug_string));
+                                }
 
-                    pthread_mutex_unlock(&Thresh2_Mutex);
-                    File_Unlock(config->shm_thresh2);
+                            Sagan_Log(NORMAL, "Threshold SID %" PRIu64 ". Tracking by %s[%d: Hash: %" PRIu32 "]", Threshold2_IPC[found].sid, debug_string, found, hash);
 
-                    return(thresh_log_flag);
+                        }
 
+                    Sagan_Counter_Add(threshold_total, 1);
                 }
 
+            IPC_Hash_Unlock(&Thresh2_Stripes, config->shm_thresh2, slots, home);
+
+            return(thresh_log_flag);
+
         }
 
-    /* If not found,  add it to the array */
+    /* If not found,  add it to the table */
 
-    if ( Clean_IPC_Object(THRESHOLD2) == 0 )
+    if ( reuse == -1 )
         {
+            IPC_Hash_Unlock(&Thresh2_Stripes, config->shm_thresh2, slots, home);
+            Sagan_Log(WARN, "[%s, line %d] No free threshold slot for SID %" PRIu64 ".  Consider raising sagan-core|mmap-ipc 'threshold' (currently %d).", __FILE__, __LINE__, sid, config->max_threshold2);
+            return(false);
+        }
 
-            File_Lock(config->shm_thresh2);
-            pthread_mutex_lock(&Thresh2_Mutex);
-
-            Threshold2_IPC[counters_ipc->thresh2_count].hash = hash;
+    if ( Threshold2_IPC[reuse].used == false )
+        {
+            Threshold2_IPC[reuse].used = true;
+            __atomic_add_fetch(&counters_ipc->thresh2_count, 1, __ATOMIC_SEQ_CST);
+        }
 
-            Threshold2_IPC[counters_ipc->thresh2_count].count = 1;
-            Threshold2_IPC[counters_ipc->thresh2_count].utime = current_time;
-            Threshold2_IPC[counters_ipc->thresh2_count].expire = rulestruct[rule_position].threshold2_seconds;
-            Threshold2_IPC[counters_ipc->thresh2_count].sid = rulestruct[rule_position].s_sid;
-            Threshold2_IPC[counters_ipc->thresh2_count].target_count =rulestruct[rule_position].threshold2_count;
-            Threshold2_IPC[counters_ipc->thresh2_count].threshold2_method_src = rulestruct[rule_position].threshold2_method_src;
-            Threshold2_IPC[counters_ipc->thresh2_count].threshold2_method_dst = rulestruct[rule_position].threshold2_method_dst;
-            Threshold2_IPC[counters_ipc->thresh2_count].threshold2_method_username = rulestruct[rule_position].threshold2_method_username;
+    Threshold2_IPC[reuse].hash = hash;
 
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].ip_src, src_tmp, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].ip_src));
-            Threshold2_IPC[counters_ipc->thresh2_count].src_port = src_port_tmp;
+    Threshold2_IPC[reuse].count = 1;
+    Threshold2_IPC[reuse].utime = current_time;
+    Threshold2_IPC[reuse].expire = rulestruct[rule_position].threshold2_seconds;
+    Threshold2_IPC[reuse].sid = sid;
+    Threshold2_IPC[reuse].target_count =rulestruct[rule_position].threshold2_count;
+    Threshold2_IPC[reuse].threshold2_method_src = rulestruct[rule_position].threshold2_method_src;
+    Threshold2_IPC[reuse].threshold2_method_dst = rulestruct[rule_position].threshold2_method_dst;
+    Threshold2_IPC[reuse].threshold2_method_username = rulestruct[rule_position].threshold2_method_username;
+    Threshold2_IPC[reuse].threshold2_method_srcport = rulestruct[rule_position].threshold2_method_srcport;
+    Threshold2_IPC[reuse].threshold2_method_dstport = rulestruct[rule_position].threshold2_method_dstport;
 
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].ip_dst, dst_tmp, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].ip_dst));
-            Threshold2_IPC[counters_ipc->thresh2_count].dst_port = dst_port_tmp;
+    strlcpy(Threshold2_IPC[reuse].ip_src, src_tmp, sizeof(Threshold2_IPC[reuse].ip_src));
+    Threshold2_IPC[reuse].src_port = src_port_tmp;
 
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].username, username_tmp, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].username));
+    strlcpy(Threshold2_IPC[reuse].ip_dst, dst_tmp, sizeof(Threshold2_IPC[reuse].ip_dst));
+    Threshold2_IPC[reuse].dst_port = dst_port_tmp;
 
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].syslog_message, syslog_message, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].syslog_message));
-            strlcpy(Threshold2_IPC[counters_ipc->thresh2_count].signature_msg, rulestruct[rule_position].s_msg, sizeof(Threshold2_IPC[counters_ipc->thresh2_count].signature_msg));
+    strlcpy(Threshold2_IPC[reuse].username, username_tmp, sizeof(Threshold2_IPC[reuse].username));
 
-            counters_ipc->thresh2_count++;
+    strlcpy(Threshold2_IPC[reuse].syslog_message, syslog_message, sizeof(Threshold2_IPC[reuse].syslog_message));
+    strlcpy(Threshold2_IPC[reuse].signature_msg, rulestruct[rule_position].s_msg, sizeof(Threshold2_IPC[reuse].signature_msg));
 
-            pthread_mutex_unlock(&Thresh2_Mutex);
-            File_Unlock(config->shm_thresh2);
-        }
+    IPC_Hash_Unlock(&Thresh2_Stripes, config->shm_thresh2, slots, home);
 
     return(false);
 
@@ -54,6 +54,7 @@
 #include "sagan-defs.h"
 #include "rules.h"
 #include "tracking-syslog.h"
+#include "util-time.h"
 
 struct _SaganConfig *config;
 struct _SaganCounters *counters;
@@ -69,9 +70,6 @@ void RuleTracking_Syslog( void )
     bool flag = 0;
 
 
-    time_t t;
-    char timet[20];
-    struct tm *now;
     int seconds = 0;
 
 
@@ -88,10 +86,7 @@ void RuleTracking_Syslog( void )
 
             sleep(config->rule_tracking_time);
 
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            seconds = atol(timet) - atol(config->sagan_startutime);
+            seconds = Return_Epoch() - atol(config->sagan_startutime);
 
             uptime_days = seconds / 86400;
             uptime_abovedays = seconds % 86400;
@@ -0,0 +1,644 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-aho-corasick.c
+ *
+ * Multi-pattern string matching using the Aho-Corasick algorithm.  Patterns
+ * are added to a trie,  then "built" into an automaton with failure links.
+ * A search makes one pass over the text regardless of how many patterns
+ * are loaded.  Several automatons (for example,  a case sensitive and a
+ * "nocase" one) can be stepped together in the same pass.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "sagan.h"
+#include "util-aho-corasick.h"
+
+#define SAGAN_AC_MAX_SEARCH	8	/* Max automatons stepped in one pass */
+
+#define SAGAN_AC_MAGIC		0x53414331	/* "SAC1" - Sagan_AC_Write() format */
+#define SAGAN_AC_ALIGN(x)	( ( (x) + 7 ) & ~( (size_t)7 ) )
+
+/* Sagan_AC_Write() header.  The search arrays follow it in the order they
+   are listed in _Sagan_AC,  each padded to 8 bytes */
+
+typedef struct _Sagan_AC_File _Sagan_AC_File;
+struct _Sagan_AC_File
+{
+    uint32_t magic;
+    uint32_t nocase;
+    int32_t state_count;
+    int32_t output_total;
+    int32_t root[256];
+    unsigned char fold[256];
+};
+
+static void Sagan_AC_Grow( struct _Sagan_AC *ac )
+{
+
+    ac->state_size = ac->state_size * 2;
+
+    ac->child = (int *) realloc(ac->child, ac->state_size * sizeof(int));
+    ac->sibling = (int *) realloc(ac->sibling, ac->state_size * sizeof(int));
+    ac->label = (unsigned char *) realloc(ac->label, ac->state_size * sizeof(unsigned char));
+
+    if ( ac->child == NULL || ac->sibling == NULL || ac->label == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Aho-Corasick states. Abort!", __FILE__, __LINE__);
+        }
+}
+
+/****************************************************************************
+ * Sagan_AC_New - Returns a new,  empty automaton.  If "nocase" is true,
+ * patterns and searched text are folded to lower case.
+ ****************************************************************************/
+
+struct _Sagan_AC *Sagan_AC_New( bool nocase )
+{
+
+    struct _Sagan_AC *ac = NULL;
+    int i;
+
+    ac = calloc(1, sizeof(struct _Sagan_AC));
+
+    if ( ac == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Aho-Corasick automaton. Abort!", __FILE__, __LINE__);
+        }
+
+    ac->nocase = nocase;
+
+    for ( i = 0; i < 256; i++ )
+        {
+            ac->fold[i] = nocase ? (unsigned char)tolower(i) : (unsigned char)i;
+        }
+
+    ac->state_size = 256;
+    ac->child = malloc(ac->state_size * sizeof(int));
+    ac->sibling = malloc(ac->state_size * sizeof(int));
+    ac->label = malloc(ac->state_size * sizeof(unsigned char));
+
+    if ( ac->child == NULL || ac->sibling == NULL || ac->label == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Aho-Corasick states. Abort!", __FILE__, __LINE__);
+        }
+
+    /* State 0 is the root */
+
+    ac->child[SAGAN_AC_ROOT] = -1;
+    ac->sibling[SAGAN_AC_ROOT] = -1;
+    ac->label[SAGAN_AC_ROOT] = 0;
+    ac->state_count = 1;
+
+    return(ac);
+}
+
+/****************************************************************************
+ * Sagan_AC_Add - Adds a pattern to the automaton. "id" is handed back to
+ * the search callback when the pattern is found.  Must be called before
+ * Sagan_AC_Build().
+ ****************************************************************************/
+
+void Sagan_AC_Add( struct _Sagan_AC *ac, const char *pattern, size_t len, int id )
+{
+
+    int state = SAGAN_AC_ROOT;
+    int next;
+    size_t i;
+    unsigned char c;
+
+    if ( ac->built == true || len == 0 )
+        {
+            return;
+        }
+
+    for ( i = 0; i < len; i++ )
+        {
+
+            c = ac->fold[(unsigned char)pattern[i]];
+
+            for ( next = ac->child[state]; next != -1 && ac->label[next] != c; next = ac->sibling[next] );
+
+            if ( next == -1 )
+                {
+
+                    if ( ac->state_count == ac->state_size )
+                        {
+                            Sagan_AC_Grow(ac);
+                        }
+
+                    next = ac->state_count;
+                    ac->state_count++;
+
+                    ac->label[next] = c;
+                    ac->child[next] = -1;
+                    ac->sibling[next] = ac->child[state];
+                    ac->child[state] = next;
+                }
+
+            state = next;
+        }
+
+    if ( ac->pattern_count == ac->pattern_size )
+        {
+
+            ac->pattern_size = ac->pattern_size == 0 ? 64 : ac->pattern_size * 2;
+
+            ac->pattern_state = (int *) realloc(ac->pattern_state, ac->pattern_size * sizeof(int));
+            ac->pattern_id = (int *) realloc(ac->pattern_id, ac->pattern_size * sizeof(int));
+
+            if ( ac->pattern_state == NULL || ac->pattern_id == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Aho-Corasick patterns. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    ac->pattern_state[ac->pattern_count] = state;
+    ac->pattern_id[ac->pattern_count] = id;
+    ac->pattern_count++;
+}
+
+/* Finds the transition from "state" on "c",  -1 if there isn't one */
+
+static inline int Sagan_AC_Edge( struct _Sagan_AC *ac, int state, unsigned char c )
+{
+
+    int lo = ac->edge_start[state];
+    int hi = lo + ac->edge_count[state] - 1;
+    int mid;
+
+    while ( lo <= hi )
+        {
+
+            mid = ( lo + hi ) / 2;
+
+            if ( ac->edge_char[mid] == c )
+                {
+                    return(ac->edge_target[mid]);
+                }
+
+            if ( ac->edge_char[mid] < c )
+                {
+                    lo = mid + 1;
+                }
+            else
+                {
+                    hi = mid - 1;
+                }
+        }
+
+    return(-1);
+}
+
+static inline int Sagan_AC_Goto( struct _Sagan_AC *ac, int state, unsigned char c )
+{
+
+    int next;
+
+    for (;;)
+        {
+
+            if ( state == SAGAN_AC_ROOT )
+                {
+                    return(ac->root[c]);
+                }
+
+            if ( ( next = Sagan_AC_Edge(ac, state, c) ) != -1 )
+                {
+                    return(next);
+                }
+
+            state = ac->fail[state];
+        }
+}
+
+/****************************************************************************
+ * Sagan_AC_Build - Converts the trie into a searchable automaton
+ ****************************************************************************/
+
+void Sagan_AC_Build( struct _Sagan_AC *ac )
+{
+
+    int *queue = NULL;
+    int head = 0;
+    int tail = 0;
+
+    int state;
+    int next;
+    int edge = 0;
+    int count;
+    int i;
+    int j;
+
+    unsigned char tmp_char;
+    int tmp_target;
+
+    if ( ac->built == true )
+        {
+            return;
+        }
+
+    ac->fail = calloc(ac->state_count, sizeof(int));
+    ac->dict = calloc(ac->state_count, sizeof(int));
+    ac->edge_start = calloc(ac->state_count, sizeof(int));
+    ac->edge_count = calloc(ac->state_count, sizeof(unsigned short));
+    ac->edge_char = calloc(ac->state_count, sizeof(unsigned char));
+    ac->edge_target = calloc(ac->state_count, sizeof(int));
+    ac->output_start = calloc(ac->state_count, sizeof(int));
+    ac->output_count = calloc(ac->state_count, sizeof(int));
+    ac->output = calloc(ac->pattern_count + 1, sizeof(int));
+    queue = calloc(ac->state_count, sizeof(int));
+
+    if ( ac->fail == NULL || ac->dict == NULL || ac->edge_start == NULL ||
+            ac->edge_count == NULL || ac->edge_char == NULL || ac->edge_target == NULL ||
+            ac->output_start == NULL || ac->output_count == NULL || ac->output == NULL || queue == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Aho-Corasick automaton. Abort!", __FILE__, __LINE__);
+        }
+
+    /* Flatten each state's children into a sorted edge list */
+
+    for ( state = 0; state < ac->state_count; state++ )
+        {
+
+            ac->edge_start[state] = edge;
+            count = 0;
+
+            for ( next = ac->child[state]; next != -1; next = ac->sibling[next] )
+                {
+                    ac->edge_char[edge+count] = ac->label[next];
+                    ac->edge_target[edge+count] = next;
+                    count++;
+                }
+
+            /* Insertion sort,  lists are short */
+
+            for ( i = 1; i < count; i++ )
+                {
+
+                    tmp_char = ac->edge_char[edge+i];
+                    tmp_target = ac->edge_target[edge+i];
+
+                    for ( j = i - 1; j >= 0 && ac->edge_char[edge+j] > tmp_char; j-- )
+                        {
+                            ac->edge_char[edge+j+1] = ac->edge_char[edge+j];
+                            ac->edge_target[edge+j+1] = ac->edge_target[edge+j];
+                        }
+
+                    ac->edge_char[edge+j+1] = tmp_char;
+                    ac->edge_target[edge+j+1] = tmp_target;
+                }
+
+            ac->edge_count[state] = count;
+            edge = edge + count;
+        }
+
+    /* Root lookup table */
+
+    for ( i = 0; i < 256; i++ )
+        {
+            ac->root[i] = SAGAN_AC_ROOT;
+        }
+
+    for ( next = ac->child[SAGAN_AC_ROOT]; next != -1; next = ac->sibling[next] )
+        {
+            ac->root[ac->label[next]] = next;
+            ac->fail[next] = SAGAN_AC_ROOT;
+            queue[tail++] = next;
+        }
+
+    /* Outputs,  grouped by state */
+
+    for ( i = 0; i < ac->pattern_count; i++ )
+        {
+            ac->output_count[ac->pattern_state[i]]++;
+        }
+
+    for ( state = 0, count = 0; state < ac->state_count; state++ )
+        {
+            ac->output_start[state] = count;
+            count = count + ac->output_count[state];
+            ac->output_count[state] = 0;
+        }
+
+    for ( i = 0; i < ac->pattern_count; i++ )
+        {
+            state = ac->pattern_state[i];
+            ac->output[ac->output_start[state] + ac->output_count[state]] = ac->pattern_id[i];
+            ac->output_count[state]++;
+        }
+
+    ac->output_total = ac->pattern_count;
+
+    /* Breadth first for failure and dictionary links */
+
+    while ( head < tail )
+        {
+
+            state = queue[head++];
+
+            ac->dict[state] = ac->output_count[ac->fail[state]] > 0 ? ac->fail[state] : ac->dict[ac->fail[state]];
+
+            for ( next = ac->child[state]; next != -1; next = ac->sibling[next] )
+                {
+                    ac->fail[next] = Sagan_AC_Goto(ac, ac->fail[state], ac->label[next]);
+                    queue[tail++] = next;
+                }
+        }
+
+    free(queue);
+
+    /* Trie data is no longer needed */
+
+    free(ac->child);
+    free(ac->sibling);
+    free(ac->label);
+    free(ac->pattern_state);
+    free(ac->pattern_id);
+
+    ac->child = NULL;
+    ac->sibling = NULL;
+    ac->label = NULL;
+    ac->pattern_state = NULL;
+    ac->pattern_id = NULL;
+
+    ac->built = true;
+}
+
+/****************************************************************************
+ * Sagan_AC_Search - Steps "ac_count" automatons over "text" in a single
+ * pass.  "callback" is called for every pattern found (a pattern may be
+ * reported more than once).
+ ****************************************************************************/
+
+void Sagan_AC_Search( struct _Sagan_AC **ac, int ac_count, const char *text, size_t len, Sagan_AC_Callback callback, void *data )
+{
+
+    int state[SAGAN_AC_MAX_SEARCH] = { 0 };
+    int out;
+    int k;
+    int o;
+    size_t i;
+
+    unsigned char c;
+
+    if ( ac_count > SAGAN_AC_MAX_SEARCH )
+        {
+            ac_count = SAGAN_AC_MAX_SEARCH;
+        }
+
+    for ( i = 0; i < len; i++ )
+        {
+
+            c = (unsigned char)text[i];
+
+            for ( k = 0; k < ac_count; k++ )
+                {
+
+                    if ( ac[k] == NULL || ac[k]->built == false )
+                        {
+                            continue;
+                        }
+
+                    state[k] = Sagan_AC_Goto(ac[k], state[k], ac[k]->fold[c]);
+
+                    out = ac[k]->output_count[state[k]] > 0 ? state[k] : ac[k]->dict[state[k]];
+
+                    while ( out != SAGAN_AC_ROOT )
+                        {
+
+                            for ( o = 0; o < ac[k]->output_count[out]; o++ )
+                                {
+                                    if ( callback(ac[k]->output[ac[k]->output_start[out] + o], data) == true )
+                                        {
+                                            return;
+                                        }
+                                }
+
+                            out = ac[k]->dict[out];
+                        }
+                }
+        }
+}
+
+/****************************************************************************
+ * Sagan_AC_Memory - Approximate memory used by a built automaton
+ ****************************************************************************/
+
+size_t Sagan_AC_Memory( struct _Sagan_AC *ac )
+{
+
+    if ( ac == NULL )
+        {
+            return(0);
+        }
+
+    return( sizeof(struct _Sagan_AC) +
+            ac->state_count * ( sizeof(int) * 5 + sizeof(unsigned short) + sizeof(unsigned char) + sizeof(int) ) +
+            ( ac->output_total + 1 ) * sizeof(int) );
+}
+
+/****************************************************************************
+ * Sagan_AC_Write - Writes a built automaton to "fp" so it can later be
+ * used straight from a mmap() with Sagan_AC_Map().  Returns the number of
+ * bytes written,  0 on error.
+ ****************************************************************************/
+
+static bool Sagan_AC_Write_Array( FILE *fp, const void *data, size_t len, size_t *total )
+{
+
+    static const char pad[8] = { 0 };
+
+    if ( len != 0 && fwrite(data, len, 1, fp) != 1 )
+        {
+            return(false);
+        }
+
+    if ( SAGAN_AC_ALIGN(len) != len && fwrite(pad, SAGAN_AC_ALIGN(len) - len, 1, fp) != 1 )
+        {
+            return(false);
+        }
+
+    *total = *total + SAGAN_AC_ALIGN(len);
+    return(true);
+}
+
+size_t Sagan_AC_Write( struct _Sagan_AC *ac, FILE *fp )
+{
+
+    struct _Sagan_AC_File header;
+    size_t total = 0;
+    size_t states;
+
+    if ( ac == NULL || ac->built == false )
+        {
+            return(0);
+        }
+
+    memset(&header, 0, sizeof(header));
+
+    header.magic = SAGAN_AC_MAGIC;
+    header.nocase = ac->nocase;
+    header.state_count = ac->state_count;
+    header.output_total = ac->output_total;
+    memcpy(header.root, ac->root, sizeof(header.root));
+    memcpy(header.fold, ac->fold, sizeof(header.fold));
+
+    states = ac->state_count;
+
+    if ( !Sagan_AC_Write_Array(fp, &header, sizeof(header), &total) ||
+            !Sagan_AC_Write_Array(fp, ac->fail, states * sizeof(int), &total) ||
+            !Sagan_AC_Write_Array(fp, ac->dict, states * sizeof(int), &total) ||
+            !Sagan_AC_Write_Array(fp, ac->edge_start, states * sizeof(int), &total) ||
+            !Sagan_AC_Write_Array(fp, ac->edge_count, states * sizeof(unsigned short), &total) ||
+            !Sagan_AC_Write_Array(fp, ac->edge_char, states * sizeof(unsigned char), &total) ||
+            !Sagan_AC_Write_Array(fp, ac->edge_target, states * sizeof(int), &total) ||
+            !Sagan_AC_Write_Array(fp, ac->output_start, states * sizeof(int), &total) ||
+            !Sagan_AC_Write_Array(fp, ac->output_count, states * sizeof(int), &total) ||
+            !Sagan_AC_Write_Array(fp, ac->output, ( ac->output_total + 1 ) * sizeof(int), &total) )
+        {
+            return(0);
+        }
+
+    return(total);
+}
+
+/****************************************************************************
+ * Sagan_AC_Map - Returns an automaton whose search data points into "buf"
+ * (as written by Sagan_AC_Write()).  Nothing is copied,  so "buf" must
+ * stay mapped until the automaton is freed.  Returns NULL if "buf" isn't
+ * a valid automaton.
+ ****************************************************************************/
+
+static const void *Sagan_AC_Map_Array( const unsigned char *buf, size_t len, size_t *offset, size_t size )
+{
+
+    const void *ptr = buf + *offset;
+
+    if ( size > len || *offset > len - size )
+        {
+            return(NULL);
+        }
+
+    *offset = *offset + SAGAN_AC_ALIGN(size);
+    return(ptr);
+}
+
+struct _Sagan_AC *Sagan_AC_Map( const void *buf, size_t len )
+{
+
+    const struct _Sagan_AC_File *header = NULL;
+    struct _Sagan_AC *ac = NULL;
+    size_t offset = 0;
+    size_t states;
+
+    header = Sagan_AC_Map_Array(buf, len, &offset, sizeof(struct _Sagan_AC_File));
+
+    if ( header == NULL || header->magic != SAGAN_AC_MAGIC ||
+            header->state_count < 1 || header->output_total < 0 )
+        {
+            return(NULL);
+        }
+
+    ac = calloc(1, sizeof(struct _Sagan_AC));
+
+    if ( ac == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Aho-Corasick automaton. Abort!", __FILE__, __LINE__);
+        }
+
+    ac->nocase = header->nocase;
+    ac->state_count = header->state_count;
+    ac->state_size = header->state_count;
+    ac->output_total = header->output_total;
+    memcpy(ac->root, header->root, sizeof(ac->root));
+    memcpy(ac->fold, header->fold, sizeof(ac->fold));
+
+    states = ac->state_count;
+
+    ac->fail = (int *)Sagan_AC_Map_Array(buf, len, &offset, states * sizeof(int));
+    ac->dict = (int *)Sagan_AC_Map_Array(buf, len, &offset, states * sizeof(int));
+    ac->edge_start = (int *)Sagan_AC_Map_Array(buf, len, &offset, states * sizeof(int));
+    ac->edge_count = (unsigned short *)Sagan_AC_Map_Array(buf, len, &offset, states * sizeof(unsigned short));
+    ac->edge_char = (unsigned char *)Sagan_AC_Map_Array(buf, len, &offset, states * sizeof(unsigned char));
+    ac->edge_target = (int *)Sagan_AC_Map_Array(buf, len, &offset, states * sizeof(int));
+    ac->output_start = (int *)Sagan_AC_Map_Array(buf, len, &offset, states * sizeof(int));
+    ac->output_count = (int *)Sagan_AC_Map_Array(buf, len, &offset, states * sizeof(int));
+    ac->output = (int *)Sagan_AC_Map_Array(buf, len, &offset, ( ac->output_total + 1 ) * sizeof(int));
+
+    if ( ac->fail == NULL || ac->dict == NULL || ac->edge_start == NULL ||
+            ac->edge_count == NULL || ac->edge_char == NULL || ac->edge_target == NULL ||
+            ac->output_start == NULL || ac->output_count == NULL || ac->output == NULL )
+        {
+            free(ac);
+            return(NULL);
+        }
+
+    ac->mapped = true;
+    ac->built = true;
+
+    return(ac);
+}
+
+void Sagan_AC_Free( struct _Sagan_AC *ac )
+{
+
+    if ( ac == NULL )
+        {
+            return;
+        }
+
+    /* Search data belongs to the caller's mapping */
+
+    if ( ac->mapped == true )
+        {
+            free(ac);
+            return;
+        }
+
+    free(ac->child);
+    free(ac->sibling);
+    free(ac->label);
+    free(ac->pattern_state);
+    free(ac->pattern_id);
+
+    free(ac->fail);
+    free(ac->dict);
+    free(ac->edge_start);
+    free(ac->edge_count);
+    free(ac->edge_char);
+    free(ac->edge_target);
+    free(ac->output_start);
+    free(ac->output_count);
+    free(ac->output);
+
+    free(ac);
+}
@@ -0,0 +1,80 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-aho-corasick.h
+ *
+ * Multi-pattern (Aho-Corasick) string matching.
+ *
+ */
+
+#define SAGAN_AC_ROOT		0
+
+typedef struct _Sagan_AC _Sagan_AC;
+struct _Sagan_AC
+{
+
+    bool nocase;			/* Patterns & text are folded to lower case */
+    bool built;
+    bool mapped;			/* Search data points into a Sagan_AC_Map() buffer */
+
+    int state_count;
+    int state_size;
+
+    /* Build time trie (first child / next sibling) */
+
+    int *child;
+    int *sibling;
+    unsigned char *label;
+
+    /* Search time data */
+
+    int root[256];			/* The root always has a direct lookup table */
+    unsigned char fold[256];		/* Byte translation (lower case for nocase) */
+    int *fail;
+    int *dict;				/* Next state in the fail chain with output */
+    int *edge_start;
+    unsigned short *edge_count;
+    unsigned char *edge_char;
+    int *edge_target;
+
+    int *output_start;			/* Patterns that end at a state */
+    int *output_count;
+    int *output;
+    int output_total;
+
+    int pattern_count;
+    int pattern_size;
+    int *pattern_state;			/* Used to build outputs */
+    int *pattern_id;
+
+};
+
+/* Callback when a pattern is found.  Return true to stop searching */
+
+typedef bool (*Sagan_AC_Callback)( int, void * );
+
+struct _Sagan_AC *Sagan_AC_New( bool );
+void   Sagan_AC_Add( struct _Sagan_AC *, const char *, size_t, int );
+void   Sagan_AC_Build( struct _Sagan_AC * );
+void   Sagan_AC_Search( struct _Sagan_AC **, int, const char *, size_t, Sagan_AC_Callback, void * );
+size_t Sagan_AC_Memory( struct _Sagan_AC * );
+size_t Sagan_AC_Write( struct _Sagan_AC *, FILE * );
+struct _Sagan_AC *Sagan_AC_Map( const void *, size_t );
+void   Sagan_AC_Free( struct _Sagan_AC * );
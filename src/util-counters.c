@@ -0,0 +1,131 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-counters.c
+ *
+ * Event counters used to be bumped with sequentially consistent atomics
+ * on the single global _SaganCounters,  so every reader and processor
+ * thread fought over the same few cache lines for every log line.  Now
+ * each thread bumps its own cache line aligned _Sagan_Counter_Shard
+ * (see Sagan_Counter_Add() in util-counters.h),  registered the first
+ * time the thread counts something.  The blocks are only added up when
+ * somebody wants to look at them (Statistics(),  perfmon,  etc).
+ *
+ * Blocks are never freed,  so counts from threads that have exited are
+ * kept.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "util-counters.h"
+
+__thread struct _Sagan_Counter_Shard *Sagan_Counter_Thread = NULL;
+
+static struct _Sagan_Counter_Shard **Counter_Shards = NULL;
+static int Counter_Shard_Count = 0;
+
+static pthread_mutex_t CounterShardMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************
+ * Sagan_Counter_Register - Gives the calling thread its own counter block.
+ * Called by Sagan_Counter_Add() the first time a thread counts something.
+ ****************************************************************************/
+
+struct _Sagan_Counter_Shard *Sagan_Counter_Register( void )
+{
+
+    struct _Sagan_Counter_Shard *shard = NULL;
+    struct _Sagan_Counter_Shard **tmp = NULL;
+
+    if ( posix_memalign((void **)&shard, SAGAN_COUNTER_CACHE_LINE, sizeof(struct _Sagan_Counter_Shard)) != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for counter shard. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(shard, 0, sizeof(struct _Sagan_Counter_Shard));
+
+    pthread_mutex_lock(&CounterShardMutex);
+
+    tmp = realloc(Counter_Shards, (Counter_Shard_Count + 1) * sizeof(struct _Sagan_Counter_Shard *));
+
+    if ( tmp == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for counter shards. Abort!", __FILE__, __LINE__);
+        }
+
+    Counter_Shards = tmp;
+    Counter_Shards[Counter_Shard_Count] = shard;
+    Counter_Shard_Count++;
+
+    pthread_mutex_unlock(&CounterShardMutex);
+
+    Sagan_Counter_Thread = shard;
+
+    return(shard);
+
+}
+
+/****************************************************************************
+ * Sagan_Counter_Sum - Adds up every thread's block into "total".  The
+ * block is nothing but uint64_t's,  so it's added up a word at a time.
+ * Counters keep moving while this runs,  so the total is a close
+ * snapshot rather than an exact one.
+ ****************************************************************************/
+
+void Sagan_Counter_Sum( struct _Sagan_Counter_Shard *total )
+{
+
+    uint64_t *sum = (uint64_t *)total;
+    uint64_t *counter = NULL;
+
+    size_t words = sizeof(struct _Sagan_Counter_Shard) / sizeof(uint64_t);
+    size_t i;
+    int s;
+
+    memset(total, 0, sizeof(struct _Sagan_Counter_Shard));
+
+    pthread_mutex_lock(&CounterShardMutex);
+
+    for ( s = 0; s < Counter_Shard_Count; s++ )
+        {
+
+            counter = (uint64_t *)Counter_Shards[s];
+
+            for ( i = 0; i < words; i++ )
+                {
+                    sum[i] = sum[i] + __atomic_load_n(&counter[i], __ATOMIC_RELAXED);
+                }
+        }
+
+    pthread_mutex_unlock(&CounterShardMutex);
+
+}
@@ -0,0 +1,173 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-counters.h
+ *
+ * Per thread event counters.  See util-counters.c
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#define SAGAN_COUNTER_CACHE_LINE	64
+
+/* Counters bumped for every event (or close to it).  Each thread gets its
+   own block,  so these are only uint64_t's.  Gauges and load time counts
+   stay in _SaganCounters. */
+
+typedef struct _Sagan_Counter_Shard _Sagan_Counter_Shard;
+struct _Sagan_Counter_Shard
+{
+
+    uint64_t events_received;
+    uint64_t events_processed;
+    uint64_t ignore_count;
+    uint64_t worker_thread_exhaustion;
+    uint64_t ring_full_wait;
+
+    uint64_t saganfound;
+    uint64_t alert_total;
+    uint64_t after_total;
+    uint64_t threshold_total;
+
+    uint64_t sagan_log_drop;
+    uint64_t sagan_output_drop;		/* Alerts the output queue had no room for */
+    uint64_t dns_miss_count;
+
+    uint64_t malformed_host;
+    uint64_t malformed_facility;
+    uint64_t malformed_priority;
+    uint64_t malformed_level;
+    uint64_t malformed_tag;
+    uint64_t malformed_date;
+    uint64_t malformed_time;
+    uint64_t malformed_program;
+    uint64_t malformed_message;
+
+    uint64_t blacklist_hit_count;
+    uint64_t blacklist_lookup_count;
+
+    uint64_t rule_index_events;		/* Events passed through the rule prefilter index */
+    uint64_t rule_index_candidates;	/* Rules handed to the engine by the rule index */
+
+    uint64_t engine_parse_ip;		/* Parse_IP() runs by the engine */
+    uint64_t engine_parse_hash;		/* Parse_Hash() runs by the engine */
+    uint64_t engine_parse_proto;	/* Parse_Proto_Program() runs by the engine */
+    uint64_t engine_ip2bit;		/* IP2Bit() conversions by the engine */
+
+    uint64_t pcre_limit;		/* "pcre" stopped by the match/depth limit */
+    uint64_t pcre_error;		/* "pcre" failed for another reason */
+
+    uint64_t follow_flow_total;
+    uint64_t follow_flow_drop;
+
+#ifdef HAVE_LIBMAXMINDDB
+    uint64_t geoip2_hit;
+    uint64_t geoip2_lookup;
+    uint64_t geoip2_error;
+#endif
+
+#ifdef WITH_BLUEDOT
+    uint64_t bluedot_ip_cache_hit;
+    uint64_t bluedot_ip_cache_miss;
+    uint64_t bluedot_ip_cache_evict;
+    uint64_t bluedot_ip_positive_hit;
+    uint64_t bluedot_ip_total;
+
+    uint64_t bluedot_hash_cache_hit;
+    uint64_t bluedot_hash_cache_miss;
+    uint64_t bluedot_hash_cache_evict;
+    uint64_t bluedot_hash_positive_hit;
+    uint64_t bluedot_hash_total;
+
+    uint64_t bluedot_url_cache_hit;
+    uint64_t bluedot_url_cache_miss;
+    uint64_t bluedot_url_cache_evict;
+    uint64_t bluedot_url_positive_hit;
+    uint64_t bluedot_url_total;
+
+    uint64_t bluedot_filename_cache_hit;
+    uint64_t bluedot_filename_cache_miss;
+    uint64_t bluedot_filename_cache_evict;
+    uint64_t bluedot_filename_positive_hit;
+    uint64_t bluedot_filename_total;
+
+    uint64_t bluedot_ja3_cache_hit;
+    uint64_t bluedot_ja3_cache_miss;
+    uint64_t bluedot_ja3_cache_evict;
+    uint64_t bluedot_ja3_positive_hit;
+    uint64_t bluedot_ja3_total;
+
+    uint64_t bluedot_mdate_cache;
+    uint64_t bluedot_cdate_cache;
+    uint64_t bluedot_error_count;
+
+    uint64_t bluedot_coalesced;
+    uint64_t bluedot_fail_open;
+    uint64_t bluedot_deferred;
+    uint64_t bluedot_deferred_replay;
+    uint64_t bluedot_deferred_drop;
+
+    uint64_t bluedot_latency[BLUEDOT_LATENCY_TYPES][BLUEDOT_LATENCY_BUCKETS];
+    uint64_t bluedot_latency_usec[BLUEDOT_LATENCY_TYPES];	   /* Sum,  for the average */
+#endif
+
+#ifdef HAVE_LIBESMTP
+    uint64_t esmtp_count_success;
+    uint64_t esmtp_count_failed;
+#endif
+
+#ifdef HAVE_LIBHIREDIS
+    uint64_t redis_writer_threads_drop;
+#endif
+
+#ifdef HAVE_LIBFASTJSON
+    uint64_t json_input_count;
+    uint64_t malformed_json_input_count;
+    uint64_t json_mp_count;
+    uint64_t malformed_json_mp_count;
+#endif
+
+} __attribute__ ((aligned (SAGAN_COUNTER_CACHE_LINE)));
+
+extern __thread struct _Sagan_Counter_Shard *Sagan_Counter_Thread;
+
+struct _Sagan_Counter_Shard *Sagan_Counter_Register( void );
+void Sagan_Counter_Sum( struct _Sagan_Counter_Shard * );
+
+/* Only the owning thread writes its block,  so a plain add is enough.  The
+   relaxed store keeps readers in Sagan_Counter_Sum() from seeing a torn
+   value. */
+
+#define Sagan_Counter_Add(field, n) ({ \
+    struct _Sagan_Counter_Shard *shard_ = Sagan_Counter_Thread != NULL ? Sagan_Counter_Thread : Sagan_Counter_Register(); \
+    __atomic_store_n(&shard_->field, shard_->field + (n), __ATOMIC_RELAXED); \
+})
+
+/* Same,  for a counter picked at run time by offsetof() */
+
+#define Sagan_Counter_Add_Offset(offset, n) ({ \
+    struct _Sagan_Counter_Shard *shard_ = Sagan_Counter_Thread != NULL ? Sagan_Counter_Thread : Sagan_Counter_Register(); \
+    uint64_t *counter_ = (uint64_t *)((char *)shard_ + (offset)); \
+    __atomic_store_n(counter_, *counter_ + (n), __ATOMIC_RELAXED); \
+})
+
@@ -0,0 +1,276 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-json-bench.c
+ *
+ * Times pulling the usual JSON input map fields out of a few EVE style
+ * log lines,  first the way SyslogInput_JSON() used to (libfastjson tree
+ * plus one lookup per field,  and nested JSON re-parsed from its string
+ * form) and then with Sagan_JSON_Walk().  Both have to find the same
+ * number of fields before they are timed.  Built with "make
+ * sagan-json-bench",  it isn't part of the normal build.
+ *
+ * Usage: sagan-json-bench [iterations]
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <json.h>
+
+#include "util-json.h"
+
+#define BENCH_DEFAULT_ITERATIONS	200000
+#define BENCH_MAX_LINE			4096
+#define BENCH_NEST_LEVELS		3
+#define BENCH_MAX_NEST			10
+
+static const char *Bench_Lines[] =
+{
+    "{\"timestamp\":\"2019-03-12T10:15:32.123456+0000\",\"flow_id\":1234567890123,\"in_iface\":\"eth0\",\"event_type\":\"alert\",\"src_ip\":\"203.0.113.54\",\"src_port\":51122,\"dest_ip\":\"192.0.2.10\",\"dest_port\":22,\"proto\":\"TCP\",\"alert\":{\"action\":\"allowed\",\"gid\":1,\"signature_id\":2001219,\"rev\":20,\"signature\":\"ET SCAN Potential SSH Scan\",\"category\":\"Attempted Information Leak\",\"severity\":2},\"host\":\"sensor1\",\"message\":\"ET SCAN Potential SSH Scan\"}",
+    "{\"timestamp\":\"2019-03-12T10:15:32.223456+0000\",\"flow_id\":1234567890124,\"event_type\":\"http\",\"src_ip\":\"198.51.100.23\",\"src_port\":40022,\"dest_ip\":\"192.0.2.10\",\"dest_port\":80,\"proto\":\"TCP\",\"tx_id\":0,\"http\":{\"hostname\":\"www.example.com\",\"url\":\"/wp-login.php\",\"http_user_agent\":\"Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/72.0.3626.121 Safari/537.36\",\"http_method\":\"GET\",\"protocol\":\"HTTP/1.1\",\"status\":404,\"length\":162},\"host\":\"sensor1\",\"message\":\"GET /wp-login.php HTTP/1.1 404 \\\"-\\\"\"}",
+    "{\"timestamp\":\"2019-03-12T10:15:33.000000+0000\",\"event_type\":\"fileinfo\",\"src_ip\":\"192.0.2.80\",\"src_port\":80,\"dest_ip\":\"10.0.0.143\",\"dest_port\":49152,\"proto\":\"TCP\",\"fileinfo\":{\"filename\":\"/update.exe\",\"magic\":\"PE32 executable (GUI) Intel 80386, for MS Windows\",\"state\":\"CLOSED\",\"md5\":\"2b1c6a7e0c5d1d8ce2e5e8a0b7a11d4f\",\"sha1\":\"0f3b2d9c1e5a4b6c7d8e9f0a1b2c3d4e5f6a7b8c\",\"stored\":false,\"size\":48120},\"host\":\"sensor2\",\"message\":\"fileinfo\"}",
+    "{\"timestamp\":\"2019-03-12T10:15:34.000000+0000\",\"event_type\":\"tls\",\"src_ip\":\"10.0.0.17\",\"src_port\":50514,\"dest_ip\":\"93.184.216.34\",\"dest_port\":443,\"proto\":\"TCP\",\"tls\":{\"subject\":\"CN=www.example.org\",\"issuerdn\":\"C=US, O=DigiCert Inc, CN=DigiCert SHA2 Secure Server CA\",\"version\":\"TLS 1.2\",\"ja3\":{\"hash\":\"e7d705a3286e19ea42f587b344ee6865\"}},\"host\":\"sensor1\",\"message\":\"tls\"}",
+    NULL
+};
+
+/* Keys of a typical JSON input map (see json-input.map) */
+
+static const char *Bench_Keys[] =
+{
+    "host", "facility", "priority", "level", "tags", "date", "time", "event_type", "message",
+    "src_ip", "dest_ip", "src_port", "dest_port", "proto", "md5", "sha1", "sha256", "filename",
+    "hostname", "url", "hash", "flow_id", NULL
+};
+
+static uint64_t Bench_Now( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+/* Tree version.  Like the old nested path,  values that are JSON objects
+   are searched again from their string form.  Returns fields found */
+
+static uint64_t Bench_Tree_Object( struct json_object *json_obj, int level, char *out, size_t size )
+{
+
+    struct json_object *tmp = NULL;
+    struct json_object *json_obj2 = NULL;
+    uint64_t found = 0;
+    int k;
+
+    for ( k = 0; Bench_Keys[k] != NULL; k++ )
+        {
+            if ( json_object_object_get_ex(json_obj, Bench_Keys[k], &tmp) && tmp != NULL )
+                {
+                    snprintf(out, size, "%s", json_object_get_string(tmp));
+                    found++;
+                }
+        }
+
+    if ( level + 1 >= BENCH_NEST_LEVELS )
+        {
+            return(found);
+        }
+
+    struct json_object_iterator it = json_object_iter_begin(json_obj);
+    struct json_object_iterator itEnd = json_object_iter_end(json_obj);
+
+    while (!json_object_iter_equal(&it, &itEnd))
+        {
+
+            const char *val_str = json_object_get_string(json_object_iter_peek_value(&it));
+
+            if ( val_str != NULL && val_str[0] == '{' )
+                {
+
+                    json_obj2 = json_tokener_parse(val_str);
+
+                    if ( json_obj2 != NULL )
+                        {
+                            found += Bench_Tree_Object(json_obj2, level + 1, out, size);
+                        }
+
+                    json_object_put(json_obj2);
+                }
+
+            json_object_iter_next(&it);
+        }
+
+    return(found);
+}
+
+static uint64_t Bench_Tree( char *line, size_t len, char *out, size_t size )
+{
+
+    struct json_object *json_obj = json_tokener_parse(line);
+    uint64_t found = 0;
+
+    (void)len;
+
+    if ( json_obj != NULL )
+        {
+            found = Bench_Tree_Object(json_obj, 0, out, size);
+        }
+
+    json_object_put(json_obj);
+
+    return(found);
+}
+
+struct _Bench_Walk
+{
+    uint64_t found;
+    char *out;
+    size_t size;
+};
+
+static void Bench_Walk_Field( void *data, uint16_t nest, const char *key, size_t key_len, const struct _Sagan_JSON_Value *value )
+{
+
+    struct _Bench_Walk *bench = data;
+    int k;
+
+    (void)nest;
+
+    if ( value->type == SAGAN_JSON_NULL )
+        {
+            return;
+        }
+
+    for ( k = 0; Bench_Keys[k] != NULL; k++ )
+        {
+            if ( Bench_Keys[k][0] == key[0] && strlen(Bench_Keys[k]) == key_len && memcmp(Bench_Keys[k], key, key_len) == 0 )
+                {
+                    Sagan_JSON_Copy(value, bench->out, bench->size);
+                    bench->found++;
+                }
+        }
+}
+
+static uint64_t Bench_Walk( char *line, size_t len, char *out, size_t size )
+{
+
+    struct _Bench_Walk bench = { 0, out, size };
+
+    (void)Sagan_JSON_Walk(line, len, BENCH_NEST_LEVELS, BENCH_MAX_NEST, NULL, Bench_Walk_Field, &bench);
+
+    return(bench.found);
+}
+
+typedef uint64_t (*Bench_Func)( char *, size_t, char *, size_t );
+
+/* Lines are copied in first since Sagan_JSON_Walk() may decode nested JSON
+   in place (and it's what the processor threads do with a batch anyway) */
+
+static uint64_t Bench_Run( Bench_Func func, int iterations, size_t *line_len, uint64_t *nsec )
+{
+
+    char line[BENCH_MAX_LINE];
+    char out[BENCH_MAX_LINE];
+    uint64_t found = 0;
+    uint64_t start;
+    int i;
+    int l;
+
+    start = Bench_Now();
+
+    for ( i = 0; i < iterations; i++ )
+        {
+            for ( l = 0; Bench_Lines[l] != NULL; l++ )
+                {
+                    memcpy(line, Bench_Lines[l], line_len[l] + 1);
+                    found += func(line, line_len[l], out, sizeof(out));
+                }
+        }
+
+    *nsec = Bench_Now() - start;
+
+    return(found);
+}
+
+int main( int argc, char **argv )
+{
+
+    size_t line_len[16];
+    size_t bytes = 0;
+    uint64_t tree_found;
+    uint64_t walk_found;
+    uint64_t tree_nsec;
+    uint64_t walk_nsec;
+    uint64_t lines;
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    int l;
+
+    if ( argc > 1 )
+        {
+            iterations = atoi(argv[1]);
+
+            if ( iterations <= 0 )
+                {
+                    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+                    return(1);
+                }
+        }
+
+    for ( l = 0; Bench_Lines[l] != NULL; l++ )
+        {
+            line_len[l] = strlen(Bench_Lines[l]);
+            bytes += line_len[l];
+        }
+
+    lines = (uint64_t)iterations * l;
+
+    /* Same answers first */
+
+    tree_found = Bench_Run(Bench_Tree, 1, line_len, &tree_nsec);
+    walk_found = Bench_Run(Bench_Walk, 1, line_len, &walk_nsec);
+
+    if ( tree_found != walk_found )
+        {
+            fprintf(stderr, "Field count mismatch: libfastjson found %" PRIu64 ",  Sagan_JSON_Walk() found %" PRIu64 "\n", tree_found, walk_found);
+            return(1);
+        }
+
+    printf("%d lines,  %zu bytes,  %" PRIu64 " fields per pass,  %d iterations\n\n", l, bytes, tree_found, iterations);
+
+    (void)Bench_Run(Bench_Tree, iterations, line_len, &tree_nsec);
+    (void)Bench_Run(Bench_Walk, iterations, line_len, &walk_nsec);
+
+    printf("%-20s %10.1f ns/line %8.2f ns/byte\n", "libfastjson tree", (double)tree_nsec / lines, (double)tree_nsec / ( (double)bytes * iterations ));
+    printf("%-20s %10.1f ns/line %8.2f ns/byte\n", "Sagan_JSON_Walk", (double)walk_nsec / lines, (double)walk_nsec / ( (double)bytes * iterations ));
+
+    return(0);
+}
+
@@ -0,0 +1,622 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-json.c
+ *
+ * Streaming JSON scanner.  Sagan_JSON_Walk() makes one pass over the text
+ * and hands every key/value of the objects we care about to a callback.
+ * Nothing is allocated and nothing is copied unless the callback asks for
+ * it with Sagan_JSON_Copy(),  which decodes the value straight into the
+ * caller's buffer.
+ *
+ * "levels" is how deep to search.  1 is only the top level object.  With
+ * more,  objects under a searched object are searched too,  and so is a
+ * string value holding JSON (the "nested" JSON some log shippers send).
+ * That string is decoded in place,  so the buffer passed in is scratch.
+ *
+ * Like libfastjson,  anything after the first complete value is ignored.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util-json.h"
+
+struct _Sagan_JSON_Walk
+{
+    const char *end;
+    unsigned char levels;
+    uint16_t max_nest;
+    uint16_t nest;				/* Searched objects so far */
+    Sagan_JSON_Callback callback;
+    void *data;
+};
+
+static const char *Sagan_JSON_Value( struct _Sagan_JSON_Walk *, const char *, int, int, struct _Sagan_JSON_Value * );
+
+static inline const char *Sagan_JSON_Space( const char *p, const char *end )
+{
+
+    while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' ) )
+        {
+            p++;
+        }
+
+    return(p);
+}
+
+/* "p" is just past the opening quote.  Returns the closing quote or NULL */
+
+static const char *Sagan_JSON_String_End( const char *p, const char *end, bool *escaped )
+{
+
+    const char *start = p;
+    const char *q;
+    size_t n;
+
+    for ( ;; )
+        {
+
+            q = memchr(p, '"', end - p);
+
+            if ( q == NULL )
+                {
+                    return(NULL);
+                }
+
+            /* An odd number of '\' in front of it means it's escaped */
+
+            n = 0;
+
+            while ( q - n > start && q[-(long)n - 1] == '\\' )
+                {
+                    n++;
+                }
+
+            if ( ( n & 1 ) == 0 )
+                {
+                    break;
+                }
+
+            p = q + 1;
+        }
+
+    *escaped = memchr(start, '\\', q - start) != NULL;
+
+    return(q);
+}
+
+static int Sagan_JSON_Hex( const char *p )
+{
+
+    int i;
+    int c = 0;
+
+    for ( i = 0; i < 4; i++ )
+        {
+
+            c <<= 4;
+
+            if ( p[i] >= '0' && p[i] <= '9' )
+                {
+                    c |= p[i] - '0';
+                }
+            else if ( p[i] >= 'a' && p[i] <= 'f' )
+                {
+                    c |= p[i] - 'a' + 10;
+                }
+            else if ( p[i] >= 'A' && p[i] <= 'F' )
+                {
+                    c |= p[i] - 'A' + 10;
+                }
+            else
+                {
+                    return(-1);
+                }
+        }
+
+    return(c);
+}
+
+/* Decodes the escaped string "s" into at most "size" bytes of "dst" (which
+   may be "s" itself).  Multi-byte characters are never split.  Returns the
+   number of bytes written,  there's no terminator. */
+
+static size_t Sagan_JSON_Decode( const char *s, size_t len, char *dst, size_t size )
+{
+
+    const char *end = s + len;
+    size_t n = 0;
+    long c;
+    long c2;
+
+    while ( s < end && n < size )
+        {
+
+            if ( *s != '\\' )
+                {
+                    dst[n++] = *s++;
+                    continue;
+                }
+
+            if ( ++s >= end )
+                {
+                    break;
+                }
+
+            switch ( *s++ )
+                {
+
+                case 'b':
+                    dst[n++] = '\b';
+                    continue;
+
+                case 'f':
+                    dst[n++] = '\f';
+                    continue;
+
+                case 'n':
+                    dst[n++] = '\n';
+                    continue;
+
+                case 'r':
+                    dst[n++] = '\r';
+                    continue;
+
+                case 't':
+                    dst[n++] = '\t';
+                    continue;
+
+                case 'u':
+                    break;
+
+                default:			/* '"',  '\\',  '/' and anything else */
+                    dst[n++] = s[-1];
+                    continue;
+                }
+
+            if ( end - s < 4 || ( c = Sagan_JSON_Hex(s) ) < 0 )
+                {
+                    dst[n++] = 'u';
+                    continue;
+                }
+
+            s += 4;
+
+            /* UTF-16 surrogate pair */
+
+            if ( c >= 0xD800 && c <= 0xDBFF && end - s >= 6 && s[0] == '\\' && s[1] == 'u' &&
+                    ( c2 = Sagan_JSON_Hex(s + 2) ) >= 0xDC00 && c2 <= 0xDFFF )
+                {
+                    c = 0x10000 + ( ( c - 0xD800 ) << 10 ) + ( c2 - 0xDC00 );
+                    s += 6;
+                }
+
+            if ( c < 0x80 )
+                {
+                    dst[n++] = (char)c;
+                }
+            else if ( c < 0x800 )
+                {
+
+                    if ( size - n < 2 )
+                        {
+                            break;
+                        }
+
+                    dst[n++] = (char)( 0xC0 | ( c >> 6 ) );
+                    dst[n++] = (char)( 0x80 | ( c & 0x3F ) );
+                }
+            else if ( c < 0x10000 )
+                {
+
+                    if ( size - n < 3 )
+                        {
+                            break;
+                        }
+
+                    dst[n++] = (char)( 0xE0 | ( c >> 12 ) );
+                    dst[n++] = (char)( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+                    dst[n++] = (char)( 0x80 | ( c & 0x3F ) );
+                }
+            else
+                {
+
+                    if ( size - n < 4 )
+                        {
+                            break;
+                        }
+
+                    dst[n++] = (char)( 0xF0 | ( c >> 18 ) );
+                    dst[n++] = (char)( 0x80 | ( ( c >> 12 ) & 0x3F ) );
+                    dst[n++] = (char)( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+                    dst[n++] = (char)( 0x80 | ( c & 0x3F ) );
+                }
+        }
+
+    return(n);
+}
+
+/* A string value that starts with '{'.  If it really is a JSON object,
+   search it as the next level down.  Strings that only look like JSON
+   are left alone. */
+
+static void Sagan_JSON_Embedded( struct _Sagan_JSON_Walk *walk, const struct _Sagan_JSON_Value *value, int level )
+{
+
+    struct _Sagan_JSON_Walk check = { 0 };
+    struct _Sagan_JSON_Value tmp;
+
+    char *json = (char *)value->ptr;
+    size_t len = value->len;
+
+    const char *end = walk->end;
+    const char *p;
+
+    if ( value->escaped == true )
+        {
+            len = Sagan_JSON_Decode(json, len, json, len);
+        }
+
+    check.end = json + len;
+
+    p = Sagan_JSON_Value(&check, json, 0, -1, &tmp);
+
+    if ( p == NULL || tmp.type != SAGAN_JSON_OBJECT )
+        {
+            return;
+        }
+
+    walk->end = json + len;
+    (void)Sagan_JSON_Value(walk, json, 0, level, &tmp);
+    walk->end = end;
+}
+
+/* "p" is on the '{'.  "level" is this object's search level,  -1 if it
+   is not searched */
+
+static const char *Sagan_JSON_Object( struct _Sagan_JSON_Walk *walk, const char *p, int depth, int level )
+{
+
+    struct _Sagan_JSON_Value value;
+
+    char key_buf[SAGAN_JSON_MAX_KEY];
+    const char *key;
+    size_t key_len;
+    bool escaped;
+
+    bool search = false;
+    uint16_t nest = 0;
+
+    if ( depth > SAGAN_JSON_MAX_DEPTH )
+        {
+            return(NULL);
+        }
+
+    if ( walk->callback != NULL && level >= 0 && level < walk->levels && walk->nest < walk->max_nest )
+        {
+            search = true;
+            nest = walk->nest++;
+        }
+
+    p = Sagan_JSON_Space(p + 1, walk->end);
+
+    if ( p < walk->end && *p == '}' )
+        {
+            return(p + 1);
+        }
+
+    for ( ;; )
+        {
+
+            if ( p >= walk->end || *p != '"' )
+                {
+                    return(NULL);
+                }
+
+            key = p + 1;
+            p = Sagan_JSON_String_End(key, walk->end, &escaped);
+
+            if ( p == NULL )
+                {
+                    return(NULL);
+                }
+
+            key_len = p - key;
+
+            p = Sagan_JSON_Space(p + 1, walk->end);
+
+            if ( p >= walk->end || *p != ':' )
+                {
+                    return(NULL);
+                }
+
+            p = Sagan_JSON_Space(p + 1, walk->end);
+            p = Sagan_JSON_Value(walk, p, depth, search ? level + 1 : -1, &value);
+
+            if ( p == NULL )
+                {
+                    return(NULL);
+                }
+
+            if ( search == true )
+                {
+
+                    if ( escaped == true )
+                        {
+                            key_len = Sagan_JSON_Decode(key, key_len, key_buf, sizeof(key_buf));
+                            key = key_buf;
+                        }
+
+                    walk->callback(walk->data, nest, key, key_len, &value);
+
+                    if ( value.type == SAGAN_JSON_STRING && value.len > 0 && value.ptr[0] == '{' &&
+                            level + 1 < walk->levels )
+                        {
+                            Sagan_JSON_Embedded(walk, &value, level + 1);
+                        }
+                }
+
+            p = Sagan_JSON_Space(p, walk->end);
+
+            if ( p >= walk->end )
+                {
+                    return(NULL);
+                }
+
+            if ( *p == '}' )
+                {
+                    return(p + 1);
+                }
+
+            if ( *p != ',' )
+                {
+                    return(NULL);
+                }
+
+            p = Sagan_JSON_Space(p + 1, walk->end);
+        }
+}
+
+/* Objects inside of arrays are never searched */
+
+static const char *Sagan_JSON_Array( struct _Sagan_JSON_Walk *walk, const char *p, int depth )
+{
+
+    struct _Sagan_JSON_Value value;
+
+    if ( depth > SAGAN_JSON_MAX_DEPTH )
+        {
+            return(NULL);
+        }
+
+    p = Sagan_JSON_Space(p + 1, walk->end);
+
+    if ( p < walk->end && *p == ']' )
+        {
+            return(p + 1);
+        }
+
+    for ( ;; )
+        {
+
+            p = Sagan_JSON_Value(walk, p, depth, -1, &value);
+
+            if ( p == NULL )
+                {
+                    return(NULL);
+                }
+
+            p = Sagan_JSON_Space(p, walk->end);
+
+            if ( p >= walk->end )
+                {
+                    return(NULL);
+                }
+
+            if ( *p == ']' )
+                {
+                    return(p + 1);
+                }
+
+            if ( *p != ',' )
+                {
+                    return(NULL);
+                }
+
+            p = Sagan_JSON_Space(p + 1, walk->end);
+        }
+}
+
+static const char *Sagan_JSON_Literal( const char *p, const char *end, const char *literal, size_t len )
+{
+
+    if ( (size_t)( end - p ) < len || memcmp(p, literal, len) != 0 )
+        {
+            return(NULL);
+        }
+
+    return(p + len);
+}
+
+/* Parses the value at "p" into "value".  Returns the first byte after it,
+   or NULL if it isn't valid */
+
+static const char *Sagan_JSON_Value( struct _Sagan_JSON_Walk *walk, const char *p, int depth, int level, struct _Sagan_JSON_Value *value )
+{
+
+    const char *start = p;
+
+    if ( p >= walk->end )
+        {
+            return(NULL);
+        }
+
+    value->escaped = false;
+
+    switch ( *p )
+        {
+
+        case '"':
+
+            value->type = SAGAN_JSON_STRING;
+            value->ptr = p + 1;
+
+            p = Sagan_JSON_String_End(p + 1, walk->end, &value->escaped);
+
+            if ( p == NULL )
+                {
+                    return(NULL);
+                }
+
+            value->len = p - value->ptr;
+            return(p + 1);
+
+        case '{':
+            value->type = SAGAN_JSON_OBJECT;
+            p = Sagan_JSON_Object(walk, p, depth + 1, level);
+            break;
+
+        case '[':
+            value->type = SAGAN_JSON_ARRAY;
+            p = Sagan_JSON_Array(walk, p, depth + 1);
+            break;
+
+        case 't':
+            value->type = SAGAN_JSON_TRUE;
+            p = Sagan_JSON_Literal(p, walk->end, "true", 4);
+            break;
+
+        case 'f':
+            value->type = SAGAN_JSON_FALSE;
+            p = Sagan_JSON_Literal(p, walk->end, "false", 5);
+            break;
+
+        case 'n':
+            value->type = SAGAN_JSON_NULL;
+            p = Sagan_JSON_Literal(p, walk->end, "null", 4);
+            break;
+
+        default:
+
+            value->type = SAGAN_JSON_NUMBER;
+
+            while ( p < walk->end && ( ( *p >= '0' && *p <= '9' ) || *p == '-' || *p == '+' ||
+                                       *p == '.' || *p == 'e' || *p == 'E' ) )
+                {
+                    p++;
+                }
+
+            if ( p == start )
+                {
+                    return(NULL);
+                }
+
+            break;
+        }
+
+    if ( p == NULL )
+        {
+            return(NULL);
+        }
+
+    value->ptr = start;
+    value->len = p - start;
+
+    return(p);
+}
+
+/*****************************************************************************
+ * Sagan_JSON_Walk - Scans "len" bytes of "json",  calling "callback" for
+ * the keys in up to "max_nest" objects "levels" deep.  If "nests" isn't
+ * NULL it's set to how many objects were searched.  Returns false if the
+ * JSON is malformed (the callback may already have been called).
+ *****************************************************************************/
+
+bool Sagan_JSON_Walk( char *json, size_t len, unsigned char levels, uint16_t max_nest, uint16_t *nests, Sagan_JSON_Callback callback, void *data )
+{
+
+    struct _Sagan_JSON_Walk walk = { 0 };
+    struct _Sagan_JSON_Value value;
+
+    const char *p;
+
+    walk.end = json + len;
+    walk.levels = levels;
+    walk.max_nest = max_nest;
+    walk.callback = callback;
+    walk.data = data;
+
+    p = Sagan_JSON_Space(json, walk.end);
+    p = Sagan_JSON_Value(&walk, p, 0, 0, &value);
+
+    if ( nests != NULL )
+        {
+            *nests = walk.nest;
+        }
+
+    return( p != NULL );
+}
+
+/*****************************************************************************
+ * Sagan_JSON_Copy - Copies "value" into "dst" (strlcpy() style,  always
+ * terminated).  Strings are unescaped,  anything else is copied as the
+ * JSON text and "null" is copied as an empty string.  Returns the length
+ * copied.
+ *****************************************************************************/
+
+size_t Sagan_JSON_Copy( const struct _Sagan_JSON_Value *value, char *dst, size_t size )
+{
+
+    size_t n;
+
+    if ( size == 0 )
+        {
+            return(0);
+        }
+
+    if ( value->type == SAGAN_JSON_NULL )
+        {
+            dst[0] = '\0';
+            return(0);
+        }
+
+    if ( value->escaped == true )
+        {
+            n = Sagan_JSON_Decode(value->ptr, value->len, dst, size - 1);
+        }
+    else
+        {
+            n = value->len < size - 1 ? value->len : size - 1;
+            memcpy(dst, value->ptr, n);
+        }
+
+    dst[n] = '\0';
+
+    return(n);
+}
+
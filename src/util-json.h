@@ -0,0 +1,63 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-json.h
+ *
+ * Streaming (no tree,  no allocation) JSON scanner used by the JSON input
+ * and message parsers.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#define SAGAN_JSON_MAX_DEPTH	32		/* Same as the libfastjson tokener */
+#define SAGAN_JSON_MAX_KEY	128		/* Longer (escaped) keys are truncated */
+
+#define SAGAN_JSON_STRING	1
+#define SAGAN_JSON_NUMBER	2
+#define SAGAN_JSON_TRUE		3
+#define SAGAN_JSON_FALSE	4
+#define SAGAN_JSON_NULL		5
+#define SAGAN_JSON_OBJECT	6
+#define SAGAN_JSON_ARRAY	7
+
+/* A value as it sits in the input.  Strings point between the quotes and
+   still have their escapes,  everything else is the raw JSON text. */
+
+typedef struct _Sagan_JSON_Value _Sagan_JSON_Value;
+struct _Sagan_JSON_Value
+{
+    unsigned char type;
+    bool escaped;				/* String contains a '\' */
+    const char *ptr;
+    size_t len;
+};
+
+/* Called for every key/value in the objects being searched.  "nest" is
+   which of those objects the key is in,  counted in the order they open
+   (the top level object is 0). */
+
+typedef void (*Sagan_JSON_Callback)( void *, uint16_t, const char *, size_t, const struct _Sagan_JSON_Value * );
+
+bool Sagan_JSON_Walk( char *, size_t, unsigned char, uint16_t, uint16_t *, Sagan_JSON_Callback, void * );
+size_t Sagan_JSON_Copy( const struct _Sagan_JSON_Value *, char *, size_t );
+
@@ -0,0 +1,348 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-mpmc.c
+ *
+ * The bounded lock free queue behind util-ring.c (log batches from the
+ * readers to the processors) and output-queue.c (alerts from the
+ * processors to the output threads).  Slots are allocated once by
+ * Sagan_MPMC_Init().  Each caller's slot type starts with a
+ * _Sagan_MPMC_Slot and the rest of it is theirs.
+ *
+ * Every slot carries a "sequence" which tells producers and consumers what
+ * state it's in (see D. Vyukov's bounded MPMC queue):
+ *
+ *      sequence == position                 - Free,  a producer may reserve it.
+ *      sequence == position + 1             - Published,  a consumer may claim it.
+ *      sequence == position + size          - Released,  free for the next lap.
+ *
+ * The mutex/conditions are only touched when a thread has nothing to do and
+ * goes to sleep.  The hot path is a single compare & swap.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "util-mpmc.h"
+
+#define SAGAN_MPMC_SPIN		128		/* Attempts before sleeping */
+#define SAGAN_MPMC_YIELD	16		/* Attempts before sched_yield() */
+#define SAGAN_MPMC_SLEEP_MS	100		/* Max sleep before checking again */
+
+#define SAGAN_MPMC_SLOT(queue, pos)	( (struct _Sagan_MPMC_Slot *)( (queue)->slot + ( (pos) & (queue)->mask ) * (queue)->stride ) )
+
+/****************************************************************************
+ * Sagan_MPMC_Init - Sets up "queue" with "size" slots (rounded up to a
+ * power of 2) of "stride" bytes each.  The slots are zeroed and returned
+ * so the caller can set up the rest of each one.
+ ****************************************************************************/
+
+void *Sagan_MPMC_Init( struct _Sagan_MPMC *queue, int size, size_t stride )
+{
+
+    uint64_t queue_size = 2;
+    uint64_t i;
+
+    while ( queue_size < (uint64_t)size )
+        {
+            queue_size = queue_size << 1;
+        }
+
+    memset(queue, 0, sizeof(struct _Sagan_MPMC));
+
+    if ( posix_memalign((void **)&queue->slot, SAGAN_MPMC_CACHE_LINE, queue_size * stride) != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for queue slots. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(queue->slot, 0, queue_size * stride);
+
+    queue->size = queue_size;
+    queue->mask = queue_size - 1;
+    queue->stride = stride;
+
+    for ( i = 0; i < queue_size; i++ )
+        {
+            SAGAN_MPMC_SLOT(queue, i)->sequence = i;
+        }
+
+    pthread_mutex_init(&queue->wait_mutex, NULL);
+    pthread_cond_init(&queue->producer_cond, NULL);
+    pthread_cond_init(&queue->consumer_cond, NULL);
+
+    return(queue->slot);
+}
+
+/****************************************************************************
+ * Non-blocking reserve/claim.  Return NULL when the queue is full/empty.
+ ****************************************************************************/
+
+static struct _Sagan_MPMC_Slot *Sagan_MPMC_Try_Reserve( struct _Sagan_MPMC *queue )
+{
+
+    struct _Sagan_MPMC_Slot *slot = NULL;
+    uint64_t pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    int64_t dif;
+
+    for (;;)
+        {
+
+            slot = SAGAN_MPMC_SLOT(queue, pos);
+            dif = (int64_t)__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (int64_t)pos;
+
+            if ( dif == 0 )
+                {
+
+                    if ( __atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+                        {
+                            slot->position = pos;
+                            return(slot);
+                        }
+                }
+
+            else if ( dif < 0 )
+                {
+                    return(NULL);		/* Full */
+                }
+
+            else
+                {
+                    pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+                }
+        }
+}
+
+static struct _Sagan_MPMC_Slot *Sagan_MPMC_Try_Claim( struct _Sagan_MPMC *queue )
+{
+
+    struct _Sagan_MPMC_Slot *slot = NULL;
+    uint64_t pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    int64_t dif;
+
+    for (;;)
+        {
+
+            slot = SAGAN_MPMC_SLOT(queue, pos);
+            dif = (int64_t)__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (int64_t)(pos + 1);
+
+            if ( dif == 0 )
+                {
+
+                    if ( __atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+                        {
+                            return(slot);
+                        }
+                }
+
+            else if ( dif < 0 )
+                {
+                    return(NULL);		/* Empty */
+                }
+
+            else
+                {
+                    pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+                }
+        }
+}
+
+/****************************************************************************
+ * Sagan_MPMC_Sleep - Sleeps (at most SAGAN_MPMC_SLEEP_MS) until "cond" is
+ * signaled.  The "ready" check is made under the mutex after announcing we
+ * are waiting,  so a wake up can't be missed.
+ ****************************************************************************/
+
+static void Sagan_MPMC_Sleep( struct _Sagan_MPMC *queue, pthread_cond_t *cond, int *waiting, bool consumer )
+{
+
+    struct timespec ts;
+    uint64_t pos;
+    uint64_t expect;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    ts.tv_nsec = ts.tv_nsec + ( SAGAN_MPMC_SLEEP_MS * 1000000L );
+
+    if ( ts.tv_nsec >= 1000000000L )
+        {
+            ts.tv_sec++;
+            ts.tv_nsec = ts.tv_nsec - 1000000000L;
+        }
+
+    pthread_mutex_lock(&queue->wait_mutex);
+
+    __atomic_add_fetch(waiting, 1, __ATOMIC_SEQ_CST);
+
+    if ( consumer == true )
+        {
+            pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_SEQ_CST);
+            expect = pos + 1;
+        }
+    else
+        {
+            pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_SEQ_CST);
+            expect = pos;
+        }
+
+    if ( __atomic_load_n(&SAGAN_MPMC_SLOT(queue, pos)->sequence, __ATOMIC_SEQ_CST) != expect )
+        {
+            pthread_cond_timedwait(cond, &queue->wait_mutex, &ts);
+        }
+
+    __atomic_sub_fetch(waiting, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&queue->wait_mutex);
+}
+
+static void Sagan_MPMC_Wake( struct _Sagan_MPMC *queue, pthread_cond_t *cond, int *waiting )
+{
+
+    if ( __atomic_load_n(waiting, __ATOMIC_SEQ_CST) > 0 )
+        {
+            pthread_mutex_lock(&queue->wait_mutex);
+            pthread_cond_signal(cond);
+            pthread_mutex_unlock(&queue->wait_mutex);
+        }
+}
+
+/****************************************************************************
+ * Sagan_MPMC_Reserve - Reserves a free slot for the producer to fill.  If
+ * "block" is false,  NULL is returned when the queue is full.
+ ****************************************************************************/
+
+void *Sagan_MPMC_Reserve( struct _Sagan_MPMC *queue, bool block )
+{
+
+    struct _Sagan_MPMC_Slot *slot = NULL;
+    int attempts = 0;
+
+    while ( ( slot = Sagan_MPMC_Try_Reserve(queue) ) == NULL )
+        {
+
+            if ( block == false )
+                {
+                    return(NULL);
+                }
+
+            attempts++;
+
+            if ( attempts < SAGAN_MPMC_YIELD )
+                {
+                    continue;
+                }
+
+            if ( attempts < SAGAN_MPMC_SPIN )
+                {
+                    sched_yield();
+                    continue;
+                }
+
+            Sagan_MPMC_Sleep(queue, &queue->producer_cond, &queue->producer_waiting, false);
+        }
+
+    return(slot);
+}
+
+/****************************************************************************
+ * Sagan_MPMC_Publish - Hands a filled slot to the consumers.
+ ****************************************************************************/
+
+void Sagan_MPMC_Publish( struct _Sagan_MPMC *queue, void *data )
+{
+
+    struct _Sagan_MPMC_Slot *slot = (struct _Sagan_MPMC_Slot *)data;
+
+    __atomic_store_n(&slot->sequence, slot->position + 1, __ATOMIC_SEQ_CST);
+
+    Sagan_MPMC_Wake(queue, &queue->consumer_cond, &queue->consumer_waiting);
+}
+
+/****************************************************************************
+ * Sagan_MPMC_Claim - Claims a published slot.  Returns NULL if nothing
+ * arrived within SAGAN_MPMC_SLEEP_MS so the caller can check for shutdown.
+ ****************************************************************************/
+
+void *Sagan_MPMC_Claim( struct _Sagan_MPMC *queue )
+{
+
+    struct _Sagan_MPMC_Slot *slot = NULL;
+    int attempts = 0;
+
+    while ( ( slot = Sagan_MPMC_Try_Claim(queue) ) == NULL )
+        {
+
+            attempts++;
+
+            if ( attempts < SAGAN_MPMC_YIELD )
+                {
+                    continue;
+                }
+
+            if ( attempts < SAGAN_MPMC_SPIN )
+                {
+                    sched_yield();
+                    continue;
+                }
+
+            Sagan_MPMC_Sleep(queue, &queue->consumer_cond, &queue->consumer_waiting, true);
+
+            return(Sagan_MPMC_Try_Claim(queue));
+        }
+
+    return(slot);
+}
+
+/****************************************************************************
+ * Sagan_MPMC_Release - Gives a consumed slot back to the producers.
+ ****************************************************************************/
+
+void Sagan_MPMC_Release( struct _Sagan_MPMC *queue, void *data )
+{
+
+    struct _Sagan_MPMC_Slot *slot = (struct _Sagan_MPMC_Slot *)data;
+
+    __atomic_store_n(&slot->sequence, slot->position + queue->size, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&queue->release_count, 1, __ATOMIC_SEQ_CST);
+
+    Sagan_MPMC_Wake(queue, &queue->producer_cond, &queue->producer_waiting);
+}
+
+/****************************************************************************
+ * Sagan_MPMC_Pending - Slots reserved/published/being consumed.
+ ****************************************************************************/
+
+uint64_t Sagan_MPMC_Pending( struct _Sagan_MPMC *queue )
+{
+
+    return( __atomic_load_n(&queue->enqueue_pos, __ATOMIC_SEQ_CST) - __atomic_load_n(&queue->release_count, __ATOMIC_SEQ_CST) );
+}
@@ -0,0 +1,73 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-mpmc.h
+ *
+ * Bounded lock free (multi-producer/multi-consumer) queue of fixed size
+ * slots.  See util-mpmc.c
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#define SAGAN_MPMC_CACHE_LINE	64
+
+/* Every slot type kept in a _Sagan_MPMC starts with this */
+
+typedef struct _Sagan_MPMC_Slot _Sagan_MPMC_Slot;
+struct _Sagan_MPMC_Slot
+{
+    uint64_t sequence;				/* Slot state (see util-mpmc.c) */
+    uint64_t position;				/* Queue position the slot was reserved at */
+};
+
+typedef struct _Sagan_MPMC _Sagan_MPMC;
+struct _Sagan_MPMC
+{
+
+    uint64_t enqueue_pos __attribute__ ((aligned (SAGAN_MPMC_CACHE_LINE)));
+    uint64_t dequeue_pos __attribute__ ((aligned (SAGAN_MPMC_CACHE_LINE)));
+    uint64_t release_count __attribute__ ((aligned (SAGAN_MPMC_CACHE_LINE)));
+
+    /* Only used when a producer or consumer has to sleep */
+
+    int producer_waiting __attribute__ ((aligned (SAGAN_MPMC_CACHE_LINE)));
+    int consumer_waiting;
+
+    pthread_mutex_t wait_mutex;
+    pthread_cond_t producer_cond;
+    pthread_cond_t consumer_cond;
+
+    uint64_t size;				/* Power of 2 */
+    uint64_t mask;
+    size_t stride;				/* sizeof() the caller's slot type */
+
+    char *slot;
+
+};
+
+void *Sagan_MPMC_Init( struct _Sagan_MPMC *, int, size_t );
+void *Sagan_MPMC_Reserve( struct _Sagan_MPMC *, bool );
+void Sagan_MPMC_Publish( struct _Sagan_MPMC *, void * );
+void *Sagan_MPMC_Claim( struct _Sagan_MPMC * );
+void Sagan_MPMC_Release( struct _Sagan_MPMC *, void * );
+uint64_t Sagan_MPMC_Pending( struct _Sagan_MPMC * );
@@ -0,0 +1,349 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-pcre.c
+ *
+ * Rule "pcre" compiling and matching.  With libpcre2 every processor
+ * thread gets its own match data,  match context (carrying the
+ * "pcre-match-limit"/"pcre-depth-limit" settings) and JIT stack.  With
+ * the older libpcre the limits are set in each pattern's pcre_extra and
+ * JIT stacks are still per thread (handed out by a callback).
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "util-counters.h"
+
+struct _SaganConfig *config;
+
+#ifdef HAVE_PCRE2
+
+static __thread pcre2_match_data *Sagan_PCRE_Match_Data = NULL;
+static __thread pcre2_match_context *Sagan_PCRE_Match_Context = NULL;
+static __thread pcre2_jit_stack *Sagan_PCRE_JIT_Stack = NULL;
+
+static __thread uint32_t Sagan_PCRE_Match_Limit = 0;
+static __thread uint32_t Sagan_PCRE_Depth_Limit = 0;
+
+/* Sets up this thread's match data/context the first time it's needed.
+   The limits are re-applied if a reload changed them */
+
+static void Sagan_PCRE_Thread_Setup( void )
+{
+
+    if ( Sagan_PCRE_Match_Data == NULL )
+        {
+
+            Sagan_PCRE_Match_Data = pcre2_match_data_create(PCRE_OVECCOUNT / 3, NULL);
+            Sagan_PCRE_Match_Context = pcre2_match_context_create(NULL);
+
+            if ( Sagan_PCRE_Match_Data == NULL || Sagan_PCRE_Match_Context == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for PCRE match data. Abort!", __FILE__, __LINE__);
+                }
+
+            if ( config->pcre_jit == true )
+                {
+
+                    Sagan_PCRE_JIT_Stack = pcre2_jit_stack_create(SAGAN_PCRE_JIT_STACK_START, SAGAN_PCRE_JIT_STACK_MAX, NULL);
+
+                    /* Without one,  PCRE uses a small stack on the machine stack */
+
+                    if ( Sagan_PCRE_JIT_Stack != NULL )
+                        {
+                            pcre2_jit_stack_assign(Sagan_PCRE_Match_Context, NULL, Sagan_PCRE_JIT_Stack);
+                        }
+                }
+
+            Sagan_PCRE_Match_Limit = 0;
+            Sagan_PCRE_Depth_Limit = 0;
+        }
+
+    if ( Sagan_PCRE_Match_Limit != config->pcre_match_limit )
+        {
+            Sagan_PCRE_Match_Limit = config->pcre_match_limit;
+            pcre2_set_match_limit(Sagan_PCRE_Match_Context, Sagan_PCRE_Match_Limit != 0 ? Sagan_PCRE_Match_Limit : UINT32_MAX);
+        }
+
+    if ( Sagan_PCRE_Depth_Limit != config->pcre_depth_limit )
+        {
+            Sagan_PCRE_Depth_Limit = config->pcre_depth_limit;
+            pcre2_set_depth_limit(Sagan_PCRE_Match_Context, Sagan_PCRE_Depth_Limit != 0 ? Sagan_PCRE_Depth_Limit : UINT32_MAX);
+        }
+}
+
+#else
+
+#ifdef PCRE_HAVE_JIT
+
+static pcre_jit_stack *Sagan_PCRE_JIT_Stack_Get( void *data )
+{
+
+    static __thread pcre_jit_stack *stack = NULL;
+
+    if ( stack == NULL )
+        {
+            stack = pcre_jit_stack_alloc(SAGAN_PCRE_JIT_STACK_START, SAGAN_PCRE_JIT_STACK_MAX);
+        }
+
+    return(stack);
+}
+
+#endif
+
+#endif
+
+/*****************************************************************************
+ * Sagan_PCRE_JIT_Available - Was the PCRE library built with JIT?
+ *****************************************************************************/
+
+bool Sagan_PCRE_JIT_Available( void )
+{
+
+#ifdef HAVE_PCRE2
+
+    uint32_t jit = 0;
+
+    pcre2_config(PCRE2_CONFIG_JIT, &jit);
+    return( jit == 1 );
+
+#elif defined(PCRE_HAVE_JIT)
+
+    int jit = 0;
+
+    pcre_config(PCRE_CONFIG_JIT, &jit);
+    return( jit == 1 );
+
+#else
+
+    return(false);
+
+#endif
+}
+
+/*****************************************************************************
+ * Sagan_PCRE_Version - Library name and version for the startup banner
+ *****************************************************************************/
+
+const char *Sagan_PCRE_Version( void )
+{
+
+    static char version[64] = { 0 };
+
+#ifdef HAVE_PCRE2
+
+    char tmp[32] = { 0 };
+
+    pcre2_config(PCRE2_CONFIG_VERSION, tmp);
+    snprintf(version, sizeof(version), "%s (pcre2)", tmp);
+
+#else
+
+    snprintf(version, sizeof(version), "%s", pcre_version());
+
+#endif
+
+    return(version);
+}
+
+/*****************************************************************************
+ * Sagan_PCRE_Compile - Compiles "pattern" (and JIT compiles it if enabled).
+ * On failure "error" holds the reason and false is returned.
+ *****************************************************************************/
+
+bool Sagan_PCRE_Compile( struct _Sagan_PCRE *pcre, const char *pattern, uint32_t options, char *error, size_t error_size )
+{
+
+    memset(pcre, 0, sizeof(struct _Sagan_PCRE));
+
+#ifdef HAVE_PCRE2
+
+    unsigned char tmp[256] = { 0 };
+    int errorcode = 0;
+    PCRE2_SIZE erroffset = 0;
+
+    pcre->re = pcre2_compile((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED, options, &errorcode, &erroffset, NULL);
+
+    if ( pcre->re == NULL )
+        {
+            pcre2_get_error_message(errorcode, tmp, sizeof(tmp));
+            snprintf(error, error_size, "%d: %s", (int)erroffset, tmp);
+            return(false);
+        }
+
+    if ( config->pcre_jit == true && pcre2_jit_compile(pcre->re, PCRE2_JIT_COMPLETE) == 0 )
+        {
+            pcre->jit = true;
+        }
+
+#else
+
+    const char *tmp = NULL;
+    int erroffset = 0;
+    int study_options = 0;
+
+    pcre->re = pcre_compile(pattern, options, &tmp, &erroffset, NULL);
+
+    if ( pcre->re == NULL )
+        {
+            snprintf(error, error_size, "%d: %s", erroffset, tmp);
+            return(false);
+        }
+
+#ifdef PCRE_HAVE_JIT
+
+    if ( config->pcre_jit == true )
+        {
+            study_options |= PCRE_STUDY_JIT_COMPILE;
+        }
+
+#endif
+
+    pcre->extra = pcre_study(pcre->re, study_options, &tmp);
+
+    /* pcre_study() returns NULL when it has nothing to add,  but the
+       limits need somewhere to live */
+
+    if ( pcre->extra == NULL && ( config->pcre_match_limit != 0 || config->pcre_depth_limit != 0 ) )
+        {
+
+            pcre->extra = pcre_malloc(sizeof(pcre_extra));
+
+            if ( pcre->extra == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for pcre_extra. Abort!", __FILE__, __LINE__);
+                }
+
+            memset(pcre->extra, 0, sizeof(pcre_extra));
+        }
+
+    if ( config->pcre_match_limit != 0 )
+        {
+            pcre->extra->flags |= PCRE_EXTRA_MATCH_LIMIT;
+            pcre->extra->match_limit = config->pcre_match_limit;
+        }
+
+#ifndef NO_PCRE_MATCH_RLIMIT
+
+    if ( config->pcre_depth_limit != 0 )
+        {
+            pcre->extra->flags |= PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+            pcre->extra->match_limit_recursion = config->pcre_depth_limit;
+        }
+
+#endif
+
+#ifdef PCRE_HAVE_JIT
+
+    int jit = 0;
+
+    if ( config->pcre_jit == true && pcre->extra != NULL &&
+            pcre_fullinfo(pcre->re, pcre->extra, PCRE_INFO_JIT, &jit) == 0 && jit == 1 )
+        {
+            pcre->jit = true;
+            pcre_assign_jit_stack(pcre->extra, Sagan_PCRE_JIT_Stack_Get, NULL);
+        }
+
+#endif
+
+#endif
+
+    return(true);
+}
+
+/*****************************************************************************
+ * Sagan_PCRE_Exec - Runs a compiled pattern against "subject".  Returns
+ * SAGAN_PCRE_MATCH,  SAGAN_PCRE_NOMATCH,  SAGAN_PCRE_LIMIT or
+ * SAGAN_PCRE_ERROR.
+ *****************************************************************************/
+
+int Sagan_PCRE_Exec( struct _Sagan_PCRE *pcre, const char *subject, size_t length )
+{
+
+    int rc = 0;
+
+#ifdef HAVE_PCRE2
+
+    Sagan_PCRE_Thread_Setup();
+
+    if ( pcre->jit == true )
+        {
+            rc = pcre2_jit_match(pcre->re, (PCRE2_SPTR)subject, length, 0, 0, Sagan_PCRE_Match_Data, Sagan_PCRE_Match_Context);
+        }
+    else
+        {
+            rc = pcre2_match(pcre->re, (PCRE2_SPTR)subject, length, 0, 0, Sagan_PCRE_Match_Data, Sagan_PCRE_Match_Context);
+        }
+
+    if ( rc >= 0 )
+        {
+            return(SAGAN_PCRE_MATCH);
+        }
+
+    if ( rc == PCRE2_ERROR_NOMATCH )
+        {
+            return(SAGAN_PCRE_NOMATCH);
+        }
+
+    if ( rc == PCRE2_ERROR_MATCHLIMIT || rc == PCRE2_ERROR_DEPTHLIMIT )
+        {
+            Sagan_Counter_Add(pcre_limit, 1);
+            return(SAGAN_PCRE_LIMIT);
+        }
+
+#else
+
+    int ovector[PCRE_OVECCOUNT];
+
+    rc = pcre_exec(pcre->re, pcre->extra, subject, (int)length, 0, 0, ovector, PCRE_OVECCOUNT);
+
+    if ( rc >= 0 )
+        {
+            return(SAGAN_PCRE_MATCH);
+        }
+
+    if ( rc == PCRE_ERROR_NOMATCH )
+        {
+            return(SAGAN_PCRE_NOMATCH);
+        }
+
+    if ( rc == PCRE_ERROR_MATCHLIMIT || rc == PCRE_ERROR_RECURSIONLIMIT )
+        {
+            Sagan_Counter_Add(pcre_limit, 1);
+            return(SAGAN_PCRE_LIMIT);
+        }
+
+#endif
+
+    Sagan_Counter_Add(pcre_error, 1);
+    return(SAGAN_PCRE_ERROR);
+}
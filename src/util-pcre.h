@@ -0,0 +1,89 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-pcre.h
+ *
+ * Rule "pcre" compiling and matching.  libpcre2 (with JIT) is used when
+ * Sagan is built with it,  otherwise the older libpcre.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#ifdef HAVE_PCRE2
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+
+#define SAGAN_PCRE_CASELESS		PCRE2_CASELESS
+#define SAGAN_PCRE_DOTALL		PCRE2_DOTALL
+#define SAGAN_PCRE_MULTILINE		PCRE2_MULTILINE
+#define SAGAN_PCRE_EXTENDED		PCRE2_EXTENDED
+#define SAGAN_PCRE_ANCHORED		PCRE2_ANCHORED
+#define SAGAN_PCRE_DOLLAR_ENDONLY	PCRE2_DOLLAR_ENDONLY
+#define SAGAN_PCRE_UNGREEDY		PCRE2_UNGREEDY
+
+#else
+
+#include <pcre.h>
+
+#define SAGAN_PCRE_CASELESS		PCRE_CASELESS
+#define SAGAN_PCRE_DOTALL		PCRE_DOTALL
+#define SAGAN_PCRE_MULTILINE		PCRE_MULTILINE
+#define SAGAN_PCRE_EXTENDED		PCRE_EXTENDED
+#define SAGAN_PCRE_ANCHORED		PCRE_ANCHORED
+#define SAGAN_PCRE_DOLLAR_ENDONLY	PCRE_DOLLAR_ENDONLY
+#define SAGAN_PCRE_UNGREEDY		PCRE_UNGREEDY
+
+#endif
+
+/* JIT stacks are per thread.  They start small and grow as needed */
+
+#define SAGAN_PCRE_JIT_STACK_START	32768
+#define SAGAN_PCRE_JIT_STACK_MAX	1048576
+
+/* Sagan_PCRE_Exec() return values */
+
+#define SAGAN_PCRE_NOMATCH		0
+#define SAGAN_PCRE_MATCH		1
+#define SAGAN_PCRE_LIMIT		-1	/* Hit the match or depth limit */
+#define SAGAN_PCRE_ERROR		-2
+
+typedef struct _Sagan_PCRE _Sagan_PCRE;
+struct _Sagan_PCRE
+{
+
+#ifdef HAVE_PCRE2
+    pcre2_code *re;
+#else
+    pcre *re;
+    pcre_extra *extra;
+#endif
+
+    bool jit;					/* Compiled to machine code */
+
+};
+
+bool Sagan_PCRE_JIT_Available( void );
+const char *Sagan_PCRE_Version( void );
+bool Sagan_PCRE_Compile( struct _Sagan_PCRE *, const char *, uint32_t, char *, size_t );
+int  Sagan_PCRE_Exec( struct _Sagan_PCRE *, const char *, size_t );
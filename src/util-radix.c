@@ -0,0 +1,345 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-radix.c
+ *
+ * Path compressed binary radix (Patricia) tree of CIDR networks.  Keys are
+ * the MAXIPBIT form from IP2Bit(),  so IPv4 and IPv6 networks live in the
+ * same tree and match exactly like is_inrange() would.  A lookup walks at
+ * most one node per differing bit instead of testing every network.
+ *
+ * Trees are built once and never changed after they are published.  A
+ * reload builds a new tree and Sagan_Radix_Swap()s it in.  Lookups running
+ * at the time may still be in the old tree,  so it's only freed when the
+ * next tree replaces it.
+ *
+ * Nodes live in one array and refer to each other by index.  node[0] is
+ * a zero length root that every key is under.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "util-radix.h"
+
+#define SAGAN_RADIX_INITIAL_NODES	64
+
+/* Bit "n" of a key,  most significant first */
+
+static inline int Sagan_Radix_Bit( const unsigned char *key, int n )
+{
+    return( ( key[n >> 3] >> ( 7 - ( n & 7 ) ) ) & 1 );
+}
+
+/* Copies the first "bits" of "in" and zeros the rest */
+
+static void Sagan_Radix_Mask( unsigned char *out, const unsigned char *in, int bits )
+{
+
+    int bytes = bits >> 3;
+
+    memset(out, 0, MAXIPBIT);
+    memcpy(out, in, bytes);
+
+    if ( bits & 7 )
+        {
+            out[bytes] = in[bytes] & (unsigned char)( 0xFF << ( 8 - ( bits & 7 ) ) );
+        }
+}
+
+/* Number of leading bits "a" and "b" share,  up to "max" */
+
+static int Sagan_Radix_Common( const unsigned char *a, const unsigned char *b, int max )
+{
+
+    int i = 0;
+    unsigned char diff;
+
+    while ( i < max )
+        {
+
+            diff = a[i >> 3] ^ b[i >> 3];
+
+            if ( diff == 0 )
+                {
+                    i = ( i | 7 ) + 1;
+                    continue;
+                }
+
+            while ( ( diff & ( 0x80 >> ( i & 7 ) ) ) == 0 )
+                {
+                    i++;
+                }
+
+            break;
+        }
+
+    return( i < max ? i : max );
+}
+
+static uint32_t Sagan_Radix_New_Node( struct _Sagan_Radix *tree, const unsigned char *key, int bits, bool network )
+{
+
+    struct _Sagan_Radix_Node *node = NULL;
+
+    if ( tree->node_count == tree->node_size )
+        {
+
+            tree->node_size *= 2;
+            tree->node = realloc(tree->node, tree->node_size * sizeof(struct _Sagan_Radix_Node));
+
+            if ( tree->node == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for radix tree. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    node = &tree->node[tree->node_count];
+
+    Sagan_Radix_Mask(node->key, key, bits);
+    node->child[0] = SAGAN_RADIX_NONE;
+    node->child[1] = SAGAN_RADIX_NONE;
+    node->bits = bits;
+    node->network = network;
+
+    return( tree->node_count++ );
+}
+
+/*****************************************************************************
+ * Sagan_Radix_Init - Returns a new,  empty tree
+ *****************************************************************************/
+
+struct _Sagan_Radix *Sagan_Radix_Init( void )
+{
+
+    unsigned char zero[MAXIPBIT] = { 0 };
+
+    struct _Sagan_Radix *tree = malloc(sizeof(struct _Sagan_Radix));
+
+    if ( tree == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for radix tree. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(tree, 0, sizeof(struct _Sagan_Radix));
+
+    tree->node_size = SAGAN_RADIX_INITIAL_NODES;
+    tree->node = malloc(tree->node_size * sizeof(struct _Sagan_Radix_Node));
+
+    if ( tree->node == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for radix tree. Abort!", __FILE__, __LINE__);
+        }
+
+    (void)Sagan_Radix_New_Node(tree, zero, 0, false);
+
+    return(tree);
+}
+
+/*****************************************************************************
+ * Sagan_Radix_Add - Adds "ipbits"/"bits" to the tree.  Returns false if
+ * that network was already loaded.
+ *****************************************************************************/
+
+bool Sagan_Radix_Add( struct _Sagan_Radix *tree, const unsigned char *ipbits, int bits )
+{
+
+    unsigned char key[MAXIPBIT];
+
+    uint32_t n = 0;
+    uint32_t c;
+    uint32_t mid;
+    uint32_t leaf;
+
+    int b;
+    int common;
+
+    Sagan_Radix_Mask(key, ipbits, bits);
+
+    /* "n" is always a prefix of "key" */
+
+    for ( ;; )
+        {
+
+            if ( tree->node[n].bits == bits )
+                {
+
+                    if ( tree->node[n].network == true )
+                        {
+                            return(false);
+                        }
+
+                    tree->node[n].network = true;
+                    tree->count++;
+                    return(true);
+                }
+
+            b = Sagan_Radix_Bit(key, tree->node[n].bits);
+            c = tree->node[n].child[b];
+
+            if ( c == SAGAN_RADIX_NONE )
+                {
+                    leaf = Sagan_Radix_New_Node(tree, key, bits, true);
+                    tree->node[n].child[b] = leaf;
+                    tree->count++;
+                    return(true);
+                }
+
+            common = Sagan_Radix_Common(tree->node[c].key, key, tree->node[c].bits < bits ? tree->node[c].bits : bits);
+
+            if ( common == tree->node[c].bits )
+                {
+                    n = c;
+                    continue;
+                }
+
+            /* "key" leaves the child's path part way down.  Put a node
+               where they split and hang both off of it */
+
+            mid = Sagan_Radix_New_Node(tree, key, common, common == bits);
+            tree->node[mid].child[ Sagan_Radix_Bit(tree->node[c].key, common) ] = c;
+
+            if ( common != bits )
+                {
+                    leaf = Sagan_Radix_New_Node(tree, key, bits, true);
+                    tree->node[mid].child[ Sagan_Radix_Bit(key, common) ] = leaf;
+                }
+
+            tree->node[n].child[b] = mid;
+            tree->count++;
+            return(true);
+        }
+}
+
+/*****************************************************************************
+ * Sagan_Radix_Match - Returns true if "ipbits" is in any network in the
+ * tree.  We only need to know that it is covered,  so the walk stops at
+ * the first network found.
+ *****************************************************************************/
+
+bool Sagan_Radix_Match( struct _Sagan_Radix *tree, const unsigned char *ipbits )
+{
+
+    struct _Sagan_Radix_Node *node = NULL;
+    uint32_t n = 0;
+    int bytes;
+
+    if ( tree == NULL )
+        {
+            return(false);
+        }
+
+    for ( ;; )
+        {
+
+            node = &tree->node[n];
+
+            /* Only networks need their whole prefix compared.  Every node
+               below one shares its prefix,  so if it doesn't match nothing
+               further down will either */
+
+            if ( node->network == true )
+                {
+
+                    bytes = node->bits >> 3;
+
+                    if ( memcmp(node->key, ipbits, bytes) != 0 )
+                        {
+                            return(false);
+                        }
+
+                    if ( ( node->bits & 7 ) &&
+                            ( ( node->key[bytes] ^ ipbits[bytes] ) & (unsigned char)( 0xFF << ( 8 - ( node->bits & 7 ) ) ) ) )
+                        {
+                            return(false);
+                        }
+
+                    return(true);
+                }
+
+            if ( node->bits >= SAGAN_RADIX_BITS )
+                {
+                    return(false);
+                }
+
+            n = node->child[ Sagan_Radix_Bit(ipbits, node->bits) ];
+
+            if ( n == SAGAN_RADIX_NONE )
+                {
+                    return(false);
+                }
+        }
+}
+
+/*****************************************************************************
+ * Sagan_Radix_Swap - Publishes "tree" in "*current".  The tree it replaces
+ * is kept (lookups may still be using it) and the one before that is freed.
+ *****************************************************************************/
+
+void Sagan_Radix_Swap( struct _Sagan_Radix **current, struct _Sagan_Radix *tree )
+{
+
+    struct _Sagan_Radix *old = __atomic_exchange_n(current, tree, __ATOMIC_SEQ_CST);
+
+    if ( old == NULL )
+        {
+            return;
+        }
+
+    Sagan_Radix_Free(old->retired);
+    old->retired = NULL;
+
+    tree->retired = old;
+}
+
+/*****************************************************************************
+ * Sagan_Radix_Get - The currently published tree (or NULL)
+ *****************************************************************************/
+
+struct _Sagan_Radix *Sagan_Radix_Get( struct _Sagan_Radix **current )
+{
+    return( __atomic_load_n(current, __ATOMIC_ACQUIRE) );
+}
+
+/*****************************************************************************
+ * Sagan_Radix_Free - Frees a tree that is no longer published
+ *****************************************************************************/
+
+void Sagan_Radix_Free( struct _Sagan_Radix *tree )
+{
+
+    if ( tree == NULL )
+        {
+            return;
+        }
+
+    free(tree->node);
+    free(tree);
+}
@@ -0,0 +1,65 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-radix.h
+ *
+ * Path compressed binary radix (Patricia) tree of CIDR networks.  Used by
+ * the blacklist,  GeoIP and Bluedot "skip_networks".
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#define SAGAN_RADIX_NONE	0		/* Child index meaning "no child" */
+#define SAGAN_RADIX_BITS	( MAXIPBIT * 8 )
+
+typedef struct _Sagan_Radix_Node _Sagan_Radix_Node;
+struct _Sagan_Radix_Node
+{
+
+    unsigned char key[MAXIPBIT];		/* Bits past "bits" are zero */
+    uint32_t child[2];				/* Indexes into "node" */
+    unsigned char bits;				/* Prefix length of "key" */
+    bool network;				/* A loaded network ends here */
+
+};
+
+typedef struct _Sagan_Radix _Sagan_Radix;
+struct _Sagan_Radix
+{
+
+    struct _Sagan_Radix_Node *node;		/* node[0] is the root */
+    uint32_t node_count;
+    uint32_t node_size;
+
+    uint64_t count;				/* Networks loaded */
+
+    struct _Sagan_Radix *retired;		/* Tree this one replaced */
+
+};
+
+struct _Sagan_Radix *Sagan_Radix_Init( void );
+bool Sagan_Radix_Add( struct _Sagan_Radix *, const unsigned char *, int );
+bool Sagan_Radix_Match( struct _Sagan_Radix *, const unsigned char * );
+void Sagan_Radix_Swap( struct _Sagan_Radix **, struct _Sagan_Radix * );
+struct _Sagan_Radix *Sagan_Radix_Get( struct _Sagan_Radix ** );
+void Sagan_Radix_Free( struct _Sagan_Radix * );
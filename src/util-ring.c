@@ -0,0 +1,142 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-ring.c
+ *
+ * A bounded lock free ring used to hand batches of logs from the readers
+ * (see input-reactor.c) to the processor threads.  Slots and their buffers
+ * are allocated once.  Readers read or receive directly into a reserved
+ * slot and the processor works directly from the slot it claimed,  so a
+ * log line is never copied between the two.  The queue itself is
+ * util-mpmc.c.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "util-mpmc.h"
+#include "util-ring.h"
+
+/****************************************************************************
+ * Sagan_Ring_Init - Allocates a ring of "size" slots (rounded up to a power
+ * of 2) that each hold "batch" log lines.
+ ****************************************************************************/
+
+struct _Sagan_Ring *Sagan_Ring_Init( int size, int batch )
+{
+
+    struct _Sagan_Ring *ring = NULL;
+    uint64_t i;
+
+    if ( posix_memalign((void **)&ring, SAGAN_RING_CACHE_LINE, sizeof(struct _Sagan_Ring)) != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for ring. Abort!", __FILE__, __LINE__);
+        }
+
+    memset(ring, 0, sizeof(struct _Sagan_Ring));
+
+    ring->slot = Sagan_MPMC_Init(&ring->queue, size, sizeof(struct _Sagan_Ring_Slot));
+    ring->batch = batch;
+
+    for ( i = 0; i < ring->queue.size; i++ )
+        {
+
+            ring->slot[i].syslog = malloc(batch * sizeof(*ring->slot[i].syslog));
+            ring->slot[i].input_type = malloc(batch * sizeof(*ring->slot[i].input_type));
+            ring->slot[i].peer = malloc(batch * sizeof(*ring->slot[i].peer));
+
+            if ( ring->slot[i].syslog == NULL || ring->slot[i].input_type == NULL || ring->slot[i].peer == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for ring slot %" PRIu64 ". Abort!", __FILE__, __LINE__, i);
+                }
+
+            ring->slot[i].syslog[0][0] = '\0';
+        }
+
+    return(ring);
+}
+
+/****************************************************************************
+ * Sagan_Ring_Reserve - Reserves a free slot for the producer to fill.  If
+ * "block" is false,  NULL is returned when the ring is full.
+ ****************************************************************************/
+
+struct _Sagan_Ring_Slot *Sagan_Ring_Reserve( struct _Sagan_Ring *ring, bool block )
+{
+
+    struct _Sagan_Ring_Slot *slot = Sagan_MPMC_Reserve(&ring->queue, block);
+
+    if ( slot != NULL )
+        {
+            slot->count = 0;
+        }
+
+    return(slot);
+}
+
+/****************************************************************************
+ * Sagan_Ring_Publish - Hands a filled slot to the consumers.
+ ****************************************************************************/
+
+void Sagan_Ring_Publish( struct _Sagan_Ring *ring, struct _Sagan_Ring_Slot *slot )
+{
+    Sagan_MPMC_Publish(&ring->queue, slot);
+}
+
+/****************************************************************************
+ * Sagan_Ring_Claim - Claims a published slot.  Returns NULL if nothing
+ * arrived for a while so the caller can check for shutdown.
+ ****************************************************************************/
+
+struct _Sagan_Ring_Slot *Sagan_Ring_Claim( struct _Sagan_Ring *ring )
+{
+    return( Sagan_MPMC_Claim(&ring->queue) );
+}
+
+/****************************************************************************
+ * Sagan_Ring_Release - Gives a processed slot back to the producer.
+ ****************************************************************************/
+
+void Sagan_Ring_Release( struct _Sagan_Ring *ring, struct _Sagan_Ring_Slot *slot )
+{
+    Sagan_MPMC_Release(&ring->queue, slot);
+}
+
+/****************************************************************************
+ * Sagan_Ring_Pending - Slots reserved/published/being processed.
+ ****************************************************************************/
+
+uint64_t Sagan_Ring_Pending( struct _Sagan_Ring *ring )
+{
+
+    return( Sagan_MPMC_Pending(&ring->queue) );
+}
@@ -0,0 +1,64 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-ring.h
+ *
+ * Bounded lock free (multi-producer/multi-consumer) ring of syslog batches.
+ * Needs util-mpmc.h.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#define SAGAN_RING_CACHE_LINE	64
+
+typedef struct _Sagan_Ring_Slot _Sagan_Ring_Slot;
+struct _Sagan_Ring_Slot
+{
+
+    struct _Sagan_MPMC_Slot mpmc;		/* Must be first (see util-mpmc.c) */
+
+    int count;					/* Log lines in this batch */
+    char (*syslog)[MAX_SYSLOGMSG];		/* config->max_batch log lines */
+    unsigned char *input_type;			/* Parser for each line (INPUT_PIPE/INPUT_JSON/INPUT_SYSLOG) */
+    struct sockaddr_storage *peer;		/* Sender of each line (INPUT_SYSLOG only) */
+
+} __attribute__ ((aligned (SAGAN_RING_CACHE_LINE)));
+
+typedef struct _Sagan_Ring _Sagan_Ring;
+struct _Sagan_Ring
+{
+
+    struct _Sagan_MPMC queue;
+
+    int batch;
+
+    struct _Sagan_Ring_Slot *slot;
+
+};
+
+struct _Sagan_Ring *Sagan_Ring_Init( int, int );
+struct _Sagan_Ring_Slot *Sagan_Ring_Reserve( struct _Sagan_Ring *, bool );
+void Sagan_Ring_Publish( struct _Sagan_Ring *, struct _Sagan_Ring_Slot * );
+struct _Sagan_Ring_Slot *Sagan_Ring_Claim( struct _Sagan_Ring * );
+void Sagan_Ring_Release( struct _Sagan_Ring *, struct _Sagan_Ring_Slot * );
+uint64_t Sagan_Ring_Pending( struct _Sagan_Ring * );
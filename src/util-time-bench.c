@@ -0,0 +1,272 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-time-bench.c
+ *
+ * Times getting "now" the way Threshold2(),  After2(),  Check_Time() and
+ * friends used to (time(),  localtime(),  strftime("%s") and atol()) against
+ * Return_Epoch() and Return_Local_Time() reading the shared clock kept by
+ * Sagan_Clock_Thread().  Each is run by one thread and then by several at
+ * once,  since localtime() serializes threads on a lock.  Built with "make
+ * sagan-time-bench",  it isn't part of the normal build.
+ *
+ * Usage: sagan-time-bench [iterations] [threads]
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "sagan.h"
+#include "util-time.h"
+
+#define BENCH_DEFAULT_ITERATIONS	2000000
+#define BENCH_DEFAULT_THREADS		4
+#define BENCH_MAX_THREADS		64
+
+typedef uint64_t (*Bench_Func)( void );
+
+struct _Bench_Job
+{
+    Bench_Func func;
+    int iterations;
+    uint64_t result;
+};
+
+/* util-time.c wants these from the rest of Sagan */
+
+void Sagan_Log( int type, const char *format, ... )
+{
+
+    va_list ap;
+
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+
+    if ( type == ERROR )
+        {
+            exit(1);
+        }
+}
+
+char *Sagan_strstr( const char *haystack, const char *needle )
+{
+    return( strstr(haystack, needle) );
+}
+
+static uint64_t Bench_Now( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
+/* What Threshold2(),  After2(),  Track_Clients(),  etc used to do */
+
+static uint64_t Bench_Old_Epoch( void )
+{
+
+    time_t t;
+    struct tm *now;
+    char timet[20];
+
+    t = time(NULL);
+    now=localtime(&t);
+    strftime(timet, sizeof(timet), "%s",  now);
+
+    return(atol(timet));
+}
+
+static uint64_t Bench_Return_Epoch( void )
+{
+    return(Return_Epoch());
+}
+
+/* What Check_Time() used to do to get the day of the week and HHMM */
+
+static uint64_t Bench_Old_Aetas( void )
+{
+
+    char ct[64];
+    char buf[80];
+    char current_time_tmp[5];
+    char hour_tmp[3];
+    char minute_tmp[3];
+    int day_current;
+
+    time_t now;
+    struct tm ts;
+    time_t t;
+    struct tm *now_utime;
+
+    t = time(NULL);
+    now_utime=localtime(&t);
+    strftime(ct, sizeof(ct), "%s",  now_utime);
+    day_current = localtime(&t)->tm_wday;
+
+    time(&now);
+    ts = *localtime(&now);
+
+    strftime(hour_tmp, sizeof(hour_tmp), "%H", &ts);
+    strftime(minute_tmp, sizeof(minute_tmp), "%M", &ts);
+
+    snprintf(current_time_tmp, sizeof(current_time_tmp), "%s%s",  hour_tmp, minute_tmp);
+    strftime(buf, sizeof(buf), "%d", &ts);
+
+    return( day_current + atoi(current_time_tmp) );
+}
+
+static uint64_t Bench_Return_Local_Time( void )
+{
+
+    struct tm ts;
+
+    Return_Local_Time(&ts);
+
+    return( ts.tm_wday + ( ts.tm_hour * 100 ) + ts.tm_min );
+}
+
+static void *Bench_Thread( void *data )
+{
+
+    struct _Bench_Job *job = data;
+    uint64_t result = 0;
+    int i;
+
+    for ( i = 0; i < job->iterations; i++ )
+        {
+            result += job->func();
+        }
+
+    job->result = result;
+
+    return(NULL);
+}
+
+/* Returns wall clock ns per iteration,  with every thread doing "iterations"
+   calls at once */
+
+static double Bench_Run( Bench_Func func, int iterations, int threads )
+{
+
+    pthread_t thread[BENCH_MAX_THREADS];
+    struct _Bench_Job job[BENCH_MAX_THREADS];
+    uint64_t start;
+    int i;
+
+    start = Bench_Now();
+
+    for ( i = 0; i < threads; i++ )
+        {
+            job[i].func = func;
+            job[i].iterations = iterations;
+            job[i].result = 0;
+
+            if ( pthread_create(&thread[i], NULL, Bench_Thread, &job[i]) != 0 )
+                {
+                    fprintf(stderr, "pthread_create() failed\n");
+                    exit(1);
+                }
+        }
+
+    for ( i = 0; i < threads; i++ )
+        {
+            pthread_join(thread[i], NULL);
+        }
+
+    return( (double)( Bench_Now() - start ) / iterations );
+}
+
+int main( int argc, char **argv )
+{
+
+    pthread_t clock_thread;
+    struct tm tm_old;
+    struct tm tm_new;
+    time_t t;
+
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    int threads = BENCH_DEFAULT_THREADS;
+
+    if ( argc > 1 )
+        {
+            iterations = atoi(argv[1]);
+        }
+
+    if ( argc > 2 )
+        {
+            threads = atoi(argv[2]);
+        }
+
+    if ( iterations <= 0 || threads <= 0 || threads > BENCH_MAX_THREADS )
+        {
+            fprintf(stderr, "Usage: %s [iterations] [threads (1-%d)]\n", argv[0], BENCH_MAX_THREADS);
+            return(1);
+        }
+
+    if ( pthread_create(&clock_thread, NULL, (void *)Sagan_Clock_Thread, NULL) != 0 )
+        {
+            fprintf(stderr, "pthread_create() failed\n");
+            return(1);
+        }
+
+    while ( Return_Epoch() != (uint64_t)time(NULL) || Bench_Old_Epoch() != Return_Epoch() )
+        {
+            sched_yield();
+        }
+
+    /* Same answers first (can be a second apart if the clock just ticked) */
+
+    t = time(NULL);
+    localtime_r(&t, &tm_old);
+    Return_Local_Time(&tm_new);
+
+    if ( Return_Epoch() + 1 < (uint64_t)t || tm_old.tm_wday != tm_new.tm_wday || tm_old.tm_hour != tm_new.tm_hour )
+        {
+            fprintf(stderr, "Cached clock doesn't match: epoch %" PRIu64 " vs %lu\n", Return_Epoch(), (unsigned long)t);
+            return(1);
+        }
+
+    printf("%d iterations,  %d threads,  wall clock ns per iteration\n\n", iterations, threads);
+
+    printf("%-32s %10s %10s\n", "", "1 thread", "threads");
+    printf("%-32s %10.1f %10.1f ns\n", "time/localtime/strftime/atol", Bench_Run(Bench_Old_Epoch, iterations, 1), Bench_Run(Bench_Old_Epoch, iterations, threads));
+    printf("%-32s %10.1f %10.1f ns\n", "Return_Epoch", Bench_Run(Bench_Return_Epoch, iterations, 1), Bench_Run(Bench_Return_Epoch, iterations, threads));
+    printf("%-32s %10.1f %10.1f ns\n", "Check_Time (old)", Bench_Run(Bench_Old_Aetas, iterations, 1), Bench_Run(Bench_Old_Aetas, iterations, threads));
+    printf("%-32s %10.1f %10.1f ns\n", "Return_Local_Time", Bench_Run(Bench_Return_Local_Time, iterations, 1), Bench_Run(Bench_Return_Local_Time, iterations, threads));
+
+    return(0);
+}
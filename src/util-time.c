@@ -22,6 +22,12 @@
  *
  * Time functions.
  *
+ * Most of Sagan only needs the time to the second.  Rather than every
+ * processor thread calling time()/localtime() (localtime() takes a
+ * global lock in glibc) for every event,  Sagan_Clock_Thread() updates
+ * a shared epoch and local "struct tm" once a second.  Return_Epoch()
+ * and Return_Local_Time() hand those out.
+ *
  */
 
 #ifdef HAVE_CONFIG_H
@@ -29,14 +35,29 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
 #include <sys/time.h>
 #include <time.h>
 #include <string.h>
 
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
 #include "sagan.h"
 #include "util-time.h"
 #include "parsers/strstr-asm/strstr-hook.h"
 
+/* The ticker writes the local time into the slot readers aren't using,
+   then flips Clock_Local_Index */
+
+static uint64_t Clock_Epoch = 0;		/* 0 == Sagan_Clock_Thread() isn't running yet */
+static struct tm Clock_Local[2];
+static int Clock_Local_Index = 0;
+
 struct tm *Sagan_LocalTime(time_t timep, struct tm *result)
 {
     return localtime_r(&timep, result);
@@ -92,23 +113,94 @@ void CreateIsoTimeString (const struct timeval *ts, char *str, size_t size)
 }
 
 
-/************************************************
- * Returns current epoch time in uint64_t format
- ************************************************/
+/****************************************************************************
+ * Sagan_Clock_Update - Sets the cached epoch and local time to "now"
+ ****************************************************************************/
+
+void Sagan_Clock_Update( void )
+{
+
+    struct timespec ts;
+    int next = __atomic_load_n(&Clock_Local_Index, __ATOMIC_RELAXED) ^ 1;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    localtime_r(&ts.tv_sec, &Clock_Local[next]);
+
+    __atomic_store_n(&Clock_Local_Index, next, __ATOMIC_RELEASE);
+    __atomic_store_n(&Clock_Epoch, (uint64_t)ts.tv_sec, __ATOMIC_RELEASE);
+
+}
+
+/****************************************************************************
+ * Sagan_Clock_Thread - Updates the cached time just after every second
+ * ticks over.  This thread never exits.
+ ****************************************************************************/
+
+void Sagan_Clock_Thread( void )
+{
+
+    (void)SetThreadName("SaganClock");
+
+    struct timespec ts;
+
+    while (1)
+        {
+
+            Sagan_Clock_Update();
+
+            /* Sleep until the next second */
+
+            clock_gettime(CLOCK_REALTIME, &ts);
+
+            ts.tv_sec = 0;
+            ts.tv_nsec = 1000000000L - ts.tv_nsec;
+
+            nanosleep(&ts, NULL);
+
+        }
+
+}
+
+/****************************************************************************
+ * Return_Epoch - Returns the current epoch from the cached clock.  Before
+ * Sagan_Clock_Thread() is started (config loading,  etc) it falls back to
+ * time().
+ ****************************************************************************/
 
 uint64_t Return_Epoch( void )
+{
+
+    uint64_t epoch = __atomic_load_n(&Clock_Epoch, __ATOMIC_ACQUIRE);
+
+    if ( epoch == 0 )
+        {
+            return( (uint64_t)time(NULL) );
+        }
+
+    return(epoch);
+
+}
+
+/****************************************************************************
+ * Return_Local_Time - Copies the cached local time into "tm".  Like
+ * Return_Epoch(),  falls back to localtime_r() if the clock isn't running.
+ ****************************************************************************/
+
+struct tm *Return_Local_Time( struct tm *tm )
 {
 
     time_t t;
-    struct tm *now;
-    char timet[20] = { 0 };
 
+    if ( __atomic_load_n(&Clock_Epoch, __ATOMIC_ACQUIRE) == 0 )
+        {
+            t = time(NULL);
+            return( localtime_r(&t, tm) );
+        }
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    *tm = Clock_Local[ __atomic_load_n(&Clock_Local_Index, __ATOMIC_ACQUIRE) ];
 
-    return(atol(timet));
+    return(tm);
 
 }
 
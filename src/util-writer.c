@@ -0,0 +1,293 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-writer.c
+ *
+ * Buffered writers for the alert,  fast and EVE files.
+ *
+ * Each output file has one writer.  Output plugins format a whole record
+ * (an alert or an EVE line) on their own stack and hand it to
+ * Sagan_Writer_Write(),  which only holds the writer's lock long enough to
+ * copy it into the buffer.  The buffer is written out when the next record
+ * won't fit (the buffer and that record go out in one writev()) or every
+ * "output-flush-time" milliseconds by Sagan_Writer_Thread().  With
+ * "output-sync" each of those writes is followed by one fdatasync().
+ *
+ * Open_Log_File() detaches the writers before closing the files on a
+ * SIGHUP (logrotate) and attaches them to the new files.  Records that
+ * arrive in between stay in the buffer.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "util-writer.h"
+
+struct _SaganConfig *config;
+
+/****************************************************************************
+ * Sagan_Writer_Attach - Points "writer" at a newly opened "fd".  A NULL
+ * writer is allocated with a "output-buffer-size" buffer.
+ ****************************************************************************/
+
+struct _Sagan_Writer *Sagan_Writer_Attach( struct _Sagan_Writer *writer, int fd, const char *name )
+{
+
+    struct stat st;
+
+    if ( writer == NULL )
+        {
+
+            writer = malloc(sizeof(struct _Sagan_Writer));
+
+            if ( writer == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for writer. Abort!", __FILE__, __LINE__);
+                }
+
+            memset(writer, 0, sizeof(struct _Sagan_Writer));
+
+            writer->size = config->output_buffer_size;
+
+            if ( writer->size > 0 )
+                {
+
+                    writer->buf = malloc(writer->size);
+
+                    if ( writer->buf == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for writer buffer. Abort!", __FILE__, __LINE__);
+                        }
+                }
+
+            pthread_mutex_init(&writer->lock, NULL);
+        }
+
+    pthread_mutex_lock(&writer->lock);
+
+    writer->fd = fd;
+    writer->name = name;
+    writer->is_file = ( fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ) ? true : false;
+
+    pthread_mutex_unlock(&writer->lock);
+
+    return(writer);
+}
+
+/****************************************************************************
+ * Sagan_Writer_Writev - writev() that keeps going after a short write.
+ * Called with the writer locked.
+ ****************************************************************************/
+
+static void Sagan_Writer_Writev( struct _Sagan_Writer *writer, struct iovec *iov, int iovcnt )
+{
+
+    ssize_t n;
+
+    while ( iovcnt > 0 )
+        {
+
+            n = writev(writer->fd, iov, iovcnt);
+
+            if ( n < 0 )
+                {
+
+                    if ( errno == EINTR )
+                        {
+                            continue;
+                        }
+
+                    Sagan_Log(WARN, "[%s, line %d] Cannot write to %s - %s", __FILE__, __LINE__, writer->name, strerror(errno));
+                    return;
+                }
+
+            while ( iovcnt > 0 && (size_t)n >= iov->iov_len )
+                {
+                    n = n - iov->iov_len;
+                    iov++;
+                    iovcnt--;
+                }
+
+            if ( iovcnt > 0 )
+                {
+                    iov->iov_base = (char *)iov->iov_base + n;
+                    iov->iov_len = iov->iov_len - n;
+                }
+        }
+
+    if ( config->output_sync == true && writer->is_file == true )
+        {
+            fdatasync(writer->fd);
+        }
+}
+
+/****************************************************************************
+ * Sagan_Writer_Write - Adds a record.  If it doesn't fit,  the buffer and
+ * the record are written together.
+ ****************************************************************************/
+
+void Sagan_Writer_Write( struct _Sagan_Writer *writer, const char *data, size_t len )
+{
+
+    struct iovec iov[2];
+
+    pthread_mutex_lock(&writer->lock);
+
+    if ( writer->used + len <= writer->size )
+        {
+            memcpy(writer->buf + writer->used, data, len);
+            writer->used = writer->used + len;
+
+            pthread_mutex_unlock(&writer->lock);
+            return;
+        }
+
+    /* Full while the file is being re-opened.  This is only the time it
+       takes Open_Log_File() to open the new file */
+
+    if ( writer->fd == -1 )
+        {
+            pthread_mutex_unlock(&writer->lock);
+            Sagan_Log(WARN, "[%s, line %d] Buffer for %s is full while re-opening. Record dropped.", __FILE__, __LINE__, writer->name);
+            return;
+        }
+
+    iov[0].iov_base = writer->buf;
+    iov[0].iov_len = writer->used;
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = len;
+
+    Sagan_Writer_Writev(writer, iov, 2);
+    writer->used = 0;
+
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/****************************************************************************
+ * Sagan_Writer_Flush - Writes out anything that is buffered
+ ****************************************************************************/
+
+void Sagan_Writer_Flush( struct _Sagan_Writer *writer )
+{
+
+    struct iovec iov[1];
+
+    if ( writer == NULL )
+        {
+            return;
+        }
+
+    pthread_mutex_lock(&writer->lock);
+
+    if ( writer->used > 0 && writer->fd != -1 )
+        {
+
+            iov[0].iov_base = writer->buf;
+            iov[0].iov_len = writer->used;
+
+            Sagan_Writer_Writev(writer, iov, 1);
+            writer->used = 0;
+        }
+
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/****************************************************************************
+ * Sagan_Writer_Detach - Flushes the writer and stops it from writing to
+ * its file.  Called before the file is closed.
+ ****************************************************************************/
+
+void Sagan_Writer_Detach( struct _Sagan_Writer *writer )
+{
+
+    if ( writer == NULL )
+        {
+            return;
+        }
+
+    Sagan_Writer_Flush(writer);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->fd = -1;
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/****************************************************************************
+ * Sagan_Writer_Flush_All - Flushes the alert,  fast and EVE writers
+ ****************************************************************************/
+
+void Sagan_Writer_Flush_All( void )
+{
+
+    Sagan_Writer_Flush(config->sagan_alert_writer);
+    Sagan_Writer_Flush(config->sagan_fast_writer);
+    Sagan_Writer_Flush(config->eve_writer);
+}
+
+/****************************************************************************
+ * Sagan_Writer_Thread - Flushes the writers every "output-flush-time"
+ * milliseconds so records don't sit in a buffer on a quiet sensor.
+ ****************************************************************************/
+
+void Sagan_Writer_Thread( void )
+{
+
+    (void)SetThreadName("SaganWriter");
+
+    struct timespec ts;
+    int flush_time;
+
+    for (;;)
+        {
+
+            /* A reload can set it to 0 (flush only when full) */
+
+            flush_time = config->output_flush_time > 0 ? config->output_flush_time : DEFAULT_OUTPUT_FLUSH_TIME;
+
+            ts.tv_sec = flush_time / 1000;
+            ts.tv_nsec = ( flush_time % 1000 ) * 1000000L;
+
+            nanosleep(&ts, NULL);
+
+            Sagan_Writer_Flush_All();
+        }
+}
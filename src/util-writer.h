@@ -0,0 +1,52 @@
+/*
+** Copyright (C) 2009-2019 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2019 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-writer.h
+ *
+ * Buffered writers for the alert,  fast and EVE files.  See util-writer.c
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+typedef struct _Sagan_Writer _Sagan_Writer;
+struct _Sagan_Writer
+{
+
+    pthread_mutex_t lock;
+
+    int fd;				/* -1 while the file is being re-opened */
+    bool is_file;			/* fdatasync() only applies to files */
+    const char *name;			/* For warnings */
+
+    char *buf;
+    size_t size;			/* 0 == every record is written right away */
+    size_t used;
+
+};
+
+struct _Sagan_Writer *Sagan_Writer_Attach( struct _Sagan_Writer *, int, const char * );
+void Sagan_Writer_Detach( struct _Sagan_Writer * );
+void Sagan_Writer_Write( struct _Sagan_Writer *, const char *, size_t );
+void Sagan_Writer_Flush( struct _Sagan_Writer * );
+void Sagan_Writer_Flush_All( void );
+void Sagan_Writer_Thread( void );
@@ -54,6 +54,8 @@
 #include "sagan-defs.h"
 #include "sagan-config.h"
 #include "lockfile.h"
+#include "util-time.h"
+#include "util-writer.h"
 
 #include "parsers/strstr-asm/strstr-hook.h"
 
@@ -217,11 +219,9 @@ void Sagan_Log (int type, const char *format,... )
     va_start(ap, format);
     char *chr="*";
     char curtime[64];
-    time_t t;
-    struct tm *now;
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  now);
+    struct tm now;
+    Return_Local_Time(&now);
+    strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  &now);
 
     if ( type == ERROR )
         {
@@ -1101,16 +1101,19 @@ void Open_Log_File( bool state, int type )
 
             if ( state == REOPEN && config->eve_flag == true )
                 {
+                    Sagan_Writer_Detach(config->eve_writer);
                     CloseStream(config->eve_stream, &config->eve_fd);
                 }
 
             if ( state == REOPEN && config->alert_flag == true )
                 {
+                    Sagan_Writer_Detach(config->sagan_alert_writer);
                     CloseStream(config->sagan_alert_stream, &config->sagan_alert_fd);
                 }
 
             if ( state == REOPEN && config->fast_flag == true )
                 {
+                    Sagan_Writer_Detach(config->sagan_fast_writer);
                     CloseStream(config->sagan_fast_stream, &config->sagan_fast_fd);
                 }
 
@@ -1124,7 +1127,7 @@ void Open_Log_File( bool state, int type )
                         }
 
                     config->eve_stream_status = true;
-
+                    config->eve_writer = Sagan_Writer_Attach(config->eve_writer, fileno(config->eve_stream), config->eve_filename);
 
                 }
             if ( config->fast_flag )
@@ -1137,6 +1140,7 @@ void Open_Log_File( bool state, int type )
                         }
 
                     config->sagan_fast_stream_status = true;
+                    config->sagan_fast_writer = Sagan_Writer_Attach(config->sagan_fast_writer, fileno(config->sagan_fast_stream), config->fast_filename);
 
                 }
 
@@ -1151,6 +1155,7 @@ void Open_Log_File( bool state, int type )
                         }
 
                     config->sagan_alert_stream_status = true;
+                    config->sagan_alert_writer = Sagan_Writer_Attach(config->sagan_alert_writer, fileno(config->sagan_alert_stream), config->sagan_alert_filepath);
 
                 }
         }
@@ -1163,10 +1168,9 @@ void Open_Log_File( bool state, int type )
 
 #if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
 
-void Set_Pipe_Size ( FILE *fd )
+void Set_Pipe_Size ( int fd_int )
 {
 
-    int fd_int;
     int current_fifo_size;
     int fd_results;
 
@@ -1174,7 +1178,6 @@ void Set_Pipe_Size ( FILE *fd )
     if ( config->sagan_fifo_size != 0 )
         {
 
-            fd_int = fileno(fd);
             current_fifo_size = fcntl(fd_int, F_GETPIPE_SZ);
 
             if ( current_fifo_size == config->sagan_fifo_size )
@@ -1211,14 +1214,35 @@ void Set_Pipe_Size ( FILE *fd )
  ****************************************************************************/
 
 bool File_Lock ( int fd )
+{
+    return(File_Lock_Range(fd, 0, 0));
+}
+
+/****************************************************************************
+ * File_Unlock - Takes in a file descriptor and "unlocks" the file.
+ * Used with IPC/memory mapped files.
+ ****************************************************************************/
+
+bool File_Unlock( int fd )
+{
+    return(File_Unlock_Range(fd, 0, 0));
+}
+
+/****************************************************************************
+ * File_Lock_Range - Locks "len" bytes of a file starting at "start" (a
+ * "len" of 0 is to the end of the file).  Used for striped locks on IPC/
+ * memory mapped files.
+ ****************************************************************************/
+
+bool File_Lock_Range ( int fd, off_t start, off_t len )
 {
 
     struct flock fl;
 
     fl.l_type = F_WRLCK;
     fl.l_whence = SEEK_SET;
-    fl.l_start = 0;
-    fl.l_len = 0;
+    fl.l_start = start;
+    fl.l_len = len;
     fl.l_pid = getpid();
 
     if (fcntl(fd, F_SETLKW, &fl) == -1)
@@ -1230,19 +1254,18 @@ bool File_Lock ( int fd )
 }
 
 /****************************************************************************
- * File_Unlock - Takes in a file descriptor and "unlocks" the file.
- * Used with IPC/memory mapped files.
+ * File_Unlock_Range - Unlocks a range locked by File_Lock_Range()
  ****************************************************************************/
 
-bool File_Unlock( int fd )
+bool File_Unlock_Range( int fd, off_t start, off_t len )
 {
 
     struct flock fl;
 
     fl.l_type = F_UNLCK;
     fl.l_whence = SEEK_SET;
-    fl.l_start = 0;
-    fl.l_len = 0;
+    fl.l_start = start;
+    fl.l_len = len;
     fl.l_pid = getpid();
 
     if (fcntl(fd, F_SETLK, &fl) == -1)
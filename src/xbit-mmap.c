@@ -31,6 +31,7 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <sys/mman.h>
+#include <inttypes.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -50,7 +51,75 @@ struct _SaganConfig *config;
 struct _Sagan_IPC_Counters *counters_ipc;
 struct _Sagan_IPC_Xbit *Xbit_IPC;
 
-pthread_mutex_t Xbit_Mutex=PTHREAD_MUTEX_INITIALIZER;
+struct _IPC_Hash_Stripes Xbit_Stripes;
+
+/* xbits are keyed on the xbit name hash and the tracking (IP) hash.  See
+ * ipc.h for how the shared hash tables work. */
+
+static uint32_t Xbit_MMAP_Home( uint32_t xbit_name_hash, uint32_t xbit_hash )
+{
+    return( IPC_Hash_Home( ( xbit_name_hash * 0x9E3779B1 ) ^ xbit_hash, IPC_Hash_Slots(config->max_xbits) ) );
+}
+
+static void Xbit_MMAP_Lock( uint32_t home )
+{
+    IPC_Hash_Lock(&Xbit_Stripes, config->shm_xbit, IPC_Hash_Slots(config->max_xbits), home);
+}
+
+static void Xbit_MMAP_Unlock( uint32_t home )
+{
+    IPC_Hash_Unlock(&Xbit_Stripes, config->shm_xbit, IPC_Hash_Slots(config->max_xbits), home);
+}
+
+/****************************************************************************/
+/* Xbit_MMAP_Find - Returns the slot holding the xbit or -1.  If "reuse" is */
+/* not NULL,  it's set to the first slot a new xbit could use (or -1).      */
+/* Must be called with the stripe(s) locked.                                */
+/****************************************************************************/
+
+static int Xbit_MMAP_Find( uint32_t home, uint32_t xbit_name_hash, uint32_t xbit_hash, uint64_t now, int *reuse )
+{
+
+    uint32_t slots = IPC_Hash_Slots(config->max_xbits);
+    uint32_t x;
+    uint32_t i;
+
+    if ( reuse != NULL )
+        {
+            *reuse = -1;
+        }
+
+    for ( i = 0; i < IPC_HASH_PROBE && i < slots; i++ )
+        {
+
+            x = ( home + i ) % slots;
+
+            /* Never used,  nothing past here */
+
+            if ( Xbit_IPC[x].xbit_used == false )
+                {
+
+                    if ( reuse != NULL && *reuse == -1 )
+                        {
+                            *reuse = x;
+                        }
+
+                    return(-1);
+                }
+
+            if ( Xbit_IPC[x].xbit_name_hash == xbit_name_hash && Xbit_IPC[x].xbit_hash == xbit_hash )
+                {
+                    return(x);
+                }
+
+            if ( reuse != NULL && *reuse == -1 && ( Xbit_IPC[x].xbit_expire == 0 || Xbit_IPC[x].xbit_expire <= now ) )
+                {
+                    *reuse = x;
+                }
+        }
+
+    return(-1);
+}
 
 /*************************************************/
 /* Xbit_Set_MMAP - Used to "set", "unset" a xbit */
@@ -61,116 +130,137 @@ void Xbit_Set_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char, char
 
     int r = 0;
     int x = 0;
+    int reuse = 0;
 
-    bool xbit_match = false;
     uint32_t hash;
+    uint32_t home;
+    uint64_t now = Return_Epoch();
 
-    if ( Clean_IPC_Object(XBIT) == 0 )
+    for (r = 0; r < rulestruct[rule_position].xbit_count; r++)
         {
 
-            for (r = 0; r < rulestruct[rule_position].xbit_count; r++)
+            if ( rulestruct[rule_position].xbit_type[r] == XBIT_SET )
                 {
 
-                    if ( rulestruct[rule_position].xbit_type[r] == XBIT_SET )
-                        {
+                    hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
+                    home = Xbit_MMAP_Home( rulestruct[rule_position].xbit_name_hash[r], hash );
 
-                            hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
+                    Xbit_MMAP_Lock(home);
 
-                            xbit_match = false;
+                    x = Xbit_MMAP_Find( home, rulestruct[rule_position].xbit_name_hash[r], hash, now, &reuse );
 
-                            for ( x = 0; x < counters_ipc->xbit_count; x++ )
-                                {
+                    if ( x != -1 )
+                        {
 
-                                    if ( hash == Xbit_IPC[x].xbit_hash && rulestruct[rule_position].xbit_name_hash[r] == Xbit_IPC[x].xbit_name_hash )
-                                        {
+                            if ( debug->debugxbit )
+                                {
+                                    Sagan_Log(DEBUG, "[%s, line %d] Got an xbit match at %d.  Updating xbit '%s' [hash: %u]", __FILE__, __LINE__, x, Xbit_IPC[x].xbit_name, Xbit_IPC[x].xbit_hash);
+                                }
+                        }
 
-                                            if ( debug->debugxbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Got an xbit match at %d.  Updating xbit '%s' [hash: %u]", __FILE__, __LINE__, x, Xbit_IPC[x].xbit_name, Xbit_IPC[x].xbit_hash);
-                                                }
+                    /* No xbit to update, add one */
 
-                                            xbit_match = true;
+                    else if ( reuse != -1 )
+                        {
 
-                                            File_Lock(config->shm_xbit);
-                                            pthread_mutex_lock(&Xbit_Mutex);
+                            x = reuse;
 
-                                            strlcpy(Xbit_IPC[x].syslog_message, syslog_message, sizeof(Xbit_IPC[x].syslog_message));
-                                            strlcpy(Xbit_IPC[x].signature_msg, rulestruct[rule_position].s_msg, sizeof(Xbit_IPC[x].signature_msg));
-                                            Xbit_IPC[x].xbit_expire = Return_Epoch() + rulestruct[rule_position].xbit_expire[r];
-                                            Xbit_IPC[x].expire = rulestruct[rule_position].xbit_expire[r];
-                                            Xbit_IPC[x].sid = rulestruct[rule_position].s_sid;
-                                            Xbit_IPC[x].xbit_hash = hash;
-                                            Xbit_IPC[x].xbit_name_hash = rulestruct[rule_position].xbit_name_hash[r];
-                                            File_Unlock(config->shm_xbit);
-                                            pthread_mutex_unlock(&Xbit_Mutex);
+                            if ( Xbit_IPC[x].xbit_used == false )
+                                {
+                                    Xbit_IPC[x].xbit_used = true;
+                                    __atomic_add_fetch(&counters_ipc->xbit_count, 1, __ATOMIC_SEQ_CST);
+                                }
 
-                                        }
+                            strlcpy(Xbit_IPC[x].xbit_name, rulestruct[rule_position].xbit_name[r], sizeof(Xbit_IPC[x].xbit_name));
+                            Xbit_IPC[x].xbit_hash = hash;
+                            Xbit_IPC[x].xbit_name_hash = rulestruct[rule_position].xbit_name_hash[r];
 
+                            if ( debug->debugxbit )
+                                {
+                                    Sagan_Log(DEBUG, "[%s, line %d] Adding xbit '%s' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
                                 }
+                        }
 
+                    else
+                        {
 
-                            /* No xbit to update, add one */
+                            Xbit_MMAP_Unlock(home);
 
-                            if ( xbit_match == false )
-                                {
+                            Sagan_Log(WARN, "[%s, line %d] No free xbit slot for '%s'.  Consider raising sagan-core|mmap-ipc 'xbit' (currently %d).", __FILE__, __LINE__, rulestruct[rule_position].xbit_name[r], config->max_xbits);
+                            continue;
+                        }
 
-                                    File_Lock(config->shm_xbit);
-                                    pthread_mutex_lock(&Xbit_Mutex);
+                    /* The stored message is only informational (saganpeek),  so it's truncated */
 
-                                    strlcpy(Xbit_IPC[counters_ipc->xbit_count].xbit_name, rulestruct[rule_position].xbit_name[r], sizeof(Xbit_IPC[counters_ipc->xbit_count].xbit_name));
-                                    strlcpy(Xbit_IPC[counters_ipc->xbit_count].syslog_message, syslog_message, sizeof(Xbit_IPC[counters_ipc->xbit_count].syslog_message));
-                                    strlcpy(Xbit_IPC[counters_ipc->xbit_count].signature_msg, rulestruct[rule_position].s_msg, sizeof(Xbit_IPC[counters_ipc->xbit_count].signature_msg));
+                    strlcpy(Xbit_IPC[x].syslog_message, syslog_message, sizeof(Xbit_IPC[x].syslog_message));
+                    strlcpy(Xbit_IPC[x].signature_msg, rulestruct[rule_position].s_msg, sizeof(Xbit_IPC[x].signature_msg));
+                    Xbit_IPC[x].xbit_expire = now + rulestruct[rule_position].xbit_expire[r];
+                    Xbit_IPC[x].expire = rulestruct[rule_position].xbit_expire[r];
+                    Xbit_IPC[x].sid = rulestruct[rule_position].s_sid;
 
-                                    Xbit_IPC[counters_ipc->xbit_count].xbit_expire = Return_Epoch() + rulestruct[rule_position].xbit_expire[r];
-                                    Xbit_IPC[x].expire = rulestruct[rule_position].xbit_expire[r];
-                                    Xbit_IPC[counters_ipc->xbit_count].sid = rulestruct[rule_position].s_sid;
-                                    Xbit_IPC[counters_ipc->xbit_count].xbit_hash = hash;
-                                    Xbit_IPC[counters_ipc->xbit_count].xbit_name_hash = rulestruct[rule_position].xbit_name_hash[r];
+                    Xbit_MMAP_Unlock(home);
 
-                                    if ( debug->debugxbit )
-                                        {
-                                            Sagan_Log(DEBUG, "[%s, line %d] Adding xbit '%s' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
-                                        }
+                }
 
-                                    counters_ipc->xbit_count++;
+            /* UNSET */
 
-                                    pthread_mutex_unlock(&Xbit_Mutex);
-                                    File_Unlock(config->shm_xbit);
+            else if ( rulestruct[rule_position].xbit_type[r] == XBIT_UNSET )
+                {
 
-                                }
+                    hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
+                    home = Xbit_MMAP_Home( rulestruct[rule_position].xbit_name_hash[r], hash );
 
-                        }
+                    Xbit_MMAP_Lock(home);
 
-                    /* UNSET */
+                    x = Xbit_MMAP_Find( home, rulestruct[rule_position].xbit_name_hash[r], hash, now, NULL );
 
-                    else if ( rulestruct[rule_position].xbit_type[r] == XBIT_UNSET )
+                    if ( x != -1 )
                         {
 
-                            hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
+                            if ( debug->debugxbit )
+                                {
+                                    Sagan_Log(DEBUG, "[%s, line %d] Unsetting xbit '%s' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
+                                }
 
-                            xbit_match = false;
+                            Xbit_IPC[x].xbit_expire = 0;
+                        }
 
-                            for ( x = 0; x < counters_ipc->xbit_count; x++ )
-                                {
+                    Xbit_MMAP_Unlock(home);
+
+                }
+
+        } /* for (r = 0; r < rulestruct[rule_position].xbit_count; r++) */
+}
 
-                                    if ( hash == Xbit_IPC[x].xbit_hash && rulestruct[rule_position].xbit_name_hash[r] == Xbit_IPC[x].xbit_name_hash )
-                                        {
+/****************************************************************************/
+/* Xbit_MMAP_Active - Is the xbit set and not expired?                      */
+/****************************************************************************/
 
-                                            if ( debug->debugxbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Unsetting xbit '%s' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
-                                                }
+static bool Xbit_MMAP_Active( int rule_position, int r, uint32_t hash, uint64_t now )
+{
 
-                                            Xbit_IPC[x].xbit_expire = 0;
+    uint32_t home = Xbit_MMAP_Home( rulestruct[rule_position].xbit_name_hash[r], hash );
+    bool active = false;
+    int x;
 
-                                        }
+    Xbit_MMAP_Lock(home);
 
-                                }
+    x = Xbit_MMAP_Find( home, rulestruct[rule_position].xbit_name_hash[r], hash, now, NULL );
 
-                        }
+    if ( x != -1 && Xbit_IPC[x].xbit_expire != 0 && now < Xbit_IPC[x].xbit_expire )
+        {
+
+            if ( debug->debugxbit )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' found at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
+                }
 
-                } /* for (r = 0; r < rulestruct[rule_position].xbit_count; r++) */
+            active = true;
         }
+
+    Xbit_MMAP_Unlock(home);
+
+    return(active);
 }
 
 /**********************************************************/
@@ -181,13 +271,11 @@ bool Xbit_Condition_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char
 {
 
     int r = 0;
-    int x = 0;
     int xbit_isset = 0;
     int xbit_isnotset = 0;
 
-    bool xbit_match = false;
-
     uint32_t hash;
+    uint64_t now = Return_Epoch();
 
     for (r = 0; r < rulestruct[rule_position].xbit_count; r++)
         {
@@ -197,27 +285,9 @@ bool Xbit_Condition_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char
 
                     hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
 
-                    for ( x = 0; x < counters_ipc->xbit_count; x++ )
+                    if ( Xbit_MMAP_Active( rule_position, r, hash, now ) == true )
                         {
-
-                            if ( hash == Xbit_IPC[x].xbit_hash &&
-                                    rulestruct[rule_position].xbit_name_hash[r] == Xbit_IPC[x].xbit_name_hash &&
-                                    Xbit_IPC[x].xbit_expire != 0 )
-                                {
-
-                                    if ( Return_Epoch() < Xbit_IPC[x].xbit_expire )
-                                        {
-
-                                            if ( debug->debugxbit )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] Xbit '%s' found for 'isset' at %d [hash: %u]", __FILE__, __LINE__, Xbit_IPC[x].xbit_name, x, Xbit_IPC[x].xbit_hash);
-                                                }
-
-                                            xbit_isset++;
-                                            break;
-
-                                        }
-                                }
+                            xbit_isset++;
                         }
                 }
 
@@ -226,23 +296,7 @@ bool Xbit_Condition_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char
 
                     hash = Xbit_Return_Tracking_Hash( rule_position, r, ip_src_char, ip_dst_char );
 
-                    for ( x = 0; x < counters_ipc->xbit_count; x++ )
-                        {
-
-                            if ( hash == Xbit_IPC[x].xbit_hash &&
-                                    rulestruct[rule_position].xbit_name_hash[r] == Xbit_IPC[x].xbit_name_hash &&
-                                    Xbit_IPC[x].xbit_expire != 0 )
-                                {
-                                    if ( Return_Epoch() < Xbit_IPC[x].xbit_expire )
-                                        {
-
-                                            xbit_match = true;
-                                            break;
-                                        }
-                                }
-                        }
-
-                    if ( xbit_match == false )
+                    if ( Xbit_MMAP_Active( rule_position, r, hash, now ) == false )
                         {
 
                             if ( debug->debugxbit )
@@ -278,4 +332,3 @@ bool Xbit_Condition_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char
     return(false);
 
 }
-
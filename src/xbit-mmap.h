@@ -22,17 +22,17 @@
 
 void Xbit_Set_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char, char *syslog_message );
 bool Xbit_Condition_MMAP(int rule_position, char *ip_src_char, char *ip_dst_char);
-void Clean_Xbit_MMAP(void);
 
 typedef struct _Sagan_IPC_Xbit _Sagan_IPC_Xbit;
 struct _Sagan_IPC_Xbit
 {
+    bool xbit_used;				/* Slot has held an xbit (never reset) */
     char xbit_name[64];
     uint32_t xbit_hash;
     uint32_t xbit_name_hash;
     uint64_t xbit_expire;
     int expire;
-    char syslog_message[MAX_SYSLOGMSG];
+    char syslog_message[MAX_IPC_SYSLOGMSG];	/* Truncated copy for saganpeek */
     uint64_t sid;
     char signature_msg[MAX_SAGAN_MSG];
 
@@ -41,10 +41,10 @@
 #include "rules.h"
 #include "redis.h"
 #include "sagan-config.h"
+#include "util-counters.h"
 
 #define 	REDIS_PREFIX	"sagan"
 
-struct _SaganCounters *counters;
 struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
@@ -156,7 +156,7 @@ void Xbit_Set_Redis(int rule_position, char *ip_src_char, char *ip_dst_char, _Sa
                     else
                         {
                             Sagan_Log(WARN, "[%s, line %d] Out of Redis 'writer' threads for 'set'.  Skipping!", __FILE__, __LINE__);
-                            __atomic_add_fetch(&counters->redis_writer_threads_drop, 1, __ATOMIC_SEQ_CST);
+                            Sagan_Counter_Add(redis_writer_threads_drop, 1);
                         }
 
                 }
@@ -189,7 +189,7 @@ void Xbit_Set_Redis(int rule_position, char *ip_src_char, char *ip_dst_char, _Sa
                     else
                         {
                             Sagan_Log(WARN, "[%s, line %d] Out of Redis 'writer' threads for 'set'.  Skipping!", __FILE__, __LINE__);
-                            __atomic_add_fetch(&counters->redis_writer_threads_drop, 1, __ATOMIC_SEQ_CST);
+                            Sagan_Counter_Add(redis_writer_threads_drop, 1);
                         }
                 }
         }
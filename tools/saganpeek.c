@@ -143,6 +143,10 @@ int main(int argc, char **argv)
     struct _Sagan_IPC_Counters *counters_ipc;
     struct _Sagan_IPC_Flexbit *flexbit_ipc;
     struct _Sagan_IPC_Xbit *xbit_ipc;
+    struct stat xbit_stat;
+    int xbit_slots = 0;
+    struct stat hash_stat;
+    int hash_slots = 0;
     struct _Sagan_Track_Clients_IPC *SaganTrackClients_ipc;
     struct _After2_IPC *After2_IPC;
     struct _Threshold2_IPC *Threshold2_IPC;
@@ -164,6 +168,8 @@ int main(int argc, char **argv)
     uint64_t thresh_oldtime;
     uint64_t after_oldtime;
     uint64_t flexbit_oldtime;
+    char flexbit_src[MAXIP] = { 0 };
+    char flexbit_dst[MAXIP] = { 0 };
 
     /* For convert to IP string */
 
@@ -309,21 +315,34 @@ int main(int argc, char **argv)
                     exit(1);
                 }
 
-            if (( Threshold2_IPC = mmap(0, sizeof(_Threshold2_IPC) + (sizeof(_Threshold2_IPC) * counters_ipc->thresh2_count ) , PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
+            /* Stored in a hash table,  so walk every slot */
+
+            if ( fstat(shm, &hash_stat) == -1 )
                 {
-                    fprintf(stderr, "[%s, line %d] Error allocating memory object! [%s]\n", __FILE__, __LINE__, strerror(errno));
+                    fprintf(stderr, "[%s, line %d] Cannot fstat() (%s)\n", __FILE__, __LINE__, strerror(errno));
                     exit(1);
                 }
 
-            close(shm);
+            hash_slots = hash_stat.st_size / sizeof(_Threshold2_IPC);
 
-            if ( counters_ipc->thresh2_count >= 1 )
+            if ( hash_slots > 0 )
                 {
 
+                    if (( Threshold2_IPC = mmap(0, sizeof(_Threshold2_IPC) * hash_slots, PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
+                        {
+                            fprintf(stderr, "[%s, line %d] Error allocating memory object! [%s]\n", __FILE__, __LINE__, strerror(errno));
+                            exit(1);
+                        }
+
 
-                    for ( i = 0; i < counters_ipc->thresh2_count; i++)
+                    for ( i = 0; i < hash_slots; i++)
                         {
 
+                            if ( Threshold2_IPC[i].used == false )
+                                {
+                                    continue;
+                                }
+
                             thresh_oldtime = current_time - Threshold2_IPC[i].utime;
 
                             /* Show only active threshold unless told otherwise */
@@ -406,6 +425,8 @@ int main(int argc, char **argv)
 
                         }
                 }
+
+            close(shm);
         }
 
 
@@ -430,20 +451,33 @@ int main(int argc, char **argv)
                     exit(1);
                 }
 
-            if (( After2_IPC = mmap(0, sizeof(_After2_IPC) + (sizeof(_After2_IPC) * counters_ipc->after2_count ) , PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
+            /* Stored in a hash table,  so walk every slot */
+
+            if ( fstat(shm, &hash_stat) == -1 )
                 {
-                    fprintf(stderr, "[%s, line %d] Error allocating memory object! [%s]\n", __FILE__, __LINE__, strerror(errno));
+                    fprintf(stderr, "[%s, line %d] Cannot fstat() (%s)\n", __FILE__, __LINE__, strerror(errno));
                     exit(1);
                 }
 
-            close(shm);
+            hash_slots = hash_stat.st_size / sizeof(_After2_IPC);
 
-            if ( counters_ipc->after2_count >= 1 )
+            if ( hash_slots > 0 )
                 {
 
-                    for ( i = 0; i < counters_ipc->after2_count; i++)
+                    if (( After2_IPC = mmap(0, sizeof(_After2_IPC) * hash_slots, PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
+                        {
+                            fprintf(stderr, "[%s, line %d] Error allocating memory object! [%s]\n", __FILE__, __LINE__, strerror(errno));
+                            exit(1);
+                        }
+
+                    for ( i = 0; i < hash_slots; i++)
                         {
 
+                            if ( After2_IPC[i].used == false )
+                                {
+                                    continue;
+                                }
+
                             after_oldtime = current_time - After2_IPC[i].utime;
 
                             /* Show only active after unless told otherwise */
@@ -526,6 +560,8 @@ int main(int argc, char **argv)
 
                         }
                 }
+
+            close(shm);
         }
 
     /*** Get "flexbit" data ***/
@@ -563,7 +599,12 @@ int main(int argc, char **argv)
                     for (i= 0; i < counters_ipc->flexbit_count; i++ )
                         {
 
-                            if ( flexbit_ipc[i].flexbit_state == 1 || all_flag == true )
+                            if ( flexbit_ipc[i].flexbit_used == false )
+                                {
+                                    continue;
+                                }
+
+                            if ( ( flexbit_ipc[i].flexbit_state == 1 && flexbit_ipc[i].flexbit_expire > current_time ) || all_flag == true )
                                 {
 
                                     u32_Time_To_Human(flexbit_ipc[i].flexbit_expire, time_buf, sizeof(time_buf));
@@ -572,8 +613,8 @@ int main(int argc, char **argv)
                                     printf("Type: flexbit [%d].\n", i);
 
                                     printf("Xbit name: \"%s\"\n", flexbit_ipc[i].flexbit_name);
-                                    printf("State: %s\n", flexbit_ipc[i].flexbit_state == 1 ? "ACTIVE" : "INACTIVE");
-                                    printf("IP: %s:%d -> %s:%d\n", flexbit_ipc[i].ip_src, flexbit_ipc[i].src_port, flexbit_ipc[i].ip_dst, flexbit_ipc[i].dst_port);
+                                    printf("State: %s\n", flexbit_ipc[i].flexbit_state == 1 && flexbit_ipc[i].flexbit_expire > current_time ? "ACTIVE" : "INACTIVE");
+                                    printf("IP: %s:%d -> %s:%d\n", Bit2IP(flexbit_ipc[i].ip_src, flexbit_src, sizeof(flexbit_src)), flexbit_ipc[i].src_port, Bit2IP(flexbit_ipc[i].ip_dst, flexbit_dst, sizeof(flexbit_dst)), flexbit_ipc[i].dst_port);
                                     printf("Signature: \"%s\" (Signature ID: %" PRIu64 ")\n", flexbit_ipc[i].signature_msg, flexbit_ipc[i].sid);
                                     printf("Expire Time: %s (%d seconds)\n", time_buf, flexbit_ipc[i].expire);
                                     printf("Time until expire: %" PRIi64 " seconds.\n", flexbit_oldtime);
@@ -611,30 +652,43 @@ int main(int argc, char **argv)
                             exit(1);
                         }
 
-                    if (( xbit_ipc = mmap(0, sizeof(_Sagan_IPC_Xbit) + (sizeof(_Sagan_IPC_Xbit) * counters_ipc->xbit_count ) , PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
+                    /* xbits are stored in a hash table,  so walk every slot */
+
+                    if ( fstat(shm, &xbit_stat) == -1 )
                         {
-                            fprintf(stderr, "[%s, line %d] Error allocating memory object! [%s]\n", __FILE__, __LINE__, strerror(errno));
+                            fprintf(stderr, "[%s, line %d] Cannot fstat() (%s)\n", __FILE__, __LINE__, strerror(errno));
                             exit(1);
                         }
 
-                    close(shm);
+                    xbit_slots = xbit_stat.st_size / sizeof(_Sagan_IPC_Xbit);
 
-                    if ( counters_ipc->xbit_count >= 1 )
+                    if ( xbit_slots > 0 )
                         {
 
-                            for (i= 0; i < counters_ipc->xbit_count; i++ )
+                            if (( xbit_ipc = mmap(0, sizeof(_Sagan_IPC_Xbit) * xbit_slots, PROT_READ, MAP_SHARED, shm, 0)) == MAP_FAILED )
+                                {
+                                    fprintf(stderr, "[%s, line %d] Error allocating memory object! [%s]\n", __FILE__, __LINE__, strerror(errno));
+                                    exit(1);
+                                }
+
+                            for (i= 0; i < xbit_slots; i++ )
                                 {
 
+                                    if ( xbit_ipc[i].xbit_used == false )
+                                        {
+                                            continue;
+                                        }
+
                                     u32_Time_To_Human(xbit_ipc[i].xbit_expire, time_buf, sizeof(time_buf));
 
-                                    if ( all_flag == true || ( xbit_ipc[i].xbit_expire != 0 && xbit_ipc[i].xbit_expire <= current_time ) )
+                                    if ( all_flag == true || ( xbit_ipc[i].xbit_expire != 0 && xbit_ipc[i].xbit_expire > current_time ) )
                                         {
 
                                             printf("Type: xbit [%d].\n", i);
                                             printf("Xbit name: \"%s\" (Hash name: %u)\n", xbit_ipc[i].xbit_name, xbit_ipc[i].xbit_name_hash);
                                             printf("State: ");
 
-                                            if (  xbit_ipc[i].xbit_expire != 0 && xbit_ipc[i].xbit_expire <= current_time )
+                                            if (  xbit_ipc[i].xbit_expire != 0 && xbit_ipc[i].xbit_expire > current_time )
                                                 {
                                                     printf("Active\n");
                                                 }
@@ -663,6 +717,8 @@ int main(int argc, char **argv)
 
                                 }
                         }
+
+                    close(shm);
                 }
         }
 